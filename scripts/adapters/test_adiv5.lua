@@ -50,6 +50,15 @@ apAHB:Memory32(GPIOE_BASE, 0x150)   -- MODE
 apAHB:Memory32(GPIOE_BASE+0x4, 0x0) -- OTYPE
 apAHB:Memory32(GPIOE_BASE+0x8, 0x0) -- OSPEED
 apAHB:Memory32(GPIOE_BASE+0xC, 0x2A0)   -- PUPDR
+-- 批量写入同样的值,一次提交
+apAHB:WriteMany({
+    {GPIOE_BASE, 0x150},    -- MODE
+    {GPIOE_BASE+0x4, 0x0},  -- OTYPE
+    {GPIOE_BASE+0x8, 0x0},  -- OSPEED
+    {GPIOE_BASE+0xC, 0x2A0},    -- PUPDR
+})
+local gpioe = apAHB:ReadMany({GPIOE_BASE, GPIOE_BASE+0x4, GPIOE_BASE+0x8, GPIOE_BASE+0xC})
+print(string.format("GPIOE MODE: 0x%X, OTYPE: 0x%X, OSPEED: 0x%X, PUPDR: 0x%X", table.unpack(gpioe)))
 
 -- PE2 = 1
 apAHB:Memory32(GPIOE_BASE+0x18, 0x4 << 16)
@@ -0,0 +1,47 @@
+--[[
+    PC采样分析
+    采样线程不停地读取核心的PC采样寄存器,按函数统计目标在哪里花时间,不需要停止核心
+]]
+local profiler = require("Profiler")
+
+-- 采样ms毫秒,打印最热的top个函数,outPath不为nil时导出flamegraph.pl的折叠栈文件
+-- cores:{ {apObj, "dwt"}, {apbAp, "edpcsr64", 0x80410000}, ... }
+function ProfileCores(cores, elfPath, ms, top, outPath)
+	local prof = profiler.New()
+	for _, core in ipairs(cores) do
+		prof:AddCore(core[1], core[2], core[3])
+	end
+	prof:Start(ms or 1000)
+	prof:Wait()
+	local stats = prof:Stats()
+	print(string.format("%d samples in %.2fs (%.0f/s), %d invalid, %d errors",
+		stats.samples, stats.elapsed, stats.rate, stats.invalid, stats.errors))
+	-- 同一函数的不同PC合并
+	local funcs, order = {}, {}
+	for _, hit in ipairs(prof:Hits(elfPath)) do
+		-- 和导出文件一样从core0开始编号
+		local name = string.format("core%d:%s", hit.core - 1, hit.func or string.format("0x%08X", hit.pc))
+		if not funcs[name] then
+			funcs[name] = 0
+			order[#order + 1] = name
+		end
+		funcs[name] = funcs[name] + hit.count
+	end
+	table.sort(order, function(a, b) return funcs[a] > funcs[b] end)
+	for i = 1, math.min(top or 20, #order) do
+		print(string.format("%6.2f%%  %s", funcs[order[i]] * 100 / stats.samples, order[i]))
+	end
+	if outPath then
+		prof:Export(outPath, "folded", elfPath)
+	end
+	return prof
+end
+
+--[[
+    用法:
+    dofile("scripts/adapters/cmsis_dap.lua")
+    dap = adiv5.Create(cmObj)
+    ap = dap:FindAccessPort(adiv5.AP_Memory, adiv5.Bus_AMBA_AHB)
+    ProfileCores({{ap, "dwt"}}, "firmware.elf", 2000, 20, "firmware.folded")
+    -- flamegraph.pl firmware.folded > firmware.svg
+]]
@@ -1,7 +1,6 @@
 --[[
     遍历ROM Table
 ]]
-local dap = require("DAP")  -- 加载DAP库
 local dap_infos = {
     { 0x4BB, 0x000, "Cortex-M3 SCS",              "(System Control Space)", },
 	{ 0x4BB, 0x001, "Cortex-M3 ITM",              "(Instrumentation Trace Module)", },
@@ -99,25 +98,28 @@ local dap_infos = {
 }
 
 -- 打印ROM Table
-function DisplayROMTable(adapter, addr, depth)
-	-- 获得对齐后的地址
-    local base_addr = addr & 0xFFFFF000
-    -- 读取pid和cid
-    local cid, pid = dap.Get_CID_PID(adapter, base_addr)
-    if (cid & 0xFFFF0FFF) ~= 0xB105000D then
+-- dap:DAP对象, ap:MEM-AP对象
+-- ROM Table由C代码一次性遍历(按层批量读取并缓存),这里只负责显示
+function DisplayROMTable(dap, ap)
+    DisplayComponent(dap:ReadRomTable(ap), 0)
+end
+
+-- 打印组件及其子组件
+function DisplayComponent(comp, depth)
+    local cid, pid = comp.CID, comp.PID
+    if not comp.Valid then
         -- 无效的CID
-        print("Invaild CID:" .. string.format("0x%08X", cid))
-        return 
+        print("Invaild CID:" .. string.format("0x%08X", cid) .. string.format(" at 0x%08X", comp.Base))
+        return
     end
     print(string.format( "\n* Component CID:0x%08X, PID:0x%010X.", cid, pid))
     -- 获得该Component占据的空间大小
-    local occupy_size = (pid >> 36) & 0xF
-    if occupy_size > 0 then 
-        print("Start Address :" .. string.format( "0x%08X", base_addr - 0x1000 * occupy_size))
+    if comp.Size > 0x1000 then
+        print("Start Address :" .. string.format( "0x%08X", comp.Base))
     end
     -- 获得当前Component的类型
-    local compon_type = (cid >> 12) & 0xF
-    local part_num = pid & 0xFFF
+    local compon_type = comp.Class
+    local part_num = comp.PartNumber
     local designer_id = ((pid >> 32) & 0xF) << 8 | ((pid >> 12) & 0xFF)
     -- TODO 判断designer_id是否是JEP106，designer_id & 0x80 == 0x80
     -- 打印组件详细信息
@@ -128,25 +130,16 @@ function DisplayROMTable(adapter, addr, depth)
         end
     end
     if compon_type == 0x1 then    -- ROM Table
-        local mem_type = dap.Memory32(adapter, base_addr + 0xFCC)
-        if mem_type & 0x1 == 0x1 then
+        if comp.DevType & 0x1 == 0x1 then
             print("- MEMTYPE system memory present on bus.")
         else
             print("- MEMTYPE system memory not present: dedicated debug bus.")
         end
-					-- 遍历Table Entry 0xefc
-        for entry_offset = 0,0xF00,4 do
-            local entry = dap.Memory32(adapter, base_addr + entry_offset)
-            if entry & 0x1 == 0x1 then  -- 存在表项
-                print(string.format( "- Next Entry:0x%08X BaseAddr:0x%08X.", entry, (base_addr + (entry & 0xFFFFF000)) & 0xFFFFFFFF))
-                						-- 递归调用
-                DisplayROMTable(adapter, (base_addr + (entry & 0xFFFFF000)) & 0xFFFFFFFF, depth+1)
-            elseif entry == 0 then break end
-        end
-    elseif compon_type == 0x9 then -- CoreSight component
-        local dev_type = dap.Memory32(adapter, base_addr + 0xFCC)
+    end
+    if compon_type == 0x9 then -- CoreSight component
+        local dev_type = comp.DevType
         local minor = (dev_type >> 4) & 0x0F
-        local major_type, sub_type = "other"
+        local major_type, sub_type = "other", "other"
         if dev_type & 0x0F == 0 then
             major_type = "Miscellaneous"
             if minor == 4 then
@@ -221,4 +214,9 @@ function DisplayROMTable(adapter, addr, depth)
         end
         print("- Type is " .. major_type .. " - " .. sub_type)
     end
+    -- ROM Table和带子表的Class 0x9组件(CoreSight ROM Table)都会有子组件
+    for idx,child in ipairs(comp.Children) do
+        print(string.format( "- Next Entry BaseAddr:0x%08X.", child.Base))
+        DisplayComponent(child, depth+1)
+    end
 end
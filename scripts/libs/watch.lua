@@ -0,0 +1,35 @@
+--[[
+    按变量名在后台监视目标变量
+    地址和宽度从ELF的调试信息中查出,采样在C的监视线程中进行,不占用Lua
+]]
+local symbols = require("Symbols")
+local watch = require("Watch")
+
+-- 在MEM-AP上监视ELF中的变量
+-- vars:{ {"g_stats.rx_count", 100}, {"g_state", 10}, ... },每项是变量路径和采样频率(Hz)
+-- 返回监视对象和编号到变量名的表
+function WatchVariables(apObj, elfPath, vars, tickHz)
+	local syms = symbols.Load(elfPath)
+	local w = watch.New(apObj, tickHz or 1000)
+	local names = {}
+	for _, var in ipairs(vars) do
+		local addr, size = syms:Lookup(var[1])
+		assert(addr, "Unknown variable " .. var[1])
+		local id = w:Add(addr, size, var[2], var[1])
+		names[id] = var[1]
+	end
+	return w, names
+end
+
+--[[
+    用法:
+    dofile("scripts/adapters/cmsis_dap.lua")
+    dap = adiv5.Create(cmObj)
+    ap = dap:FindAccessPort(adiv5.AP_Memory, adiv5.Bus_AMBA_AHB)
+    w, names = WatchVariables(ap, "firmware.elf", {{"g_stats.rx_count", 1000}, {"g_state", 10}})
+    w:Log("watch.csv")                      -- 不设置日志时用w:Drain()取回采样
+    w:Start()
+    -- 监视期间不要通过这个Adapter做其他访问
+    w:Stop()
+    for k, v in pairs(w:Stats()) do print(k, v) end
+]]
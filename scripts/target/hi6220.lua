@@ -40,10 +40,12 @@ do
 	if ByteTrans then print("Support Less Word Transfer.") end
 end 
 
-local rom_table_base = dap.GetROMTable(cmsis_dapObj)
-print(string.format("ROM Table Base: 0x%08X", rom_table_base))
-dap.SetCSWReg(cmsis_dapObj, 0xa2000000)	-- 设置CSW，具体参考CoreSight Specs
-DisplayROMTable(cmsis_dapObj, rom_table_base, 0)
+-- ROM Table由ADIv5库遍历,CSW由库自己设置
+local adiv5 = require("ADIv5")
+local dapObj = adiv5.Create(cmsis_dapObj)
+local apAPB = dapObj:FindAccessPort(adiv5.AP_Memory, adiv5.Bus_AMBA_APB)
+print(string.format("ROM Table Base: 0x%08X", apAPB:RomTable()))
+DisplayROMTable(dapObj, apAPB)
 print(string.format("CTRL/STAT:0x%08X", dap.GetCTRL_STATReg(cmsis_dapObj)))
 print("Hello World")
 cmsis_dapObj:SetStatus(adapter.STATUS_IDLE)
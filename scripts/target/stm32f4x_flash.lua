@@ -0,0 +1,25 @@
+--[[
+    STM32F4 Flash编程
+    用法: 修改下面的镜像路径后运行
+]]
+adiv5 = require("ADIv5")
+stm32f4 = require("STM32F4")
+dofile("scripts/adapters/cmsis_dap.lua")    -- 获得CMSIS-DAP对象
+-- 值匹配轮询在仿真器端重试,match retry设大一些可以减少USB往返
+cmObj:TransferConfig(5, 5, 1000)
+cmObj:TransferMode(adapter.SWD)
+dap = adiv5.Create(cmObj)
+apAHB = dap:FindAccessPort(adiv5.AP_Memory, adiv5.Bus_AMBA_AHB)
+
+flash = stm32f4.Flash(apAHB)  -- 默认工作区: 0x20000000开始的16KB
+local size, sectors = flash:Info()
+print(string.format("Flash: %d KB, %d sectors", size // 1024, sectors))
+print(string.format("FLASH_OPTCR: 0x%08X", flash:OptionBytes()))
+
+local file = assert(io.open("firmware.bin", "rb"))
+local data = file:read("a")
+file:close()
+-- 内容一致的扇区被跳过,空白的扇区不擦除
+local stats = flash:Program(0x08000000, data, true)
+print(string.format("Programmed %d bytes, erased %d sectors, skipped %d sectors in %.3f s",
+	stats.Bytes, stats.Erased, stats.Skipped, stats.Seconds))
@@ -0,0 +1,41 @@
+--[[
+    STM32F4 内存映射
+    ReadMemory/WriteMemory按区域选择访问方式:
+    Flash和SRAM用32位地址自增Block传输,外设寄存器逐个访问,不缓存也不合并写
+]]
+adiv5 = require("ADIv5")
+
+-- 在DAP上建立STM32F4的内存映射,ap是AHB-AP的索引
+function STM32F4_MemoryMap(dapObj, ap)
+	ap = ap or 0
+	local regions = {
+		-- Flash: 只读缓存,编程后需要InvalidateCache
+		{Base = 0x08000000, Size = 0x00200000, AP = ap, Cache = adiv5.Cache_ReadOnly},
+		-- 系统存储器和OTP
+		{Base = 0x1FFF0000, Size = 0x00007A10, AP = ap, Cache = adiv5.Cache_ReadOnly},
+		-- CCM RAM, SRAM1/SRAM2/SRAM3
+		{Base = 0x10000000, Size = 0x00010000, AP = ap, Cache = adiv5.Cache_WriteThrough},
+		{Base = 0x20000000, Size = 0x00050000, AP = ap, Cache = adiv5.Cache_WriteThrough},
+		-- 外设寄存器
+		{Base = 0x40000000, Size = 0x20000000, AP = ap, Type = adiv5.Memory_Device},
+		-- FSMC/FMC外部存储器,16位总线
+		{Base = 0x60000000, Size = 0x40000000, AP = ap, Widths = adiv5.Width_8 | adiv5.Width_16,
+			MaxBurst = 1024},
+		-- Cortex-M4私有外设: SCS寄存器只允许32位访问
+		{Base = 0xE0000000, Size = 0x00100000, AP = ap, Type = adiv5.Memory_Device, Widths = adiv5.Width_32},
+	}
+	for _, region in ipairs(regions) do
+		dapObj:MemoryRegion(region)
+	end
+end
+
+--[[
+    用法:
+    dofile("scripts/adapters/cmsis_dap.lua")
+    dap = adiv5.Create(cmObj)
+    STM32F4_MemoryMap(dap, 0)
+    local idcode = string.unpack("I4", dap:ReadMemory(0xE0042000, 4))    -- DBGMCU_IDCODE
+    for _, step in ipairs(dap:PlanAccess(0x20000001, 64)) do
+        print(string.format("0x%08X %d bytes, size %d, mode %d", step.Addr, step.Len, step.Size, step.Mode))
+    end
+]]
@@ -0,0 +1,33 @@
+--[[
+    STM32F4 按名字访问外设寄存器
+    寄存器定义来自厂商的CMSIS-SVD文件,第一次加载时编译成数据库缓存在磁盘上,之后直接映射
+]]
+svd = require("SVD")
+
+-- 在AHB-AP上绑定SVD数据库,返回的设备对象用dev.外设.寄存器.位域访问
+function STM32F4_Registers(apObj, path)
+	local db = svd.Load(path or "scripts/target/STM32F40x.svd")
+	return db:Bind(apObj)
+end
+
+-- 打开GPIO端口的时钟并把引脚配置成推挽输出,所有修改一次写入
+function STM32F4_GpioOutput(dev, port, pin)
+	local gpio = dev["GPIO" .. port]
+	dev:Begin(dev.RCC.AHB1ENR, gpio.MODER, gpio.OTYPER)
+	dev.RCC.AHB1ENR["GPIO" .. port .. "EN"] = 1
+	gpio.MODER["MODER" .. pin] = 1
+	gpio.OTYPER["OT" .. pin] = 0
+	dev:Commit()
+end
+
+--[[
+    用法:
+    dofile("scripts/adapters/cmsis_dap.lua")
+    dap = adiv5.Create(cmObj)
+    ap = dap:FindAccessPort(adiv5.AP_Memory, adiv5.Bus_AMBA_AHB)
+    dev = STM32F4_Registers(ap, "STM32F407.svd")
+    dev.RCC.AHB1ENR.GPIOEEN = 1                     -- 一次读-改-写
+    dev.RCC.CR:Modify{HSEON = 1, CSSON = 1}          -- 多个位域一次读-改-写
+    print(string.format("0x%08X", dev.RCC.CFGR:Read()))
+    STM32F4_GpioOutput(dev, "E", 3)
+]]
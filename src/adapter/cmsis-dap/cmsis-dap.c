@@ -168,6 +168,9 @@ static int swjJtag2Swd(struct cmsis_dap *cmdapObj){
 			0x00,	// 8 bit
 	};	// DAP_SWJ_Sequence Command
 	DAP_EXCHANGE_DATA(cmdapObj, switchSque, sizeof(switchSque));
+	// Line Reset之后multi-drop的所有目标都处于未选中状态
+	cmdapObj->targetSelected = FALSE;
+	cmdapObj->queuedTargetValid = FALSE;
 	return ADPT_SUCCESS;
 }
 
@@ -311,6 +314,8 @@ static int CmdapSwdLineReset(Adapter self){
 			0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x03, // 51 bit，后面跟一个0
 	};	// DAP_SWJ_Sequence Command
 	DAP_EXCHANGE_DATA(cmdapObj, resetSque, sizeof(resetSque));
+	cmdapObj->targetSelected = FALSE;
+	cmdapObj->queuedTargetValid = FALSE;
 	return ADPT_SUCCESS;
 }
 
@@ -715,9 +720,9 @@ MAKE_PACKT:
 	packetStartIdx = idx;
 	// 统计一些信息
 	for(; seqIdx < sequenceCnt; seqIdx ++){
-		data[idx] &= 0xf;	// 只保留[3:0]位
+		data[idx] &= 0x3f;	// 只保留[5:0]位
 		// 判断是否是读寄存器
-		if((data[idx] & CMDAP_TRANSFER_RnW) == CMDAP_TRANSFER_RnW){
+		if(CMDAP_TRANSFER_HAS_RDATA(data[idx])){
 			// 判断是否超出最大包长度
 			if((3 + readCount + 4) > cmdapObj->PacketSize || (3 + writeCount + 1) > cmdapObj->PacketSize){
 				break;
@@ -759,16 +764,21 @@ MAKE_PACKT:
 	// if(seqIdx < (sequenceCnt-1) && sendPackCnt < cmsis_dapObj->MaxPcaketCount) goto MAKE_PACKT;
 	if(seqIdx < (sequenceCnt-1) && sendPackCnt < 1) goto MAKE_PACKT;
 
-	BOOL result = TRUE;
+	int result = ADPT_SUCCESS;
 	for(int readPackCnt = 0; readPackCnt < sendPackCnt; readPackCnt++){	// NOTIC 这个循环也就执行一次
 		dapRead(cmdapObj, &transferred);
 		log_trace("Read %d byte.", transferred);
 		// 本次执行的Sequence是否等于应该执行的个数
-		if(result == TRUE){
+		if(result == ADPT_SUCCESS){
 			*okSeqCnt += cmdapObj->respBuffer[1];
 			if(cmdapObj->respBuffer[1] != packetInfo[readPackCnt].seqCnt){
-				log_warn("Last Response: %d.", cmdapObj->respBuffer[2]);
-				result = FALSE;
+				// 值匹配失败时ACK是OK,只是没有等到期望的值,由调用者决定是否重试
+				if(cmdapObj->respBuffer[2] == (CMDAP_TRANSFER_MISMATCH | CMDAP_TRANSFER_OK)){
+					result = ADPT_ERR_MISMATCH;
+				}else{
+					log_warn("Last Response: %d.", cmdapObj->respBuffer[2]);
+					result = ADPT_FAILED;
+				}
 			}
 			// 拷贝数据
 			if(response){
@@ -777,10 +787,12 @@ MAKE_PACKT:
 			}
 		}
 	}
-	if(result == FALSE){
+	if(result != ADPT_SUCCESS){
 		free(buff);
-		log_error("An error occurred during the transfer.");
-		return ADPT_FAILED;
+		if(result != ADPT_ERR_MISMATCH){
+			log_error("An error occurred during the transfer.");
+		}
+		return result;
 	}
 	// 判断是否处理完，如果没有则跳回去重新处理
 	if(seqIdx < (sequenceCnt-1)) {
@@ -792,13 +804,27 @@ MAKE_PACKT:
 	return ADPT_SUCCESS;
 }
 
+/**
+ * 在数据包中生成循环写入的数据
+ * 参数:
+ * 	start:第一个字在整个序列中的位置,决定从pattern的哪个字开始
+ */
+static void fillPattern(uint8_t *buff, const uint32_t *pattern, int patternLen, int start, int count){
+	int idx;
+	for(idx = 0; idx < count; idx++){
+		// XXX 小端字节序
+		memcpy(buff + (idx << 2), pattern + (start + idx) % patternLen, 4);
+	}
+}
+
 /**
  * DAP_TransferBlock
  * 对单个寄存器进行多次读写，常配合地址自增使用
  * 参数列表和意义与DAP_Transfer相同
+ * okReadLen：写入response的有效数据长度,失败时包括出错的那一次传输中已经成功读取的数据
  */
-static int CmdapTransferBlock(Adapter self, uint8_t index, int sequenceCnt, uint8_t *data, uint8_t *response, int *okSeqCnt){
-	assert(self != NULL && okSeqCnt != NULL);
+static int CmdapTransferBlock(Adapter self, uint8_t index, int sequenceCnt, uint8_t *data, uint8_t *response, int *okSeqCnt, int *okReadLen){
+	assert(self != NULL && okSeqCnt != NULL && okReadLen != NULL);
 	struct cmsis_dap *cmdapObj = container_of(self, struct cmsis_dap, adaperAPI);
 
 	assert(cmdapObj->PacketSize != 0);
@@ -833,7 +859,7 @@ static int CmdapTransferBlock(Adapter self, uint8_t index, int sequenceCnt, uint
 						writeCnt += readPacketMaxCnt << 2;
 						restCnt -= readPacketMaxCnt;	// 成功读取readPacketMaxCnt个字
 					}else{	// 失败
-						goto END;
+						goto READ_FAILED;
 					}
 				}else{
 					*CAST(uint16_t *, buff + 2) = restCnt;
@@ -846,18 +872,32 @@ static int CmdapTransferBlock(Adapter self, uint8_t index, int sequenceCnt, uint
 						writeCnt += restCnt << 2;
 						restCnt = 0;	// 全部发送完了
 					}else{	// 失败
-						goto END;
+						goto READ_FAILED;
 					}
 				}
 			}
 		}else{	// 写操作
+			uint32_t pattern[2];
+			int patternLen = 0, sentCnt = 0;
+			// 循环写入的数据,在数据包中直接生成
+			if(seq & CMDAP_BLOCK_PATTERN){
+				seq &= ~CMDAP_BLOCK_PATTERN;
+				patternLen = *(data + readCnt++);
+				memcpy(pattern, data + readCnt, patternLen << 2);
+				readCnt += patternLen << 2;
+			}
 			while(restCnt > 0){
 				if(restCnt > sentPacketMaxCnt){
 					*CAST(uint16_t *, buff + 2) = sentPacketMaxCnt;
 					buff[4] = seq;
 					// 拷贝数据
-					memcpy(buff + 5, data + readCnt, sentPacketMaxCnt << 2);	// 将数据拷贝到
-					readCnt += sentPacketMaxCnt << 2;
+					if(patternLen){
+						fillPattern(buff + 5, pattern, patternLen, sentCnt, sentPacketMaxCnt);
+						sentCnt += sentPacketMaxCnt;
+					}else{
+						memcpy(buff + 5, data + readCnt, sentPacketMaxCnt << 2);	// 将数据拷贝到
+						readCnt += sentPacketMaxCnt << 2;
+					}
 					// 交换数据
 					DAP_EXCHANGE_DATA(cmdapObj, buff, 5 + (sentPacketMaxCnt << 2));
 					// 判断操作成功 XXX 小端字节序
@@ -870,8 +910,12 @@ static int CmdapTransferBlock(Adapter self, uint8_t index, int sequenceCnt, uint
 					*CAST(uint16_t *, buff + 2) = restCnt;
 					buff[4] = seq;
 					// 拷贝数据
-					memcpy(buff + 5, data + readCnt, restCnt << 2);	// 将数据拷贝到
-					readCnt += restCnt << 2;
+					if(patternLen){
+						fillPattern(buff + 5, pattern, patternLen, sentCnt, restCnt);
+					}else{
+						memcpy(buff + 5, data + readCnt, restCnt << 2);	// 将数据拷贝到
+						readCnt += restCnt << 2;
+					}
 					// 交换数据 FIXED 以后运算符根据优先级都要打上括号！！MMP
 					DAP_EXCHANGE_DATA(cmdapObj, buff, 5 + (restCnt << 2));
 					// 判断操作成功 XXX 小端字节序
@@ -885,7 +929,16 @@ static int CmdapTransferBlock(Adapter self, uint8_t index, int sequenceCnt, uint
 		}
 	}
 	result = ADPT_SUCCESS;
+	goto END;
+READ_FAILED:
+	// 保留出错之前已经成功读取的数据,上层可以从出错的位置继续传输
+	restCnt = *CAST(uint16_t *, cmdapObj->respBuffer + 1);
+	if(restCnt > 0 && restCnt <= readPacketMaxCnt){
+		memcpy(response + writeCnt, cmdapObj->respBuffer + 4, restCnt << 2);
+		writeCnt += restCnt << 2;
+	}
 END:
+	*okReadLen = writeCnt;
 	free(buff);
 	return result;
 }
@@ -1271,6 +1324,132 @@ static int cleanJtagInsQueue(Adapter self){
 	return ADPT_SUCCESS;
 }
 
+/**
+ * 构造multi-drop切换目标的SWJ时序
+ * Line Reset(56个1) + 8个空闲周期 + TARGETSEL写请求(0x99) + 5个不驱动的应答周期 + 32位数据 + 奇偶校验 + 2个空闲周期
+ * 目标在TARGETSEL的应答周期不驱动总线,所以可以用SWJ_Sequence发送
+ * 参数:
+ * 	seq:时序缓冲区,至少14字节
+ * 返回:时序的二进制位个数
+ */
+static int makeTargetSelSequence(uint8_t *seq, uint32_t targetSel){
+	int bitCnt = 0, idx;
+	unsigned int parity = 0;
+	memset(seq, 0x0, 14);
+	for(idx = 0; idx < 56; idx++, bitCnt++){
+		SET_Nth_BIT(seq, bitCnt, 1);
+	}
+	bitCnt += 8;	// 空闲周期
+	for(idx = 0; idx < 8; idx++, bitCnt++){
+		SET_Nth_BIT(seq, bitCnt, (0x99 >> idx) & 0x1);
+	}
+	bitCnt += 5;	// Turnaround + ACK + Turnaround
+	for(idx = 0; idx < 32; idx++, bitCnt++){
+		SET_Nth_BIT(seq, bitCnt, (targetSel >> idx) & 0x1);
+		parity ^= (targetSel >> idx) & 0x1;
+	}
+	SET_Nth_BIT(seq, bitCnt, parity);
+	bitCnt++;
+	bitCnt += 2;	// 空闲周期
+	return bitCnt;
+}
+
+/**
+ * 执行队列头部的切换目标指令
+ * 如果仿真器支持DAP_ExecuteCommands(V1.1),则将切换时序和后面的单次读写寄存器指令放在同一个数据包中
+ * 否则单独发送切换时序,后面的指令正常执行
+ */
+static int executeTargetSel(Adapter self){
+	struct cmsis_dap *cmdapObj = container_of(self, struct cmsis_dap, adaperAPI);
+	struct DAP_Command *selCmd = container_of(cmdapObj->DapInsQueue.next, struct DAP_Command, list_entry);
+	struct DAP_Command *cmd, *cmd_t;
+	uint8_t seq[14];
+	int bitCnt = makeTargetSelSequence(seq, selCmd->instr.targetSel.targetSel);
+	int transferred, pos, countPos, respLen, seqCnt = 0, okSeqCnt, readCnt;
+
+	uint8_t *buff = malloc(cmdapObj->PacketSize);
+	if(buff == NULL){
+		log_warn("Unable to allocate send packet buffer, the heap may be full.");
+		return ADPT_ERR_INTERNAL_ERROR;
+	}
+	if(cmdapObj->Version < 110){
+		buff[0] = CMDAP_ID_DAP_SWJ_Sequence;
+		buff[1] = bitCnt;
+		memcpy(buff + 2, seq, (bitCnt + 7) >> 3);
+		if(dapWrite(cmdapObj, buff, 2 + ((bitCnt + 7) >> 3), &transferred) != ADPT_SUCCESS
+				|| dapRead(cmdapObj, &transferred) != ADPT_SUCCESS || cmdapObj->respBuffer[1] != CMDAP_OK){
+			log_error("Send TARGETSEL sequence failed.");
+			free(buff);
+			return ADPT_FAILED;
+		}
+		free(buff);
+		cmdapObj->selectedTarget = selCmd->instr.targetSel.targetSel;
+		cmdapObj->targetSelected = TRUE;
+		list_del(&selCmd->list_entry);
+		free(selCmd);
+		return ADPT_SUCCESS;
+	}
+	// DAP_ExecuteCommands: SWJ_Sequence + DAP_Transfer
+	buff[0] = CMDAP_ID_DAP_ExecuteCommands;
+	buff[1] = 2;
+	buff[2] = CMDAP_ID_DAP_SWJ_Sequence;
+	buff[3] = bitCnt;
+	memcpy(buff + 4, seq, (bitCnt + 7) >> 3);
+	pos = 4 + ((bitCnt + 7) >> 3);
+	buff[pos++] = CMDAP_ID_DAP_Transfer;
+	buff[pos++] = cmdapObj->tapIndex;
+	countPos = pos++;
+	respLen = 7;	// 7F 02 12 status 05 count response
+	cmd = selCmd;
+	list_for_each_entry_continue(cmd, &cmdapObj->DapInsQueue, list_entry){
+		if(cmd->type != DAP_INS_RW_REG_SINGLE || seqCnt == 0xFF) break;
+		if(CMDAP_TRANSFER_HAS_RDATA(cmd->instr.singleReg.request)){
+			if(pos + 1 > cmdapObj->PacketSize || respLen + 4 > cmdapObj->PacketSize) break;
+			buff[pos++] = cmd->instr.singleReg.request;
+			respLen += 4;
+		}else{
+			if(pos + 5 > cmdapObj->PacketSize) break;
+			buff[pos++] = cmd->instr.singleReg.request;
+			// XXX 小端字节序
+			memcpy(buff + pos, CAST(uint8_t *, &cmd->instr.singleReg.data.write), 4);
+			pos += 4;
+		}
+		seqCnt++;
+	}
+	buff[countPos] = seqCnt;
+	if(dapWrite(cmdapObj, buff, pos, &transferred) != ADPT_SUCCESS || dapRead(cmdapObj, &transferred) != ADPT_SUCCESS){
+		free(buff);
+		return ADPT_ERR_TRANSPORT_ERROR;
+	}
+	free(buff);
+	if(cmdapObj->respBuffer[0] != CMDAP_ID_DAP_ExecuteCommands || cmdapObj->respBuffer[3] != CMDAP_OK){
+		log_error("Send TARGETSEL sequence failed.");
+		return ADPT_FAILED;
+	}
+	cmdapObj->selectedTarget = selCmd->instr.targetSel.targetSel;
+	cmdapObj->targetSelected = TRUE;
+	list_del(&selCmd->list_entry);
+	free(selCmd);
+	// 同步数据
+	okSeqCnt = cmdapObj->respBuffer[5];
+	readCnt = 7;
+	list_for_each_entry_safe(cmd, cmd_t, &cmdapObj->DapInsQueue, list_entry){
+		if(okSeqCnt <= 0) break;
+		okSeqCnt--;
+		if(CMDAP_TRANSFER_HAS_RDATA(cmd->instr.singleReg.request)){
+			memcpy(cmd->instr.singleReg.data.read, cmdapObj->respBuffer + readCnt, 4);
+			readCnt += 4;
+		}
+		list_del(&cmd->list_entry);
+		free(cmd);
+	}
+	if(cmdapObj->respBuffer[5] != seqCnt){
+		log_error("DAP_Transfer:Some DAP Instruction Execute Failed. Success:%d, All:%d.", cmdapObj->respBuffer[5], seqCnt);
+		return ADPT_FAILED;
+	}
+	return ADPT_SUCCESS;
+}
+
 /**
  * 解析执行DAP指令队列
  * 注意：对于读操作，成功之后才写入内存地址，如果读取失败，则值保持不变，不要清零
@@ -1283,11 +1462,27 @@ static int executeDapCmd(Adapter self){
 	int readCnt, writeCnt, seqCnt;
 	int readBuffLen, writeBuffLen;
 
+	if(list_empty(&cmdapObj->DapInsQueue)){
+		return ADPT_SUCCESS;
+	}
 REEXEC:;
 	readCnt = 0; writeCnt = 0; seqCnt = 0;
 	readBuffLen = 0;writeBuffLen = 0;
 	// 本次处理的指令类型，找到指令队列中第一个指令的类型
 	enum DAP_InstrType thisType = container_of(cmdapObj->DapInsQueue.next, struct DAP_Command, list_entry)->type;
+	if(thisType == DAP_INS_TARGET_SEL){
+		int result = executeTargetSel(self);
+		if(result != ADPT_SUCCESS){
+			// 不确定目标的选中状态,下次访问时重新发送切换时序
+			cmdapObj->targetSelected = FALSE;
+			cmdapObj->queuedTargetValid = FALSE;
+			return result;
+		}
+		if(list_empty(&cmdapObj->DapInsQueue)){
+			return ADPT_SUCCESS;
+		}
+		goto REEXEC;
+	}
 	// 第一次遍历，计算所占用的空间
 	list_for_each_entry(cmd, &cmdapObj->DapInsQueue, list_entry){
 		if(cmd->type != thisType){
@@ -1296,7 +1491,7 @@ REEXEC:;
 		switch(cmd->type){
 		case DAP_INS_RW_REG_SINGLE:	// 单次读写寄存器
 			writeBuffLen += 1;
-			if((cmd->instr.singleReg.request & 0x2) == 0x2){	// 读操作
+			if(CMDAP_TRANSFER_HAS_RDATA(cmd->instr.singleReg.request)){	// 读操作
 				readBuffLen += 4;
 			}else{
 				writeBuffLen += 4;
@@ -1307,10 +1502,16 @@ REEXEC:;
 			writeBuffLen += 1 + sizeof(int);	// int:blockCnt, byte:seq
 			if((cmd->instr.multiReg.request & 0x2) == 0x2){	// 读操作
 				readBuffLen += cmd->instr.multiReg.count << 2;
+			}else if(cmd->instr.multiReg.patternLen){	// 循环写只需要保存pattern
+				writeBuffLen += 1 + (cmd->instr.multiReg.patternLen << 2);
 			}else{
 				writeBuffLen += cmd->instr.multiReg.count << 2;
 			}
 			break;
+
+		case DAP_INS_TARGET_SEL:	// 由executeTargetSel处理,不会和其他指令一起执行
+			assert(0);
+			break;
 		}
 		
 	}
@@ -1348,8 +1549,8 @@ REEXEC:;
 //				}
 //			}while(0);
 
-			// 如果是写操作
-			if((cmd->instr.singleReg.request & 0x2) == 0){
+			// 如果是写操作或者match value
+			if(CMDAP_TRANSFER_HAS_WDATA(cmd->instr.singleReg.request)){
 				// XXX 小端字节序
 				memcpy(writeBuff + writeCnt, CAST(uint8_t *, &cmd->instr.singleReg.data.write), 4);
 				writeCnt += 4;
@@ -1361,6 +1562,14 @@ REEXEC:;
 			// 写入本次操作的次数
 			*CAST(int *, writeBuff + writeCnt) = cmd->instr.multiReg.count;
 			writeCnt += sizeof(int);
+			if(cmd->instr.multiReg.patternLen){
+				*(writeBuff + writeCnt++) = cmd->instr.multiReg.request | CMDAP_BLOCK_PATTERN;
+				*(writeBuff + writeCnt++) = cmd->instr.multiReg.patternLen;
+				memcpy(writeBuff + writeCnt, CAST(uint8_t *, cmd->instr.multiReg.pattern), cmd->instr.multiReg.patternLen << 2);
+				writeCnt += cmd->instr.multiReg.patternLen << 2;
+				seqCnt++;
+				break;
+			}
 			*(writeBuff + writeCnt++) = cmd->instr.multiReg.request;
 			// 如果是写操作
 			if((cmd->instr.multiReg.request & 0x2) == 0){
@@ -1370,16 +1579,24 @@ REEXEC:;
 			}
 			seqCnt++;
 			break;
+
+		case DAP_INS_TARGET_SEL:
+			assert(0);
+			break;
 		}
 	}
 
 	// 执行成功的Sequence个数
-	int okSeqCnt = 0;
+	int okSeqCnt = 0, okReadLen = readBuffLen;
 	int result = ADPT_SUCCESS;
 	switch(thisType){
 	case DAP_INS_RW_REG_SINGLE:
 		// 执行指令 DAP_Transfer
-		if(CmdapTransfer(self, cmdapObj->tapIndex, seqCnt, writeBuff, readBuff, &okSeqCnt) != ADPT_SUCCESS){
+		result = CmdapTransfer(self, cmdapObj->tapIndex, seqCnt, writeBuff, readBuff, &okSeqCnt);
+		if(result == ADPT_ERR_MISMATCH){
+			break;	// 值不匹配不是错误,不打印日志
+		}
+		if(result != ADPT_SUCCESS){
 			log_error("DAP_Transfer:Some DAP Instruction Execute Failed. Success:%d, All:%d.", okSeqCnt, seqCnt);
 			result = ADPT_FAILED;
 		}
@@ -1387,11 +1604,15 @@ REEXEC:;
 
 	case DAP_INS_RW_REG_MULTI:
 		// transfer block
-		if(CmdapTransferBlock(self, cmdapObj->tapIndex, seqCnt, writeBuff, readBuff, &okSeqCnt) != ADPT_SUCCESS){
+		if(CmdapTransferBlock(self, cmdapObj->tapIndex, seqCnt, writeBuff, readBuff, &okSeqCnt, &okReadLen) != ADPT_SUCCESS){
 			log_error("DAP_TransferBlock:Some DAP Instruction Execute Failed. Success:%d, All:%d.", okSeqCnt, seqCnt);
 			result = ADPT_FAILED;
 		}
 	break;
+
+	case DAP_INS_TARGET_SEL:
+		assert(0);
+	break;
 	}
 
 	// 第三次遍历：同步数据
@@ -1404,7 +1625,7 @@ REEXEC:;
 			break;
 		}
 		okSeqCnt--;	// 只同步执行成功的Seq个数
-		if(cmd->type == DAP_INS_RW_REG_SINGLE && (cmd->instr.singleReg.request & 0x2) == 0x2){	// 单次读寄存器
+		if(cmd->type == DAP_INS_RW_REG_SINGLE && CMDAP_TRANSFER_HAS_RDATA(cmd->instr.singleReg.request)){	// 单次读寄存器
 			memcpy(cmd->instr.singleReg.data.read, readBuff + readCnt, 4);
 			readCnt += 4;
 		}else if(cmd->type == DAP_INS_RW_REG_MULTI && (cmd->instr.multiReg.request & 0x2) == 0x2){	// 多次读寄存器
@@ -1414,8 +1635,20 @@ REEXEC:;
 		list_del(&cmd->list_entry);	// 将链表中删除
 		free(cmd);
 	}
+	// 多次读出错时,把出错的指令中已经成功读取的数据同步回去
+	if(result != ADPT_SUCCESS && thisType == DAP_INS_RW_REG_MULTI && okReadLen > readCnt && !list_empty(&cmdapObj->DapInsQueue)){
+		cmd = container_of(cmdapObj->DapInsQueue.next, struct DAP_Command, list_entry);
+		if(cmd->type == DAP_INS_RW_REG_MULTI && (cmd->instr.multiReg.request & 0x2) == 0x2
+				&& okReadLen - readCnt < (cmd->instr.multiReg.count << 2)){
+			memcpy(cmd->instr.multiReg.data, readBuff + readCnt, okReadLen - readCnt);
+		}
+	}
 	free(writeBuff);
 	free(readBuff);
+	if(result != ADPT_SUCCESS){
+		cmdapObj->targetSelected = FALSE;
+		cmdapObj->queuedTargetValid = FALSE;
+	}
 	// 判断是否继续执行
 	if(result == ADPT_SUCCESS && !list_empty(&cmdapObj->DapInsQueue)){
 		goto REEXEC;
@@ -1522,6 +1755,93 @@ static int addDapMultiWrite(Adapter self, enum dapRegType type, int reg, int cou
 	return ADPT_SUCCESS;
 }
 
+/**
+ * 增加循环写指令
+ */
+static int addDapPatternWrite(Adapter self, enum dapRegType type, int reg, int count, const uint32_t *pattern, int patternLen){
+	assert(self != NULL && pattern != NULL);
+	struct cmsis_dap *cmdapObj = container_of(self, struct cmsis_dap, adaperAPI);
+
+	if(count <= 0){
+		log_error("Count must be greater than 0.");
+		return ADPT_ERR_BAD_PARAMETER;
+	}
+	if(patternLen < 1 || patternLen > 2){
+		log_error("Pattern length must be 1 or 2 words.");
+		return ADPT_ERR_BAD_PARAMETER;
+	}
+	// 新建指令
+	struct DAP_Command *command = newDapCommand(cmdapObj);
+	if(command == NULL){
+		return ADPT_ERR_INTERNAL_ERROR;
+	}
+	command->type = DAP_INS_RW_REG_MULTI;
+	command->instr.multiReg.request = (reg & 0xC);
+	if(type == ADPT_DAP_AP_REG){
+		command->instr.multiReg.request |= 0x1;
+	}
+	memcpy(command->instr.multiReg.pattern, pattern, patternLen << 2);
+	command->instr.multiReg.patternLen = patternLen;
+	command->instr.multiReg.count = count;
+	return ADPT_SUCCESS;
+}
+
+/**
+ * 增加值匹配读指令
+ * 先用Match Mask写入掩码,再用Value Match读寄存器,仿真器在本地重复读取直到
+ * (值 & mask) == value或者超过TransferConfigure设置的match retry次数
+ */
+static int addDapValueMatch(Adapter self, enum dapRegType type, int reg, uint32_t mask, uint32_t value){
+	assert(self != NULL);
+	struct cmsis_dap *cmdapObj = container_of(self, struct cmsis_dap, adaperAPI);
+
+	struct DAP_Command *command = newDapCommand(cmdapObj);
+	if(command == NULL){
+		return ADPT_ERR_INTERNAL_ERROR;
+	}
+	command->type = DAP_INS_RW_REG_SINGLE;
+	command->instr.singleReg.request = CMDAP_TRANSFER_MATCH_MASK;
+	command->instr.singleReg.data.write = mask;
+
+	command = newDapCommand(cmdapObj);
+	if(command == NULL){
+		return ADPT_ERR_INTERNAL_ERROR;
+	}
+	command->type = DAP_INS_RW_REG_SINGLE;
+	command->instr.singleReg.request = (reg & 0xC) | CMDAP_TRANSFER_RnW | CMDAP_TRANSFER_MATCH_VALUE;
+	if(type == ADPT_DAP_AP_REG){
+		command->instr.singleReg.request |= CMDAP_TRANSFER_APnDP;
+	}
+	command->instr.singleReg.data.write = value;
+	return ADPT_SUCCESS;
+}
+
+/**
+ * 增加multi-drop切换目标指令
+ * 只有和队列末尾选中的目标不同时才插入切换时序,切换之后必须读一次DPIDR
+ */
+static int addDapSelectTarget(Adapter self, uint32_t targetSel){
+	assert(self != NULL);
+	struct cmsis_dap *cmdapObj = container_of(self, struct cmsis_dap, adaperAPI);
+	if(cmdapObj->currTransMode != ADPT_MODE_SWD){
+		log_error("Multi-drop only available in SWD transfer mode.");
+		return ADPT_ERR_UNSUPPORT;
+	}
+	if(cmdapObj->queuedTargetValid && cmdapObj->queuedTarget == targetSel){
+		return ADPT_SUCCESS;
+	}
+	// 新建指令
+	struct DAP_Command *command = newDapCommand(cmdapObj);
+	if(command == NULL){
+		return ADPT_ERR_INTERNAL_ERROR;
+	}
+	command->type = DAP_INS_TARGET_SEL;
+	command->instr.targetSel.targetSel = targetSel;
+	cmdapObj->queuedTarget = targetSel;
+	cmdapObj->queuedTargetValid = TRUE;
+	return addDapSingleRead(self, ADPT_DAP_DP_REG, DP_REG_DPIDR, &cmdapObj->targetDpidr);
+}
+
 /* 清空DAP指令队列 */
 static int cleanDapInsQueue(Adapter self){
 	assert(self != NULL);
@@ -1532,9 +1852,163 @@ static int cleanDapInsQueue(Adapter self){
 		list_del(&cmd->list_entry);	// 将链表中删除
 		free(cmd);
 	}
+	// 队列末尾的目标恢复为当前实际选中的目标
+	cmdapObj->queuedTarget = cmdapObj->selectedTarget;
+	cmdapObj->queuedTargetValid = cmdapObj->targetSelected;
 	return ADPT_SUCCESS;
 }
 
+/* 释放预编译的程序 */
+static void freeDapProgram(Adapter self, DapProgram program){
+	if(program == NULL) return;
+	free(program->image);
+	free(program->packets);
+	free(program->writeOffset);
+	free(program->writeData);
+	free(program);
+}
+
+/**
+ * 把DAP指令队列编译成DAP_Transfer数据包
+ * Block读写展开成对同一个寄存器的多次transfer,分包规则和CmdapTransfer相同
+ */
+static int prepareDapProgram(Adapter self, DapProgram *programOut, unsigned int *readCount, unsigned int *writeCount){
+	assert(self != NULL && programOut != NULL);
+	struct cmsis_dap *cmdapObj = container_of(self, struct cmsis_dap, adaperAPI);
+	struct DAP_Command *cmd;
+	struct dapProgram *program;
+	struct programPacket *packet = NULL;
+	unsigned int transCnt = 0, imageLen = 0;
+	int idx, count;
+	uint8_t request;
+	uint32_t value = 0;
+	assert(cmdapObj->PacketSize != 0);
+	// 统计transfer个数
+	list_for_each_entry(cmd, &cmdapObj->DapInsQueue, list_entry){
+		if(cmd->type == DAP_INS_RW_REG_SINGLE){
+			transCnt++;
+		}else if(cmd->type == DAP_INS_RW_REG_MULTI){
+			transCnt += cmd->instr.multiReg.count;
+		}else{
+			log_warn("Target selection can not be prepared.");
+			return ADPT_ERR_UNSUPPORT;
+		}
+	}
+	program = calloc(1, sizeof(struct dapProgram));
+	if(program == NULL){
+		log_error("Failed to create a DAP program object.");
+		return ADPT_ERR_INTERNAL_ERROR;
+	}
+	// 每个transfer最多5字节,每个数据包最多带3字节的头部
+	program->image = malloc(transCnt * 8 + 1);
+	program->packets = malloc((transCnt + 1) * sizeof(struct programPacket));
+	program->writeOffset = malloc((transCnt + 1) * sizeof(unsigned int));
+	program->writeData = malloc((transCnt + 1) * sizeof(uint32_t));
+	if(program->image == NULL || program->packets == NULL || program->writeOffset == NULL || program->writeData == NULL){
+		log_error("Failed to allocate DAP program buffer.");
+		freeDapProgram(self, program);
+		return ADPT_ERR_INTERNAL_ERROR;
+	}
+	list_for_each_entry(cmd, &cmdapObj->DapInsQueue, list_entry){
+		count = cmd->type == DAP_INS_RW_REG_SINGLE ? 1 : cmd->instr.multiReg.count;
+		for(idx = 0; idx < count; idx++){
+			if(cmd->type == DAP_INS_RW_REG_SINGLE){
+				request = cmd->instr.singleReg.request & 0x3f;
+				value = cmd->instr.singleReg.data.write;
+			}else{
+				request = cmd->instr.multiReg.request & 0x0f;
+				if(cmd->instr.multiReg.patternLen){
+					value = cmd->instr.multiReg.pattern[idx % cmd->instr.multiReg.patternLen];
+				}else if(CMDAP_TRANSFER_HAS_WDATA(request)){
+					value = cmd->instr.multiReg.data[idx];
+				}
+			}
+			// 当前数据包放不下时开始新的数据包
+			if(packet == NULL || packet->seqCnt == 0xFF
+					|| packet->length + 1 + (CMDAP_TRANSFER_HAS_WDATA(request) ? 4 : 0) > cmdapObj->PacketSize
+					|| (CMDAP_TRANSFER_HAS_RDATA(request) && 3 + packet->readLen + 4 > cmdapObj->PacketSize)){
+				packet = &program->packets[program->packetCount++];
+				packet->offset = imageLen;
+				packet->length = 3;
+				packet->seqCnt = 0;
+				packet->readLen = 0;
+				program->image[imageLen++] = CMDAP_ID_DAP_Transfer;
+				program->image[imageLen++] = cmdapObj->tapIndex;
+				program->image[imageLen++] = 0;
+			}
+			program->image[imageLen++] = request;
+			if(CMDAP_TRANSFER_HAS_WDATA(request)){
+				program->writeData[program->writeCount] = value;
+				program->writeOffset[program->writeCount++] = imageLen;
+				// XXX 小端字节序
+				memcpy(program->image + imageLen, CAST(uint8_t *, &value), 4);
+				imageLen += 4;
+			}
+			if(CMDAP_TRANSFER_HAS_RDATA(request)){
+				packet->readLen += 4;
+				program->readCount++;
+			}
+			packet->seqCnt++;
+			packet->length = imageLen - packet->offset;
+			program->image[packet->offset + 2] = packet->seqCnt;
+		}
+	}
+	// 队列中的操作已经编译到程序中
+	cleanDapInsQueue(self);
+	log_debug("DAP program: %u transfer(s), %d packet(s).", transCnt, program->packetCount);
+	*programOut = program;
+	if(readCount) *readCount = program->readCount;
+	if(writeCount) *writeCount = program->writeCount;
+	return ADPT_SUCCESS;
+}
+
+/**
+ * 执行预编译的程序
+ * 和CmdapTransfer一样每次只发送一个数据包,出错之后不再发送后面的数据包
+ * 每次执行都重新填写image中的写数据,没有传入writes时恢复成编译时的数据
+ */
+static int runDapProgram(Adapter self, DapProgram program, const uint32_t *writes, uint32_t *reads){
+	assert(self != NULL && program != NULL);
+	struct cmsis_dap *cmdapObj = container_of(self, struct cmsis_dap, adaperAPI);
+	struct programPacket *packet;
+	unsigned int idx;
+	int transferred, result;
+	// 先执行队列中已有的操作
+	if((result = executeDapCmd(self)) != ADPT_SUCCESS){
+		return result;
+	}
+	if(writes == NULL){
+		writes = program->writeData;
+	}
+	for(idx = 0; idx < program->writeCount; idx++){
+		// XXX 小端字节序
+		memcpy(program->image + program->writeOffset[idx], CAST(const uint8_t *, writes + idx), 4);
+	}
+	for(packet = program->packets; packet < program->packets + program->packetCount; packet++){
+		if(dapWrite(cmdapObj, program->image + packet->offset, packet->length, &transferred) != ADPT_SUCCESS
+				|| dapRead(cmdapObj, &transferred) != ADPT_SUCCESS){
+			cmdapObj->targetSelected = FALSE;
+			cmdapObj->queuedTargetValid = FALSE;
+			return ADPT_ERR_TRANSPORT_ERROR;
+		}
+		if(cmdapObj->respBuffer[1] != packet->seqCnt){
+			log_error("DAP program failed at packet %d. Success:%d, All:%d, Last Response: %d.",
+					(int)(packet - program->packets), cmdapObj->respBuffer[1], packet->seqCnt, cmdapObj->respBuffer[2]);
+			// 清除STICKYERR等错误标志,否则之后的访问都会失败
+			if(CmdapWriteAbort(self, DP_ABORT_STKCMPCLR | DP_ABORT_STKERRCLR | DP_ABORT_WDERRCLR | DP_ABORT_ORUNERRCLR) != ADPT_SUCCESS){
+				log_warn("Failed to clear sticky error flags.");
+			}
+			cmdapObj->targetSelected = FALSE;
+			cmdapObj->queuedTargetValid = FALSE;
+			return ADPT_FAILED;
+		}
+		if(reads){
+			memcpy(reads, cmdapObj->respBuffer + 3, packet->readLen);
+			reads += packet->readLen >> 2;
+		}
+	}
+	return ADPT_SUCCESS;
+}
 
 /**
  * DAP写ABORT寄存器
@@ -1599,6 +2073,12 @@ Adapter CreateCmsisDap(void){
 	obj->adaperAPI.DapMultiWrite = addDapMultiWrite;
 	obj->adaperAPI.DapCommit = executeDapCmd;
 	obj->adaperAPI.DapCleanPending = cleanDapInsQueue;
+	obj->adaperAPI.DapSelectTarget = addDapSelectTarget;
+	obj->adaperAPI.DapPatternWrite = addDapPatternWrite;
+	obj->adaperAPI.DapValueMatch = addDapValueMatch;
+	obj->adaperAPI.DapPrepare = prepareDapProgram;
+	obj->adaperAPI.DapRunProgram = runDapProgram;
+	obj->adaperAPI.DapFreeProgram = freeDapProgram;
 
 	obj->connected = FALSE;
 	return (Adapter)&obj->adaperAPI;
@@ -17,6 +17,14 @@
 #define CMDAP_TRANSFER_RnW			(1U<<1)
 #define CMDAP_TRANSFER_A2			(1U<<2)
 #define CMDAP_TRANSFER_A3			(1U<<3)
+#define CMDAP_TRANSFER_MATCH_VALUE	(1U<<4)	// 读操作:读到的值和match value比较,不返回数据
+#define CMDAP_TRANSFER_MATCH_MASK	(1U<<5)	// 写操作:写入match mask而不是寄存器
+// 单次读写指令是否带4字节数据,match value读操作带的是比较的值
+#define CMDAP_TRANSFER_HAS_WDATA(req)	(((req) & CMDAP_TRANSFER_RnW) == 0 || ((req) & CMDAP_TRANSFER_MATCH_VALUE))
+// 单次读写指令的响应中是否有4字节数据
+#define CMDAP_TRANSFER_HAS_RDATA(req)	(((req) & (CMDAP_TRANSFER_RnW | CMDAP_TRANSFER_MATCH_VALUE)) == CMDAP_TRANSFER_RnW)
+// 指令缓冲区内部使用:TransferBlock写操作的数据是循环的pattern,不发送给仿真器
+#define CMDAP_BLOCK_PATTERN			(1U<<7)
 
 // CMSIS-DAP Command IDs
 // V1.0
@@ -159,6 +167,7 @@ struct JTAG_Command{
 enum DAP_InstrType{
 	DAP_INS_RW_REG_SINGLE,	// 单次读写nP寄存器
 	DAP_INS_RW_REG_MULTI,	// 多次读写寄存器
+	DAP_INS_TARGET_SEL,	// SWD multi-drop 切换目标
 };
 
 // DAP指令对象
@@ -173,6 +182,7 @@ struct DAP_Command{
 			 * Bit 1: RnW: 0 = Write Register, 1 = Read Register.
 			 * Bit 2: A2 Register Address bit 2.
 			 * Bit 3: A3 Register Address bit 3.
+			 * Bit 4: Value Match,Bit 5: Match Mask
 			 */
 			uint8_t request;
 			// 指令的数据
@@ -192,10 +202,34 @@ struct DAP_Command{
 			// 指令的数据
 			uint32_t *data;
 			int count;	// 读写次数
+			uint32_t pattern[2];	// 循环写入的数据,patternLen不为0时代替data
+			int patternLen;
 		} multiReg;	// 多次读写寄存器
+		struct {
+			uint32_t targetSel;	// TARGETSEL的值
+		} targetSel;	// 切换目标
 	} instr;
 };
 
+// 预编译程序中的一个DAP_Transfer数据包
+struct programPacket {
+	int offset;	// 数据包在image中的偏移
+	int length;	// 数据包长度
+	int seqCnt;	// 包含的transfer个数
+	int readLen;	// 响应中数据的字节数
+};
+
+// 预编译的DAP传输程序
+struct dapProgram {
+	uint8_t *image;	// 编码好的所有数据包
+	struct programPacket *packets;	// 数据包
+	int packetCount;	// 数据包个数
+	unsigned int *writeOffset;	// 每个写入的字在image中的偏移
+	uint32_t *writeData;	// 编译时写入的数据,Run不传入写数据时使用
+	unsigned int writeCount;	// 写入的字数
+	unsigned int readCount;	// 读取的字数
+};
+
 /* CMSIS-DAP对象 */
 struct cmsis_dap {
 	USB usbObj;	// USB连接对象
@@ -215,6 +249,12 @@ struct cmsis_dap {
 	struct list_head DapInsQueue;	// DAP指令队列，元素类型struct DAP_Command
 	unsigned int tapCount;	// TAP个数
 	unsigned int tapIndex;	// 要操作的TAP在扫描链中的索引,在DAP Transfer相关函数中会用到
+	// SWD multi-drop
+	BOOL targetSelected;	// 是否已经选中目标
+	uint32_t selectedTarget;	// 当前选中的目标
+	BOOL queuedTargetValid;	// 指令队列末尾是否已经确定目标
+	uint32_t queuedTarget;	// 指令队列末尾选中的目标
+	uint32_t targetDpidr;	// 切换目标后读取的DPIDR
 	// TODO 实现更高版本仿真器支持 SWO、
 };
 
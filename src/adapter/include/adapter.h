@@ -24,10 +24,13 @@ enum {
 	ADPT_ERR_UNSUPPORT,	// 不支持的操作
 	ADPT_ERR_INTERNAL_ERROR,	// 内部错误,不是由于Adapter功能部分造成的失败
 	ADPT_ERR_BAD_PARAMETER,	// 无效的参数
+	ADPT_ERR_MISMATCH,	// DapValueMatch超过重试次数仍不匹配,不是传输错误
 };
 
 /* 仿真器对象 */
 typedef struct adapter *Adapter;
+// 预编译的DAP传输程序,由各Adapter自己定义
+typedef struct dapProgram *DapProgram;
 
 // 仿真器的状态
 enum adapterStatus {
@@ -272,6 +275,7 @@ typedef int (*ADPT_DAP_SINGLE_WRITE)(
  * 	reg:reg地址
  * 	count:读取的次数
  * 	data:将寄存器的内容写入到该参数指定的数组
+ * 	执行失败时,出错之前已经成功读取的数据也会写入该数组
  * 返回:
  */
 typedef int (*ADPT_DAP_MULTI_READ)(
@@ -327,6 +331,120 @@ typedef int (*ADPT_DAP_CLEAN_PENDING)(
 		IN Adapter self
 );
 
+/**
+ * DapSelectTarget - SWD multi-drop:选中后续DAP操作的目标DP
+ * 会将该动作加入Pending队列,不会立即执行
+ * 仿真器记录当前选中的目标,只有目标改变时才会在队列中插入
+ * Line Reset + TARGETSEL + 读DPIDR 的切换时序,并与后续的DAP操作放在同一个数据包中发送
+ * 参数:
+ * 	self:Adapter对象自身
+ * 	targetSel:写入TARGETSEL寄存器的值
+ * 返回:
+ * 	ADPT_SUCCESS:成功
+ * 	ADPT_ERR_UNSUPPORT:当前传输模式不支持
+ */
+typedef int (*ADPT_DAP_SELECT_TARGET)(
+		IN Adapter self,
+		IN uint32_t targetSel
+);
+
+/**
+ * DapPatternWrite - 多次写同一组数据:AP或者DP,寄存器地址
+ * 会将该动作加入Pending队列,不会立即执行
+ * 第n次写入pattern[n % patternLen],数据在发送时直接生成,不需要count大小的缓冲区
+ * 可选接口,为NULL时用DapMultiWrite代替
+ * 参数:
+ * 	self:Adapter对象自身
+ * 	type:寄存器类型,DP还是AP
+ * 	reg:reg地址
+ * 	count:写的次数
+ * 	pattern:循环写入的数据
+ * 	patternLen:pattern的字数,1或者2
+ * 返回:
+ */
+typedef int (*ADPT_DAP_PATTERN_WRITE)(
+		IN Adapter self,
+		IN enum dapRegType type,
+		IN int reg,
+		IN int count,
+		IN const uint32_t *pattern,
+		IN int patternLen
+);
+
+/**
+ * DapValueMatch - 在仿真器端轮询寄存器,直到(值 & mask) == value
+ * 会将该动作加入Pending队列,不会立即执行
+ * 轮询次数由仿真器的match retry决定,超过次数仍不匹配时Commit返回ADPT_ERR_MISMATCH,
+ * 这时目标的sticky标志没有变化;ACK为FAULT/WAIT等传输错误时Commit返回其他错误码
+ * 可选接口,为NULL时由上层读回比较
+ * 参数:
+ * 	self:Adapter对象自身
+ * 	type:寄存器类型,DP还是AP
+ * 	reg:reg地址
+ * 	mask:比较的掩码
+ * 	value:期望的值
+ * 返回:
+ */
+typedef int (*ADPT_DAP_VALUE_MATCH)(
+		IN Adapter self,
+		IN enum dapRegType type,
+		IN int reg,
+		IN uint32_t mask,
+		IN uint32_t value
+);
+
+/**
+ * DapPrepare - 把Pending队列中的DAP操作编译成可以重复执行的程序
+ * 队列中的操作不会执行,编译之后队列被清空,读操作的数据地址不再使用
+ * 程序在编译时就编码成了可以直接发送的数据包,执行时只替换写入的数据,读到的数据按顺序放入结果数组
+ * 编译时的TAP索引和传输模式固定在程序中,之后修改需要重新编译
+ * 可选接口,为NULL时不支持
+ * 参数:
+ * 	self:Adapter对象自身
+ * 	program:编译好的程序
+ * 	readCount:程序读取的字数,也就是DapRunProgram的reads数组大小
+ * 	writeCount:程序写入的字数,也就是DapRunProgram的writes数组大小
+ * 返回:
+ * 	ADPT_SUCCESS:成功
+ * 	ADPT_ERR_UNSUPPORT:队列中有不能预编译的操作,比如multi-drop切换目标
+ */
+typedef int (*ADPT_DAP_PREPARE)(
+		IN Adapter self,
+		OUT DapProgram *program,
+		OUT unsigned int *readCount,
+		OUT unsigned int *writeCount
+);
+
+/**
+ * DapRunProgram - 执行预编译的程序
+ * 会先执行Pending队列中已有的操作
+ * 参数:
+ * 	self:Adapter对象自身
+ * 	program:DapPrepare编译的程序
+ * 	writes:按顺序替换每个写入的字(包括match value),NULL表示使用编译时的数据
+ * 	reads:读到的数据按顺序存放,可以为NULL
+ * 返回:
+ * 	ADPT_SUCCESS:成功
+ * 	ADPT_FAILED:有操作执行失败,失败之后的数据包不会发送
+ */
+typedef int (*ADPT_DAP_RUN_PROGRAM)(
+		IN Adapter self,
+		IN DapProgram program,
+		IN const uint32_t *writes,
+		OUT uint32_t *reads
+);
+
+/**
+ * DapFreeProgram - 释放预编译的程序
+ * 参数:
+ * 	self:Adapter对象自身
+ * 	program:DapPrepare编译的程序
+ */
+typedef void (*ADPT_DAP_FREE_PROGRAM)(
+		IN Adapter self,
+		IN DapProgram program
+);
+
 /**
  * Adapter接口对象
  */
@@ -354,6 +472,12 @@ struct adapter {
 	ADPT_DAP_MULTI_WRITE DapMultiWrite;		// 连续写
 	ADPT_DAP_COMMIT DapCommit;				// 提交Pending动作
 	ADPT_DAP_CLEAN_PENDING DapCleanPending;	// 清除Pending的动作
+	ADPT_DAP_SELECT_TARGET DapSelectTarget;	// SWD multi-drop选中目标DP
+	ADPT_DAP_PATTERN_WRITE DapPatternWrite;	// 连续写同一组数据
+	ADPT_DAP_VALUE_MATCH DapValueMatch;		// 仿真器端轮询直到值匹配
+	ADPT_DAP_PREPARE DapPrepare;			// 把Pending队列编译成可以重复执行的程序
+	ADPT_DAP_RUN_PROGRAM DapRunProgram;		// 执行预编译的程序
+	ADPT_DAP_FREE_PROGRAM DapFreeProgram;	// 释放预编译的程序
 };
 
 /**
@@ -15,6 +15,16 @@
 
 // 注意!!!!所有Adapter对象的metatable都要以 "adapter." 开头!!!!
 #define CMDAP_LUA_OBJECT_TYPE "adapter.CMSIS-DAP"
+#define DAP_PROGRAM_LUA_OBJECT_TYPE "DapProgram"
+
+// 预编译的DAP程序
+struct luaApi_dapProgram {
+	int reference;	// Adapter对象的引用
+	Adapter adapter;	// Adapter对象
+	DapProgram program;	// 程序
+	unsigned int readCount;	// 读取的字数
+	unsigned int writeCount;	// 写入的字数
+};
 
 /**
  * 设置状态指示灯 如果有的话
@@ -110,21 +120,34 @@ static int luaApi_adapter_jtag_status_change(lua_State *L){
 /**
  * jtag交换TDI TDO
  * 1#：adapter对象
- * 2#:字符串对象
+ * 2#:字符串对象或者Buffer对象,Buffer中的TDI数据直接被TDO数据替换
  * 3#:二进制位个数
  * Note：该函数会刷新JTAG指令队列,因为要同步获得数据
  * 返回：
- * 1#：捕获到的TDO数据
+ * 1#：捕获到的TDO数据,传入Buffer时返回该Buffer
  */
 static int luaApi_adapter_jtag_exchange_data(lua_State *L){
 	Adapter cmdapObj = *CAST(Adapter *, luaL_checkudata(L, 1, CMDAP_LUA_OBJECT_TYPE));
 	size_t str_len = 0;
-	const char *tdi_data = lua_tolstring (L, 2, &str_len);
+	uint8_t *buffer = LuaApiToBuffer(L, 2, &str_len);
+	const char *tdi_data = buffer ? NULL : lua_tolstring (L, 2, &str_len);
 	unsigned int bitCnt = (unsigned int)luaL_checkinteger(L, 3);
 	// 判断bit长度是否合法
 	if((str_len << 3) < bitCnt ){	// 字符串长度小于要发送的字节数
 		return luaL_error(L, "TDI data length is illegal!");
 	}
+	if(buffer){
+		// 在Buffer中原地交换
+		if(cmdapObj->JtagExchangeData(cmdapObj, buffer, bitCnt) != ADPT_SUCCESS){
+			return luaL_error(L, "Insert to instruction queue failed!");
+		}
+		if(cmdapObj->JtagCommit(cmdapObj) != ADPT_SUCCESS){
+			cmdapObj->JtagCleanPending(cmdapObj);
+			return luaL_error(L, "Execute the instruction queue failed!");
+		}
+		lua_pushvalue(L, 2);
+		return 1;
+	}
 	// 开辟缓冲内存空间
 	uint8_t *data = malloc(str_len * sizeof(uint8_t));
 	if(data == NULL){
@@ -247,14 +270,29 @@ static int luaApi_adapter_dap_single_write(lua_State *L){
  * 2#:type寄存器类型 AP还是DP
  * 3#:reg 寄存器号
  * 4#:count 读取次数
+ * 5#:存放数据的Buffer(可选),数据直接读到Buffer中
  * 返回
- * 1#:读的数据
+ * 1#:读的数据,传入Buffer时返回该Buffer,否则是字符串
  */
 static int luaApi_adapter_dap_multi_read(lua_State *L){
 	Adapter cmdapObj = *CAST(Adapter *, luaL_checkudata(L, 1, CMDAP_LUA_OBJECT_TYPE));
 	int type = (int)luaL_checkinteger(L, 2);
 	int reg = (int)luaL_checkinteger(L, 3);
 	int count = (int)luaL_checkinteger(L, 4);
+	if(!lua_isnoneornil(L, 5)){
+		uint32_t *data = CAST(uint32_t *, LuaApiOptBuffer(L, 5, count * sizeof(uint32_t)));
+		if((uintptr_t)data & 0x3){
+			return luaL_error(L, "Buffer is not word aligned.");
+		}
+		if(cmdapObj->DapMultiRead(cmdapObj, type, reg, count, data) != ADPT_SUCCESS){
+			return luaL_error(L, "Insert to instruction queue failed!");
+		}
+		if(cmdapObj->DapCommit(cmdapObj) != ADPT_SUCCESS){
+			cmdapObj->DapCleanPending(cmdapObj);
+			return luaL_error(L, "Execute the instruction queue failed!");
+		}
+		return 1;
+	}
 	// 开辟缓冲内存空间
 	uint32_t *buff = malloc(count * sizeof(uint32_t));
 	if(buff == NULL){
@@ -280,14 +318,17 @@ static int luaApi_adapter_dap_multi_read(lua_State *L){
  * 1#:Adapter对象
  * 2#:type寄存器类型 AP还是DP
  * 3#:reg 寄存器号
- * 4#:data 写的数据(字符串)
+ * 4#:data 写的数据(字符串或者Buffer)
  */
 static int luaApi_adapter_dap_multi_write(lua_State *L){
 	Adapter cmdapObj = *CAST(Adapter *, luaL_checkudata(L, 1, CMDAP_LUA_OBJECT_TYPE));
 	int type = (int)luaL_checkinteger(L, 2);
 	int reg = (int)luaL_checkinteger(L, 3);
 	size_t transCnt;	// 注意size_t在在64位环境下是8字节，int在64位下是4字节
-	uint32_t *buff = (uint32_t *)luaL_checklstring (L, 4, &transCnt);
+	uint32_t *buff = (uint32_t *)LuaApiCheckBytes(L, 4, &transCnt);
+	if((uintptr_t)buff & 0x3){
+		return luaL_error(L, "Buffer is not word aligned.");
+	}
 	if(transCnt == 0 || (transCnt & 0x3)){
 		return luaL_error(L, "The length of the data to be written is not a multiple of the word.");
 	}
@@ -303,6 +344,169 @@ static int luaApi_adapter_dap_multi_write(lua_State *L){
 	return 0;
 }
 
+/**
+ * 把一组DAP寄存器读写编译成可以重复执行的程序
+ * 1#:Adapter对象
+ * 2#:操作数组,元素是{type, reg}表示读,{type, reg, data}表示写
+ * 返回:
+ * 1#:程序对象,用program:Run([writes])执行
+ */
+static int luaApi_adapter_dap_prepare(lua_State *L){
+	Adapter cmdapObj = *CAST(Adapter *, luaL_checkudata(L, 1, CMDAP_LUA_OBJECT_TYPE));
+	struct luaApi_dapProgram *luaProgram;
+	uint32_t discard;
+	unsigned int count, pos;
+	int type, reg, result;
+	luaL_checktype(L, 2, LUA_TTABLE);
+	if(cmdapObj->DapPrepare == NULL){
+		return luaL_error(L, "This adapter does not support prepared programs.");
+	}
+	luaProgram = lua_newuserdata(L, sizeof(struct luaApi_dapProgram));	// +1
+	luaProgram->program = NULL;
+	luaProgram->reference = LUA_NOREF;
+	luaL_setmetatable(L, DAP_PROGRAM_LUA_OBJECT_TYPE);
+	count = (unsigned int)lua_rawlen(L, 2);
+	for(pos = 0; pos < count; pos++){
+		if(lua_rawgeti(L, 2, pos + 1) != LUA_TTABLE){
+			cmdapObj->DapCleanPending(cmdapObj);
+			return luaL_error(L, "Entry %d is not a {type, reg[, data]} table.", pos + 1);
+		}
+		lua_rawgeti(L, -1, 1);
+		lua_rawgeti(L, -2, 2);
+		type = (int)lua_tointeger(L, -2);
+		reg = (int)lua_tointeger(L, -1);
+		lua_pop(L, 2);
+		if(lua_rawgeti(L, -1, 3) == LUA_TNIL){
+			result = cmdapObj->DapSingleRead(cmdapObj, type, reg, &discard);
+		}else{
+			result = cmdapObj->DapSingleWrite(cmdapObj, type, reg, (uint32_t)lua_tointeger(L, -1));
+		}
+		lua_pop(L, 2);
+		if(result != ADPT_SUCCESS){
+			cmdapObj->DapCleanPending(cmdapObj);
+			return luaL_error(L, "Insert to instruction queue failed!");
+		}
+	}
+	if(cmdapObj->DapPrepare(cmdapObj, &luaProgram->program, &luaProgram->readCount, &luaProgram->writeCount) != ADPT_SUCCESS){
+		luaProgram->program = NULL;
+		cmdapObj->DapCleanPending(cmdapObj);
+		return luaL_error(L, "Failed to prepare the DAP program.");
+	}
+	luaProgram->adapter = cmdapObj;
+	// 增加Adapter的引用
+	lua_pushvalue(L, 1);
+	luaProgram->reference = luaL_ref(L, LUA_REGISTRYINDEX);
+	return 1;
+}
+
+/**
+ * 执行预编译的DAP程序
+ * 1#:程序对象
+ * 2#:按顺序替换每个写入的数据(可选,数组长度必须等于写操作的个数,默认使用编译时的数据)
+ * 返回:
+ * 1#:读到的数据数组
+ */
+static int luaApi_dap_program_run(lua_State *L){
+	struct luaApi_dapProgram *luaProgram = luaL_checkudata(L, 1, DAP_PROGRAM_LUA_OBJECT_TYPE);
+	uint32_t *writes = NULL, *reads;
+	unsigned int pos;
+	LuaApiAsyncCheckIdle(L, luaProgram->adapter);
+	if(!lua_isnoneornil(L, 2)){
+		luaL_checktype(L, 2, LUA_TTABLE);
+		if(lua_rawlen(L, 2) != luaProgram->writeCount){
+			return luaL_error(L, "The program writes %d word(s).", luaProgram->writeCount);
+		}
+		writes = lua_newuserdata(L, (luaProgram->writeCount + 1) * sizeof(uint32_t));
+		for(pos = 0; pos < luaProgram->writeCount; pos++){
+			lua_rawgeti(L, 2, pos + 1);
+			writes[pos] = (uint32_t)luaL_checkinteger(L, -1);
+			lua_pop(L, 1);
+		}
+	}
+	reads = lua_newuserdata(L, (luaProgram->readCount + 1) * sizeof(uint32_t));
+	if(luaProgram->adapter->DapRunProgram(luaProgram->adapter, luaProgram->program, writes, reads) != ADPT_SUCCESS){
+		return luaL_error(L, "Execute the DAP program failed!");
+	}
+	lua_createtable(L, luaProgram->readCount, 0);
+	for(pos = 0; pos < luaProgram->readCount; pos++){
+		lua_pushinteger(L, reads[pos]);
+		lua_rawseti(L, -2, pos + 1);
+	}
+	return 1;
+}
+
+// 执行DAP程序的异步任务
+struct luaApi_dapProgramJob {
+	Adapter adapter;
+	DapProgram program;
+	uint32_t *writes;
+	uint32_t *reads;
+};
+
+static int luaApi_dap_program_job(void *context){
+	struct luaApi_dapProgramJob *job = context;
+	return job->adapter->DapRunProgram(job->adapter, job->program, job->writes, job->reads);
+}
+
+static int luaApi_dap_program_run_k(lua_State *L, int status, lua_KContext ctx){
+	struct luaApi_dapProgram *luaProgram = lua_touserdata(L, 1);
+	struct luaApi_dapProgramJob *job;
+	unsigned int pos;
+	(void)status;
+	if(LuaApiAsyncResult(L, ctx, (void **)&job) != ADPT_SUCCESS){
+		return luaL_error(L, "Execute the DAP program failed!");
+	}
+	lua_createtable(L, luaProgram->readCount, 0);
+	for(pos = 0; pos < luaProgram->readCount; pos++){
+		lua_pushinteger(L, job->reads[pos]);
+		lua_rawseti(L, -2, pos + 1);
+	}
+	return 1;
+}
+
+/**
+ * 异步执行预编译的DAP程序
+ * 在协程中调用时挂起协程,执行完成后返回;参数和返回值同Run
+ */
+static int luaApi_dap_program_run_async(lua_State *L){
+	struct luaApi_dapProgram *luaProgram = luaL_checkudata(L, 1, DAP_PROGRAM_LUA_OBJECT_TYPE);
+	struct luaApi_dapProgramJob *job;
+	uint32_t *writes = NULL, *reads;
+	unsigned int pos;
+	if(!lua_isnoneornil(L, 2)){
+		luaL_checktype(L, 2, LUA_TTABLE);
+		if(lua_rawlen(L, 2) != luaProgram->writeCount){
+			return luaL_error(L, "The program writes %d word(s).", luaProgram->writeCount);
+		}
+		writes = lua_newuserdata(L, (luaProgram->writeCount + 1) * sizeof(uint32_t));
+		for(pos = 0; pos < luaProgram->writeCount; pos++){
+			lua_rawgeti(L, 2, pos + 1);
+			writes[pos] = (uint32_t)luaL_checkinteger(L, -1);
+			lua_pop(L, 1);
+		}
+	}
+	reads = lua_newuserdata(L, (luaProgram->readCount + 1) * sizeof(uint32_t));
+	job = LuaApiNewAsyncJob(L, luaApi_dap_program_job, sizeof(struct luaApi_dapProgramJob), 1, -1);	// +1
+	job->adapter = luaProgram->adapter;
+	job->program = luaProgram->program;
+	job->writes = writes;
+	job->reads = reads;
+	return LuaApiAsyncAwait(L, -1, luaProgram->adapter, luaApi_dap_program_run_k);
+}
+
+/**
+ * DAP程序垃圾回收函数
+ */
+static int luaApi_dap_program_gc(lua_State *L){
+	struct luaApi_dapProgram *luaProgram = luaL_checkudata(L, 1, DAP_PROGRAM_LUA_OBJECT_TYPE);
+	if(luaProgram->program){
+		luaProgram->adapter->DapFreeProgram(luaProgram->adapter, luaProgram->program);
+		luaProgram->program = NULL;
+	}
+	luaL_unref(L, LUA_REGISTRYINDEX, luaProgram->reference);
+	return 0;
+}
+
 /**
  * 新建CMSIS-DAP对象
  */
@@ -496,6 +700,7 @@ static const luaL_Reg lib_cmdap_oo[] = {
 	{"DapSingleWrite", luaApi_adapter_dap_single_write},
 	{"DapMultiRead", luaApi_adapter_dap_multi_read},
 	{"DapMultiWrite", luaApi_adapter_dap_multi_write},
+	{"DapPrepare", luaApi_adapter_dap_prepare},
 
 	// CMSIS-DAP 特定接口
 	{"Connect", luaApi_cmsis_dap_connect},	// 连接CMSIS-DAP
@@ -508,10 +713,18 @@ static const luaL_Reg lib_cmdap_oo[] = {
 	{NULL, NULL}
 };
 
+// 预编译的DAP程序
+static const luaL_Reg lib_dap_program_oo[] = {
+	{"Run", luaApi_dap_program_run},
+	{"RunAsync", luaApi_dap_program_run_async},
+	{NULL, NULL}
+};
+
 // 注册接口调用
 void RegisterApi_CmsisDap(lua_State *L){
 	// 创建CMSIS-DAP类型对应的元表
 	LuaApiNewTypeMetatable(L, CMDAP_LUA_OBJECT_TYPE, luaApi_cmsis_dap_gc, lib_cmdap_oo);
+	LuaApiNewTypeMetatable(L, DAP_PROGRAM_LUA_OBJECT_TYPE, luaApi_dap_program_gc, lib_dap_program_oo);
 	luaL_requiref(L, "CMSIS-DAP", luaopen_cmsis_dap, 0);
 	lua_pop(L, 1);
 }
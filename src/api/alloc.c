@@ -0,0 +1,325 @@
+/*
+ * alloc.c
+ *
+ *  Created on: 2019-7-3
+ *      Author: virusv
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "smart_ocd.h"
+#include "misc/log.h"
+
+#include "api/api.h"
+
+/**
+ * Lua状态机的内存分配器
+ * system:和luaL_newstate一样使用realloc/free
+ * pool:不超过POOL_MAX_SIZE的小块按16字节分级,释放的块挂到对应级别的空闲链表中,
+ * 空闲链表为空时从arena中顺序切出新块,arena在状态机关闭时整体释放;大块仍然使用realloc/free。
+ * Lua的表节点、短字符串、闭包和userdata头大部分都是小块,频繁的创建和回收不再经过malloc
+ * 两种分配器都统计分配次数和内存用量,用Allocator.Stats()查看,便于在同一个脚本上比较
+ * 分配器不是线程安全的,只能在Lua状态机所在的线程中使用
+ */
+#define POOL_GRANULE 16	// 小块的对齐和分级粒度
+#define POOL_MAX_SIZE 512	// 小块的最大字节数
+#define POOL_CLASSES (POOL_MAX_SIZE / POOL_GRANULE)
+#define POOL_ARENA_SIZE (64 * 1024)	// 每次向系统申请的arena大小
+
+// pool分配器默认的GC参数:小块分配便宜,降低GC频率,每一步多做一些工作
+#define POOL_GC_PAUSE 300
+#define POOL_GC_STEPMUL 400
+
+struct freeBlock {
+	struct freeBlock *next;
+};
+
+struct arena {
+	struct arena *next;
+	uint8_t *bump;	// 下一个可分配的位置
+	uint8_t *end;
+};
+
+struct allocStats {
+	uint64_t allocs;	// 分配次数
+	uint64_t frees;	// 释放次数
+	uint64_t reallocs;	// 改变大小的次数
+	uint64_t poolHits;	// 从空闲链表取得的小块
+	uint64_t arenaAllocs;	// 从arena切出的小块
+	uint64_t largeAllocs;	// 使用malloc的大块
+	uint64_t gcCycles;	// 完成的GC周期
+	size_t inUse;	// Lua使用中的字节数
+	size_t peak;	// inUse的峰值
+	size_t arenaBytes;	// arena占用的字节数
+};
+
+struct luaAllocator {
+	const char *name;
+	BOOL pooled;
+	struct freeBlock *freeList[POOL_CLASSES];
+	struct arena *arenas;
+	struct allocStats stats;
+};
+
+static void *systemAlloc(void *ud, void *ptr, size_t osize, size_t nsize){
+	struct luaAllocator *allocator = ud;
+	void *block;
+	if(ptr == NULL) osize = 0;	// ptr为NULL时osize是对象类型
+	if(nsize == 0){
+		if(ptr == NULL) return NULL;
+		free(ptr);
+		allocator->stats.frees++;
+		allocator->stats.inUse -= osize;
+		return NULL;
+	}
+	block = realloc(ptr, nsize);
+	if(block == NULL) return NULL;
+	if(ptr == NULL){
+		allocator->stats.allocs++;
+	}else{
+		allocator->stats.reallocs++;
+	}
+	allocator->stats.inUse += nsize - osize;
+	if(allocator->stats.inUse > allocator->stats.peak){
+		allocator->stats.peak = allocator->stats.inUse;
+	}
+	return block;
+}
+
+/**
+ * 分配一个小块
+ * idx:级别,块大小为(idx + 1) * POOL_GRANULE
+ */
+static void *poolGet(struct luaAllocator *allocator, unsigned int idx){
+	struct freeBlock *block = allocator->freeList[idx];
+	struct arena *arena = allocator->arenas;
+	size_t size = (idx + 1) * POOL_GRANULE;
+	if(block){
+		allocator->freeList[idx] = block->next;
+		allocator->stats.poolHits++;
+		return block;
+	}
+	if(arena == NULL || (size_t)(arena->end - arena->bump) < size){
+		// 旧arena剩下的空间不足一块,直接放弃
+		arena = malloc(POOL_ARENA_SIZE);
+		if(arena == NULL) return NULL;
+		arena->bump = CAST(uint8_t *, arena) + ((sizeof(struct arena) + POOL_GRANULE - 1) & ~(POOL_GRANULE - 1));
+		arena->end = CAST(uint8_t *, arena) + POOL_ARENA_SIZE;
+		arena->next = allocator->arenas;
+		allocator->arenas = arena;
+		allocator->stats.arenaBytes += POOL_ARENA_SIZE;
+	}
+	block = CAST(struct freeBlock *, arena->bump);
+	arena->bump += size;
+	allocator->stats.arenaAllocs++;
+	return block;
+}
+
+static void poolPut(struct luaAllocator *allocator, unsigned int idx, void *ptr){
+	struct freeBlock *block = ptr;
+	block->next = allocator->freeList[idx];
+	allocator->freeList[idx] = block;
+}
+
+static void *poolAlloc(void *ud, void *ptr, size_t osize, size_t nsize){
+	struct luaAllocator *allocator = ud;
+	unsigned int oidx, nidx;
+	void *block;
+	if(ptr == NULL) osize = 0;	// ptr为NULL时osize是对象类型
+	oidx = (osize - 1) / POOL_GRANULE;	// 只在osize不为0时使用
+	nidx = (nsize - 1) / POOL_GRANULE;
+	if(nsize == 0){
+		if(ptr == NULL) return NULL;
+		if(osize <= POOL_MAX_SIZE){
+			poolPut(allocator, oidx, ptr);
+		}else{
+			free(ptr);
+		}
+		allocator->stats.frees++;
+		allocator->stats.inUse -= osize;
+		return NULL;
+	}
+	if(ptr != NULL && osize <= POOL_MAX_SIZE && nsize <= POOL_MAX_SIZE && oidx == nidx){
+		// 同一个级别,不需要移动
+		block = ptr;
+	}else if(ptr != NULL && osize > POOL_MAX_SIZE && nsize > POOL_MAX_SIZE){
+		block = realloc(ptr, nsize);
+		if(block == NULL) return NULL;
+	}else{
+		if(nsize <= POOL_MAX_SIZE){
+			block = poolGet(allocator, nidx);
+		}else{
+			block = malloc(nsize);
+			allocator->stats.largeAllocs++;
+		}
+		if(block == NULL) return NULL;
+		if(ptr != NULL){
+			memcpy(block, ptr, osize < nsize ? osize : nsize);
+			if(osize <= POOL_MAX_SIZE){
+				poolPut(allocator, oidx, ptr);
+			}else{
+				free(ptr);
+			}
+		}
+	}
+	if(ptr == NULL){
+		allocator->stats.allocs++;
+	}else{
+		allocator->stats.reallocs++;
+	}
+	allocator->stats.inUse += nsize - osize;
+	if(allocator->stats.inUse > allocator->stats.peak){
+		allocator->stats.peak = allocator->stats.inUse;
+	}
+	return block;
+}
+
+static int panic(lua_State *L){
+	log_fatal("PANIC: unprotected error in call to Lua API (%s)", lua_tostring(L, -1));
+	return 0;
+}
+
+/**
+ * 创建Lua状态机
+ * 参数:
+ * 	allocator:分配器名称,"pool"或者"system",NULL使用pool
+ * 返回:
+ * 	Lua状态机,分配器名称不正确或者内存不足时返回NULL
+ */
+lua_State *LuaApiNewState(const char *allocator){
+	struct luaAllocator *luaAllocator;
+	lua_State *L;
+	luaAllocator = calloc(1, sizeof(struct luaAllocator));
+	if(luaAllocator == NULL) return NULL;
+	if(allocator == NULL || strcmp(allocator, "pool") == 0){
+		luaAllocator->name = "pool";
+		luaAllocator->pooled = TRUE;
+		L = lua_newstate(poolAlloc, luaAllocator);
+	}else if(strcmp(allocator, "system") == 0){
+		luaAllocator->name = "system";
+		L = lua_newstate(systemAlloc, luaAllocator);
+	}else{
+		log_error("Unknown allocator: %s.", allocator);
+		free(luaAllocator);
+		return NULL;
+	}
+	if(L == NULL){
+		free(luaAllocator);
+		return NULL;
+	}
+	lua_atpanic(L, panic);
+	if(luaAllocator->pooled){
+		lua_gc(L, LUA_GCSETPAUSE, POOL_GC_PAUSE);
+		lua_gc(L, LUA_GCSETSTEPMUL, POOL_GC_STEPMUL);
+	}
+	return L;
+}
+
+/**
+ * 关闭Lua状态机,释放分配器
+ */
+void LuaApiCloseState(lua_State *L){
+	struct luaAllocator *luaAllocator;
+	struct arena *arena, *next;
+	lua_getallocf(L, CAST(void **, &luaAllocator));
+	lua_close(L);
+	for(arena = luaAllocator->arenas; arena; arena = next){
+		next = arena->next;
+		free(arena);
+	}
+	free(luaAllocator);
+}
+
+/**
+ * GC周期计数:哨兵对象被回收时计数加一,并创建下一个哨兵
+ */
+static int luaApi_alloc_sentinel_gc(lua_State *L){
+	struct luaAllocator *luaAllocator;
+	lua_getallocf(L, CAST(void **, &luaAllocator));
+	luaAllocator->stats.gcCycles++;
+	lua_newuserdata(L, 0);
+	luaL_setmetatable(L, "Allocator.Sentinel");
+	return 0;
+}
+
+/**
+ * 取得内存分配和GC的统计信息
+ * 返回:
+ * 1#:统计信息表
+ */
+static int luaApi_alloc_stats(lua_State *L){
+	struct luaAllocator *luaAllocator;
+	lua_getallocf(L, CAST(void **, &luaAllocator));
+	lua_createtable(L, 0, 16);
+	lua_pushstring(L, luaAllocator->name);
+	lua_setfield(L, -2, "Allocator");
+	lua_pushinteger(L, (lua_Integer)luaAllocator->stats.allocs);
+	lua_setfield(L, -2, "Allocs");
+	lua_pushinteger(L, (lua_Integer)luaAllocator->stats.frees);
+	lua_setfield(L, -2, "Frees");
+	lua_pushinteger(L, (lua_Integer)luaAllocator->stats.reallocs);
+	lua_setfield(L, -2, "Reallocs");
+	lua_pushinteger(L, (lua_Integer)luaAllocator->stats.poolHits);
+	lua_setfield(L, -2, "PoolHits");
+	lua_pushinteger(L, (lua_Integer)luaAllocator->stats.arenaAllocs);
+	lua_setfield(L, -2, "ArenaAllocs");
+	lua_pushinteger(L, (lua_Integer)luaAllocator->stats.largeAllocs);
+	lua_setfield(L, -2, "LargeAllocs");
+	lua_pushinteger(L, (lua_Integer)luaAllocator->stats.inUse);
+	lua_setfield(L, -2, "InUse");
+	lua_pushinteger(L, (lua_Integer)luaAllocator->stats.peak);
+	lua_setfield(L, -2, "Peak");
+	lua_pushinteger(L, (lua_Integer)luaAllocator->stats.arenaBytes);
+	lua_setfield(L, -2, "ArenaBytes");
+	lua_pushinteger(L, (lua_Integer)luaAllocator->stats.gcCycles);
+	lua_setfield(L, -2, "GcCycles");
+	lua_pushinteger(L, lua_gc(L, LUA_GCCOUNT, 0) * 1024 + lua_gc(L, LUA_GCCOUNTB, 0));
+	lua_setfield(L, -2, "GcBytes");
+	return 1;
+}
+
+/**
+ * 清零分配次数和GC周期计数,峰值重置为当前用量
+ */
+static int luaApi_alloc_reset(lua_State *L){
+	struct luaAllocator *luaAllocator;
+	size_t inUse, arenaBytes;
+	lua_getallocf(L, CAST(void **, &luaAllocator));
+	inUse = luaAllocator->stats.inUse;
+	arenaBytes = luaAllocator->stats.arenaBytes;
+	memset(&luaAllocator->stats, 0x0, sizeof(struct allocStats));
+	luaAllocator->stats.inUse = inUse;
+	luaAllocator->stats.peak = inUse;
+	luaAllocator->stats.arenaBytes = arenaBytes;
+	return 0;
+}
+
+// 模块静态函数
+static const luaL_Reg lib_alloc_f[] = {
+	{"Stats", luaApi_alloc_stats},
+	{"Reset", luaApi_alloc_reset},
+	{NULL, NULL}
+};
+
+// 哨兵对象没有方法
+static const luaL_Reg lib_alloc_sentinel_oo[] = {
+	{NULL, NULL}
+};
+
+int luaopen_allocator (lua_State *L) {
+	lua_createtable(L, 0, 0);
+	luaL_setfuncs(L, lib_alloc_f, 0);
+	return 1;
+}
+
+// 注册接口调用
+void RegisterApi_Allocator(lua_State *L){
+	LuaApiNewTypeMetatable(L, "Allocator.Sentinel", luaApi_alloc_sentinel_gc, lib_alloc_sentinel_oo);
+	lua_pop(L, 1);
+	// 第一个哨兵
+	lua_newuserdata(L, 0);
+	luaL_setmetatable(L, "Allocator.Sentinel");
+	lua_pop(L, 1);
+	luaL_requiref(L, "Allocator", luaopen_allocator, 0);
+	lua_pop(L, 1);
+}
@@ -8,18 +8,36 @@
 #include "smart_ocd.h"
 #include "api/api.h"
 
+extern void RegisterApi_Buffer(lua_State *L);
+extern void RegisterApi_Async(lua_State *L);
+extern void RegisterApi_Loader(lua_State *L);
+extern void RegisterApi_Allocator(lua_State *L);
 extern void RegisterApi_Adapter(lua_State *L);
 extern void RegisterApi_CmsisDap(lua_State *L);
 extern void RegisterApi_ADIv5(lua_State *L);
+extern void RegisterApi_STM32F4(lua_State *L);
+extern void RegisterApi_SVD(lua_State *L);
+extern void RegisterApi_Symbols(lua_State *L);
+extern void RegisterApi_Watch(lua_State *L);
+extern void RegisterApi_Profiler(lua_State *L);
 
 /**
  * 初始化Lua接口
  */
 void LuaApiInit(lua_State *L){
+	RegisterApi_Loader(L);
+	RegisterApi_Allocator(L);
+	RegisterApi_Buffer(L);
+	RegisterApi_Async(L);
 	RegisterApi_Adapter(L);
 	// 注册cmsis-dap仿真器库函数
 	RegisterApi_CmsisDap(L);
 	RegisterApi_ADIv5(L);
+	RegisterApi_STM32F4(L);
+	RegisterApi_SVD(L);
+	RegisterApi_Symbols(L);
+	RegisterApi_Watch(L);
+	RegisterApi_Profiler(L);
 }
 
 /**
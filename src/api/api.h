@@ -9,10 +9,12 @@
 #define SRC_API_API_H_
 
 #include <string.h>
+#include <stdint.h>
 
 #include "lua/src/lua.h"
 #include "lua/src/lauxlib.h"
 #include "lua/src/lualib.h"
+#include "misc/async.h"
 
 typedef struct {
 	char *name;
@@ -27,7 +29,43 @@ typedef struct {
  */
 void LuaApiInit(lua_State *L);
 
+/**
+ * 创建和关闭Lua状态机
+ * allocator:内存分配器,"pool"(默认)使用分级空闲链表的内存池,"system"使用realloc
+ */
+lua_State *LuaApiNewState(const char *allocator);
+void LuaApiCloseState(lua_State *L);
+
 void LuaApiRegConstant(lua_State *L, const luaApi_regConst *c);
 
 void LuaApiNewTypeMetatable(lua_State *L, const char *tname, lua_CFunction gc, const luaL_Reg *oo);
+
+/**
+ * 加载脚本文件,优先使用缓存的字节码,用法同luaL_loadfile
+ * dofile和require也使用字节码缓存
+ */
+int LuaApiLoadFile(lua_State *L, const char *path);
+
+/**
+ * Buffer对象
+ * 块读写、JTAG交换和DAP多次读写的数据参数可以是Buffer或者字符串,
+ * 输出参数可以传入Buffer,数据直接写入Buffer中
+ */
+#define BUFFER_LUA_OBJECT_TYPE "Buffer"
+
+uint8_t *LuaApiNewBuffer(lua_State *L, size_t size);
+uint8_t *LuaApiToBuffer(lua_State *L, int idx, size_t *size);
+const uint8_t *LuaApiCheckBytes(lua_State *L, int idx, size_t *size);
+uint8_t *LuaApiOptBuffer(lua_State *L, int idx, size_t size);
+
+/**
+ * 异步接口
+ * 绑定函数用LuaApiNewAsyncJob创建任务,LuaApiAsyncAwait提交并yield当前协程,
+ * 在延续函数中用LuaApiAsyncResult取得任务函数的返回值
+ * 同步接口访问设备之前用LuaApiAsyncCheckIdle检查设备上没有未完成的任务,也没有被后台线程占用
+ */
+void *LuaApiNewAsyncJob(lua_State *L, ASYNC_JOB_FUNC func, size_t size, int first, int last);
+int LuaApiAsyncAwait(lua_State *L, int idx, void *device, lua_KFunction k);
+int LuaApiAsyncResult(lua_State *L, lua_KContext ctx, void **context);
+void LuaApiAsyncCheckIdle(lua_State *L, void *device);
 #endif /* SRC_API_API_H_ */
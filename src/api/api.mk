@@ -5,4 +5,6 @@ endif
 # 把当前目录加到头文件目录集合中
 SMARTOCD_SRC_FILES += $(wildcard $(ROOT_DIR)/src/api/*.c)
 SMARTOCD_SRC_FILES += $(wildcard $(ROOT_DIR)/src/api/adapter/*.c)
-SMARTOCD_SRC_FILES += $(wildcard $(ROOT_DIR)/src/api/arch/ARM/ADI/*.c)
\ No newline at end of file
+SMARTOCD_SRC_FILES += $(wildcard $(ROOT_DIR)/src/api/arch/ARM/ADI/*.c)
+SMARTOCD_SRC_FILES += $(wildcard $(ROOT_DIR)/src/api/arch/ARM/STM32/*.c)
+SMARTOCD_SRC_FILES += $(wildcard $(ROOT_DIR)/src/api/arch/ARM/CMSIS/*.c)
\ No newline at end of file
@@ -12,20 +12,7 @@
 #include "arch/ARM/ADI/include/ADIv5.h"
 
 #include "api/api.h"
-
-#define ADIV5_LUA_OBJECT_TYPE "arch.ARM.ADIv5"
-#define ADIV5_AP_MEM_LUA_OBJECT_TYPE "arch.ARM.ADIv5.AccessPort.Memory"
-#define ADIV5_AP_JTAG_LUA_OBJECT_TYPE "arch.ARM.ADIv5.AccessPort.Jtag"
-
-struct luaApi_dap {
-	int adapterRef;	// adapter的Lua对象引用
-	DAP dap;	// DAP 对象
-};
-
-struct luaApi_accessPort {
-	int reference;	// lua_dap对象的reference
-	AccessPort ap;	// AP对象
-};
+#include "api/arch/ARM/ADI/ADIv5_api.h"
 
 /**
  * 检查是否是Adapter对象
@@ -53,10 +40,71 @@ static void *checkAdapter (lua_State *L, int ud) {
 	return NULL;  /* value is not a userdata with a metatable */
 }
 
+/**
+ * 取得Adapter对象,异步任务按Adapter排队执行
+ * adapterRef:Adapter对象的reference
+ */
+static void *luaApi_adiv5_adapter_device(lua_State *L, int adapterRef){
+	Adapter adapterObj;
+	lua_rawgeti(L, LUA_REGISTRYINDEX, adapterRef);	// +1
+	adapterObj = *CAST(Adapter *, lua_touserdata(L, -1));
+	lua_pop(L, 1);
+	return adapterObj;
+}
+
+/**
+ * 取得AccessPort所在的Adapter对象
+ * dapRef:DAP对象的reference
+ */
+static void *luaApi_adiv5_async_device(lua_State *L, int dapRef){
+	struct luaApi_dap *dapObj;
+	lua_rawgeti(L, LUA_REGISTRYINDEX, dapRef);	// +1
+	dapObj = lua_touserdata(L, -1);
+	lua_pop(L, 1);	// AccessPort持有DAP对象的引用
+	return luaApi_adiv5_adapter_device(L, dapObj->adapterRef);
+}
+
+/**
+ * 检查DAP对象并确认Adapter空闲
+ */
+struct luaApi_dap *LuaApiAdiv5CheckDap(lua_State *L, int idx){
+	struct luaApi_dap *dapObj = CAST(struct luaApi_dap *, luaL_checkudata(L, idx, ADIV5_LUA_OBJECT_TYPE));
+	LuaApiAsyncCheckIdle(L, luaApi_adiv5_adapter_device(L, dapObj->adapterRef));
+	return dapObj;
+}
+
+/**
+ * 检查AccessPort对象并确认Adapter空闲
+ */
+struct luaApi_accessPort *LuaApiAdiv5CheckAp(lua_State *L, int idx){
+	struct luaApi_accessPort *luaApObj = luaL_checkudata(L, idx, ADIV5_AP_MEM_LUA_OBJECT_TYPE);
+	LuaApiAsyncCheckIdle(L, luaApi_adiv5_async_device(L, luaApObj->reference));
+	return luaApObj;
+}
+
+/**
+ * 持有AccessPort引用的对象(批量读程序、Flash、SVD Device等)访问目标之前调用
+ */
+struct luaApi_accessPort *LuaApiAdiv5CheckApRef(lua_State *L, int apRef){
+	struct luaApi_accessPort *luaApObj;
+	lua_rawgeti(L, LUA_REGISTRYINDEX, apRef);	// +1
+	luaApObj = LuaApiAdiv5CheckAp(L, -1);
+	lua_pop(L, 1);
+	return luaApObj;
+}
+
+/**
+ * 取得AccessPort所在的Adapter对象,监视、采样线程用它占用Adapter
+ */
+void *LuaApiAdiv5ApDevice(lua_State *L, struct luaApi_accessPort *luaApObj){
+	return luaApi_adiv5_async_device(L, luaApObj->reference);
+}
+
 /**
  * 创建DAP对象
  * 参数:
  * 1# Adapter对象
+ * 2# SWD multi-drop目标的TARGETSEL值(Optional),不指定则为点对点连接
  * 返回值:
  * 1# DAP对象
  * 失败抛出错误
@@ -67,15 +115,22 @@ static int luaApi_adiv5_create_dap(lua_State *L){
 		return luaL_error(L, "Not a vailed Adapter object!");
 	}
 	Adapter adapterObj = *CAST(Adapter *, udata);
+	// 在新建userdata之前取参数,之后栈上2#是DAP对象
+	BOOL multidrop = !lua_isnoneornil(L, 2);
+	uint32_t targetSel = multidrop ? (uint32_t)luaL_checkinteger(L, 2) : 0;
 
 	struct luaApi_dap *luaDap = lua_newuserdata(L, sizeof(struct luaApi_dap));	// +1
-	luaDap->dap = ADIv5_CreateDap(adapterObj);
+	if(!multidrop){
+		luaDap->dap = ADIv5_CreateDap(adapterObj);
+	}else{
+		luaDap->dap = ADIv5_CreateMultidropDap(adapterObj, targetSel);
+	}
 	if(luaDap->dap == NULL){
 		return luaL_error(L, "Failed to create ADIv5 DAP object.");
 	}
 	luaL_setmetatable(L, ADIV5_LUA_OBJECT_TYPE);
 	// adapter对象增加引用
-	lua_pushvalue(L, -1);
+	lua_pushvalue(L, 1);
 	luaDap->adapterRef = luaL_ref(L, LUA_REGISTRYINDEX);
 	return 1;	// 返回压到栈中的返回值个数
 }
@@ -90,7 +145,7 @@ static int luaApi_adiv5_create_dap(lua_State *L){
  * 	1# AP对象
  */
 static int luaApi_adiv5_find_access_port(lua_State *L){
-	struct luaApi_dap* dapObj = CAST(struct luaApi_dap *, luaL_checkudata(L, 1, ADIV5_LUA_OBJECT_TYPE));
+	struct luaApi_dap* dapObj = LuaApiAdiv5CheckDap(L, 1);
 	int type = luaL_checkinteger(L, 2);
 	int bus = luaL_optinteger(L, 3, 0);
 	// 创建AP对象
@@ -110,6 +165,279 @@ static int luaApi_adiv5_find_access_port(lua_State *L){
 	return 1;
 }
 
+/**
+ * 把组件树压入Lua栈
+ */
+static void pushCoresightComponent(lua_State *L, const struct coresightComponent *comp){
+	unsigned int idx;
+	lua_createtable(L, 0, 12);
+	lua_pushinteger(L, comp->base);
+	lua_setfield(L, -2, "Base");
+	lua_pushinteger(L, comp->size);
+	lua_setfield(L, -2, "Size");
+	lua_pushinteger(L, comp->cid);
+	lua_setfield(L, -2, "CID");
+	lua_pushinteger(L, comp->pid);
+	lua_setfield(L, -2, "PID");
+	lua_pushinteger(L, comp->componentClass);
+	lua_setfield(L, -2, "Class");
+	lua_pushinteger(L, comp->partNumber);
+	lua_setfield(L, -2, "PartNumber");
+	lua_pushinteger(L, comp->designer);
+	lua_setfield(L, -2, "Designer");
+	lua_pushinteger(L, comp->revision);
+	lua_setfield(L, -2, "Revision");
+	lua_pushinteger(L, comp->devType);
+	lua_setfield(L, -2, "DevType");
+	lua_pushinteger(L, comp->devArch);
+	lua_setfield(L, -2, "DevArch");
+	lua_pushboolean(L, comp->valid);
+	lua_setfield(L, -2, "Valid");
+	lua_createtable(L, comp->childCount, 0);
+	for(idx = 0; idx < comp->childCount; idx++){
+		pushCoresightComponent(L, &comp->children[idx]);
+		lua_rawseti(L, -2, idx + 1);
+	}
+	lua_setfield(L, -2, "Children");
+}
+
+/**
+ * 遍历MEM-AP的ROM Table
+ * 参数:
+ * 	1# DAP对象
+ * 	2# MEM-AP对象
+ * 返回:
+ * 	1# 根组件,字段:Base,Size,CID,PID,Class,PartNumber,Designer,Revision,DevType,DevArch,Valid,Children
+ */
+static int luaApi_adiv5_read_rom_table(lua_State *L){
+	struct luaApi_dap* dapObj = LuaApiAdiv5CheckDap(L, 1);
+	struct luaApi_accessPort *luaApObj = LuaApiAdiv5CheckAp(L, 2);
+	const struct coresightComponent *root;
+	if(dapObj->dap->ReadRomTable(dapObj->dap, luaApObj->ap, &root) != ADI_SUCCESS){
+		return luaL_error(L, "Failed to read ROM Table.");
+	}
+	pushCoresightComponent(L, root);
+	return 1;
+}
+
+/**
+ * 读取区域描述表中的整数字段
+ */
+static lua_Integer regionField(lua_State *L, int idx, const char *name, BOOL required, lua_Integer def){
+	lua_Integer value = def;
+	int type = lua_getfield(L, idx, name);
+	if(type == LUA_TNUMBER){
+		value = lua_tointeger(L, -1);
+	}else if(type != LUA_TNIL || required){
+		return luaL_error(L, "Memory region field '%s' must be an integer.", name);
+	}
+	lua_pop(L, 1);
+	return value;
+}
+
+/**
+ * 添加内存映射的区域
+ * 1#:DAP对象
+ * 2#:区域描述表 {Base, Size, AP, Widths, Type, MaxBurst, Cache}
+ * 	Base,Size:必须
+ * 	AP:MEM-AP的索引,默认0
+ * 	Widths:Width_8/16/32的组合,默认AP支持的所有宽度
+ * 	Type:Memory_Normal或Memory_Device,默认Memory_Normal
+ * 	MaxBurst:一次地址自增传输的最大字节数,默认不限制
+ * 	Cache:Cache_*,默认Cache_Uncached
+ */
+static int luaApi_adiv5_memory_region(lua_State *L){
+	struct luaApi_dap* dapObj = LuaApiAdiv5CheckDap(L, 1);
+	struct memoryRegion region;
+	luaL_checktype(L, 2, LUA_TTABLE);
+	region.base = (uint64_t)regionField(L, 2, "Base", TRUE, 0);
+	region.size = (uint64_t)regionField(L, 2, "Size", TRUE, 0);
+	region.apIndex = (unsigned int)regionField(L, 2, "AP", FALSE, 0);
+	region.widths = (unsigned int)regionField(L, 2, "Widths", FALSE, 0);
+	region.type = (enum memoryType)regionField(L, 2, "Type", FALSE, MemoryType_Normal);
+	region.maxBurst = (unsigned int)regionField(L, 2, "MaxBurst", FALSE, 0);
+	region.cache = (enum cachePolicy)regionField(L, 2, "Cache", FALSE, CachePolicy_Uncached);
+	if(dapObj->dap->AddMemoryRegion(dapObj->dap, &region) != ADI_SUCCESS){
+		return luaL_error(L, "Failed to add memory region 0x%I.", (lua_Integer)region.base);
+	}
+	return 0;
+}
+
+/**
+ * 清空内存映射
+ * 1#:DAP对象
+ */
+static int luaApi_adiv5_clear_memory_map(lua_State *L){
+	struct luaApi_dap* dapObj = LuaApiAdiv5CheckDap(L, 1);
+	dapObj->dap->ClearMemoryMap(dapObj->dap);
+	return 0;
+}
+
+/**
+ * 规划一次访问,不访问目标
+ * 1#:DAP对象
+ * 2#:起始地址
+ * 3#:字节数
+ * 返回:
+ * 1#:步骤数组,每一步 {Addr, Len, Count, AP, Size, Mode, Type}
+ */
+static int luaApi_adiv5_plan_access(lua_State *L){
+	struct luaApi_dap* dapObj = LuaApiAdiv5CheckDap(L, 1);
+	uint64_t addr = (uint64_t)luaL_checkinteger(L, 2);
+	uint64_t len = (uint64_t)luaL_checkinteger(L, 3);
+	struct accessStep *steps;
+	unsigned int count, idx;
+	if(dapObj->dap->PlanAccess(dapObj->dap, addr, len, NULL, 0, &count) != ADI_SUCCESS){
+		return luaL_error(L, "Failed to plan access at 0x%I.", (lua_Integer)addr);
+	}
+	steps = lua_newuserdata(L, (count ? count : 1) * sizeof(struct accessStep));
+	dapObj->dap->PlanAccess(dapObj->dap, addr, len, steps, count, &count);
+	lua_createtable(L, count, 0);
+	for(idx = 0; idx < count; idx++){
+		lua_createtable(L, 0, 7);
+		lua_pushinteger(L, (lua_Integer)steps[idx].addr);
+		lua_setfield(L, -2, "Addr");
+		lua_pushinteger(L, steps[idx].len);
+		lua_setfield(L, -2, "Len");
+		lua_pushinteger(L, steps[idx].count);
+		lua_setfield(L, -2, "Count");
+		lua_pushinteger(L, steps[idx].apIndex);
+		lua_setfield(L, -2, "AP");
+		lua_pushinteger(L, steps[idx].size);
+		lua_setfield(L, -2, "Size");
+		lua_pushinteger(L, steps[idx].mode);
+		lua_setfield(L, -2, "Mode");
+		lua_pushinteger(L, steps[idx].type);
+		lua_setfield(L, -2, "Type");
+		lua_rawseti(L, -2, idx + 1);
+	}
+	return 1;
+}
+
+/**
+ * 按内存映射读内存
+ * 1#:DAP对象
+ * 2#:起始地址
+ * 3#:字节数
+ * 4#:存放数据的Buffer(可选),数据直接读到Buffer中
+ * 返回:
+ * 1#:读取的数据,传入Buffer时返回该Buffer,否则是字符串
+ */
+static int luaApi_adiv5_read_memory(lua_State *L){
+	struct luaApi_dap* dapObj = LuaApiAdiv5CheckDap(L, 1);
+	uint64_t addr = (uint64_t)luaL_checkinteger(L, 2);
+	size_t len = (size_t)luaL_checkinteger(L, 3);
+	BOOL toBuffer = !lua_isnoneornil(L, 4);
+	uint8_t *buff;
+	buff = LuaApiOptBuffer(L, 4, len);
+	if(dapObj->dap->ReadMemory(dapObj->dap, addr, len, buff) != ADI_SUCCESS){
+		return luaL_error(L, "Failed to read memory at 0x%I.", (lua_Integer)addr);
+	}
+	if(!toBuffer){
+		lua_pushlstring(L, CAST(const char *, buff), len);
+	}
+	return 1;
+}
+
+/**
+ * 按内存映射写内存
+ * 1#:DAP对象
+ * 2#:起始地址
+ * 3#:要写的数据(字符串或者Buffer)
+ */
+static int luaApi_adiv5_write_memory(lua_State *L){
+	struct luaApi_dap* dapObj = LuaApiAdiv5CheckDap(L, 1);
+	uint64_t addr = (uint64_t)luaL_checkinteger(L, 2);
+	size_t len;
+	const uint8_t *data = LuaApiCheckBytes(L, 3, &len);
+	if(dapObj->dap->WriteMemory(dapObj->dap, addr, len, data) != ADI_SUCCESS){
+		return luaL_error(L, "Failed to write memory at 0x%I.", (lua_Integer)addr);
+	}
+	return 0;
+}
+
+// 按内存映射读写内存的异步任务
+struct luaApi_memoryJob {
+	DAP dap;
+	uint64_t addr;
+	size_t len;
+	uint8_t *buff;
+	BOOL write;
+	BOOL toBuffer;	// 读操作是否返回传入的Buffer
+};
+
+static int luaApi_adiv5_memory_job(void *context){
+	struct luaApi_memoryJob *job = context;
+	if(job->write){
+		return job->dap->WriteMemory(job->dap, job->addr, job->len, job->buff);
+	}
+	return job->dap->ReadMemory(job->dap, job->addr, job->len, job->buff);
+}
+
+static int luaApi_adiv5_read_memory_k(lua_State *L, int status, lua_KContext ctx){
+	struct luaApi_memoryJob *job;
+	(void)status;
+	if(LuaApiAsyncResult(L, ctx, (void **)&job) != ADI_SUCCESS){
+		return luaL_error(L, "Failed to read memory at 0x%I.", (lua_Integer)job->addr);
+	}
+	if(job->toBuffer){
+		lua_pushvalue(L, 4);
+	}else{
+		lua_pushlstring(L, CAST(const char *, job->buff), job->len);
+	}
+	return 1;
+}
+
+/**
+ * 异步按内存映射读内存
+ * 在协程中调用时挂起协程,读取完成后返回;参数和返回值同ReadMemory
+ */
+static int luaApi_adiv5_read_memory_async(lua_State *L){
+	struct luaApi_dap* dapObj = CAST(struct luaApi_dap *, luaL_checkudata(L, 1, ADIV5_LUA_OBJECT_TYPE));
+	struct luaApi_memoryJob *job;
+	uint64_t addr = (uint64_t)luaL_checkinteger(L, 2);
+	size_t len = (size_t)luaL_checkinteger(L, 3);
+	// 没有传入Buffer时LuaApiOptBuffer会新建一个,要先记下
+	BOOL toBuffer = !lua_isnoneornil(L, 4);
+	uint8_t *buff = LuaApiOptBuffer(L, 4, len);	// +1
+	job = LuaApiNewAsyncJob(L, luaApi_adiv5_memory_job, sizeof(struct luaApi_memoryJob), 1, -1);	// +1
+	job->dap = dapObj->dap;
+	job->addr = addr;
+	job->len = len;
+	job->buff = buff;
+	job->write = FALSE;
+	job->toBuffer = toBuffer;
+	return LuaApiAsyncAwait(L, -1, luaApi_adiv5_adapter_device(L, dapObj->adapterRef), luaApi_adiv5_read_memory_k);
+}
+
+static int luaApi_adiv5_write_memory_k(lua_State *L, int status, lua_KContext ctx){
+	struct luaApi_memoryJob *job;
+	(void)status;
+	if(LuaApiAsyncResult(L, ctx, (void **)&job) != ADI_SUCCESS){
+		return luaL_error(L, "Failed to write memory at 0x%I.", (lua_Integer)job->addr);
+	}
+	return 0;
+}
+
+/**
+ * 异步按内存映射写内存
+ * 在协程中调用时挂起协程,写入完成后返回;参数同WriteMemory
+ */
+static int luaApi_adiv5_write_memory_async(lua_State *L){
+	struct luaApi_dap* dapObj = CAST(struct luaApi_dap *, luaL_checkudata(L, 1, ADIV5_LUA_OBJECT_TYPE));
+	struct luaApi_memoryJob *job;
+	uint64_t addr = (uint64_t)luaL_checkinteger(L, 2);
+	size_t len;
+	const uint8_t *data = LuaApiCheckBytes(L, 3, &len);
+	job = LuaApiNewAsyncJob(L, luaApi_adiv5_memory_job, sizeof(struct luaApi_memoryJob), 1, -1);	// +1
+	job->dap = dapObj->dap;
+	job->addr = addr;
+	job->len = len;
+	job->buff = CAST(uint8_t *, data);
+	job->write = TRUE;
+	return LuaApiAsyncAwait(L, -1, luaApi_adiv5_adapter_device(L, dapObj->adapterRef), luaApi_adiv5_write_memory_k);
+}
+
 /**
  * 返回当前AP的rom table
  * 1#：Adapter对象
@@ -117,7 +445,7 @@ static int luaApi_adiv5_find_access_port(lua_State *L){
  * 1#: rom table
  */
 static int luaApi_adiv5_ap_mem_rom_table(lua_State *L){
-	struct luaApi_accessPort *luaApObj = luaL_checkudata(L, 1, ADIV5_AP_MEM_LUA_OBJECT_TYPE);
+	struct luaApi_accessPort *luaApObj = LuaApiAdiv5CheckAp(L, 1);
 	if(luaApObj->ap->type != AccessPort_Memory){
 		return luaL_error(L, "Not a memory access port.");
 	}
@@ -134,7 +462,7 @@ static int luaApi_adiv5_ap_mem_rom_table(lua_State *L){
  * 1#：数据
  */
 static int luaApi_adiv5_ap_mem_csw(lua_State *L){
-	struct luaApi_accessPort *luaApObj = luaL_checkudata(L, 1, ADIV5_AP_MEM_LUA_OBJECT_TYPE);
+	struct luaApi_accessPort *luaApObj = LuaApiAdiv5CheckAp(L, 1);
 	uint32_t data = 0;
 	if(luaApObj->ap->type != AccessPort_Memory){
 		return luaL_error(L, "Not a memory access port.");
@@ -160,7 +488,7 @@ static int luaApi_adiv5_ap_mem_csw(lua_State *L){
  * 返回：空
  */
 static int luaApi_adiv5_ap_mem_abort(lua_State *L){
-	struct luaApi_accessPort *luaApObj = luaL_checkudata(L, 1, ADIV5_AP_MEM_LUA_OBJECT_TYPE);
+	struct luaApi_accessPort *luaApObj = LuaApiAdiv5CheckAp(L, 1);
 	if(luaApObj->ap->type != AccessPort_Memory){
 		return luaL_error(L, "Not a memory access port.");
 	}
@@ -180,7 +508,7 @@ static int luaApi_adiv5_ap_mem_abort(lua_State *L){
  * 1#：数据
  */
 static int luaApi_adiv5_ap_mem_rw_8(lua_State *L){
-	struct luaApi_accessPort *luaApObj = luaL_checkudata(L, 1, ADIV5_AP_MEM_LUA_OBJECT_TYPE);
+	struct luaApi_accessPort *luaApObj = LuaApiAdiv5CheckAp(L, 1);
 	uint64_t addr = luaL_checkinteger(L, 2);
 	uint8_t data = 0;
 	if(luaApObj->ap->type != AccessPort_Memory){
@@ -202,7 +530,7 @@ static int luaApi_adiv5_ap_mem_rw_8(lua_State *L){
 }
 
 static int luaApi_adiv5_ap_mem_rw_16(lua_State *L){
-	struct luaApi_accessPort *luaApObj = luaL_checkudata(L, 1, ADIV5_AP_MEM_LUA_OBJECT_TYPE);
+	struct luaApi_accessPort *luaApObj = LuaApiAdiv5CheckAp(L, 1);
 	uint64_t addr = luaL_checkinteger(L, 2);
 	uint16_t data = 0;
 	if(luaApObj->ap->type != AccessPort_Memory){
@@ -224,7 +552,7 @@ static int luaApi_adiv5_ap_mem_rw_16(lua_State *L){
 }
 
 static int luaApi_adiv5_ap_mem_rw_32(lua_State *L){
-	struct luaApi_accessPort *luaApObj = luaL_checkudata(L, 1, ADIV5_AP_MEM_LUA_OBJECT_TYPE);
+	struct luaApi_accessPort *luaApObj = LuaApiAdiv5CheckAp(L, 1);
 	uint64_t addr = luaL_checkinteger(L, 2);
 	uint32_t data;
 	if(luaApObj->ap->type != AccessPort_Memory){
@@ -245,6 +573,203 @@ static int luaApi_adiv5_ap_mem_rw_32(lua_State *L){
 	}
 }
 
+/**
+ * 从Lua数组解析批量访问的各项
+ * 数组元素是地址,或者{地址, [数据,] 宽度}形式的表,没有宽度时使用defSize
+ * 参数:
+ * 	idx:数组在栈中的位置
+ * 	write:表中是否带有数据
+ * 返回:
+ * 	用lua_newuserdata分配的数组,留在栈顶
+ */
+static struct memoryAccess *luaApi_adiv5_check_access(lua_State *L, int idx, enum dataSize defSize, BOOL write, unsigned int *countOut){
+	unsigned int count, pos;
+	struct memoryAccess *access;
+	luaL_checktype(L, idx, LUA_TTABLE);
+	count = (unsigned int)lua_rawlen(L, idx);
+	access = lua_newuserdata(L, (count ? count : 1) * sizeof(struct memoryAccess));
+	for(pos = 0; pos < count; pos++){
+		access[pos].size = defSize;
+		access[pos].data = 0;
+		if(lua_rawgeti(L, idx, pos + 1) == LUA_TTABLE){
+			lua_rawgeti(L, -1, 1);
+			access[pos].addr = (uint64_t)luaL_checkinteger(L, -1);
+			lua_pop(L, 1);
+			if(write){
+				lua_rawgeti(L, -1, 2);
+				access[pos].data = (uint64_t)luaL_checkinteger(L, -1);
+				lua_pop(L, 1);
+			}
+			if(lua_rawgeti(L, -1, write ? 3 : 2) != LUA_TNIL){
+				access[pos].size = (enum dataSize)luaL_checkinteger(L, -1);
+			}
+			lua_pop(L, 1);
+		}else if(write){
+			luaL_error(L, "Entry %d is not an {address, value} pair.", pos + 1);
+			return NULL;
+		}else{
+			access[pos].addr = (uint64_t)luaL_checkinteger(L, -1);
+		}
+		lua_pop(L, 1);
+	}
+	*countOut = count;
+	return access;
+}
+
+/**
+ * 批量读取不连续的地址,所有读操作一次提交
+ * 1#:AccessPort对象
+ * 2#:地址数组,元素是地址或者{地址, 宽度}
+ * 3#:默认宽度(可选,默认DataSize_32)
+ * 返回:
+ * 1#:读到的数据数组,和地址数组一一对应
+ */
+static int luaApi_adiv5_ap_read_many(lua_State *L){
+	struct luaApi_accessPort *luaApObj = LuaApiAdiv5CheckAp(L, 1);
+	enum dataSize defSize = (enum dataSize)luaL_optinteger(L, 3, DataSize_32);
+	unsigned int count, pos;
+	struct memoryAccess *access;
+	if(luaApObj->ap->type != AccessPort_Memory){
+		return luaL_error(L, "Not a memory access port.");
+	}
+	access = luaApi_adiv5_check_access(L, 2, defSize, FALSE, &count);
+	if(luaApObj->ap->Interface.Memory.ReadMany(luaApObj->ap, access, count) != ADI_SUCCESS){
+		return luaL_error(L, "Read %d memory locations failed!", count);
+	}
+	lua_createtable(L, count, 0);
+	for(pos = 0; pos < count; pos++){
+		lua_pushinteger(L, (lua_Integer)access[pos].data);
+		lua_rawseti(L, -2, pos + 1);
+	}
+	return 1;
+}
+
+/**
+ * 批量写入不连续的地址,按数组顺序写入,一次提交
+ * 1#:AccessPort对象
+ * 2#:数组,元素是{地址, 数据, [宽度]}
+ * 3#:默认宽度(可选,默认DataSize_32)
+ */
+static int luaApi_adiv5_ap_write_many(lua_State *L){
+	struct luaApi_accessPort *luaApObj = LuaApiAdiv5CheckAp(L, 1);
+	enum dataSize defSize = (enum dataSize)luaL_optinteger(L, 3, DataSize_32);
+	unsigned int count;
+	struct memoryAccess *access;
+	if(luaApObj->ap->type != AccessPort_Memory){
+		return luaL_error(L, "Not a memory access port.");
+	}
+	access = luaApi_adiv5_check_access(L, 2, defSize, TRUE, &count);
+	if(luaApObj->ap->Interface.Memory.WriteMany(luaApObj->ap, access, count) != ADI_SUCCESS){
+		return luaL_error(L, "Write %d memory locations failed!", count);
+	}
+	return 0;
+}
+
+/**
+ * 把批量读取编译成可以重复执行的程序,用于高频率采样一组固定的变量
+ * 1#:AccessPort对象
+ * 2#:地址数组,元素是地址或者{地址, 宽度}
+ * 3#:默认宽度(可选,默认DataSize_32)
+ * 返回:
+ * 1#:程序对象,用program:Run()执行,返回读到的数据数组
+ */
+static int luaApi_adiv5_ap_prepare_read(lua_State *L){
+	struct luaApi_accessPort *luaApObj = LuaApiAdiv5CheckAp(L, 1);
+	enum dataSize defSize = (enum dataSize)luaL_optinteger(L, 3, DataSize_32);
+	unsigned int count;
+	struct memoryAccess *access;
+	struct luaApi_memProgram *luaProgram;
+	if(luaApObj->ap->type != AccessPort_Memory){
+		return luaL_error(L, "Not a memory access port.");
+	}
+	access = luaApi_adiv5_check_access(L, 2, defSize, FALSE, &count);	// +1
+	luaProgram = lua_newuserdata(L, sizeof(struct luaApi_memProgram));	// +1
+	luaProgram->program = NULL;
+	luaProgram->reference = LUA_NOREF;
+	luaL_setmetatable(L, ADIV5_MEM_PROGRAM_LUA_OBJECT_TYPE);
+	if(luaApObj->ap->Interface.Memory.PrepareRead(luaApObj->ap, access, count, &luaProgram->program) != ADI_SUCCESS){
+		return luaL_error(L, "Failed to prepare the memory program.");
+	}
+	luaProgram->ap = luaApObj->ap;
+	luaProgram->count = count;
+	// 增加AccessPort的引用
+	lua_pushvalue(L, 1);
+	luaProgram->reference = luaL_ref(L, LUA_REGISTRYINDEX);
+	return 1;
+}
+
+/**
+ * 执行预编译的批量读程序
+ * 1#:程序对象
+ * 返回:
+ * 1#:读到的数据数组
+ */
+static int luaApi_adiv5_mem_program_run(lua_State *L){
+	struct luaApi_memProgram *luaProgram = luaL_checkudata(L, 1, ADIV5_MEM_PROGRAM_LUA_OBJECT_TYPE);
+	struct memoryAccess *access;
+	unsigned int pos;
+	LuaApiAdiv5CheckApRef(L, luaProgram->reference);
+	access = lua_newuserdata(L, luaProgram->count * sizeof(struct memoryAccess));
+	if(luaProgram->ap->Interface.Memory.RunProgram(luaProgram->ap, luaProgram->program, access) != ADI_SUCCESS){
+		return luaL_error(L, "Execute the memory program failed!");
+	}
+	lua_createtable(L, luaProgram->count, 0);
+	for(pos = 0; pos < luaProgram->count; pos++){
+		lua_pushinteger(L, (lua_Integer)access[pos].data);
+		lua_rawseti(L, -2, pos + 1);
+	}
+	return 1;
+}
+
+// 执行批量读程序的异步任务
+struct luaApi_memProgramJob {
+	AccessPort ap;
+	MemProgram program;
+	struct memoryAccess *access;
+};
+
+static int luaApi_adiv5_mem_program_job(void *context){
+	struct luaApi_memProgramJob *job = context;
+	return job->ap->Interface.Memory.RunProgram(job->ap, job->program, job->access);
+}
+
+static int luaApi_adiv5_mem_program_run_k(lua_State *L, int status, lua_KContext ctx){
+	struct luaApi_memProgram *luaProgram = lua_touserdata(L, 1);
+	struct luaApi_memProgramJob *job;
+	unsigned int pos;
+	(void)status;
+	if(LuaApiAsyncResult(L, ctx, (void **)&job) != ADI_SUCCESS){
+		return luaL_error(L, "Execute the memory program failed!");
+	}
+	lua_createtable(L, luaProgram->count, 0);
+	for(pos = 0; pos < luaProgram->count; pos++){
+		lua_pushinteger(L, (lua_Integer)job->access[pos].data);
+		lua_rawseti(L, -2, pos + 1);
+	}
+	return 1;
+}
+
+/**
+ * 异步执行预编译的批量读程序
+ * 在协程中调用时挂起协程,执行完成后返回;返回值同Run
+ */
+static int luaApi_adiv5_mem_program_run_async(lua_State *L){
+	struct luaApi_memProgram *luaProgram = luaL_checkudata(L, 1, ADIV5_MEM_PROGRAM_LUA_OBJECT_TYPE);
+	struct luaApi_accessPort *luaApObj;
+	struct luaApi_memProgramJob *job;
+	void *device;
+	lua_rawgeti(L, LUA_REGISTRYINDEX, luaProgram->reference);	// +1
+	luaApObj = lua_touserdata(L, -1);
+	device = luaApi_adiv5_async_device(L, luaApObj->reference);
+	lua_pop(L, 1);
+	lua_newuserdata(L, luaProgram->count * sizeof(struct memoryAccess));	// +1
+	job = LuaApiNewAsyncJob(L, luaApi_adiv5_mem_program_job, sizeof(struct luaApi_memProgramJob), 1, -1);	// +1
+	job->ap = luaProgram->ap;
+	job->program = luaProgram->program;
+	job->access = lua_touserdata(L, -2);
+	return LuaApiAsyncAwait(L, -1, device, luaApi_adiv5_mem_program_run_k);
+}
+
 /**
  * 读取内存块
  * 1#:Adapter对象
@@ -252,23 +777,32 @@ static int luaApi_adiv5_ap_mem_rw_32(lua_State *L){
  * 3#:地址自增模式
  * 4#:单次传输数据大小
  * 5#:读取多少次
+ * 6#:存放数据的Buffer(可选),数据直接读到Buffer中
  * 返回：
- * 1#:读取的数据 字符串形式
+ * 1#:读取的数据,传入Buffer时返回该Buffer,否则是字符串
  */
 static int luaApi_adiv5_ap_read_mem_block(lua_State *L){
-	struct luaApi_accessPort *luaApObj = luaL_checkudata(L, 1, ADIV5_AP_MEM_LUA_OBJECT_TYPE);
+	struct luaApi_accessPort *luaApObj = LuaApiAdiv5CheckAp(L, 1);
 	uint64_t addr = luaL_checkinteger(L, 2);
 	int addrIncMode = (int)luaL_checkinteger(L, 3);
 	int dataSize = (int)luaL_checkinteger(L, 4);
 	int transCnt = (int)luaL_checkinteger(L, 5);
+	BOOL toBuffer = !lua_isnoneornil(L, 6);
 	if(luaApObj->ap->type != AccessPort_Memory){
 		return luaL_error(L, "Not a memory access port.");
 	}
-	uint8_t *buff = (uint8_t *)lua_newuserdata(L, transCnt * sizeof(uint32_t));
+	uint8_t *buff = LuaApiOptBuffer(L, 6, transCnt * sizeof(uint32_t));
+	if((uintptr_t)buff & 0x3){
+		return luaL_error(L, "Buffer is not word aligned.");
+	}
+	struct transferStatus status;
 	if(luaApObj->ap->Interface.Memory.BlockRead(luaApObj->ap, addr, addrIncMode, dataSize, transCnt, buff) != ADI_SUCCESS){
-		return luaL_error(L, "Block read failed!");
+		luaApObj->ap->Interface.Memory.GetTransferStatus(luaApObj->ap, &status);
+		return luaL_error(L, "Block read failed! Last good address: %I.", (lua_Integer)status.lastGood);
+	}
+	if(!toBuffer){
+		lua_pushlstring(L, CAST(const char *, buff), transCnt * sizeof(uint32_t));
 	}
-	lua_pushlstring(L, CAST(const char *, buff), transCnt * sizeof(uint32_t));
 	return 1;
 }
 
@@ -278,27 +812,656 @@ static int luaApi_adiv5_ap_read_mem_block(lua_State *L){
  * 2#:要读取的地址
  * 3#:地址自增模式
  * 4#:单次传输数据大小
- * 5#:要写的数据（字符串）
+ * 5#:要写的数据（字符串或者Buffer）
  */
 static int luaApi_adiv5_ap_write_mem_block(lua_State *L){
-	struct luaApi_accessPort *luaApObj = luaL_checkudata(L, 1, ADIV5_AP_MEM_LUA_OBJECT_TYPE);
+	struct luaApi_accessPort *luaApObj = LuaApiAdiv5CheckAp(L, 1);
 	uint64_t addr = luaL_checkinteger(L, 2);
 	int addrIncMode = (int)luaL_checkinteger(L, 3);
 	int dataSize = (int)luaL_checkinteger(L, 4);
 	size_t transCnt;	// 注意size_t在在64位环境下是8字节，int在64位下是4字节
-	uint8_t *buff = (uint8_t *)lua_tolstring (L, 5, &transCnt);
+	uint8_t *buff = CAST(uint8_t *, LuaApiCheckBytes(L, 5, &transCnt));
 	if(luaApObj->ap->type != AccessPort_Memory){
 		return luaL_error(L, "Not a memory access port.");
 	}
+	if((uintptr_t)buff & 0x3){
+		return luaL_error(L, "Buffer is not word aligned.");
+	}
 	if(transCnt & 0x3){
 		return luaL_error(L, "The length of the data to be written is not a multiple of the word.");
 	}
+	struct transferStatus status;
 	if(luaApObj->ap->Interface.Memory.BlockWrite(luaApObj->ap, addr, addrIncMode, dataSize, (int)transCnt >> 2, buff) != ADI_SUCCESS){
-		return luaL_error(L, "Block write failed!");
+		luaApObj->ap->Interface.Memory.GetTransferStatus(luaApObj->ap, &status);
+		return luaL_error(L, "Block write failed! Last good address: %I.", (lua_Integer)status.lastGood);
+	}
+	return 0;
+}
+
+// 块读写的异步任务
+struct luaApi_blockJob {
+	AccessPort ap;
+	uint64_t addr;
+	int addrIncMode;
+	int dataSize;
+	int transCnt;
+	uint8_t *buff;
+	BOOL write;
+	BOOL toBuffer;	// 读操作是否返回传入的Buffer
+	uint64_t lastGood;	// 失败时最后一个成功传输的地址
+};
+
+static int luaApi_adiv5_block_job(void *context){
+	struct luaApi_blockJob *job = context;
+	struct transferStatus status;
+	int result;
+	if(job->write){
+		result = job->ap->Interface.Memory.BlockWrite(job->ap, job->addr, job->addrIncMode, job->dataSize, job->transCnt, job->buff);
+	}else{
+		result = job->ap->Interface.Memory.BlockRead(job->ap, job->addr, job->addrIncMode, job->dataSize, job->transCnt, job->buff);
+	}
+	if(result != ADI_SUCCESS){
+		job->ap->Interface.Memory.GetTransferStatus(job->ap, &status);
+		job->lastGood = status.lastGood;
+	}
+	return result;
+}
+
+static int luaApi_adiv5_ap_read_mem_block_k(lua_State *L, int status, lua_KContext ctx){
+	struct luaApi_blockJob *job;
+	(void)status;
+	if(LuaApiAsyncResult(L, ctx, (void **)&job) != ADI_SUCCESS){
+		return luaL_error(L, "Block read failed! Last good address: %I.", (lua_Integer)job->lastGood);
+	}
+	if(job->toBuffer){
+		lua_pushvalue(L, 6);
+	}else{
+		lua_pushlstring(L, CAST(const char *, job->buff), job->transCnt * sizeof(uint32_t));
+	}
+	return 1;
+}
+
+/**
+ * 异步读取内存块
+ * 在协程中调用时挂起协程,读取完成后返回;参数和返回值同BlockRead
+ */
+static int luaApi_adiv5_ap_read_mem_block_async(lua_State *L){
+	struct luaApi_accessPort *luaApObj = luaL_checkudata(L, 1, ADIV5_AP_MEM_LUA_OBJECT_TYPE);
+	struct luaApi_blockJob *job;
+	uint64_t addr = luaL_checkinteger(L, 2);
+	int addrIncMode = (int)luaL_checkinteger(L, 3);
+	int dataSize = (int)luaL_checkinteger(L, 4);
+	int transCnt = (int)luaL_checkinteger(L, 5);
+	BOOL toBuffer = !lua_isnoneornil(L, 6);
+	if(luaApObj->ap->type != AccessPort_Memory){
+		return luaL_error(L, "Not a memory access port.");
+	}
+	uint8_t *buff = LuaApiOptBuffer(L, 6, transCnt * sizeof(uint32_t));	// +1
+	if((uintptr_t)buff & 0x3){
+		return luaL_error(L, "Buffer is not word aligned.");
+	}
+	job = LuaApiNewAsyncJob(L, luaApi_adiv5_block_job, sizeof(struct luaApi_blockJob), 1, -1);	// +1
+	job->ap = luaApObj->ap;
+	job->addr = addr;
+	job->addrIncMode = addrIncMode;
+	job->dataSize = dataSize;
+	job->transCnt = transCnt;
+	job->buff = buff;
+	job->write = FALSE;
+	job->toBuffer = toBuffer;
+	return LuaApiAsyncAwait(L, -1, luaApi_adiv5_async_device(L, luaApObj->reference), luaApi_adiv5_ap_read_mem_block_k);
+}
+
+static int luaApi_adiv5_ap_write_mem_block_k(lua_State *L, int status, lua_KContext ctx){
+	struct luaApi_blockJob *job;
+	(void)status;
+	if(LuaApiAsyncResult(L, ctx, (void **)&job) != ADI_SUCCESS){
+		return luaL_error(L, "Block write failed! Last good address: %I.", (lua_Integer)job->lastGood);
+	}
+	return 0;
+}
+
+/**
+ * 异步写入内存块
+ * 在协程中调用时挂起协程,写入完成后返回;参数同BlockWrite
+ */
+static int luaApi_adiv5_ap_write_mem_block_async(lua_State *L){
+	struct luaApi_accessPort *luaApObj = luaL_checkudata(L, 1, ADIV5_AP_MEM_LUA_OBJECT_TYPE);
+	struct luaApi_blockJob *job;
+	uint64_t addr = luaL_checkinteger(L, 2);
+	int addrIncMode = (int)luaL_checkinteger(L, 3);
+	int dataSize = (int)luaL_checkinteger(L, 4);
+	size_t transCnt;
+	uint8_t *buff = CAST(uint8_t *, LuaApiCheckBytes(L, 5, &transCnt));
+	if(luaApObj->ap->type != AccessPort_Memory){
+		return luaL_error(L, "Not a memory access port.");
+	}
+	if((uintptr_t)buff & 0x3){
+		return luaL_error(L, "Buffer is not word aligned.");
+	}
+	if(transCnt & 0x3){
+		return luaL_error(L, "The length of the data to be written is not a multiple of the word.");
+	}
+	job = LuaApiNewAsyncJob(L, luaApi_adiv5_block_job, sizeof(struct luaApi_blockJob), 1, -1);	// +1
+	job->ap = luaApObj->ap;
+	job->addr = addr;
+	job->addrIncMode = addrIncMode;
+	job->dataSize = dataSize;
+	job->transCnt = (int)transCnt >> 2;
+	job->buff = buff;
+	job->write = TRUE;
+	return LuaApiAsyncAwait(L, -1, luaApi_adiv5_async_device(L, luaApObj->reference), luaApi_adiv5_ap_write_mem_block_k);
+}
+
+/**
+ * 设置Block传输出错恢复策略
+ * 1#:AccessPort对象
+ * 2#:同一位置出错的重试次数
+ * 3#:第一次重试前等待的微秒数,之后每次重试加倍
+ * 4#:重试失败后跳过的页大小,0表示不跳过直接报错(可选)
+ */
+static int luaApi_adiv5_ap_transfer_policy(lua_State *L){
+	struct luaApi_accessPort *luaApObj = LuaApiAdiv5CheckAp(L, 1);
+	struct transferPolicy policy;
+	policy.retries = (unsigned int)luaL_checkinteger(L, 2);
+	policy.backoff = (unsigned int)luaL_checkinteger(L, 3);
+	policy.skipSize = (unsigned int)luaL_optinteger(L, 4, 0);
+	if(luaApObj->ap->Interface.Memory.SetTransferPolicy(luaApObj->ap, &policy) != ADI_SUCCESS){
+		return luaL_error(L, "Set transfer policy failed!");
+	}
+	return 0;
+}
+
+/**
+ * 获得最近一次Block传输的结果
+ * 1#:AccessPort对象
+ * 返回:
+ * 1#:连续传输成功的结束地址
+ * 2#:跳过的字节数
+ * 3#:重试次数
+ */
+static int luaApi_adiv5_ap_transfer_status(lua_State *L){
+	struct luaApi_accessPort *luaApObj = LuaApiAdiv5CheckAp(L, 1);
+	struct transferStatus status;
+	if(luaApObj->ap->Interface.Memory.GetTransferStatus(luaApObj->ap, &status) != ADI_SUCCESS){
+		return luaL_error(L, "Get transfer status failed!");
+	}
+	lua_pushinteger(L, (lua_Integer)status.lastGood);
+	lua_pushinteger(L, (lua_Integer)status.skipped);
+	lua_pushinteger(L, status.retries);
+	return 3;
+}
+
+/**
+ * 配置主机端内存缓存
+ * 1#:AccessPort对象
+ * 2#:缓存行大小,2的幂,4~1024字节
+ * 3#:缓存行数,0表示关闭缓存
+ */
+static int luaApi_adiv5_ap_config_cache(lua_State *L){
+	struct luaApi_accessPort *luaApObj = LuaApiAdiv5CheckAp(L, 1);
+	unsigned int lineSize = (unsigned int)luaL_checkinteger(L, 2);
+	unsigned int lineCount = (unsigned int)luaL_checkinteger(L, 3);
+	if(luaApObj->ap->Interface.Memory.ConfigCache(luaApObj->ap, lineSize, lineCount) != ADI_SUCCESS){
+		return luaL_error(L, "Config cache failed!");
 	}
 	return 0;
 }
 
+/**
+ * 设置地址区域的缓存策略
+ * 1#:AccessPort对象
+ * 2#:区域基址
+ * 3#:区域大小
+ * 4#:缓存策略 ADIv5.Cache_Uncached/Cache_ReadOnly/Cache_WriteThrough
+ */
+static int luaApi_adiv5_ap_cache_region(lua_State *L){
+	struct luaApi_accessPort *luaApObj = LuaApiAdiv5CheckAp(L, 1);
+	uint64_t base = luaL_checkinteger(L, 2);
+	uint64_t size = luaL_checkinteger(L, 3);
+	int policy = (int)luaL_checkinteger(L, 4);
+	if(luaApObj->ap->Interface.Memory.AddCacheRegion(luaApObj->ap, base, size, policy) != ADI_SUCCESS){
+		return luaL_error(L, "Add cache region failed!");
+	}
+	return 0;
+}
+
+/**
+ * 使缓存失效
+ * 1#:AccessPort对象
+ * 2#:起始地址(可选,默认使全部缓存失效)
+ * 3#:大小(可选)
+ */
+static int luaApi_adiv5_ap_invalidate_cache(lua_State *L){
+	struct luaApi_accessPort *luaApObj = LuaApiAdiv5CheckAp(L, 1);
+	uint64_t addr = luaL_optinteger(L, 2, 0);
+	uint64_t size = luaL_optinteger(L, 3, 0);
+	if(luaApObj->ap->Interface.Memory.InvalidateCache(luaApObj->ap, addr, size) != ADI_SUCCESS){
+		return luaL_error(L, "Invalidate cache failed!");
+	}
+	return 0;
+}
+
+/**
+ * 获得缓存统计
+ * 1#:AccessPort对象
+ * 返回:
+ * 1#:统计表 {Hits, Misses, Fills, Evictions, Bypass}
+ */
+static int luaApi_adiv5_ap_cache_stats(lua_State *L){
+	struct luaApi_accessPort *luaApObj = LuaApiAdiv5CheckAp(L, 1);
+	struct cacheStats stats;
+	if(luaApObj->ap->Interface.Memory.GetCacheStats(luaApObj->ap, &stats) != ADI_SUCCESS){
+		return luaL_error(L, "Get cache stats failed!");
+	}
+	lua_createtable(L, 0, 5);
+	lua_pushinteger(L, (lua_Integer)stats.hits);
+	lua_setfield(L, -2, "Hits");
+	lua_pushinteger(L, (lua_Integer)stats.misses);
+	lua_setfield(L, -2, "Misses");
+	lua_pushinteger(L, (lua_Integer)stats.fills);
+	lua_setfield(L, -2, "Fills");
+	lua_pushinteger(L, (lua_Integer)stats.evictions);
+	lua_setfield(L, -2, "Evictions");
+	lua_pushinteger(L, (lua_Integer)stats.bypass);
+	lua_setfield(L, -2, "Bypass");
+	return 1;
+}
+
+/**
+ * 在写合并区间内执行函数
+ * 函数内的Memory8/16/32写操作被合并,函数返回或者出错时提交
+ * 1#:AccessPort对象
+ * 2#:要执行的函数
+ * 返回:
+ * 函数的返回值
+ */
+static int luaApi_adiv5_ap_write_combine(lua_State *L){
+	struct luaApi_accessPort *luaApObj = LuaApiAdiv5CheckAp(L, 1);
+	int status, result;
+	luaL_checktype(L, 2, LUA_TFUNCTION);
+	if(luaApObj->ap->Interface.Memory.WriteCombine(luaApObj->ap, TRUE) != ADI_SUCCESS){
+		return luaL_error(L, "Enter write combine scope failed!");
+	}
+	lua_pushvalue(L, 2);
+	status = lua_pcall(L, 0, LUA_MULTRET, 0);
+	// 无论函数是否出错都要退出区间
+	result = luaApObj->ap->Interface.Memory.WriteCombine(luaApObj->ap, FALSE);
+	if(status != LUA_OK){
+		return lua_error(L);
+	}
+	if(result != ADI_SUCCESS){
+		return luaL_error(L, "Flush write buffer failed!");
+	}
+	return lua_gettop(L) - 2;
+}
+
+/**
+ * 写屏障:提交写合并缓冲区
+ * 1#:AccessPort对象
+ */
+static int luaApi_adiv5_ap_flush_writes(lua_State *L){
+	struct luaApi_accessPort *luaApObj = LuaApiAdiv5CheckAp(L, 1);
+	if(luaApObj->ap->Interface.Memory.FlushWrites(luaApObj->ap) != ADI_SUCCESS){
+		return luaL_error(L, "Flush write buffer failed!");
+	}
+	return 0;
+}
+
+/**
+ * 标记设备内存,设备内存的写操作不合并
+ * 1#:AccessPort对象
+ * 2#:区域基址
+ * 3#:区域大小
+ */
+static int luaApi_adiv5_ap_device_region(lua_State *L){
+	struct luaApi_accessPort *luaApObj = LuaApiAdiv5CheckAp(L, 1);
+	uint64_t base = luaL_checkinteger(L, 2);
+	uint64_t size = luaL_checkinteger(L, 3);
+	if(luaApObj->ap->Interface.Memory.AddDeviceRegion(luaApObj->ap, base, size) != ADI_SUCCESS){
+		return luaL_error(L, "Add device region failed!");
+	}
+	return 0;
+}
+
+/**
+ * 校验内存
+ * 1#:AccessPort对象
+ * 2#:起始地址
+ * 3#:期望的数据(字符串或者Buffer,长度是4的倍数)
+ * 返回:
+ * 1#:全部一致返回true,否则返回false
+ * 2#:第一个不一致的地址
+ */
+static int luaApi_adiv5_ap_verify(lua_State *L){
+	struct luaApi_accessPort *luaApObj = LuaApiAdiv5CheckAp(L, 1);
+	uint64_t addr = luaL_checkinteger(L, 2);
+	size_t len;
+	const uint8_t *expect = LuaApiCheckBytes(L, 3, &len);
+	uint64_t mismatch = 0;
+	uint32_t *buff = CAST(uint32_t *, expect);
+	if(len & 0x3){
+		return luaL_error(L, "The length of the data to be verified is not a multiple of the word.");
+	}
+	// Lua字符串和Buffer的slice不保证4字节对齐
+	if((uintptr_t)expect & 0x3){
+		buff = (uint32_t *)lua_newuserdata(L, len);
+		memcpy(buff, expect, len);
+	}
+	switch(luaApObj->ap->Interface.Memory.Verify(luaApObj->ap, addr, (unsigned int)(len >> 2), buff, &mismatch)){
+	case ADI_SUCCESS:
+		lua_pushboolean(L, 1);
+		return 1;
+	case ADI_FAILED:
+		lua_pushboolean(L, 0);
+		lua_pushinteger(L, (lua_Integer)mismatch);
+		return 2;
+	default:
+		return luaL_error(L, "Verify memory failed!");
+	}
+}
+
+/**
+ * 查找内存中的值
+ * 1#:AccessPort对象
+ * 2#:起始地址
+ * 3#:查找的字数
+ * 4#:要查找的值
+ * 5#:参与比较的字节(可选,默认0xF)
+ * 返回:
+ * 1#:第一个找到的地址,没有找到返回nil
+ */
+static int luaApi_adiv5_ap_search(lua_State *L){
+	struct luaApi_accessPort *luaApObj = LuaApiAdiv5CheckAp(L, 1);
+	uint64_t addr = luaL_checkinteger(L, 2);
+	unsigned int count = (unsigned int)luaL_checkinteger(L, 3);
+	uint32_t value = (uint32_t)luaL_checkinteger(L, 4);
+	uint8_t lanes = (uint8_t)luaL_optinteger(L, 5, 0xF);
+	uint64_t where = 0;
+	switch(luaApObj->ap->Interface.Memory.Search(luaApObj->ap, addr, count, value, lanes, &where)){
+	case ADI_SUCCESS:
+		lua_pushinteger(L, (lua_Integer)where);
+		return 1;
+	case ADI_FAILED:
+		lua_pushnil(L);
+		return 1;
+	default:
+		return luaL_error(L, "Search memory failed!");
+	}
+}
+
+/**
+ * 内存扫描迭代函数
+ * 上值1:扫描对象 上值2:AccessPort对象,保证扫描期间AP不被回收
+ */
+static int luaApi_adiv5_ap_scan_next(lua_State *L){
+	MemScan *scan = lua_touserdata(L, lua_upvalueindex(1));
+	uint64_t where = 0;
+	if(*scan == NULL){
+		lua_pushnil(L);
+		return 1;
+	}
+	LuaApiAdiv5CheckAp(L, lua_upvalueindex(2));
+	switch(ADIv5_ScanNext(*scan, &where)){
+	case ADI_SUCCESS:
+		lua_pushinteger(L, (lua_Integer)where);
+		return 1;
+	case ADI_FAILED:
+		ADIv5_ScanClose(scan);
+		lua_pushnil(L);
+		return 1;
+	default:
+		ADIv5_ScanClose(scan);
+		return luaL_error(L, "Scan memory failed!");
+	}
+}
+
+/**
+ * 扫描内存中的字节串
+ * 1#:AccessPort对象
+ * 2#:起始地址
+ * 3#:扫描的字节数
+ * 4#:要查找的字节串(字符串或者Buffer)
+ * 5#:每个字节参与比较的位(可选,和字节串等长的字符串或者Buffer,默认全部比较)
+ * 6#:匹配地址的对齐:1、2、4、8(可选,默认1)
+ * 返回:
+ * 1#:迭代函数,每次返回一个匹配的地址,用法 for addr in ap:Scan(...) do ... end
+ */
+static int luaApi_adiv5_ap_scan(lua_State *L){
+	struct luaApi_accessPort *luaApObj = LuaApiAdiv5CheckAp(L, 1);
+	uint64_t addr = luaL_checkinteger(L, 2);
+	uint64_t len = luaL_checkinteger(L, 3);
+	size_t patternLen, maskLen;
+	const uint8_t *pattern = LuaApiCheckBytes(L, 4, &patternLen);
+	const uint8_t *mask = lua_isnoneornil(L, 5) ? NULL : LuaApiCheckBytes(L, 5, &maskLen);
+	unsigned int align = (unsigned int)luaL_optinteger(L, 6, 1);
+	if(mask != NULL && maskLen != patternLen){
+		return luaL_error(L, "The mask must be as long as the pattern.");
+	}
+	MemScan *scan = lua_newuserdata(L, sizeof(MemScan));	// +1
+	*scan = NULL;
+	luaL_setmetatable(L, ADIV5_MEM_SCAN_LUA_OBJECT_TYPE);
+	if(luaApObj->ap->Interface.Memory.Scan(luaApObj->ap, addr, len, pattern, mask, (unsigned int)patternLen, align, scan) != ADI_SUCCESS){
+		return luaL_error(L, "Scan memory failed!");
+	}
+	lua_pushvalue(L, 1);	// +1
+	lua_pushcclosure(L, luaApi_adiv5_ap_scan_next, 2);	// -2 +1
+	return 1;
+}
+
+/**
+ * 用重复的pattern填充内存
+ * 1#:AccessPort对象
+ * 2#:起始地址
+ * 3#:填充的字节数
+ * 4#:pattern(可选,默认0)
+ * 5#:pattern的字节数:1、2、4、8(可选,默认4)
+ */
+static int luaApi_adiv5_ap_fill(lua_State *L){
+	struct luaApi_accessPort *luaApObj = LuaApiAdiv5CheckAp(L, 1);
+	uint64_t addr = luaL_checkinteger(L, 2);
+	uint64_t len = luaL_checkinteger(L, 3);
+	uint64_t pattern = luaL_optinteger(L, 4, 0);
+	unsigned int patternSize = (unsigned int)luaL_optinteger(L, 5, 4);
+	if(luaApObj->ap->Interface.Memory.Fill(luaApObj->ap, addr, len, pattern, patternSize) != ADI_SUCCESS){
+		return luaL_error(L, "Fill memory failed!");
+	}
+	return 0;
+}
+
+/**
+ * 加载镜像文件到内存
+ * 1#:AccessPort对象
+ * 2#:文件路径
+ * 3#:格式:ADIv5.Image_Auto、Image_Binary、Image_IntelHex、Image_Elf(可选,默认Image_Auto)
+ * 4#:二进制文件的加载地址(可选,默认0)
+ * 5#:写入后是否校验(可选,默认false)
+ * 返回:
+ * 1#:统计表 {Bytes, Segments, Seconds, VerifySeconds, Entry}
+ */
+static int luaApi_adiv5_ap_load_image(lua_State *L){
+	struct luaApi_accessPort *luaApObj = LuaApiAdiv5CheckAp(L, 1);
+	const char *path = luaL_checkstring(L, 2);
+	enum imageFormat format = (enum imageFormat)luaL_optinteger(L, 3, ImageFormat_Auto);
+	uint64_t base = luaL_optinteger(L, 4, 0);
+	BOOL verify = lua_toboolean(L, 5);
+	struct loadStats stats;
+	Image image;
+	int result;
+	image = image_Load(path, format, base);
+	if(image == NULL){
+		return luaL_error(L, "Failed to load image %s!", path);
+	}
+	result = luaApObj->ap->Interface.Memory.LoadImage(luaApObj->ap, image, verify, &stats);
+	lua_Integer entry = (lua_Integer)image->entry;
+	image_Free(&image);
+	if(result == ADI_FAILED){
+		return luaL_error(L, "Image verify failed!");
+	}else if(result != ADI_SUCCESS){
+		return luaL_error(L, "Load image failed!");
+	}
+	lua_createtable(L, 0, 5);
+	lua_pushinteger(L, (lua_Integer)stats.bytes);
+	lua_setfield(L, -2, "Bytes");
+	lua_pushinteger(L, stats.segments);
+	lua_setfield(L, -2, "Segments");
+	lua_pushnumber(L, stats.seconds);
+	lua_setfield(L, -2, "Seconds");
+	lua_pushnumber(L, stats.verifySeconds);
+	lua_setfield(L, -2, "VerifySeconds");
+	lua_pushinteger(L, entry);
+	lua_setfield(L, -2, "Entry");
+	return 1;
+}
+
+/**
+ * 增量写入内存
+ * 1#:AccessPort对象
+ * 2#:起始地址
+ * 3#:要写入的数据(字符串或者Buffer)
+ * 4#:比较的对象:ADIv5.Delta_Record、ADIv5.Delta_Target(可选,默认Delta_Record)
+ * 返回:
+ * 1#:实际写入的字节数
+ */
+static int luaApi_adiv5_ap_delta_write(lua_State *L){
+	struct luaApi_accessPort *luaApObj = LuaApiAdiv5CheckAp(L, 1);
+	uint64_t addr = luaL_checkinteger(L, 2);
+	size_t len;
+	const uint8_t *data = LuaApiCheckBytes(L, 3, &len);
+	enum deltaSource source = (enum deltaSource)luaL_optinteger(L, 4, DeltaSource_Record);
+	uint64_t written = 0;
+	if(source != DeltaSource_Record && source != DeltaSource_Target){
+		return luaL_error(L, "Unknown delta source.");
+	}
+	if(luaApObj->ap->Interface.Memory.DeltaWrite(luaApObj->ap, addr, len, data, source, &written) != ADI_SUCCESS){
+		return luaL_error(L, "Delta write memory failed!");
+	}
+	lua_pushinteger(L, (lua_Integer)written);
+	return 1;
+}
+
+// Dump进度回调的参数
+struct luaApi_dumpProgress {
+	lua_State *L;
+	int func;	// 回调函数在栈中的位置
+	BOOL error;	// 回调出错,错误信息在栈顶
+};
+
+/**
+ * 调用Lua的进度回调,回调返回false时中止转储
+ */
+static BOOL luaApi_dump_progress(void *context, uint64_t done, uint64_t total){
+	struct luaApi_dumpProgress *progress = context;
+	lua_State *L = progress->L;
+	BOOL cont;
+	lua_pushvalue(L, progress->func);
+	lua_pushinteger(L, (lua_Integer)done);
+	lua_pushinteger(L, (lua_Integer)total);
+	// 不能在C函数中抛出错误,否则文件不会被关闭
+	if(lua_pcall(L, 2, 1, 0) != LUA_OK){
+		progress->error = TRUE;
+		return FALSE;
+	}
+	cont = lua_isnil(L, -1) || lua_toboolean(L, -1);
+	lua_pop(L, 1);
+	return cont;
+}
+
+/**
+ * 转储内存到文件
+ * 1#:AccessPort对象
+ * 2#:起始地址,字对齐
+ * 3#:转储的字节数,字的整数倍
+ * 4#:文件路径
+ * 5#:选项:ADIv5.Dump_Resume、ADIv5.Dump_Sparse的组合(可选,默认0)
+ * 6#:进度回调函数(可选),参数是已转储的字节数和总字节数,返回false中止转储
+ * 返回:
+ * 1#:全部完成返回true,被回调中止返回false
+ * 2#:不能访问被跳过的字节数
+ */
+static int luaApi_adiv5_ap_dump(lua_State *L){
+	struct luaApi_accessPort *luaApObj = LuaApiAdiv5CheckAp(L, 1);
+	uint64_t addr = luaL_checkinteger(L, 2);
+	uint64_t len = luaL_checkinteger(L, 3);
+	const char *path = luaL_checkstring(L, 4);
+	unsigned int flags = (unsigned int)luaL_optinteger(L, 5, 0);
+	struct luaApi_dumpProgress progress = {L, 6, FALSE};
+	uint64_t skipped = 0;
+	int result;
+	if(!lua_isnoneornil(L, 6)){
+		luaL_checktype(L, 6, LUA_TFUNCTION);
+	}
+	result = luaApObj->ap->Interface.Memory.Dump(luaApObj->ap, addr, len, path, flags,
+			lua_isnoneornil(L, 6) ? NULL : luaApi_dump_progress, &progress, &skipped);
+	if(progress.error){
+		return lua_error(L);
+	}
+	if(result != ADI_SUCCESS && result != ADI_FAILED){
+		return luaL_error(L, "Dump memory failed!");
+	}
+	lua_pushboolean(L, result == ADI_SUCCESS);
+	lua_pushinteger(L, (lua_Integer)skipped);
+	return 2;
+}
+
+/**
+ * 轮询一个字直到(值 & mask) == value
+ * 1#:AccessPort对象
+ * 2#:地址,字对齐
+ * 3#:掩码
+ * 4#:期望的值
+ * 5#:超时的毫秒数(可选,默认1000)
+ * 返回:
+ * 1#:匹配返回true,超时返回false
+ */
+static int luaApi_adiv5_ap_wait_value(lua_State *L){
+	struct luaApi_accessPort *luaApObj = LuaApiAdiv5CheckAp(L, 1);
+	uint64_t addr = luaL_checkinteger(L, 2);
+	uint32_t mask = (uint32_t)luaL_checkinteger(L, 3);
+	uint32_t value = (uint32_t)luaL_checkinteger(L, 4);
+	unsigned int timeout = (unsigned int)luaL_optinteger(L, 5, 1000);
+	int result = luaApObj->ap->Interface.Memory.WaitValue(luaApObj->ap, addr, mask, value, timeout);
+	if(result != ADI_SUCCESS && result != ADI_FAILED){
+		return luaL_error(L, "Wait value failed!");
+	}
+	lua_pushboolean(L, result == ADI_SUCCESS);
+	return 1;
+}
+
+/**
+ * 指定TAR地址自增的回绕大小
+ * 1#:AccessPort对象
+ * 2#:回绕大小,2的幂,1KB~64KB,0恢复为默认的1KB
+ */
+static int luaApi_adiv5_ap_tar_wrap(lua_State *L){
+	struct luaApi_accessPort *luaApObj = LuaApiAdiv5CheckAp(L, 1);
+	unsigned int wrap = (unsigned int)luaL_checkinteger(L, 2);
+	if(luaApObj->ap->Interface.Memory.SetTarWrap(luaApObj->ap, wrap) != ADI_SUCCESS){
+		return luaL_error(L, "Set TAR wrap size failed!");
+	}
+	return 0;
+}
+
+/**
+ * 探测TAR地址自增的回绕大小,只读不写
+ * 1#:AccessPort对象
+ * 2#:可以安全读取的内存区域基址
+ * 3#:区域大小
+ * 返回:
+ * 1#:回绕大小
+ */
+static int luaApi_adiv5_ap_probe_tar_wrap(lua_State *L){
+	struct luaApi_accessPort *luaApObj = LuaApiAdiv5CheckAp(L, 1);
+	uint64_t addr = luaL_checkinteger(L, 2);
+	uint64_t size = luaL_checkinteger(L, 3);
+	unsigned int wrap;
+	if(luaApObj->ap->Interface.Memory.ProbeTarWrap(luaApObj->ap, addr, size, &wrap) != ADI_SUCCESS){
+		return luaL_error(L, "Probe TAR wrap size failed!");
+	}
+	lua_pushinteger(L, wrap);
+	return 1;
+}
+
 /**
  * 读取Component ID 和 Peripheral ID
  * 1#：Adapter对象
@@ -308,7 +1471,7 @@ static int luaApi_adiv5_ap_write_mem_block(lua_State *L){
  * 2#：pid 64位
  */
 static int luaApi_adiv5_ap_get_pid_cid(lua_State *L){
-	struct luaApi_accessPort *luaApObj = luaL_checkudata(L, 1, ADIV5_AP_MEM_LUA_OBJECT_TYPE);
+	struct luaApi_accessPort *luaApObj = LuaApiAdiv5CheckAp(L, 1);
 	uint64_t base = luaL_checkinteger(L, 2);
 	uint32_t cid; uint64_t pid;
 	if(ADIv5_ReadCidPid(luaApObj->ap, base, &cid, &pid) != ADI_SUCCESS){
@@ -319,6 +1482,28 @@ static int luaApi_adiv5_ap_get_pid_cid(lua_State *L){
 	return 2;
 }
 
+/**
+ * 内存扫描对象垃圾回收函数
+ */
+static int luaApi_adiv5_mem_scan_gc(lua_State *L){
+	MemScan *scan = CAST(MemScan *, luaL_checkudata(L, 1, ADIV5_MEM_SCAN_LUA_OBJECT_TYPE));
+	ADIv5_ScanClose(scan);
+	return 0;
+}
+
+/**
+ * 批量读程序垃圾回收函数
+ */
+static int luaApi_adiv5_mem_program_gc(lua_State *L){
+	struct luaApi_memProgram *luaProgram = luaL_checkudata(L, 1, ADIV5_MEM_PROGRAM_LUA_OBJECT_TYPE);
+	if(luaProgram->program){
+		luaProgram->ap->Interface.Memory.FreeProgram(luaProgram->ap, luaProgram->program);
+		luaProgram->program = NULL;
+	}
+	luaL_unref(L, LUA_REGISTRYINDEX, luaProgram->reference);
+	return 0;
+}
+
 /**
  * ADIv5垃圾回收函数
  */
@@ -369,6 +1554,27 @@ static const luaApi_regConst lib_adiv5_const[] = {
 	{"DataSize_64", DataSize_64},
 	{"DataSize_128", DataSize_128},
 	{"DataSize_256", DataSize_256},
+	// 主机端内存缓存策略
+	{"Cache_Uncached", CachePolicy_Uncached},
+	{"Cache_ReadOnly", CachePolicy_ReadOnly},
+	{"Cache_WriteThrough", CachePolicy_WriteThrough},
+	// 镜像文件格式
+	{"Image_Auto", ImageFormat_Auto},
+	{"Image_Binary", ImageFormat_Binary},
+	{"Image_IntelHex", ImageFormat_IntelHex},
+	{"Image_Elf", ImageFormat_Elf},
+	// 增量写入比较的对象
+	{"Delta_Record", DeltaSource_Record},
+	{"Delta_Target", DeltaSource_Target},
+	// 内存转储选项
+	{"Dump_Resume", DumpFlag_Resume},
+	{"Dump_Sparse", DumpFlag_Sparse},
+
+	{"Memory_Normal", MemoryType_Normal},
+	{"Memory_Device", MemoryType_Device},
+	{"Width_8", MEMORY_WIDTH(DataSize_8)},
+	{"Width_16", MEMORY_WIDTH(DataSize_16)},
+	{"Width_32", MEMORY_WIDTH(DataSize_32)},
 	{NULL, 0}
 };
 
@@ -386,6 +1592,15 @@ int luaopen_adiv5 (lua_State *L) {
 static const luaL_Reg lib_adiv5_oo[] = {
 	// 基本函数
 	{"FindAccessPort", luaApi_adiv5_find_access_port},
+	{"ReadRomTable", luaApi_adiv5_read_rom_table},
+	// 内存映射
+	{"MemoryRegion", luaApi_adiv5_memory_region},
+	{"ClearMemoryMap", luaApi_adiv5_clear_memory_map},
+	{"PlanAccess", luaApi_adiv5_plan_access},
+	{"ReadMemory", luaApi_adiv5_read_memory},
+	{"WriteMemory", luaApi_adiv5_write_memory},
+	{"ReadMemoryAsync", luaApi_adiv5_read_memory_async},
+	{"WriteMemoryAsync", luaApi_adiv5_write_memory_async},
 	{NULL, NULL}
 };
 
@@ -401,9 +1616,48 @@ static const luaL_Reg lib_access_port_oo[] = {
 	{"Memory16", luaApi_adiv5_ap_mem_rw_16},
 	{"Memory32", luaApi_adiv5_ap_mem_rw_32},
 	//TODO {"Memory64", luaApi_adiv5_find_access_port},
+	{"ReadMany", luaApi_adiv5_ap_read_many},
+	{"WriteMany", luaApi_adiv5_ap_write_many},
+	{"PrepareRead", luaApi_adiv5_ap_prepare_read},
 
 	{"BlockRead", luaApi_adiv5_ap_read_mem_block},
 	{"BlockWrite", luaApi_adiv5_ap_write_mem_block},
+	{"BlockReadAsync", luaApi_adiv5_ap_read_mem_block_async},
+	{"BlockWriteAsync", luaApi_adiv5_ap_write_mem_block_async},
+	{"WaitValue", luaApi_adiv5_ap_wait_value},
+	{"TarWrap", luaApi_adiv5_ap_tar_wrap},
+	{"ProbeTarWrap", luaApi_adiv5_ap_probe_tar_wrap},
+	{"TransferPolicy", luaApi_adiv5_ap_transfer_policy},
+	{"TransferStatus", luaApi_adiv5_ap_transfer_status},
+
+	{"ConfigCache", luaApi_adiv5_ap_config_cache},
+	{"CacheRegion", luaApi_adiv5_ap_cache_region},
+	{"InvalidateCache", luaApi_adiv5_ap_invalidate_cache},
+	{"CacheStats", luaApi_adiv5_ap_cache_stats},
+
+	{"WriteCombine", luaApi_adiv5_ap_write_combine},
+	{"FlushWrites", luaApi_adiv5_ap_flush_writes},
+	{"DeviceRegion", luaApi_adiv5_ap_device_region},
+
+	{"Verify", luaApi_adiv5_ap_verify},
+	{"Search", luaApi_adiv5_ap_search},
+	{"Scan", luaApi_adiv5_ap_scan},
+	{"Fill", luaApi_adiv5_ap_fill},
+	{"LoadImage", luaApi_adiv5_ap_load_image},
+	{"DeltaWrite", luaApi_adiv5_ap_delta_write},
+	{"Dump", luaApi_adiv5_ap_dump},
+	{NULL, NULL}
+};
+
+// 内存扫描对象只在迭代函数内部使用,没有方法
+static const luaL_Reg lib_mem_scan_oo[] = {
+	{NULL, NULL}
+};
+
+// 预编译的批量读程序
+static const luaL_Reg lib_mem_program_oo[] = {
+	{"Run", luaApi_adiv5_mem_program_run},
+	{"RunAsync", luaApi_adiv5_mem_program_run_async},
 	{NULL, NULL}
 };
 
@@ -413,6 +1667,8 @@ void RegisterApi_ADIv5(lua_State *L){
 	// 创建
 	LuaApiNewTypeMetatable(L, ADIV5_LUA_OBJECT_TYPE, luaApi_adiv5_gc, lib_adiv5_oo);
 	LuaApiNewTypeMetatable(L, ADIV5_AP_MEM_LUA_OBJECT_TYPE, luaApi_adiv5_access_port_gc, lib_access_port_oo);
+	LuaApiNewTypeMetatable(L, ADIV5_MEM_SCAN_LUA_OBJECT_TYPE, luaApi_adiv5_mem_scan_gc, lib_mem_scan_oo);
+	LuaApiNewTypeMetatable(L, ADIV5_MEM_PROGRAM_LUA_OBJECT_TYPE, luaApi_adiv5_mem_program_gc, lib_mem_program_oo);
 	luaL_requiref(L, "ADIv5", luaopen_adiv5, 0);
 	lua_pop(L, 1);
 }
@@ -0,0 +1,54 @@
+/*
+ * ADIv5_api.h
+ *
+ *  Created on: 2019-6-28
+ *      Author: virusv
+ */
+
+#ifndef SRC_API_ARCH_ARM_ADI_ADIV5_API_H_
+#define SRC_API_ARCH_ARM_ADI_ADIV5_API_H_
+
+#include "lua/src/lua.h"
+#include "arch/ARM/ADI/include/ADIv5.h"
+
+#define ADIV5_LUA_OBJECT_TYPE "arch.ARM.ADIv5"
+#define ADIV5_AP_MEM_LUA_OBJECT_TYPE "arch.ARM.ADIv5.AccessPort.Memory"
+#define ADIV5_AP_JTAG_LUA_OBJECT_TYPE "arch.ARM.ADIv5.AccessPort.Jtag"
+#define ADIV5_MEM_SCAN_LUA_OBJECT_TYPE "arch.ARM.ADIv5.MemScan"
+#define ADIV5_MEM_PROGRAM_LUA_OBJECT_TYPE "arch.ARM.ADIv5.MemProgram"
+
+struct luaApi_dap {
+	int adapterRef;	// adapter的Lua对象引用
+	DAP dap;	// DAP 对象
+};
+
+// 其他模块通过AccessPort对象访问目标内存
+struct luaApi_accessPort {
+	int reference;	// lua_dap对象的reference
+	AccessPort ap;	// AP对象
+};
+
+// 预编译的批量读程序
+struct luaApi_memProgram {
+	int reference;	// AccessPort对象的引用
+	AccessPort ap;	// AP对象
+	MemProgram program;	// 程序
+	unsigned int count;	// 项数
+};
+
+/**
+ * 同步访问目标的接口用这些函数取得DAP、AccessPort对象
+ * Adapter上有没完成的异步任务或者被监视、采样线程占用时抛出错误
+ * LuaApiAdiv5CheckApRef:apRef是AccessPort对象的reference
+ */
+struct luaApi_dap *LuaApiAdiv5CheckDap(lua_State *L, int idx);
+struct luaApi_accessPort *LuaApiAdiv5CheckAp(lua_State *L, int idx);
+struct luaApi_accessPort *LuaApiAdiv5CheckApRef(lua_State *L, int apRef);
+
+/**
+ * 取得AccessPort所在的Adapter对象
+ * 后台线程运行期间用Async_Acquire占用这个对象,同步接口和异步任务都会被拒绝
+ */
+void *LuaApiAdiv5ApDevice(lua_State *L, struct luaApi_accessPort *luaApObj);
+
+#endif /* SRC_API_ARCH_ARM_ADI_ADIV5_API_H_ */
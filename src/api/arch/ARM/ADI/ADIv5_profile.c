@@ -0,0 +1,378 @@
+/*
+ * ADIv5_profile.c
+ *
+ *  Created on: 2019-7-7
+ *      Author: virusv
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "smart_ocd.h"
+#include "misc/log.h"
+#include "misc/symbols.h"
+#include "misc/async.h"
+#include "arch/ARM/ADI/include/ADIv5.h"
+
+#include "api/api.h"
+#include "api/arch/ARM/ADI/ADIv5_api.h"
+
+/**
+ * PC采样分析
+ * prof = Profiler.New()
+ * prof:AddCore(ahbAp, "dwt")	-- Cortex-M
+ * prof:AddCore(apbAp, "edpcsr64", 0x80410000)	-- ARMv8核心的调试寄存器基地址
+ * prof:Start(5000); prof:Wait()
+ * for _, hit in ipairs(prof:Hits("firmware.elf", 20)) do print(hit.func, hit.count) end
+ * prof:Export("out.folded", "folded", "firmware.elf")
+ * 采样线程运行期间占用这些MEM-AP所在的Adapter,同步接口和异步接口都会抛出错误,直到Wait或者Stop
+ */
+#define PROFILE_LUA_OBJECT_TYPE "Profiler"
+#define PROFILE_DEFAULT_BATCH	256
+#define PROFILE_DWT_BASE	0xE0001000
+
+struct luaApi_profile {
+	int apTableRef;	// 保存各个核心的AccessPort对象的表
+	BOOL owning;	// 是否占用了各个核心所在的Adapter
+	PcProfile profile;
+};
+
+static struct luaApi_profile *checkProfile(lua_State *L, int idx){
+	struct luaApi_profile *luaProfile = luaL_checkudata(L, idx, PROFILE_LUA_OBJECT_TYPE);
+	if(luaProfile->profile == NULL){
+		luaL_error(L, "Profiler object has been destroyed.");
+	}
+	return luaProfile;
+}
+
+/**
+ * 加载可选的ELF文件
+ * 返回:
+ * 	符号对象,idx处没有参数时返回NULL
+ */
+static Symbols optSymbols(lua_State *L, int idx){
+	const char *path = luaL_optstring(L, idx, NULL);
+	Symbols syms;
+	if(path == NULL) return NULL;
+	syms = symbols_Load(path);
+	if(syms == NULL){
+		luaL_error(L, "Failed to load symbols from %s.", path);
+	}
+	return syms;
+}
+
+/**
+ * 新建PC采样分析对象
+ * 1#:每个核心每批读取的采样数(可选)
+ * 返回:
+ * 1#:分析对象
+ */
+static int luaApi_profile_new(lua_State *L){
+	lua_Integer batch = luaL_optinteger(L, 1, PROFILE_DEFAULT_BATCH);
+	struct luaApi_profile *luaProfile;
+	luaL_argcheck(L, batch > 0 && batch <= 65536, 1, "invalid batch size");
+	luaProfile = lua_newuserdata(L, sizeof(struct luaApi_profile));	// +1
+	luaProfile->profile = NULL;
+	luaProfile->apTableRef = LUA_NOREF;
+	luaProfile->owning = FALSE;
+	luaL_setmetatable(L, PROFILE_LUA_OBJECT_TYPE);
+	if(ADIv5_ProfileCreate((unsigned int)batch, &luaProfile->profile) != ADI_SUCCESS){
+		return luaL_error(L, "Failed to create the profiler.");
+	}
+	lua_createtable(L, 0, 0);
+	luaProfile->apTableRef = luaL_ref(L, LUA_REGISTRYINDEX);
+	return 1;
+}
+
+/**
+ * 增加核心,只能在停止时调用
+ * 1#:分析对象
+ * 2#:核心所在的MEM-AP对象
+ * 3#:采样寄存器:"dwt"(默认),"edpcsr","edpcsr64"
+ * 4#:DWT或者核心调试寄存器的基地址,dwt默认0xE0001000
+ * 返回:
+ * 1#:核心编号,从1开始
+ */
+static int luaApi_profile_add_core(lua_State *L){
+	static const char *const types[] = {"dwt", "edpcsr", "edpcsr64", NULL};
+	static const enum profileCoreType typeValues[] = {ProfileCore_DWT, ProfileCore_EDPCSR, ProfileCore_EDPCSR64};
+	struct luaApi_profile *luaProfile = checkProfile(L, 1);
+	struct luaApi_accessPort *luaApObj = LuaApiAdiv5CheckAp(L, 2);
+	int type = luaL_checkoption(L, 3, "dwt", types);
+	uint64_t base;
+	unsigned int core;
+	if(typeValues[type] == ProfileCore_DWT){
+		base = (uint64_t)luaL_optinteger(L, 4, PROFILE_DWT_BASE);
+	}else{
+		base = (uint64_t)luaL_checkinteger(L, 4);
+	}
+	if(luaApObj->ap->type != AccessPort_Memory){
+		return luaL_error(L, "Not a memory access port.");
+	}
+	if(ADIv5_ProfileAddCore(luaProfile->profile, luaApObj->ap, typeValues[type], base, &core) != ADI_SUCCESS){
+		return luaL_error(L, "Failed to add the core at 0x%I.", (lua_Integer)base);
+	}
+	// 保持AccessPort对象的引用
+	lua_rawgeti(L, LUA_REGISTRYINDEX, luaProfile->apTableRef);	// +1
+	lua_pushvalue(L, 2);
+	lua_rawseti(L, -2, core + 1);
+	lua_pop(L, 1);
+	lua_pushinteger(L, core + 1);
+	return 1;
+}
+
+/**
+ * 取得第idx个核心所在的Adapter
+ * apTable:核心表在栈中的位置
+ */
+static void *coreDevice(lua_State *L, int apTable, lua_Integer idx){
+	void *device;
+	lua_rawgeti(L, apTable, idx);	// +1
+	device = LuaApiAdiv5ApDevice(L, lua_touserdata(L, -1));
+	lua_pop(L, 1);
+	return device;
+}
+
+/**
+ * 占用或者释放前count个核心所在的Adapter,多个核心在同一个Adapter上时只处理一次
+ * 返回:
+ * 	占用失败的核心编号(从1开始),全部成功时返回0
+ */
+static lua_Integer ownDevices(lua_State *L, struct luaApi_profile *luaProfile, lua_Integer count, BOOL acquire){
+	lua_Integer idx, prev, failed = 0;
+	void *device;
+	int apTable;
+	lua_rawgeti(L, LUA_REGISTRYINDEX, luaProfile->apTableRef);	// +1
+	apTable = lua_gettop(L);
+	for(idx = 1; idx <= count; idx++){
+		device = coreDevice(L, apTable, idx);
+		for(prev = 1; prev < idx && coreDevice(L, apTable, prev) != device; prev++);
+		if(prev < idx) continue;	// 前面的核心已经处理过这个Adapter
+		if(!acquire){
+			Async_Release(device);
+		}else if(Async_Acquire(device) == FALSE){
+			failed = idx;
+			break;
+		}
+	}
+	lua_pop(L, 1);
+	return failed;
+}
+
+/**
+ * 等待采样线程结束之后释放Adapter
+ */
+static void releaseDevices(lua_State *L, struct luaApi_profile *luaProfile){
+	lua_Integer count;
+	if(!luaProfile->owning) return;
+	lua_rawgeti(L, LUA_REGISTRYINDEX, luaProfile->apTableRef);
+	count = (lua_Integer)lua_rawlen(L, -1);
+	lua_pop(L, 1);
+	ownDevices(L, luaProfile, count, FALSE);
+	luaProfile->owning = FALSE;
+}
+
+/**
+ * 启动采样线程
+ * 1#:分析对象
+ * 2#:采样时间(毫秒,可选),不指定时一直采样直到Stop
+ */
+static int luaApi_profile_start(lua_State *L){
+	struct luaApi_profile *luaProfile = checkProfile(L, 1);
+	lua_Integer duration = luaL_optinteger(L, 2, 0);
+	lua_Integer count, failed;
+	struct profileStats stats;
+	luaL_argcheck(L, duration >= 0 && duration <= UINT32_MAX, 2, "invalid duration");
+	if(luaProfile->owning){
+		ADIv5_ProfileStats(luaProfile->profile, &stats);
+		if(stats.running) return 0;
+		// 上一次定时采样已经结束但是没有Wait
+		ADIv5_ProfileWait(luaProfile->profile);
+		releaseDevices(L, luaProfile);
+	}
+	lua_rawgeti(L, LUA_REGISTRYINDEX, luaProfile->apTableRef);
+	count = (lua_Integer)lua_rawlen(L, -1);
+	lua_pop(L, 1);
+	failed = ownDevices(L, luaProfile, count, TRUE);
+	if(failed){
+		ownDevices(L, luaProfile, failed - 1, FALSE);
+		return luaL_error(L, "The adapter of core %d is busy, cannot start the profiler.", (int)failed);
+	}
+	if(ADIv5_ProfileStart(luaProfile->profile, (unsigned int)duration) != ADI_SUCCESS){
+		ownDevices(L, luaProfile, count, FALSE);
+		return luaL_error(L, "Failed to start the profiler.");
+	}
+	luaProfile->owning = TRUE;
+	return 0;
+}
+
+/**
+ * 等待采样结束
+ * 1#:分析对象
+ */
+static int luaApi_profile_wait(lua_State *L){
+	struct luaApi_profile *luaProfile = checkProfile(L, 1);
+	ADIv5_ProfileWait(luaProfile->profile);
+	releaseDevices(L, luaProfile);
+	return 0;
+}
+
+/**
+ * 停止采样线程
+ * 1#:分析对象
+ */
+static int luaApi_profile_stop(lua_State *L){
+	struct luaApi_profile *luaProfile = checkProfile(L, 1);
+	ADIv5_ProfileStop(luaProfile->profile);
+	releaseDevices(L, luaProfile);
+	return 0;
+}
+
+/**
+ * 清空直方图
+ * 1#:分析对象
+ */
+static int luaApi_profile_clear(lua_State *L){
+	struct luaApi_profile *luaProfile = checkProfile(L, 1);
+	ADIv5_ProfileClear(luaProfile->profile);
+	return 0;
+}
+
+/**
+ * 统计信息
+ * 1#:分析对象
+ * 返回:
+ * 1#:表,字段见struct profileStats,另外rate是每秒的采样数
+ */
+static int luaApi_profile_stats(lua_State *L){
+	struct luaApi_profile *luaProfile = checkProfile(L, 1);
+	struct profileStats stats;
+	ADIv5_ProfileStats(luaProfile->profile, &stats);
+	lua_createtable(L, 0, 9);
+	lua_pushinteger(L, (lua_Integer)stats.samples);
+	lua_setfield(L, -2, "samples");
+	lua_pushinteger(L, (lua_Integer)stats.invalid);
+	lua_setfield(L, -2, "invalid");
+	lua_pushinteger(L, (lua_Integer)stats.batches);
+	lua_setfield(L, -2, "batches");
+	lua_pushinteger(L, (lua_Integer)stats.errors);
+	lua_setfield(L, -2, "errors");
+	lua_pushnumber(L, (lua_Number)stats.elapsedNs / 1e9);
+	lua_setfield(L, -2, "elapsed");
+	lua_pushnumber(L, stats.elapsedNs ? (lua_Number)(stats.samples + stats.invalid) * 1e9 / (lua_Number)stats.elapsedNs : 0);
+	lua_setfield(L, -2, "rate");
+	lua_pushinteger(L, stats.uniquePCs);
+	lua_setfield(L, -2, "uniquePCs");
+	lua_pushinteger(L, stats.lastError);
+	lua_setfield(L, -2, "lastError");
+	lua_pushboolean(L, stats.running);
+	lua_setfield(L, -2, "running");
+	return 1;
+}
+
+/**
+ * 取出直方图,按命中次数从多到少排序,只能在停止时调用
+ * 1#:分析对象
+ * 2#:ELF文件路径(可选),用于解析函数名
+ * 3#:最多返回的项数(可选)
+ * 返回:
+ * 1#:数组,每项是{pc=, core=, count=, func=, offset=},没有解析到函数时没有func和offset
+ */
+static int luaApi_profile_hits(lua_State *L){
+	struct luaApi_profile *luaProfile = checkProfile(L, 1);
+	lua_Integer max = luaL_optinteger(L, 3, LUA_MAXINTEGER);
+	struct profileHit *hits;
+	unsigned int count, idx;
+	const char *name;
+	uint64_t offset;
+	Symbols syms;
+	luaL_argcheck(L, max >= 0, 3, "invalid count");
+	syms = optSymbols(L, 2);
+	count = ADIv5_ProfileHits(luaProfile->profile, &hits);
+	if(max < count) count = (unsigned int)max;
+	lua_createtable(L, count, 0);	// +1
+	for(idx = 0; idx < count; idx++){
+		lua_createtable(L, 0, 5);
+		lua_pushinteger(L, (lua_Integer)hits[idx].pc);
+		lua_setfield(L, -2, "pc");
+		lua_pushinteger(L, hits[idx].core + 1);
+		lua_setfield(L, -2, "core");
+		lua_pushinteger(L, (lua_Integer)hits[idx].count);
+		lua_setfield(L, -2, "count");
+		if(syms && symbols_Function(syms, hits[idx].pc, &name, &offset)){
+			lua_pushstring(L, name);
+			lua_setfield(L, -2, "func");
+			lua_pushinteger(L, (lua_Integer)offset);
+			lua_setfield(L, -2, "offset");
+		}
+		lua_rawseti(L, -2, idx + 1);
+	}
+	free(hits);
+	if(syms) symbols_Free(&syms);
+	return 1;
+}
+
+/**
+ * 导出采样结果,只能在停止时调用
+ * 1#:分析对象
+ * 2#:文件路径
+ * 3#:格式:"folded"(默认,flamegraph.pl的输入)或者"perf"(perf script的文本格式)
+ * 4#:ELF文件路径(可选),用于解析函数名
+ */
+static int luaApi_profile_export(lua_State *L){
+	static const char *const formats[] = {"folded", "perf", NULL};
+	struct luaApi_profile *luaProfile = checkProfile(L, 1);
+	const char *path = luaL_checkstring(L, 2);
+	int format = luaL_checkoption(L, 3, "folded", formats);
+	Symbols syms = optSymbols(L, 4);
+	int result = ADIv5_ProfileExport(luaProfile->profile, path, format == 0 ? ProfileExport_Folded : ProfileExport_Perf, syms);
+	if(syms) symbols_Free(&syms);
+	if(result != ADI_SUCCESS){
+		return luaL_error(L, "Failed to export the profile to %s.", path);
+	}
+	return 0;
+}
+
+static int luaApi_profile_gc(lua_State *L){
+	struct luaApi_profile *luaProfile = luaL_checkudata(L, 1, PROFILE_LUA_OBJECT_TYPE);
+	if(luaProfile->profile){
+		ADIv5_ProfileDestroy(&luaProfile->profile);
+	}
+	releaseDevices(L, luaProfile);
+	luaL_unref(L, LUA_REGISTRYINDEX, luaProfile->apTableRef);
+	luaProfile->apTableRef = LUA_NOREF;
+	return 0;
+}
+
+// 模块静态函数
+static const luaL_Reg lib_profile_f[] = {
+	{"New", luaApi_profile_new},
+	{NULL, NULL}
+};
+
+// 分析对象方法
+static const luaL_Reg lib_profile_oo[] = {
+	{"AddCore", luaApi_profile_add_core},
+	{"Start", luaApi_profile_start},
+	{"Wait", luaApi_profile_wait},
+	{"Stop", luaApi_profile_stop},
+	{"Clear", luaApi_profile_clear},
+	{"Stats", luaApi_profile_stats},
+	{"Hits", luaApi_profile_hits},
+	{"Export", luaApi_profile_export},
+	{NULL, NULL}
+};
+
+int luaopen_profiler (lua_State *L) {
+	lua_createtable(L, 0, 0);
+	luaL_setfuncs(L, lib_profile_f, 0);
+	return 1;
+}
+
+// 注册接口调用
+void RegisterApi_Profiler(lua_State *L){
+	LuaApiNewTypeMetatable(L, PROFILE_LUA_OBJECT_TYPE, luaApi_profile_gc, lib_profile_oo);
+	lua_pop(L, 1);
+	luaL_requiref(L, "Profiler", luaopen_profiler, 0);
+	lua_pop(L, 1);
+}
@@ -0,0 +1,279 @@
+/*
+ * ADIv5_watch.c
+ *
+ *  Created on: 2019-7-6
+ *      Author: virusv
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "smart_ocd.h"
+#include "misc/log.h"
+#include "misc/async.h"
+#include "arch/ARM/ADI/include/ADIv5.h"
+
+#include "api/api.h"
+#include "api/arch/ARM/ADI/ADIv5_api.h"
+
+/**
+ * 后台监视目标变量
+ * w = Watch.New(ap, 1000)	-- 1kHz节拍
+ * w:Add(addr, 4, 100, "g_stats.rx_count")	-- 4字节,100Hz
+ * w:Start(); ...; local times, entries, values = w:Drain()
+ * 监视线程运行期间占用这个MEM-AP所在的Adapter,同步接口和异步接口都会抛出错误,需要访问时先Stop
+ */
+#define WATCH_LUA_OBJECT_TYPE "Watch"
+#define WATCH_DEFAULT_CAPACITY	65536
+#define WATCH_DRAIN_CHUNK	4096
+
+struct luaApi_watch {
+	int apReference;	// AccessPort对象的引用
+	void *device;	// 运行期间占用的Adapter,停止时为NULL
+	MemWatch watch;
+};
+
+static struct luaApi_watch *checkWatch(lua_State *L, int idx){
+	struct luaApi_watch *luaWatch = luaL_checkudata(L, idx, WATCH_LUA_OBJECT_TYPE);
+	if(luaWatch->watch == NULL){
+		luaL_error(L, "Watch object has been destroyed.");
+	}
+	return luaWatch;
+}
+
+/**
+ * 新建监视对象
+ * 1#:MEM-AP对象
+ * 2#:节拍频率(Hz),0表示连续采样
+ * 3#:环形缓冲区的采样数(可选)
+ * 返回:
+ * 1#:监视对象
+ */
+static int luaApi_watch_new(lua_State *L){
+	struct luaApi_accessPort *luaApObj = LuaApiAdiv5CheckAp(L, 1);
+	lua_Integer tickHz = luaL_checkinteger(L, 2);
+	lua_Integer capacity = luaL_optinteger(L, 3, WATCH_DEFAULT_CAPACITY);
+	struct luaApi_watch *luaWatch;
+	if(luaApObj->ap->type != AccessPort_Memory){
+		return luaL_error(L, "Not a memory access port.");
+	}
+	luaL_argcheck(L, tickHz >= 0 && tickHz <= 1000000, 2, "invalid tick rate");
+	luaL_argcheck(L, capacity > 0 && capacity <= (1 << 30), 3, "invalid capacity");
+	luaWatch = lua_newuserdata(L, sizeof(struct luaApi_watch));	// +1
+	luaWatch->watch = NULL;
+	luaWatch->apReference = LUA_NOREF;
+	luaWatch->device = NULL;
+	luaL_setmetatable(L, WATCH_LUA_OBJECT_TYPE);
+	if(ADIv5_WatchCreate(luaApObj->ap, (unsigned int)tickHz, (unsigned int)capacity, &luaWatch->watch) != ADI_SUCCESS){
+		return luaL_error(L, "Failed to create the watch.");
+	}
+	lua_pushvalue(L, 1);
+	luaWatch->apReference = luaL_ref(L, LUA_REGISTRYINDEX);
+	return 1;
+}
+
+/**
+ * 增加监视项,只能在停止时调用
+ * 1#:监视对象
+ * 2#:地址
+ * 3#:字节数:1,2,4,8
+ * 4#:采样频率(Hz),0表示每个节拍都采样
+ * 5#:名字(可选),用于日志文件
+ * 返回:
+ * 1#:监视项的编号,从1开始,和Drain返回的编号对应
+ */
+static int luaApi_watch_add(lua_State *L){
+	struct luaApi_watch *luaWatch = checkWatch(L, 1);
+	uint64_t addr = (uint64_t)luaL_checkinteger(L, 2);
+	lua_Integer width = luaL_checkinteger(L, 3);
+	lua_Integer rate = luaL_optinteger(L, 4, 0);
+	const char *name = luaL_optstring(L, 5, NULL);
+	enum dataSize size;
+	unsigned int entry;
+	switch(width){
+	case 1: size = DataSize_8; break;
+	case 2: size = DataSize_16; break;
+	case 4: size = DataSize_32; break;
+	case 8: size = DataSize_64; break;
+	default:
+		return luaL_argerror(L, 3, "width must be 1, 2, 4 or 8");
+	}
+	luaL_argcheck(L, rate >= 0, 4, "invalid sample rate");
+	if(ADIv5_WatchAdd(luaWatch->watch, addr, size, (unsigned int)rate, name, &entry) != ADI_SUCCESS){
+		return luaL_error(L, "Failed to add watch entry at 0x%I.", (lua_Integer)addr);
+	}
+	lua_pushinteger(L, entry + 1);
+	return 1;
+}
+
+/**
+ * 设置日志文件,只能在停止时调用
+ * 设置后采样由日志线程写入文件,Drain不再返回采样
+ * 1#:监视对象
+ * 2#:文件路径,nil表示取消
+ * 3#:格式:"csv"(默认)或者"binary"
+ */
+static int luaApi_watch_log(lua_State *L){
+	static const char *const formats[] = {"csv", "binary", NULL};
+	struct luaApi_watch *luaWatch = checkWatch(L, 1);
+	const char *path = luaL_optstring(L, 2, NULL);
+	int format = luaL_checkoption(L, 3, "csv", formats);
+	if(ADIv5_WatchLog(luaWatch->watch, path, format == 0 ? WatchLog_CSV : WatchLog_Binary) != ADI_SUCCESS){
+		return luaL_error(L, "Failed to set the watch log.");
+	}
+	return 0;
+}
+
+/**
+ * 启动监视线程
+ * 1#:监视对象
+ */
+static int luaApi_watch_start(lua_State *L){
+	struct luaApi_watch *luaWatch = checkWatch(L, 1);
+	void *device;
+	if(luaWatch->device){	// 已经在运行
+		return 0;
+	}
+	device = LuaApiAdiv5ApDevice(L, LuaApiAdiv5CheckApRef(L, luaWatch->apReference));
+	if(Async_Acquire(device) == FALSE){
+		return luaL_error(L, "The adapter is busy, cannot start the watch.");
+	}
+	if(ADIv5_WatchStart(luaWatch->watch) != ADI_SUCCESS){
+		Async_Release(device);
+		return luaL_error(L, "Failed to start the watch.");
+	}
+	luaWatch->device = device;
+	return 0;
+}
+
+/**
+ * 监视线程停止之后释放Adapter
+ */
+static void releaseDevice(struct luaApi_watch *luaWatch){
+	if(luaWatch->device){
+		Async_Release(luaWatch->device);
+		luaWatch->device = NULL;
+	}
+}
+
+/**
+ * 停止监视线程
+ * 1#:监视对象
+ */
+static int luaApi_watch_stop(lua_State *L){
+	struct luaApi_watch *luaWatch = checkWatch(L, 1);
+	ADIv5_WatchStop(luaWatch->watch);
+	releaseDevice(luaWatch);
+	return 0;
+}
+
+/**
+ * 读出采样
+ * 1#:监视对象
+ * 2#:最多读出的采样数(可选),默认读出所有
+ * 返回:
+ * 1#:采样时间数组,从Start开始的秒数
+ * 2#:监视项编号数组
+ * 3#:值数组
+ */
+static int luaApi_watch_drain(lua_State *L){
+	struct luaApi_watch *luaWatch = checkWatch(L, 1);
+	lua_Integer max = luaL_optinteger(L, 2, LUA_MAXINTEGER);
+	struct watchSample *samples;
+	unsigned int count, idx;
+	lua_Integer total = 0;
+	luaL_argcheck(L, max >= 0, 2, "invalid count");
+	lua_createtable(L, 0, 0);	// +1
+	lua_createtable(L, 0, 0);	// +1
+	lua_createtable(L, 0, 0);	// +1
+	samples = lua_newuserdata(L, WATCH_DRAIN_CHUNK * sizeof(struct watchSample));	// +1
+	while(total < max){
+		count = ADIv5_WatchDrain(luaWatch->watch, samples, max - total < WATCH_DRAIN_CHUNK ? (unsigned int)(max - total) : WATCH_DRAIN_CHUNK);
+		if(count == 0) break;
+		for(idx = 0; idx < count; idx++){
+			lua_pushnumber(L, (lua_Number)samples[idx].time / 1e9);
+			lua_rawseti(L, -5, total + idx + 1);
+			lua_pushinteger(L, samples[idx].entry + 1);
+			lua_rawseti(L, -4, total + idx + 1);
+			lua_pushinteger(L, (lua_Integer)samples[idx].value);
+			lua_rawseti(L, -3, total + idx + 1);
+		}
+		total += count;
+	}
+	lua_pop(L, 1);
+	return 3;
+}
+
+/**
+ * 统计信息
+ * 1#:监视对象
+ * 返回:
+ * 1#:表,字段见struct watchStats
+ */
+static int luaApi_watch_stats(lua_State *L){
+	struct luaApi_watch *luaWatch = checkWatch(L, 1);
+	struct watchStats stats;
+	ADIv5_WatchStats(luaWatch->watch, &stats);
+	lua_createtable(L, 0, 9);
+	lua_pushinteger(L, (lua_Integer)stats.ticks);
+	lua_setfield(L, -2, "ticks");
+	lua_pushinteger(L, (lua_Integer)stats.transactions);
+	lua_setfield(L, -2, "transactions");
+	lua_pushinteger(L, (lua_Integer)stats.samples);
+	lua_setfield(L, -2, "samples");
+	lua_pushinteger(L, (lua_Integer)stats.dropped);
+	lua_setfield(L, -2, "dropped");
+	lua_pushinteger(L, (lua_Integer)stats.late);
+	lua_setfield(L, -2, "late");
+	lua_pushinteger(L, (lua_Integer)stats.errors);
+	lua_setfield(L, -2, "errors");
+	lua_pushinteger(L, (lua_Integer)stats.logged);
+	lua_setfield(L, -2, "logged");
+	lua_pushinteger(L, stats.lastError);
+	lua_setfield(L, -2, "lastError");
+	lua_pushboolean(L, stats.running);
+	lua_setfield(L, -2, "running");
+	return 1;
+}
+
+static int luaApi_watch_gc(lua_State *L){
+	struct luaApi_watch *luaWatch = luaL_checkudata(L, 1, WATCH_LUA_OBJECT_TYPE);
+	if(luaWatch->watch){
+		ADIv5_WatchDestroy(&luaWatch->watch);
+	}
+	releaseDevice(luaWatch);
+	luaL_unref(L, LUA_REGISTRYINDEX, luaWatch->apReference);
+	luaWatch->apReference = LUA_NOREF;
+	return 0;
+}
+
+// 模块静态函数
+static const luaL_Reg lib_watch_f[] = {
+	{"New", luaApi_watch_new},
+	{NULL, NULL}
+};
+
+// 监视对象方法
+static const luaL_Reg lib_watch_oo[] = {
+	{"Add", luaApi_watch_add},
+	{"Log", luaApi_watch_log},
+	{"Start", luaApi_watch_start},
+	{"Stop", luaApi_watch_stop},
+	{"Drain", luaApi_watch_drain},
+	{"Stats", luaApi_watch_stats},
+	{NULL, NULL}
+};
+
+int luaopen_watch (lua_State *L) {
+	lua_createtable(L, 0, 0);
+	luaL_setfuncs(L, lib_watch_f, 0);
+	return 1;
+}
+
+// 注册接口调用
+void RegisterApi_Watch(lua_State *L){
+	LuaApiNewTypeMetatable(L, WATCH_LUA_OBJECT_TYPE, luaApi_watch_gc, lib_watch_oo);
+	lua_pop(L, 1);
+	luaL_requiref(L, "Watch", luaopen_watch, 0);
+	lua_pop(L, 1);
+}
@@ -0,0 +1,751 @@
+/*
+ * SVD.c
+ *
+ *  Created on: 2019-7-4
+ *      Author: virusv
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "smart_ocd.h"
+#include "misc/log.h"
+#include "arch/ARM/CMSIS/include/SVD.h"
+
+#include "api/api.h"
+#include "api/arch/ARM/ADI/ADIv5_api.h"
+
+/**
+ * 按名字访问外设寄存器
+ * db = SVD.Load(path); dev = db:Bind(ap)
+ * dev.RCC.AHB1ENR.GPIOEEN = 1	-- 读-改-写一个位域
+ * dev.RCC.CR:Modify{HSEON = 1, CSSON = 0}	-- 多个位域只读写一次
+ * 在dev:Begin()和dev:Commit()之间,每个寄存器只读一次,修改保存在影子寄存器中,
+ * Commit时所有改过的寄存器用一次WriteMany写入。写1清零之类有副作用的寄存器不要在批处理中读-改-写
+ * 外设和寄存器对象第一次访问后缓存在父对象中,之后的访问只有一次散列表查找
+ */
+#define SVD_LUA_OBJECT_TYPE "arch.ARM.SVD"
+#define SVD_DEVICE_LUA_OBJECT_TYPE "arch.ARM.SVD.Device"
+#define SVD_PERIPHERAL_LUA_OBJECT_TYPE "arch.ARM.SVD.Peripheral"
+#define SVD_REGISTER_LUA_OBJECT_TYPE "arch.ARM.SVD.Register"
+
+struct luaApi_svd {
+	SVDDatabase db;
+};
+
+// 批处理中的影子寄存器
+struct svdShadow {
+	uint64_t addr;
+	const struct svdRegister *reg;
+	uint32_t value;
+	BOOL dirty;
+};
+
+struct luaApi_svdDevice {
+	int dbReference;	// 数据库对象的引用
+	int apReference;	// AccessPort对象的引用
+	SVDDatabase db;
+	AccessPort ap;
+	BOOL batch;	// 是否在Begin和Commit之间
+	struct svdShadow *shadow;
+	unsigned int shadowCount, shadowCapacity;
+};
+
+// 外设对象,uservalue是表:[1]为Device对象,其余是按名字缓存的寄存器对象
+struct luaApi_svdPeripheral {
+	struct luaApi_svdDevice *device;
+	const struct svdPeripheral *peripheral;
+};
+
+// 寄存器对象,uservalue是Device对象
+struct luaApi_svdRegister {
+	struct luaApi_svdDevice *device;
+	const struct svdPeripheral *peripheral;
+	const struct svdRegister *reg;
+	uint64_t addr;
+};
+
+static enum dataSize regDataSize(const struct svdRegister *reg){
+	switch(reg->size){
+	case 8: return DataSize_8;
+	case 16: return DataSize_16;
+	default: return DataSize_32;
+	}
+}
+
+static uint32_t fieldMask(const struct svdField *field){
+	return (field->bitWidth >= 32 ? 0xFFFFFFFFu : ((1u << field->bitWidth) - 1)) << field->bitOffset;
+}
+
+static struct svdShadow *findShadow(struct luaApi_svdDevice *device, uint64_t addr){
+	unsigned int i;
+	for(i = 0; i < device->shadowCount; i++){
+		if(device->shadow[i].addr == addr) return &device->shadow[i];
+	}
+	return NULL;
+}
+
+static struct svdShadow *addShadow(lua_State *L, struct luaApi_svdDevice *device, const struct svdRegister *reg, uint64_t addr, uint32_t value){
+	struct svdShadow *shadow;
+	if(device->shadowCount == device->shadowCapacity){
+		unsigned int capacity = device->shadowCapacity ? device->shadowCapacity * 2 : 16;
+		shadow = realloc(device->shadow, capacity * sizeof(struct svdShadow));
+		if(shadow == NULL){
+			luaL_error(L, "Not enough memory.");
+			return NULL;
+		}
+		device->shadow = shadow;
+		device->shadowCapacity = capacity;
+	}
+	shadow = &device->shadow[device->shadowCount++];
+	shadow->addr = addr;
+	shadow->reg = reg;
+	shadow->value = value;
+	shadow->dirty = FALSE;
+	return shadow;
+}
+
+/**
+ * 读寄存器的值
+ * 只写寄存器没有可读的值,使用复位值
+ */
+static uint32_t readRegister(lua_State *L, struct luaApi_svdRegister *luaReg){
+	struct luaApi_svdDevice *device = luaReg->device;
+	struct memoryAccess access;
+	struct svdShadow *shadow;
+	if(device->batch && (shadow = findShadow(device, luaReg->addr)) != NULL){
+		return shadow->value;
+	}
+	if(!(luaReg->reg->access & SVD_ACCESS_READ)){
+		access.data = luaReg->reg->resetValue & luaReg->reg->resetMask;
+	}else{
+		access.addr = luaReg->addr;
+		access.size = regDataSize(luaReg->reg);
+		access.data = 0;
+		LuaApiAdiv5CheckApRef(L, device->apReference);
+		if(device->ap->Interface.Memory.ReadMany(device->ap, &access, 1) != ADI_SUCCESS){
+			return luaL_error(L, "Read register %s.%s failed!", SVD_Name(device->db, luaReg->peripheral->name), SVD_Name(device->db, luaReg->reg->name));
+		}
+	}
+	if(device->batch){
+		addShadow(L, device, luaReg->reg, luaReg->addr, (uint32_t)access.data);
+	}
+	return (uint32_t)access.data;
+}
+
+/**
+ * 写寄存器,批处理中只修改影子寄存器
+ */
+static void writeRegister(lua_State *L, struct luaApi_svdRegister *luaReg, uint32_t value){
+	struct luaApi_svdDevice *device = luaReg->device;
+	struct memoryAccess access;
+	struct svdShadow *shadow;
+	if(!(luaReg->reg->access & SVD_ACCESS_WRITE)){
+		luaL_error(L, "Register %s.%s is read-only.", SVD_Name(device->db, luaReg->peripheral->name), SVD_Name(device->db, luaReg->reg->name));
+		return;
+	}
+	if(device->batch){
+		shadow = findShadow(device, luaReg->addr);
+		if(shadow == NULL){
+			shadow = addShadow(L, device, luaReg->reg, luaReg->addr, value);
+		}
+		shadow->value = value;
+		shadow->dirty = TRUE;
+		return;
+	}
+	access.addr = luaReg->addr;
+	access.size = regDataSize(luaReg->reg);
+	access.data = value;
+	LuaApiAdiv5CheckApRef(L, device->apReference);
+	if(device->ap->Interface.Memory.WriteMany(device->ap, &access, 1) != ADI_SUCCESS){
+		luaL_error(L, "Write register %s.%s failed!", SVD_Name(device->db, luaReg->peripheral->name), SVD_Name(device->db, luaReg->reg->name));
+	}
+}
+
+static const struct svdField *checkField(lua_State *L, struct luaApi_svdRegister *luaReg, const char *name, int access){
+	SVDDatabase db = luaReg->device->db;
+	const struct svdField *field = SVD_FindField(db, luaReg->reg, name);
+	if(field == NULL){
+		luaL_error(L, "Register %s.%s has no field %s.", SVD_Name(db, luaReg->peripheral->name), SVD_Name(db, luaReg->reg->name), name);
+		return NULL;
+	}
+	if(!(field->access & access)){
+		luaL_error(L, "Field %s.%s.%s is %s.", SVD_Name(db, luaReg->peripheral->name), SVD_Name(db, luaReg->reg->name), name,
+				access == SVD_ACCESS_READ ? "write-only" : "read-only");
+		return NULL;
+	}
+	return field;
+}
+
+/**
+ * 把新值合并到寄存器的值中
+ * idx:新值在栈上的索引
+ */
+static uint32_t insertField(lua_State *L, struct luaApi_svdRegister *luaReg, const struct svdField *field, uint32_t value, int idx){
+	lua_Integer fieldValue = luaL_checkinteger(L, idx);
+	uint32_t mask = fieldMask(field);
+	if(fieldValue < 0 || (((uint64_t)fieldValue << field->bitOffset) & ~(uint64_t)mask) != 0){
+		return luaL_error(L, "Value %I does not fit field %s (%d bits).", fieldValue,
+				SVD_Name(luaReg->device->db, field->name), field->bitWidth);
+	}
+	return (value & ~mask) | ((uint32_t)fieldValue << field->bitOffset);
+}
+
+/**
+ * 加载SVD文件,编译好的数据库缓存在磁盘上
+ * 1#:SVD文件路径
+ * 返回:
+ * 1#:数据库对象
+ */
+static int luaApi_svd_load(lua_State *L){
+	const char *path = luaL_checkstring(L, 1);
+	struct luaApi_svd *luaSvd = lua_newuserdata(L, sizeof(struct luaApi_svd));	// +1
+	luaSvd->db = SVD_Load(path);
+	if(luaSvd->db == NULL){
+		return luaL_error(L, "Failed to load SVD file %s.", path);
+	}
+	luaL_setmetatable(L, SVD_LUA_OBJECT_TYPE);
+	return 1;
+}
+
+/**
+ * 数据库统计信息
+ * 1#:数据库对象
+ * 返回:
+ * 1#:外设数
+ * 2#:寄存器数
+ * 3#:位域数
+ * 4#:数据库字节数
+ */
+static int luaApi_svd_info(lua_State *L){
+	struct luaApi_svd *luaSvd = luaL_checkudata(L, 1, SVD_LUA_OBJECT_TYPE);
+	unsigned int peripherals, registers, fields;
+	size_t bytes;
+	SVD_Info(luaSvd->db, &peripherals, &registers, &fields, &bytes);
+	lua_pushinteger(L, peripherals);
+	lua_pushinteger(L, registers);
+	lua_pushinteger(L, fields);
+	lua_pushinteger(L, (lua_Integer)bytes);
+	return 4;
+}
+
+/**
+ * 所有外设的名字
+ * 1#:数据库对象
+ * 返回:
+ * 1#:名字数组
+ */
+static int luaApi_svd_peripherals(lua_State *L){
+	struct luaApi_svd *luaSvd = luaL_checkudata(L, 1, SVD_LUA_OBJECT_TYPE);
+	const struct svdPeripheral *peripheral;
+	unsigned int i;
+	lua_newtable(L);
+	for(i = 0; (peripheral = SVD_Peripheral(luaSvd->db, i)) != NULL; i++){
+		lua_pushstring(L, SVD_Name(luaSvd->db, peripheral->name));
+		lua_rawseti(L, -2, i + 1);
+	}
+	return 1;
+}
+
+/**
+ * 查找外设、寄存器或者位域
+ * 1#:数据库对象
+ * 2#:"外设"、"外设.寄存器"或者"外设.寄存器.位域"
+ * 返回:
+ * 外设:基址
+ * 寄存器:地址,位宽,复位值
+ * 位域:寄存器地址,最低位,位宽
+ * 不存在时返回nil
+ */
+static int luaApi_svd_lookup(lua_State *L){
+	struct luaApi_svd *luaSvd = luaL_checkudata(L, 1, SVD_LUA_OBJECT_TYPE);
+	const char *path = luaL_checkstring(L, 2);
+	const struct svdPeripheral *peripheral;
+	const struct svdRegister *reg;
+	const struct svdField *field;
+	char name[128], *regName, *fieldName;
+	snprintf(name, sizeof(name), "%s", path);
+	regName = strchr(name, '.');
+	if(regName) *regName++ = '\0';
+	fieldName = regName ? strchr(regName, '.') : NULL;
+	if(fieldName) *fieldName++ = '\0';
+	peripheral = SVD_FindPeripheral(luaSvd->db, name);
+	if(peripheral == NULL) return 0;
+	if(regName == NULL){
+		lua_pushinteger(L, peripheral->baseAddress);
+		return 1;
+	}
+	reg = SVD_FindRegister(luaSvd->db, peripheral, regName);
+	if(reg == NULL) return 0;
+	if(fieldName == NULL){
+		lua_pushinteger(L, (lua_Integer)peripheral->baseAddress + reg->addressOffset);
+		lua_pushinteger(L, reg->size);
+		lua_pushinteger(L, reg->resetValue);
+		return 3;
+	}
+	field = SVD_FindField(luaSvd->db, reg, fieldName);
+	if(field == NULL) return 0;
+	lua_pushinteger(L, (lua_Integer)peripheral->baseAddress + reg->addressOffset);
+	lua_pushinteger(L, field->bitOffset);
+	lua_pushinteger(L, field->bitWidth);
+	return 3;
+}
+
+/**
+ * 把数据库绑定到MEM-AP上
+ * 1#:数据库对象
+ * 2#:MEM-AP对象
+ * 返回:
+ * 1#:Device对象,dev.外设.寄存器.位域访问寄存器
+ */
+static int luaApi_svd_bind(lua_State *L){
+	struct luaApi_svd *luaSvd = luaL_checkudata(L, 1, SVD_LUA_OBJECT_TYPE);
+	struct luaApi_accessPort *luaApObj = LuaApiAdiv5CheckAp(L, 2);
+	struct luaApi_svdDevice *device;
+	if(luaApObj->ap->type != AccessPort_Memory){
+		return luaL_error(L, "Not a memory access port.");
+	}
+	device = lua_newuserdata(L, sizeof(struct luaApi_svdDevice));	// +1
+	memset(device, 0x0, sizeof(struct luaApi_svdDevice));
+	device->db = luaSvd->db;
+	device->ap = luaApObj->ap;
+	lua_pushvalue(L, 1);
+	device->dbReference = luaL_ref(L, LUA_REGISTRYINDEX);
+	lua_pushvalue(L, 2);
+	device->apReference = luaL_ref(L, LUA_REGISTRYINDEX);
+	luaL_setmetatable(L, SVD_DEVICE_LUA_OBJECT_TYPE);
+	// 外设对象缓存
+	lua_newtable(L);
+	lua_setuservalue(L, -2);
+	return 1;
+}
+
+static int luaApi_svd_gc(lua_State *L){
+	struct luaApi_svd *luaSvd = luaL_checkudata(L, 1, SVD_LUA_OBJECT_TYPE);
+	if(luaSvd->db){
+		SVD_Close(&luaSvd->db);
+	}
+	return 0;
+}
+
+/**
+ * Device对象的__index
+ * 上值1#:方法表
+ * 1#:Device对象
+ * 2#:外设名或者方法名
+ */
+static int luaApi_svd_device_index(lua_State *L){
+	struct luaApi_svdDevice *device = luaL_checkudata(L, 1, SVD_DEVICE_LUA_OBJECT_TYPE);
+	struct luaApi_svdPeripheral *luaPeripheral;
+	const struct svdPeripheral *peripheral;
+	if(lua_type(L, 2) == LUA_TSTRING){
+		lua_getuservalue(L, 1);	// +1
+		lua_pushvalue(L, 2);
+		if(lua_rawget(L, -2) != LUA_TNIL){
+			return 1;
+		}
+		lua_pop(L, 1);
+		peripheral = SVD_FindPeripheral(device->db, lua_tostring(L, 2));
+		if(peripheral){
+			luaPeripheral = lua_newuserdata(L, sizeof(struct luaApi_svdPeripheral));	// +1
+			luaPeripheral->device = device;
+			luaPeripheral->peripheral = peripheral;
+			luaL_setmetatable(L, SVD_PERIPHERAL_LUA_OBJECT_TYPE);
+			lua_createtable(L, 1, 0);
+			lua_pushvalue(L, 1);
+			lua_rawseti(L, -2, 1);
+			lua_setuservalue(L, -2);
+			lua_pushvalue(L, 2);
+			lua_pushvalue(L, -2);
+			lua_rawset(L, -4);
+			return 1;
+		}
+	}
+	lua_pushvalue(L, 2);
+	lua_rawget(L, lua_upvalueindex(1));
+	return 1;
+}
+
+/**
+ * 开始批处理
+ * 1#:Device对象
+ * ...:要预先读取的寄存器对象(可选),一次读取
+ */
+static int luaApi_svd_device_begin(lua_State *L){
+	struct luaApi_svdDevice *device = luaL_checkudata(L, 1, SVD_DEVICE_LUA_OBJECT_TYPE);
+	struct luaApi_svdRegister *luaReg;
+	struct memoryAccess *access;
+	unsigned int count = 0, i;
+	int argc = lua_gettop(L), pos;
+	if(device->batch){
+		return luaL_error(L, "A batch is already in progress.");
+	}
+	LuaApiAdiv5CheckApRef(L, device->apReference);
+	access = lua_newuserdata(L, (argc > 1 ? argc - 1 : 1) * sizeof(struct memoryAccess));
+	for(pos = 2; pos <= argc; pos++){
+		luaReg = luaL_checkudata(L, pos, SVD_REGISTER_LUA_OBJECT_TYPE);
+		luaL_argcheck(L, luaReg->device == device, pos, "register of another device");
+		if(!(luaReg->reg->access & SVD_ACCESS_READ)) continue;
+		access[count].addr = luaReg->addr;
+		access[count].size = regDataSize(luaReg->reg);
+		access[count].data = 0;
+		count++;
+	}
+	if(count > 0 && device->ap->Interface.Memory.ReadMany(device->ap, access, count) != ADI_SUCCESS){
+		return luaL_error(L, "Read %d registers failed!", count);
+	}
+	device->shadowCount = 0;
+	device->batch = TRUE;
+	for(pos = 2, i = 0; pos <= argc; pos++){
+		luaReg = lua_touserdata(L, pos);
+		if(findShadow(device, luaReg->addr)) continue;
+		if(luaReg->reg->access & SVD_ACCESS_READ){
+			// 和access中的顺序一致
+			for(i = 0; i < count && access[i].addr != luaReg->addr; i++);
+			addShadow(L, device, luaReg->reg, luaReg->addr, (uint32_t)access[i].data);
+		}else{
+			addShadow(L, device, luaReg->reg, luaReg->addr, luaReg->reg->resetValue & luaReg->reg->resetMask);
+		}
+	}
+	return 0;
+}
+
+/**
+ * 结束批处理,修改过的寄存器按第一次访问的顺序用一次WriteMany写入
+ * 1#:Device对象
+ * 返回:
+ * 1#:写入的寄存器数
+ */
+static int luaApi_svd_device_commit(lua_State *L){
+	struct luaApi_svdDevice *device = luaL_checkudata(L, 1, SVD_DEVICE_LUA_OBJECT_TYPE);
+	struct memoryAccess *access;
+	unsigned int count = 0, i;
+	if(!device->batch){
+		return luaL_error(L, "No batch in progress.");
+	}
+	LuaApiAdiv5CheckApRef(L, device->apReference);
+	device->batch = FALSE;
+	access = lua_newuserdata(L, (device->shadowCount ? device->shadowCount : 1) * sizeof(struct memoryAccess));
+	for(i = 0; i < device->shadowCount; i++){
+		if(!device->shadow[i].dirty) continue;
+		access[count].addr = device->shadow[i].addr;
+		access[count].size = regDataSize(device->shadow[i].reg);
+		access[count].data = device->shadow[i].value;
+		count++;
+	}
+	device->shadowCount = 0;
+	if(count > 0 && device->ap->Interface.Memory.WriteMany(device->ap, access, count) != ADI_SUCCESS){
+		return luaL_error(L, "Write %d registers failed!", count);
+	}
+	lua_pushinteger(L, count);
+	return 1;
+}
+
+/**
+ * 放弃批处理中的修改
+ * 1#:Device对象
+ */
+static int luaApi_svd_device_abort(lua_State *L){
+	struct luaApi_svdDevice *device = luaL_checkudata(L, 1, SVD_DEVICE_LUA_OBJECT_TYPE);
+	device->batch = FALSE;
+	device->shadowCount = 0;
+	return 0;
+}
+
+static int luaApi_svd_device_gc(lua_State *L){
+	struct luaApi_svdDevice *device = luaL_checkudata(L, 1, SVD_DEVICE_LUA_OBJECT_TYPE);
+	luaL_unref(L, LUA_REGISTRYINDEX, device->dbReference);
+	luaL_unref(L, LUA_REGISTRYINDEX, device->apReference);
+	free(device->shadow);
+	device->shadow = NULL;
+	return 0;
+}
+
+/**
+ * 外设对象的__index
+ * 上值1#:方法表
+ * 1#:外设对象
+ * 2#:寄存器名或者方法名
+ */
+static int luaApi_svd_peripheral_index(lua_State *L){
+	struct luaApi_svdPeripheral *luaPeripheral = luaL_checkudata(L, 1, SVD_PERIPHERAL_LUA_OBJECT_TYPE);
+	struct luaApi_svdRegister *luaReg;
+	const struct svdRegister *reg;
+	if(lua_type(L, 2) == LUA_TSTRING){
+		lua_getuservalue(L, 1);	// +1
+		lua_pushvalue(L, 2);
+		if(lua_rawget(L, -2) != LUA_TNIL){
+			return 1;
+		}
+		lua_pop(L, 1);
+		reg = SVD_FindRegister(luaPeripheral->device->db, luaPeripheral->peripheral, lua_tostring(L, 2));
+		if(reg){
+			luaReg = lua_newuserdata(L, sizeof(struct luaApi_svdRegister));	// +1
+			luaReg->device = luaPeripheral->device;
+			luaReg->peripheral = luaPeripheral->peripheral;
+			luaReg->reg = reg;
+			luaReg->addr = (uint64_t)luaPeripheral->peripheral->baseAddress + reg->addressOffset;
+			luaL_setmetatable(L, SVD_REGISTER_LUA_OBJECT_TYPE);
+			lua_rawgeti(L, -2, 1);	// Device对象
+			lua_setuservalue(L, -2);
+			lua_pushvalue(L, 2);
+			lua_pushvalue(L, -2);
+			lua_rawset(L, -4);
+			return 1;
+		}
+	}
+	lua_pushvalue(L, 2);
+	lua_rawget(L, lua_upvalueindex(1));
+	return 1;
+}
+
+/**
+ * 外设基址
+ * 1#:外设对象
+ */
+static int luaApi_svd_peripheral_base(lua_State *L){
+	struct luaApi_svdPeripheral *luaPeripheral = luaL_checkudata(L, 1, SVD_PERIPHERAL_LUA_OBJECT_TYPE);
+	lua_pushinteger(L, luaPeripheral->peripheral->baseAddress);
+	return 1;
+}
+
+/**
+ * 外设的所有寄存器名
+ * 1#:外设对象
+ * 返回:
+ * 1#:名字数组
+ */
+static int luaApi_svd_peripheral_registers(lua_State *L){
+	struct luaApi_svdPeripheral *luaPeripheral = luaL_checkudata(L, 1, SVD_PERIPHERAL_LUA_OBJECT_TYPE);
+	const struct svdPeripheral *peripheral = luaPeripheral->peripheral;
+	unsigned int i;
+	lua_createtable(L, peripheral->registerCount, 0);
+	for(i = 0; i < peripheral->registerCount; i++){
+		lua_pushstring(L, SVD_Name(luaPeripheral->device->db, SVD_Register(luaPeripheral->device->db, peripheral->firstRegister + i)->name));
+		lua_rawseti(L, -2, i + 1);
+	}
+	return 1;
+}
+
+/**
+ * 寄存器对象的__index:读位域
+ * 上值1#:方法表
+ * 1#:寄存器对象
+ * 2#:位域名或者方法名
+ */
+static int luaApi_svd_register_index(lua_State *L){
+	struct luaApi_svdRegister *luaReg = luaL_checkudata(L, 1, SVD_REGISTER_LUA_OBJECT_TYPE);
+	const struct svdField *field;
+	uint32_t value;
+	lua_pushvalue(L, 2);
+	if(lua_rawget(L, lua_upvalueindex(1)) != LUA_TNIL){
+		return 1;
+	}
+	field = checkField(L, luaReg, luaL_checkstring(L, 2), SVD_ACCESS_READ);
+	value = readRegister(L, luaReg);
+	lua_pushinteger(L, (value & fieldMask(field)) >> field->bitOffset);
+	return 1;
+}
+
+/**
+ * 寄存器对象的__newindex:读-改-写位域
+ * 1#:寄存器对象
+ * 2#:位域名
+ * 3#:位域的值
+ */
+static int luaApi_svd_register_newindex(lua_State *L){
+	struct luaApi_svdRegister *luaReg = luaL_checkudata(L, 1, SVD_REGISTER_LUA_OBJECT_TYPE);
+	const struct svdField *field = checkField(L, luaReg, luaL_checkstring(L, 2), SVD_ACCESS_WRITE);
+	writeRegister(L, luaReg, insertField(L, luaReg, field, readRegister(L, luaReg), 3));
+	return 0;
+}
+
+/**
+ * 读寄存器
+ * 1#:寄存器对象
+ */
+static int luaApi_svd_register_read(lua_State *L){
+	struct luaApi_svdRegister *luaReg = luaL_checkudata(L, 1, SVD_REGISTER_LUA_OBJECT_TYPE);
+	lua_pushinteger(L, readRegister(L, luaReg));
+	return 1;
+}
+
+/**
+ * 写寄存器
+ * 1#:寄存器对象
+ * 2#:值
+ */
+static int luaApi_svd_register_write(lua_State *L){
+	struct luaApi_svdRegister *luaReg = luaL_checkudata(L, 1, SVD_REGISTER_LUA_OBJECT_TYPE);
+	uint32_t value = (uint32_t)luaL_checkinteger(L, 2);
+	writeRegister(L, luaReg, value);
+	return 0;
+}
+
+/**
+ * 一次读-改-写多个位域
+ * 1#:寄存器对象
+ * 2#:{位域名 = 值}
+ * 返回:
+ * 1#:写入的值
+ */
+static int luaApi_svd_register_modify(lua_State *L){
+	struct luaApi_svdRegister *luaReg = luaL_checkudata(L, 1, SVD_REGISTER_LUA_OBJECT_TYPE);
+	const struct svdField *field;
+	uint32_t value;
+	luaL_checktype(L, 2, LUA_TTABLE);
+	// 先检查所有位域,出错时不访问目标
+	lua_pushnil(L);
+	while(lua_next(L, 2) != 0){
+		checkField(L, luaReg, luaL_checkstring(L, -2), SVD_ACCESS_WRITE);
+		lua_pop(L, 1);
+	}
+	value = readRegister(L, luaReg);
+	lua_pushnil(L);
+	while(lua_next(L, 2) != 0){
+		field = SVD_FindField(luaReg->device->db, luaReg->reg, lua_tostring(L, -2));
+		value = insertField(L, luaReg, field, value, -1);
+		lua_pop(L, 1);
+	}
+	writeRegister(L, luaReg, value);
+	lua_pushinteger(L, value);
+	return 1;
+}
+
+/**
+ * 寄存器的所有位域
+ * 1#:寄存器对象
+ * 返回:
+ * 1#:数组,元素是{Name = 名字, Offset = 最低位, Width = 位宽}
+ */
+static int luaApi_svd_register_fields(lua_State *L){
+	struct luaApi_svdRegister *luaReg = luaL_checkudata(L, 1, SVD_REGISTER_LUA_OBJECT_TYPE);
+	const struct svdField *field;
+	unsigned int i;
+	lua_createtable(L, luaReg->reg->fieldCount, 0);
+	for(i = 0; i < luaReg->reg->fieldCount; i++){
+		field = SVD_Field(luaReg->device->db, luaReg->reg->firstField + i);
+		lua_createtable(L, 0, 3);
+		lua_pushstring(L, SVD_Name(luaReg->device->db, field->name));
+		lua_setfield(L, -2, "Name");
+		lua_pushinteger(L, field->bitOffset);
+		lua_setfield(L, -2, "Offset");
+		lua_pushinteger(L, field->bitWidth);
+		lua_setfield(L, -2, "Width");
+		lua_rawseti(L, -2, i + 1);
+	}
+	return 1;
+}
+
+/**
+ * 寄存器地址
+ * 1#:寄存器对象
+ */
+static int luaApi_svd_register_address(lua_State *L){
+	struct luaApi_svdRegister *luaReg = luaL_checkudata(L, 1, SVD_REGISTER_LUA_OBJECT_TYPE);
+	lua_pushinteger(L, (lua_Integer)luaReg->addr);
+	return 1;
+}
+
+/**
+ * 寄存器复位值
+ * 1#:寄存器对象
+ */
+static int luaApi_svd_register_reset(lua_State *L){
+	struct luaApi_svdRegister *luaReg = luaL_checkudata(L, 1, SVD_REGISTER_LUA_OBJECT_TYPE);
+	lua_pushinteger(L, luaReg->reg->resetValue);
+	return 1;
+}
+
+static int luaApi_svd_register_tostring(lua_State *L){
+	struct luaApi_svdRegister *luaReg = luaL_checkudata(L, 1, SVD_REGISTER_LUA_OBJECT_TYPE);
+	char addr[24];
+	snprintf(addr, sizeof(addr), "0x%08llX", (unsigned long long)luaReg->addr);
+	lua_pushfstring(L, "%s.%s@%s", SVD_Name(luaReg->device->db, luaReg->peripheral->name),
+			SVD_Name(luaReg->device->db, luaReg->reg->name), addr);
+	return 1;
+}
+
+/**
+ * 新建带有方法表上值的元表
+ * meta中的元方法以方法表为上值
+ */
+static void newProxyMetatable(lua_State *L, const char *tname, const luaL_Reg *meta, const luaL_Reg *oo){
+	luaL_newmetatable(L, tname);	// +1
+	lua_createtable(L, 0, 0);	// +1
+	luaL_setfuncs(L, oo, 0);
+	luaL_setfuncs(L, meta, 1);	// -1
+	lua_pop(L, 1);
+}
+
+// 模块静态函数
+static const luaL_Reg lib_svd_f[] = {
+	{"Load", luaApi_svd_load},
+	{NULL, NULL}
+};
+
+// 数据库对象方法
+static const luaL_Reg lib_svd_oo[] = {
+	{"Bind", luaApi_svd_bind},
+	{"Info", luaApi_svd_info},
+	{"Peripherals", luaApi_svd_peripherals},
+	{"Lookup", luaApi_svd_lookup},
+	{NULL, NULL}
+};
+
+static const luaL_Reg lib_svd_device_meta[] = {
+	{"__index", luaApi_svd_device_index},
+	{"__gc", luaApi_svd_device_gc},
+	{NULL, NULL}
+};
+
+static const luaL_Reg lib_svd_device_oo[] = {
+	{"Begin", luaApi_svd_device_begin},
+	{"Commit", luaApi_svd_device_commit},
+	{"Abort", luaApi_svd_device_abort},
+	{NULL, NULL}
+};
+
+static const luaL_Reg lib_svd_peripheral_meta[] = {
+	{"__index", luaApi_svd_peripheral_index},
+	{NULL, NULL}
+};
+
+static const luaL_Reg lib_svd_peripheral_oo[] = {
+	{"Base", luaApi_svd_peripheral_base},
+	{"Registers", luaApi_svd_peripheral_registers},
+	{NULL, NULL}
+};
+
+static const luaL_Reg lib_svd_register_meta[] = {
+	{"__index", luaApi_svd_register_index},
+	{"__newindex", luaApi_svd_register_newindex},
+	{"__tostring", luaApi_svd_register_tostring},
+	{NULL, NULL}
+};
+
+static const luaL_Reg lib_svd_register_oo[] = {
+	{"Read", luaApi_svd_register_read},
+	{"Write", luaApi_svd_register_write},
+	{"Modify", luaApi_svd_register_modify},
+	{"Fields", luaApi_svd_register_fields},
+	{"Address", luaApi_svd_register_address},
+	{"Reset", luaApi_svd_register_reset},
+	{NULL, NULL}
+};
+
+int luaopen_svd (lua_State *L) {
+	lua_createtable(L, 0, 0);
+	luaL_setfuncs(L, lib_svd_f, 0);
+	return 1;
+}
+
+// 注册接口调用
+void RegisterApi_SVD(lua_State *L){
+	LuaApiNewTypeMetatable(L, SVD_LUA_OBJECT_TYPE, luaApi_svd_gc, lib_svd_oo);
+	lua_pop(L, 1);
+	newProxyMetatable(L, SVD_DEVICE_LUA_OBJECT_TYPE, lib_svd_device_meta, lib_svd_device_oo);
+	newProxyMetatable(L, SVD_PERIPHERAL_LUA_OBJECT_TYPE, lib_svd_peripheral_meta, lib_svd_peripheral_oo);
+	newProxyMetatable(L, SVD_REGISTER_LUA_OBJECT_TYPE, lib_svd_register_meta, lib_svd_register_oo);
+	luaL_requiref(L, "SVD", luaopen_svd, 0);
+	lua_pop(L, 1);
+}
@@ -0,0 +1,187 @@
+/*
+ * STM32F4.c
+ *
+ *  Created on: 2019-6-28
+ *      Author: virusv
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "smart_ocd.h"
+#include "misc/log.h"
+#include "arch/ARM/STM32/include/STM32F4.h"
+
+#include "api/api.h"
+#include "api/arch/ARM/ADI/ADIv5_api.h"
+
+#define STM32F4_FLASH_LUA_OBJECT_TYPE "arch.ARM.STM32F4.Flash"
+
+struct luaApi_stm32f4Flash {
+	int reference;	// AccessPort对象的reference
+	STM32F4Flash flash;
+};
+
+/**
+ * 创建Flash对象
+ * 1#:连接到系统总线的MEM-AP对象
+ * 2#:工作区地址(可选,默认0x20000000)
+ * 3#:工作区字节数(可选,默认16KB)
+ * 返回:
+ * 1#:Flash对象
+ */
+static int luaApi_stm32f4_flash(lua_State *L){
+	struct luaApi_accessPort *luaApObj = LuaApiAdiv5CheckAp(L, 1);
+	uint32_t workArea = (uint32_t)luaL_optinteger(L, 2, STM32F4_DEFAULT_WORK_AREA);
+	uint32_t workSize = (uint32_t)luaL_optinteger(L, 3, STM32F4_DEFAULT_WORK_SIZE);
+	struct luaApi_stm32f4Flash *luaFlash = lua_newuserdata(L, sizeof(struct luaApi_stm32f4Flash));	// +1
+	luaFlash->flash = STM32F4_CreateFlash(luaApObj->ap, workArea, workSize);
+	if(luaFlash->flash == NULL){
+		return luaL_error(L, "Failed to create STM32F4 flash object.");
+	}
+	luaL_setmetatable(L, STM32F4_FLASH_LUA_OBJECT_TYPE);
+	// 增加AccessPort的引用
+	lua_pushvalue(L, 1);
+	luaFlash->reference = luaL_ref(L, LUA_REGISTRYINDEX);
+	return 1;
+}
+
+/**
+ * 获得Flash信息
+ * 1#:Flash对象
+ * 返回:
+ * 1#:Flash的字节数
+ * 2#:扇区数
+ */
+static int luaApi_stm32f4_flash_info(lua_State *L){
+	struct luaApi_stm32f4Flash *luaFlash = luaL_checkudata(L, 1, STM32F4_FLASH_LUA_OBJECT_TYPE);
+	uint32_t size;
+	unsigned int sectorCount;
+	STM32F4_FlashInfo(luaFlash->flash, &size, &sectorCount);
+	lua_pushinteger(L, size);
+	lua_pushinteger(L, sectorCount);
+	return 2;
+}
+
+/**
+ * 擦除扇区
+ * 1#:Flash对象
+ * 2#:第一个扇区
+ * 3#:最后一个扇区(可选,默认和第一个相同)
+ */
+static int luaApi_stm32f4_flash_erase(lua_State *L){
+	struct luaApi_stm32f4Flash *luaFlash = luaL_checkudata(L, 1, STM32F4_FLASH_LUA_OBJECT_TYPE);
+	unsigned int first = (unsigned int)luaL_checkinteger(L, 2);
+	unsigned int last = (unsigned int)luaL_optinteger(L, 3, first);
+	LuaApiAdiv5CheckApRef(L, luaFlash->reference);
+	if(STM32F4_FlashErase(luaFlash->flash, first, last) != ADI_SUCCESS){
+		return luaL_error(L, "Erase flash failed!");
+	}
+	return 0;
+}
+
+/**
+ * 编程Flash
+ * 1#:Flash对象
+ * 2#:起始地址
+ * 3#:数据(字符串或者Buffer)
+ * 4#:编程后是否校验(可选,默认false)
+ * 返回:
+ * 1#:统计表 {Bytes, Erased, Skipped, Seconds}
+ */
+static int luaApi_stm32f4_flash_program(lua_State *L){
+	struct luaApi_stm32f4Flash *luaFlash = luaL_checkudata(L, 1, STM32F4_FLASH_LUA_OBJECT_TYPE);
+	uint32_t addr = (uint32_t)luaL_checkinteger(L, 2);
+	size_t len;
+	const uint8_t *data = LuaApiCheckBytes(L, 3, &len);
+	BOOL verify = lua_toboolean(L, 4);
+	struct stm32f4ProgramStats stats;
+	int result;
+	LuaApiAdiv5CheckApRef(L, luaFlash->reference);
+	result = STM32F4_FlashProgram(luaFlash->flash, addr, (uint32_t)len, data, verify, &stats);
+	if(result == ADI_FAILED){
+		return luaL_error(L, "Flash verify failed!");
+	}else if(result != ADI_SUCCESS){
+		return luaL_error(L, "Program flash failed!");
+	}
+	lua_createtable(L, 0, 4);
+	lua_pushinteger(L, (lua_Integer)stats.bytes);
+	lua_setfield(L, -2, "Bytes");
+	lua_pushinteger(L, stats.erased);
+	lua_setfield(L, -2, "Erased");
+	lua_pushinteger(L, stats.skipped);
+	lua_setfield(L, -2, "Skipped");
+	lua_pushnumber(L, stats.seconds);
+	lua_setfield(L, -2, "Seconds");
+	return 1;
+}
+
+/**
+ * 读写选项字节
+ * 1#:Flash对象
+ * 2#:FLASH_OPTCR的新值(可选),不指定则只读取
+ * 返回:
+ * 1#:FLASH_OPTCR的当前值
+ */
+static int luaApi_stm32f4_flash_option_bytes(lua_State *L){
+	struct luaApi_stm32f4Flash *luaFlash = luaL_checkudata(L, 1, STM32F4_FLASH_LUA_OBJECT_TYPE);
+	uint32_t optcr;
+	LuaApiAdiv5CheckApRef(L, luaFlash->reference);
+	if(!lua_isnoneornil(L, 2)
+			&& STM32F4_WriteOptionBytes(luaFlash->flash, (uint32_t)luaL_checkinteger(L, 2)) != ADI_SUCCESS){
+		return luaL_error(L, "Write option bytes failed!");
+	}
+	if(STM32F4_ReadOptionBytes(luaFlash->flash, &optcr) != ADI_SUCCESS){
+		return luaL_error(L, "Read option bytes failed!");
+	}
+	lua_pushinteger(L, optcr);
+	return 1;
+}
+
+/**
+ * Flash对象垃圾回收函数
+ */
+static int luaApi_stm32f4_flash_gc(lua_State *L){
+	struct luaApi_stm32f4Flash *luaFlash = luaL_checkudata(L, 1, STM32F4_FLASH_LUA_OBJECT_TYPE);
+	log_trace("[GC] STM32F4 Flash");
+	STM32F4_DestroyFlash(&luaFlash->flash);
+	// 取消引用AccessPort对象
+	luaL_unref(L, LUA_REGISTRYINDEX, luaFlash->reference);
+	return 0;
+}
+
+// 模块静态函数
+static const luaL_Reg lib_stm32f4_f[] = {
+	{"Flash", luaApi_stm32f4_flash},
+	{NULL, NULL}
+};
+
+// 模块常量
+static const luaApi_regConst lib_stm32f4_const[] = {
+	{"WorkArea", STM32F4_DEFAULT_WORK_AREA},
+	{"WorkSize", STM32F4_DEFAULT_WORK_SIZE},
+	{NULL, 0}
+};
+
+// 初始化STM32F4库
+int luaopen_stm32f4 (lua_State *L) {
+	lua_createtable(L, 0, sizeof(lib_stm32f4_const)/sizeof(lib_stm32f4_const[0]));
+	LuaApiRegConstant(L, lib_stm32f4_const);
+	luaL_setfuncs(L, lib_stm32f4_f, 0);
+	return 1;
+}
+
+// Flash对象的面向对象方法
+static const luaL_Reg lib_stm32f4_flash_oo[] = {
+	{"Info", luaApi_stm32f4_flash_info},
+	{"Erase", luaApi_stm32f4_flash_erase},
+	{"Program", luaApi_stm32f4_flash_program},
+	{"OptionBytes", luaApi_stm32f4_flash_option_bytes},
+	{NULL, NULL}
+};
+
+// 注册接口调用
+void RegisterApi_STM32F4(lua_State *L){
+	LuaApiNewTypeMetatable(L, STM32F4_FLASH_LUA_OBJECT_TYPE, luaApi_stm32f4_flash_gc, lib_stm32f4_flash_oo);
+	luaL_requiref(L, "STM32F4", luaopen_stm32f4, 0);
+	lua_pop(L, 1);
+}
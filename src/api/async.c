@@ -0,0 +1,325 @@
+/*
+ * async.c
+ *
+ *  Created on: 2019-7-1
+ *      Author: virusv
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "smart_ocd.h"
+#include "misc/log.h"
+#include "misc/async.h"
+
+#include "api/api.h"
+
+/**
+ * AsyncJob对象:提交到设备工作线程的一次操作
+ * 异步接口在协程中调用时提交任务,然后把AsyncJob对象yield出去,任务完成后恢复协程并返回结果;
+ * 不能yield时(主线程、元方法等)直接等待任务完成。
+ * Async.Run是调度器:依次恢复各个协程,协程等待的任务没有完成时跳过,所有协程都在等待时阻塞到有任务完成。
+ * 不使用Async.Run自己恢复协程时,resume返回的AsyncJob对象可以用Done/Wait查询和等待。
+ * 任务持有参数的引用,在任务完成之前不能改变作为参数的Buffer的大小;
+ * 同一个Adapter上有没完成的任务时,对应的同步接口(ReadMemory、BlockRead、Run等)会抛出错误;
+ * Adapter被监视、采样线程占用时同步接口和异步接口都会抛出错误
+ */
+#define ASYNC_JOB_LUA_OBJECT_TYPE "AsyncJob"
+
+struct luaApi_asyncJob {
+	struct asyncJob job;
+	uint64_t context[];	// 任务函数的参数
+};
+
+// 当前Async.Run的任务表在注册表中的键
+static const char tasksKey = 'T';
+
+/**
+ * 新建AsyncJob对象并压栈
+ * 参数:
+ * 	func:在工作线程中执行的任务函数
+ * 	size:任务参数的字节数
+ * 	first,last:栈上first到last的值在任务完成之前不会被回收(任务函数要访问这些值的内存)
+ * 返回:
+ * 	任务参数,初始化为0
+ */
+void *LuaApiNewAsyncJob(lua_State *L, ASYNC_JOB_FUNC func, size_t size, int first, int last){
+	struct luaApi_asyncJob *luaJob;
+	int pos;
+	first = lua_absindex(L, first);
+	last = lua_absindex(L, last);
+	lua_createtable(L, last - first + 1, 0);	// +1
+	for(pos = first; pos <= last; pos++){
+		lua_pushvalue(L, pos);
+		lua_rawseti(L, -2, pos - first + 1);
+	}
+	luaJob = lua_newuserdata(L, sizeof(struct luaApi_asyncJob) + size);	// +1
+	memset(luaJob, 0x0, sizeof(struct luaApi_asyncJob) + size);
+	luaJob->job.func = func;
+	luaJob->job.context = luaJob->context;
+	luaL_setmetatable(L, ASYNC_JOB_LUA_OBJECT_TYPE);
+	lua_insert(L, -2);
+	lua_setuservalue(L, -2);	// -1
+	return luaJob->context;
+}
+
+/**
+ * 提交AsyncJob对象,等待完成后调用k
+ * 可以yield时把AsyncJob对象yield给调度器,协程恢复后调用k;否则直接等待任务完成
+ * k的ctx参数是AsyncJob对象在栈上的索引,用LuaApiAsyncResult取得任务的返回值
+ * 参数:
+ * 	idx:AsyncJob对象在栈上的索引
+ * 	device:执行任务的设备
+ * 	k:任务完成后的延续函数
+ */
+int LuaApiAsyncAwait(lua_State *L, int idx, void *device, lua_KFunction k){
+	struct luaApi_asyncJob *luaJob = luaL_checkudata(L, idx, ASYNC_JOB_LUA_OBJECT_TYPE);
+	idx = lua_absindex(L, idx);
+	if(luaJob->job.submitted){
+		return luaL_error(L, "The job has already been submitted.");
+	}
+	if(Async_Owned(device)){
+		return luaL_error(L, "The adapter is busy with a running watch or profiler, stop it first.");
+	}
+	if(Async_Submit(device, &luaJob->job) == FALSE){
+		return luaL_error(L, "Failed to submit the job.");
+	}
+	if(lua_isyieldable(L)){
+		lua_pushvalue(L, idx);
+		return lua_yieldk(L, 1, (lua_KContext)idx, k);
+	}
+	Async_Wait(&luaJob->job);
+	return k(L, LUA_OK, (lua_KContext)idx);
+}
+
+/**
+ * 同步接口访问设备之前调用,设备上还有没完成的任务或者被监视、采样线程占用时抛出错误
+ * 参数:
+ * 	device:要访问的设备
+ */
+void LuaApiAsyncCheckIdle(lua_State *L, void *device){
+	unsigned int pending;
+	if(Async_Owned(device)){
+		luaL_error(L, "The adapter is busy with a running watch or profiler, stop it first.");
+	}
+	pending = Async_Pending(device);
+	if(pending > 0){
+		luaL_error(L, "The adapter is busy with %d pending async job(s), wait for them before synchronous access.", (int)pending);
+	}
+}
+
+/**
+ * 取得延续函数中AsyncJob对象的返回值
+ * 协程可能被调度器以外的代码提前恢复,这里会等待任务完成
+ * 参数:
+ * 	ctx:延续函数的ctx参数
+ * 	context:任务参数(可以为NULL)
+ */
+int LuaApiAsyncResult(lua_State *L, lua_KContext ctx, void **context){
+	struct luaApi_asyncJob *luaJob = lua_touserdata(L, (int)ctx);
+	if(context){
+		*context = luaJob->context;
+	}
+	return Async_Wait(&luaJob->job);
+}
+
+/**
+ * 任务是否完成
+ * 1#:AsyncJob对象
+ * 返回:
+ * 1#:boolean
+ */
+static int luaApi_async_job_done(lua_State *L){
+	struct luaApi_asyncJob *luaJob = luaL_checkudata(L, 1, ASYNC_JOB_LUA_OBJECT_TYPE);
+	lua_pushboolean(L, !luaJob->job.submitted || Async_Done(&luaJob->job));
+	return 1;
+}
+
+/**
+ * 等待任务完成
+ * 1#:AsyncJob对象
+ */
+static int luaApi_async_job_wait(lua_State *L){
+	struct luaApi_asyncJob *luaJob = luaL_checkudata(L, 1, ASYNC_JOB_LUA_OBJECT_TYPE);
+	if(luaJob->job.submitted){
+		Async_Wait(&luaJob->job);
+	}
+	return 0;
+}
+
+/**
+ * AsyncJob对象的垃圾回收函数
+ * 工作线程还在使用任务参数时等待任务完成
+ */
+static int luaApi_async_job_gc(lua_State *L){
+	struct luaApi_asyncJob *luaJob = luaL_checkudata(L, 1, ASYNC_JOB_LUA_OBJECT_TYPE);
+	if(luaJob->job.submitted){
+		Async_Wait(&luaJob->job);
+	}
+	return 0;
+}
+
+/**
+ * 在当前的Async.Run中新建协程
+ * 1#:协程函数
+ * ...:传给协程函数的参数
+ * 返回:
+ * 1#:协程对象
+ */
+static int luaApi_async_spawn(lua_State *L){
+	lua_State *co;
+	int argc = lua_gettop(L);
+	luaL_checktype(L, 1, LUA_TFUNCTION);
+	if(lua_rawgetp(L, LUA_REGISTRYINDEX, &tasksKey) != LUA_TTABLE){	// +1
+		return luaL_error(L, "Async.Spawn must be called inside Async.Run.");
+	}
+	co = lua_newthread(L);	// +1
+	lua_pushvalue(L, -1);
+	lua_rawseti(L, -3, lua_rawlen(L, -3) + 1);
+	lua_rotate(L, 1, 2);	// 把任务表和协程移到函数前面
+	lua_xmove(L, co, argc);
+	return 1;
+}
+
+/**
+ * 恢复一个协程
+ * 参数:
+ * 	waits:任务表中等待中的AsyncJob的索引
+ * 返回:
+ * 	协程的状态,出错时把带栈回溯的错误信息压入L
+ */
+static int resumeTask(lua_State *L, lua_State *co, int waits, int *nres){
+	int status, narg = 0;
+	// 新的协程栈上是函数和参数
+	if(lua_status(co) == LUA_OK){
+		narg = lua_gettop(co) - 1;
+	}
+	status = lua_resume(co, L, narg);
+	*nres = lua_gettop(co);
+	if(status == LUA_YIELD){
+		// yield出来的AsyncJob对象:任务完成之前不再恢复该协程
+		lua_pushthread(co);
+		lua_xmove(co, L, 1);
+		if(*nres > 0 && luaL_testudata(co, -1, ASYNC_JOB_LUA_OBJECT_TYPE)){
+			lua_pushvalue(co, -1);
+			lua_xmove(co, L, 1);
+		}else{
+			lua_pushnil(L);
+		}
+		lua_rawset(L, waits);
+		lua_pop(co, *nres);
+	}else if(status != LUA_OK){
+		luaL_traceback(L, co, lua_tostring(co, -1), 0);
+	}
+	return status;
+}
+
+/**
+ * 运行协程调度器,直到所有协程结束
+ * 1#:主协程函数
+ * ...:传给主协程函数的参数
+ * 返回:
+ * 主协程函数的返回值
+ * 任何一个协程出错时抛出带栈回溯的错误
+ */
+static int luaApi_async_run(lua_State *L){
+	lua_State *co, *mainCo;
+	int tasks, waits, count, pos, keep, nres, nresults = 0, status;
+	unsigned long generation;
+	BOOL progress;
+	struct luaApi_asyncJob *luaJob;
+	luaL_checktype(L, 1, LUA_TFUNCTION);
+	// 保存外层Async.Run的任务表
+	lua_rawgetp(L, LUA_REGISTRYINDEX, &tasksKey);	// +1
+	lua_insert(L, 1);
+	lua_newtable(L);
+	lua_insert(L, 2);
+	tasks = 2;
+	lua_newtable(L);
+	lua_insert(L, 3);
+	waits = 3;
+	lua_pushvalue(L, tasks);
+	lua_rawsetp(L, LUA_REGISTRYINDEX, &tasksKey);
+	// 主协程
+	lua_pushcfunction(L, luaApi_async_spawn);
+	lua_insert(L, 4);
+	lua_call(L, lua_gettop(L) - 4, 1);
+	mainCo = lua_tothread(L, 4);
+	while(lua_rawlen(L, tasks) > 0){
+		progress = FALSE;
+		generation = Async_Generation();
+		count = (int)lua_rawlen(L, tasks);
+		for(pos = 1, keep = 0; pos <= count; pos++){
+			lua_rawgeti(L, tasks, pos);
+			co = lua_tothread(L, -1);
+			lua_pushvalue(L, -1);
+			lua_rawget(L, waits);
+			luaJob = lua_touserdata(L, -1);
+			lua_pop(L, 1);
+			if(luaJob == NULL || Async_Done(&luaJob->job)){
+				progress = TRUE;
+				status = resumeTask(L, co, waits, &nres);
+				if(status == LUA_OK){
+					if(co == mainCo){
+						luaL_checkstack(L, nres, "too many results");
+						lua_xmove(co, L, nres);
+						lua_rotate(L, -nres - 1, nres);
+						nresults = nres;
+					}
+					lua_pushnil(L);
+					lua_rawset(L, waits);
+					continue;
+				}else if(status != LUA_YIELD){
+					lua_pushvalue(L, 1);
+					lua_rawsetp(L, LUA_REGISTRYINDEX, &tasksKey);
+					return lua_error(L);
+				}
+			}
+			lua_rawseti(L, tasks, ++keep);
+		}
+		// 本轮新建的协程
+		count = (int)lua_rawlen(L, tasks);
+		for(; pos <= count; pos++){
+			lua_rawgeti(L, tasks, pos);
+			lua_rawseti(L, tasks, ++keep);
+		}
+		for(pos = keep + 1; pos <= count; pos++){
+			lua_pushnil(L);
+			lua_rawseti(L, tasks, pos);
+		}
+		// 所有协程都在等待任务完成
+		if(!progress){
+			Async_WaitAny(generation);
+		}
+	}
+	lua_pushvalue(L, 1);
+	lua_rawsetp(L, LUA_REGISTRYINDEX, &tasksKey);
+	return nresults;
+}
+
+// 模块静态函数
+static const luaL_Reg lib_async_f[] = {
+	{"Run", luaApi_async_run},
+	{"Spawn", luaApi_async_spawn},
+	{NULL, NULL}
+};
+
+// AsyncJob对象方法
+static const luaL_Reg lib_async_job_oo[] = {
+	{"Done", luaApi_async_job_done},
+	{"Wait", luaApi_async_job_wait},
+	{NULL, NULL}
+};
+
+int luaopen_async (lua_State *L) {
+	lua_createtable(L, 0, 0);
+	luaL_setfuncs(L, lib_async_f, 0);
+	return 1;
+}
+
+// 注册接口调用
+void RegisterApi_Async(lua_State *L){
+	LuaApiNewTypeMetatable(L, ASYNC_JOB_LUA_OBJECT_TYPE, luaApi_async_job_gc, lib_async_job_oo);
+	lua_pop(L, 1);
+	luaL_requiref(L, "Async", luaopen_async, 0);
+	lua_pop(L, 1);
+}
@@ -0,0 +1,360 @@
+/*
+ * buffer.c
+ *
+ *  Created on: 2019-6-29
+ *      Author: virusv
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "smart_ocd.h"
+#include "misc/log.h"
+
+#include "api/api.h"
+
+/**
+ * Buffer对象:可以改变大小的字节缓冲区
+ * 块读写、JTAG交换和DAP多次读写直接在Buffer的内存中进行,不需要和Lua字符串来回复制
+ * Slice是根Buffer一段数据的视图,持有根Buffer的引用,每次访问时按根Buffer当前的大小检查边界
+ * 所有偏移从0开始,多字节数据按小端序访问,和string.pack("<I4")一致
+ */
+struct luaApi_buffer {
+	uint8_t *data;	// 根Buffer的数据,slice不使用
+	size_t size;	// 字节数
+	size_t capacity;	// 根Buffer已分配的字节数
+	struct luaApi_buffer *root;	// 根Buffer,根Buffer指向自己
+	size_t offset;	// 在根Buffer中的偏移
+	int reference;	// slice持有的根Buffer的reference,根Buffer为LUA_NOREF
+};
+
+/**
+ * 改变根Buffer的大小,新增的部分填0
+ */
+static BOOL resizeBuffer(struct luaApi_buffer *buffer, size_t size){
+	uint8_t *data;
+	size_t capacity;
+	if(size > buffer->capacity){
+		capacity = buffer->capacity ? buffer->capacity : 64;
+		while(capacity < size) capacity <<= 1;
+		data = realloc(buffer->data, capacity);
+		if(data == NULL){
+			log_error("Failed to allocate buffer!");
+			return FALSE;
+		}
+		buffer->data = data;
+		buffer->capacity = capacity;
+	}
+	if(size > buffer->size){
+		memset(buffer->data + buffer->size, 0x0, size - buffer->size);
+	}
+	buffer->size = size;
+	return TRUE;
+}
+
+/**
+ * 取得Buffer的数据,slice超出根Buffer当前大小时报错
+ */
+static uint8_t *bufferData(lua_State *L, struct luaApi_buffer *buffer){
+	if(buffer->root == buffer){
+		return buffer->data;
+	}
+	if(buffer->offset + buffer->size > buffer->root->size){
+		luaL_error(L, "Buffer slice is out of range of its parent.");
+	}
+	return buffer->root->data + buffer->offset;
+}
+
+/**
+ * LuaApiNewBuffer 创建Buffer对象并压栈
+ * 返回:
+ * 	Buffer的数据
+ */
+uint8_t *LuaApiNewBuffer(lua_State *L, size_t size){
+	struct luaApi_buffer *buffer = lua_newuserdata(L, sizeof(struct luaApi_buffer));	// +1
+	memset(buffer, 0x0, sizeof(struct luaApi_buffer));
+	buffer->root = buffer;
+	buffer->reference = LUA_NOREF;
+	luaL_setmetatable(L, BUFFER_LUA_OBJECT_TYPE);
+	if(resizeBuffer(buffer, size) == FALSE){
+		luaL_error(L, "Failed to allocate buffer.");
+	}
+	return buffer->data;
+}
+
+/**
+ * LuaApiToBuffer 如果栈中idx位置是Buffer对象,返回它的数据和大小,否则返回NULL
+ */
+uint8_t *LuaApiToBuffer(lua_State *L, int idx, size_t *size){
+	struct luaApi_buffer *buffer = luaL_testudata(L, idx, BUFFER_LUA_OBJECT_TYPE);
+	if(buffer == NULL) return NULL;
+	*size = buffer->size;
+	return bufferData(L, buffer);
+}
+
+/**
+ * LuaApiCheckBytes 取得Buffer对象或者字符串的数据,其他类型报错
+ * 字符串的数据是只读的
+ */
+const uint8_t *LuaApiCheckBytes(lua_State *L, int idx, size_t *size){
+	uint8_t *data = LuaApiToBuffer(L, idx, size);
+	if(data != NULL) return data;
+	return CAST(const uint8_t *, luaL_checklstring(L, idx, size));
+}
+
+/**
+ * LuaApiOptBuffer 取得可选的输出Buffer
+ * 栈中idx位置是Buffer时调整到size字节并返回它的数据,没有参数时新建一个Buffer;
+ * 两种情况下Buffer对象都留在栈顶
+ */
+uint8_t *LuaApiOptBuffer(lua_State *L, int idx, size_t size){
+	struct luaApi_buffer *buffer;
+	if(lua_isnoneornil(L, idx)){
+		return LuaApiNewBuffer(L, size);
+	}
+	buffer = luaL_checkudata(L, idx, BUFFER_LUA_OBJECT_TYPE);
+	if(buffer->size != size){
+		if(buffer->root != buffer){
+			luaL_error(L, "Buffer slice size is %I, %I bytes required.", (lua_Integer)buffer->size, (lua_Integer)size);
+		}
+		if(resizeBuffer(buffer, size) == FALSE){
+			luaL_error(L, "Failed to allocate buffer.");
+		}
+	}
+	lua_pushvalue(L, idx);
+	return bufferData(L, buffer);
+}
+
+/**
+ * 检查偏移和长度,返回数据的地址
+ */
+static uint8_t *checkRange(lua_State *L, struct luaApi_buffer *buffer, int arg, lua_Integer offset, size_t len){
+	luaL_argcheck(L, offset >= 0 && (size_t)offset <= buffer->size && len <= buffer->size - (size_t)offset, arg, "out of range");
+	return bufferData(L, buffer) + offset;
+}
+
+/**
+ * 创建Buffer
+ * 1#:字节数,或者用来初始化的字符串
+ * 2#:填充的字节(可选,默认0)
+ * 返回:
+ * 1#:Buffer对象
+ */
+static int luaApi_buffer_new(lua_State *L){
+	size_t size;
+	uint8_t *data;
+	if(lua_type(L, 1) == LUA_TSTRING){
+		const char *str = lua_tolstring(L, 1, &size);
+		data = LuaApiNewBuffer(L, size);
+		memcpy(data, str, size);
+		return 1;
+	}
+	lua_Integer len = luaL_checkinteger(L, 1);
+	luaL_argcheck(L, len >= 0, 1, "negative size");
+	size = (size_t)len;
+	data = LuaApiNewBuffer(L, size);
+	memset(data, (int)luaL_optinteger(L, 2, 0), size);
+	return 1;
+}
+
+/**
+ * 获得或者改变Buffer的大小
+ * 1#:Buffer对象
+ * 2#:新的字节数(可选),slice不能改变大小
+ * 返回:
+ * 1#:字节数
+ */
+static int luaApi_buffer_size(lua_State *L){
+	struct luaApi_buffer *buffer = luaL_checkudata(L, 1, BUFFER_LUA_OBJECT_TYPE);
+	if(!lua_isnoneornil(L, 2)){
+		lua_Integer size = luaL_checkinteger(L, 2);
+		luaL_argcheck(L, size >= 0, 2, "negative size");
+		if(buffer->root != buffer){
+			return luaL_error(L, "Can not resize a buffer slice.");
+		}
+		if(resizeBuffer(buffer, (size_t)size) == FALSE){
+			return luaL_error(L, "Failed to allocate buffer.");
+		}
+	}
+	lua_pushinteger(L, (lua_Integer)buffer->size);
+	return 1;
+}
+
+/**
+ * 取得Buffer的一段视图,不复制数据
+ * 1#:Buffer对象
+ * 2#:偏移
+ * 3#:字节数(可选,默认到结尾)
+ * 返回:
+ * 1#:Slice对象
+ */
+static int luaApi_buffer_slice(lua_State *L){
+	struct luaApi_buffer *buffer = luaL_checkudata(L, 1, BUFFER_LUA_OBJECT_TYPE);
+	lua_Integer offset = luaL_checkinteger(L, 2);
+	luaL_argcheck(L, offset >= 0 && (size_t)offset <= buffer->size, 2, "out of range");
+	lua_Integer len = luaL_optinteger(L, 3, (lua_Integer)(buffer->size - (size_t)offset));
+	luaL_argcheck(L, len >= 0 && (size_t)len <= buffer->size - (size_t)offset, 3, "out of range");
+	struct luaApi_buffer *slice = lua_newuserdata(L, sizeof(struct luaApi_buffer));	// +1
+	memset(slice, 0x0, sizeof(struct luaApi_buffer));
+	slice->root = buffer->root;
+	slice->offset = buffer->offset + (size_t)offset;
+	slice->size = (size_t)len;
+	luaL_setmetatable(L, BUFFER_LUA_OBJECT_TYPE);
+	// 引用根Buffer,防止被回收
+	if(buffer->root == buffer){
+		lua_pushvalue(L, 1);
+	}else{
+		lua_rawgeti(L, LUA_REGISTRYINDEX, buffer->reference);
+	}
+	slice->reference = luaL_ref(L, LUA_REGISTRYINDEX);
+	return 1;
+}
+
+/**
+ * 读写小端序的整数
+ * 1#:Buffer对象
+ * 2#:偏移
+ * 3#:要写入的值(可选)
+ * 返回:
+ * 1#:没有写入时返回读取的值
+ */
+static int accessInteger(lua_State *L, size_t width){
+	struct luaApi_buffer *buffer = luaL_checkudata(L, 1, BUFFER_LUA_OBJECT_TYPE);
+	uint8_t *data = checkRange(L, buffer, 2, luaL_checkinteger(L, 2), width);
+	uint64_t value = 0;
+	size_t idx;
+	if(!lua_isnoneornil(L, 3)){
+		value = (uint64_t)luaL_checkinteger(L, 3);
+		for(idx = 0; idx < width; idx++){
+			data[idx] = (uint8_t)(value >> (idx << 3));
+		}
+		return 0;
+	}
+	for(idx = 0; idx < width; idx++){
+		value |= (uint64_t)data[idx] << (idx << 3);
+	}
+	lua_pushinteger(L, (lua_Integer)value);
+	return 1;
+}
+
+static int luaApi_buffer_u8(lua_State *L){
+	return accessInteger(L, 1);
+}
+
+static int luaApi_buffer_u16(lua_State *L){
+	return accessInteger(L, 2);
+}
+
+static int luaApi_buffer_u32(lua_State *L){
+	return accessInteger(L, 4);
+}
+
+static int luaApi_buffer_u64(lua_State *L){
+	return accessInteger(L, 8);
+}
+
+/**
+ * 转换成字符串,可以用string.unpack解析
+ * 1#:Buffer对象
+ * 2#:偏移(可选,默认0)
+ * 3#:字节数(可选,默认到结尾)
+ * 返回:
+ * 1#:字符串
+ */
+static int luaApi_buffer_to_string(lua_State *L){
+	struct luaApi_buffer *buffer = luaL_checkudata(L, 1, BUFFER_LUA_OBJECT_TYPE);
+	lua_Integer offset = luaL_optinteger(L, 2, 0);
+	lua_Integer len;
+	luaL_argcheck(L, offset >= 0 && (size_t)offset <= buffer->size, 2, "out of range");
+	len = luaL_optinteger(L, 3, (lua_Integer)(buffer->size - (size_t)offset));
+	luaL_argcheck(L, len >= 0, 3, "negative length");
+	const uint8_t *data = checkRange(L, buffer, 3, offset, (size_t)len);
+	lua_pushlstring(L, CAST(const char *, data), (size_t)len);
+	return 1;
+}
+
+/**
+ * 把字符串或者另一个Buffer的数据复制到Buffer中
+ * 1#:Buffer对象
+ * 2#:字符串或者Buffer,可以是string.pack的结果
+ * 3#:偏移(可选,默认0)
+ */
+static int luaApi_buffer_write(lua_State *L){
+	struct luaApi_buffer *buffer = luaL_checkudata(L, 1, BUFFER_LUA_OBJECT_TYPE);
+	size_t len;
+	const uint8_t *src = LuaApiCheckBytes(L, 2, &len);
+	uint8_t *data = checkRange(L, buffer, 3, luaL_optinteger(L, 3, 0), len);
+	memmove(data, src, len);
+	return 0;
+}
+
+/**
+ * 用一个字节填充Buffer
+ * 1#:Buffer对象
+ * 2#:字节
+ */
+static int luaApi_buffer_fill(lua_State *L){
+	struct luaApi_buffer *buffer = luaL_checkudata(L, 1, BUFFER_LUA_OBJECT_TYPE);
+	int value = (int)luaL_checkinteger(L, 2);
+	memset(bufferData(L, buffer), value, buffer->size);
+	return 0;
+}
+
+/**
+ * #运算符
+ */
+static int luaApi_buffer_len(lua_State *L){
+	struct luaApi_buffer *buffer = luaL_checkudata(L, 1, BUFFER_LUA_OBJECT_TYPE);
+	lua_pushinteger(L, (lua_Integer)buffer->size);
+	return 1;
+}
+
+/**
+ * Buffer垃圾回收函数
+ */
+static int luaApi_buffer_gc(lua_State *L){
+	struct luaApi_buffer *buffer = luaL_checkudata(L, 1, BUFFER_LUA_OBJECT_TYPE);
+	if(buffer->root == buffer){
+		free(buffer->data);
+		buffer->data = NULL;
+	}else{
+		luaL_unref(L, LUA_REGISTRYINDEX, buffer->reference);
+	}
+	return 0;
+}
+
+// 模块静态函数
+static const luaL_Reg lib_buffer_f[] = {
+	{"New", luaApi_buffer_new},
+	{NULL, NULL}
+};
+
+// 初始化Buffer库
+int luaopen_buffer (lua_State *L) {
+	lua_createtable(L, 0, 1);
+	luaL_setfuncs(L, lib_buffer_f, 0);
+	return 1;
+}
+
+// Buffer对象的面向对象方法
+static const luaL_Reg lib_buffer_oo[] = {
+	{"Size", luaApi_buffer_size},
+	{"Slice", luaApi_buffer_slice},
+	{"U8", luaApi_buffer_u8},
+	{"U16", luaApi_buffer_u16},
+	{"U32", luaApi_buffer_u32},
+	{"U64", luaApi_buffer_u64},
+	{"ToString", luaApi_buffer_to_string},
+	{"Write", luaApi_buffer_write},
+	{"Fill", luaApi_buffer_fill},
+	{NULL, NULL}
+};
+
+// 注册接口调用
+void RegisterApi_Buffer(lua_State *L){
+	LuaApiNewTypeMetatable(L, BUFFER_LUA_OBJECT_TYPE, luaApi_buffer_gc, lib_buffer_oo);
+	lua_pushcfunction(L, luaApi_buffer_len);
+	lua_setfield(L, -2, "__len");
+	lua_pop(L, 1);
+	luaL_requiref(L, "Buffer", luaopen_buffer, 0);
+	lua_pop(L, 1);
+}
@@ -0,0 +1,242 @@
+/*
+ * loader.c
+ *
+ *  Created on: 2019-7-2
+ *      Author: virusv
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <inttypes.h>
+#include <sys/stat.h>
+#include "smart_ocd.h"
+#include "misc/log.h"
+#include "misc/misc.h"
+
+#include "api/api.h"
+
+/**
+ * 脚本字节码缓存
+ * 编译后的字节码按脚本路径保存在磁盘缓存目录中,文件头记录源文件的修改时间、长度和内容散列,
+ * 三者一致时直接加载字节码,跳过词法和语法分析。
+ * -f参数、dofile和require(package.searchers中的Lua文件搜索器)都经过这里
+ */
+#define BYTECODE_MAGIC 0x434c4f53	// "SOLC"
+
+struct bytecodeHeader {
+	uint32_t magic;
+	uint32_t version;	// LUA_VERSION_NUM
+	int64_t mtime;	// 源文件修改时间
+	uint64_t size;	// 源文件长度
+	uint64_t hash;	// 源文件内容散列
+};
+
+// lua_dump输出缓冲区
+struct dumpBuffer {
+	uint8_t *data;
+	size_t length;
+	size_t capacity;
+};
+
+static int dumpWriter(lua_State *L, const void *p, size_t size, void *ud){
+	struct dumpBuffer *buff = ud;
+	uint8_t *data;
+	size_t capacity;
+	(void)L;
+	if(buff->length + size > buff->capacity){
+		capacity = buff->capacity ? buff->capacity : 4096;
+		while(capacity < buff->length + size) capacity <<= 1;
+		data = realloc(buff->data, capacity);
+		if(data == NULL) return 1;
+		buff->data = data;
+		buff->capacity = capacity;
+	}
+	memcpy(buff->data + buff->length, p, size);
+	buff->length += size;
+	return 0;
+}
+
+/**
+ * 读取整个源文件
+ */
+static char *readSource(const char *path, size_t *length, struct stat *st){
+	FILE *fp;
+	char *data;
+	fp = fopen(path, "rb");
+	if(fp == NULL) return NULL;
+	if(fstat(fileno(fp), st) != 0){
+		fclose(fp);
+		return NULL;
+	}
+	data = malloc(st->st_size + 1);
+	if(data == NULL){
+		fclose(fp);
+		return NULL;
+	}
+	if(fread(data, 1, st->st_size, fp) != (size_t)st->st_size){
+		free(data);
+		fclose(fp);
+		return NULL;
+	}
+	fclose(fp);
+	*length = st->st_size;
+	return data;
+}
+
+/**
+ * 缓存文件名,由脚本的绝对路径和加载时使用的路径决定
+ * 加载时的路径是字节码中记录的chunkname,出错信息和栈回溯中会用到
+ */
+static void cacheName(const char *path, char *name, size_t size){
+	char real[PATH_MAX];
+	uint64_t hash = 0;
+	if(realpath(path, real) != NULL){
+		hash = misc_Hash64(real, strlen(real), 0);
+	}
+	hash = misc_Hash64(path, strlen(path), hash);
+	snprintf(name, size, "lua-%016" PRIx64 ".luac", hash);
+}
+
+/**
+ * 按文件加载Lua代码块,和luaL_loadfile一样把代码块或者错误信息压栈
+ * 使用缓存的字节码,缓存不存在或者过期时编译源文件并更新缓存
+ * 参数:
+ * 	path:脚本路径,NULL表示标准输入
+ * 返回:
+ * 	同luaL_loadfile
+ */
+int LuaApiLoadFile(lua_State *L, const char *path){
+	struct bytecodeHeader header, *cached;
+	struct dumpBuffer dump = {NULL, 0, 0};
+	struct stat st;
+	char name[64];
+	const char *code;
+	char *source;
+	void *data;
+	size_t length, cachedLength;
+	int status;
+	if(path == NULL){
+		return luaL_loadfile(L, NULL);
+	}
+	source = readSource(path, &length, &st);
+	if(source == NULL){
+		// 由luaL_loadfile生成错误信息
+		return luaL_loadfile(L, path);
+	}
+	// 已经是字节码
+	if(length > 0 && source[0] == LUA_SIGNATURE[0]){
+		free(source);
+		return luaL_loadfile(L, path);
+	}
+	memset(&header, 0x0, sizeof(struct bytecodeHeader));
+	header.magic = BYTECODE_MAGIC;
+	header.version = LUA_VERSION_NUM;
+	header.mtime = (int64_t)st.st_mtime;
+	header.size = length;
+	header.hash = misc_Hash64(source, length, 0);
+	lua_pushfstring(L, "@%s", path);	// +1 chunkname
+	cacheName(path, name, sizeof(name));
+	if(misc_CacheLoad(name, &data, &cachedLength) == TRUE){
+		cached = data;
+		if(cachedLength > sizeof(struct bytecodeHeader) && memcmp(cached, &header, sizeof(struct bytecodeHeader)) == 0){
+			status = luaL_loadbufferx(L, CAST(const char *, cached + 1), cachedLength - sizeof(struct bytecodeHeader), lua_tostring(L, -1), "b");
+			free(data);
+			if(status == LUA_OK){
+				free(source);
+				lua_remove(L, -2);
+				log_debug("Loaded %s from bytecode cache.", path);
+				return LUA_OK;
+			}
+			lua_pop(L, 1);	// 缓存损坏或者版本不匹配,重新编译
+		}else{
+			free(data);
+		}
+	}
+	// 和luaL_loadfile一样跳过UTF-8 BOM和第一行的注释,保留换行使行号不变
+	code = source;
+	if(length >= 3 && memcmp(code, "\xEF\xBB\xBF", 3) == 0){
+		code += 3;
+	}
+	if(code < source + length && *code == '#'){
+		while(code < source + length && *code != '\n') code++;
+	}
+	status = luaL_loadbufferx(L, code, length - (code - source), lua_tostring(L, -1), "t");
+	free(source);
+	lua_remove(L, -2);
+	if(status != LUA_OK){
+		return status;
+	}
+	// 更新缓存
+	if(dumpWriter(L, &header, sizeof(struct bytecodeHeader), &dump) == 0 && lua_dump(L, dumpWriter, &dump, 0) == 0){
+		if(misc_CacheStore(name, dump.data, dump.length) == FALSE){
+			log_debug("Failed to store bytecode cache of %s.", path);
+		}
+	}
+	free(dump.data);
+	return LUA_OK;
+}
+
+static int luaApi_dofile_k(lua_State *L, int status, lua_KContext ctx){
+	(void)status;
+	(void)ctx;
+	return lua_gettop(L) - 1;
+}
+
+/**
+ * 替换标准库的dofile,使用字节码缓存
+ * 1#:脚本路径(可选,默认标准输入)
+ * 返回:
+ * 脚本的返回值
+ */
+static int luaApi_dofile(lua_State *L){
+	const char *path = luaL_optstring(L, 1, NULL);
+	lua_settop(L, 1);
+	if(LuaApiLoadFile(L, path) != LUA_OK){
+		return lua_error(L);
+	}
+	lua_callk(L, 0, LUA_MULTRET, 0, luaApi_dofile_k);
+	return luaApi_dofile_k(L, LUA_OK, 0);
+}
+
+/**
+ * require的Lua文件搜索器,替换package.searchers[2]
+ * 上值1#:package表
+ * 1#:模块名
+ * 返回:
+ * 1#:加载函数,找不到文件时返回说明字符串
+ * 2#:文件路径
+ */
+static int luaApi_searcher_lua(lua_State *L){
+	const char *name = luaL_checkstring(L, 1);
+	const char *path;
+	lua_getfield(L, lua_upvalueindex(1), "searchpath");	// +1
+	lua_pushvalue(L, 1);
+	if(lua_getfield(L, lua_upvalueindex(1), "path") != LUA_TSTRING){
+		return luaL_error(L, "'package.path' must be a string");
+	}
+	lua_call(L, 2, 2);	// +2
+	if(lua_isnil(L, -2)){
+		return 1;	// 文件都不存在的说明
+	}
+	lua_pop(L, 1);
+	path = lua_tostring(L, -1);
+	if(LuaApiLoadFile(L, path) != LUA_OK){
+		return luaL_error(L, "error loading module '%s' from file '%s':\n\t%s", name, path, lua_tostring(L, -1));
+	}
+	lua_insert(L, -2);	// 加载函数,文件路径
+	return 2;
+}
+
+// 注册接口调用
+void RegisterApi_Loader(lua_State *L){
+	int top = lua_gettop(L);
+	lua_pushcfunction(L, luaApi_dofile);
+	lua_setglobal(L, "dofile");
+	if(lua_getglobal(L, "package") == LUA_TTABLE && lua_getfield(L, -1, "searchers") == LUA_TTABLE){
+		lua_pushvalue(L, -2);
+		lua_pushcclosure(L, luaApi_searcher_lua, 1);
+		lua_rawseti(L, -2, 2);
+	}
+	lua_settop(L, top);
+}
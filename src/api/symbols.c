@@ -0,0 +1,476 @@
+/*
+ * symbols.c
+ *
+ *  Created on: 2019-7-5
+ *      Author: virusv
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "smart_ocd.h"
+#include "misc/log.h"
+#include "misc/symbols.h"
+
+#include "api/api.h"
+#include "api/arch/ARM/ADI/ADIv5_api.h"
+
+/**
+ * 按变量名访问目标内存
+ * sym = Symbols.Load("firmware.elf")
+ * addr, size, typeName = sym("g_stats.rx_count")
+ * stats = sym:Read(ap, "g_stats")	-- 结构体和数组一次块传输读出,解码成表
+ * sym:Write(ap, "g_stats.flags.enabled", 1)	-- 位域读-改-写
+ * 路径第一次解析后缓存在符号对象中
+ */
+#define SYMBOLS_LUA_OBJECT_TYPE "Symbols"
+
+// 一次ReadMany/WriteMany最多的访问数
+#define SYMBOLS_MAX_SPLIT 32
+// 解码嵌套的最大深度
+#define SYMBOLS_MAX_DEPTH 16
+
+struct luaApi_symbols {
+	Symbols syms;
+};
+
+/**
+ * 把[addr, addr+size)拆成按宽度对齐的8/16/32位访问
+ * 返回:
+ * 	访问个数
+ */
+static unsigned int splitAccess(uint64_t addr, uint64_t size, struct memoryAccess *access){
+	unsigned int count = 0;
+	uint64_t end = addr + size;
+	while(addr < end){
+		if((addr & 0x3) == 0 && end - addr >= 4){
+			access[count].size = DataSize_32;
+			access[count].addr = addr;
+			addr += 4;
+		}else if((addr & 0x1) == 0 && end - addr >= 2){
+			access[count].size = DataSize_16;
+			access[count].addr = addr;
+			addr += 2;
+		}else{
+			access[count].size = DataSize_8;
+			access[count].addr = addr;
+			addr += 1;
+		}
+		access[count].data = 0;
+		count++;
+	}
+	return count;
+}
+
+static AccessPort checkMemoryAp(lua_State *L, int idx){
+	struct luaApi_accessPort *luaApObj = LuaApiAdiv5CheckAp(L, idx);
+	if(luaApObj->ap->type != AccessPort_Memory){
+		luaL_error(L, "Not a memory access port.");
+	}
+	return luaApObj->ap;
+}
+
+static void checkResolve(lua_State *L, Symbols syms, const char *path, struct symbolLocation *location){
+	if(symbols_Resolve(syms, path, location) == FALSE){
+		luaL_error(L, "Cannot resolve symbol %s.", path);
+	}
+}
+
+/**
+ * 读取目标内存,返回的指针指向栈顶的userdata中
+ * 小对象拆成对齐的访问一次ReadMany读出,大对象按字对齐后一次BlockRead读出
+ */
+static const uint8_t *readMemory(lua_State *L, AccessPort ap, uint64_t addr, uint64_t size){
+	struct memoryAccess access[SYMBOLS_MAX_SPLIT];
+	uint64_t start = addr & ~3ull, end = (addr + size + 3) & ~3ull;
+	unsigned int count, i, j, width;
+	uint8_t *buff;
+	if(size <= 8){
+		buff = lua_newuserdata(L, (size_t)size);	// +1
+		count = splitAccess(addr, size, access);
+		if(ap->Interface.Memory.ReadMany(ap, access, count) != ADI_SUCCESS){
+			luaL_error(L, "Read memory at 0x%I failed!", (lua_Integer)addr);
+		}
+		for(i = 0; i < count; i++){
+			width = 1u << access[i].size;
+			for(j = 0; j < width; j++){
+				buff[access[i].addr - addr + j] = (uint8_t)(access[i].data >> (j << 3));
+			}
+		}
+		return buff;
+	}
+	if(end - start > 0xFFFFFFFFull){
+		luaL_error(L, "Object is too large to read.");
+	}
+	// lua_newuserdata返回的内存按字对齐
+	buff = lua_newuserdata(L, (size_t)(end - start));	// +1
+	if(ap->Interface.Memory.BlockRead(ap, start, AddrInc_Single, DataSize_32, (unsigned int)((end - start) >> 2), buff) != ADI_SUCCESS){
+		luaL_error(L, "Read memory at 0x%I failed!", (lua_Integer)start);
+	}
+	return buff + (addr - start);
+}
+
+/**
+ * 写目标内存,拆成对齐的访问一次WriteMany写入
+ */
+static void writeMemory(lua_State *L, AccessPort ap, uint64_t addr, const uint8_t *data, uint64_t size){
+	struct memoryAccess access[SYMBOLS_MAX_SPLIT];
+	unsigned int count, i, j, width;
+	uint64_t chunk;
+	while(size > 0){
+		// 每批最多SYMBOLS_MAX_SPLIT个访问
+		chunk = size > 4 * (SYMBOLS_MAX_SPLIT - 4) ? 4 * (SYMBOLS_MAX_SPLIT - 4) : size;
+		count = splitAccess(addr, chunk, access);
+		for(i = 0; i < count; i++){
+			width = 1u << access[i].size;
+			for(j = 0; j < width; j++){
+				access[i].data |= (uint64_t)data[access[i].addr - addr + j] << (j << 3);
+			}
+		}
+		if(ap->Interface.Memory.WriteMany(ap, access, count) != ADI_SUCCESS){
+			luaL_error(L, "Write memory at 0x%I failed!", (lua_Integer)addr);
+		}
+		addr += chunk;
+		data += chunk;
+		size -= chunk;
+	}
+}
+
+static uint64_t loadBits(const uint8_t *data, unsigned int bitOffset, unsigned int bitSize){
+	uint64_t value = 0;
+	unsigned int i, bit;
+	for(i = 0; i < bitSize; i++){
+		bit = bitOffset + i;
+		value |= (uint64_t)((data[bit >> 3] >> (bit & 0x7)) & 0x1) << i;
+	}
+	return value;
+}
+
+static void storeBits(uint8_t *data, unsigned int bitOffset, unsigned int bitSize, uint64_t value){
+	unsigned int i, bit;
+	for(i = 0; i < bitSize; i++){
+		bit = bitOffset + i;
+		data[bit >> 3] = (data[bit >> 3] & ~(1u << (bit & 0x7))) | (((value >> i) & 0x1) << (bit & 0x7));
+	}
+}
+
+/**
+ * 把整数按类型的编码压栈
+ */
+static void pushScalar(lua_State *L, const struct symbolType *type, uint64_t value, unsigned int bits){
+	if(type->kind == SymbolType_Base && type->encoding == SymbolEncoding_Float){
+		if(bits == 32){
+			float f;
+			uint32_t raw = (uint32_t)value;
+			memcpy(&f, &raw, sizeof(f));
+			lua_pushnumber(L, f);
+		}else{
+			double d;
+			memcpy(&d, &value, sizeof(d));
+			lua_pushnumber(L, d);
+		}
+		return;
+	}
+	if(type->kind == SymbolType_Base && type->encoding == SymbolEncoding_Bool){
+		lua_pushboolean(L, value != 0);
+		return;
+	}
+	if(type->encoding == SymbolEncoding_Signed && bits < 64 && (value >> (bits - 1)) & 0x1){
+		value |= ~0ull << bits;
+	}
+	lua_pushinteger(L, (lua_Integer)value);
+}
+
+static void pushValue(lua_State *L, Symbols syms, const struct symbolType *type, const uint8_t *data, unsigned int depth);
+
+/**
+ * 结构体成员放入栈顶的表,匿名结构体和联合的成员直接放入
+ */
+static void pushMembers(lua_State *L, Symbols syms, const struct symbolType *type, const uint8_t *data, unsigned int depth){
+	const struct symbolMember *member;
+	const struct symbolType *memberType;
+	unsigned int i;
+	for(i = 0; i < type->memberCount; i++){
+		member = &type->members[i];
+		memberType = symbols_MemberType(syms, member);
+		if(memberType == NULL) continue;
+		// 成员必须在结构体范围内,data之外的内存没有读出
+		if(member->offset + (member->bitSize ? (member->bitOffset + member->bitSize + 7u) / 8 : memberType->size) > type->size) continue;
+		if(member->name == NULL){
+			if(memberType->kind == SymbolType_Struct || memberType->kind == SymbolType_Union){
+				pushMembers(L, syms, memberType, data + member->offset, depth + 1);
+			}
+			continue;
+		}
+		if(member->bitSize){
+			pushScalar(L, memberType, loadBits(data + member->offset, member->bitOffset, member->bitSize), member->bitSize);
+		}else{
+			pushValue(L, syms, memberType, data + member->offset, depth + 1);
+		}
+		lua_setfield(L, -2, member->name);
+	}
+}
+
+/**
+ * 把目标内存中的数据按类型解码后压栈
+ * 结构体和联合解码为表,char数组解码为字符串,其他数组解码为从1开始的表
+ */
+static void pushValue(lua_State *L, Symbols syms, const struct symbolType *type, const uint8_t *data, unsigned int depth){
+	const struct symbolType *element;
+	uint64_t value = 0, i;
+	luaL_checkstack(L, 4, "Type is too deeply nested.");
+	if(depth > SYMBOLS_MAX_DEPTH){
+		lua_pushnil(L);
+		return;
+	}
+	switch(type->kind){
+	case SymbolType_Base: case SymbolType_Enum: case SymbolType_Pointer:
+		if(type->size == 0 || type->size > 8){
+			lua_pushlstring(L, CAST(const char *, data), (size_t)type->size);
+			return;
+		}
+		for(i = 0; i < type->size; i++){
+			value |= (uint64_t)data[i] << (i << 3);
+		}
+		pushScalar(L, type, value, (unsigned int)type->size * 8);
+		return;
+	case SymbolType_Struct: case SymbolType_Union:
+		lua_createtable(L, 0, type->memberCount);
+		pushMembers(L, syms, type, data, depth);
+		return;
+	case SymbolType_Array:
+		element = symbols_Target(syms, type);
+		if(element == NULL || element->size == 0){
+			lua_createtable(L, 0, 0);
+			return;
+		}
+		if(element->kind == SymbolType_Base && element->size == 1 && strstr(element->name, "char")){
+			const void *nul = memchr(data, '\0', (size_t)type->count);
+			lua_pushlstring(L, CAST(const char *, data), nul ? (size_t)(CAST(const uint8_t *, nul) - data) : (size_t)type->count);
+			return;
+		}
+		lua_createtable(L, (int)type->count, 0);
+		for(i = 0; i < type->count; i++){
+			pushValue(L, syms, element, data + i * element->size, depth + 1);
+			lua_rawseti(L, -2, (lua_Integer)i + 1);
+		}
+		return;
+	default:
+		lua_pushlstring(L, CAST(const char *, data), (size_t)type->size);
+		return;
+	}
+}
+
+/**
+ * 加载ELF文件
+ * 1#:ELF文件路径
+ * 返回:
+ * 1#:符号对象
+ */
+static int luaApi_symbols_load(lua_State *L){
+	const char *path = luaL_checkstring(L, 1);
+	struct luaApi_symbols *luaSyms = lua_newuserdata(L, sizeof(struct luaApi_symbols));	// +1
+	luaSyms->syms = symbols_Load(path);
+	if(luaSyms->syms == NULL){
+		return luaL_error(L, "Failed to load symbols from %s.", path);
+	}
+	luaL_setmetatable(L, SYMBOLS_LUA_OBJECT_TYPE);
+	return 1;
+}
+
+/**
+ * 统计信息
+ * 1#:符号对象
+ * 返回:
+ * 1#:索引中的符号数
+ * 2#:编译单元数
+ * 3#:已经解码的编译单元数
+ * 4#:已经解码的类型数
+ */
+static int luaApi_symbols_info(lua_State *L){
+	struct luaApi_symbols *luaSyms = luaL_checkudata(L, 1, SYMBOLS_LUA_OBJECT_TYPE);
+	unsigned int symbolCount, unitCount, decodedUnits, typeCount;
+	symbols_Info(luaSyms->syms, &symbolCount, &unitCount, &decodedUnits, &typeCount);
+	lua_pushinteger(L, symbolCount);
+	lua_pushinteger(L, unitCount);
+	lua_pushinteger(L, decodedUnits);
+	lua_pushinteger(L, typeCount);
+	return 4;
+}
+
+/**
+ * 解析变量路径,也可以直接调用符号对象
+ * 1#:符号对象
+ * 2#:路径,例如"g_stats.rx_count"
+ * 返回:
+ * 1#:地址,不存在时返回nil
+ * 2#:字节数
+ * 3#:类型名,没有调试信息时为nil
+ * 4#:位域的最低位
+ * 5#:位域宽度,不是位域时为0
+ */
+static int luaApi_symbols_lookup(lua_State *L){
+	struct luaApi_symbols *luaSyms = luaL_checkudata(L, 1, SYMBOLS_LUA_OBJECT_TYPE);
+	const char *path = luaL_checkstring(L, 2);
+	struct symbolLocation location;
+	if(symbols_Resolve(luaSyms->syms, path, &location) == FALSE){
+		lua_pushnil(L);
+		return 1;
+	}
+	lua_pushinteger(L, (lua_Integer)location.addr);
+	lua_pushinteger(L, (lua_Integer)location.size);
+	if(location.type){
+		lua_pushstring(L, location.type->name);
+	}else{
+		lua_pushnil(L);
+	}
+	lua_pushinteger(L, location.bitOffset);
+	lua_pushinteger(L, location.bitSize);
+	return 5;
+}
+
+/**
+ * 查找地址所在的函数
+ * 1#:符号对象
+ * 2#:地址
+ * 返回:
+ * 1#:函数名,不在任何函数中时返回nil
+ * 2#:相对函数起始地址的偏移
+ */
+static int luaApi_symbols_function(lua_State *L){
+	struct luaApi_symbols *luaSyms = luaL_checkudata(L, 1, SYMBOLS_LUA_OBJECT_TYPE);
+	uint64_t addr = (uint64_t)luaL_checkinteger(L, 2);
+	const char *name;
+	uint64_t offset;
+	if(symbols_Function(luaSyms->syms, addr, &name, &offset) == FALSE){
+		lua_pushnil(L);
+		return 1;
+	}
+	lua_pushstring(L, name);
+	lua_pushinteger(L, (lua_Integer)offset);
+	return 2;
+}
+
+/**
+ * 读取变量
+ * 1#:符号对象
+ * 2#:MEM-AP对象
+ * 3#:路径
+ * 返回:
+ * 1#:解码后的值,没有调试信息时为原始字节串
+ */
+static int luaApi_symbols_read(lua_State *L){
+	struct luaApi_symbols *luaSyms = luaL_checkudata(L, 1, SYMBOLS_LUA_OBJECT_TYPE);
+	AccessPort ap = checkMemoryAp(L, 2);
+	const char *path = luaL_checkstring(L, 3);
+	struct symbolLocation location;
+	const uint8_t *data;
+	checkResolve(L, luaSyms->syms, path, &location);
+	if(location.size == 0){
+		return luaL_error(L, "Symbol %s has no size.", path);
+	}
+	data = readMemory(L, ap, location.addr, location.size);	// +1
+	if(location.type == NULL){
+		lua_pushlstring(L, CAST(const char *, data), (size_t)location.size);
+	}else if(location.bitSize){
+		pushScalar(L, location.type, loadBits(data, location.bitOffset, location.bitSize), location.bitSize);
+	}else{
+		pushValue(L, luaSyms->syms, location.type, data, 0);
+	}
+	return 1;
+}
+
+/**
+ * 写变量
+ * 标量写入数值,位域先读出所在的字节再写回;结构体和数组写入同样长度的字节串
+ * 1#:符号对象
+ * 2#:MEM-AP对象
+ * 3#:路径
+ * 4#:值
+ */
+static int luaApi_symbols_write(lua_State *L){
+	struct luaApi_symbols *luaSyms = luaL_checkudata(L, 1, SYMBOLS_LUA_OBJECT_TYPE);
+	AccessPort ap = checkMemoryAp(L, 2);
+	const char *path = luaL_checkstring(L, 3);
+	const struct symbolType *type;
+	struct symbolLocation location;
+	uint8_t bytes[9];
+	const char *str;
+	uint64_t value, i;
+	size_t len;
+	checkResolve(L, luaSyms->syms, path, &location);
+	type = location.type;
+	if(type == NULL || type->kind == SymbolType_Struct || type->kind == SymbolType_Union
+			|| type->kind == SymbolType_Array || (!location.bitSize && location.size > 8)){
+		str = luaL_checklstring(L, 4, &len);
+		if(len != location.size){
+			return luaL_error(L, "Symbol %s needs %I bytes.", path, (lua_Integer)location.size);
+		}
+		writeMemory(L, ap, location.addr, CAST(const uint8_t *, str), location.size);
+		return 0;
+	}
+	if(type->kind == SymbolType_Base && type->encoding == SymbolEncoding_Float && !location.bitSize){
+		if(location.size == 4){
+			float f = (float)luaL_checknumber(L, 4);
+			uint32_t raw;
+			memcpy(&raw, &f, sizeof(raw));
+			value = raw;
+		}else{
+			double d = luaL_checknumber(L, 4);
+			memcpy(&value, &d, sizeof(value));
+		}
+	}else if(type->kind == SymbolType_Base && type->encoding == SymbolEncoding_Bool){
+		value = lua_toboolean(L, 4) ? 1 : 0;
+	}else{
+		value = (uint64_t)luaL_checkinteger(L, 4);
+	}
+	if(location.bitSize){
+		memcpy(bytes, readMemory(L, ap, location.addr, location.size), (size_t)location.size);
+		storeBits(bytes, location.bitOffset, location.bitSize, value);
+	}else{
+		for(i = 0; i < location.size; i++){
+			bytes[i] = (uint8_t)(value >> (i << 3));
+		}
+	}
+	writeMemory(L, ap, location.addr, bytes, location.size);
+	return 0;
+}
+
+static int luaApi_symbols_gc(lua_State *L){
+	struct luaApi_symbols *luaSyms = luaL_checkudata(L, 1, SYMBOLS_LUA_OBJECT_TYPE);
+	if(luaSyms->syms){
+		symbols_Free(&luaSyms->syms);
+	}
+	return 0;
+}
+
+// 模块静态函数
+static const luaL_Reg lib_symbols_f[] = {
+	{"Load", luaApi_symbols_load},
+	{NULL, NULL}
+};
+
+// 符号对象方法
+static const luaL_Reg lib_symbols_oo[] = {
+	{"Info", luaApi_symbols_info},
+	{"Lookup", luaApi_symbols_lookup},
+	{"Function", luaApi_symbols_function},
+	{"Read", luaApi_symbols_read},
+	{"Write", luaApi_symbols_write},
+	{"__call", luaApi_symbols_lookup},
+	{NULL, NULL}
+};
+
+int luaopen_symbols (lua_State *L) {
+	lua_createtable(L, 0, 0);
+	luaL_setfuncs(L, lib_symbols_f, 0);
+	return 1;
+}
+
+// 注册接口调用
+void RegisterApi_Symbols(lua_State *L){
+	LuaApiNewTypeMetatable(L, SYMBOLS_LUA_OBJECT_TYPE, luaApi_symbols_gc, lib_symbols_oo);
+	lua_pop(L, 1);
+	luaL_requiref(L, "Symbols", luaopen_symbols, 0);
+	lua_pop(L, 1);
+}
@@ -5,9 +5,14 @@
  *      Author: virusv
  */
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
 #include "smart_ocd.h"
 #include "misc/log.h"
+#include "misc/misc.h"
 
 #include "arch/ARM/ADI/ADIv5_private.h"
 
@@ -18,11 +23,15 @@
 static int dapInit(struct ADIv5_Dap *dap){
 	// 调试部分复位
 	dap->adapter->Reset(dap->adapter, ADPT_RESET_DEBUG_RESET);
+	if(dap->multidrop && dap->adapter->currTransMode != ADPT_MODE_SWD){
+		log_error("Multi-drop only available in SWD transfer mode.");
+		return ADI_ERR_UNSUPPORT;
+	}
 	if(dap->adapter->currTransMode == ADPT_MODE_SWD){
-		uint32_t dpidr = 0;
+		ADIv5_QueueTarget(dap);
 		// SWD模式下第一个读取的寄存器必须要是DPIDR，这样才能读取其他的寄存器
 		// 否则其他寄存器无法读取
-		dap->adapter->DapSingleRead(dap->adapter, ADPT_DAP_DP_REG, DP_REG_DPIDR, &dpidr);
+		dap->adapter->DapSingleRead(dap->adapter, ADPT_DAP_DP_REG, DP_REG_DPIDR, &dap->idr.regData);
 		dap->adapter->DapSingleWrite(dap->adapter, ADPT_DAP_DP_REG, DP_REG_ABORT, 0x1e);	// 清空STICKER ERROR 信息
 		if(dap->adapter->DapCommit(dap->adapter) != ADPT_SUCCESS){
 			// 清理指令队列
@@ -30,7 +39,7 @@ static int dapInit(struct ADIv5_Dap *dap){
 			log_error("Init DAP failed!");
 			return ADI_ERR_INTERNAL_ERROR;
 		}
-		log_info("DAP DPIDR:0x%08X.", dpidr);
+		log_info("DAP DPIDR:0x%08X.", dap->idr.regData);
 	}else if(dap->adapter->currTransMode == ADPT_MODE_JTAG){
 		dap->adapter->JtagToState(dap->adapter, JTAG_TAP_IDLE);
 		if(dap->adapter->JtagCommit(dap->adapter) != ADPT_SUCCESS){
@@ -45,6 +54,12 @@ static int dapInit(struct ADIv5_Dap *dap){
 	}
 
 	uint32_t ctrl_stat = 0;
+	ADIv5_QueueTarget(dap);
+	// DPv2:读取TARGETID寄存器,在DP bank 2
+	if(dap->idr.regInfo.Version >= 2){
+		dap->adapter->DapSingleWrite(dap->adapter, ADPT_DAP_DP_REG, DP_REG_SELECT, DP_REG_TARGETID >> 4);
+		dap->adapter->DapSingleRead(dap->adapter, ADPT_DAP_DP_REG, DP_REG_TARGETID, &dap->targetId);
+	}
 	// 清零SELECT寄存器
 	dap->adapter->DapSingleWrite(dap->adapter, ADPT_DAP_DP_REG, DP_REG_SELECT, 0);
 	// 写0x20到CTRL，并读取
@@ -59,6 +74,7 @@ static int dapInit(struct ADIv5_Dap *dap){
 		return ADI_ERR_INTERNAL_ERROR;
 	}
 	do{
+		ADIv5_QueueTarget(dap);
 		dap->adapter->DapSingleRead(dap->adapter, ADPT_DAP_DP_REG, DP_REG_CTRL_STAT, &ctrl_stat);
 		if(dap->adapter->DapCommit(dap->adapter) != ADPT_SUCCESS){
 			// 清理指令队列
@@ -68,785 +84,874 @@ static int dapInit(struct ADIv5_Dap *dap){
 		}
 	}while((ctrl_stat & (DP_STAT_CDBGPWRUPACK | DP_STAT_CSYSPWRUPACK)) != (DP_STAT_CDBGPWRUPACK | DP_STAT_CSYSPWRUPACK));
 	log_debug("DAP Power up. CTRL_STAT:0x%08X.", ctrl_stat);
+	if(dap->idr.regInfo.Version >= 2){
+		log_info("DAP TARGETID:0x%08X.", dap->targetId);
+	}
+	dap->select.regData = 0;
+	dap->selectValid = TRUE;
 	return ADI_SUCCESS;
 }
 
 /**
- * apRead8 读8位数据
+ * ADIv5_DapCommit 执行指令队列
+ * 队列中的SELECT和CSW写操作在加入队列时就更新了影子寄存器,
+ * 执行失败时不知道哪些操作已经生效,所以要使影子寄存器失效,下次访问时重新写入
  */
-static int apRead8(AccessPort self, uint64_t addr, uint8_t *data){
-	assert(self != NULL);
-	assert(data != NULL);
-	ADIv5_DpSelectRegister selectTmp;
-	ADIv5_ApCswRegister cswTmp;
-	struct ADIv5_AccessPort *ap = container_of(self, struct ADIv5_AccessPort, apApi);
-	// 检查AP类型
-	if(self->type != AccessPort_Memory){
-		log_error("Not a memory access port!");
-		return ADI_ERR_BAD_PARAMETER;
-	}
-	// 初始化本地临时变量
-	selectTmp.regData = ap->dap->select.regData;
-	cswTmp.regData = ap->type.memory.csw.regData;
-	// 选中当前ap
-	selectTmp.regInfo.AP_Sel = ap->index;
-	// 选中当前ap CSW 寄存器 bank
-	selectTmp.regInfo.AP_BankSel = 0x0;
-	// 设置CSW：Size=Word，AddrInc=off
-	cswTmp.regInfo.AddrInc = AP_CSW_NADDRINC;	// AddrInc Off
-	if(!ap->type.memory.config.lessWordTransfers){
-		log_warn("Couldn't support Less Word Transfers.");
-		return ADI_ERR_UNSUPPORT;
-	}
-	cswTmp.regInfo.Size = AP_CSW_SIZE8;	// Byte
-	// 是否需要更新SELECT寄存器?
-	if(ap->dap->select.regData != selectTmp.regData){
-		ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_DP_REG, DP_REG_SELECT, selectTmp.regData);
+int ADIv5_DapCommit(struct ADIv5_Dap *dap){
+	assert(dap != NULL);
+	if(dap->adapter->DapCommit(dap->adapter) == ADPT_SUCCESS){
+		return ADI_SUCCESS;
 	}
-	// 是否需要更新CSW寄存器？
-	if(ap->type.memory.csw.regData != cswTmp.regData){
-		ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_CSW, cswTmp.regData);
+	ADIv5_DapInvalidate(dap);
+	log_error("Execute DAP command failed!");
+	return ADI_ERR_INTERNAL_ERROR;
+}
+
+/**
+ * ADIv5_DapInvalidate 提交失败后清理指令队列,并使SELECT和CSW影子寄存器失效
+ */
+void ADIv5_DapInvalidate(struct ADIv5_Dap *dap){
+	assert(dap != NULL);
+	struct ADIv5_AccessPort *ap;
+	dap->adapter->DapCleanPending(dap->adapter);
+	dap->selectValid = FALSE;
+	list_for_each_entry(ap, &dap->apList, list_entry){
+		if(ap->apApi.type == AccessPort_Memory){
+			ap->type.memory.cswValid = FALSE;
+		}
 	}
-	// 写入TAR
-	ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_TAR_LSB, addr & 0xFFFFFFFFu);
-	if(ap->type.memory.config.largeAddress){
-		ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_TAR_MSB, (addr >> 32) & 0xFFFFFFFFu);
+}
+
+/**
+ * ADIv5_QueueTarget multi-drop模式下选中该DAP对应的目标
+ * 每次向队列加入DP/AP操作之前都要调用,Adapter只在目标改变时才插入切换时序
+ */
+void ADIv5_QueueTarget(struct ADIv5_Dap *dap){
+	assert(dap != NULL);
+	if(dap->multidrop){
+		dap->adapter->DapSelectTarget(dap->adapter, dap->targetSel);
 	}
-	uint32_t data_tmp = 0;
-	// 读DRW寄存器
-	ap->dap->adapter->DapSingleRead(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_DRW, &data_tmp);
-	// 执行指令队列
-	if(ap->dap->adapter->DapCommit(ap->dap->adapter) != ADPT_SUCCESS){
-		// 清理指令队列
-		ap->dap->adapter->DapCleanPending(ap->dap->adapter);
-		log_error("Execute DAP command failed!");
-		return ADI_ERR_INTERNAL_ERROR;
+}
+
+/**
+ * ADIv5_QueueSelect 选中AP和AP寄存器bank
+ * 只有和影子寄存器不一致时才写SELECT
+ */
+void ADIv5_QueueSelect(struct ADIv5_AccessPort *ap, uint8_t bank){
+	assert(ap != NULL);
+	ADIv5_DpSelectRegister selectTmp;
+	ADIv5_QueueTarget(ap->dap);
+	selectTmp.regData = 0;
+	// 选中当前ap
+	selectTmp.regInfo.AP_Sel = ap->index;
+	// 选中当前ap寄存器 bank
+	selectTmp.regInfo.AP_BankSel = bank;
+	if(ap->dap->selectValid && ap->dap->select.regData == selectTmp.regData){
+		return;
 	}
-	// 根据byte lane获得数据
-	*data = (data_tmp >> ((addr & 3) << 3)) & 0xff;
-	// 指令执行成功，同步数据到DAP影子寄存器
+	ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_DP_REG, DP_REG_SELECT, selectTmp.regData);
 	ap->dap->select.regData = selectTmp.regData;
-	ap->type.memory.csw.regData = cswTmp.regData;
-	return ADI_SUCCESS;
+	ap->dap->selectValid = TRUE;
 }
 
 /**
- * apRead16 读16位数据
+ * ADIv5_QueueCsw 设置CSW的地址自增模式和传输数据大小
+ * 只有和影子寄存器不一致时才写CSW
  */
-static int apRead16(AccessPort self, uint64_t addr, uint16_t *data){
-	assert(self != NULL);
-	assert(data != NULL);
-	ADIv5_DpSelectRegister selectTmp;
+int ADIv5_QueueCsw(struct ADIv5_AccessPort *ap, enum addrIncreaseMode mode, enum dataSize size){
+	assert(ap != NULL);
 	ADIv5_ApCswRegister cswTmp;
-	struct ADIv5_AccessPort *ap = container_of(self, struct ADIv5_AccessPort, apApi);
-	// 检查AP类型
-	if(self->type != AccessPort_Memory){
-		log_error("Not a memory access port!");
-		return ADI_ERR_BAD_PARAMETER;
-	}
-	// 检查对齐
-	if(addr & 0x1){
-		log_warn("Memory address is not half word aligned!");
-		return ADI_ERR_BAD_PARAMETER;
-	}
-	// 初始化本地临时变量
-	selectTmp.regData = ap->dap->select.regData;
 	cswTmp.regData = ap->type.memory.csw.regData;
-	// 选中当前ap
-	selectTmp.regInfo.AP_Sel = ap->index;
-	// 选中当前ap CSW 寄存器 bank
-	selectTmp.regInfo.AP_BankSel = 0x0;
-	// 设置CSW：Size=Word，AddrInc=off
-	cswTmp.regInfo.AddrInc = AP_CSW_NADDRINC;	// AddrInc Off
-	if(!ap->type.memory.config.lessWordTransfers){
-		log_warn("Couldn't support Less Word Transfers.");
+	switch(size){
+	case DataSize_8:
+	case DataSize_16:
+		// 检查是否支持less word Transfer
+		if(!ap->type.memory.config.lessWordTransfers){
+			log_warn("Couldn't support less word transfers.");
+			return ADI_ERR_UNSUPPORT;
+		}
+		cswTmp.regInfo.Size = size == DataSize_8 ? AP_CSW_SIZE8 : AP_CSW_SIZE16;
+		break;
+	case DataSize_32:
+		cswTmp.regInfo.Size = AP_CSW_SIZE32;	// Word
+		break;
+	case DataSize_64:
+		if(!ap->type.memory.config.largeData){
+			log_warn("Couldn't support Large Word Transfers.");
+			return ADI_ERR_UNSUPPORT;
+		}
+		cswTmp.regInfo.Size = AP_CSW_SIZE64;	// Double Word
+		break;
+	case DataSize_128:
+	case DataSize_256:
+	default:
+		log_warn("Specified data size is not support.");
 		return ADI_ERR_UNSUPPORT;
 	}
-	cswTmp.regInfo.Size = AP_CSW_SIZE16;	// Half Word
-	// 是否需要更新SELECT寄存器?
-	if(ap->dap->select.regData != selectTmp.regData){
-		ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_DP_REG, DP_REG_SELECT, selectTmp.regData);
+	// 地址自增模式
+	switch(mode){
+	case AddrInc_Off: cswTmp.regInfo.AddrInc = AP_CSW_NADDRINC; break;
+	case AddrInc_Single: cswTmp.regInfo.AddrInc = AP_CSW_SADDRINC; break;
+	case AddrInc_Packed:
+		if(!ap->type.memory.config.packedTransfers){
+			log_warn("Couldn't support packed transfers.");
+			return ADI_ERR_UNSUPPORT;
+		}
+		cswTmp.regInfo.AddrInc = AP_CSW_PADDRINC;
+		break;
+	default:
+		log_warn("Specified address increase mode is not support.");
+		return ADI_ERR_UNSUPPORT;
 	}
+	ADIv5_QueueSelect(ap, 0x0);
 	// 是否需要更新CSW寄存器？
-	if(ap->type.memory.csw.regData != cswTmp.regData){
-		ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_CSW, cswTmp.regData);
-	}
-	// 写入TAR
-	ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_TAR_LSB, addr & 0xFFFFFFFFu);
-	if(ap->type.memory.config.largeAddress){
-		ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_TAR_MSB, (addr >> 32) & 0xFFFFFFFFu);
-	}
-	uint32_t data_tmp = 0;
-	// 读DRW寄存器
-	ap->dap->adapter->DapSingleRead(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_DRW, &data_tmp);
-	// 执行指令队列
-	if(ap->dap->adapter->DapCommit(ap->dap->adapter) != ADPT_SUCCESS){
-		// 清理指令队列
-		ap->dap->adapter->DapCleanPending(ap->dap->adapter);
-		log_error("Execute DAP command failed!");
-		return ADI_ERR_INTERNAL_ERROR;
+	if(ap->type.memory.cswValid && ap->type.memory.csw.regData == cswTmp.regData){
+		return ADI_SUCCESS;
 	}
-	// 根据byte lane获得数据
-	*data = (data_tmp >> ((addr & 3) << 3)) & 0xffff;
-	// 指令执行成功，同步数据到DAP影子寄存器
-	ap->dap->select.regData = selectTmp.regData;
+	ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_CSW, cswTmp.regData);
 	ap->type.memory.csw.regData = cswTmp.regData;
+	ap->type.memory.cswValid = TRUE;
 	return ADI_SUCCESS;
 }
 
 /**
- * apRead32 读32位数据
+ * ADIv5_QueueTar 写入TAR
  */
-static int apRead32(AccessPort self, uint64_t addr, uint32_t *data){
-	assert(self != NULL);
-	assert(data != NULL);
-	ADIv5_DpSelectRegister selectTmp;
-	ADIv5_ApCswRegister cswTmp;
-	struct ADIv5_AccessPort *ap = container_of(self, struct ADIv5_AccessPort, apApi);
-	// 检查AP类型
-	if(self->type != AccessPort_Memory){
-		log_error("Not a memory access port!");
-		return ADI_ERR_BAD_PARAMETER;
-	}
-	// 检查对齐
-	if(addr & 0x3){
-		log_warn("Memory address is not word aligned!");
-		return ADI_ERR_BAD_PARAMETER;
-	}
-	// 初始化本地临时变量
-	selectTmp.regData = ap->dap->select.regData;
-	cswTmp.regData = ap->type.memory.csw.regData;
-	// 选中当前ap
-	selectTmp.regInfo.AP_Sel = ap->index;
-	// 选中当前ap寄存器 bank
-	selectTmp.regInfo.AP_BankSel = 0x0;
-	// 设置CSW：Size=Word，AddrInc=off
-	cswTmp.regInfo.AddrInc = AP_CSW_NADDRINC;	// AddrInc Off
-	cswTmp.regInfo.Size = AP_CSW_SIZE32;	// Word
-	// 是否需要更新SELECT寄存器?
-	if(ap->dap->select.regData != selectTmp.regData){
-		ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_DP_REG, DP_REG_SELECT, selectTmp.regData);
-	}
-	// 是否需要更新CSW寄存器？
-	if(ap->type.memory.csw.regData != cswTmp.regData){
-		ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_CSW, cswTmp.regData);
-	}
-	// 写入TAR
+void ADIv5_QueueTar(struct ADIv5_AccessPort *ap, uint64_t addr){
+	assert(ap != NULL);
+	ADIv5_QueueSelect(ap, 0x0);
 	ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_TAR_LSB, addr & 0xFFFFFFFFu);
 	if(ap->type.memory.config.largeAddress){
 		ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_TAR_MSB, (addr >> 32) & 0xFFFFFFFFu);
 	}
-	// 读DRW寄存器, 根据byte lane获得数据
-	ap->dap->adapter->DapSingleRead(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_DRW, data);
-	// 执行指令队列
-	if(ap->dap->adapter->DapCommit(ap->dap->adapter) != ADPT_SUCCESS){
-		// 清理指令队列
-		ap->dap->adapter->DapCleanPending(ap->dap->adapter);
-		log_error("Execute DAP command failed!");
-		return ADI_ERR_INTERNAL_ERROR;
-	}
-	// 指令执行成功，同步数据到DAP影子寄存器
-	ap->dap->select.regData = selectTmp.regData;
-	ap->type.memory.csw.regData = cswTmp.regData;
-	return ADI_SUCCESS;
 }
 
 /**
- * apRead64 读64位数据
+ * 检查地址是否按照传输数据大小对齐
  */
-static int apRead64(AccessPort self, uint64_t addr, uint64_t *data){
-	assert(self != NULL);
-	assert(data != NULL);
-	ADIv5_DpSelectRegister selectTmp;
-	ADIv5_ApCswRegister cswTmp;
-	struct ADIv5_AccessPort *ap = container_of(self, struct ADIv5_AccessPort, apApi);
-	// 检查AP类型
-	if(self->type != AccessPort_Memory){
-		log_error("Not a memory access port!");
+static int checkAlign(uint64_t addr, enum dataSize size){
+	if(size <= DataSize_64 && (addr & ((1u << size) - 1))){
+		log_warn("Memory address is not aligned to the transfer size!");
 		return ADI_ERR_BAD_PARAMETER;
 	}
-	// 检查对齐
-	if(addr & 0x7){
-		log_warn("Memory address is not double word aligned!");
-		return ADI_ERR_BAD_PARAMETER;
-	}
-	// 初始化本地临时变量
-	selectTmp.regData = ap->dap->select.regData;
-	cswTmp.regData = ap->type.memory.csw.regData;
-	// 选中当前ap
-	selectTmp.regInfo.AP_Sel = ap->index;
-	// 选中当前ap寄存器 bank
-	selectTmp.regInfo.AP_BankSel = 0x0;
-	// 设置CSW：Size=Word，AddrInc=off
-	cswTmp.regInfo.AddrInc = AP_CSW_NADDRINC;	// AddrInc Off
-	if(!ap->type.memory.config.largeData){
-		log_warn("Couldn't support Large Word Transfers.");
-		return ADI_ERR_UNSUPPORT;
-	}
-	cswTmp.regInfo.Size = AP_CSW_SIZE64;	// Double Word
-	// 是否需要更新SELECT寄存器?
-	if(ap->dap->select.regData != selectTmp.regData){
-		ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_DP_REG, DP_REG_SELECT, selectTmp.regData);
-	}
-	// 是否需要更新CSW寄存器？
-	if(ap->type.memory.csw.regData != cswTmp.regData){
-		ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_CSW, cswTmp.regData);
-	}
-	// 写入TAR
-	ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_TAR_LSB, addr & 0xFFFFFFFFu);
-	if(ap->type.memory.config.largeAddress){
-		ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_TAR_MSB, (addr >> 32) & 0xFFFFFFFFu);
+	return ADI_SUCCESS;
+}
+
+/**
+ * 把Block读写加入队列
+ * 地址自增模式下TAR只在回绕大小以内自增,超过回绕边界需要拆分重写TAR。
+ * 回绕大小默认是ADIv5保证的1KB,可以用ProbeTarWrap探测或者SetTarWrap指定
+ */
+static int queueBlock(struct ADIv5_AccessPort *ap, uint64_t addr, enum addrIncreaseMode mode, enum dataSize size,
+		unsigned int count, uint32_t *data, BOOL write){
+	int result;
+	uint64_t addrCurr = addr, addrEnd;	// 当前地址，结束地址
+	uint64_t addrNextBoundary;	// 地址的下一个回绕边界
+	unsigned int thisTimeTransCnt, dataPos = 0;	// 指向data的偏移
+	unsigned int shift;	// 每次DRW访问TAR增加的字节数的log2
+	if(count == 0) return ADI_SUCCESS;
+	if(mode != AddrInc_Packed && (result = checkAlign(addr, size)) != ADI_SUCCESS){
+		return result;
+	}
+	if((result = ADIv5_QueueCsw(ap, mode, size)) != ADI_SUCCESS){
+		return result;
+	}
+	if(mode == AddrInc_Off){	// 地址不增
+		ADIv5_QueueTar(ap, addr);
+		if(write){
+			ap->dap->adapter->DapMultiWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_DRW, count, data);
+		}else{
+			ap->dap->adapter->DapMultiRead(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_DRW, count, data);
+		}
+		return ADI_SUCCESS;
 	}
-	// 读DRW寄存器
-	uint32_t data_tmp[2];	// 定义缓冲区
-	// 读取数据，第一次读取的是低位，接下来读取高位，必须两次读取后才能完成本次AP Memory access
-	ap->dap->adapter->DapSingleRead(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_DRW, data_tmp);
-	ap->dap->adapter->DapSingleRead(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_DRW, data_tmp + 1);
-	// 执行指令队列
-	if(ap->dap->adapter->DapCommit(ap->dap->adapter) != ADPT_SUCCESS){
-		// 清理指令队列
-		ap->dap->adapter->DapCleanPending(ap->dap->adapter);
-		log_error("Execute DAP command failed!");
-		return ADI_ERR_INTERNAL_ERROR;
+	// Single模式每次写DRW，发起一次memory access，之后自增TAR
+	// Packed模式每次写DRW，发起多次memory access，每次Memory access成功后自增TAR
+	shift = mode == AddrInc_Single ? size : 2;
+	addrEnd = addr + ((uint64_t)count << shift);
+	while(addrCurr < addrEnd){
+		addrNextBoundary = (addrCurr | (ap->type.memory.tarWrap - 1)) + 1;	// 找到下一个回绕边界
+		// 写入TAR
+		ADIv5_QueueTar(ap, addrCurr);
+		// 如果下一个边界大于结束地址
+		if(addrNextBoundary > addrEnd){
+			thisTimeTransCnt = (addrEnd - addrCurr) >> shift;
+			addrCurr = addrEnd;
+		}else{
+			thisTimeTransCnt = (addrNextBoundary - addrCurr) >> shift;
+			addrCurr = addrNextBoundary;
+		}
+		if(write){
+			ap->dap->adapter->DapMultiWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_DRW, thisTimeTransCnt, data + dataPos);
+		}else{
+			ap->dap->adapter->DapMultiRead(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_DRW, thisTimeTransCnt, data + dataPos);
+		}
+		dataPos += thisTimeTransCnt;
 	}
-	*data = ((uint64_t)data_tmp[1] << 32) | data_tmp[0];
-	// 指令执行成功，同步数据到DAP影子寄存器
-	ap->dap->select.regData = selectTmp.regData;
-	ap->type.memory.csw.regData = cswTmp.regData;
 	return ADI_SUCCESS;
 }
 
 /**
- * apWrite8 写8位数据
+ * ADIv5_QueueBlockRead 把Block读加入队列,不提交
  */
-static int apWrite8(AccessPort self, uint64_t addr, uint8_t data){
+int ADIv5_QueueBlockRead(struct ADIv5_AccessPort *ap, uint64_t addr, enum addrIncreaseMode mode, enum dataSize size,
+		unsigned int count, uint32_t *data){
+	assert(ap != NULL && data != NULL);
+	return queueBlock(ap, addr, mode, size, count, data, FALSE);
+}
+
+/**
+ * ADIv5_QueueBlockWrite 把Block写加入队列,不提交
+ */
+int ADIv5_QueueBlockWrite(struct ADIv5_AccessPort *ap, uint64_t addr, enum addrIncreaseMode mode, enum dataSize size,
+		unsigned int count, uint32_t *data){
+	assert(ap != NULL && data != NULL);
+	return queueBlock(ap, addr, mode, size, count, data, TRUE);
+}
+
+/**
+ * apReadDrw 读取一次数据:设置CSW,TAR,然后读DRW
+ * 64位数据需要读两次DRW,第一次读取的是低位,接下来读取高位
+ */
+static int apReadDrw(AccessPort self, uint64_t addr, enum dataSize size, uint32_t *data){
 	assert(self != NULL);
-	ADIv5_DpSelectRegister selectTmp;
-	ADIv5_ApCswRegister cswTmp;
 	struct ADIv5_AccessPort *ap = container_of(self, struct ADIv5_AccessPort, apApi);
+	int result;
 	// 检查AP类型
 	if(self->type != AccessPort_Memory){
 		log_error("Not a memory access port!");
 		return ADI_ERR_BAD_PARAMETER;
 	}
-	// 初始化本地临时变量
-	selectTmp.regData = ap->dap->select.regData;
-	cswTmp.regData = ap->type.memory.csw.regData;
-	// 选中当前ap
-	selectTmp.regInfo.AP_Sel = ap->index;
-	// 选中当前ap寄存器 bank
-	selectTmp.regInfo.AP_BankSel = 0x0;
-	// 设置CSW：Size=Word，AddrInc=off
-	cswTmp.regInfo.AddrInc = AP_CSW_NADDRINC;	// AddrInc Off
-	if(!ap->type.memory.config.lessWordTransfers){
-		log_warn("Couldn't support Less Word Transfers.");
-		return ADI_ERR_UNSUPPORT;
+	// 检查对齐
+	if((result = checkAlign(addr, size)) != ADI_SUCCESS){
+		return result;
 	}
-	cswTmp.regInfo.Size = AP_CSW_SIZE8;	// Byte
-	// 是否需要更新SELECT寄存器?
-	if(ap->dap->select.regData != selectTmp.regData){
-		ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_DP_REG, DP_REG_SELECT, selectTmp.regData);
+	// 先提交写合并缓冲区中重叠的写操作
+	if((result = ADIv5_WriteBufferFlush(ap, addr, 1u << size)) != ADI_SUCCESS){
+		return result;
 	}
-	// 是否需要更新CSW寄存器？
-	if(ap->type.memory.csw.regData != cswTmp.regData){
-		ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_CSW, cswTmp.regData);
+	// 先查缓存,数据按byte lane放置
+	if(ap->type.memory.cache && ADIv5_CacheRead(ap, addr, 1u << size, CAST(uint8_t *, data) + (addr & 0x3))){
+		return ADI_SUCCESS;
+	}
+	// 设置CSW：AddrInc=off
+	if((result = ADIv5_QueueCsw(ap, AddrInc_Off, size)) != ADI_SUCCESS){
+		return result;
 	}
 	// 写入TAR
-	ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_TAR_LSB, addr & 0xFFFFFFFFu);
-	if(ap->type.memory.config.largeAddress){
-		ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_TAR_MSB, (addr >> 32) & 0xFFFFFFFFu);
+	ADIv5_QueueTar(ap, addr);
+	// 读DRW寄存器
+	ap->dap->adapter->DapSingleRead(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_DRW, data);
+	if(size == DataSize_64){
+		ap->dap->adapter->DapSingleRead(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_DRW, data + 1);
 	}
-	// 写DRW寄存器
-	uint32_t data_tmp = data << ((addr & 3) << 3);	// 放到Byte Lane确定的位置
-	ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_DRW, data_tmp);
 	// 执行指令队列
-	if(ap->dap->adapter->DapCommit(ap->dap->adapter) != ADPT_SUCCESS){
-		// 清理指令队列
-		ap->dap->adapter->DapCleanPending(ap->dap->adapter);
-		log_error("Execute DAP command failed!");
-		return ADI_ERR_INTERNAL_ERROR;
-	}
-	// 指令执行成功，同步数据到DAP影子寄存器
-	ap->dap->select.regData = selectTmp.regData;
-	ap->type.memory.csw.regData = cswTmp.regData;
-	return ADI_SUCCESS;
+	return ADIv5_DapCommit(ap->dap);
 }
 
 /**
- * apWrite16 写16位数据
+ * apWriteDrw 写入一次数据:设置CSW,TAR,然后写DRW
  */
-static int apWrite16(AccessPort self, uint64_t addr, uint16_t data){
+static int apWriteDrw(AccessPort self, uint64_t addr, enum dataSize size, const uint32_t *data){
 	assert(self != NULL);
-	ADIv5_DpSelectRegister selectTmp;
-	ADIv5_ApCswRegister cswTmp;
 	struct ADIv5_AccessPort *ap = container_of(self, struct ADIv5_AccessPort, apApi);
+	BOOL buffered;
+	int result;
 	// 检查AP类型
 	if(self->type != AccessPort_Memory){
 		log_error("Not a memory access port!");
 		return ADI_ERR_BAD_PARAMETER;
 	}
 	// 检查对齐
-	if(addr & 0x1){
-		log_warn("Memory address is not half word aligned!");
-		return ADI_ERR_BAD_PARAMETER;
+	if((result = checkAlign(addr, size)) != ADI_SUCCESS){
+		return result;
 	}
-	// 初始化本地临时变量
-	selectTmp.regData = ap->dap->select.regData;
-	cswTmp.regData = ap->type.memory.csw.regData;
-	// 选中当前ap
-	selectTmp.regInfo.AP_Sel = ap->index;
-	// 选中当前ap寄存器 bank
-	selectTmp.regInfo.AP_BankSel = 0x0;
-	// 设置CSW：Size=Word，AddrInc=off
-	cswTmp.regInfo.AddrInc = AP_CSW_NADDRINC;	// AddrInc Off
-	if(!ap->type.memory.config.lessWordTransfers){
-		log_warn("Couldn't support Less Word Transfers.");
-		return ADI_ERR_UNSUPPORT;
+	// 写合并区间内先放入缓冲区,之前缓冲的写操作提交失败时返回错误
+	if((result = ADIv5_BufferWrite(ap, addr, 1u << size, CAST(const uint8_t *, data) + (addr & 0x3), &buffered)) != ADI_SUCCESS){
+		return result;
 	}
-	cswTmp.regInfo.Size = AP_CSW_SIZE16;	// Half Word
-	// 是否需要更新SELECT寄存器?
-	if(ap->dap->select.regData != selectTmp.regData){
-		ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_DP_REG, DP_REG_SELECT, selectTmp.regData);
+	if(buffered){
+		return ADI_SUCCESS;
 	}
-	// 是否需要更新CSW寄存器？
-	if(ap->type.memory.csw.regData != cswTmp.regData){
-		ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_CSW, cswTmp.regData);
+	// 设置CSW：AddrInc=off
+	if((result = ADIv5_QueueCsw(ap, AddrInc_Off, size)) != ADI_SUCCESS){
+		return result;
 	}
 	// 写入TAR
-	ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_TAR_LSB, addr & 0xFFFFFFFFu);
-	if(ap->type.memory.config.largeAddress){
-		ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_TAR_MSB, (addr >> 32) & 0xFFFFFFFFu);
-	}
+	ADIv5_QueueTar(ap, addr);
 	// 写DRW寄存器
-	uint32_t data_tmp = data << ((addr & 3) << 3);	// 放到Byte Lane确定的位置
-	ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_DRW, data_tmp);
+	ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_DRW, data[0]);
+	if(size == DataSize_64){
+		ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_DRW, data[1]);
+	}
 	// 执行指令队列
-	if(ap->dap->adapter->DapCommit(ap->dap->adapter) != ADPT_SUCCESS){
-		// 清理指令队列
-		ap->dap->adapter->DapCleanPending(ap->dap->adapter);
-		log_error("Execute DAP command failed!");
-		return ADI_ERR_INTERNAL_ERROR;
+	result = ADIv5_DapCommit(ap->dap);
+	ADIv5_DeltaForget(ap, addr, 1u << size);
+	// 更新缓存,写失败时目标内存的状态不确定,使缓存行失效
+	if(ap->type.memory.cache){
+		if(result == ADI_SUCCESS){
+			ADIv5_CacheWrite(ap, addr, 1u << size, CAST(const uint8_t *, data) + (addr & 0x3));
+		}else{
+			ADIv5_CacheInvalidate(ap, addr, 1u << size);
+		}
 	}
-	// 指令执行成功，同步数据到DAP影子寄存器
-	ap->dap->select.regData = selectTmp.regData;
-	ap->type.memory.csw.regData = cswTmp.regData;
-	return ADI_SUCCESS;
+	return result;
 }
 
 /**
- * apWrite32 写32位数据
+ * apRead8 读8位数据
  */
-static int apWrite32(AccessPort self, uint64_t addr, uint32_t data){
+static int apRead8(AccessPort self, uint64_t addr, uint8_t *data){
+	assert(data != NULL);
+	uint32_t data_tmp = 0;
+	int result = apReadDrw(self, addr, DataSize_8, &data_tmp);
+	if(result == ADI_SUCCESS){
+		// 根据byte lane获得数据
+		*data = (data_tmp >> ((addr & 3) << 3)) & 0xff;
+	}
+	return result;
+}
+
+/**
+ * apRead16 读16位数据
+ */
+static int apRead16(AccessPort self, uint64_t addr, uint16_t *data){
+	assert(data != NULL);
+	uint32_t data_tmp = 0;
+	int result = apReadDrw(self, addr, DataSize_16, &data_tmp);
+	if(result == ADI_SUCCESS){
+		// 根据byte lane获得数据
+		*data = (data_tmp >> ((addr & 3) << 3)) & 0xffff;
+	}
+	return result;
+}
+
+/**
+ * apRead32 读32位数据
+ */
+static int apRead32(AccessPort self, uint64_t addr, uint32_t *data){
+	assert(data != NULL);
+	return apReadDrw(self, addr, DataSize_32, data);
+}
+
+/**
+ * apRead64 读64位数据
+ */
+static int apRead64(AccessPort self, uint64_t addr, uint64_t *data){
+	assert(data != NULL);
+	uint32_t data_tmp[2];	// 定义缓冲区
+	int result = apReadDrw(self, addr, DataSize_64, data_tmp);
+	if(result == ADI_SUCCESS){
+		*data = ((uint64_t)data_tmp[1] << 32) | data_tmp[0];
+	}
+	return result;
+}
+
+/**
+ * apWrite8 写8位数据
+ */
+static int apWrite8(AccessPort self, uint64_t addr, uint8_t data){
+	// 根据byte lane放置数据
+	uint32_t data_tmp = (uint32_t)data << ((addr & 3) << 3);
+	return apWriteDrw(self, addr, DataSize_8, &data_tmp);
+}
+
+/**
+ * apWrite16 写16位数据
+ */
+static int apWrite16(AccessPort self, uint64_t addr, uint16_t data){
+	// 根据byte lane放置数据
+	uint32_t data_tmp = (uint32_t)data << ((addr & 3) << 3);
+	return apWriteDrw(self, addr, DataSize_16, &data_tmp);
+}
+
+/**
+ * apWrite32 写32位数据
+ */
+static int apWrite32(AccessPort self, uint64_t addr, uint32_t data){
+	return apWriteDrw(self, addr, DataSize_32, &data);
+}
+
+/**
+ * apWrite64 写64位数据
+ */
+static int apWrite64(AccessPort self, uint64_t addr, uint64_t data){
+	uint32_t data_tmp[2] = {data & 0xFFFFFFFFu, data >> 32};
+	return apWriteDrw(self, addr, DataSize_64, data_tmp);
+}
+
+/**
+ * apWaitValue 轮询一个字直到(值 & mask) == value
+ * Adapter支持DapValueMatch时由仿真器在本地重复读取,每次提交可以轮询match retry次,
+ * 不匹配时提交返回ADPT_ERR_MISMATCH,这不是错误,所以这里直接调用Adapter的提交,避免每次都打印错误。
+ * 其他提交失败是真正的传输错误(FAULT等),清除sticky标志之后返回错误,不再继续轮询
+ */
+static int apWaitValue(AccessPort self, uint64_t addr, uint32_t mask, uint32_t value, unsigned int timeout){
 	assert(self != NULL);
-	ADIv5_DpSelectRegister selectTmp;
-	ADIv5_ApCswRegister cswTmp;
 	struct ADIv5_AccessPort *ap = container_of(self, struct ADIv5_AccessPort, apApi);
-	// 检查AP类型
+	Adapter adapter = ap->dap->adapter;
+	struct timespec start, now;
+	uint32_t data = 0;
+	int result;
 	if(self->type != AccessPort_Memory){
 		log_error("Not a memory access port!");
 		return ADI_ERR_BAD_PARAMETER;
 	}
-	// 检查对齐
-	if(addr & 0x3){
-		log_warn("Memory address is not word aligned!");
-		return ADI_ERR_BAD_PARAMETER;
+	if((result = checkAlign(addr, DataSize_32)) != ADI_SUCCESS){
+		return result;
 	}
-	// 初始化本地临时变量
-	selectTmp.regData = ap->dap->select.regData;
-	cswTmp.regData = ap->type.memory.csw.regData;
-	// 选中当前ap
-	selectTmp.regInfo.AP_Sel = ap->index;
-	// 选中当前ap寄存器 bank
-	selectTmp.regInfo.AP_BankSel = 0x0;
-	// 设置CSW：Size=Word，AddrInc=off
-	cswTmp.regInfo.AddrInc = AP_CSW_NADDRINC;	// AddrInc Off
-	cswTmp.regInfo.Size = AP_CSW_SIZE32;	// Word
-	// 是否需要更新SELECT寄存器?
-	if(ap->dap->select.regData != selectTmp.regData){
-		ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_DP_REG, DP_REG_SELECT, selectTmp.regData);
+	if((result = ADIv5_WriteBufferFlush(ap, addr, 4)) != ADI_SUCCESS){
+		return result;
 	}
-	// 是否需要更新CSW寄存器？
-	if(ap->type.memory.csw.regData != cswTmp.regData){
-		ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_CSW, cswTmp.regData);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(;;){
+		if((result = ADIv5_QueueCsw(ap, AddrInc_Off, DataSize_32)) != ADI_SUCCESS){
+			return result;
+		}
+		ADIv5_QueueTar(ap, addr);
+		if(adapter->DapValueMatch){
+			adapter->DapValueMatch(adapter, ADPT_DAP_AP_REG, AP_REG_DRW, mask, value);
+		}else{
+			adapter->DapSingleRead(adapter, ADPT_DAP_AP_REG, AP_REG_DRW, &data);
+		}
+		result = adapter->DapCommit(adapter);
+		if(result == ADPT_SUCCESS){
+			if(adapter->DapValueMatch || (data & mask) == value){
+				return ADI_SUCCESS;
+			}
+		}else{
+			ADIv5_DapInvalidate(ap->dap);
+			if(result != ADPT_ERR_MISMATCH){
+				log_error("Wait for 0x%08X at 0x%" PRIX64 " failed!", value, addr);
+				// 清除STICKYERR等错误标志,之后的访问才能继续
+				ADIv5_QueueTarget(ap->dap);
+				adapter->DapSingleWrite(adapter, ADPT_DAP_DP_REG, DP_REG_ABORT,
+						DP_ABORT_STKCMPCLR | DP_ABORT_STKERRCLR | DP_ABORT_WDERRCLR | DP_ABORT_ORUNERRCLR);
+				ADIv5_DapCommit(ap->dap);
+				return ADI_ERR_INTERNAL_ERROR;
+			}
+		}
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if((uint64_t)(now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000 >= timeout){
+			log_warn("Wait for 0x%08X at 0x%" PRIX64 " timeout.", value, addr);
+			return ADI_FAILED;
+		}
 	}
-	// 写入TAR
-	ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_TAR_LSB, addr & 0xFFFFFFFFu);
-	if(ap->type.memory.config.largeAddress){
-		ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_TAR_MSB, (addr >> 32) & 0xFFFFFFFFu);
+}
+
+/**
+ * recoverTransfer Block传输出错后清除错误标志,并读取TAR得到出错的位置
+ * 第一次只清除STICKYERR等标志;如果还失败,说明AP还在等待总线应答,用DAPABORT终止当前传输
+ */
+static int recoverTransfer(struct ADIv5_AccessPort *ap, uint64_t *tar){
+	uint32_t tarLsb = 0, tarMsb = 0;
+	int retry;
+	for(retry = 0; retry < 2; retry++){
+		ADIv5_QueueTarget(ap->dap);
+		ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_DP_REG, DP_REG_ABORT, (retry ? DP_ABORT_DAPABORT : 0)
+				| DP_ABORT_STKCMPCLR | DP_ABORT_STKERRCLR | DP_ABORT_WDERRCLR | DP_ABORT_ORUNERRCLR);
+		ADIv5_QueueSelect(ap, 0x0);
+		ap->dap->adapter->DapSingleRead(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_TAR_LSB, &tarLsb);
+		if(ap->type.memory.config.largeAddress){
+			ap->dap->adapter->DapSingleRead(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_TAR_MSB, &tarMsb);
+		}
+		if(ADIv5_DapCommit(ap->dap) == ADI_SUCCESS){
+			*tar = (uint64_t)tarMsb << 32 | tarLsb;
+			return ADI_SUCCESS;
+		}
 	}
-	// 写DRW寄存器
-	ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_DRW, data);
-	// 执行指令队列
-	if(ap->dap->adapter->DapCommit(ap->dap->adapter) != ADPT_SUCCESS){
-		// 清理指令队列
-		ap->dap->adapter->DapCleanPending(ap->dap->adapter);
-		log_error("Execute DAP command failed!");
-		return ADI_ERR_INTERNAL_ERROR;
+	return ADI_ERR_INTERNAL_ERROR;
+}
+
+/**
+ * blockTransfer 带出错恢复的Block传输
+ * 出错后根据TAR从出错的位置继续传输,同一位置多次出错按照policy退避重试或者跳过所在的页
+ * AddrInc_Off模式下无法定位出错位置,只能整体重试
+ */
+static int blockTransfer(struct ADIv5_AccessPort *ap, uint64_t addr, enum addrIncreaseMode mode, enum dataSize size,
+		unsigned int count, uint32_t *data, BOOL write){
+	const struct transferPolicy *policy = &ap->type.memory.policy;
+	struct transferStatus *status = &ap->type.memory.status;
+	unsigned int shift = mode == AddrInc_Packed ? 2 : size;	// 每次DRW访问TAR增加的字节数的log2
+	unsigned int pos = 0, attempt = 0, next;
+	uint64_t addrCurr, addrEnd = addr + ((uint64_t)count << shift), tar, pageEnd;
+	BOOL contiguous = TRUE;
+	int result = ADI_SUCCESS;
+
+	status->lastGood = addr;
+	status->skipped = 0;
+	status->retries = 0;
+	while(pos < count){
+		addrCurr = mode == AddrInc_Off ? addr : addr + ((uint64_t)pos << shift);
+		if((result = queueBlock(ap, addrCurr, mode, size, count - pos, data + pos, write)) != ADI_SUCCESS){
+			ap->dap->adapter->DapCleanPending(ap->dap->adapter);
+			return result;
+		}
+		if(ADIv5_DapCommit(ap->dap) == ADI_SUCCESS){
+			pos = count;
+			break;
+		}
+		if(recoverTransfer(ap, &tar) != ADI_SUCCESS){
+			log_error("Failed to recover from block transfer error!");
+			result = ADI_ERR_INTERNAL_ERROR;
+			break;
+		}
+		// TAR指向出错的地址,之前的数据都已经传输成功
+		if(mode != AddrInc_Off && tar > addrCurr && tar < addrEnd){
+			next = (tar - addr) >> shift;
+			if(next > pos){
+				pos = next;
+				attempt = 0;
+				if(contiguous) status->lastGood = addr + ((uint64_t)pos << shift);
+				log_info("Block transfer failed at 0x%" PRIX64 ", resume.", tar);
+				continue;
+			}
+		}
+		if(attempt < policy->retries){
+			status->retries++;
+			usleep(policy->backoff << attempt);
+			attempt++;
+			continue;
+		}
+		if(policy->skipSize == 0 || mode == AddrInc_Off){
+			result = ADI_FAILED;
+			break;
+		}
+		// 跳过出错位置所在的页
+		pageEnd = (addrCurr | (policy->skipSize - 1)) + 1;
+		next = pageEnd >= addrEnd ? count : (pageEnd - addr + (1u << shift) - 1) >> shift;
+		log_warn("Skip inaccessible memory 0x%" PRIX64 " - 0x%" PRIX64 ".", addrCurr, addr + ((uint64_t)next << shift));
+		if(!write){
+			memset(data + pos, 0x0, (next - pos) * sizeof(uint32_t));
+		}
+		status->skipped += (uint64_t)(next - pos) << shift;
+		contiguous = FALSE;
+		pos = next;
+		attempt = 0;
 	}
-	// 指令执行成功，同步数据到DAP影子寄存器
-	ap->dap->select.regData = selectTmp.regData;
-	ap->type.memory.csw.regData = cswTmp.regData;
-	return ADI_SUCCESS;
+	if(contiguous && pos == count){
+		status->lastGood = addrEnd;
+	}
+	return result;
 }
 
 /**
- * apWrite64 写64位数据
+ * Block读
  */
-static int apWrite64(AccessPort self, uint64_t addr, uint64_t data){
-	assert(self != NULL);
-	ADIv5_DpSelectRegister selectTmp;
-	ADIv5_ApCswRegister cswTmp;
+static int apBlockRead(AccessPort self, uint64_t addr, enum addrIncreaseMode mode, enum dataSize size, unsigned int count, uint8_t *data){
+	assert(self != NULL && data != NULL);
 	struct ADIv5_AccessPort *ap = container_of(self, struct ADIv5_AccessPort, apApi);
+	int result;
 	// 检查AP类型
 	if(self->type != AccessPort_Memory){
 		log_error("Not a memory access port!");
 		return ADI_ERR_BAD_PARAMETER;
 	}
-	// 检查对齐
-	if(addr & 0x7){
-		log_warn("Memory address is not double word aligned!");
-		return ADI_ERR_BAD_PARAMETER;
-	}
-	// 初始化本地临时变量
-	selectTmp.regData = ap->dap->select.regData;
-	cswTmp.regData = ap->type.memory.csw.regData;
-	// 选中当前ap
-	selectTmp.regInfo.AP_Sel = ap->index;
-	// 选中当前ap寄存器 bank
-	selectTmp.regInfo.AP_BankSel = 0x0;
-	// 设置CSW：Size=Word，AddrInc=off
-	cswTmp.regInfo.AddrInc = AP_CSW_NADDRINC;	// AddrInc Off
-	if(!ap->type.memory.config.largeData){
-		log_warn("Couldn't support Large Word Transfers.");
+	if(size > DataSize_32){
+		log_warn("Specified data size is not support.");
 		return ADI_ERR_UNSUPPORT;
 	}
-	cswTmp.regInfo.Size = AP_CSW_SIZE64;	// Double Word
-	// 是否需要更新SELECT寄存器?
-	if(ap->dap->select.regData != selectTmp.regData){
-		ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_DP_REG, DP_REG_SELECT, selectTmp.regData);
+	if((result = ADIv5_WriteBufferFlush(ap, addr, mode == AddrInc_Off ? 1u << size
+			: (uint64_t)count << (mode == AddrInc_Packed ? 2 : size))) != ADI_SUCCESS){
+		return result;
 	}
-	// 是否需要更新CSW寄存器？
-	if(ap->type.memory.csw.regData != cswTmp.regData){
-		ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_CSW, cswTmp.regData);
-	}
-	// 写入TAR
-	ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_TAR_LSB, addr & 0xFFFFFFFFu);
-	if(ap->type.memory.config.largeAddress){
-		ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_TAR_MSB, (addr >> 32) & 0xFFFFFFFFu);
-	}
-	// 写DRW寄存器，先写低位，再写高位，最后一个高位写完后才初始化Memory access
-	ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_DRW, data & 0xFFFFFFFFu);
-	ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_DRW, (data >> 32) & 0xFFFFFFFFu);
-	// 执行指令队列
-	if(ap->dap->adapter->DapCommit(ap->dap->adapter) != ADPT_SUCCESS){
-		// 清理指令队列
-		ap->dap->adapter->DapCleanPending(ap->dap->adapter);
-		log_error("Execute DAP command failed!");
-		return ADI_ERR_INTERNAL_ERROR;
+	// 32位和packed传输的缓冲区就是连续的内存数据,可以经过缓存
+	if(ap->type.memory.cache && mode != AddrInc_Off && (mode == AddrInc_Packed || size == DataSize_32)
+			&& ADIv5_CacheRead(ap, addr, count << 2, data)){
+		ap->type.memory.status.lastGood = addr + (count << 2);
+		ap->type.memory.status.skipped = 0;
+		ap->type.memory.status.retries = 0;
+		return ADI_SUCCESS;
 	}
-	// 指令执行成功，同步数据到DAP影子寄存器
-	ap->dap->select.regData = selectTmp.regData;
-	ap->type.memory.csw.regData = cswTmp.regData;
-	return ADI_SUCCESS;
+	return blockTransfer(ap, addr, mode, size, count, CAST(uint32_t *, data), FALSE);
 }
 
 /**
- * Block读
+ * Block写
  */
-static int apBlockRead(AccessPort self, uint64_t addr, enum addrIncreaseMode mode, enum dataSize size, unsigned int count, uint8_t *data){
+static int apBlockWrite(AccessPort self, uint64_t addr, enum addrIncreaseMode mode, enum dataSize size, unsigned int count, uint8_t *data){
 	assert(self != NULL && data != NULL);
-	uint32_t *data_out = CAST(uint32_t *, data);
 	struct ADIv5_AccessPort *ap = container_of(self, struct ADIv5_AccessPort, apApi);
-	ADIv5_DpSelectRegister selectTmp;
-	ADIv5_ApCswRegister cswTmp;
 	// 检查AP类型
 	if(self->type != AccessPort_Memory){
 		log_error("Not a memory access port!");
 		return ADI_ERR_BAD_PARAMETER;
 	}
-	// 初始化本地临时变量
-	selectTmp.regData = ap->dap->select.regData;
-	cswTmp.regData = ap->type.memory.csw.regData;
-	// 选中当前ap
-	selectTmp.regInfo.AP_Sel = ap->index;
-	// 选中当前ap寄存器 bank
-	selectTmp.regInfo.AP_BankSel = 0x0;
-	// some checks
-	switch(size){
-	case DataSize_8:
-		// 检查是否支持less word Transfer
-		if(ap->type.memory.config.lessWordTransfers){	// 支持lessWordTransfer
-			cswTmp.regInfo.Size = AP_CSW_SIZE8;	// Half Word
-		}else{
-			log_warn("Couldn't support less word transfers.");
-			return ADI_ERR_UNSUPPORT;
-		}
-		break;
-	case DataSize_16:
-		// 检查是否对齐
-		if(addr & 0x1){
-			log_warn("Memory address is not half word aligned!");
-			return ADI_ERR_BAD_PARAMETER;
-		}
-		// 检查是否支持less word Transfer
-		if(ap->type.memory.config.lessWordTransfers){	// 支持lessWordTransfer
-			cswTmp.regInfo.Size = AP_CSW_SIZE16;	// Half Word
+	if(size > DataSize_32){
+		log_warn("Specified data size is not support.");
+		return ADI_ERR_UNSUPPORT;
+	}
+	int result;
+	// Block写必须在缓冲区中的写操作之后
+	if((result = ADIv5_WriteBufferFlush(ap, 0, 0)) != ADI_SUCCESS){
+		return result;
+	}
+	result = blockTransfer(ap, addr, mode, size, count, CAST(uint32_t *, data), TRUE);
+	ADIv5_DeltaForget(ap, addr, mode == AddrInc_Off ? 1u << size : (uint64_t)count << (mode == AddrInc_Packed ? 2 : size));
+	if(ap->type.memory.cache){
+		if(result == ADI_SUCCESS && ap->type.memory.status.skipped == 0
+				&& mode != AddrInc_Off && (mode == AddrInc_Packed || size == DataSize_32)){
+			ADIv5_CacheWrite(ap, addr, count << 2, data);
 		}else{
-			log_warn("Couldn't support less word transfers.");
-			return ADI_ERR_UNSUPPORT;
+			ADIv5_CacheInvalidate(ap, addr, mode == AddrInc_Off ? 1u << size : (uint64_t)count << (mode == AddrInc_Packed ? 2 : size));
 		}
-		break;
-	case DataSize_32:
-		if(addr & 0x3){
-			log_warn("Memory address is not word aligned!");
-			return ADI_ERR_BAD_PARAMETER;
+	}
+	return result;
+}
+
+/**
+ * 获得填充区域中相对起始地址offset处的字节
+ */
+static uint8_t patternByte(uint64_t pattern, unsigned int patternSize, uint64_t offset){
+	return (pattern >> ((offset % patternSize) << 3)) & 0xFF;
+}
+
+/**
+ * 写一个字中的部分字节[addr, addr+len),加入队列
+ * 支持小于字的传输时拆分成字节和半字写,否则读出整个字,修改后写回
+ * 参数:
+ * 	bytes:[addr, addr+len)的数据
+ */
+static int writeEdge(struct ADIv5_AccessPort *ap, uint64_t addr, unsigned int len, const uint8_t *bytes){
+	uint32_t data = 0, mask = 0, orig = 0, laneMask;
+	uint64_t addrCurr;
+	enum dataSize size;
+	unsigned int idx;
+	int result;
+	for(idx = 0; idx < len; idx++){
+		data |= (uint32_t)bytes[idx] << (((addr + idx) & 0x3) << 3);
+		mask |= 0xFFu << (((addr + idx) & 0x3) << 3);
+	}
+	if(ap->type.memory.config.lessWordTransfers){
+		for(addrCurr = addr; addrCurr < addr + len; addrCurr += 1u << size){
+			size = (!(addrCurr & 0x1) && addrCurr + 2 <= addr + len) ? DataSize_16 : DataSize_8;
+			if((result = ADIv5_QueueCsw(ap, AddrInc_Off, size)) != ADI_SUCCESS){
+				return result;
+			}
+			laneMask = (size == DataSize_8 ? 0xFFu : 0xFFFFu) << ((addrCurr & 0x3) << 3);
+			ADIv5_QueueTar(ap, addrCurr);
+			ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_DRW, data & laneMask);
 		}
-		cswTmp.regInfo.Size = AP_CSW_SIZE32;	// Word
-		break;
-	case DataSize_64:
-	case DataSize_128:
-	case DataSize_256:
-	default:
-		log_warn("Specified data size is not support.");
-		return ADI_ERR_UNSUPPORT;
+		return ADI_SUCCESS;
 	}
-	// 地址自增模式
-	switch(mode){
-	case AddrInc_Off: cswTmp.regInfo.AddrInc = AP_CSW_NADDRINC; break;
-	case AddrInc_Single: cswTmp.regInfo.AddrInc = AP_CSW_SADDRINC; break;
-	case AddrInc_Packed: cswTmp.regInfo.AddrInc = AP_CSW_PADDRINC; break;
-	default:
-		log_warn("Specified address increase mode is not support.");
-		return ADI_ERR_UNSUPPORT;
+	// 读-改-写
+	if((result = ADIv5_QueueCsw(ap, AddrInc_Off, DataSize_32)) != ADI_SUCCESS){
+		return result;
 	}
-	// 是否需要更新SELECT寄存器?
-	if(ap->dap->select.regData != selectTmp.regData){
-		ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_DP_REG, DP_REG_SELECT, selectTmp.regData);
+	ADIv5_QueueTar(ap, addr & ~0x3ull);
+	ap->dap->adapter->DapSingleRead(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_DRW, &orig);
+	if((result = ADIv5_DapCommit(ap->dap)) != ADI_SUCCESS){
+		return result;
 	}
-	// 是否需要更新CSW寄存器？
-	if(ap->type.memory.csw.regData != cswTmp.regData){
-		ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_CSW, cswTmp.regData);
+	if((result = ADIv5_QueueCsw(ap, AddrInc_Off, DataSize_32)) != ADI_SUCCESS){
+		return result;
 	}
+	ADIv5_QueueTar(ap, addr & ~0x3ull);
+	ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_DRW, (orig & ~mask) | data);
+	return ADI_SUCCESS;
+}
 
-	// 处理地址自增模式下超过1kb边界的情况，超过1kb的边界了需要拆分，每次地址自增控制在1kb以内
-	uint64_t addrCurr = addr, addrEnd;	// 当前地址，结束地址
-	uint64_t addrNextBoundary;	// 地址的下一个1kb边界
-	unsigned int thisTimeTransCnt,dataPos = 0;// 指向data_out的偏移
-
-	if(cswTmp.regInfo.AddrInc == AP_CSW_SADDRINC){
-		addrEnd = addr + (count << cswTmp.regInfo.Size);	// 每次写DRW，发起一次memory access，之后自增TAR
-		while(addrCurr < addrEnd){
-			addrNextBoundary = ((addrCurr >> 10) + 1) << 10;	// 找到下一个1kb边界
-			// 写入TAR
-			ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_TAR_LSB, addrCurr & 0xFFFFFFFFu);
-			if(ap->type.memory.config.largeAddress){
-				ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_TAR_MSB, (addrCurr >> 32) & 0xFFFFFFFFu);
-			}
-			//log_debug("SINGLE:CurrAddr:0x%08X;next boundary:0x%08X.", addrCurr, addrNextBoundary);
-			// 如果下一个边界大于结束地址
-			if(addrNextBoundary > addrEnd){
-				thisTimeTransCnt = (addrEnd - addrCurr) >> cswTmp.regInfo.Size;
-				addrCurr = addrEnd;
-			}else{
-				thisTimeTransCnt = (addrNextBoundary - addrCurr) >> cswTmp.regInfo.Size;
-				addrCurr = addrNextBoundary;
+/**
+ * 填充一个字中的部分字节[addr, addr+len)
+ * 参数:
+ * 	start:填充区域的起始地址,用来确定pattern的相位
+ */
+static int fillEdge(struct ADIv5_AccessPort *ap, uint64_t addr, unsigned int len, uint64_t start, uint64_t pattern, unsigned int patternSize){
+	uint8_t bytes[4];
+	unsigned int idx;
+	for(idx = 0; idx < len; idx++){
+		bytes[idx] = patternByte(pattern, patternSize, addr + idx - start);
+	}
+	return writeEdge(ap, addr, len, bytes);
+}
+
+/**
+ * 用重复的pattern填充内存
+ * 字对齐的部分按TAR回绕边界拆分,每段用一次循环写;Adapter支持DapPatternWrite时数据在发送时生成,
+ * 否则所有段共用一个回绕大小的缓冲区,每FILL_COMMIT_BYTES提交一次,主机内存占用和填充长度无关
+ */
+static int apFill(AccessPort self, uint64_t addr, uint64_t len, uint64_t pattern, unsigned int patternSize){
+	assert(self != NULL);
+	struct ADIv5_AccessPort *ap = container_of(self, struct ADIv5_AccessPort, apApi);
+	Adapter adapter = ap->dap->adapter;
+	uint64_t end = addr + len, headEnd, wordEnd, addrCurr, segEnd, sinceCommit = 0;
+	uint32_t words[2], segPattern[2], *fillBuff = NULL;
+	unsigned int patternLen, phase, count, idx, jdx, wrapWords;
+	int result;
+	if(self->type != AccessPort_Memory){
+		log_error("Not a memory access port!");
+		return ADI_ERR_BAD_PARAMETER;
+	}
+	if(patternSize != 1 && patternSize != 2 && patternSize != 4 && patternSize != 8){
+		log_error("Pattern size must be 1, 2, 4 or 8 bytes!");
+		return ADI_ERR_BAD_PARAMETER;
+	}
+	if(len == 0) return ADI_SUCCESS;
+	if((result = ADIv5_WriteBufferFlush(ap, 0, 0)) != ADI_SUCCESS){
+		return result;
+	}
+	headEnd = (addr + 3) & ~0x3ull;
+	if(headEnd > end) headEnd = end;
+	wordEnd = end & ~0x3ull;
+	// 开头不对齐的部分
+	if(headEnd > addr && (result = fillEdge(ap, addr, headEnd - addr, addr, pattern, patternSize)) != ADI_SUCCESS){
+		goto EXIT;
+	}
+	// 中间对齐的字,8字节的pattern每两个字循环一次
+	if(wordEnd > headEnd){
+		patternLen = patternSize == 8 ? 2 : 1;
+		for(idx = 0; idx < 2; idx++){
+			words[idx] = 0;
+			for(jdx = 0; jdx < 4; jdx++){
+				words[idx] |= (uint32_t)patternByte(pattern, patternSize, headEnd + (idx << 2) + jdx - addr) << (jdx << 3);
 			}
-			//log_debug("SINGLE:dataPos:%d;thisTimeTransCnt:%d.", dataPos, thisTimeTransCnt);
-			// 读取block
-			ap->dap->adapter->DapMultiRead(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_DRW, thisTimeTransCnt, data_out + dataPos);
-			dataPos += thisTimeTransCnt;
 		}
-	}else if(cswTmp.regInfo.AddrInc == AP_CSW_PADDRINC){
-		addrEnd = addr + (count << 2);	// 每次写DRW，发起多次memory access，每次Memory access成功后自增TAR
-		while(addrCurr < addrEnd){
-			addrNextBoundary = ((addrCurr >> 10) + 1) << 10;	// 找到下一个1kb边界
-			// 写入TAR
-			ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_TAR_LSB, addrCurr & 0xFFFFFFFFu);
-			if(ap->type.memory.config.largeAddress){
-				ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_TAR_MSB, (addrCurr >> 32) & 0xFFFFFFFFu);
+		if(adapter->DapPatternWrite == NULL){
+			// 多一个字,用偏移表示不同的相位
+			wrapWords = ap->type.memory.tarWrap >> 2;
+			fillBuff = malloc((wrapWords + 1) * sizeof(uint32_t));
+			if(fillBuff == NULL){
+				log_error("Failed to allocate fill buffer!");
+				result = ADI_ERR_INTERNAL_ERROR;
+				goto EXIT;
 			}
-			//log_debug("PACKED:CurrAddr:0x%08X;next boundary:0x%08X.", addrCurr, addrNextBoundary);
-			// 如果下一个边界大于结束地址
-			if(addrNextBoundary > addrEnd){
-				thisTimeTransCnt = (addrEnd - addrCurr) >> 2;
-				addrCurr = addrEnd;
-			}else{
-				thisTimeTransCnt = (addrNextBoundary - addrCurr) >> 2;
-				addrCurr = addrNextBoundary;
+			for(idx = 0; idx <= wrapWords; idx++){
+				fillBuff[idx] = words[idx % patternLen];
 			}
-			//log_debug("PACKED:dataPos:%d;thisTimeTransCnt:%d.", dataPos, thisTimeTransCnt);
-			// 读取block
-			ap->dap->adapter->DapMultiRead(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_DRW, thisTimeTransCnt, data_out + dataPos);
-			dataPos += thisTimeTransCnt;
 		}
-	}else{	// 地址不增 XXX 没测试
-		// 写入TAR
-		ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_TAR_LSB, addr & 0xFFFFFFFFu);
-		if(ap->type.memory.config.largeAddress){
-			ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_TAR_MSB, (addr >> 32) & 0xFFFFFFFFu);
+		if((result = ADIv5_QueueCsw(ap, AddrInc_Single, DataSize_32)) != ADI_SUCCESS){
+			goto EXIT;
+		}
+		for(addrCurr = headEnd; addrCurr < wordEnd; addrCurr = segEnd){
+			segEnd = (addrCurr | (ap->type.memory.tarWrap - 1)) + 1;	// 下一个回绕边界
+			if(segEnd > wordEnd) segEnd = wordEnd;
+			count = (segEnd - addrCurr) >> 2;
+			phase = ((addrCurr - headEnd) >> 2) % patternLen;
+			ADIv5_QueueTar(ap, addrCurr);
+			if(adapter->DapPatternWrite){
+				segPattern[0] = words[phase];
+				segPattern[1] = words[phase ^ 1];
+				adapter->DapPatternWrite(adapter, ADPT_DAP_AP_REG, AP_REG_DRW, count, segPattern, patternLen);
+			}else{
+				adapter->DapMultiWrite(adapter, ADPT_DAP_AP_REG, AP_REG_DRW, count, fillBuff + phase);
+			}
+			sinceCommit += segEnd - addrCurr;
+			if(sinceCommit >= FILL_COMMIT_BYTES){
+				if((result = ADIv5_DapCommit(ap->dap)) != ADI_SUCCESS){
+					goto EXIT;
+				}
+				sinceCommit = 0;
+			}
 		}
-		ap->dap->adapter->DapMultiRead(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_DRW, count, data_out);
 	}
-	// 执行指令队列
-	if(ap->dap->adapter->DapCommit(ap->dap->adapter) != ADPT_SUCCESS){
-		// 清理指令队列
-		ap->dap->adapter->DapCleanPending(ap->dap->adapter);
-		log_error("Execute DAP command failed!");
-		return ADI_ERR_INTERNAL_ERROR;
+	// 结尾不足一个字的部分
+	if(end > wordEnd && wordEnd >= headEnd && (result = fillEdge(ap, wordEnd, end - wordEnd, addr, pattern, patternSize)) != ADI_SUCCESS){
+		goto EXIT;
 	}
-	// 指令执行成功，同步数据到DAP影子寄存器
-	ap->dap->select.regData = selectTmp.regData;
-	ap->type.memory.csw.regData = cswTmp.regData;
-	return ADI_SUCCESS;
+	result = ADIv5_DapCommit(ap->dap);
+EXIT:
+	if(result != ADI_SUCCESS){
+		adapter->DapCleanPending(adapter);
+	}
+	free(fillBuff);
+	ADIv5_CacheInvalidate(ap, addr, len);
+	ADIv5_DeltaForget(ap, addr, len);
+	return result;
 }
 
 /**
- * Block写
+ * 写任意对齐的一段数据
+ * 开头和结尾不足一个字的部分用writeEdge写,中间的字用32位Block写,每WRITE_COMMIT_BYTES提交一次。
+ * data在主机内存中字对齐时直接加入队列,否则分段复制到暂存缓冲区
  */
-static int apBlockWrite(AccessPort self, uint64_t addr, enum addrIncreaseMode mode, enum dataSize size, unsigned int count, uint8_t *data){
+static int apWrite(AccessPort self, uint64_t addr, uint64_t len, const uint8_t *data){
 	assert(self != NULL && data != NULL);
-	uint32_t *data_out = CAST(uint32_t *, data);
 	struct ADIv5_AccessPort *ap = container_of(self, struct ADIv5_AccessPort, apApi);
-	ADIv5_DpSelectRegister selectTmp;
-	ADIv5_ApCswRegister cswTmp;
-	// 检查AP类型
+	uint64_t end = addr + len, headEnd, wordEnd, addrCurr, segEnd;
+	uint32_t *stage = NULL;
+	const uint8_t *src;
+	int result;
 	if(self->type != AccessPort_Memory){
 		log_error("Not a memory access port!");
 		return ADI_ERR_BAD_PARAMETER;
 	}
-	// 初始化本地临时变量
-	selectTmp.regData = ap->dap->select.regData;
-	cswTmp.regData = ap->type.memory.csw.regData;
-	// 选中当前ap
-	selectTmp.regInfo.AP_Sel = ap->index;
-	// 选中当前ap寄存器 bank
-	selectTmp.regInfo.AP_BankSel = 0x0;
-	// some checks
-	switch(size){
-	case DataSize_8:
-		// 检查是否支持less word Transfer
-		if(ap->type.memory.config.lessWordTransfers){	// 支持lessWordTransfer
-			cswTmp.regInfo.Size = AP_CSW_SIZE8;	// Half Word
-		}else{
-			log_warn("Couldn't support less word transfers.");
-			return ADI_ERR_UNSUPPORT;
+	if(len == 0) return ADI_SUCCESS;
+	if((result = ADIv5_WriteBufferFlush(ap, 0, 0)) != ADI_SUCCESS){
+		return result;
+	}
+	headEnd = (addr + 3) & ~0x3ull;
+	if(headEnd > end) headEnd = end;
+	wordEnd = end & ~0x3ull;
+	if(headEnd > addr && (result = writeEdge(ap, addr, headEnd - addr, data)) != ADI_SUCCESS){
+		goto EXIT;
+	}
+	if(wordEnd > headEnd && ((uintptr_t)(data + (headEnd - addr)) & 0x3)){
+		stage = malloc(WRITE_COMMIT_BYTES);
+		if(stage == NULL){
+			log_error("Failed to allocate write buffer!");
+			result = ADI_ERR_INTERNAL_ERROR;
+			goto EXIT;
 		}
-		break;
-	case DataSize_16:
-		// 检查是否对齐
-		if(addr & 0x1){
-			log_warn("Memory address is not half word aligned!");
-			return ADI_ERR_BAD_PARAMETER;
+	}
+	for(addrCurr = headEnd; addrCurr < wordEnd; addrCurr = segEnd){
+		segEnd = wordEnd - addrCurr < WRITE_COMMIT_BYTES ? wordEnd : addrCurr + WRITE_COMMIT_BYTES;
+		src = data + (addrCurr - addr);
+		if(stage){
+			memcpy(stage, src, segEnd - addrCurr);
+			src = CAST(const uint8_t *, stage);
 		}
-		// 检查是否支持less word Transfer
-		if(ap->type.memory.config.lessWordTransfers){	// 支持lessWordTransfer
-			cswTmp.regInfo.Size = AP_CSW_SIZE16;	// Half Word
-		}else{
-			log_warn("Couldn't support less word transfers.");
-			return ADI_ERR_UNSUPPORT;
+		if((result = ADIv5_QueueBlockWrite(ap, addrCurr, AddrInc_Single, DataSize_32, (segEnd - addrCurr) >> 2,
+				CAST(uint32_t *, src))) != ADI_SUCCESS){
+			goto EXIT;
 		}
-		break;
-	case DataSize_32:
-		if(addr & 0x3){
-			log_warn("Memory address is not word aligned!");
-			return ADI_ERR_BAD_PARAMETER;
+		// 结尾的部分和最后一段一起提交
+		if(segEnd < wordEnd && (result = ADIv5_DapCommit(ap->dap)) != ADI_SUCCESS){
+			goto EXIT;
 		}
-		cswTmp.regInfo.Size = AP_CSW_SIZE32;	// Word
-		break;
-	case DataSize_64:
-	case DataSize_128:
-	case DataSize_256:
-	default:
-		log_warn("Specified data size is not support.");
-		return ADI_ERR_UNSUPPORT;
 	}
-	// 地址自增模式
-	switch(mode){
-	case AddrInc_Off: cswTmp.regInfo.AddrInc = AP_CSW_NADDRINC; break;
-	case AddrInc_Single: cswTmp.regInfo.AddrInc = AP_CSW_SADDRINC; break;
-	case AddrInc_Packed: cswTmp.regInfo.AddrInc = AP_CSW_PADDRINC; break;
-	default:
-		log_warn("Specified address increase mode is not support.");
-		return ADI_ERR_UNSUPPORT;
+	if(end > wordEnd && wordEnd >= headEnd && (result = writeEdge(ap, wordEnd, end - wordEnd, data + (wordEnd - addr))) != ADI_SUCCESS){
+		goto EXIT;
 	}
-	// 是否需要更新SELECT寄存器?
-	if(ap->dap->select.regData != selectTmp.regData){
-		ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_DP_REG, DP_REG_SELECT, selectTmp.regData);
-	}
-	// 是否需要更新CSW寄存器？
-	if(ap->type.memory.csw.regData != cswTmp.regData){
-		ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_CSW, cswTmp.regData);
+	result = ADIv5_DapCommit(ap->dap);
+EXIT:
+	if(result != ADI_SUCCESS){
+		ap->dap->adapter->DapCleanPending(ap->dap->adapter);
 	}
+	free(stage);
+	ADIv5_CacheInvalidate(ap, addr, len);
+	ADIv5_DeltaForget(ap, addr, len);
+	return result;
+}
 
-	// 处理地址自增模式下超过1kb边界的情况，超过1kb的边界了需要拆分，每次地址自增控制在1kb以内
-	uint64_t addrCurr = addr, addrEnd;	// 当前地址，结束地址
-	uint64_t addrNextBoundary;	// 地址的下一个1kb边界
-	unsigned int thisTimeTransCnt,dataPos = 0;// 指向data_out的偏移
-
-	if(cswTmp.regInfo.AddrInc == AP_CSW_SADDRINC){
-		addrEnd = addr + (count << cswTmp.regInfo.Size);	// 每次写DRW，发起一次memory access，之后自增TAR
-		while(addrCurr < addrEnd){
-			addrNextBoundary = ((addrCurr >> 10) + 1) << 10;	// 找到下一个1kb边界
-			// 写入TAR
-			ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_TAR_LSB, addrCurr & 0xFFFFFFFFu);
-			if(ap->type.memory.config.largeAddress){
-				ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_TAR_MSB, (addrCurr >> 32) & 0xFFFFFFFFu);
-			}
-			log_debug("SINGLE:CurrAddr:0x%08X;next boundary:0x%08X.", addrCurr, addrNextBoundary);
-			// 如果下一个边界大于结束地址
-			if(addrNextBoundary > addrEnd){
-				thisTimeTransCnt = (addrEnd - addrCurr) >> cswTmp.regInfo.Size;
-				addrCurr = addrEnd;
-			}else{
-				thisTimeTransCnt = (addrNextBoundary - addrCurr) >> cswTmp.regInfo.Size;
-				addrCurr = addrNextBoundary;
-			}
-			//log_debug("SINGLE:dataPos:%d;thisTimeTransCnt:%d.", dataPos, thisTimeTransCnt);
-			// 读取block
-			ap->dap->adapter->DapMultiWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_DRW, thisTimeTransCnt, data_out + dataPos);
-			dataPos += thisTimeTransCnt;
-		}
-	}else if(cswTmp.regInfo.AddrInc == AP_CSW_PADDRINC){
-		addrEnd = addr + (count << 2);	// 每次写DRW，发起多次memory access，每次Memory access成功后自增TAR
-		while(addrCurr < addrEnd){
-			addrNextBoundary = ((addrCurr >> 10) + 1) << 10;	// 找到下一个1kb边界
-			// 写入TAR
-			ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_TAR_LSB, addrCurr & 0xFFFFFFFFu);
-			if(ap->type.memory.config.largeAddress){
-				ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_TAR_MSB, (addrCurr >> 32) & 0xFFFFFFFFu);
-			}
-			//log_debug("PACKED:CurrAddr:0x%08X;next boundary:0x%08X.", addrCurr, addrNextBoundary);
-			// 如果下一个边界大于结束地址
-			if(addrNextBoundary > addrEnd){
-				thisTimeTransCnt = (addrEnd - addrCurr) >> 2;
-				addrCurr = addrEnd;
-			}else{
-				thisTimeTransCnt = (addrNextBoundary - addrCurr) >> 2;
-				addrCurr = addrNextBoundary;
-			}
-			//log_debug("PACKED:dataPos:%d;thisTimeTransCnt:%d.", dataPos, thisTimeTransCnt);
-			// 读取block
-			ap->dap->adapter->DapMultiWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_DRW, thisTimeTransCnt, data_out + dataPos);
-			dataPos += thisTimeTransCnt;
-		}
-	}else{	// 地址不增 XXX 没测试
-		// 写入TAR
-		ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_TAR_LSB, addr & 0xFFFFFFFFu);
-		if(ap->type.memory.config.largeAddress){
-			ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_TAR_MSB, (addr >> 32) & 0xFFFFFFFFu);
-		}
-		ap->dap->adapter->DapMultiWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_DRW, count, data_out);
+/**
+ * 设置Block传输出错恢复策略
+ */
+static int apSetTransferPolicy(AccessPort self, const struct transferPolicy *policy){
+	assert(self != NULL && policy != NULL);
+	struct ADIv5_AccessPort *ap = container_of(self, struct ADIv5_AccessPort, apApi);
+	if(self->type != AccessPort_Memory){
+		log_error("Not a memory access port!");
+		return ADI_ERR_BAD_PARAMETER;
+	}
+	if(policy->skipSize & (policy->skipSize - 1)){
+		log_error("Skip size must be a power of 2!");
+		return ADI_ERR_BAD_PARAMETER;
 	}
-	// 执行指令队列
-	if(ap->dap->adapter->DapCommit(ap->dap->adapter) != ADPT_SUCCESS){
-		// 清理指令队列
-		ap->dap->adapter->DapCleanPending(ap->dap->adapter);
-		log_error("Execute DAP command failed!");
-		return ADI_ERR_INTERNAL_ERROR;
+	ap->type.memory.policy = *policy;
+	return ADI_SUCCESS;
+}
+
+/**
+ * 获得最近一次Block传输的结果
+ */
+static int apGetTransferStatus(AccessPort self, struct transferStatus *status){
+	assert(self != NULL && status != NULL);
+	struct ADIv5_AccessPort *ap = container_of(self, struct ADIv5_AccessPort, apApi);
+	if(self->type != AccessPort_Memory){
+		log_error("Not a memory access port!");
+		return ADI_ERR_BAD_PARAMETER;
 	}
-	// 指令执行成功，同步数据到DAP影子寄存器
-	ap->dap->select.regData = selectTmp.regData;
-	ap->type.memory.csw.regData = cswTmp.regData;
+	*status = ap->type.memory.status;
 	return ADI_SUCCESS;
 }
 
@@ -856,27 +961,14 @@ static int apBlockWrite(AccessPort self, uint64_t addr, enum addrIncreaseMode mo
 static int apReadCSW(AccessPort self, uint32_t *data){
 	assert(self != NULL && data != NULL);
 	struct ADIv5_AccessPort *ap = container_of(self, struct ADIv5_AccessPort, apApi);
-	ADIv5_DpSelectRegister selectTmp;
-	selectTmp.regData = ap->dap->select.regData;
-	// 选中当前ap
-	selectTmp.regInfo.AP_Sel = ap->index;
-	// 选中当前ap寄存器 bank
-	selectTmp.regInfo.AP_BankSel = 0x0;
-	// 是否需要更新SELECT寄存器?
-	if(ap->dap->select.regData != selectTmp.regData){
-		ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_DP_REG, DP_REG_SELECT, selectTmp.regData);
-	}
+	ADIv5_QueueSelect(ap, 0x0);
 	// 读CSW
 	ap->dap->adapter->DapSingleRead(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_CSW, &ap->type.memory.csw.regData);
 	// 执行指令队列
-	if(ap->dap->adapter->DapCommit(ap->dap->adapter) != ADPT_SUCCESS){
-		// 清理指令队列
-		ap->dap->adapter->DapCleanPending(ap->dap->adapter);
-		log_error("Execute DAP command failed!");
+	if(ADIv5_DapCommit(ap->dap) != ADI_SUCCESS){
 		return ADI_ERR_INTERNAL_ERROR;
 	}
-	// 指令执行成功，同步数据到DAP影子寄存器
-	ap->dap->select.regData = selectTmp.regData;
+	ap->type.memory.cswValid = TRUE;
 	*data = ap->type.memory.csw.regData;
 	return ADI_SUCCESS;
 }
@@ -887,28 +979,20 @@ static int apReadCSW(AccessPort self, uint32_t *data){
 static int apWriteCSW(AccessPort self, uint32_t data){
 	assert(self != NULL);
 	struct ADIv5_AccessPort *ap = container_of(self, struct ADIv5_AccessPort, apApi);
-	ADIv5_DpSelectRegister selectTmp;
-	selectTmp.regData = ap->dap->select.regData;
-	// 选中当前ap
-	selectTmp.regInfo.AP_Sel = ap->index;
-	// 选中当前ap寄存器 bank
-	selectTmp.regInfo.AP_BankSel = 0x0;
-	// 是否需要更新SELECT寄存器?
-	if(ap->dap->select.regData != selectTmp.regData){
-		ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_DP_REG, DP_REG_SELECT, selectTmp.regData);
+	// 缓冲区中的写操作必须用原来的CSW设置提交
+	if(ADIv5_WriteBufferFlush(ap, 0, 0) != ADI_SUCCESS){
+		return ADI_ERR_INTERNAL_ERROR;
 	}
+	ADIv5_QueueSelect(ap, 0x0);
 	// 写CSW
 	ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_CSW, data);
+	// 指令执行成功后从硬件读回,只读位和不支持的设置以硬件为准
+	ap->dap->adapter->DapSingleRead(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_CSW, &ap->type.memory.csw.regData);
 	// 执行指令队列
-	if(ap->dap->adapter->DapCommit(ap->dap->adapter) != ADPT_SUCCESS){
-		// 清理指令队列
-		ap->dap->adapter->DapCleanPending(ap->dap->adapter);
-		log_error("Execute DAP command failed!");
+	if(ADIv5_DapCommit(ap->dap) != ADI_SUCCESS){
 		return ADI_ERR_INTERNAL_ERROR;
 	}
-	// 指令执行成功，同步数据到DAP影子寄存器
-	ap->dap->select.regData = selectTmp.regData;
-	ap->type.memory.csw.regData = data;
+	ap->type.memory.cswValid = TRUE;
 	return ADI_SUCCESS;
 }
 
@@ -919,81 +1003,363 @@ static int apAbort(AccessPort self){
 	assert(self != NULL);
 	struct ADIv5_AccessPort *ap = container_of(self, struct ADIv5_AccessPort, apApi);
 	// 写DP Abort
-	ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_DP_REG, DP_REG_ABORT, 0x1);
+	ADIv5_QueueTarget(ap->dap);
+	ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_DP_REG, DP_REG_ABORT, DP_ABORT_DAPABORT);
 	// 执行指令队列
-	if(ap->dap->adapter->DapCommit(ap->dap->adapter) != ADPT_SUCCESS){
-		// 清理指令队列
-		ap->dap->adapter->DapCleanPending(ap->dap->adapter);
-		log_error("Execute DAP command failed!");
-		return ADI_ERR_INTERNAL_ERROR;
+	return ADIv5_DapCommit(ap->dap);
+}
+
+/**
+ * checkApType 检查AP类型是否匹配
+ */
+static int checkApType(ADIv5_ApIdrRegister idr, enum AccessPortType type, enum busType bus){
+	// 检查厂商
+	if(idr.regInfo.JEP106Code != JEP106_CODE_ARM) return ADI_FAILED;
+	if(type == AccessPort_JTAG && idr.regInfo.Class == 0){	// JTAG-AP
+		return ADI_SUCCESS;
+	}else if(type == AccessPort_Memory && idr.regInfo.Class == 0x8){	// 选择MEM-AP
+		if(idr.regInfo.Type == bus){	// 检查总线类型
+			return ADI_SUCCESS;
+		}
 	}
-	return ADI_SUCCESS;
+	return ADI_FAILED;
 }
 
+// 每次提交查询的AP数量
+#define AP_SCAN_BATCH	32
+
+// AP表磁盘缓存
+#define AP_TABLE_CACHE_MAGIC	0x42545041	// "APTB"
+#define AP_TABLE_CACHE_VERSION	3
+#define ROM_CIDR_OFFSET	0xFF0	// ROM Table中CIDR0-3的偏移
+struct apTableCacheHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t dpidr;
+	uint32_t targetId;
+	uint32_t count;
+};
+
 /**
- * fillApConfig 填充AP的配置信息:CSW,CFG
- * 此函数默认AP_BankSel=0xF
+ * 判断AP表项是否是MEM-AP
  */
-static int fillApConfig(struct ADIv5_Dap *dapObj, struct ADIv5_AccessPort *ap){
-	assert(dapObj != NULL);
-	assert(ap != NULL);
-	if(ap->apApi.type == AccessPort_Memory){
-		uint32_t temp = 0, temp_2 = 0;
-		// 读CFG寄存器,并初始化相关标志位
-		dapObj->adapter->DapSingleRead(dapObj->adapter, ADPT_DAP_AP_REG, AP_REG_CFG, &temp);
-		// 读ROM_LSB寄存器
-		dapObj->adapter->DapSingleRead(dapObj->adapter, ADPT_DAP_AP_REG, AP_REG_ROM_LSB, &temp_2);
-		if(dapObj->adapter->DapCommit(dapObj->adapter) != ADPT_SUCCESS){
-			// 清理指令队列
-			ap->dap->adapter->DapCleanPending(ap->dap->adapter);
-			log_error("Read AP register failed!");
+static inline BOOL isMemoryAp(const struct ADIv5_ApInfo *info){
+	ADIv5_ApIdrRegister idr;
+	idr.regData = info->idr;
+	return idr.regInfo.Class == 0x8 ? TRUE : FALSE;
+}
+
+/**
+ * 判断MEM-AP是否有可以访问的ROM Table:AP已使能,并且BASE寄存器指示ROM Table存在
+ */
+static BOOL romTablePresent(const struct ADIv5_ApInfo *info){
+	if(!isMemoryAp(info) || (info->csw & AP_CSW_DEVENABLE) == 0) return FALSE;
+	if(info->rom == 0xFFFFFFFFu || (info->rom & 0x1) == 0) return FALSE;
+	return TRUE;
+}
+
+/**
+ * 根据CFG和BASE寄存器计算ROM Table基址
+ */
+static inline uint64_t romBase(uint32_t cfg, uint32_t romLsb, uint32_t romMsb){
+	return cfg & AP_CFG_LARGE_ADDRESS ? ((uint64_t)romMsb << 32) | romLsb : romLsb;
+}
+
+/**
+ * 清除访问出错后的STICKYERR等错误标志
+ */
+static void clearStickyError(struct ADIv5_Dap *dapObj){
+	ADIv5_QueueTarget(dapObj);
+	dapObj->adapter->DapSingleWrite(dapObj->adapter, ADPT_DAP_DP_REG, DP_REG_ABORT,
+			DP_ABORT_STKCMPCLR | DP_ABORT_STKERRCLR | DP_ABORT_WDERRCLR | DP_ABORT_ORUNERRCLR);
+	ADIv5_DapCommit(dapObj);
+}
+
+/**
+ * readRomCidrs 用一次提交读取AP表中所有ROM Table的CIDR
+ * 读取时临时把CSW设为32位单次自增,读完后恢复为表中的CSW
+ * 参数: table:AP表 count:表项数 cidr:读取到的CIDR,没有ROM Table的AP为0
+ * 返回: 提交失败时清除错误标志,返回ADI_ERR_INTERNAL_ERROR
+ */
+static int readRomCidrs(struct ADIv5_Dap *dapObj, const struct ADIv5_ApInfo *table, unsigned int count, uint32_t *cidr){
+	uint32_t (*raw)[4];
+	ADIv5_DpSelectRegister select;
+	ADIv5_ApCswRegister csw;
+	uint64_t addr;
+	unsigned int idx, pos;
+	BOOL pending = FALSE;
+
+	raw = calloc(count ? count : 1, sizeof(*raw));
+	if(raw == NULL) return ADI_ERR_INTERNAL_ERROR;
+	ADIv5_QueueTarget(dapObj);
+	select.regData = dapObj->select.regData;
+	select.regInfo.AP_BankSel = 0x0;
+	for(idx = 0; idx < count; idx++){
+		if(!romTablePresent(&table[idx])) continue;
+		addr = (table[idx].rom & ~0xFFFull) + ROM_CIDR_OFFSET;
+		select.regInfo.AP_Sel = table[idx].index;
+		dapObj->adapter->DapSingleWrite(dapObj->adapter, ADPT_DAP_DP_REG, DP_REG_SELECT, select.regData);
+		csw.regData = table[idx].csw;
+		csw.regInfo.AddrInc = AP_CSW_SADDRINC;
+		csw.regInfo.Size = AP_CSW_SIZE32;
+		dapObj->adapter->DapSingleWrite(dapObj->adapter, ADPT_DAP_AP_REG, AP_REG_CSW, csw.regData);
+		if(table[idx].cfg & AP_CFG_LARGE_ADDRESS){
+			dapObj->adapter->DapSingleWrite(dapObj->adapter, ADPT_DAP_AP_REG, AP_REG_TAR_MSB, (uint32_t)(addr >> 32));
+		}
+		dapObj->adapter->DapSingleWrite(dapObj->adapter, ADPT_DAP_AP_REG, AP_REG_TAR_LSB, (uint32_t)addr);
+		for(pos = 0; pos < 4; pos++){
+			dapObj->adapter->DapSingleRead(dapObj->adapter, ADPT_DAP_AP_REG, AP_REG_DRW, &raw[idx][pos]);
+		}
+		dapObj->adapter->DapSingleWrite(dapObj->adapter, ADPT_DAP_AP_REG, AP_REG_CSW, table[idx].csw);	// 恢复
+		pending = TRUE;
+	}
+	if(pending){
+		dapObj->select.regData = select.regData;
+		dapObj->selectValid = TRUE;
+		if(ADIv5_DapCommit(dapObj) != ADI_SUCCESS){
+			clearStickyError(dapObj);
+			free(raw);
 			return ADI_ERR_INTERNAL_ERROR;
 		}
-		ap->type.memory.config.largeAddress = !!(temp & AP_CFG_LARGE_ADDRESS);
-		ap->type.memory.config.largeData = !!(temp & AP_CFG_LARGE_DATA);
-		ap->type.memory.config.bigEndian = !!(temp & AP_CFG_BIG_ENDIAN);
-		// 读ROM_MSB寄存器
-		if(ap->type.memory.config.largeAddress){
-			dapObj->adapter->DapSingleRead(dapObj->adapter, ADPT_DAP_AP_REG, AP_REG_ROM_MSB, &temp);
-			if(dapObj->adapter->DapCommit(dapObj->adapter) != ADPT_SUCCESS){
-				// 清理指令队列
-				ap->dap->adapter->DapCleanPending(ap->dap->adapter);
-				log_error("Read AP register failed!");
-				return ADI_ERR_INTERNAL_ERROR;
-			}
-			ap->type.memory.rom = ((uint64_t)temp << 32) | temp_2;
-		}else{
-			ap->type.memory.rom = temp_2;
+	}
+	for(idx = 0; idx < count; idx++){
+		cidr[idx] = 0;
+		if(!romTablePresent(&table[idx])) continue;
+		// CIDR0-3每个寄存器只有低8位有效
+		for(pos = 0; pos < 4; pos++){
+			cidr[idx] |= (raw[idx][pos] & 0xFF) << (pos << 3);
 		}
+	}
+	free(raw);
+	return ADI_SUCCESS;
+}
 
-		// 读CSW寄存器
-		dapObj->select.regInfo.AP_BankSel = 0x0;
-		dapObj->adapter->DapSingleWrite(dapObj->adapter, ADPT_DAP_DP_REG, DP_REG_SELECT, dapObj->select.regData);
-		dapObj->adapter->DapSingleRead(dapObj->adapter, ADPT_DAP_AP_REG, AP_REG_CSW, &ap->type.memory.csw.regData);
-		if(dapObj->adapter->DapCommit(dapObj->adapter) != ADPT_SUCCESS){
-			// 清理指令队列
-			ap->dap->adapter->DapCleanPending(ap->dap->adapter);
-			log_error("Read/Write AP register failed!");
-			return ADI_ERR_INTERNAL_ERROR;
+/**
+ * AP表缓存文件名,以DPIDR和TARGETID作为键值
+ * 返回:FALSE:DPIDR未知,不能使用缓存
+ */
+static BOOL apTableCacheName(struct ADIv5_Dap *dapObj, char *name, size_t size){
+	if(dapObj->idr.regData == 0) return FALSE;
+	snprintf(name, size, "aptable-%08X-%08X.bin", dapObj->idr.regData, dapObj->targetId);
+	return TRUE;
+}
+
+/**
+ * 将AP表写入磁盘缓存
+ */
+static void storeApTableCache(struct ADIv5_Dap *dapObj){
+	char name[64];
+	struct apTableCacheHeader *header;
+	size_t length = sizeof(struct apTableCacheHeader) + dapObj->apCount * sizeof(struct ADIv5_ApInfo);
+	if(apTableCacheName(dapObj, name, sizeof(name)) == FALSE) return;
+	header = malloc(length);
+	if(header == NULL) return;
+	header->magic = AP_TABLE_CACHE_MAGIC;
+	header->version = AP_TABLE_CACHE_VERSION;
+	header->dpidr = dapObj->idr.regData;
+	header->targetId = dapObj->targetId;
+	header->count = dapObj->apCount;
+	memcpy(header + 1, dapObj->apTable, dapObj->apCount * sizeof(struct ADIv5_ApInfo));
+	if(misc_CacheStore(name, header, length) == FALSE){
+		log_debug("Failed to store AP table cache.");
+	}
+	free(header);
+}
+
+/**
+ * 读取磁盘缓存的AP表,并验证:
+ * 第一次提交读取每个AP的IDR,MEM-AP的CFG,ROM_LSB/MSB和CSW,最后一个AP之后的IDR必须为0;
+ * 第二次提交读取ROM Table的CIDR。IDR,CFG,BASE和CIDR必须和缓存一致,CSW以重新读取的为准
+ */
+static int loadApTableCache(struct ADIv5_Dap *dapObj){
+	char name[64];
+	struct apTableCacheHeader *header;
+	struct ADIv5_ApInfo *table;
+	uint32_t idr[ADIv5_MAX_AP_COUNT], endIdr = 0;
+	uint32_t cfg[ADIv5_MAX_AP_COUNT], romLsb[ADIv5_MAX_AP_COUNT], romMsb[ADIv5_MAX_AP_COUNT], cidr[ADIv5_MAX_AP_COUNT];
+	ADIv5_DpSelectRegister select;
+	size_t length;
+	unsigned int idx;
+
+	if(apTableCacheName(dapObj, name, sizeof(name)) == FALSE) return ADI_FAILED;
+	if(misc_CacheLoad(name, (void **)&header, &length) == FALSE) return ADI_FAILED;
+	if(length < sizeof(struct apTableCacheHeader) || header->magic != AP_TABLE_CACHE_MAGIC
+			|| header->version != AP_TABLE_CACHE_VERSION || header->dpidr != dapObj->idr.regData
+			|| header->targetId != dapObj->targetId || header->count > ADIv5_MAX_AP_COUNT
+			|| length != sizeof(struct apTableCacheHeader) + header->count * sizeof(struct ADIv5_ApInfo)){
+		free(header);
+		return ADI_FAILED;
+	}
+	table = calloc(header->count ? header->count : 1, sizeof(struct ADIv5_ApInfo));
+	if(table == NULL){
+		free(header);
+		return ADI_FAILED;
+	}
+	memcpy(table, header + 1, header->count * sizeof(struct ADIv5_ApInfo));
+	// 一次提交验证所有的AP
+	ADIv5_QueueTarget(dapObj);
+	select.regData = dapObj->select.regData;
+	for(idx = 0; idx < header->count; idx++){
+		select.regInfo.AP_Sel = table[idx].index;
+		select.regInfo.AP_BankSel = 0xF;
+		dapObj->adapter->DapSingleWrite(dapObj->adapter, ADPT_DAP_DP_REG, DP_REG_SELECT, select.regData);
+		dapObj->adapter->DapSingleRead(dapObj->adapter, ADPT_DAP_AP_REG, AP_REG_IDR, &idr[idx]);
+		if(isMemoryAp(&table[idx])){
+			dapObj->adapter->DapSingleRead(dapObj->adapter, ADPT_DAP_AP_REG, AP_REG_CFG, &cfg[idx]);
+			dapObj->adapter->DapSingleRead(dapObj->adapter, ADPT_DAP_AP_REG, AP_REG_ROM_LSB, &romLsb[idx]);
+			dapObj->adapter->DapSingleRead(dapObj->adapter, ADPT_DAP_AP_REG, AP_REG_ROM_MSB, &romMsb[idx]);
+			// CSW可能在上次会话中被修改,必须重新读取
+			select.regInfo.AP_BankSel = 0x0;
+			dapObj->adapter->DapSingleWrite(dapObj->adapter, ADPT_DAP_DP_REG, DP_REG_SELECT, select.regData);
+			dapObj->adapter->DapSingleRead(dapObj->adapter, ADPT_DAP_AP_REG, AP_REG_CSW, &table[idx].csw);
 		}
-		// 判断DeviceEn位
-		if((ap->type.memory.csw.regData & AP_CSW_DEVENABLE) == 0){
-			log_warn("This AP is not enabled.");
+	}
+	if(header->count < ADIv5_MAX_AP_COUNT){
+		select.regInfo.AP_Sel = header->count;
+		select.regInfo.AP_BankSel = 0xF;
+		dapObj->adapter->DapSingleWrite(dapObj->adapter, ADPT_DAP_DP_REG, DP_REG_SELECT, select.regData);
+		dapObj->adapter->DapSingleRead(dapObj->adapter, ADPT_DAP_AP_REG, AP_REG_IDR, &endIdr);
+	}
+	dapObj->select.regData = select.regData;
+	dapObj->selectValid = TRUE;
+	if(ADIv5_DapCommit(dapObj) != ADI_SUCCESS){
+		log_error("Validate AP table failed!");
+		free(table);
+		free(header);
+		return ADI_ERR_INTERNAL_ERROR;
+	}
+	for(idx = 0; idx < header->count; idx++){
+		if(idr[idx] != table[idx].idr) break;
+		if(isMemoryAp(&table[idx]) && (cfg[idx] != table[idx].cfg
+				|| romBase(cfg[idx], romLsb[idx], romMsb[idx]) != table[idx].rom)) break;
+	}
+	// BASE一致时再比较ROM Table的CIDR,读取失败同样认为缓存失效
+	if(idx != header->count || endIdr != 0 || readRomCidrs(dapObj, table, header->count, cidr) != ADI_SUCCESS){
+		log_info("AP table cache is out of date.");
+		free(table);
+		free(header);
+		return ADI_FAILED;
+	}
+	for(idx = 0; idx < header->count; idx++){
+		if(cidr[idx] != table[idx].romCidr){
+			log_info("AP table cache is out of date.");
+			free(table);
+			free(header);
 			return ADI_FAILED;
 		}
+	}
+	dapObj->apTable = table;
+	dapObj->apCount = header->count;
+	free(header);
+	log_debug("Load %d APs from AP table cache.", dapObj->apCount);
+	return ADI_SUCCESS;
+}
 
-		temp = ap->type.memory.csw.regData;	// 备份CSW寄存器的初始值
-		// 测试Packed和Less word transfer
-		ap->type.memory.csw.regInfo.AddrInc = AP_CSW_PADDRINC;
-		ap->type.memory.csw.regInfo.Size = AP_CSW_SIZE8;
-		dapObj->adapter->DapSingleWrite(dapObj->adapter, ADPT_DAP_AP_REG, AP_REG_CSW, ap->type.memory.csw.regData);	// 写
-		dapObj->adapter->DapSingleRead(dapObj->adapter, ADPT_DAP_AP_REG, AP_REG_CSW, &ap->type.memory.csw.regData);	// 读
-		if(dapObj->adapter->DapCommit(dapObj->adapter) != ADPT_SUCCESS){
-			// 清理指令队列
-			ap->dap->adapter->DapCleanPending(ap->dap->adapter);
-			log_error("Read/Write AP register failed!");
+/**
+ * scanAccessPorts 枚举所有AP,建立AP表
+ * 每次提交查询AP_SCAN_BATCH个AP的IDR,遇到IDR为0时停止;
+ * 然后用一次提交读取所有MEM-AP的CFG,ROM,CSW,再用一次提交测试所有MEM-AP的Packed和Less word transfer
+ */
+static int scanAccessPorts(struct ADIv5_Dap *dapObj){
+	assert(dapObj != NULL);
+	uint32_t idr[ADIv5_MAX_AP_COUNT];
+	uint32_t romLsb[ADIv5_MAX_AP_COUNT], romMsb[ADIv5_MAX_AP_COUNT], probe[ADIv5_MAX_AP_COUNT];
+	ADIv5_DpSelectRegister select;
+	ADIv5_ApCswRegister csw;
+	struct ADIv5_ApInfo *table;
+	unsigned int base, idx, count = 0;
+	BOOL end = FALSE;
+
+	if(dapObj->apTable != NULL) return ADI_SUCCESS;
+	// 优先使用磁盘缓存
+	if(loadApTableCache(dapObj) == ADI_SUCCESS) return ADI_SUCCESS;
+
+	table = calloc(ADIv5_MAX_AP_COUNT, sizeof(struct ADIv5_ApInfo));
+	if(table == NULL){
+		log_error("Failed to create AP table!");
+		return ADI_ERR_INTERNAL_ERROR;
+	}
+	// 搜索AP:读取IDR
+	select.regData = dapObj->select.regData;
+	select.regInfo.AP_BankSel = 0xF;	// IDR寄存器的Bank
+	for(base = 0; base < ADIv5_MAX_AP_COUNT && end == FALSE; base += AP_SCAN_BATCH){
+		ADIv5_QueueTarget(dapObj);
+		for(idx = base; idx < base + AP_SCAN_BATCH; idx++){
+			// 写SELECT
+			select.regInfo.AP_Sel = idx;
+			dapObj->adapter->DapSingleWrite(dapObj->adapter, ADPT_DAP_DP_REG, DP_REG_SELECT, select.regData);
+			// 读 APIDR
+			dapObj->adapter->DapSingleRead(dapObj->adapter, ADPT_DAP_AP_REG, AP_REG_IDR, &idr[idx]);
+		}
+		dapObj->select.regData = select.regData;
+		dapObj->selectValid = TRUE;
+		if(ADIv5_DapCommit(dapObj) != ADI_SUCCESS){
+			log_error("Read AP IDR register failed!");
+			free(table);
 			return ADI_ERR_INTERNAL_ERROR;
 		}
+		for(idx = base; idx < base + AP_SCAN_BATCH; idx++){
+			// 检查AP是否存在
+			if(idr[idx] == 0){
+				end = TRUE;
+				break;
+			}
+			log_debug("AP[%d] IDR: 0x%08X.", idx, idr[idx]);
+			table[count].index = idx;
+			table[count].idr = idr[idx];
+			count++;
+		}
+	}
+
+	// 读取所有MEM-AP的CFG,ROM和CSW寄存器
+	ADIv5_QueueTarget(dapObj);
+	for(idx = 0; idx < count; idx++){
+		if(!isMemoryAp(&table[idx])) continue;
+		select.regInfo.AP_Sel = table[idx].index;
+		select.regInfo.AP_BankSel = 0xF;
+		dapObj->adapter->DapSingleWrite(dapObj->adapter, ADPT_DAP_DP_REG, DP_REG_SELECT, select.regData);
+		dapObj->adapter->DapSingleRead(dapObj->adapter, ADPT_DAP_AP_REG, AP_REG_CFG, &table[idx].cfg);
+		dapObj->adapter->DapSingleRead(dapObj->adapter, ADPT_DAP_AP_REG, AP_REG_ROM_LSB, &romLsb[idx]);
+		// 不支持Large Address时ROM_MSB是RES0
+		dapObj->adapter->DapSingleRead(dapObj->adapter, ADPT_DAP_AP_REG, AP_REG_ROM_MSB, &romMsb[idx]);
+		select.regInfo.AP_BankSel = 0x0;
+		dapObj->adapter->DapSingleWrite(dapObj->adapter, ADPT_DAP_DP_REG, DP_REG_SELECT, select.regData);
+		dapObj->adapter->DapSingleRead(dapObj->adapter, ADPT_DAP_AP_REG, AP_REG_CSW, &table[idx].csw);
+	}
+	dapObj->select.regData = select.regData;
+	dapObj->selectValid = TRUE;
+	if(ADIv5_DapCommit(dapObj) != ADI_SUCCESS){
+		log_error("Read AP register failed!");
+		free(table);
+		return ADI_ERR_INTERNAL_ERROR;
+	}
+
+	// 测试Packed和Less word transfer,测试完成后恢复CSW
+	// 没有使能的AP不能写CSW,跳过测试,按只支持字传输处理
+	ADIv5_QueueTarget(dapObj);
+	for(idx = 0; idx < count; idx++){
+		if(!isMemoryAp(&table[idx])) continue;
+		table[idx].rom = romBase(table[idx].cfg, romLsb[idx], romMsb[idx]);
+		if((table[idx].csw & AP_CSW_DEVENABLE) == 0) continue;
+		select.regInfo.AP_Sel = table[idx].index;
+		dapObj->adapter->DapSingleWrite(dapObj->adapter, ADPT_DAP_DP_REG, DP_REG_SELECT, select.regData);
+		csw.regData = table[idx].csw;
+		csw.regInfo.AddrInc = AP_CSW_PADDRINC;
+		csw.regInfo.Size = AP_CSW_SIZE8;
+		dapObj->adapter->DapSingleWrite(dapObj->adapter, ADPT_DAP_AP_REG, AP_REG_CSW, csw.regData);	// 写
+		dapObj->adapter->DapSingleRead(dapObj->adapter, ADPT_DAP_AP_REG, AP_REG_CSW, &probe[idx]);	// 读
+		dapObj->adapter->DapSingleWrite(dapObj->adapter, ADPT_DAP_AP_REG, AP_REG_CSW, table[idx].csw);	// 恢复
+	}
+	dapObj->select.regData = select.regData;
+	dapObj->selectValid = TRUE;
+	if(ADIv5_DapCommit(dapObj) != ADI_SUCCESS){
+		log_error("Read/Write AP register failed!");
+		free(table);
+		return ADI_ERR_INTERNAL_ERROR;
+	}
+	for(idx = 0; idx < count; idx++){
+		if(!isMemoryAp(&table[idx]) || (table[idx].csw & AP_CSW_DEVENABLE) == 0) continue;
+		csw.regData = probe[idx];
 		/**
 		 * ARM ID080813
 		 * 第7-133
@@ -1003,69 +1369,129 @@ static int fillApConfig(struct ADIv5_Dap *dapObj, struct ADIv5_AccessPort *ap){
 		 * If the MEM-AP Large Data Extention is not supported, then when a MEM-AP implementation supports different
 		 * sized access, it MUST support word, halfword and byte accesses.
 		 */
-		if(ap->type.memory.csw.regInfo.AddrInc == AP_CSW_PADDRINC){
-			ap->type.memory.config.packedTransfers = 1;
-			ap->type.memory.config.lessWordTransfers = 1;
+		if(csw.regInfo.AddrInc == AP_CSW_PADDRINC){
+			table[idx].packedTransfers = 1;
+			table[idx].lessWordTransfers = 1;
 		}else{
-			ap->type.memory.config.lessWordTransfers = ap->type.memory.csw.regInfo.Size == AP_CSW_SIZE8 ? 1 : 0;
+			table[idx].lessWordTransfers = csw.regInfo.Size == AP_CSW_SIZE8 ? 1 : 0;
 		}
-
-		ap->type.memory.csw.regData = temp;	// 恢复CSW记录的数据
-		dapObj->adapter->DapSingleWrite(dapObj->adapter, ADPT_DAP_AP_REG, AP_REG_CSW, ap->type.memory.csw.regData);	// 写
-		if(dapObj->adapter->DapCommit(dapObj->adapter) != ADPT_SUCCESS){
-			// 清理指令队列
-			ap->dap->adapter->DapCleanPending(ap->dap->adapter);
-			log_error("Read/Write AP register failed!");
-			return ADI_ERR_INTERNAL_ERROR;
+	}
+	// 读取ROM Table的CIDR,用于下次连接时验证缓存;一起读取失败时逐个读取
+	if(readRomCidrs(dapObj, table, count, probe) != ADI_SUCCESS){
+		for(idx = 0; idx < count; idx++){
+			if(readRomCidrs(dapObj, &table[idx], 1, &probe[idx]) != ADI_SUCCESS){
+				log_warn("Read ROM Table CIDR of AP[%d] failed!", table[idx].index);
+				probe[idx] = 0;
+			}
 		}
-		return ADI_SUCCESS;
-	}else {
-		// TODO 增加JTAG相关的初始化
-		return ADI_ERR_UNSUPPORT;
 	}
+	for(idx = 0; idx < count; idx++){
+		table[idx].romCidr = probe[idx];
+	}
+	dapObj->apTable = table;
+	dapObj->apCount = count;
+	log_debug("Found %d APs.", count);
+	storeApTableCache(dapObj);
+	return ADI_SUCCESS;
 }
 
 /**
- * checkApType 检查AP类型是否匹配
+ * 指定TAR地址自增的回绕大小,0恢复为默认的1KB
  */
-static int checkApType(ADIv5_ApIdrRegister idr, enum AccessPortType type, enum busType bus){
-	// 检查厂商
-	if(idr.regInfo.JEP106Code != JEP106_CODE_ARM) return ADI_FAILED;
-	if(type == AccessPort_JTAG && idr.regInfo.Class == 0){	// JTAG-AP
-		return ADI_SUCCESS;
-	}else if(type == AccessPort_Memory && idr.regInfo.Class == 0x8){	// 选择MEM-AP
-		if(idr.regInfo.Type == bus){	// 检查总线类型
-			return ADI_SUCCESS;
-		}
+static int apSetTarWrap(AccessPort self, unsigned int wrap){
+	assert(self != NULL);
+	struct ADIv5_AccessPort *ap = container_of(self, struct ADIv5_AccessPort, apApi);
+	if(self->type != AccessPort_Memory){
+		log_error("Not a memory access port!");
+		return ADI_ERR_BAD_PARAMETER;
 	}
-	return ADI_FAILED;
+	if(wrap == 0) wrap = TAR_WRAP_MIN;
+	if(wrap < TAR_WRAP_MIN || wrap > TAR_WRAP_MAX || (wrap & (wrap - 1))){
+		log_error("TAR wrap size must be a power of 2 between %u and %u!", TAR_WRAP_MIN, TAR_WRAP_MAX);
+		return ADI_ERR_BAD_PARAMETER;
+	}
+	ap->type.memory.tarWrap = wrap;
+	return ADI_SUCCESS;
 }
 
 /**
- * findAP
+ * 探测TAR地址自增的回绕大小
+ * 从1KB开始,每次在区域内找一个回绕候选值的奇数倍地址作为边界,从边界前一个字开始连续读两个字,再读回TAR:
+ * TAR越过了边界说明回绕大小大于候选值,否则回绕大小就是候选值。只读不写,区域必须是可以安全读取的内存
+ * 结果只保存在AP对象中,不写入AP表缓存
  */
-static int findAP(DAP self, enum AccessPortType type, enum busType bus, AccessPort* apOut){
-	assert(self != NULL);
-	struct ADIv5_AccessPort *ap, *ap_t = NULL;
-	struct ADIv5_Dap *dapObj = container_of(self, struct ADIv5_Dap, dapApi);
-	// 先在链表中搜索,如果没有,则尝试创建新的AP,插入链表
-	list_for_each_entry(ap, &dapObj->apList, list_entry){
-		if(checkApType(ap->idr, type, bus) == ADI_SUCCESS){
-			*apOut = &ap->apApi;
-			return ADI_SUCCESS;
+static int apProbeTarWrap(AccessPort self, uint64_t addr, uint64_t size, unsigned int *wrap){
+	assert(self != NULL && wrap != NULL);
+	struct ADIv5_AccessPort *ap = container_of(self, struct ADIv5_AccessPort, apApi);
+	Adapter adapter;
+	uint64_t end = addr + size, boundary;
+	uint32_t data[2], tar;
+	unsigned int step, found = TAR_WRAP_MIN;
+	int result;
+	if(self->type != AccessPort_Memory){
+		log_error("Not a memory access port!");
+		return ADI_ERR_BAD_PARAMETER;
+	}
+	adapter = ap->dap->adapter;
+	if((result = ADIv5_WriteBufferFlush(ap, addr, size)) != ADI_SUCCESS){
+		return result;
+	}
+	for(step = TAR_WRAP_MIN; step < TAR_WRAP_MAX; step <<= 1){
+		boundary = (addr + 4 + step - 1) & ~(uint64_t)(step - 1);
+		if((boundary / step & 0x1) == 0) boundary += step;
+		if(boundary + 4 > end){
+			log_warn("Probe region is too small, TAR wrap size is at least %u bytes.", found);
+			break;
 		}
+		if((result = ADIv5_QueueCsw(ap, AddrInc_Single, DataSize_32)) != ADI_SUCCESS){
+			return result;
+		}
+		ADIv5_QueueTar(ap, boundary - 4);
+		adapter->DapMultiRead(adapter, ADPT_DAP_AP_REG, AP_REG_DRW, 2, data);
+		adapter->DapSingleRead(adapter, ADPT_DAP_AP_REG, AP_REG_TAR_LSB, &tar);
+		if((result = ADIv5_DapCommit(ap->dap)) != ADI_SUCCESS){
+			return result;
+		}
+		if(tar != (uint32_t)(boundary + 4)){
+			found = step;
+			break;
+		}
+		found = step << 1;
 	}
-	// 新建AccessPort对象
-	ap_t = calloc(1, sizeof(struct ADIv5_AccessPort));
+	log_info("AP[%u] TAR wrap size: %u bytes.", ap->index, found);
+	ap->type.memory.tarWrap = found;
+	*wrap = found;
+	return ADI_SUCCESS;
+}
+
+/**
+ * 根据AP表项创建AccessPort对象
+ */
+static struct ADIv5_AccessPort *createAccessPort(struct ADIv5_Dap *dapObj, const struct ADIv5_ApInfo *info, enum AccessPortType type){
+	struct ADIv5_AccessPort *ap_t = calloc(1, sizeof(struct ADIv5_AccessPort));
 	if(ap_t == NULL){
 		log_error("Failed to create AccessPort object!");
-		return ADI_ERR_INTERNAL_ERROR;
+		return NULL;
 	}
 	// 设置接口类型
 	INTERFACE_CONST_INIT(enum AccessPortType, ap_t->apApi.type, type);
 	ap_t->dap = dapObj;
+	ap_t->index = info->index;
+	ap_t->idr.regData = info->idr;
 	switch(type){
 	case AccessPort_Memory:
+		ap_t->type.memory.csw.regData = info->csw;
+		ap_t->type.memory.cswValid = TRUE;
+		ap_t->type.memory.rom = info->rom;
+		ap_t->type.memory.config.largeAddress = !!(info->cfg & AP_CFG_LARGE_ADDRESS);
+		ap_t->type.memory.config.largeData = !!(info->cfg & AP_CFG_LARGE_DATA);
+		ap_t->type.memory.config.bigEndian = !!(info->cfg & AP_CFG_BIG_ENDIAN);
+		ap_t->type.memory.config.packedTransfers = info->packedTransfers;
+		ap_t->type.memory.config.lessWordTransfers = info->lessWordTransfers;
+		ap_t->type.memory.tarWrap = TAR_WRAP_MIN;	// 回绕大小只在本次会话有效,需要时用ProbeTarWrap重新探测
+		// 初始化接口的ROM Table常量
+		INTERFACE_CONST_INIT(uint64_t, ap_t->apApi.Interface.Memory.RomTableBase, ap_t->type.memory.rom);
+
 		ap_t->apApi.Interface.Memory.ReadCSW = apReadCSW;
 		ap_t->apApi.Interface.Memory.WriteCSW = apWriteCSW;
 		ap_t->apApi.Interface.Memory.Abort = apAbort;
@@ -1081,6 +1507,34 @@ static int findAP(DAP self, enum AccessPortType type, enum busType bus, AccessPo
 		ap_t->apApi.Interface.Memory.Write32 = apWrite32;
 		ap_t->apApi.Interface.Memory.Write64 = apWrite64;
 		ap_t->apApi.Interface.Memory.BlockWrite = apBlockWrite;
+
+		ap_t->type.memory.policy.retries = TRANSFER_DEFAULT_RETRIES;
+		ap_t->type.memory.policy.backoff = TRANSFER_DEFAULT_BACKOFF;
+		ap_t->apApi.Interface.Memory.SetTransferPolicy = apSetTransferPolicy;
+		ap_t->apApi.Interface.Memory.GetTransferStatus = apGetTransferStatus;
+		ap_t->apApi.Interface.Memory.ConfigCache = ADIv5_ConfigCache;
+		ap_t->apApi.Interface.Memory.AddCacheRegion = ADIv5_AddCacheRegion;
+		ap_t->apApi.Interface.Memory.InvalidateCache = ADIv5_InvalidateCache;
+		ap_t->apApi.Interface.Memory.GetCacheStats = ADIv5_GetCacheStats;
+		ap_t->apApi.Interface.Memory.WriteCombine = ADIv5_WriteCombine;
+		ap_t->apApi.Interface.Memory.FlushWrites = ADIv5_FlushWrites;
+		ap_t->apApi.Interface.Memory.AddDeviceRegion = ADIv5_AddDeviceRegion;
+		ap_t->apApi.Interface.Memory.Verify = ADIv5_Verify;
+		ap_t->apApi.Interface.Memory.Search = ADIv5_Search;
+		ap_t->apApi.Interface.Memory.Scan = ADIv5_Scan;
+		ap_t->apApi.Interface.Memory.Fill = apFill;
+		ap_t->apApi.Interface.Memory.Write = apWrite;
+		ap_t->apApi.Interface.Memory.LoadImage = ADIv5_LoadImage;
+		ap_t->apApi.Interface.Memory.DeltaWrite = ADIv5_DeltaWrite;
+		ap_t->apApi.Interface.Memory.Dump = ADIv5_Dump;
+		ap_t->apApi.Interface.Memory.WaitValue = apWaitValue;
+		ap_t->apApi.Interface.Memory.SetTarWrap = apSetTarWrap;
+		ap_t->apApi.Interface.Memory.ProbeTarWrap = apProbeTarWrap;
+		ap_t->apApi.Interface.Memory.ReadMany = ADIv5_ReadMany;
+		ap_t->apApi.Interface.Memory.WriteMany = ADIv5_WriteMany;
+		ap_t->apApi.Interface.Memory.PrepareRead = ADIv5_PrepareRead;
+		ap_t->apApi.Interface.Memory.RunProgram = ADIv5_RunProgram;
+		ap_t->apApi.Interface.Memory.FreeProgram = ADIv5_FreeProgram;
 		break;
 	case AccessPort_JTAG:
 		// TODO 设置接口
@@ -1088,54 +1542,99 @@ static int findAP(DAP self, enum AccessPortType type, enum busType bus, AccessPo
 	default:
 		log_error("Unknow AP type!");
 		free(ap_t);
-		return ADI_ERR_BAD_PARAMETER;
+		return NULL;
 	}
+	return ap_t;
+}
 
-	// 搜索AP
-	dapObj->select.regInfo.AP_BankSel = 0xF;	// IDR寄存器的Bank
-	for(ap_t->index=0; ap_t->index<256; ap_t->index++){
-		// 写SELECT
-		dapObj->select.regInfo.AP_Sel = ap_t->index;
-		dapObj->adapter->DapSingleWrite(dapObj->adapter, ADPT_DAP_DP_REG, DP_REG_SELECT, dapObj->select.regData);
-		// 读 APIDR
-		dapObj->adapter->DapSingleRead(dapObj->adapter, ADPT_DAP_AP_REG, AP_REG_IDR, &ap_t->idr.regData);
-		if(dapObj->adapter->DapCommit(dapObj->adapter) != ADPT_SUCCESS){
-			// 清理指令队列
-			ap->dap->adapter->DapCleanPending(ap->dap->adapter);
-			log_error("Read AP IDR register failed!");
-			free(ap_t);
-			return ADI_ERR_INTERNAL_ERROR;
-		}
-		// 检查AP是否存在
-		if(ap_t->idr.regData == 0){
-			log_warn("Arrive at the end of the AP list!");
-			free(ap_t);
-			return ADI_FAILED;
+/**
+ * findAP
+ */
+static int findAP(DAP self, enum AccessPortType type, enum busType bus, AccessPort* apOut){
+	assert(self != NULL);
+	struct ADIv5_AccessPort *ap, *ap_t = NULL;
+	struct ADIv5_Dap *dapObj = container_of(self, struct ADIv5_Dap, dapApi);
+	ADIv5_ApIdrRegister idr;
+	unsigned int idx;
+	if(type != AccessPort_Memory && type != AccessPort_JTAG){
+		log_error("Unknow AP type!");
+		return ADI_ERR_BAD_PARAMETER;
+	}
+	// 先在链表中搜索,如果没有,则在AP表中查找,创建新的AP,插入链表
+	list_for_each_entry(ap, &dapObj->apList, list_entry){
+		if(checkApType(ap->idr, type, bus) == ADI_SUCCESS){
+			*apOut = &ap->apApi;
+			return ADI_SUCCESS;
 		}
-		log_debug("AP[%d] IDR: 0x%08X.", ap_t->index, ap_t->idr.regData);
+	}
+	// 建立AP表
+	if(scanAccessPorts(dapObj) != ADI_SUCCESS){
+		return ADI_ERR_INTERNAL_ERROR;
+	}
+	for(idx = 0; idx < dapObj->apCount; idx++){
+		idr.regData = dapObj->apTable[idx].idr;
 		// 检查AP类型
-		if(checkApType(ap_t->idr, type, bus) != ADI_SUCCESS){
+		if(checkApType(idr, type, bus) != ADI_SUCCESS){
 			continue;
 		}
-		// 填充AccessPort对象数据
-		if(fillApConfig(dapObj, ap_t) == ADI_SUCCESS){
-			// 初始化接口的ROM Table常量
-			INTERFACE_CONST_INIT(uint64_t, ap_t->apApi.Interface.Memory.RomTableBase, ap_t->type.memory.rom);
-			// 插入AccessPort链表
-			list_add_tail(&ap_t->list_entry, &dapObj->apList);
-			*apOut = (AccessPort)&ap_t->apApi;
-			return ADI_SUCCESS;
-		}else{
-			free(ap_t);
+		// 判断DeviceEn位
+		if(type == AccessPort_Memory && (dapObj->apTable[idx].csw & AP_CSW_DEVENABLE) == 0){
+			log_warn("AP[%d] is not enabled.", dapObj->apTable[idx].index);
+			continue;
+		}
+		ap_t = createAccessPort(dapObj, &dapObj->apTable[idx], type);
+		if(ap_t == NULL){
 			return ADI_ERR_INTERNAL_ERROR;
 		}
+		// 插入AccessPort链表
+		list_add_tail(&ap_t->list_entry, &dapObj->apList);
+		*apOut = (AccessPort)&ap_t->apApi;
+		return ADI_SUCCESS;
 	}
-	free(ap_t);
+	log_warn("Arrive at the end of the AP list!");
 	return ADI_FAILED;
 }
 
+/**
+ * ADIv5_GetMemoryAp 按索引取得MEM-AP对象,链表中没有时从AP表中创建
+ */
+int ADIv5_GetMemoryAp(struct ADIv5_Dap *dapObj, unsigned int index, struct ADIv5_AccessPort **apOut){
+	assert(dapObj != NULL && apOut != NULL);
+	struct ADIv5_AccessPort *ap;
+	unsigned int idx;
+	list_for_each_entry(ap, &dapObj->apList, list_entry){
+		if(ap->index == index && ap->apApi.type == AccessPort_Memory){
+			*apOut = ap;
+			return ADI_SUCCESS;
+		}
+	}
+	if(scanAccessPorts(dapObj) != ADI_SUCCESS){
+		return ADI_ERR_INTERNAL_ERROR;
+	}
+	for(idx = 0; idx < dapObj->apCount; idx++){
+		if(dapObj->apTable[idx].index != index) continue;
+		if(!isMemoryAp(&dapObj->apTable[idx])){
+			log_error("AP[%u] is not a memory access port!", index);
+			return ADI_ERR_BAD_PARAMETER;
+		}
+		if((dapObj->apTable[idx].csw & AP_CSW_DEVENABLE) == 0){
+			log_warn("AP[%u] is not enabled.", index);
+			return ADI_FAILED;
+		}
+		ap = createAccessPort(dapObj, &dapObj->apTable[idx], AccessPort_Memory);
+		if(ap == NULL){
+			return ADI_ERR_INTERNAL_ERROR;
+		}
+		list_add_tail(&ap->list_entry, &dapObj->apList);
+		*apOut = ap;
+		return ADI_SUCCESS;
+	}
+	log_error("AP[%u] does not exist!", index);
+	return ADI_ERR_BAD_PARAMETER;
+}
+
 // 创建DAP对象
-DAP ADIv5_CreateDap(Adapter adapter){
+static DAP createDap(Adapter adapter, BOOL multidrop, uint32_t targetSel){
 	assert(adapter != NULL);
 	struct ADIv5_Dap *dap = calloc(1, sizeof(struct ADIv5_Dap));
 	if(!dap){
@@ -1144,7 +1643,15 @@ DAP ADIv5_CreateDap(Adapter adapter){
 	}
 	INIT_LIST_HEAD(&dap->apList);
 	dap->adapter = adapter;
+	dap->multidrop = multidrop;
+	dap->targetSel = targetSel;
 	dap->dapApi.FindAccessPort = findAP;
+	dap->dapApi.ReadRomTable = ADIv5_ReadRomTable;
+	dap->dapApi.AddMemoryRegion = ADIv5_AddMemoryRegion;
+	dap->dapApi.ClearMemoryMap = ADIv5_ClearMemoryMap;
+	dap->dapApi.PlanAccess = ADIv5_PlanAccess;
+	dap->dapApi.ReadMemory = ADIv5_ReadMemory;
+	dap->dapApi.WriteMemory = ADIv5_WriteMemory;
 	// 初始化DAP对象
 	if(dapInit(dap) != ADI_SUCCESS){
 		free(dap);
@@ -1154,6 +1661,20 @@ DAP ADIv5_CreateDap(Adapter adapter){
 	return (DAP)&dap->dapApi;
 }
 
+DAP ADIv5_CreateDap(Adapter adapter){
+	return createDap(adapter, FALSE, 0);
+}
+
+// 创建multi-drop目标的DAP对象
+DAP ADIv5_CreateMultidropDap(Adapter adapter, uint32_t targetSel){
+	assert(adapter != NULL);
+	if(adapter->DapSelectTarget == NULL){
+		log_error("The adapter does not support SWD multi-drop!");
+		return NULL;
+	}
+	return createDap(adapter, TRUE, targetSel);
+}
+
 // DestoryDap 销毁Dap对象
 void ADIv5_DestoryDap(DAP *self){
 	assert(self != NULL);
@@ -1163,8 +1684,17 @@ void ADIv5_DestoryDap(DAP *self){
 	// 释放链表
 	list_for_each_entry_safe(ap, ap_t, &dapObj->apList, list_entry){
 		list_del(&ap->list_entry);	// 将链表中删除
+		if(ap->apApi.type == AccessPort_Memory){
+			ADIv5_FreeRomTable(ap->type.memory.romTable);
+			ADIv5_WriteBufferFlush(ap, 0, 0);
+			ADIv5_FreeWriteBuffer(ap->type.memory.writeBuffer);
+			ADIv5_FreeCache(ap->type.memory.cache);
+			ADIv5_FreeDeltaRecord(ap->type.memory.deltaRecord);
+		}
 		free(ap);
 	}
+	free(dapObj->apTable);
+	free(dapObj->memoryMap);
 	free(dapObj);
 	*self = NULL;
 }
@@ -1174,36 +1704,27 @@ void ADIv5_DestoryDap(DAP *self){
  */
 int ADIv5_ReadCidPid(AccessPort self, uint64_t componentBase, uint32_t *cid, uint64_t *pid){
 	assert(self != NULL && cid != NULL && pid != NULL);
-	jmp_buf exception;
+	struct ADIv5_AccessPort *ap = container_of(self, struct ADIv5_AccessPort, apApi);
+	uint32_t ids[12];	// PID4-7,PID0-3,CID0-3
+	unsigned int idx;
 	if((componentBase & 0xFFF) != 0) {
 		log_warn("Component base address is not 4KB aligned!");
 		return ADI_ERR_BAD_PARAMETER;
 	}
-
 	*cid = 0; *pid = 0;
-	uint32_t cid0, cid1, cid2, cid3;
-	uint32_t pid0, pid1, pid2, pid3, pid4;	// XXX pid5-7全是0，所以不用读
-	// 错误处理
-	switch(setjmp(exception)){
-	case 1: log_error("DAP_ReadMem32:Read Component ID Failed!"); return ADI_FAILED;
-	case 2: log_error("DAP_ReadMem32:Read Peripheral ID Failed!"); return ADI_FAILED;
-	case 3: log_error("DAP_Execute:Failed!"); return ADI_FAILED;
-	default: log_error("Unknow Error."); return ADI_FAILED;
-	case 0:break;
-	}
-	// 读取Component ID
-	if(apRead32(self, componentBase + 0xFF0, &cid0) != ADI_SUCCESS) longjmp(exception, 1);
-	if(apRead32(self, componentBase + 0xFF4, &cid1) != ADI_SUCCESS) longjmp(exception, 1);
-	if(apRead32(self, componentBase + 0xFF8, &cid2) != ADI_SUCCESS) longjmp(exception, 1);
-	if(apRead32(self, componentBase + 0xFFC, &cid3) != ADI_SUCCESS) longjmp(exception, 1);
-	// 读取Peripheral ID
-	if(apRead32(self, componentBase + 0xFE0, &pid0) != ADI_SUCCESS) longjmp(exception, 2);
-	if(apRead32(self, componentBase + 0xFE4, &pid1) != ADI_SUCCESS) longjmp(exception, 2);
-	if(apRead32(self, componentBase + 0xFE8, &pid2) != ADI_SUCCESS) longjmp(exception, 2);
-	if(apRead32(self, componentBase + 0xFEC, &pid3) != ADI_SUCCESS) longjmp(exception, 2);
-	if(apRead32(self, componentBase + 0xFD0, &pid4) != ADI_SUCCESS) longjmp(exception, 2);
-
-	*cid = (cid3 & 0xff) << 24 | (cid2 & 0xff) << 16 | (cid1 & 0xff) << 8 | (cid0 & 0xff);
-	*pid = (uint64_t)(pid4 & 0xff) << 32 | (pid3 & 0xff) << 24 | (pid2 & 0xff) << 16 | (pid1 & 0xff) << 8 | (pid0 & 0xff);
+	// 0xFD0-0xFFC在一次提交中读取
+	if(ADIv5_QueueBlockRead(ap, componentBase + 0xFD0, AddrInc_Single, DataSize_32, 12, ids) != ADI_SUCCESS){
+		ap->dap->adapter->DapCleanPending(ap->dap->adapter);
+		return ADI_FAILED;
+	}
+	if(ADIv5_DapCommit(ap->dap) != ADI_SUCCESS){
+		log_error("Read Component ID and Peripheral ID Failed!");
+		return ADI_FAILED;
+	}
+	for(idx = 0; idx < 4; idx++){
+		*cid |= (ids[8 + idx] & 0xff) << (idx << 3);
+		*pid |= (uint64_t)(ids[4 + idx] & 0xff) << (idx << 3);
+		*pid |= (uint64_t)(ids[idx] & 0xff) << ((idx + 4) << 3);
+	}
 	return ADI_SUCCESS;
 }
@@ -0,0 +1,361 @@
+/*
+ * ADIv5_batch.c
+ *
+ *  Created on: 2019-6-30
+ *      Author: virusv
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "smart_ocd.h"
+#include "misc/log.h"
+#include "misc/misc.h"
+
+#include "arch/ARM/ADI/ADIv5_private.h"
+
+/**
+ * 批量读写不连续的地址
+ * 寄存器转储之类的操作会访问几十上百个零散的地址,逐个调用Read32/Write32每次都要提交一次。
+ * 这里把所有访问加入同一个指令队列,一次提交,由Adapter打包成尽量少的数据包。
+ * CSW设置为地址单次自增,上一次访问之后TAR正好指向下一项地址时省略写TAR,
+ * 连续的寄存器只需要读写DRW
+ */
+
+/**
+ * 获得MEM-AP对象
+ */
+static struct ADIv5_AccessPort *memoryAp(AccessPort apApi){
+	assert(apApi != NULL);
+	if(apApi->type != AccessPort_Memory){
+		log_error("Not a memory access port!");
+		return NULL;
+	}
+	return container_of(apApi, struct ADIv5_AccessPort, apApi);
+}
+
+// 每一项读到的DRW数据
+struct readSlot {
+	uint32_t drw[2];	// 64位访问读两次DRW,第一次是低位
+	BOOL cached;	// 命中缓存,不需要访问目标
+};
+
+/**
+ * 检查每一项的宽度和对齐,并提交写合并缓冲区中和它们重叠的写操作
+ * 写合并缓冲区提交时会执行指令队列,所以必须在加入访问之前完成
+ */
+static int prepareAccess(struct ADIv5_AccessPort *ap, const struct memoryAccess *access, unsigned int count){
+	unsigned int idx;
+	int result;
+	for(idx = 0; idx < count; idx++){
+		if(access[idx].size > DataSize_64){
+			log_warn("Specified data size is not support.");
+			return ADI_ERR_UNSUPPORT;
+		}
+		if(access[idx].addr & ((1u << access[idx].size) - 1)){
+			log_warn("Memory address 0x%" PRIX64 " is not aligned to the transfer size!", access[idx].addr);
+			return ADI_ERR_BAD_PARAMETER;
+		}
+		if((result = ADIv5_WriteBufferFlush(ap, access[idx].addr, 1u << access[idx].size)) != ADI_SUCCESS){
+			return result;
+		}
+	}
+	return ADI_SUCCESS;
+}
+
+/**
+ * 设置CSW,TAR没有自增到addr时写TAR
+ * 参数:
+ * 	tarNext:上一次访问之后TAR的值,访问之后更新
+ * 	tarValid:tarNext是否有效
+ */
+static int queueAddress(struct ADIv5_AccessPort *ap, uint64_t addr, enum dataSize size, uint64_t *tarNext, BOOL *tarValid){
+	int result;
+	if((result = ADIv5_QueueCsw(ap, AddrInc_Single, size)) != ADI_SUCCESS){
+		return result;
+	}
+	// TAR只保证在回绕大小以内自增
+	if(!*tarValid || *tarNext != addr || (addr & (ap->type.memory.tarWrap - 1)) == 0){
+		ADIv5_QueueTar(ap, addr);
+	}
+	*tarNext = addr + (1u << size);
+	*tarValid = TRUE;
+	return ADI_SUCCESS;
+}
+
+/**
+ * 把一项的DRW读加入队列,64位访问读两次DRW,第一次是低位
+ * 返回: Adapter无法加入队列时返回ADI_ERR_INTERNAL_ERROR,由调用者清理队列
+ */
+static int queueDrwRead(struct ADIv5_AccessPort *ap, enum dataSize size, uint32_t *drw){
+	Adapter adapter = ap->dap->adapter;
+	if(adapter->DapSingleRead(adapter, ADPT_DAP_AP_REG, AP_REG_DRW, &drw[0]) != ADPT_SUCCESS){
+		return ADI_ERR_INTERNAL_ERROR;
+	}
+	if(size == DataSize_64 && adapter->DapSingleRead(adapter, ADPT_DAP_AP_REG, AP_REG_DRW, &drw[1]) != ADPT_SUCCESS){
+		return ADI_ERR_INTERNAL_ERROR;
+	}
+	return ADI_SUCCESS;
+}
+
+/**
+ * 把一项的DRW写加入队列,返回值同queueDrwRead
+ */
+static int queueDrwWrite(struct ADIv5_AccessPort *ap, const struct memoryAccess *access){
+	Adapter adapter = ap->dap->adapter;
+	if(access->size == DataSize_64){
+		if(adapter->DapSingleWrite(adapter, ADPT_DAP_AP_REG, AP_REG_DRW, access->data & 0xFFFFFFFFu) != ADPT_SUCCESS
+				|| adapter->DapSingleWrite(adapter, ADPT_DAP_AP_REG, AP_REG_DRW, access->data >> 32) != ADPT_SUCCESS){
+			return ADI_ERR_INTERNAL_ERROR;
+		}
+	}else if(adapter->DapSingleWrite(adapter, ADPT_DAP_AP_REG, AP_REG_DRW,
+			(uint32_t)(access->data << ((access->addr & 3) << 3))) != ADPT_SUCCESS){	// 根据byte lane放置数据
+		return ADI_ERR_INTERNAL_ERROR;
+	}
+	return ADI_SUCCESS;
+}
+
+/**
+ * ADIv5_ReadMany 批量读取
+ * 命中缓存的项不访问目标
+ */
+int ADIv5_ReadMany(AccessPort apApi, struct memoryAccess *access, unsigned int count){
+	struct ADIv5_AccessPort *ap = memoryAp(apApi);
+	struct readSlot *slots;
+	uint8_t bytes[8];
+	uint64_t tarNext = 0;
+	BOOL tarValid = FALSE;
+	unsigned int idx, i;
+	int result;
+	if(ap == NULL || (access == NULL && count > 0)) return ADI_ERR_BAD_PARAMETER;
+	if(count == 0) return ADI_SUCCESS;
+	if((result = prepareAccess(ap, access, count)) != ADI_SUCCESS){
+		return result;
+	}
+	slots = calloc(count, sizeof(struct readSlot));
+	if(slots == NULL){
+		log_error("Failed to allocate read buffer.");
+		return ADI_ERR_INTERNAL_ERROR;
+	}
+	for(idx = 0; idx < count; idx++){
+		if(ap->type.memory.cache && ADIv5_CacheRead(ap, access[idx].addr, 1u << access[idx].size, bytes)){
+			for(access[idx].data = 0, i = 0; i < (1u << access[idx].size); i++){
+				access[idx].data |= (uint64_t)bytes[i] << (i << 3);
+			}
+			slots[idx].cached = TRUE;
+			continue;
+		}
+		if((result = queueAddress(ap, access[idx].addr, access[idx].size, &tarNext, &tarValid)) != ADI_SUCCESS
+				|| (result = queueDrwRead(ap, access[idx].size, slots[idx].drw)) != ADI_SUCCESS){
+			// 清理已经加入队列的访问
+			ADIv5_DapInvalidate(ap->dap);
+			free(slots);
+			return result;
+		}
+	}
+	// 提交失败时ADIv5_DapCommit清理队列
+	if(tarValid && (result = ADIv5_DapCommit(ap->dap)) != ADI_SUCCESS){
+		free(slots);
+		return result;
+	}
+	for(idx = 0; idx < count; idx++){
+		if(slots[idx].cached) continue;
+		switch(access[idx].size){
+		case DataSize_64:
+			access[idx].data = ((uint64_t)slots[idx].drw[1] << 32) | slots[idx].drw[0];
+			break;
+		case DataSize_32:
+			access[idx].data = slots[idx].drw[0];
+			break;
+		default:	// 根据byte lane获得数据
+			access[idx].data = (slots[idx].drw[0] >> ((access[idx].addr & 3) << 3)) & ((1u << (8u << access[idx].size)) - 1);
+			break;
+		}
+	}
+	free(slots);
+	return ADI_SUCCESS;
+}
+
+/**
+ * ADIv5_WriteMany 批量写入
+ * 不经过写合并缓冲区,提交之后更新缓存和增量写入记录
+ */
+int ADIv5_WriteMany(AccessPort apApi, const struct memoryAccess *access, unsigned int count){
+	struct ADIv5_AccessPort *ap = memoryAp(apApi);
+	uint8_t bytes[8];
+	uint64_t tarNext = 0;
+	BOOL tarValid = FALSE;
+	unsigned int idx, i;
+	int result;
+	if(ap == NULL || (access == NULL && count > 0)) return ADI_ERR_BAD_PARAMETER;
+	if(count == 0) return ADI_SUCCESS;
+	if((result = prepareAccess(ap, access, count)) != ADI_SUCCESS){
+		return result;
+	}
+	for(idx = 0; idx < count; idx++){
+		if((result = queueAddress(ap, access[idx].addr, access[idx].size, &tarNext, &tarValid)) != ADI_SUCCESS
+				|| (result = queueDrwWrite(ap, &access[idx])) != ADI_SUCCESS){
+			// 清理已经加入队列的访问,不能只写入一部分
+			ADIv5_DapInvalidate(ap->dap);
+			return result;
+		}
+	}
+	// 提交失败时ADIv5_DapCommit清理队列
+	result = ADIv5_DapCommit(ap->dap);
+	for(idx = 0; idx < count; idx++){
+		ADIv5_DeltaForget(ap, access[idx].addr, 1u << access[idx].size);
+		if(!ap->type.memory.cache) continue;
+		// 写失败时目标内存的状态不确定,使缓存行失效
+		if(result == ADI_SUCCESS){
+			for(i = 0; i < (1u << access[idx].size); i++){
+				bytes[i] = (access[idx].data >> (i << 3)) & 0xff;
+			}
+			ADIv5_CacheWrite(ap, access[idx].addr, 1u << access[idx].size, bytes);
+		}else{
+			ADIv5_CacheInvalidate(ap, access[idx].addr, 1u << access[idx].size);
+		}
+	}
+	return result;
+}
+
+/**
+ * 预编译的批量读程序
+ * 编译时SELECT和CSW的影子寄存器设为无效,程序开头总是写SELECT和CSW,不依赖执行时的状态;
+ * 执行成功后影子寄存器更新为程序结束时的值
+ */
+struct memProgram {
+	DapProgram program;	// Adapter编译的程序
+	struct memoryAccess *access;	// 编译时的地址和宽度
+	unsigned int count;	// 项数
+	uint32_t *reads;	// 程序读到的DRW数据
+	uint32_t select;	// 程序结束时的SELECT
+	uint32_t csw;	// 程序结束时的CSW
+};
+
+/**
+ * ADIv5_FreeProgram 释放预编译的批量读程序
+ */
+void ADIv5_FreeProgram(AccessPort apApi, MemProgram program){
+	struct ADIv5_AccessPort *ap = memoryAp(apApi);
+	if(program == NULL) return;
+	if(ap && program->program){
+		ap->dap->adapter->DapFreeProgram(ap->dap->adapter, program->program);
+	}
+	free(program->access);
+	free(program->reads);
+	free(program);
+}
+
+/**
+ * ADIv5_PrepareRead 编译批量读程序
+ */
+int ADIv5_PrepareRead(AccessPort apApi, const struct memoryAccess *access, unsigned int count, MemProgram *programOut){
+	struct ADIv5_AccessPort *ap = memoryAp(apApi);
+	struct memProgram *program;
+	uint64_t tarNext = 0;
+	BOOL tarValid = FALSE;
+	unsigned int idx, readCount;
+	uint32_t discard[2];
+	int result;
+	if(ap == NULL || access == NULL || count == 0 || programOut == NULL) return ADI_ERR_BAD_PARAMETER;
+	if(ap->dap->adapter->DapPrepare == NULL || ap->dap->multidrop){
+		log_warn("Prepared programs are not supported by this adapter or in multi-drop mode.");
+		return ADI_ERR_UNSUPPORT;
+	}
+	if((result = prepareAccess(ap, access, count)) != ADI_SUCCESS){
+		return result;
+	}
+	program = calloc(1, sizeof(struct memProgram));
+	if(program == NULL){
+		log_error("Failed to create a memory program object.");
+		return ADI_ERR_INTERNAL_ERROR;
+	}
+	program->count = count;
+	program->access = malloc(count * sizeof(struct memoryAccess));
+	if(program->access == NULL){
+		log_error("Failed to allocate memory program buffer.");
+		free(program);
+		return ADI_ERR_INTERNAL_ERROR;
+	}
+	memcpy(program->access, access, count * sizeof(struct memoryAccess));
+	// 程序执行时不知道SELECT和CSW的状态,强制写入
+	ap->dap->selectValid = FALSE;
+	ap->type.memory.cswValid = FALSE;
+	for(idx = 0; idx < count; idx++){
+		if((result = queueAddress(ap, access[idx].addr, access[idx].size, &tarNext, &tarValid)) != ADI_SUCCESS){
+			ADIv5_DapInvalidate(ap->dap);
+			ADIv5_FreeProgram(apApi, program);
+			return result;
+		}
+		// 读到的数据在执行时放入reads,这里的地址不会被使用
+		if((result = queueDrwRead(ap, access[idx].size, discard)) != ADI_SUCCESS){
+			ADIv5_DapInvalidate(ap->dap);
+			ADIv5_FreeProgram(apApi, program);
+			return result;
+		}
+	}
+	program->select = ap->dap->select.regData;
+	program->csw = ap->type.memory.csw.regData;
+	result = ap->dap->adapter->DapPrepare(ap->dap->adapter, &program->program, &readCount, NULL);
+	// 队列中的操作没有执行,硬件状态未知
+	ADIv5_DapInvalidate(ap->dap);
+	if(result != ADPT_SUCCESS){
+		program->program = NULL;
+		ADIv5_FreeProgram(apApi, program);
+		return result == ADPT_ERR_UNSUPPORT ? ADI_ERR_UNSUPPORT : ADI_ERR_INTERNAL_ERROR;
+	}
+	program->reads = calloc(readCount ? readCount : 1, sizeof(uint32_t));
+	if(program->reads == NULL){
+		log_error("Failed to allocate memory program buffer.");
+		ADIv5_FreeProgram(apApi, program);
+		return ADI_ERR_INTERNAL_ERROR;
+	}
+	*programOut = program;
+	return ADI_SUCCESS;
+}
+
+/**
+ * ADIv5_RunProgram 执行预编译的批量读程序
+ */
+int ADIv5_RunProgram(AccessPort apApi, MemProgram program, struct memoryAccess *access){
+	struct ADIv5_AccessPort *ap = memoryAp(apApi);
+	unsigned int idx, pos = 0;
+	uint64_t data;
+	int result;
+	if(ap == NULL || program == NULL || access == NULL) return ADI_ERR_BAD_PARAMETER;
+	// 写合并缓冲区中有重叠的写操作时先提交
+	if(ap->type.memory.writeBuffer){
+		for(idx = 0; idx < program->count; idx++){
+			if((result = ADIv5_WriteBufferFlush(ap, program->access[idx].addr, 1u << program->access[idx].size)) != ADI_SUCCESS){
+				return result;
+			}
+		}
+	}
+	if(ap->dap->adapter->DapRunProgram(ap->dap->adapter, program->program, NULL, program->reads) != ADPT_SUCCESS){
+		ADIv5_DapInvalidate(ap->dap);
+		log_error("Execute memory program failed!");
+		return ADI_ERR_INTERNAL_ERROR;
+	}
+	ap->dap->select.regData = program->select;
+	ap->dap->selectValid = TRUE;
+	ap->type.memory.csw.regData = program->csw;
+	ap->type.memory.cswValid = TRUE;
+	for(idx = 0; idx < program->count; idx++){
+		switch(program->access[idx].size){
+		case DataSize_64:
+			data = ((uint64_t)program->reads[pos + 1] << 32) | program->reads[pos];
+			pos += 2;
+			break;
+		case DataSize_32:
+			data = program->reads[pos++];
+			break;
+		default:	// 根据byte lane获得数据
+			data = (program->reads[pos++] >> ((program->access[idx].addr & 3) << 3)) & ((1u << (8u << program->access[idx].size)) - 1);
+			break;
+		}
+		access[idx].addr = program->access[idx].addr;
+		access[idx].size = program->access[idx].size;
+		access[idx].data = data;
+	}
+	return ADI_SUCCESS;
+}
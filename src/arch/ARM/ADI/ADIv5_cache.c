@@ -0,0 +1,361 @@
+/*
+ * ADIv5_cache.c
+ *
+ *  Created on: 2019-6-18
+ *      Author: virusv
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "smart_ocd.h"
+#include "misc/log.h"
+#include "misc/misc.h"
+
+#include "arch/ARM/ADI/ADIv5_private.h"
+
+/**
+ * 主机端内存缓存
+ * 组相联结构,每组CACHE_WAYS行,组内按最近使用时间替换
+ * 未命中的缓存行用32位Block读填充,一次访问缺失的所有缓存行在同一次提交中读取
+ * 缓存行不会跨越1KB边界,所以每个缓存行只需要写一次TAR
+ */
+#define CACHE_WAYS				4
+#define CACHE_MIN_LINE_SIZE		4
+#define CACHE_MAX_LINE_SIZE		1024
+// 一次访问最多经过缓存的行数,更大的访问直接发到目标上,避免冲刷缓存
+#define CACHE_MAX_ACCESS_LINES	256
+
+struct cacheLine {
+	uint64_t tag;	// 缓存行的起始地址
+	uint64_t lastUse;	// 最近一次使用的时间戳
+	BOOL valid;
+};
+
+struct cacheRegion {
+	uint64_t base;
+	uint64_t size;
+	enum cachePolicy policy;
+};
+
+struct ADIv5_Cache {
+	unsigned int lineSize;
+	unsigned int lineShift;	// log2(lineSize)
+	unsigned int lineCount;
+	unsigned int setCount;	// lineCount / CACHE_WAYS
+	uint64_t clock;	// LRU时间戳
+	struct cacheLine *lines;
+	uint32_t *data;	// 缓存行数据,lineCount * lineSize字节
+	struct cacheRegion *regions;
+	unsigned int regionCount;
+	struct cacheStats stats;
+};
+
+// 获得缓存行的数据
+#define LINE_DATA(cache,line) (CAST(uint8_t *, (cache)->data) + ((size_t)((line) - (cache)->lines) << (cache)->lineShift))
+
+/**
+ * 查找地址所在的区域策略,后添加的区域优先
+ * [start, end)必须完全在同一个区域内,否则按不缓存处理
+ */
+static enum cachePolicy findPolicy(struct ADIv5_Cache *cache, uint64_t start, uint64_t end){
+	unsigned int idx;
+	for(idx = cache->regionCount; idx > 0; idx--){
+		struct cacheRegion *region = &cache->regions[idx - 1];
+		if(start >= region->base ? start - region->base >= region->size : end <= region->base){
+			continue;	// 没有重叠
+		}
+		// 部分重叠按不缓存处理
+		if(start < region->base || end - region->base > region->size){
+			return CachePolicy_Uncached;
+		}
+		return region->policy;
+	}
+	return CachePolicy_Uncached;
+}
+
+/**
+ * 查找缓存行,没有命中返回NULL
+ */
+static struct cacheLine *lookupLine(struct ADIv5_Cache *cache, uint64_t tag){
+	struct cacheLine *set = &cache->lines[((tag >> cache->lineShift) % cache->setCount) * CACHE_WAYS];
+	int way;
+	for(way = 0; way < CACHE_WAYS; way++){
+		if(set[way].valid && set[way].tag == tag){
+			return &set[way];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * 在组内选出要替换的缓存行:优先使用无效的行,否则替换最久没有使用的行
+ */
+static struct cacheLine *victimLine(struct ADIv5_Cache *cache, uint64_t tag){
+	struct cacheLine *set = &cache->lines[((tag >> cache->lineShift) % cache->setCount) * CACHE_WAYS];
+	struct cacheLine *victim = &set[0];
+	int way;
+	for(way = 0; way < CACHE_WAYS; way++){
+		if(!set[way].valid){
+			return &set[way];
+		}
+		if(set[way].lastUse < victim->lastUse){
+			victim = &set[way];
+		}
+	}
+	cache->stats.evictions++;
+	victim->valid = FALSE;
+	return victim;
+}
+
+/**
+ * ADIv5_CacheRead 从缓存中读取数据,缺失的缓存行从目标填充
+ * 参数:
+ * 	ap:MEM-AP对象
+ * 	addr:起始地址
+ * 	len:读取的字节数
+ * 	data:数据存放地址
+ * 返回:
+ * 	TRUE:数据已经从缓存中读出;FALSE:该地址不可缓存或者填充失败,调用者需要直接访问目标
+ */
+BOOL ADIv5_CacheRead(struct ADIv5_AccessPort *ap, uint64_t addr, unsigned int len, uint8_t *data){
+	assert(ap != NULL && data != NULL);
+	struct ADIv5_Cache *cache = ap->type.memory.cache;
+	struct cacheLine *line, *filling[CACHE_MAX_ACCESS_LINES];
+	uint64_t start, end, tag;
+	unsigned int fillCount = 0, idx, offset, copyLen;
+
+	if(cache == NULL || len == 0) return FALSE;
+	start = addr & ~(uint64_t)(cache->lineSize - 1);
+	end = (addr + len + cache->lineSize - 1) & ~(uint64_t)(cache->lineSize - 1);
+	// 访问的缓存行数不能超过组数,否则同一次访问会把自己填充的缓存行替换出去
+	if(end <= start || ((end - start) >> cache->lineShift) > cache->setCount
+			|| ((end - start) >> cache->lineShift) > CACHE_MAX_ACCESS_LINES
+			|| findPolicy(cache, start, end) == CachePolicy_Uncached){
+		cache->stats.bypass++;
+		return FALSE;
+	}
+	// 把所有缺失的缓存行加入队列
+	for(tag = start; tag < end; tag += cache->lineSize){
+		if(lookupLine(cache, tag) != NULL){
+			cache->stats.hits++;
+			continue;
+		}
+		cache->stats.misses++;
+		line = victimLine(cache, tag);
+		line->tag = tag;
+		if(ADIv5_QueueBlockRead(ap, tag, AddrInc_Single, DataSize_32, cache->lineSize >> 2,
+				CAST(uint32_t *, LINE_DATA(cache, line))) != ADI_SUCCESS){
+			ap->dap->adapter->DapCleanPending(ap->dap->adapter);
+			return FALSE;
+		}
+		filling[fillCount++] = line;
+	}
+	if(fillCount > 0){
+		cache->stats.fills++;
+		// 填充失败时让调用者直接访问,由Block传输的出错恢复处理
+		if(ADIv5_DapCommit(ap->dap) != ADI_SUCCESS){
+			log_debug("Cache fill 0x%" PRIX64 "-0x%" PRIX64 " failed.", start, end);
+			return FALSE;
+		}
+		for(idx = 0; idx < fillCount; idx++){
+			filling[idx]->valid = TRUE;
+		}
+	}
+	// 复制数据
+	cache->clock++;
+	while(len > 0){
+		tag = addr & ~(uint64_t)(cache->lineSize - 1);
+		line = lookupLine(cache, tag);
+		assert(line != NULL);
+		line->lastUse = cache->clock;
+		offset = addr - tag;
+		copyLen = len < cache->lineSize - offset ? len : cache->lineSize - offset;
+		memcpy(data, LINE_DATA(cache, line) + offset, copyLen);
+		data += copyLen;
+		addr += copyLen;
+		len -= copyLen;
+	}
+	return TRUE;
+}
+
+/**
+ * ADIv5_CacheWrite 写入目标成功后更新缓存
+ * 写直达区域更新已经缓存的行(不分配新的缓存行),只读区域使对应的行失效
+ */
+void ADIv5_CacheWrite(struct ADIv5_AccessPort *ap, uint64_t addr, unsigned int len, const uint8_t *data){
+	assert(ap != NULL && data != NULL);
+	struct ADIv5_Cache *cache = ap->type.memory.cache;
+	struct cacheLine *line;
+	uint64_t tag;
+	unsigned int offset, copyLen;
+	if(cache == NULL || len == 0) return;
+	if(findPolicy(cache, addr, addr + len) != CachePolicy_WriteThrough){
+		ADIv5_CacheInvalidate(ap, addr, len);
+		return;
+	}
+	while(len > 0){
+		tag = addr & ~(uint64_t)(cache->lineSize - 1);
+		offset = addr - tag;
+		copyLen = len < cache->lineSize - offset ? len : cache->lineSize - offset;
+		if((line = lookupLine(cache, tag)) != NULL){
+			memcpy(LINE_DATA(cache, line) + offset, data, copyLen);
+		}
+		data += copyLen;
+		addr += copyLen;
+		len -= copyLen;
+	}
+}
+
+/**
+ * ADIv5_CacheInvalidate 使一段地址的缓存行失效
+ * len为0时使全部缓存行失效
+ */
+void ADIv5_CacheInvalidate(struct ADIv5_AccessPort *ap, uint64_t addr, uint64_t len){
+	assert(ap != NULL);
+	struct ADIv5_Cache *cache = ap->type.memory.cache;
+	struct cacheLine *line;
+	uint64_t tag, end;
+	unsigned int idx;
+	if(cache == NULL) return;
+	end = addr + len;
+	// 范围比缓存大时直接遍历所有缓存行
+	if(len == 0 || end < addr || (len >> cache->lineShift) >= cache->lineCount){
+		for(idx = 0; idx < cache->lineCount; idx++){
+			line = &cache->lines[idx];
+			if(len == 0 || (line->tag + cache->lineSize > addr && line->tag < end)){
+				line->valid = FALSE;
+			}
+		}
+		return;
+	}
+	for(tag = addr & ~(uint64_t)(cache->lineSize - 1); tag < end; tag += cache->lineSize){
+		if((line = lookupLine(cache, tag)) != NULL){
+			line->valid = FALSE;
+		}
+	}
+}
+
+/**
+ * ADIv5_FreeCache 释放缓存
+ */
+void ADIv5_FreeCache(struct ADIv5_Cache *cache){
+	if(cache == NULL) return;
+	free(cache->lines);
+	free(cache->data);
+	free(cache->regions);
+	free(cache);
+}
+
+/**
+ * 获得MEM-AP对象
+ */
+static struct ADIv5_AccessPort *memoryAp(AccessPort apApi){
+	assert(apApi != NULL);
+	if(apApi->type != AccessPort_Memory){
+		log_error("Not a memory access port!");
+		return NULL;
+	}
+	return container_of(apApi, struct ADIv5_AccessPort, apApi);
+}
+
+/**
+ * ADIv5_ConfigCache 配置缓存
+ * 重新配置会丢弃所有缓存行,但保留区域策略
+ */
+int ADIv5_ConfigCache(AccessPort apApi, unsigned int lineSize, unsigned int lineCount){
+	struct ADIv5_AccessPort *ap = memoryAp(apApi);
+	struct ADIv5_Cache *cache;
+	if(ap == NULL) return ADI_ERR_BAD_PARAMETER;
+	cache = ap->type.memory.cache;
+	if(lineCount == 0){
+		ADIv5_FreeCache(cache);
+		ap->type.memory.cache = NULL;
+		return ADI_SUCCESS;
+	}
+	if(lineSize < CACHE_MIN_LINE_SIZE || lineSize > CACHE_MAX_LINE_SIZE || (lineSize & (lineSize - 1))){
+		log_error("Cache line size must be a power of 2 between %d and %d!", CACHE_MIN_LINE_SIZE, CACHE_MAX_LINE_SIZE);
+		return ADI_ERR_BAD_PARAMETER;
+	}
+	// 行数取整到组数的整数倍
+	lineCount = (lineCount + CACHE_WAYS - 1) / CACHE_WAYS * CACHE_WAYS;
+	if(cache == NULL){
+		cache = calloc(1, sizeof(struct ADIv5_Cache));
+		if(cache == NULL){
+			log_error("Failed to allocate cache object!");
+			return ADI_ERR_INTERNAL_ERROR;
+		}
+		ap->type.memory.cache = cache;
+	}else{
+		free(cache->lines);
+		free(cache->data);
+	}
+	cache->lines = calloc(lineCount, sizeof(struct cacheLine));
+	cache->data = malloc((size_t)lineCount * lineSize);
+	if(cache->lines == NULL || cache->data == NULL){
+		log_error("Failed to allocate cache lines!");
+		ADIv5_FreeCache(cache);
+		ap->type.memory.cache = NULL;
+		return ADI_ERR_INTERNAL_ERROR;
+	}
+	cache->lineSize = lineSize;
+	for(cache->lineShift = 0; (1u << cache->lineShift) < lineSize; cache->lineShift++);
+	cache->lineCount = lineCount;
+	cache->setCount = lineCount / CACHE_WAYS;
+	return ADI_SUCCESS;
+}
+
+/**
+ * ADIv5_AddCacheRegion 设置区域策略
+ * 区域内已经缓存的行会失效
+ */
+int ADIv5_AddCacheRegion(AccessPort apApi, uint64_t base, uint64_t size, enum cachePolicy policy){
+	struct ADIv5_AccessPort *ap = memoryAp(apApi);
+	struct ADIv5_Cache *cache;
+	struct cacheRegion *regions;
+	if(ap == NULL) return ADI_ERR_BAD_PARAMETER;
+	if((cache = ap->type.memory.cache) == NULL){
+		log_error("Cache is not enabled!");
+		return ADI_ERR_BAD_PARAMETER;
+	}
+	if(size == 0 || policy > CachePolicy_WriteThrough){
+		return ADI_ERR_BAD_PARAMETER;
+	}
+	regions = realloc(cache->regions, (cache->regionCount + 1) * sizeof(struct cacheRegion));
+	if(regions == NULL){
+		log_error("Failed to allocate cache region!");
+		return ADI_ERR_INTERNAL_ERROR;
+	}
+	regions[cache->regionCount].base = base;
+	regions[cache->regionCount].size = size;
+	regions[cache->regionCount].policy = policy;
+	cache->regions = regions;
+	cache->regionCount++;
+	ADIv5_CacheInvalidate(ap, base, size);
+	return ADI_SUCCESS;
+}
+
+/**
+ * ADIv5_InvalidateCache 使缓存失效
+ */
+int ADIv5_InvalidateCache(AccessPort apApi, uint64_t addr, uint64_t size){
+	struct ADIv5_AccessPort *ap = memoryAp(apApi);
+	if(ap == NULL) return ADI_ERR_BAD_PARAMETER;
+	ADIv5_CacheInvalidate(ap, addr, size);
+	return ADI_SUCCESS;
+}
+
+/**
+ * ADIv5_GetCacheStats 获得缓存统计
+ */
+int ADIv5_GetCacheStats(AccessPort apApi, struct cacheStats *stats){
+	assert(stats != NULL);
+	struct ADIv5_AccessPort *ap = memoryAp(apApi);
+	if(ap == NULL) return ADI_ERR_BAD_PARAMETER;
+	if(ap->type.memory.cache == NULL){
+		memset(stats, 0x0, sizeof(struct cacheStats));
+	}else{
+		*stats = ap->type.memory.cache->stats;
+	}
+	return ADI_SUCCESS;
+}
@@ -0,0 +1,327 @@
+/*
+ * ADIv5_delta.c
+ *
+ *  Created on: 2019-6-25
+ *      Author: virusv
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "smart_ocd.h"
+#include "misc/log.h"
+#include "misc/misc.h"
+
+#include "arch/ARM/ADI/ADIv5_private.h"
+
+/**
+ * 增量写入
+ * 数据按DELTA_WINDOW_SIZE大小的窗口处理,每个窗口找出和比较对象不同的字节,
+ * 间隔小于DELTA_MERGE_GAP的不同部分合并,扩展到字对齐后用32位Block写写出。
+ * 从目标比较时,当前窗口的写操作和下一个窗口的读操作在同一次提交中完成
+ * 主机端记录按DELTA_BLOCK_SIZE大小的块记录是否有效,其他写操作使重叠的块失效
+ */
+#define DELTA_WINDOW_SIZE		(64u << 10)
+#define DELTA_MERGE_GAP			32u		// 重新设置TAR的开销大约是这么多字节
+#define DELTA_BLOCK_SHIFT		8
+#define DELTA_BLOCK_SIZE		(1u << DELTA_BLOCK_SHIFT)
+#define DELTA_STAGE_EXTRA		6u		// 开头和结尾各最多3个不对齐的字节
+
+struct ADIv5_DeltaRecord {
+	struct ADIv5_DeltaRecord *next;
+	uint64_t base;
+	uint64_t len;
+	uint8_t *data;
+	uint8_t *valid;	// 每位对应一个块,置位表示记录和目标一致
+};
+
+void ADIv5_FreeDeltaRecord(struct ADIv5_DeltaRecord *record){
+	struct ADIv5_DeltaRecord *next;
+	for(; record; record = next){
+		next = record->next;
+		free(record->data);
+		free(record->valid);
+		free(record);
+	}
+}
+
+/**
+ * ADIv5_DeltaForget 目标内存被其他写操作修改,使记录中重叠的块失效
+ */
+void ADIv5_DeltaForget(struct ADIv5_AccessPort *ap, uint64_t addr, uint64_t len){
+	struct ADIv5_DeltaRecord *record;
+	uint64_t start, end, block;
+	for(record = ap->type.memory.deltaRecord; record; record = record->next){
+		start = addr > record->base ? addr : record->base;
+		end = addr + len < record->base + record->len ? addr + len : record->base + record->len;
+		if(start >= end) continue;
+		for(block = (start - record->base) >> DELTA_BLOCK_SHIFT; block <= (end - 1 - record->base) >> DELTA_BLOCK_SHIFT; block++){
+			record->valid[block >> 3] &= ~(1u << (block & 0x7));
+		}
+	}
+}
+
+/**
+ * 删除和[addr, addr+len)重叠的记录,返回起始地址是addr的记录
+ */
+static struct ADIv5_DeltaRecord *takeRecord(struct ADIv5_AccessPort *ap, uint64_t addr, uint64_t len){
+	struct ADIv5_DeltaRecord **link = &ap->type.memory.deltaRecord, *record, *found = NULL;
+	while((record = *link) != NULL){
+		if(record->base < addr + len && addr < record->base + record->len){
+			*link = record->next;
+			record->next = NULL;
+			if(found == NULL && record->base == addr){
+				found = record;
+			}else{
+				ADIv5_FreeDeltaRecord(record);
+			}
+		}else{
+			link = &record->next;
+		}
+	}
+	return found;
+}
+
+/**
+ * 用记录生成比较数据,记录中无效或者不存在的部分取数据的反码,保证被写入
+ * 参数:
+ * 	offset:窗口相对于addr的偏移
+ */
+static void recordReference(struct ADIv5_DeltaRecord *record, const uint8_t *data, uint64_t offset, unsigned int size, uint8_t *ref){
+	unsigned int idx;
+	uint64_t pos;
+	for(idx = 0; idx < size; idx++){
+		pos = offset + idx;
+		if(record && pos < record->len && (record->valid[pos >> (DELTA_BLOCK_SHIFT + 3)] & (1u << ((pos >> DELTA_BLOCK_SHIFT) & 0x7)))){
+			ref[idx] = record->data[pos];
+		}else{
+			ref[idx] = ~data[pos];
+		}
+	}
+}
+
+/**
+ * 把数据开头或结尾不对齐的字节加入写队列,[start, end)在同一个字内
+ * 支持less word transfer时逐字节用8位写;只支持字传输时读出这个字,合并后用32位写,
+ * 读之前会提交队列中已有的操作,顺序不变
+ * 参数:
+ * 	stage,staged:同queueDiff,每个字节或者合并后的字占一个字
+ */
+static int queueBytes(struct ADIv5_AccessPort *ap, uint64_t start, uint64_t end, const uint8_t *data, uint32_t *stage, unsigned int *staged){
+	uint32_t *slot = stage + *staged;
+	uint64_t pos;
+	int result;
+	if(ap->type.memory.config.lessWordTransfers){
+		// 根据byte lane放置数据
+		for(pos = start; pos < end; pos++){
+			slot[pos - start] = (uint32_t)data[pos - start] << ((pos & 0x3) << 3);
+		}
+		if((result = ADIv5_QueueBlockWrite(ap, start, AddrInc_Single, DataSize_8, (unsigned int)(end - start), slot)) != ADI_SUCCESS){
+			return result;
+		}
+		*staged += (unsigned int)(end - start);
+		return ADI_SUCCESS;
+	}
+	if((result = ADIv5_QueueBlockRead(ap, start & ~0x3ull, AddrInc_Single, DataSize_32, 1, slot)) != ADI_SUCCESS){
+		return result;
+	}
+	if((result = ADIv5_DapCommit(ap->dap)) != ADI_SUCCESS){
+		return result;
+	}
+	for(pos = start; pos < end; pos++){
+		*slot &= ~(0xFFu << ((pos & 0x3) << 3));
+		*slot |= (uint32_t)data[pos - start] << ((pos & 0x3) << 3);
+	}
+	if((result = ADIv5_QueueBlockWrite(ap, start & ~0x3ull, AddrInc_Single, DataSize_32, 1, slot)) != ADI_SUCCESS){
+		return result;
+	}
+	*staged += 1;
+	return ADI_SUCCESS;
+}
+
+/**
+ * 找出窗口中不同的部分,加入写队列
+ * 除了第一个窗口的开头和最后一个窗口的结尾,窗口边界都是字对齐的,扩展对齐不会越过窗口
+ * 参数:
+ * 	addr,len,data:整个数据
+ * 	offset,size:窗口
+ * 	ref:窗口对应的比较数据
+ * 	stage:字对齐的暂存缓冲区,提交前必须有效。开头和结尾不对齐的字节另外最多占用DELTA_STAGE_EXTRA个字
+ * 	staged:加入写队列的字数
+ * 	written:累计写入的字节数
+ */
+static int queueDiff(struct ADIv5_AccessPort *ap, uint64_t addr, uint64_t len, const uint8_t *data,
+		uint64_t offset, unsigned int size, const uint8_t *ref, uint32_t *stage, unsigned int *staged, uint64_t *written){
+	const uint8_t *window = data + offset;
+	unsigned int pos = 0, runEnd, same, count;
+	uint64_t start, end;
+	int result;
+	while(pos < size){
+		if(window[pos] == ref[pos]){
+			pos++;
+			continue;
+		}
+		// 扩展不同的部分,吸收小于DELTA_MERGE_GAP的相同部分
+		runEnd = pos + 1;
+		same = 0;
+		while(runEnd + same < size && same < DELTA_MERGE_GAP){
+			if(window[runEnd + same] != ref[runEnd + same]){
+				runEnd += same + 1;
+				same = 0;
+			}else{
+				same++;
+			}
+		}
+		// 在数据范围内扩展到字对齐
+		start = addr + offset + pos;
+		end = addr + offset + runEnd;
+		if((start & ~0x3ull) >= addr) start &= ~0x3ull;
+		if(((end + 3) & ~0x3ull) <= addr + len) end = (end + 3) & ~0x3ull;
+		*written += end - start;
+		pos = runEnd;
+		if(start & 0x3){
+			uint64_t headEnd = ((start + 3) & ~0x3ull) < end ? (start + 3) & ~0x3ull : end;
+			if((result = queueBytes(ap, start, headEnd, data + (start - addr), stage, staged)) != ADI_SUCCESS){
+				return result;
+			}
+			start = headEnd;
+		}
+		if((end & 0x3) && end > start){
+			uint64_t tailStart = (end & ~0x3ull) > start ? end & ~0x3ull : start;
+			if((result = queueBytes(ap, tailStart, end, data + (tailStart - addr), stage, staged)) != ADI_SUCCESS){
+				return result;
+			}
+			end = tailStart;
+		}
+		if(end <= start) continue;
+		count = (unsigned int)((end - start) >> 2);
+		memcpy(stage + *staged, data + (start - addr), count << 2);
+		if((result = ADIv5_QueueBlockWrite(ap, start, AddrInc_Single, DataSize_32, count, stage + *staged)) != ADI_SUCCESS){
+			return result;
+		}
+		*staged += count;
+	}
+	return ADI_SUCCESS;
+}
+
+/**
+ * 加入读目标窗口的操作,读取的范围扩展到字对齐
+ */
+static int queueRead(struct ADIv5_AccessPort *ap, uint64_t start, unsigned int size, uint32_t *buff){
+	uint64_t wordStart = start & ~0x3ull, wordEnd = (start + size + 3) & ~0x3ull;
+	return ADIv5_QueueBlockRead(ap, wordStart, AddrInc_Single, DataSize_32, (unsigned int)((wordEnd - wordStart) >> 2), buff);
+}
+
+/**
+ * 保存这次写入的数据
+ */
+static void saveRecord(struct ADIv5_AccessPort *ap, struct ADIv5_DeltaRecord *record, uint64_t addr, uint64_t len, const uint8_t *data){
+	size_t validSize = (size_t)(((len + DELTA_BLOCK_SIZE - 1) >> DELTA_BLOCK_SHIFT) + 7) >> 3;
+	uint8_t *newData, *newValid;
+	if(record == NULL){
+		record = calloc(1, sizeof(struct ADIv5_DeltaRecord));
+		if(record == NULL) goto FAILED;
+	}
+	newData = realloc(record->data, (size_t)len);
+	if(newData == NULL) goto FAILED;
+	record->data = newData;
+	newValid = realloc(record->valid, validSize);
+	if(newValid == NULL) goto FAILED;
+	record->valid = newValid;
+	memcpy(record->data, data, (size_t)len);
+	memset(record->valid, 0xFF, validSize);
+	record->base = addr;
+	record->len = len;
+	record->next = ap->type.memory.deltaRecord;
+	ap->type.memory.deltaRecord = record;
+	return;
+FAILED:
+	log_warn("Failed to record written data, next delta write will write everything.");
+	ADIv5_FreeDeltaRecord(record);
+}
+
+/**
+ * ADIv5_DeltaWrite 增量写入
+ */
+int ADIv5_DeltaWrite(AccessPort apApi, uint64_t addr, uint64_t len, const uint8_t *data, enum deltaSource source, uint64_t *written){
+	assert(apApi != NULL && data != NULL);
+	struct ADIv5_AccessPort *ap;
+	struct ADIv5_DeltaRecord *record;
+	uint32_t *stage = NULL, *readBuff = NULL;
+	uint8_t *ref = NULL;
+	uint64_t offset, writtenBytes = 0;
+	unsigned int size, nextSize, staged;
+	int result;
+	if(apApi->type != AccessPort_Memory){
+		log_error("Not a memory access port!");
+		return ADI_ERR_BAD_PARAMETER;
+	}
+	if(len == 0 || addr + len < addr){
+		log_error("Invalid delta write range!");
+		return ADI_ERR_BAD_PARAMETER;
+	}
+	ap = container_of(apApi, struct ADIv5_AccessPort, apApi);
+	if((result = ADIv5_WriteBufferFlush(ap, 0, 0)) != ADI_SUCCESS){
+		return result;
+	}
+	// 这次写入之后旧的记录都不再有用
+	record = takeRecord(ap, addr, len);
+	// 读回的数据结尾最多多出3字节
+	stage = malloc(DELTA_WINDOW_SIZE + DELTA_STAGE_EXTRA * sizeof(uint32_t));
+	readBuff = malloc(DELTA_WINDOW_SIZE + 4);
+	ref = malloc(DELTA_WINDOW_SIZE);
+	if(stage == NULL || readBuff == NULL || ref == NULL){
+		log_error("Failed to allocate delta write buffer!");
+		result = ADI_ERR_INTERNAL_ERROR;
+		goto EXIT;
+	}
+	// 第一个窗口缩短到下一个字边界
+	size = DELTA_WINDOW_SIZE - (unsigned int)(addr & 0x3);
+	if(len < size) size = (unsigned int)len;
+	if(source == DeltaSource_Target){
+		if((result = queueRead(ap, addr, size, readBuff)) != ADI_SUCCESS){
+			goto EXIT;
+		}
+		if((result = ADIv5_DapCommit(ap->dap)) != ADI_SUCCESS){
+			goto EXIT;
+		}
+	}
+	for(offset = 0; offset < len; offset += size, size = nextSize){
+		nextSize = len - offset - size < DELTA_WINDOW_SIZE ? (unsigned int)(len - offset - size) : DELTA_WINDOW_SIZE;
+		if(source == DeltaSource_Target){
+			memcpy(ref, CAST(uint8_t *, readBuff) + ((addr + offset) & 0x3), size);
+		}else{
+			recordReference(record, data, offset, size, ref);
+		}
+		staged = 0;
+		if((result = queueDiff(ap, addr, len, data, offset, size, ref, stage, &staged, &writtenBytes)) != ADI_SUCCESS){
+			goto EXIT;
+		}
+		// 比较数据已经取出,读缓冲区可以用来读下一个窗口
+		if(source == DeltaSource_Target && nextSize > 0){
+			if((result = queueRead(ap, addr + offset + size, nextSize, readBuff)) != ADI_SUCCESS){
+				goto EXIT;
+			}
+			staged++;
+		}
+		if(staged > 0 && (result = ADIv5_DapCommit(ap->dap)) != ADI_SUCCESS){
+			goto EXIT;
+		}
+	}
+EXIT:
+	if(result != ADI_SUCCESS){
+		ap->dap->adapter->DapCleanPending(ap->dap->adapter);
+	}
+	ADIv5_CacheInvalidate(ap, addr, len);
+	if(result == ADI_SUCCESS){
+		saveRecord(ap, record, addr, len, data);
+	}else{
+		// 目标内存的状态不确定
+		ADIv5_FreeDeltaRecord(record);
+	}
+	if(written) *written = writtenBytes;
+	free(stage);
+	free(readBuff);
+	free(ref);
+	return result;
+}
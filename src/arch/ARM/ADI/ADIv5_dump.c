@@ -0,0 +1,147 @@
+/*
+ * ADIv5_dump.c
+ *
+ *  Created on: 2019-6-26
+ *      Author: virusv
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "smart_ocd.h"
+#include "misc/log.h"
+#include "misc/misc.h"
+
+#include "arch/ARM/ADI/ADIv5_private.h"
+
+/**
+ * 内存转储
+ * 每次Block读DUMP_CHUNK_SIZE字节,读出的缓冲区直接pwrite到文件对应的偏移,
+ * 整个转储只使用这一个缓冲区。
+ * 续传的位置就是文件的长度,稀疏模式下结尾的空洞用ftruncate计入文件长度
+ */
+#define DUMP_CHUNK_SIZE		(256u << 10)
+#define DUMP_PAGE_SIZE		4096u	// 稀疏模式判断全0的粒度,和文件系统的块对应
+
+static BOOL pageIsZero(const uint8_t *data, unsigned int size){
+	return data[0] == 0 && memcmp(data, data + 1, size - 1) == 0;
+}
+
+static int writeFile(int fd, const uint8_t *data, size_t size, off_t offset){
+	ssize_t written;
+	while(size > 0){
+		written = pwrite(fd, data, size, offset);
+		if(written < 0){
+			if(errno == EINTR) continue;
+			return -1;
+		}
+		data += written;
+		size -= written;
+		offset += written;
+	}
+	return 0;
+}
+
+/**
+ * 把读出的一块写入文件
+ * 参数:
+ * 	offset:这一块在文件中的偏移
+ */
+static int dumpChunk(int fd, const uint8_t *data, unsigned int size, uint64_t offset, BOOL sparse){
+	unsigned int page, pageSize;
+	if(!sparse){
+		return writeFile(fd, data, size, (off_t)offset);
+	}
+	for(page = 0; page < size; page += pageSize){
+		pageSize = size - page < DUMP_PAGE_SIZE ? size - page : DUMP_PAGE_SIZE;
+		if(!pageIsZero(data + page, pageSize) && writeFile(fd, data + page, pageSize, (off_t)(offset + page)) != 0){
+			return -1;
+		}
+	}
+	return ftruncate(fd, (off_t)(offset + size));
+}
+
+/**
+ * ADIv5_Dump 转储内存到文件
+ */
+int ADIv5_Dump(AccessPort apApi, uint64_t addr, uint64_t len, const char *path, unsigned int flags,
+		ADIv5_DUMP_PROGRESS progress, void *context, uint64_t *skipped){
+	assert(apApi != NULL && path != NULL);
+	struct ADIv5_AccessPort *ap;
+	struct transferPolicy policy;
+	struct stat fileStat;
+	BOOL sparse = (flags & DumpFlag_Sparse) != 0;
+	uint64_t done = 0, skippedBytes = 0;
+	unsigned int size;
+	uint8_t *buff;
+	int fd, result = ADI_SUCCESS;
+	if(apApi->type != AccessPort_Memory){
+		log_error("Not a memory access port!");
+		return ADI_ERR_BAD_PARAMETER;
+	}
+	if((addr | len) & 0x3){
+		log_error("Dump address and length must be word aligned!");
+		return ADI_ERR_BAD_PARAMETER;
+	}
+	ap = container_of(apApi, struct ADIv5_AccessPort, apApi);
+	buff = malloc(DUMP_CHUNK_SIZE);
+	if(buff == NULL){
+		log_error("Failed to allocate dump buffer!");
+		return ADI_ERR_INTERNAL_ERROR;
+	}
+	fd = open(path, O_WRONLY | O_CREAT | ((flags & DumpFlag_Resume) ? 0 : O_TRUNC), 0644);
+	if(fd < 0){
+		log_error("Failed to open %s: %s.", path, strerror(errno));
+		free(buff);
+		return ADI_ERR_INTERNAL_ERROR;
+	}
+	if(flags & DumpFlag_Resume){
+		if(fstat(fd, &fileStat) != 0){
+			log_error("Failed to get the size of %s: %s.", path, strerror(errno));
+			result = ADI_ERR_INTERNAL_ERROR;
+			goto EXIT;
+		}
+		done = (uint64_t)fileStat.st_size < len ? (uint64_t)fileStat.st_size & ~0x3ull : len;
+		if(done > 0){
+			log_info("Resume dump from 0x%" PRIX64 ".", addr + done);
+		}
+	}
+	// 稀疏模式下跳过不能访问的页,读出的数据是0,不会写入文件
+	policy = ap->type.memory.policy;
+	if(sparse && policy.skipSize == 0){
+		ap->type.memory.policy.skipSize = DUMP_PAGE_SIZE;
+	}
+	while(done < len){
+		size = len - done < DUMP_CHUNK_SIZE ? (unsigned int)(len - done) : DUMP_CHUNK_SIZE;
+		result = apApi->Interface.Memory.BlockRead(apApi, addr + done, AddrInc_Single, DataSize_32, size >> 2, buff);
+		if(result != ADI_SUCCESS){
+			log_error("Failed to read memory at 0x%" PRIX64 ".", ap->type.memory.status.lastGood);
+			break;
+		}
+		skippedBytes += ap->type.memory.status.skipped;
+		if(dumpChunk(fd, buff, size, done, sparse) != 0){
+			log_error("Failed to write %s: %s.", path, strerror(errno));
+			result = ADI_ERR_INTERNAL_ERROR;
+			break;
+		}
+		done += size;
+		if(progress && !progress(context, done, len)){
+			log_info("Dump aborted at 0x%" PRIX64 ".", addr + done);
+			result = ADI_FAILED;
+			break;
+		}
+	}
+	ap->type.memory.policy = policy;
+EXIT:
+	if(close(fd) != 0 && result == ADI_SUCCESS){
+		log_error("Failed to close %s: %s.", path, strerror(errno));
+		result = ADI_ERR_INTERNAL_ERROR;
+	}
+	free(buff);
+	if(skipped) *skipped = skippedBytes;
+	return result;
+}
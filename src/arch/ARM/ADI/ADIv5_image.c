@@ -0,0 +1,114 @@
+/*
+ * ADIv5_image.c
+ *
+ *  Created on: 2019-6-27
+ *      Author: virusv
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "smart_ocd.h"
+#include "misc/log.h"
+#include "misc/misc.h"
+
+#include "arch/ARM/ADI/ADIv5_private.h"
+
+#define VERIFY_CHUNK_SIZE	(64u << 10)
+
+static double elapsedSeconds(const struct timespec *start){
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)(now.tv_sec - start->tv_sec) + (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/**
+ * 校验一段任意对齐的数据
+ * 中间对齐的字用Verify(pushed-verify),开头和结尾不足一个字的部分逐字节读回比较
+ */
+static int verifySegment(AccessPort apApi, const struct imageSegment *seg, uint32_t *buff){
+	uint64_t end = seg->addr + seg->size, headEnd, wordEnd, addr, chunkEnd, mismatch;
+	const uint8_t *data;
+	uint8_t byte;
+	int result;
+	headEnd = (seg->addr + 3) & ~0x3ull;
+	if(headEnd > end) headEnd = end;
+	wordEnd = end & ~0x3ull;
+	if(wordEnd < headEnd) wordEnd = headEnd;
+	for(addr = seg->addr; addr < end; addr++){
+		// 跳过中间对齐的部分
+		if(addr == headEnd) addr = wordEnd;
+		if(addr >= end) break;
+		if((result = apApi->Interface.Memory.Read8(apApi, addr, &byte)) != ADI_SUCCESS){
+			return result;
+		}
+		if(byte != seg->data[addr - seg->addr]){
+			log_error("Verify failed at 0x%" PRIX64 ".", addr);
+			return ADI_FAILED;
+		}
+	}
+	for(addr = headEnd; addr < wordEnd; addr = chunkEnd){
+		chunkEnd = wordEnd - addr < VERIFY_CHUNK_SIZE ? wordEnd : addr + VERIFY_CHUNK_SIZE;
+		data = seg->data + (addr - seg->addr);
+		memcpy(buff, data, chunkEnd - addr);
+		result = apApi->Interface.Memory.Verify(apApi, addr, (unsigned int)((chunkEnd - addr) >> 2), buff, &mismatch);
+		if(result == ADI_FAILED){
+			log_error("Verify failed at 0x%" PRIX64 ".", mismatch);
+			return ADI_FAILED;
+		}
+		if(result != ADI_SUCCESS){
+			return result;
+		}
+	}
+	return ADI_SUCCESS;
+}
+
+/**
+ * ADIv5_LoadImage 把镜像写入目标内存
+ */
+int ADIv5_LoadImage(AccessPort apApi, Image image, BOOL verify, struct loadStats *stats){
+	assert(apApi != NULL && image != NULL);
+	struct timespec start;
+	uint32_t *buff = NULL;
+	unsigned int idx;
+	int result = ADI_SUCCESS;
+	struct loadStats loadStats = {0};
+	if(apApi->type != AccessPort_Memory){
+		log_error("Not a memory access port!");
+		return ADI_ERR_BAD_PARAMETER;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(idx = 0; idx < image->segmentCount; idx++){
+		const struct imageSegment *seg = &image->segments[idx];
+		log_debug("Load segment 0x%" PRIX64 " - 0x%" PRIX64 ".", seg->addr, seg->addr + seg->size);
+		if((result = apApi->Interface.Memory.Write(apApi, seg->addr, seg->size, seg->data)) != ADI_SUCCESS){
+			log_error("Failed to load segment at 0x%" PRIX64 ".", seg->addr);
+			goto EXIT;
+		}
+		loadStats.bytes += seg->size;
+		loadStats.segments++;
+	}
+	loadStats.seconds = elapsedSeconds(&start);
+	log_info("Loaded %" PRIu64 " bytes in %u segments, %.3f s (%.1f KiB/s).", loadStats.bytes, loadStats.segments,
+			loadStats.seconds, loadStats.seconds > 0 ? loadStats.bytes / 1024.0 / loadStats.seconds : 0.0);
+	if(!verify) goto EXIT;
+	buff = malloc(VERIFY_CHUNK_SIZE);
+	if(buff == NULL){
+		log_error("Failed to allocate verify buffer!");
+		result = ADI_ERR_INTERNAL_ERROR;
+		goto EXIT;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(idx = 0; idx < image->segmentCount; idx++){
+		if((result = verifySegment(apApi, &image->segments[idx], buff)) != ADI_SUCCESS){
+			goto EXIT;
+		}
+	}
+	loadStats.verifySeconds = elapsedSeconds(&start);
+	log_info("Verified in %.3f s.", loadStats.verifySeconds);
+EXIT:
+	free(buff);
+	if(stats) *stats = loadStats;
+	return result;
+}
@@ -0,0 +1,319 @@
+/*
+ * ADIv5_memmap.c
+ *
+ *  Created on: 2019-6-28
+ *      Author: virusv
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "smart_ocd.h"
+#include "misc/log.h"
+#include "misc/misc.h"
+
+#include "arch/ARM/ADI/ADIv5_private.h"
+
+/**
+ * 内存映射和访问规划
+ * 每个区域记录所属的MEM-AP、允许的访问宽度、内存类型、最大突发长度和缓存策略,
+ * 访问时按区域拆分,每一段选择合法的最快方式:
+ * 普通内存:对齐的部分用32位地址自增Block传输,只允许窄宽度时用packed传输,开头和结尾用允许的最大宽度单独访问
+ * 设备内存:用允许的最大宽度逐个访问,只有指定了最大突发长度才使用地址自增
+ */
+// 一步的最大字节数,同时也是暂存缓冲区的大小
+#define STEP_MAX_BYTES	WRITE_COMMIT_BYTES
+
+/**
+ * 查找地址所在的区域
+ */
+static const struct memoryRegion *findRegion(struct ADIv5_Dap *dapObj, uint64_t addr){
+	unsigned int idx;
+	for(idx = 0; idx < dapObj->regionCount; idx++){
+		const struct memoryRegion *region = &dapObj->memoryMap[idx];
+		if(addr < region->base) break;	// 区域按基址排序
+		if(addr - region->base < region->size) return region;
+	}
+	return NULL;
+}
+
+/**
+ * 区域在AP上实际可用的访问宽度
+ */
+static unsigned int regionWidths(const struct memoryRegion *region, struct ADIv5_AccessPort *ap){
+	unsigned int widths = region->widths ? region->widths : MEMORY_WIDTH_ALL;
+	if(!ap->type.memory.config.lessWordTransfers){
+		widths &= MEMORY_WIDTH(DataSize_32);
+	}
+	return widths;
+}
+
+/**
+ * 选择对齐并且不超过limit的最大合法宽度
+ * 返回:FALSE没有合法的宽度
+ */
+static BOOL widestSize(unsigned int widths, uint64_t addr, uint64_t limit, enum dataSize *size){
+	int s;
+	for(s = DataSize_32; s >= DataSize_8; s--){
+		if((widths & MEMORY_WIDTH(s)) && (addr & ((1u << s) - 1)) == 0 && limit >= (1u << s)){
+			*size = (enum dataSize)s;
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+/**
+ * 规划从addr开始的一步,end是整个访问的结束地址
+ */
+static int nextStep(struct ADIv5_Dap *dapObj, uint64_t addr, uint64_t end, struct accessStep *step){
+	const struct memoryRegion *region;
+	struct ADIv5_AccessPort *ap;
+	uint64_t limit, burst;
+	unsigned int widths;
+	int result;
+	if((region = findRegion(dapObj, addr)) == NULL){
+		log_warn("Address 0x%" PRIX64 " is not in the memory map!", addr);
+		return ADI_ERR_BAD_PARAMETER;
+	}
+	if((result = ADIv5_GetMemoryAp(dapObj, region->apIndex, &ap)) != ADI_SUCCESS){
+		return result;
+	}
+	limit = region->base + region->size - addr;
+	if(limit > end - addr) limit = end - addr;
+	widths = regionWidths(region, ap);
+	step->addr = addr;
+	step->apIndex = region->apIndex;
+	step->type = region->type;
+	if(region->type == MemoryType_Normal){
+		burst = region->maxBurst ? region->maxBurst : STEP_MAX_BYTES;
+		if(burst > STEP_MAX_BYTES) burst = STEP_MAX_BYTES;
+		if(burst > limit) burst = limit;
+		if((addr & 0x3) == 0 && burst >= 4){
+			if(widths & MEMORY_WIDTH(DataSize_32)){
+				step->size = DataSize_32;
+				step->mode = AddrInc_Single;
+			}else if(ap->type.memory.config.packedTransfers){
+				// 只允许窄宽度时,packed传输每次DRW访问仍然传输4字节
+				step->size = (widths & MEMORY_WIDTH(DataSize_16)) ? DataSize_16 : DataSize_8;
+				step->mode = AddrInc_Packed;
+			}else{
+				goto SINGLE;
+			}
+			step->count = (unsigned int)(burst >> 2);
+			step->len = step->count << 2;
+			return ADI_SUCCESS;
+		}
+	}
+SINGLE:
+	if(!widestSize(widths, addr, limit, &step->size)){
+		log_warn("No legal access width at 0x%" PRIX64 "!", addr);
+		return ADI_ERR_BAD_PARAMETER;
+	}
+	// 设备内存只有指定了最大突发长度才能地址自增
+	if(region->type == MemoryType_Device && step->size == DataSize_32 && region->maxBurst >= 8 && limit >= 8){
+		burst = region->maxBurst < limit ? region->maxBurst : limit;
+		if(burst > STEP_MAX_BYTES) burst = STEP_MAX_BYTES;
+		step->count = (unsigned int)(burst >> 2);
+		step->len = step->count << 2;
+		step->mode = AddrInc_Single;
+		return ADI_SUCCESS;
+	}
+	step->count = 1;
+	step->len = 1u << step->size;
+	step->mode = AddrInc_Off;
+	return ADI_SUCCESS;
+}
+
+/**
+ * ADIv5_AddMemoryRegion 添加内存映射的区域
+ */
+int ADIv5_AddMemoryRegion(DAP self, const struct memoryRegion *region){
+	assert(self != NULL && region != NULL);
+	struct ADIv5_Dap *dapObj = container_of(self, struct ADIv5_Dap, dapApi);
+	struct ADIv5_AccessPort *ap;
+	struct memoryRegion *regions;
+	unsigned int idx;
+	int result;
+	if(region->size == 0 || region->base + region->size - 1 < region->base
+			|| (region->widths & ~MEMORY_WIDTH_ALL) || region->type > MemoryType_Device
+			|| region->cache > CachePolicy_WriteThrough){
+		log_error("Invalid memory region!");
+		return ADI_ERR_BAD_PARAMETER;
+	}
+	if(region->type == MemoryType_Device && region->cache != CachePolicy_Uncached){
+		log_error("Device memory can not be cached!");
+		return ADI_ERR_BAD_PARAMETER;
+	}
+	if((result = ADIv5_GetMemoryAp(dapObj, region->apIndex, &ap)) != ADI_SUCCESS){
+		return result;
+	}
+	if(regionWidths(region, ap) == 0){
+		log_error("AP[%u] does not support the access widths of region 0x%" PRIX64 ".", region->apIndex, region->base);
+		return ADI_ERR_BAD_PARAMETER;
+	}
+	// 找到插入位置,同时检查重叠
+	for(idx = 0; idx < dapObj->regionCount; idx++){
+		const struct memoryRegion *curr = &dapObj->memoryMap[idx];
+		if(region->base < curr->base + curr->size && curr->base < region->base + region->size){
+			log_error("Memory region 0x%" PRIX64 " overlaps region 0x%" PRIX64 "!", region->base, curr->base);
+			return ADI_ERR_BAD_PARAMETER;
+		}
+		if(region->base < curr->base) break;
+	}
+	if(region->type == MemoryType_Device
+			&& (result = ADIv5_AddDeviceRegion(&ap->apApi, region->base, region->size)) != ADI_SUCCESS){
+		return result;
+	}
+	if(region->cache != CachePolicy_Uncached){
+		if(ap->type.memory.cache){
+			if((result = ADIv5_AddCacheRegion(&ap->apApi, region->base, region->size, region->cache)) != ADI_SUCCESS){
+				return result;
+			}
+		}else{
+			log_info("AP[%u] cache is not enabled, cache policy of region 0x%" PRIX64 " takes effect after ConfigCache.",
+					region->apIndex, region->base);
+		}
+	}
+	regions = realloc(dapObj->memoryMap, (dapObj->regionCount + 1) * sizeof(struct memoryRegion));
+	if(regions == NULL){
+		log_error("Failed to allocate memory region!");
+		return ADI_ERR_INTERNAL_ERROR;
+	}
+	memmove(&regions[idx + 1], &regions[idx], (dapObj->regionCount - idx) * sizeof(struct memoryRegion));
+	regions[idx] = *region;
+	dapObj->memoryMap = regions;
+	dapObj->regionCount++;
+	return ADI_SUCCESS;
+}
+
+/**
+ * ADIv5_ClearMemoryMap 清空内存映射
+ * 已经加到AP上的设备区域和缓存区域保留
+ */
+int ADIv5_ClearMemoryMap(DAP self){
+	assert(self != NULL);
+	struct ADIv5_Dap *dapObj = container_of(self, struct ADIv5_Dap, dapApi);
+	free(dapObj->memoryMap);
+	dapObj->memoryMap = NULL;
+	dapObj->regionCount = 0;
+	return ADI_SUCCESS;
+}
+
+/**
+ * ADIv5_PlanAccess 规划一次访问
+ */
+int ADIv5_PlanAccess(DAP self, uint64_t addr, uint64_t len, struct accessStep *steps, unsigned int maxSteps, unsigned int *stepCount){
+	assert(self != NULL && stepCount != NULL);
+	struct ADIv5_Dap *dapObj = container_of(self, struct ADIv5_Dap, dapApi);
+	struct accessStep step;
+	uint64_t end = addr + len;
+	unsigned int count = 0;
+	int result;
+	*stepCount = 0;
+	for(; addr < end; addr += step.len){
+		if((result = nextStep(dapObj, addr, end, &step)) != ADI_SUCCESS){
+			return result;
+		}
+		if(steps && count < maxSteps){
+			steps[count] = step;
+		}
+		count++;
+	}
+	*stepCount = count;
+	return ADI_SUCCESS;
+}
+
+/**
+ * 执行一步,data是这一步对应的主机端数据,stage是4字节对齐的暂存缓冲区
+ */
+static int doStep(struct ADIv5_AccessPort *ap, const struct accessStep *step, uint8_t *data, uint32_t *stage, BOOL write){
+	AccessPort apApi = &ap->apApi;
+	uint32_t word;
+	uint16_t half;
+	int result;
+	if(step->mode != AddrInc_Off){
+		if(write){
+			memcpy(stage, data, step->len);
+			return apApi->Interface.Memory.BlockWrite(apApi, step->addr, step->mode, step->size, step->count, CAST(uint8_t *, stage));
+		}
+		if((result = apApi->Interface.Memory.BlockRead(apApi, step->addr, step->mode, step->size, step->count,
+				CAST(uint8_t *, stage))) == ADI_SUCCESS){
+			memcpy(data, stage, step->len);
+		}
+		return result;
+	}
+	switch(step->size){
+	case DataSize_8:
+		return write ? apApi->Interface.Memory.Write8(apApi, step->addr, *data)
+				: apApi->Interface.Memory.Read8(apApi, step->addr, data);
+	case DataSize_16:
+		if(write){
+			memcpy(&half, data, 2);
+			return apApi->Interface.Memory.Write16(apApi, step->addr, half);
+		}
+		if((result = apApi->Interface.Memory.Read16(apApi, step->addr, &half)) == ADI_SUCCESS){
+			memcpy(data, &half, 2);
+		}
+		return result;
+	default:
+		if(write){
+			memcpy(&word, data, 4);
+			return apApi->Interface.Memory.Write32(apApi, step->addr, word);
+		}
+		if((result = apApi->Interface.Memory.Read32(apApi, step->addr, &word)) == ADI_SUCCESS){
+			memcpy(data, &word, 4);
+		}
+		return result;
+	}
+}
+
+/**
+ * 按规划的步骤读写
+ */
+static int transfer(DAP self, uint64_t addr, uint64_t len, uint8_t *data, BOOL write){
+	struct ADIv5_Dap *dapObj = container_of(self, struct ADIv5_Dap, dapApi);
+	struct ADIv5_AccessPort *ap;
+	struct accessStep step;
+	uint64_t pos, end = addr + len;
+	uint32_t *stage = NULL;
+	int result = ADI_SUCCESS;
+	if(end < addr){
+		return ADI_ERR_BAD_PARAMETER;
+	}
+	for(pos = addr; pos < end; pos += step.len){
+		if((result = nextStep(dapObj, pos, end, &step)) != ADI_SUCCESS){
+			break;
+		}
+		if(step.mode != AddrInc_Off && stage == NULL && (stage = malloc(STEP_MAX_BYTES)) == NULL){
+			log_error("Failed to allocate transfer buffer!");
+			result = ADI_ERR_INTERNAL_ERROR;
+			break;
+		}
+		if((result = ADIv5_GetMemoryAp(dapObj, step.apIndex, &ap)) != ADI_SUCCESS){
+			break;
+		}
+		if((result = doStep(ap, &step, data + (pos - addr), stage, write)) != ADI_SUCCESS){
+			log_error("Failed to %s memory at 0x%" PRIX64 " through AP[%u].", write ? "write" : "read", pos, step.apIndex);
+			break;
+		}
+	}
+	free(stage);
+	return result;
+}
+
+/**
+ * ADIv5_ReadMemory 按内存映射读内存
+ */
+int ADIv5_ReadMemory(DAP self, uint64_t addr, uint64_t len, uint8_t *data){
+	assert(self != NULL && data != NULL);
+	return transfer(self, addr, len, data, FALSE);
+}
+
+/**
+ * ADIv5_WriteMemory 按内存映射写内存
+ */
+int ADIv5_WriteMemory(DAP self, uint64_t addr, uint64_t len, const uint8_t *data){
+	assert(self != NULL && data != NULL);
+	return transfer(self, addr, len, CAST(uint8_t *, data), TRUE);
+}
@@ -20,13 +20,6 @@
 #define IS_AP_REG(reg) ((reg) == AP_REG_CSW || (reg) == AP_REG_TAR_LSB || (reg) == AP_REG_TAR_MSB || (reg) == AP_REG_DRW || (reg) == AP_REG_BD0 || (reg) == AP_REG_BD1 || \
 		(reg) == AP_REG_BD2 || (reg) == AP_REG_BD3 || (reg) == AP_REG_CFG || (reg) == AP_REG_ROM_MSB || (reg) == AP_REG_ROM_LSB || (reg) == AP_REG_IDR)
 
-// Abort Register definitions
-#define DP_ABORT_DAPABORT       0x00000001  // DAP Abort
-#define DP_ABORT_STKCMPCLR      0x00000002  // Clear STICKYCMP Flag (SW Only)
-#define DP_ABORT_STKERRCLR      0x00000004  // Clear STICKYERR Flag (SW Only)
-#define DP_ABORT_WDERRCLR       0x00000008  // Clear WDATAERR Flag (SW Only)
-#define DP_ABORT_ORUNERRCLR     0x00000010  // Clear STICKYORUN Flag (SW Only)
-
 // Debug Control and Status definitions
 #define DP_CTRL_ORUNDETECT		0x00000001  // Overrun Detect
 #define DP_STAT_STICKYORUN		0x00000002  // Sticky Overrun
@@ -206,6 +199,36 @@ union PackedTransferData{
 	uint8_t data_8[4];
 };
 
+// Block传输出错默认的重试次数和第一次重试前等待的微秒数
+#define TRANSFER_DEFAULT_RETRIES	3
+#define TRANSFER_DEFAULT_BACKOFF	1000
+
+// 填充内存时每次提交的字节数
+#define FILL_COMMIT_BYTES	(1u << 20)
+// 写任意对齐的数据时每次提交的字节数
+#define WRITE_COMMIT_BYTES	(64u << 10)
+
+// TAR地址自增的回绕大小,ADIv5保证至少低10位自增
+#define TAR_WRAP_MIN	(1u << 10)
+#define TAR_WRAP_MAX	(64u << 10)
+
+// 一个DAP最多有256个AP
+#define ADIv5_MAX_AP_COUNT		256
+
+/**
+ * AP表项:一次性枚举得到的AP信息,可以缓存到磁盘
+ */
+struct ADIv5_ApInfo{
+	uint32_t idr;	// APIDR寄存器
+	uint32_t cfg;	// CFG寄存器,MEM-AP有效
+	uint64_t rom;	// ROM Table基址,MEM-AP有效
+	uint32_t csw;	// CSW寄存器的初始值,MEM-AP有效
+	uint32_t romCidr;	// ROM Table的CIDR,用于验证AP表缓存,0表示没有读到
+	uint8_t index;	// AP的索引
+	uint8_t packedTransfers;	// 是否支持packed传输
+	uint8_t lessWordTransfers;	// 是否支持小于1个字的传输
+};
+
 /**
  * ADIv5 的DAP结构体
  */
@@ -214,8 +237,16 @@ struct ADIv5_Dap{
 	Adapter adapter;	// Adapter对象的接口
 	struct dap dapApi;
 	ADIv5_DpSelectRegister select;	// SELECT寄存器
+	BOOL selectValid;	// SELECT影子寄存器是否和硬件一致
 	ADIv5_DpCtrlStatRegister ctrlStat;	// CTRL/STAT寄存器
 	ADIv5_DpIdrRegister idr;	// DPIDR寄存器
+	uint32_t targetId;	// TARGETID寄存器,DPv2才有
+	struct ADIv5_ApInfo *apTable;	// AP表,第一次查找AP时建立
+	unsigned int apCount;	// AP表的项数
+	BOOL multidrop;	// 是否是SWD multi-drop目标
+	uint32_t targetSel;	// multi-drop目标的TARGETSEL值
+	struct memoryRegion *memoryMap;	// 内存映射,按基址排序
+	unsigned int regionCount;	// 内存映射的区域数
 };
 
 // AP定义
@@ -229,7 +260,15 @@ struct ADIv5_AccessPort{
 		// MEM-AP
 		struct {
 			ADIv5_ApCswRegister csw;
+			BOOL cswValid;	// CSW影子寄存器是否和硬件一致
 			uint64_t rom;	// ROM Table基址
+			struct coresightComponent *romTable;	// ROM Table组件树,第一次遍历时建立
+			struct transferPolicy policy;	// Block传输出错恢复策略
+			struct transferStatus status;	// 最近一次Block传输的结果
+			struct ADIv5_Cache *cache;	// 主机端内存缓存,NULL表示没有开启
+			struct ADIv5_WriteBuffer *writeBuffer;	// 写合并缓冲区,第一次使用时建立
+			struct ADIv5_DeltaRecord *deltaRecord;	// 增量写入的主机端记录链表
+			unsigned int tarWrap;	// TAR地址自增的回绕大小,地址自增传输在它的边界上拆分
 			struct {
 				uint8_t largeAddress:1;	// 该AP是否支持64位地址访问，如果支持，则TAR和ROM寄存器是64位
 				uint8_t largeData:1;	// 是否支持大于32位数据传输
@@ -245,4 +284,79 @@ struct ADIv5_AccessPort{
 	} type;
 };
 
+/**
+ * 以下函数把DAP操作加入指令队列,不会立即执行
+ * SELECT和CSW在加入队列时就更新影子寄存器,所以必须用ADIv5_DapCommit提交,
+ * 提交失败时它会清理队列并使影子寄存器失效
+ */
+int ADIv5_DapCommit(struct ADIv5_Dap *dap);
+void ADIv5_DapInvalidate(struct ADIv5_Dap *dap);
+void ADIv5_QueueTarget(struct ADIv5_Dap *dap);
+void ADIv5_QueueSelect(struct ADIv5_AccessPort *ap, uint8_t bank);
+int ADIv5_QueueCsw(struct ADIv5_AccessPort *ap, enum addrIncreaseMode mode, enum dataSize size);
+void ADIv5_QueueTar(struct ADIv5_AccessPort *ap, uint64_t addr);
+int ADIv5_QueueBlockRead(struct ADIv5_AccessPort *ap, uint64_t addr, enum addrIncreaseMode mode, enum dataSize size,
+		unsigned int count, uint32_t *data);
+int ADIv5_QueueBlockWrite(struct ADIv5_AccessPort *ap, uint64_t addr, enum addrIncreaseMode mode, enum dataSize size,
+		unsigned int count, uint32_t *data);
+
+// 按索引取得MEM-AP
+int ADIv5_GetMemoryAp(struct ADIv5_Dap *dapObj, unsigned int index, struct ADIv5_AccessPort **apOut);
+
+// ROM Table
+int ADIv5_ReadRomTable(DAP self, AccessPort apApi, const struct coresightComponent **root);
+void ADIv5_FreeRomTable(struct coresightComponent *root);
+
+// 主机端内存缓存
+int ADIv5_ConfigCache(AccessPort apApi, unsigned int lineSize, unsigned int lineCount);
+int ADIv5_AddCacheRegion(AccessPort apApi, uint64_t base, uint64_t size, enum cachePolicy policy);
+int ADIv5_InvalidateCache(AccessPort apApi, uint64_t addr, uint64_t size);
+int ADIv5_GetCacheStats(AccessPort apApi, struct cacheStats *stats);
+BOOL ADIv5_CacheRead(struct ADIv5_AccessPort *ap, uint64_t addr, unsigned int len, uint8_t *data);
+void ADIv5_CacheWrite(struct ADIv5_AccessPort *ap, uint64_t addr, unsigned int len, const uint8_t *data);
+void ADIv5_CacheInvalidate(struct ADIv5_AccessPort *ap, uint64_t addr, uint64_t len);
+void ADIv5_FreeCache(struct ADIv5_Cache *cache);
+
+// 写合并
+int ADIv5_WriteCombine(AccessPort apApi, BOOL enable);
+int ADIv5_FlushWrites(AccessPort apApi);
+int ADIv5_AddDeviceRegion(AccessPort apApi, uint64_t base, uint64_t size);
+int ADIv5_BufferWrite(struct ADIv5_AccessPort *ap, uint64_t addr, unsigned int len, const uint8_t *data, BOOL *buffered);
+int ADIv5_WriteBufferFlush(struct ADIv5_AccessPort *ap, uint64_t addr, uint64_t len);
+void ADIv5_FreeWriteBuffer(struct ADIv5_WriteBuffer *buffer);
+
+// Pushed-verify和Pushed-compare
+int ADIv5_Verify(AccessPort apApi, uint64_t addr, unsigned int count, const uint32_t *expect, uint64_t *mismatch);
+int ADIv5_Search(AccessPort apApi, uint64_t addr, unsigned int count, uint32_t value, uint8_t lanes, uint64_t *where);
+
+// 增量写入
+int ADIv5_DeltaWrite(AccessPort apApi, uint64_t addr, uint64_t len, const uint8_t *data, enum deltaSource source, uint64_t *written);
+void ADIv5_DeltaForget(struct ADIv5_AccessPort *ap, uint64_t addr, uint64_t len);
+void ADIv5_FreeDeltaRecord(struct ADIv5_DeltaRecord *record);
+
+// 加载镜像
+int ADIv5_LoadImage(AccessPort apApi, Image image, BOOL verify, struct loadStats *stats);
+
+// 转储到文件
+int ADIv5_Dump(AccessPort apApi, uint64_t addr, uint64_t len, const char *path, unsigned int flags,
+		ADIv5_DUMP_PROGRESS progress, void *context, uint64_t *skipped);
+
+// 主机端内存扫描
+int ADIv5_Scan(AccessPort apApi, uint64_t addr, uint64_t len, const uint8_t *pattern, const uint8_t *mask,
+		unsigned int patternLen, unsigned int align, MemScan *scan);
+
+// 批量读写
+int ADIv5_ReadMany(AccessPort apApi, struct memoryAccess *access, unsigned int count);
+int ADIv5_WriteMany(AccessPort apApi, const struct memoryAccess *access, unsigned int count);
+int ADIv5_PrepareRead(AccessPort apApi, const struct memoryAccess *access, unsigned int count, MemProgram *program);
+int ADIv5_RunProgram(AccessPort apApi, MemProgram program, struct memoryAccess *access);
+void ADIv5_FreeProgram(AccessPort apApi, MemProgram program);
+
+// 内存映射和访问规划
+int ADIv5_AddMemoryRegion(DAP self, const struct memoryRegion *region);
+int ADIv5_ClearMemoryMap(DAP self);
+int ADIv5_PlanAccess(DAP self, uint64_t addr, uint64_t len, struct accessStep *steps, unsigned int maxSteps, unsigned int *stepCount);
+int ADIv5_ReadMemory(DAP self, uint64_t addr, uint64_t len, uint8_t *data);
+int ADIv5_WriteMemory(DAP self, uint64_t addr, uint64_t len, const uint8_t *data);
+
 #endif /* SRC_ARCH_ARM_ADI_ADIV5_PRIVATE_H_ */
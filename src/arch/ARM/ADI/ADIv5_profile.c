@@ -0,0 +1,621 @@
+/*
+ * ADIv5_profile.c
+ *
+ *  Created on: 2019-7-7
+ *      Author: virusv
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "smart_ocd.h"
+#include "misc/log.h"
+#include "misc/symbols.h"
+
+#include "arch/ARM/ADI/include/ADIv5.h"
+
+/**
+ * PC采样分析
+ * 核心运行时PC采样寄存器返回最近执行的指令地址,读取不会打断核心。采样线程不停地批量读取这些寄存器,
+ * 同一个MEM-AP上的核心放在一次ReadMany中交替读取;MEM-AP上只有一个32位采样寄存器时用地址不自增的块读,
+ * 一次提交读出整批采样。采样按(核心,PC)累加到开放寻址的散列表中,只有采样线程写入,
+ * 停止后才能读取直方图和导出,不需要加锁。
+ * 采样线程不打印日志,错误记录在统计信息中
+ */
+#define PROFILE_DWT_PCSR		0x01C	// DWT_PCSR相对DWT基地址的偏移
+#define PROFILE_DEMCR			0xE000EDFCull
+#define PROFILE_DEMCR_TRCENA	(1u << 24)
+#define PROFILE_EDPCSR_LO		0x0A0	// 相对核心调试寄存器基地址的偏移
+#define PROFILE_EDPCSR_HI		0x0AC
+#define PROFILE_OSLAR			0x300
+#define PROFILE_EDLAR			0xFB0
+#define PROFILE_UNLOCK_KEY		0xC5ACCE55
+#define PROFILE_NO_SAMPLE		0xFFFFFFFFu	// 核心停止或者禁止采样时读到的值
+#define PROFILE_INIT_SLOTS		4096	// 散列表的初始大小,2的幂
+#define PROFILE_MAX_BATCH		65536
+
+struct profileCore {
+	AccessPort ap;
+	enum profileCoreType type;
+	uint64_t sampleAddr;	// DWT_PCSR或者EDPCSRlo的地址
+	uint64_t base;
+};
+
+// 同一个MEM-AP上的核心
+struct profileGroup {
+	AccessPort ap;
+	unsigned int *cores;
+	unsigned int coreCount;
+	BOOL useBlock;	// 只有一个32位采样寄存器,用块读
+	uint32_t *block;
+	struct memoryAccess *access;	// 每批的访问,按采样顺序排列各个核心
+	unsigned int accessCount;
+};
+
+// 散列表的槽,count为0表示空
+struct profileSlot {
+	uint64_t pc;
+	uint64_t count;
+	uint32_t core;
+};
+
+struct pcProfile {
+	unsigned int batch;
+	struct profileCore *cores;
+	unsigned int coreCount, coreCapacity;
+	struct profileGroup *groups;
+	unsigned int groupCount;
+	// 直方图
+	struct profileSlot *slots;
+	unsigned int slotCount;	// 2的幂
+	atomic_uint used;
+	// 采样线程
+	pthread_t thread;
+	atomic_bool stop;
+	atomic_bool active;	// 采样线程还没有结束
+	BOOL running;	// 采样线程还没有回收
+	uint64_t startNs, durationNs;
+	// 统计
+	atomic_ullong samples, invalid, batches, errors, elapsedNs;
+	atomic_int lastError;
+};
+
+static uint64_t nowNs(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static inline unsigned int slotHash(uint64_t pc, uint32_t core){
+	uint64_t h = (pc ^ ((uint64_t)core << 56)) * 0x9E3779B97F4A7C15ull;
+	return (unsigned int)(h >> 32);
+}
+
+/**
+ * 散列表扩容
+ */
+static BOOL growSlots(struct pcProfile *profile){
+	struct profileSlot *slots, *slot;
+	unsigned int count = profile->slotCount ? profile->slotCount * 2 : PROFILE_INIT_SLOTS;
+	unsigned int idx, pos, mask = count - 1;
+	slots = calloc(count, sizeof(struct profileSlot));
+	if(slots == NULL) return FALSE;
+	for(idx = 0; idx < profile->slotCount; idx++){
+		slot = &profile->slots[idx];
+		if(slot->count == 0) continue;
+		for(pos = slotHash(slot->pc, slot->core) & mask; slots[pos].count; pos = (pos + 1) & mask);
+		slots[pos] = *slot;
+	}
+	free(profile->slots);
+	profile->slots = slots;
+	profile->slotCount = count;
+	return TRUE;
+}
+
+/**
+ * 累加一个采样
+ */
+static BOOL recordSample(struct pcProfile *profile, uint32_t core, uint64_t pc){
+	struct profileSlot *slot;
+	unsigned int pos, mask = profile->slotCount - 1;
+	for(pos = slotHash(pc, core) & mask; profile->slots[pos].count; pos = (pos + 1) & mask){
+		slot = &profile->slots[pos];
+		if(slot->pc == pc && slot->core == core){
+			slot->count++;
+			return TRUE;
+		}
+	}
+	// 新的PC,装载率超过3/4时扩容后重新查找插入位置
+	if((atomic_load_explicit(&profile->used, memory_order_relaxed) + 1) * 4 > profile->slotCount * 3){
+		if(growSlots(profile) == FALSE) return FALSE;
+		mask = profile->slotCount - 1;
+		for(pos = slotHash(pc, core) & mask; profile->slots[pos].count; pos = (pos + 1) & mask);
+	}
+	slot = &profile->slots[pos];
+	slot->pc = pc;
+	slot->core = core;
+	slot->count = 1;
+	atomic_fetch_add_explicit(&profile->used, 1, memory_order_relaxed);
+	return TRUE;
+}
+
+/**
+ * 读取一个MEM-AP上所有核心的一批采样
+ */
+static void sampleGroup(struct pcProfile *profile, struct profileGroup *group){
+	const struct profileCore *core;
+	uint64_t lo, hi, valid = 0, invalid = 0;
+	unsigned int sample, idx, pos = 0;
+	int result;
+	if(group->useBlock){
+		result = group->ap->Interface.Memory.BlockRead(group->ap, profile->cores[group->cores[0]].sampleAddr,
+				AddrInc_Off, DataSize_32, profile->batch, CAST(uint8_t *, group->block));
+	}else{
+		result = group->ap->Interface.Memory.ReadMany(group->ap, group->access, group->accessCount);
+	}
+	atomic_fetch_add_explicit(&profile->batches, 1, memory_order_relaxed);
+	if(result != ADI_SUCCESS){
+		atomic_fetch_add_explicit(&profile->errors, 1, memory_order_relaxed);
+		atomic_store_explicit(&profile->lastError, result, memory_order_relaxed);
+		return;
+	}
+	for(sample = 0; sample < profile->batch; sample++){
+		for(idx = 0; idx < group->coreCount; idx++){
+			core = &profile->cores[group->cores[idx]];
+			hi = 0;
+			if(group->useBlock){
+				lo = group->block[sample];
+			}else{
+				lo = group->access[pos++].data & 0xFFFFFFFFu;
+				if(core->type == ProfileCore_EDPCSR64){
+					hi = group->access[pos++].data & 0xFFFFFFFFu;
+				}
+			}
+			if(lo == PROFILE_NO_SAMPLE){
+				invalid++;
+				continue;
+			}
+			if(recordSample(profile, group->cores[idx], lo | (hi << 32)) == FALSE){
+				atomic_store_explicit(&profile->lastError, ADI_ERR_INTERNAL_ERROR, memory_order_relaxed);
+				invalid++;
+				continue;
+			}
+			valid++;
+		}
+	}
+	atomic_fetch_add_explicit(&profile->samples, valid, memory_order_relaxed);
+	atomic_fetch_add_explicit(&profile->invalid, invalid, memory_order_relaxed);
+}
+
+/**
+ * 采样线程
+ */
+static void *profileThread(void *arg){
+	struct pcProfile *profile = arg;
+	uint64_t deadline = profile->durationNs ? profile->startNs + profile->durationNs : 0;
+	unsigned int idx;
+	while(!atomic_load_explicit(&profile->stop, memory_order_acquire)){
+		if(deadline && nowNs() >= deadline) break;
+		for(idx = 0; idx < profile->groupCount; idx++){
+			sampleGroup(profile, &profile->groups[idx]);
+		}
+	}
+	atomic_fetch_add_explicit(&profile->elapsedNs, nowNs() - profile->startNs, memory_order_relaxed);
+	atomic_store_explicit(&profile->active, FALSE, memory_order_release);
+	return NULL;
+}
+
+static void freeGroups(struct pcProfile *profile){
+	unsigned int idx;
+	for(idx = 0; idx < profile->groupCount; idx++){
+		free(profile->groups[idx].cores);
+		free(profile->groups[idx].block);
+		free(profile->groups[idx].access);
+	}
+	free(profile->groups);
+	profile->groups = NULL;
+	profile->groupCount = 0;
+}
+
+/**
+ * 按MEM-AP分组,生成每批的访问
+ */
+static int buildGroups(struct pcProfile *profile){
+	struct profileGroup *group;
+	const struct profileCore *core;
+	unsigned int idx, g, sample, pos, perSample;
+	freeGroups(profile);
+	profile->groups = calloc(profile->coreCount, sizeof(struct profileGroup));
+	if(profile->groups == NULL) return ADI_ERR_INTERNAL_ERROR;
+	for(idx = 0; idx < profile->coreCount; idx++){
+		for(g = 0; g < profile->groupCount && profile->groups[g].ap != profile->cores[idx].ap; g++);
+		group = &profile->groups[g];
+		if(g == profile->groupCount){
+			group->ap = profile->cores[idx].ap;
+			group->cores = calloc(profile->coreCount, sizeof(unsigned int));
+			profile->groupCount++;
+			if(group->cores == NULL) return ADI_ERR_INTERNAL_ERROR;
+		}
+		group->cores[group->coreCount++] = idx;
+	}
+	for(g = 0; g < profile->groupCount; g++){
+		group = &profile->groups[g];
+		core = &profile->cores[group->cores[0]];
+		if(group->coreCount == 1 && core->type != ProfileCore_EDPCSR64 && group->ap->Interface.Memory.BlockRead){
+			group->useBlock = TRUE;
+			group->block = malloc(profile->batch * sizeof(uint32_t));
+			if(group->block == NULL) return ADI_ERR_INTERNAL_ERROR;
+			continue;
+		}
+		for(idx = 0, perSample = 0; idx < group->coreCount; idx++){
+			perSample += profile->cores[group->cores[idx]].type == ProfileCore_EDPCSR64 ? 2 : 1;
+		}
+		group->accessCount = perSample * profile->batch;
+		group->access = calloc(group->accessCount, sizeof(struct memoryAccess));
+		if(group->access == NULL) return ADI_ERR_INTERNAL_ERROR;
+		for(sample = 0, pos = 0; sample < profile->batch; sample++){
+			for(idx = 0; idx < group->coreCount; idx++){
+				core = &profile->cores[group->cores[idx]];
+				group->access[pos].addr = core->sampleAddr;
+				group->access[pos++].size = DataSize_32;
+				if(core->type == ProfileCore_EDPCSR64){
+					group->access[pos].addr = core->base + PROFILE_EDPCSR_HI;
+					group->access[pos++].size = DataSize_32;
+				}
+			}
+		}
+	}
+	return ADI_SUCCESS;
+}
+
+/**
+ * 使能采样寄存器
+ * DWT需要DEMCR.TRCENA;ARMv8的外部调试寄存器需要解锁软件锁并清除OS Lock
+ */
+static int enableCore(const struct profileCore *core){
+	struct memoryAccess access[2];
+	int result;
+	memset(access, 0x0, sizeof(access));
+	if(core->type == ProfileCore_DWT){
+		access[0].addr = PROFILE_DEMCR;
+		access[0].size = DataSize_32;
+		result = core->ap->Interface.Memory.ReadMany(core->ap, access, 1);
+		if(result != ADI_SUCCESS || (access[0].data & PROFILE_DEMCR_TRCENA)) return result;
+		access[0].data |= PROFILE_DEMCR_TRCENA;
+		return core->ap->Interface.Memory.WriteMany(core->ap, access, 1);
+	}
+	access[0].addr = core->base + PROFILE_EDLAR;
+	access[0].size = DataSize_32;
+	access[0].data = PROFILE_UNLOCK_KEY;
+	access[1].addr = core->base + PROFILE_OSLAR;
+	access[1].size = DataSize_32;
+	access[1].data = 0;
+	return core->ap->Interface.Memory.WriteMany(core->ap, access, 2);
+}
+
+/**
+ * 采样线程到时自己结束后回收线程
+ * 返回:
+ * 	采样线程是否还在运行
+ */
+static BOOL isRunning(struct pcProfile *profile){
+	if(profile->running && !atomic_load_explicit(&profile->active, memory_order_acquire)){
+		ADIv5_ProfileWait(profile);
+	}
+	return profile->running;
+}
+
+/**
+ * ADIv5_ProfileCreate 创建PC采样分析对象
+ */
+int ADIv5_ProfileCreate(unsigned int batch, PcProfile *profileOut){
+	struct pcProfile *profile;
+	if(profileOut == NULL || batch == 0 || batch > PROFILE_MAX_BATCH){
+		return ADI_ERR_BAD_PARAMETER;
+	}
+	profile = calloc(1, sizeof(struct pcProfile));
+	if(profile == NULL){
+		log_error("Failed to create a profile object.");
+		return ADI_ERR_INTERNAL_ERROR;
+	}
+	profile->batch = batch;
+	if(growSlots(profile) == FALSE){
+		log_error("Failed to allocate the profile histogram.");
+		free(profile);
+		return ADI_ERR_INTERNAL_ERROR;
+	}
+	atomic_init(&profile->used, 0);
+	atomic_init(&profile->stop, FALSE);
+	atomic_init(&profile->active, FALSE);
+	*profileOut = profile;
+	return ADI_SUCCESS;
+}
+
+/**
+ * ADIv5_ProfileAddCore 增加核心
+ */
+int ADIv5_ProfileAddCore(PcProfile profile, AccessPort self, enum profileCoreType type, uint64_t base, unsigned int *coreOut){
+	struct profileCore *core;
+	assert(profile != NULL);
+	if(self == NULL || self->type != AccessPort_Memory || type > ProfileCore_EDPCSR64 || (base & 0x3)){
+		return ADI_ERR_BAD_PARAMETER;
+	}
+	if(isRunning(profile)){
+		log_warn("Cannot add a core while the profiler is running.");
+		return ADI_FAILED;
+	}
+	if(profile->coreCount == profile->coreCapacity){
+		unsigned int capacity = profile->coreCapacity ? profile->coreCapacity * 2 : 4;
+		core = realloc(profile->cores, capacity * sizeof(struct profileCore));
+		if(core == NULL){
+			log_error("Failed to allocate profile cores.");
+			return ADI_ERR_INTERNAL_ERROR;
+		}
+		profile->cores = core;
+		profile->coreCapacity = capacity;
+	}
+	core = &profile->cores[profile->coreCount];
+	core->ap = self;
+	core->type = type;
+	core->base = base;
+	core->sampleAddr = base + (type == ProfileCore_DWT ? PROFILE_DWT_PCSR : PROFILE_EDPCSR_LO);
+	if(coreOut) *coreOut = profile->coreCount;
+	profile->coreCount++;
+	return ADI_SUCCESS;
+}
+
+/**
+ * ADIv5_ProfileStart 启动采样线程
+ */
+int ADIv5_ProfileStart(PcProfile profile, unsigned int durationMs){
+	unsigned int idx;
+	int result;
+	assert(profile != NULL);
+	if(isRunning(profile)) return ADI_SUCCESS;
+	if(profile->coreCount == 0){
+		log_warn("No core to profile.");
+		return ADI_FAILED;
+	}
+	for(idx = 0; idx < profile->coreCount; idx++){
+		if((result = enableCore(&profile->cores[idx])) != ADI_SUCCESS){
+			log_error("Failed to enable PC sampling of core %u.", idx);
+			return result;
+		}
+	}
+	if((result = buildGroups(profile)) != ADI_SUCCESS){
+		log_error("Failed to allocate profile buffers.");
+		freeGroups(profile);
+		return result;
+	}
+	atomic_store(&profile->stop, FALSE);
+	atomic_store(&profile->active, TRUE);
+	atomic_store(&profile->lastError, ADI_SUCCESS);
+	profile->durationNs = (uint64_t)durationMs * 1000000ull;
+	profile->startNs = nowNs();
+	if(pthread_create(&profile->thread, NULL, profileThread, profile) != 0){
+		log_error("Failed to start the profile thread.");
+		atomic_store(&profile->active, FALSE);
+		return ADI_ERR_INTERNAL_ERROR;
+	}
+	profile->running = TRUE;
+	return ADI_SUCCESS;
+}
+
+/**
+ * ADIv5_ProfileWait 等待采样线程结束
+ */
+void ADIv5_ProfileWait(PcProfile profile){
+	assert(profile != NULL);
+	if(!profile->running) return;
+	pthread_join(profile->thread, NULL);
+	profile->running = FALSE;
+}
+
+/**
+ * ADIv5_ProfileStop 停止采样线程
+ */
+void ADIv5_ProfileStop(PcProfile profile){
+	assert(profile != NULL);
+	if(!profile->running) return;
+	atomic_store_explicit(&profile->stop, TRUE, memory_order_release);
+	ADIv5_ProfileWait(profile);
+}
+
+/**
+ * ADIv5_ProfileClear 清空直方图和统计
+ */
+void ADIv5_ProfileClear(PcProfile profile){
+	assert(profile != NULL);
+	if(isRunning(profile)){
+		log_warn("Cannot clear the histogram while the profiler is running.");
+		return;
+	}
+	memset(profile->slots, 0x0, profile->slotCount * sizeof(struct profileSlot));
+	atomic_store(&profile->used, 0);
+	atomic_store(&profile->samples, 0);
+	atomic_store(&profile->invalid, 0);
+	atomic_store(&profile->batches, 0);
+	atomic_store(&profile->errors, 0);
+	atomic_store(&profile->elapsedNs, 0);
+	atomic_store(&profile->lastError, ADI_SUCCESS);
+}
+
+/**
+ * ADIv5_ProfileStats 获得统计信息
+ */
+void ADIv5_ProfileStats(PcProfile profile, struct profileStats *stats){
+	assert(profile != NULL && stats != NULL);
+	stats->samples = atomic_load_explicit(&profile->samples, memory_order_relaxed);
+	stats->invalid = atomic_load_explicit(&profile->invalid, memory_order_relaxed);
+	stats->batches = atomic_load_explicit(&profile->batches, memory_order_relaxed);
+	stats->errors = atomic_load_explicit(&profile->errors, memory_order_relaxed);
+	stats->uniquePCs = atomic_load_explicit(&profile->used, memory_order_relaxed);
+	stats->lastError = atomic_load_explicit(&profile->lastError, memory_order_relaxed);
+	stats->running = atomic_load_explicit(&profile->active, memory_order_acquire);
+	stats->elapsedNs = atomic_load_explicit(&profile->elapsedNs, memory_order_relaxed);
+	// 运行中加上这一次已经采样的时间
+	if(stats->running) stats->elapsedNs += nowNs() - profile->startNs;
+}
+
+static int compareHit(const void *a, const void *b){
+	const struct profileHit *hitA = a, *hitB = b;
+	if(hitA->count != hitB->count) return hitA->count > hitB->count ? -1 : 1;
+	if(hitA->core != hitB->core) return hitA->core < hitB->core ? -1 : 1;
+	return hitA->pc < hitB->pc ? -1 : hitA->pc > hitB->pc;
+}
+
+/**
+ * ADIv5_ProfileHits 取出直方图
+ */
+unsigned int ADIv5_ProfileHits(PcProfile profile, struct profileHit **hitsOut){
+	struct profileHit *hits;
+	unsigned int idx, count = 0;
+	assert(profile != NULL && hitsOut != NULL);
+	*hitsOut = NULL;
+	if(isRunning(profile)){
+		log_warn("Cannot read the histogram while the profiler is running.");
+		return 0;
+	}
+	if(atomic_load(&profile->used) == 0) return 0;
+	hits = malloc(atomic_load(&profile->used) * sizeof(struct profileHit));
+	if(hits == NULL){
+		log_error("Failed to allocate profile hits.");
+		return 0;
+	}
+	for(idx = 0; idx < profile->slotCount; idx++){
+		if(profile->slots[idx].count == 0) continue;
+		hits[count].pc = profile->slots[idx].pc;
+		hits[count].core = profile->slots[idx].core;
+		hits[count].count = profile->slots[idx].count;
+		count++;
+	}
+	qsort(hits, count, sizeof(struct profileHit), compareHit);
+	*hitsOut = hits;
+	return count;
+}
+
+// 折叠栈的一行:同一核心同一函数的采样合并
+struct foldedLine {
+	uint32_t core;
+	const char *name;	// NULL表示没有解析到函数,使用pc
+	uint64_t pc;
+	uint64_t count;
+};
+
+static int compareFolded(const void *a, const void *b){
+	const struct foldedLine *lineA = a, *lineB = b;
+	if(lineA->core != lineB->core) return lineA->core < lineB->core ? -1 : 1;
+	if(lineA->name && lineB->name) return strcmp(lineA->name, lineB->name);
+	if(lineA->name || lineB->name) return lineA->name ? -1 : 1;
+	return lineA->pc < lineB->pc ? -1 : lineA->pc > lineB->pc;
+}
+
+static BOOL writeFolded(FILE *file, const struct profileHit *hits, unsigned int count, Symbols syms){
+	struct foldedLine *lines;
+	unsigned int idx, kept = 0;
+	BOOL ok = TRUE;
+	if(count == 0) return TRUE;
+	lines = malloc(count * sizeof(struct foldedLine));
+	if(lines == NULL) return FALSE;
+	for(idx = 0; idx < count; idx++){
+		lines[idx].core = hits[idx].core;
+		lines[idx].pc = hits[idx].pc;
+		lines[idx].count = hits[idx].count;
+		if(syms == NULL || symbols_Function(syms, hits[idx].pc, &lines[idx].name, NULL) == FALSE){
+			lines[idx].name = NULL;
+		}
+	}
+	qsort(lines, count, sizeof(struct foldedLine), compareFolded);
+	for(idx = 0; idx < count; idx++){
+		if(kept && compareFolded(&lines[kept - 1], &lines[idx]) == 0){
+			lines[kept - 1].count += lines[idx].count;
+			continue;
+		}
+		lines[kept++] = lines[idx];
+	}
+	for(idx = 0; idx < kept && ok; idx++){
+		if(lines[idx].name){
+			ok = fprintf(file, "core%" PRIu32 ";%s %" PRIu64 "\n", lines[idx].core, lines[idx].name, lines[idx].count) >= 0;
+		}else{
+			ok = fprintf(file, "core%" PRIu32 ";0x%08" PRIX64 " %" PRIu64 "\n", lines[idx].core, lines[idx].pc, lines[idx].count) >= 0;
+		}
+	}
+	free(lines);
+	return ok;
+}
+
+/**
+ * perf script的文本格式:"comm pid/tid [cpu] time: period event:",下一行是"\taddr sym+off (dso)"
+ */
+static BOOL writePerf(FILE *file, const struct profileHit *hits, unsigned int count, Symbols syms, uint64_t elapsedNs){
+	const char *name;
+	uint64_t offset;
+	unsigned int idx;
+	int written;
+	for(idx = 0; idx < count; idx++){
+		written = fprintf(file, "smartocd 0/%" PRIu32 " [%03" PRIu32 "] %" PRIu64 ".%06" PRIu64 ": %" PRIu64 " pc-sample:\n",
+				hits[idx].core, hits[idx].core, elapsedNs / UINT64_C(1000000000), (elapsedNs % UINT64_C(1000000000)) / 1000, hits[idx].count);
+		if(written < 0) return FALSE;
+		if(syms && symbols_Function(syms, hits[idx].pc, &name, &offset)){
+			written = fprintf(file, "\t%16" PRIx64 " %s+0x%" PRIx64 " ([target])\n\n", hits[idx].pc, name, offset);
+		}else{
+			written = fprintf(file, "\t%16" PRIx64 " [unknown] ([target])\n\n", hits[idx].pc);
+		}
+		if(written < 0) return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * ADIv5_ProfileExport 导出采样结果
+ */
+int ADIv5_ProfileExport(PcProfile profile, const char *path, enum profileExportFormat format, Symbols syms){
+	struct profileHit *hits;
+	unsigned int count;
+	FILE *file;
+	BOOL ok;
+	assert(profile != NULL && path != NULL);
+	if(isRunning(profile)){
+		log_warn("Cannot export while the profiler is running.");
+		return ADI_FAILED;
+	}
+	count = ADIv5_ProfileHits(profile, &hits);
+	if(count == 0 && atomic_load(&profile->used) != 0) return ADI_ERR_INTERNAL_ERROR;
+	file = fopen(path, "w");
+	if(file == NULL){
+		log_error("Failed to open %s: %s.", path, strerror(errno));
+		free(hits);
+		return ADI_FAILED;
+	}
+	if(format == ProfileExport_Perf){
+		ok = writePerf(file, hits, count, syms, atomic_load(&profile->elapsedNs));
+	}else{
+		ok = writeFolded(file, hits, count, syms);
+	}
+	if(fclose(file) != 0) ok = FALSE;
+	free(hits);
+	if(!ok){
+		log_error("Failed to write %s.", path);
+		return ADI_FAILED;
+	}
+	return ADI_SUCCESS;
+}
+
+/**
+ * ADIv5_ProfileDestroy 停止并销毁PC采样分析对象
+ */
+void ADIv5_ProfileDestroy(PcProfile *profilePtr){
+	struct pcProfile *profile;
+	assert(profilePtr != NULL && *profilePtr != NULL);
+	profile = *profilePtr;
+	ADIv5_ProfileStop(profile);
+	freeGroups(profile);
+	free(profile->cores);
+	free(profile->slots);
+	free(profile);
+	*profilePtr = NULL;
+}
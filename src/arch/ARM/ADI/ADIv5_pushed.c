@@ -0,0 +1,258 @@
+/*
+ * ADIv5_pushed.c
+ *
+ *  Created on: 2019-6-22
+ *      Author: virusv
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "smart_ocd.h"
+#include "misc/log.h"
+#include "misc/misc.h"
+
+#include "arch/ARM/ADI/ADIv5_private.h"
+
+/**
+ * Pushed-verify和Pushed-compare
+ * CTRL/STAT.TRNMODE设置为pushed模式后,对DRW的写操作不会写入内存,而是由AP读出TAR指向的数据和写入的值比较:
+ * pushed-verify在不相等时,pushed-compare在相等时置位STICKYCMP。
+ * 整个块在一次提交中写出,之后读CTRL/STAT检查STICKYCMP,置位时用二分法找到第一个命中的字
+ * MINDP没有实现pushed操作,用读回比较代替
+ */
+#define PUSHED_CHUNK_WORDS		256	// 每次提交的字数
+#define PUSHED_POWERUP_REQ		(DP_CTRL_CSYSPWRUPREQ | DP_CTRL_CDBGPWRUPREQ)
+
+/**
+ * 清除sticky标志,恢复普通传输模式
+ */
+static int pushedRestore(struct ADIv5_Dap *dap){
+	ADIv5_QueueTarget(dap);
+	dap->adapter->DapSingleWrite(dap->adapter, ADPT_DAP_DP_REG, DP_REG_ABORT,
+			DP_ABORT_STKCMPCLR | DP_ABORT_STKERRCLR | DP_ABORT_WDERRCLR | DP_ABORT_ORUNERRCLR);
+	dap->adapter->DapSingleWrite(dap->adapter, ADPT_DAP_DP_REG, DP_REG_CTRL_STAT, PUSHED_POWERUP_REQ);
+	return ADIv5_DapCommit(dap);
+}
+
+/**
+ * 以pushed模式写一段数据,返回STICKYCMP是否置位
+ * 没有置位时保持pushed模式,由调用者最后调用pushedRestore
+ * 参数:
+ * 	ctrl:CTRL/STAT中TRNMODE和MASKLANE的设置
+ * 	hit:STICKYCMP是否置位
+ */
+static int pushedChunk(struct ADIv5_AccessPort *ap, uint32_t ctrl, uint64_t addr, unsigned int count, uint32_t *data, BOOL *hit){
+	struct ADIv5_Dap *dap = ap->dap;
+	uint32_t ctrlStat = 0;
+	int result;
+
+	ADIv5_QueueTarget(dap);
+	dap->adapter->DapSingleWrite(dap->adapter, ADPT_DAP_DP_REG, DP_REG_CTRL_STAT, PUSHED_POWERUP_REQ | ctrl);
+	if((result = ADIv5_QueueBlockWrite(ap, addr, AddrInc_Single, DataSize_32, count, data)) != ADI_SUCCESS){
+		dap->adapter->DapCleanPending(dap->adapter);
+		return result;
+	}
+	ADIv5_QueueTarget(dap);
+	dap->adapter->DapSingleRead(dap->adapter, ADPT_DAP_DP_REG, DP_REG_CTRL_STAT, &ctrlStat);
+	if(dap->adapter->DapCommit(dap->adapter) != ADPT_SUCCESS){
+		// SWD下STICKYCMP置位后AP访问返回FAULT,读CTRL/STAT确认原因
+		ADIv5_DapInvalidate(dap);
+		ADIv5_QueueTarget(dap);
+		dap->adapter->DapSingleRead(dap->adapter, ADPT_DAP_DP_REG, DP_REG_CTRL_STAT, &ctrlStat);
+		if(ADIv5_DapCommit(dap) != ADI_SUCCESS){
+			return ADI_ERR_INTERNAL_ERROR;
+		}
+	}
+	if(!(ctrlStat & (DP_STAT_STICKYCMP | DP_STAT_STICKYERR))){
+		*hit = FALSE;
+		return ADI_SUCCESS;
+	}
+	if((result = pushedRestore(dap)) != ADI_SUCCESS){
+		return result;
+	}
+	if(ctrlStat & DP_STAT_STICKYERR){
+		log_error("Bus error during pushed transfer at 0x%" PRIX64 ".", addr);
+		return ADI_ERR_INTERNAL_ERROR;
+	}
+	*hit = TRUE;
+	return ADI_SUCCESS;
+}
+
+/**
+ * 找到第一个使STICKYCMP置位的字
+ * 参数:
+ * 	found:是否找到
+ * 	where:第一个命中的字的地址
+ */
+static int pushedFindRange(struct ADIv5_AccessPort *ap, uint32_t ctrl, uint64_t addr, unsigned int count, uint32_t *data,
+		BOOL *found, uint64_t *where){
+	unsigned int pos = 0, thisTimeCnt, lo, len, half;
+	BOOL hit;
+	int result;
+	*found = FALSE;
+	while(pos < count){
+		thisTimeCnt = count - pos < PUSHED_CHUNK_WORDS ? count - pos : PUSHED_CHUNK_WORDS;
+		if((result = pushedChunk(ap, ctrl, addr + ((uint64_t)pos << 2), thisTimeCnt, data + pos, &hit)) != ADI_SUCCESS){
+			return result;
+		}
+		if(!hit){
+			pos += thisTimeCnt;
+			continue;
+		}
+		// 二分查找:前一半没有命中,那么一定在后一半
+		lo = pos;
+		len = thisTimeCnt;
+		while(len > 1){
+			half = len >> 1;
+			if((result = pushedChunk(ap, ctrl, addr + ((uint64_t)lo << 2), half, data + lo, &hit)) != ADI_SUCCESS){
+				return result;
+			}
+			if(hit){
+				len = half;
+			}else{
+				lo += half;
+				len -= half;
+			}
+		}
+		*found = TRUE;
+		*where = addr + ((uint64_t)lo << 2);
+		return ADI_SUCCESS;
+	}
+	return ADI_SUCCESS;
+}
+
+static int pushedFind(struct ADIv5_AccessPort *ap, uint32_t ctrl, uint64_t addr, unsigned int count, uint32_t *data,
+		BOOL *found, uint64_t *where){
+	int result = pushedFindRange(ap, ctrl, addr, count, data, found, where);
+	int restore = pushedRestore(ap->dap);
+	return result != ADI_SUCCESS ? result : restore;
+}
+
+/**
+ * 读回比较,DP不支持pushed操作时使用
+ * 直接从目标读取,不经过主机端缓存
+ * 参数:
+ * 	expect:期望的数据,verify时每个字对应一个期望值,search时只使用expect[0]
+ * 	search:TRUE找第一个相等的字,FALSE找第一个不相等的字
+ * 	mask:比较的位
+ */
+static int readbackFind(struct ADIv5_AccessPort *ap, uint64_t addr, unsigned int count, const uint32_t *expect, BOOL search,
+		uint32_t mask, BOOL *found, uint64_t *where){
+	uint32_t buff[PUSHED_CHUNK_WORDS];
+	unsigned int pos = 0, thisTimeCnt, idx;
+	int result;
+	*found = FALSE;
+	while(pos < count){
+		thisTimeCnt = count - pos < PUSHED_CHUNK_WORDS ? count - pos : PUSHED_CHUNK_WORDS;
+		if((result = ADIv5_QueueBlockRead(ap, addr + ((uint64_t)pos << 2), AddrInc_Single, DataSize_32, thisTimeCnt, buff)) != ADI_SUCCESS){
+			ap->dap->adapter->DapCleanPending(ap->dap->adapter);
+			return result;
+		}
+		if((result = ADIv5_DapCommit(ap->dap)) != ADI_SUCCESS){
+			return result;
+		}
+		for(idx = 0; idx < thisTimeCnt; idx++){
+			BOOL equal = ((buff[idx] ^ (search ? expect[0] : expect[pos + idx])) & mask) == 0;
+			if(equal == search){
+				*found = TRUE;
+				*where = addr + ((uint64_t)(pos + idx) << 2);
+				return ADI_SUCCESS;
+			}
+		}
+		pos += thisTimeCnt;
+	}
+	return ADI_SUCCESS;
+}
+
+/**
+ * 检查AP并提交写合并缓冲区
+ */
+static struct ADIv5_AccessPort *pushedAp(AccessPort apApi, uint64_t addr){
+	struct ADIv5_AccessPort *ap;
+	assert(apApi != NULL);
+	if(apApi->type != AccessPort_Memory){
+		log_error("Not a memory access port!");
+		return NULL;
+	}
+	if(addr & 0x3){
+		log_error("Address 0x%" PRIX64 " is not word aligned!", addr);
+		return NULL;
+	}
+	ap = container_of(apApi, struct ADIv5_AccessPort, apApi);
+	// 比较的是目标内存,缓冲区中的写操作必须先提交
+	if(ADIv5_WriteBufferFlush(ap, 0, 0) != ADI_SUCCESS){
+		return NULL;
+	}
+	return ap;
+}
+
+/**
+ * ADIv5_Verify 校验内存
+ */
+int ADIv5_Verify(AccessPort apApi, uint64_t addr, unsigned int count, const uint32_t *expect, uint64_t *mismatch){
+	assert(expect != NULL && mismatch != NULL);
+	struct ADIv5_AccessPort *ap = pushedAp(apApi, addr);
+	BOOL found;
+	int result;
+	if(ap == NULL) return ADI_ERR_BAD_PARAMETER;
+	if(ap->dap->idr.regInfo.Min){
+		result = readbackFind(ap, addr, count, expect, FALSE, 0xFFFFFFFFu, &found, mismatch);
+	}else{
+		// pushed写不会修改数据,但是接口要求可写的缓冲区
+		result = pushedFind(ap, DP_CTRL_TRNVERIFY | DP_CTRL_MASKLANEMSK, addr, count, CAST(uint32_t *, expect), &found, mismatch);
+	}
+	if(result != ADI_SUCCESS){
+		return result;
+	}
+	return found ? ADI_FAILED : ADI_SUCCESS;
+}
+
+/**
+ * ADIv5_Search 在内存中查找数据
+ */
+int ADIv5_Search(AccessPort apApi, uint64_t addr, unsigned int count, uint32_t value, uint8_t lanes, uint64_t *where){
+	assert(where != NULL);
+	struct ADIv5_AccessPort *ap = pushedAp(apApi, addr);
+	uint32_t *pattern, mask = 0;
+	unsigned int idx;
+	BOOL found;
+	int result;
+	if(ap == NULL) return ADI_ERR_BAD_PARAMETER;
+	lanes &= 0xF;
+	if(lanes == 0){
+		log_error("At least one byte lane must be compared!");
+		return ADI_ERR_BAD_PARAMETER;
+	}
+	for(idx = 0; idx < 4; idx++){
+		if(lanes & (1u << idx)) mask |= 0xFFu << (idx << 3);
+	}
+	if(ap->dap->idr.regInfo.Min){
+		result = readbackFind(ap, addr, count, &value, TRUE, mask, &found, where);
+	}else{
+		// 每个字都写同样的值
+		pattern = malloc(PUSHED_CHUNK_WORDS * sizeof(uint32_t));
+		if(pattern == NULL){
+			log_error("Failed to allocate pattern buffer!");
+			return ADI_ERR_INTERNAL_ERROR;
+		}
+		for(idx = 0; idx < PUSHED_CHUNK_WORDS; idx++){
+			pattern[idx] = value;
+		}
+		result = ADI_SUCCESS;
+		found = FALSE;
+		// pattern只有一块大小,逐块查找
+		for(idx = 0; idx < count && result == ADI_SUCCESS && !found; idx += PUSHED_CHUNK_WORDS){
+			result = pushedFindRange(ap, DP_CTRL_TRNCOMPARE | ((uint32_t)lanes << 8), addr + ((uint64_t)idx << 2),
+					count - idx < PUSHED_CHUNK_WORDS ? count - idx : PUSHED_CHUNK_WORDS, pattern, &found, where);
+		}
+		if(pushedRestore(ap->dap) != ADI_SUCCESS && result == ADI_SUCCESS){
+			result = ADI_ERR_INTERNAL_ERROR;
+		}
+		free(pattern);
+	}
+	if(result != ADI_SUCCESS){
+		return result;
+	}
+	return found ? ADI_SUCCESS : ADI_FAILED;
+}
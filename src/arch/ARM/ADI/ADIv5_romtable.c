@@ -0,0 +1,592 @@
+/*
+ * ADIv5_romtable.c
+ *
+ *  Created on: 2019-6-15
+ *      Author: virusv
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "smart_ocd.h"
+#include "misc/log.h"
+#include "misc/misc.h"
+
+#include "arch/ARM/ADI/ADIv5_private.h"
+
+/**
+ * 组件的ID寄存器块:从0xFBC(DEVARCH)到0xFFC(CID3)
+ */
+#define ID_BLOCK_OFFSET		0xFBC
+#define ID_BLOCK_WORDS		17
+#define ID_DEVARCH			0	// 0xFBC
+#define ID_DEVTYPE			4	// 0xFCC
+#define ID_PID4				5	// 0xFD0
+#define ID_PID0				9	// 0xFE0
+#define ID_CID0				13	// 0xFF0
+
+// 每次预取的ROM Table表项数
+#define ENTRY_PREFETCH		64
+// Class 0x1 ROM Table最多960个表项(0x000-0xEFC),Class 0x9 ROM Table最多512个32位表项(0x000-0x7FC)
+#define CLASS1_MAX_ENTRIES	960
+#define CLASS9_MAX_ENTRIES	512
+// ROM Table最大嵌套深度,防止错误的表项造成死循环
+#define ROM_TABLE_MAX_DEPTH	16
+// DEVARCH.ARCHID = 0x0AF7,DEVARCH.PRESENT = 1,ARCHITECT = ARM:Class 0x9 ROM Table
+#define DEVARCH_ROM_TABLE	0x47700AF7
+#define DEVARCH_MASK		0xFFF0FFFF
+
+// ROM Table磁盘缓存
+#define ROM_TABLE_CACHE_MAGIC	0x4C42544D	// "MTBL"
+#define ROM_TABLE_CACHE_VERSION	1
+struct romTableCacheHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t dpidr;
+	uint32_t targetId;
+	uint64_t romBase;
+	uint32_t apIndex;
+	uint32_t nodeCount;	// 组件个数
+	uint32_t rootEntryCount;	// 根ROM Table的表项个数,包括结束符
+	uint32_t reserved;
+};
+struct romTableCacheNode {
+	uint64_t base;
+	uint64_t size;
+	uint64_t pid;
+	uint32_t cid;
+	uint32_t devArch;
+	uint32_t childCount;
+	uint16_t partNumber;
+	uint16_t designer;
+	uint8_t devType;
+	uint8_t componentClass;
+	uint8_t revision;
+	uint8_t valid;
+};
+
+/**
+ * 遍历过程中的组件信息
+ */
+struct walkNode {
+	struct coresightComponent *comp;
+	uint64_t idBase;	// ID寄存器所在的4KB块
+	uint32_t ids[ID_BLOCK_WORDS];
+	uint32_t *entries;	// ROM Table表项
+	unsigned int entryCount;	// 已读取的表项数
+	unsigned int maxEntries;	// 最大表项数,0表示不是ROM Table
+	BOOL end;	// 已经读到ROM Table的结束符
+};
+
+/**
+ * 清除STICKYERR等错误标志,使错误之后的访问可以继续进行
+ */
+static void clearStickyError(struct ADIv5_Dap *dap){
+	ADIv5_QueueTarget(dap);
+	dap->adapter->DapSingleWrite(dap->adapter, ADPT_DAP_DP_REG, DP_REG_ABORT,
+			DP_ABORT_STKCMPCLR | DP_ABORT_STKERRCLR | DP_ABORT_WDERRCLR | DP_ABORT_ORUNERRCLR);
+	ADIv5_DapCommit(dap);
+}
+
+/**
+ * 根据ID寄存器的值填充组件信息
+ */
+static void decodeComponent(struct walkNode *node){
+	struct coresightComponent *comp = node->comp;
+	const uint32_t *ids = node->ids;
+	uint32_t pid4;
+	unsigned int idx;
+	comp->cid = 0;
+	comp->pid = 0;
+	for(idx = 0; idx < 4; idx++){
+		comp->cid |= (ids[ID_CID0 + idx] & 0xff) << (idx << 3);
+		comp->pid |= (uint64_t)(ids[ID_PID0 + idx] & 0xff) << (idx << 3);
+		comp->pid |= (uint64_t)(ids[ID_PID4 + idx] & 0xff) << ((idx + 4) << 3);
+	}
+	// Component ID的preamble必须是0xB105_X00D
+	comp->valid = (comp->cid & 0xFFFF0FFF) == 0xB105000D;
+	comp->componentClass = (comp->cid >> 12) & 0xF;
+	comp->partNumber = comp->pid & 0xFFF;
+	comp->designer = ((comp->pid >> 32) & 0xF) << 7 | ((comp->pid >> 12) & 0x7F);
+	comp->revision = (comp->pid >> 20) & 0xF;
+	pid4 = ids[ID_PID4];
+	// PID4.SIZE:组件占用4KB块个数的log2,ID寄存器在最后一个4KB块中
+	comp->size = 0x1000ull << ((pid4 >> 4) & 0xF);
+	comp->base = node->idBase - (comp->size - 0x1000);
+	// Class 0x1 ROM Table的0xFCC是MEMTYPE寄存器
+	if(comp->componentClass == 0x9 || comp->componentClass == 0x1){
+		comp->devType = ids[ID_DEVTYPE] & 0xFF;
+	}
+	if(comp->componentClass == 0x9){
+		comp->devArch = ids[ID_DEVARCH];
+	}
+	node->maxEntries = 0;
+	if(comp->valid){
+		if(comp->componentClass == 0x1){
+			node->maxEntries = CLASS1_MAX_ENTRIES;
+		}else if(comp->componentClass == 0x9 && (comp->devArch & DEVARCH_MASK) == DEVARCH_ROM_TABLE){
+			node->maxEntries = CLASS9_MAX_ENTRIES;
+		}
+	}
+}
+
+/**
+ * 读取一层组件的ID寄存器,所有组件在一次提交中读取
+ * 如果提交失败(比如某个组件掉电),清除错误后逐个读取,读取失败的组件标记为无效
+ */
+static int readIdBlocks(struct ADIv5_AccessPort *ap, struct walkNode *nodes, unsigned int count){
+	unsigned int idx;
+	int result;
+	if(count == 0) return ADI_SUCCESS;
+	for(idx = 0; idx < count; idx++){
+		result = ADIv5_QueueBlockRead(ap, nodes[idx].idBase + ID_BLOCK_OFFSET, AddrInc_Single, DataSize_32, ID_BLOCK_WORDS, nodes[idx].ids);
+		if(result != ADI_SUCCESS){
+			ADIv5_DapInvalidate(ap->dap);
+			return result;
+		}
+	}
+	if(ADIv5_DapCommit(ap->dap) != ADI_SUCCESS){
+		log_info("Read component ID registers in one transaction failed, retry one by one.");
+		for(idx = 0; idx < count; idx++){
+			clearStickyError(ap->dap);
+			result = ADIv5_QueueBlockRead(ap, nodes[idx].idBase + ID_BLOCK_OFFSET, AddrInc_Single, DataSize_32, ID_BLOCK_WORDS, nodes[idx].ids);
+			if(result != ADI_SUCCESS){
+				ADIv5_DapInvalidate(ap->dap);
+				return result;
+			}
+			if(ADIv5_DapCommit(ap->dap) != ADI_SUCCESS){
+				log_warn("Component at 0x%" PRIX64 " is not accessible.", nodes[idx].idBase);
+				memset(nodes[idx].ids, 0x0, sizeof(nodes[idx].ids));
+			}
+		}
+		clearStickyError(ap->dap);
+	}
+	for(idx = 0; idx < count; idx++){
+		decodeComponent(&nodes[idx]);
+	}
+	return ADI_SUCCESS;
+}
+
+/**
+ * 读取一层所有ROM Table的表项,每次提交为每个ROM Table预取ENTRY_PREFETCH个表项,
+ * 直到所有ROM Table都读到结束符
+ */
+static int readEntries(struct ADIv5_AccessPort *ap, struct walkNode *nodes, unsigned int count){
+	unsigned int idx, pos, num;
+	int result;
+	BOOL pending;
+	do{
+		pending = FALSE;
+		for(idx = 0; idx < count; idx++){
+			struct walkNode *node = &nodes[idx];
+			if(node->maxEntries == 0 || node->end) continue;
+			num = node->maxEntries - node->entryCount;
+			if(num > ENTRY_PREFETCH) num = ENTRY_PREFETCH;
+			if(node->entries == NULL){
+				node->entries = calloc(node->maxEntries, sizeof(uint32_t));
+				if(node->entries == NULL){
+					log_error("Failed to allocate ROM Table entries!");
+					ADIv5_DapInvalidate(ap->dap);
+					return ADI_ERR_INTERNAL_ERROR;
+				}
+			}
+			result = ADIv5_QueueBlockRead(ap, node->idBase + (node->entryCount << 2), AddrInc_Single, DataSize_32, num, node->entries + node->entryCount);
+			if(result != ADI_SUCCESS){
+				ADIv5_DapInvalidate(ap->dap);
+				return result;
+			}
+			pending = TRUE;
+		}
+		if(pending == FALSE) break;
+		if(ADIv5_DapCommit(ap->dap) != ADI_SUCCESS){
+			log_error("Read ROM Table entries failed!");
+			return ADI_ERR_INTERNAL_ERROR;
+		}
+		for(idx = 0; idx < count; idx++){
+			struct walkNode *node = &nodes[idx];
+			if(node->maxEntries == 0 || node->end) continue;
+			num = node->maxEntries - node->entryCount;
+			if(num > ENTRY_PREFETCH) num = ENTRY_PREFETCH;
+			// 查找结束符
+			for(pos = node->entryCount; pos < node->entryCount + num; pos++){
+				if(node->comp->componentClass == 0x9 ? (node->entries[pos] & 0x3) == 0 : node->entries[pos] == 0){
+					node->end = TRUE;
+					break;
+				}
+			}
+			node->entryCount = pos;
+			if(node->entryCount >= node->maxEntries) node->end = TRUE;
+		}
+	}while(1);
+	return ADI_SUCCESS;
+}
+
+/**
+ * 判断表项是否指向一个存在的组件
+ * Class 0x1:bit0 Present,bit1 Format必须是32位
+ * Class 0x9:bit[1:0] = 0b11表示存在,0b10表示不存在但需要继续遍历
+ */
+static BOOL entryPresent(uint32_t entry){
+	return (entry & 0x3) == 0x3 ? TRUE : FALSE;
+}
+
+/**
+ * 释放组件树
+ */
+static void freeComponents(struct coresightComponent *comp){
+	unsigned int idx;
+	for(idx = 0; idx < comp->childCount; idx++){
+		freeComponents(&comp->children[idx]);
+	}
+	free(comp->children);
+	comp->children = NULL;
+	comp->childCount = 0;
+}
+
+/**
+ * 释放ROM Table组件树
+ */
+void ADIv5_FreeRomTable(struct coresightComponent *root){
+	if(root == NULL) return;
+	freeComponents(root);
+	free(root);
+}
+
+/**
+ * 判断地址是否已经在遍历过的组件中,防止环路
+ */
+static BOOL visited(struct walkNode *nodes, unsigned int count, uint64_t idBase){
+	unsigned int idx;
+	for(idx = 0; idx < count; idx++){
+		if(nodes[idx].idBase == idBase) return TRUE;
+	}
+	return FALSE;
+}
+
+/**
+ * walkRomTable 按层遍历ROM Table
+ * 每一层:一次提交读取该层所有组件的ID寄存器,然后一起预取该层所有ROM Table的表项
+ */
+static int walkRomTable(struct ADIv5_AccessPort *ap, uint64_t tableBase, struct coresightComponent **rootOut,
+		uint32_t **rootEntries, unsigned int *rootEntryCount){
+	struct walkNode *level, *next = NULL, *all = NULL;
+	unsigned int levelCount = 1, nextCount, allCount = 0, idx, pos, depth;
+	struct coresightComponent *root;
+	int result = ADI_SUCCESS;
+
+	root = calloc(1, sizeof(struct coresightComponent));
+	level = calloc(1, sizeof(struct walkNode));
+	if(root == NULL || level == NULL){
+		log_error("Failed to allocate ROM Table component!");
+		free(root);
+		free(level);
+		return ADI_ERR_INTERNAL_ERROR;
+	}
+	level[0].comp = root;
+	level[0].idBase = tableBase;
+	*rootEntries = NULL;
+	*rootEntryCount = 0;
+	for(depth = 0; levelCount > 0 && depth < ROM_TABLE_MAX_DEPTH; depth++){
+		if((result = readIdBlocks(ap, level, levelCount)) != ADI_SUCCESS) break;
+		if((result = readEntries(ap, level, levelCount)) != ADI_SUCCESS) break;
+		// 记录已经遍历过的组件
+		struct walkNode *allTmp = realloc(all, (allCount + levelCount) * sizeof(struct walkNode));
+		if(allTmp == NULL){
+			result = ADI_ERR_INTERNAL_ERROR;
+			break;
+		}
+		all = allTmp;
+		memcpy(all + allCount, level, levelCount * sizeof(struct walkNode));
+		allCount += levelCount;
+		// 建立下一层的组件
+		nextCount = 0;
+		for(idx = 0; idx < levelCount; idx++){
+			for(pos = 0; pos < level[idx].entryCount; pos++){
+				if(entryPresent(level[idx].entries[pos])) nextCount++;
+			}
+		}
+		next = calloc(nextCount ? nextCount : 1, sizeof(struct walkNode));
+		if(next == NULL){
+			result = ADI_ERR_INTERNAL_ERROR;
+			break;
+		}
+		nextCount = 0;
+		for(idx = 0; idx < levelCount; idx++){
+			struct walkNode *node = &level[idx];
+			unsigned int childCount = 0;
+			for(pos = 0; pos < node->entryCount; pos++){
+				if(entryPresent(node->entries[pos])) childCount++;
+			}
+			if(childCount == 0) continue;
+			node->comp->children = calloc(childCount, sizeof(struct coresightComponent));
+			if(node->comp->children == NULL){
+				result = ADI_ERR_INTERNAL_ERROR;
+				break;
+			}
+			for(pos = 0; pos < node->entryCount; pos++){
+				uint32_t entry = node->entries[pos];
+				uint64_t childBase;
+				if(!entryPresent(entry)) continue;
+				// 表项的[31:12]是有符号的地址偏移
+				childBase = node->idBase + (int64_t)(int32_t)(entry & 0xFFFFF000);
+				if(ap->type.memory.config.largeAddress == 0) childBase &= 0xFFFFFFFFull;
+				if(visited(all, allCount, childBase) || visited(next, nextCount, childBase)){
+					log_warn("ROM Table entry 0x%08X points to a visited component.", entry);
+					continue;
+				}
+				next[nextCount].comp = &node->comp->children[node->comp->childCount++];
+				next[nextCount].comp->base = childBase;
+				next[nextCount].idBase = childBase;
+				nextCount++;
+			}
+		}
+		if(result != ADI_SUCCESS) break;
+		if(depth == 0){
+			// 记录根ROM Table的表项(包括结束符),用于下次连接时验证缓存
+			*rootEntryCount = level[0].end && level[0].entryCount < level[0].maxEntries ? level[0].entryCount + 1 : level[0].entryCount;
+			*rootEntries = level[0].entries;
+			level[0].entries = NULL;
+			all[0].entries = NULL;
+		}
+		for(idx = 0; idx < levelCount; idx++){
+			free(level[idx].entries);
+			level[idx].entries = NULL;
+		}
+		free(level);
+		level = next;
+		levelCount = nextCount;
+		next = NULL;
+	}
+	for(idx = 0; idx < levelCount; idx++){
+		free(level[idx].entries);
+	}
+	free(level);
+	free(next);
+	free(all);
+	if(result != ADI_SUCCESS){
+		ADIv5_FreeRomTable(root);
+		free(*rootEntries);
+		*rootEntries = NULL;
+		return result;
+	}
+	*rootOut = root;
+	return ADI_SUCCESS;
+}
+
+/**
+ * ROM Table缓存文件名,以DPIDR,TARGETID,AP索引和ROM Table基址作为键值
+ */
+static BOOL romTableCacheName(struct ADIv5_AccessPort *ap, char *name, size_t size){
+	if(ap->dap->idr.regData == 0) return FALSE;
+	snprintf(name, size, "romtable-%08X-%08X-%02X-%016" PRIX64 ".bin",
+			ap->dap->idr.regData, ap->dap->targetId, ap->index, ap->type.memory.rom);
+	return TRUE;
+}
+
+/**
+ * 统计组件个数
+ */
+static unsigned int countComponents(const struct coresightComponent *comp){
+	unsigned int idx, count = 1;
+	for(idx = 0; idx < comp->childCount; idx++){
+		count += countComponents(&comp->children[idx]);
+	}
+	return count;
+}
+
+/**
+ * 先序序列化组件树
+ */
+static struct romTableCacheNode *serializeComponents(const struct coresightComponent *comp, struct romTableCacheNode *out){
+	unsigned int idx;
+	out->base = comp->base;
+	out->size = comp->size;
+	out->pid = comp->pid;
+	out->cid = comp->cid;
+	out->devArch = comp->devArch;
+	out->childCount = comp->childCount;
+	out->partNumber = comp->partNumber;
+	out->designer = comp->designer;
+	out->devType = comp->devType;
+	out->componentClass = comp->componentClass;
+	out->revision = comp->revision;
+	out->valid = comp->valid;
+	out++;
+	for(idx = 0; idx < comp->childCount; idx++){
+		out = serializeComponents(&comp->children[idx], out);
+	}
+	return out;
+}
+
+/**
+ * 反序列化组件树
+ * 返回:下一个节点,NULL表示数据不完整
+ */
+static const struct romTableCacheNode *deserializeComponents(struct coresightComponent *comp,
+		const struct romTableCacheNode *in, const struct romTableCacheNode *end){
+	unsigned int idx;
+	if(in >= end) return NULL;
+	comp->base = in->base;
+	comp->size = in->size;
+	comp->pid = in->pid;
+	comp->cid = in->cid;
+	comp->devArch = in->devArch;
+	comp->partNumber = in->partNumber;
+	comp->designer = in->designer;
+	comp->devType = in->devType;
+	comp->componentClass = in->componentClass;
+	comp->revision = in->revision;
+	comp->valid = in->valid;
+	comp->childCount = 0;
+	if(in->childCount > (unsigned int)(end - in)) return NULL;
+	if(in->childCount){
+		comp->children = calloc(in->childCount, sizeof(struct coresightComponent));
+		if(comp->children == NULL) return NULL;
+	}
+	idx = in->childCount;
+	in++;
+	for(; idx > 0; idx--){
+		in = deserializeComponents(&comp->children[comp->childCount++], in, end);
+		if(in == NULL) return NULL;
+	}
+	return in;
+}
+
+/**
+ * 把组件树写入磁盘缓存
+ */
+static void storeRomTableCache(struct ADIv5_AccessPort *ap, const struct coresightComponent *root,
+		const uint32_t *rootEntries, unsigned int rootEntryCount){
+	char name[80];
+	struct romTableCacheHeader *header;
+	unsigned int nodeCount = countComponents(root);
+	size_t length = sizeof(struct romTableCacheHeader) + rootEntryCount * sizeof(uint32_t)
+			+ nodeCount * sizeof(struct romTableCacheNode);
+	if(romTableCacheName(ap, name, sizeof(name)) == FALSE) return;
+	header = calloc(1, length);
+	if(header == NULL) return;
+	header->magic = ROM_TABLE_CACHE_MAGIC;
+	header->version = ROM_TABLE_CACHE_VERSION;
+	header->dpidr = ap->dap->idr.regData;
+	header->targetId = ap->dap->targetId;
+	header->romBase = ap->type.memory.rom;
+	header->apIndex = ap->index;
+	header->nodeCount = nodeCount;
+	header->rootEntryCount = rootEntryCount;
+	memcpy(header + 1, rootEntries, rootEntryCount * sizeof(uint32_t));
+	serializeComponents(root, CAST(struct romTableCacheNode *, CAST(uint32_t *, header + 1) + rootEntryCount));
+	if(misc_CacheStore(name, header, length) == FALSE){
+		log_debug("Failed to store ROM Table cache.");
+	}
+	free(header);
+}
+
+/**
+ * 读取磁盘缓存的组件树,然后用一次提交重新读取根组件的ID寄存器和根ROM Table的表项来验证
+ */
+static int loadRomTableCache(struct ADIv5_AccessPort *ap, uint64_t tableBase, struct coresightComponent **rootOut){
+	char name[80];
+	struct romTableCacheHeader *header;
+	const struct romTableCacheNode *nodes;
+	struct coresightComponent *root;
+	struct walkNode check;
+	uint32_t *entries;
+	size_t length;
+	if(romTableCacheName(ap, name, sizeof(name)) == FALSE) return ADI_FAILED;
+	if(misc_CacheLoad(name, (void **)&header, &length) == FALSE) return ADI_FAILED;
+	if(length < sizeof(struct romTableCacheHeader) || header->magic != ROM_TABLE_CACHE_MAGIC
+			|| header->version != ROM_TABLE_CACHE_VERSION || header->dpidr != ap->dap->idr.regData
+			|| header->targetId != ap->dap->targetId || header->romBase != ap->type.memory.rom
+			|| header->apIndex != ap->index || header->rootEntryCount > CLASS1_MAX_ENTRIES || header->nodeCount == 0
+			|| length != sizeof(struct romTableCacheHeader) + header->rootEntryCount * sizeof(uint32_t)
+				+ header->nodeCount * sizeof(struct romTableCacheNode)){
+		free(header);
+		return ADI_FAILED;
+	}
+	nodes = CAST(const struct romTableCacheNode *, CAST(uint32_t *, header + 1) + header->rootEntryCount);
+	entries = calloc(header->rootEntryCount ? header->rootEntryCount : 1, sizeof(uint32_t));
+	if(entries == NULL){
+		free(header);
+		return ADI_FAILED;
+	}
+	// 一次提交验证
+	memset(&check, 0x0, sizeof(check));
+	if(ADIv5_QueueBlockRead(ap, tableBase + ID_BLOCK_OFFSET, AddrInc_Single, DataSize_32, ID_BLOCK_WORDS, check.ids) != ADI_SUCCESS
+			|| ADIv5_QueueBlockRead(ap, tableBase, AddrInc_Single, DataSize_32, header->rootEntryCount, entries) != ADI_SUCCESS){
+		ADIv5_DapInvalidate(ap->dap);
+		free(entries);
+		free(header);
+		return ADI_FAILED;
+	}
+	if(ADIv5_DapCommit(ap->dap) != ADI_SUCCESS){
+		clearStickyError(ap->dap);
+		free(entries);
+		free(header);
+		return ADI_FAILED;
+	}
+	struct coresightComponent checkComp;
+	check.comp = &checkComp;
+	check.idBase = tableBase;
+	decodeComponent(&check);
+	if(checkComp.cid != nodes[0].cid || checkComp.pid != nodes[0].pid
+			|| memcmp(entries, header + 1, header->rootEntryCount * sizeof(uint32_t)) != 0){
+		log_info("ROM Table cache is out of date.");
+		free(entries);
+		free(header);
+		return ADI_FAILED;
+	}
+	free(entries);
+	root = calloc(1, sizeof(struct coresightComponent));
+	if(root == NULL){
+		free(header);
+		return ADI_FAILED;
+	}
+	if(deserializeComponents(root, nodes, nodes + header->nodeCount) == NULL){
+		ADIv5_FreeRomTable(root);
+		free(header);
+		return ADI_FAILED;
+	}
+	free(header);
+	*rootOut = root;
+	log_debug("Load ROM Table from cache.");
+	return ADI_SUCCESS;
+}
+
+/**
+ * readRomTable 读取MEM-AP的ROM Table组件树
+ */
+int ADIv5_ReadRomTable(DAP self, AccessPort apApi, const struct coresightComponent **rootOut){
+	assert(self != NULL && apApi != NULL && rootOut != NULL);
+	struct ADIv5_Dap *dapObj = container_of(self, struct ADIv5_Dap, dapApi);
+	struct ADIv5_AccessPort *ap = container_of(apApi, struct ADIv5_AccessPort, apApi);
+	struct coresightComponent *root = NULL;
+	uint32_t *rootEntries;
+	unsigned int rootEntryCount;
+	uint64_t tableBase;
+	int result;
+	if(apApi->type != AccessPort_Memory || ap->dap != dapObj){
+		log_error("Not a memory access port of this DAP!");
+		return ADI_ERR_BAD_PARAMETER;
+	}
+	if(ap->type.memory.romTable != NULL){
+		*rootOut = ap->type.memory.romTable;
+		return ADI_SUCCESS;
+	}
+	// BASE寄存器:bit0表示是否存在调试组件,0xFFFFFFFF是不存在ROM Table的旧格式
+	if(ap->type.memory.rom == 0xFFFFFFFFu || (ap->type.memory.rom & 0x1) == 0){
+		log_warn("No debug entry present on this AP.");
+		return ADI_FAILED;
+	}
+	tableBase = ap->type.memory.rom & ~0xFFFull;
+	if(loadRomTableCache(ap, tableBase, &root) != ADI_SUCCESS){
+		result = walkRomTable(ap, tableBase, &root, &rootEntries, &rootEntryCount);
+		if(result != ADI_SUCCESS){
+			return result;
+		}
+		storeRomTableCache(ap, root, rootEntries, rootEntryCount);
+		free(rootEntries);
+	}
+	ap->type.memory.romTable = root;
+	*rootOut = root;
+	return ADI_SUCCESS;
+}
@@ -0,0 +1,203 @@
+/*
+ * ADIv5_scan.c
+ *
+ *  Created on: 2019-6-24
+ *      Author: virusv
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "smart_ocd.h"
+#include "misc/log.h"
+#include "misc/misc.h"
+
+#include "arch/ARM/ADI/ADIv5_private.h"
+
+/**
+ * 主机端内存扫描
+ * 目标内存按SCAN_CHUNK_SIZE大小的块读到主机端,每块一次提交,
+ * 块之间保留patternLen-1字节,跨块的匹配不会丢失
+ * 查找时用memchr定位第一个完整比较的字节,再比较整个字节串
+ */
+#define SCAN_CHUNK_SIZE			(64u << 10)	// 每次读取的字节数
+#define SCAN_MAX_PATTERN		4096u
+
+struct memScan {
+	struct ADIv5_AccessPort *ap;
+	uint8_t *pattern;	// 已经和mask相与
+	uint8_t *mask;		// NULL表示全部比较
+	unsigned int patternLen;
+	unsigned int align;
+	int anchor;			// memchr定位用的字节下标,-1表示没有完整比较的字节
+	uint64_t next;		// 下一次读取的地址
+	uint64_t end;		// 扫描范围的结束地址
+	uint64_t readEnd;	// 读取的结束地址,字对齐
+	uint64_t base;		// buff[0]对应的地址,字对齐
+	unsigned int length;	// buff中有效的字节数
+	unsigned int pos;	// 下一个要比较的位置
+	uint8_t *buff;
+};
+
+static BOOL scanMatch(struct memScan *scan, unsigned int pos){
+	const uint8_t *data = scan->buff + pos;
+	unsigned int idx;
+	if(scan->mask == NULL){
+		return memcmp(data, scan->pattern, scan->patternLen) == 0;
+	}
+	for(idx = 0; idx < scan->patternLen; idx++){
+		if((data[idx] & scan->mask[idx]) != scan->pattern[idx]) return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * 在已经读取的数据中查找下一个匹配
+ */
+static BOOL scanBuffer(struct memScan *scan, uint64_t *where){
+	unsigned int limit = scan->length, last, pos;
+	const uint8_t *hit;
+	// 读取时按字对齐,尾部可能超出扫描范围
+	if(scan->base + limit > scan->end){
+		limit = (unsigned int)(scan->end - scan->base);
+	}
+	if(limit < scan->patternLen){
+		return FALSE;
+	}
+	last = limit - scan->patternLen;
+	while(scan->pos <= last){
+		pos = scan->pos;
+		if(scan->anchor >= 0){
+			hit = memchr(scan->buff + pos + scan->anchor, scan->pattern[scan->anchor], last - pos + 1);
+			if(hit == NULL){
+				scan->pos = last + 1;
+				return FALSE;
+			}
+			pos = (unsigned int)(hit - scan->buff) - scan->anchor;
+		}
+		scan->pos = pos + 1;
+		if(((scan->base + pos) & (scan->align - 1)) == 0 && scanMatch(scan, pos)){
+			*where = scan->base + pos;
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+/**
+ * 丢弃已经比较过的数据,读取下一块
+ */
+static int scanFill(struct memScan *scan){
+	// 保持base字对齐,块读的目标缓冲区才是字对齐的
+	unsigned int drop = scan->pos & ~0x3u, bytes;
+	uint64_t readEnd;
+	int result;
+	memmove(scan->buff, scan->buff + drop, scan->length - drop);
+	scan->base += drop;
+	scan->length -= drop;
+	scan->pos -= drop;
+
+	readEnd = scan->next + SCAN_CHUNK_SIZE < scan->readEnd ? scan->next + SCAN_CHUNK_SIZE : scan->readEnd;
+	bytes = (unsigned int)(readEnd - scan->next);
+	result = scan->ap->apApi.Interface.Memory.BlockRead(&scan->ap->apApi, scan->next, AddrInc_Single, DataSize_32,
+			bytes >> 2, scan->buff + scan->length);
+	if(result != ADI_SUCCESS){
+		log_error("Failed to read memory at 0x%" PRIX64 " while scanning.", scan->next);
+		return result;
+	}
+	scan->length += bytes;
+	scan->next = readEnd;
+	return ADI_SUCCESS;
+}
+
+/**
+ * ADIv5_Scan 创建内存扫描对象
+ */
+int ADIv5_Scan(AccessPort apApi, uint64_t addr, uint64_t len, const uint8_t *pattern, const uint8_t *mask,
+		unsigned int patternLen, unsigned int align, MemScan *scan){
+	assert(apApi != NULL && pattern != NULL && scan != NULL);
+	struct memScan *memScan;
+	unsigned int idx;
+	BOOL fullMask = TRUE;
+	if(apApi->type != AccessPort_Memory){
+		log_error("Not a memory access port!");
+		return ADI_ERR_BAD_PARAMETER;
+	}
+	if(patternLen == 0 || patternLen > SCAN_MAX_PATTERN){
+		log_error("Pattern length must be between 1 and %u bytes!", SCAN_MAX_PATTERN);
+		return ADI_ERR_BAD_PARAMETER;
+	}
+	if(align == 0 || align > 8 || (align & (align - 1))){
+		log_error("Match alignment must be 1, 2, 4 or 8!");
+		return ADI_ERR_BAD_PARAMETER;
+	}
+	if(addr + len < addr){
+		log_error("Scan range wraps around the address space!");
+		return ADI_ERR_BAD_PARAMETER;
+	}
+	memScan = calloc(1, sizeof(struct memScan));
+	if(memScan == NULL){
+		log_error("Failed to allocate memory scan object!");
+		return ADI_ERR_INTERNAL_ERROR;
+	}
+	memScan->pattern = malloc(patternLen << 1);
+	// 保留的数据最多patternLen-1字节,加上对齐的3字节
+	memScan->buff = malloc(SCAN_CHUNK_SIZE + patternLen + 4);
+	if(memScan->pattern == NULL || memScan->buff == NULL){
+		log_error("Failed to allocate memory scan buffer!");
+		ADIv5_ScanClose(&memScan);
+		return ADI_ERR_INTERNAL_ERROR;
+	}
+	memScan->anchor = -1;
+	for(idx = 0; idx < patternLen; idx++){
+		uint8_t byteMask = mask ? mask[idx] : 0xFFu;
+		memScan->pattern[idx] = pattern[idx] & byteMask;
+		memScan->pattern[patternLen + idx] = byteMask;
+		if(byteMask == 0xFFu){
+			if(memScan->anchor < 0) memScan->anchor = (int)idx;
+		}else{
+			fullMask = FALSE;
+		}
+	}
+	memScan->mask = fullMask ? NULL : memScan->pattern + patternLen;
+	memScan->patternLen = patternLen;
+	memScan->align = align;
+	memScan->ap = container_of(apApi, struct ADIv5_AccessPort, apApi);
+	memScan->next = memScan->base = addr & ~0x3ull;
+	memScan->end = addr + len;
+	memScan->readEnd = (memScan->end + 3) & ~0x3ull;
+	memScan->pos = (unsigned int)(addr - memScan->base);
+	*scan = memScan;
+	return ADI_SUCCESS;
+}
+
+/**
+ * ADIv5_ScanNext 取得下一个匹配
+ */
+int ADIv5_ScanNext(MemScan scan, uint64_t *where){
+	assert(scan != NULL && where != NULL);
+	int result;
+	for(;;){
+		if(scanBuffer(scan, where)){
+			return ADI_SUCCESS;
+		}
+		if(scan->next >= scan->readEnd){
+			return ADI_FAILED;
+		}
+		if((result = scanFill(scan)) != ADI_SUCCESS){
+			return result;
+		}
+	}
+}
+
+/**
+ * ADIv5_ScanClose 销毁内存扫描对象
+ */
+void ADIv5_ScanClose(MemScan *scan){
+	assert(scan != NULL);
+	if(*scan == NULL) return;
+	free((*scan)->pattern);
+	free((*scan)->buff);
+	free(*scan);
+	*scan = NULL;
+}
@@ -0,0 +1,664 @@
+/*
+ * ADIv5_watch.c
+ *
+ *  Created on: 2019-7-6
+ *      Author: virusv
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "smart_ocd.h"
+#include "misc/log.h"
+#include "misc/ring.h"
+
+#include "arch/ARM/ADI/include/ADIv5.h"
+
+/**
+ * 变量监视
+ * 监视线程按节拍运行,每个监视项的采样周期是节拍的整数倍。每个节拍取出到期的监视项,
+ * 按地址排序后合并:落在同一个字或者相邻字中的监视项读成一段地址连续的32位访问,
+ * ReadMany对连续地址只写一次TAR,相当于块读;单独的8/16位监视项按原宽度读,不碰相邻的字节。
+ * 到期的监视项组合由各个周期的最小公倍数决定,种类有限,每种组合第一次出现时规划一次,
+ * Adapter支持时编译成预编译程序,之后每个节拍只执行程序,不再构造指令。
+ * 采样写入单生产者单消费者的环形缓冲区,由Lua或者日志线程读出,监视线程不会被阻塞。
+ * 监视线程和日志线程都不打印日志,错误记录在统计信息中
+ */
+#define WATCH_MAX_PLANS		64	// 缓存的规划数,超过时每个节拍临时规划
+#define WATCH_SLEEP_SLICE	(50ull * 1000000)	// 等待下一个节拍时检查停止标志的间隔
+#define WATCH_LOG_INTERVAL	(10ull * 1000000)	// 日志线程读取环形缓冲区的间隔
+#define WATCH_LOG_CHUNK		1024	// 日志线程每次读出的采样数
+#define WATCH_LOG_MAGIC		0x54574f53	// "SOWT"
+#define WATCH_LOG_VERSION	1
+
+struct watchEntry {
+	uint64_t addr;
+	enum dataSize size;
+	unsigned int period;	// 采样周期,节拍数
+	char *name;
+};
+
+// 规划中的一个监视项:值从access开始的第offset个字节起
+struct watchMember {
+	unsigned int entry;
+	unsigned int access;
+	unsigned int offset;
+	unsigned int width;
+};
+
+// 一种到期组合的规划
+struct watchPlan {
+	uint64_t key;	// 到期组合的标识,见planKey
+	struct memoryAccess *access;
+	unsigned int accessCount;
+	struct watchMember *members;
+	unsigned int memberCount;
+	MemProgram program;
+	BOOL programTried;	// 是否已经尝试编译
+	struct watchPlan *next;
+};
+
+// 二进制日志文件头
+struct watchLogHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t entryCount;	// 之后是entryCount个监视项:uint64_t地址,uint32_t字节数,uint32_t周期,uint32_t名字长度,名字
+	uint32_t tickHz;
+};
+
+struct memWatch {
+	AccessPort ap;
+	unsigned int tickHz;
+	uint64_t tickNs;	// 节拍间隔,0表示连续采样
+	struct watchEntry *entries;
+	unsigned int entryCount, entryCapacity;
+	unsigned int *order;	// 按地址排序的监视项索引
+	unsigned int *periods;	// 不同的采样周期
+	unsigned int periodCount;
+	struct watchPlan *plans;
+	unsigned int planCount;
+	BOOL useProgram;	// Adapter是否支持预编译程序
+	RingBuffer ring;
+	struct watchSample *samples;	// 一个节拍的采样
+	// 监视线程
+	pthread_t thread;
+	atomic_bool stop;
+	BOOL running;
+	uint64_t startNs;
+	// 日志
+	FILE *log;
+	enum watchLogFormat format;
+	BOOL logHeader;	// 是否已经写入文件头
+	pthread_t logThread;
+	atomic_bool logStop;
+	// 统计
+	atomic_ullong ticks, transactions, sampleCount, dropped, late, errors, logged;
+	atomic_int lastError;
+};
+
+static uint64_t nowNs(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void sleepNs(uint64_t ns){
+	struct timespec ts;
+	ts.tv_sec = (time_t)(ns / 1000000000ull);
+	ts.tv_nsec = (long)(ns % 1000000000ull);
+	while(nanosleep(&ts, &ts) != 0 && errno == EINTR);
+}
+
+static void freePlan(struct memWatch *watch, struct watchPlan *plan){
+	if(plan->program && watch->ap->Interface.Memory.FreeProgram){
+		watch->ap->Interface.Memory.FreeProgram(watch->ap, plan->program);
+	}
+	free(plan->access);
+	free(plan->members);
+	free(plan);
+}
+
+static void freePlans(struct memWatch *watch){
+	struct watchPlan *plan, *next;
+	for(plan = watch->plans; plan; plan = next){
+		next = plan->next;
+		freePlan(watch, plan);
+	}
+	watch->plans = NULL;
+	watch->planCount = 0;
+}
+
+/**
+ * 到期组合的标识:每个采样周期一位
+ * 周期超过64种时无法表示,返回FALSE
+ */
+static BOOL planKey(struct memWatch *watch, uint64_t tick, uint64_t *key){
+	unsigned int idx;
+	if(watch->periodCount > 64) return FALSE;
+	*key = 0;
+	for(idx = 0; idx < watch->periodCount; idx++){
+		if(tick % watch->periods[idx] == 0) *key |= 1ull << idx;
+	}
+	return TRUE;
+}
+
+/**
+ * 规划tick到期的监视项
+ * 按地址顺序合并字范围相交或者相邻的监视项
+ */
+static struct watchPlan *buildPlan(struct memWatch *watch, uint64_t tick){
+	struct watchPlan *plan;
+	struct watchMember *member;
+	uint64_t runStart = 0, runEnd = 0, wordStart = 0, wordEnd = 0, addr = 0;
+	unsigned int idx, entryIdx = 0, runFirst = 0, runMembers = 0, width = 0, count;
+	BOOL inRun = FALSE;
+	plan = calloc(1, sizeof(struct watchPlan));
+	if(plan == NULL) return NULL;
+	// 每个监视项最多两个字
+	plan->access = calloc(watch->entryCount * 2, sizeof(struct memoryAccess));
+	plan->members = calloc(watch->entryCount, sizeof(struct watchMember));
+	if(plan->access == NULL || plan->members == NULL){
+		freePlan(watch, plan);
+		return NULL;
+	}
+	for(idx = 0; idx <= watch->entryCount; idx++){
+		if(idx < watch->entryCount){
+			entryIdx = watch->order[idx];
+			if(tick % watch->entries[entryIdx].period != 0) continue;
+			addr = watch->entries[entryIdx].addr;
+			width = 1u << watch->entries[entryIdx].size;
+			wordStart = addr & ~3ull;
+			wordEnd = (addr + width + 3) & ~3ull;
+			if(inRun && wordStart <= runEnd){
+				// 并入当前段
+				if(wordEnd > runEnd) runEnd = wordEnd;
+				member = &plan->members[plan->memberCount++];
+				member->entry = entryIdx;
+				member->offset = (unsigned int)(addr - runStart);
+				member->width = width;
+				runMembers++;
+				continue;
+			}
+		}
+		// 结束当前段
+		if(inRun){
+			member = &plan->members[runFirst];
+			if(runMembers == 1 && member->width < 4){
+				// 单独的8/16位监视项按原宽度读
+				plan->access[plan->accessCount].addr = runStart + member->offset;
+				plan->access[plan->accessCount].size = watch->entries[member->entry].size;
+				member->offset = 0;
+				member->access = plan->accessCount++;
+			}else{
+				for(count = 0; runStart + count * 4 < runEnd; count++){
+					plan->access[plan->accessCount + count].addr = runStart + count * 4;
+					plan->access[plan->accessCount + count].size = DataSize_32;
+				}
+				for(; runFirst < plan->memberCount; runFirst++){
+					plan->members[runFirst].access = plan->accessCount;
+				}
+				plan->accessCount += count;
+			}
+			inRun = FALSE;
+		}
+		if(idx == watch->entryCount) break;
+		// 开始新的一段
+		runStart = wordStart;
+		runEnd = wordEnd;
+		runFirst = plan->memberCount;
+		runMembers = 1;
+		member = &plan->members[plan->memberCount++];
+		member->entry = entryIdx;
+		member->offset = (unsigned int)(addr - runStart);
+		member->width = width;
+		inRun = TRUE;
+	}
+	return plan;
+}
+
+/**
+ * 取得tick的规划,缓存中没有时规划并加入缓存
+ * 参数:
+ * 	temporary:返回的规划没有缓存,用完后需要释放
+ */
+static struct watchPlan *getPlan(struct memWatch *watch, uint64_t tick, BOOL *temporary){
+	struct watchPlan *plan;
+	uint64_t key;
+	BOOL cacheable = planKey(watch, tick, &key);
+	*temporary = FALSE;
+	if(cacheable){
+		for(plan = watch->plans; plan; plan = plan->next){
+			if(plan->key == key) return plan;
+		}
+	}
+	plan = buildPlan(watch, tick);
+	if(plan == NULL) return NULL;
+	if(!cacheable || watch->planCount >= WATCH_MAX_PLANS){
+		*temporary = TRUE;
+		return plan;
+	}
+	plan->key = key;
+	plan->next = watch->plans;
+	watch->plans = plan;
+	watch->planCount++;
+	return plan;
+}
+
+/**
+ * 执行一个节拍
+ */
+static void runTick(struct memWatch *watch, uint64_t tick){
+	struct watchPlan *plan;
+	const struct watchMember *member;
+	struct watchSample *sample;
+	uint64_t begin, end, value;
+	unsigned int idx, byte, pushed;
+	BOOL temporary;
+	int result;
+	atomic_fetch_add_explicit(&watch->ticks, 1, memory_order_relaxed);
+	plan = getPlan(watch, tick, &temporary);
+	if(plan == NULL){
+		atomic_fetch_add_explicit(&watch->errors, 1, memory_order_relaxed);
+		atomic_store_explicit(&watch->lastError, ADI_ERR_INTERNAL_ERROR, memory_order_relaxed);
+		return;
+	}
+	if(plan->memberCount == 0) goto EXIT;
+	// 第一次执行缓存的规划时尝试编译成程序
+	if(!temporary && watch->useProgram && !plan->programTried){
+		plan->programTried = TRUE;
+		result = watch->ap->Interface.Memory.PrepareRead(watch->ap, plan->access, plan->accessCount, &plan->program);
+		if(result != ADI_SUCCESS){
+			plan->program = NULL;
+			if(result == ADI_ERR_UNSUPPORT) watch->useProgram = FALSE;
+		}
+	}
+	begin = nowNs();
+	if(plan->program){
+		result = watch->ap->Interface.Memory.RunProgram(watch->ap, plan->program, plan->access);
+	}else{
+		result = watch->ap->Interface.Memory.ReadMany(watch->ap, plan->access, plan->accessCount);
+	}
+	end = nowNs();
+	atomic_fetch_add_explicit(&watch->transactions, 1, memory_order_relaxed);
+	if(result != ADI_SUCCESS){
+		atomic_fetch_add_explicit(&watch->errors, 1, memory_order_relaxed);
+		atomic_store_explicit(&watch->lastError, result, memory_order_relaxed);
+		goto EXIT;
+	}
+	// 采样时间取传输的中点
+	for(idx = 0; idx < plan->memberCount; idx++){
+		member = &plan->members[idx];
+		for(value = 0, byte = 0; byte < member->width; byte++){
+			unsigned int pos = member->offset + byte;
+			value |= ((plan->access[member->access + pos / 4].data >> ((pos % 4) << 3)) & 0xFF) << (byte << 3);
+		}
+		sample = &watch->samples[idx];
+		sample->time = (begin + end) / 2 - watch->startNs;
+		sample->entry = member->entry;
+		sample->tick = (uint32_t)tick;
+		sample->value = value;
+	}
+	pushed = Ring_Push(watch->ring, watch->samples, plan->memberCount);
+	atomic_fetch_add_explicit(&watch->sampleCount, pushed, memory_order_relaxed);
+	if(pushed < plan->memberCount){
+		atomic_fetch_add_explicit(&watch->dropped, plan->memberCount - pushed, memory_order_relaxed);
+	}
+EXIT:
+	if(temporary) freePlan(watch, plan);
+}
+
+/**
+ * 监视线程
+ * 错过的节拍直接跳过,不补采样
+ */
+static void *watchThread(void *arg){
+	struct memWatch *watch = arg;
+	uint64_t tick = 0, next = watch->startNs, now, missed;
+	while(!atomic_load_explicit(&watch->stop, memory_order_acquire)){
+		if(watch->tickNs){
+			now = nowNs();
+			if(now < next){
+				// 分段等待,及时响应停止
+				sleepNs(next - now > WATCH_SLEEP_SLICE ? WATCH_SLEEP_SLICE : next - now);
+				continue;
+			}
+			missed = (now - next) / watch->tickNs;
+			if(missed){
+				atomic_fetch_add_explicit(&watch->late, missed, memory_order_relaxed);
+				tick += missed;
+				next += missed * watch->tickNs;
+			}
+			next += watch->tickNs;
+		}
+		runTick(watch, tick++);
+	}
+	return NULL;
+}
+
+static BOOL writeLog(struct memWatch *watch, const struct watchSample *samples, unsigned int count){
+	const struct watchEntry *entry;
+	unsigned int idx;
+	if(watch->format == WatchLog_Binary){
+		return fwrite(samples, sizeof(struct watchSample), count, watch->log) == count;
+	}
+	for(idx = 0; idx < count; idx++){
+		entry = &watch->entries[samples[idx].entry];
+		if(entry->name){
+			if(fprintf(watch->log, "%" PRIu64 ",%s,%" PRIu64 "\n", samples[idx].time, entry->name, samples[idx].value) < 0) return FALSE;
+		}else{
+			if(fprintf(watch->log, "%" PRIu64 ",0x%08" PRIX64 ",%" PRIu64 "\n", samples[idx].time, entry->addr, samples[idx].value) < 0) return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/**
+ * 日志线程,停止时读完环形缓冲区中剩余的采样
+ */
+static void *logThread(void *arg){
+	struct memWatch *watch = arg;
+	struct watchSample samples[WATCH_LOG_CHUNK];
+	unsigned int count;
+	BOOL stopping, failed = FALSE;
+	for(;;){
+		stopping = atomic_load_explicit(&watch->logStop, memory_order_acquire);
+		while((count = Ring_Pop(watch->ring, samples, WATCH_LOG_CHUNK)) > 0){
+			if(!failed && writeLog(watch, samples, count) == FALSE){
+				failed = TRUE;
+				atomic_fetch_add_explicit(&watch->errors, 1, memory_order_relaxed);
+				atomic_store_explicit(&watch->lastError, ADI_ERR_INTERNAL_ERROR, memory_order_relaxed);
+			}
+			if(!failed) atomic_fetch_add_explicit(&watch->logged, count, memory_order_relaxed);
+		}
+		if(stopping) break;
+		sleepNs(WATCH_LOG_INTERVAL);
+	}
+	return NULL;
+}
+
+static int writeLogHeader(struct memWatch *watch){
+	struct watchLogHeader header;
+	const struct watchEntry *entry;
+	uint32_t size, period, nameLen;
+	unsigned int idx;
+	if(watch->format == WatchLog_CSV){
+		return fputs("time_ns,name,value\n", watch->log) < 0 ? ADI_FAILED : ADI_SUCCESS;
+	}
+	header.magic = WATCH_LOG_MAGIC;
+	header.version = WATCH_LOG_VERSION;
+	header.entryCount = watch->entryCount;
+	header.tickHz = watch->tickHz;
+	if(fwrite(&header, sizeof(header), 1, watch->log) != 1) return ADI_FAILED;
+	for(idx = 0; idx < watch->entryCount; idx++){
+		entry = &watch->entries[idx];
+		size = 1u << entry->size;
+		period = entry->period;
+		nameLen = entry->name ? (uint32_t)strlen(entry->name) : 0;
+		if(fwrite(&entry->addr, sizeof(uint64_t), 1, watch->log) != 1
+				|| fwrite(&size, sizeof(uint32_t), 1, watch->log) != 1
+				|| fwrite(&period, sizeof(uint32_t), 1, watch->log) != 1
+				|| fwrite(&nameLen, sizeof(uint32_t), 1, watch->log) != 1
+				|| (nameLen && fwrite(entry->name, nameLen, 1, watch->log) != 1)){
+			return ADI_FAILED;
+		}
+	}
+	return ADI_SUCCESS;
+}
+
+/**
+ * ADIv5_WatchCreate 创建变量监视对象
+ */
+int ADIv5_WatchCreate(AccessPort self, unsigned int tickHz, unsigned int capacity, MemWatch *watchOut){
+	struct memWatch *watch;
+	if(self == NULL || watchOut == NULL || self->type != AccessPort_Memory){
+		return ADI_ERR_BAD_PARAMETER;
+	}
+	if(tickHz > 1000000){
+		log_warn("Watch tick rate %u Hz is too high.", tickHz);
+		return ADI_ERR_BAD_PARAMETER;
+	}
+	watch = calloc(1, sizeof(struct memWatch));
+	if(watch == NULL){
+		log_error("Failed to create a watch object.");
+		return ADI_ERR_INTERNAL_ERROR;
+	}
+	watch->ring = Ring_Create(sizeof(struct watchSample), capacity);
+	if(watch->ring == NULL){
+		free(watch);
+		return ADI_ERR_INTERNAL_ERROR;
+	}
+	watch->ap = self;
+	watch->tickHz = tickHz;
+	watch->tickNs = tickHz ? 1000000000ull / tickHz : 0;
+	watch->useProgram = self->Interface.Memory.PrepareRead != NULL && self->Interface.Memory.RunProgram != NULL;
+	atomic_init(&watch->stop, FALSE);
+	atomic_init(&watch->logStop, FALSE);
+	*watchOut = watch;
+	return ADI_SUCCESS;
+}
+
+/**
+ * ADIv5_WatchAdd 增加监视项
+ */
+int ADIv5_WatchAdd(MemWatch watch, uint64_t addr, enum dataSize size, unsigned int rateHz, const char *name, unsigned int *entryOut){
+	struct watchEntry *entry;
+	unsigned int period = 1;
+	assert(watch != NULL);
+	if(watch->running){
+		log_warn("Cannot add a watch entry while the watch is running.");
+		return ADI_FAILED;
+	}
+	if(size > DataSize_64 || (addr & ((1u << size) - 1))){
+		log_warn("Watch entry at 0x%" PRIX64 " is not aligned to its size.", addr);
+		return ADI_ERR_BAD_PARAMETER;
+	}
+	// 采样周期取最接近的节拍数
+	if(rateHz && watch->tickHz){
+		period = (watch->tickHz + rateHz / 2) / rateHz;
+		if(period == 0) period = 1;
+	}
+	if(watch->entryCount == watch->entryCapacity){
+		unsigned int capacity = watch->entryCapacity ? watch->entryCapacity * 2 : 16;
+		entry = realloc(watch->entries, capacity * sizeof(struct watchEntry));
+		if(entry == NULL){
+			log_error("Failed to allocate watch entries.");
+			return ADI_ERR_INTERNAL_ERROR;
+		}
+		watch->entries = entry;
+		watch->entryCapacity = capacity;
+	}
+	entry = &watch->entries[watch->entryCount];
+	entry->addr = addr;
+	entry->size = size;
+	entry->period = period;
+	entry->name = NULL;
+	if(name && (entry->name = strdup(name)) == NULL){
+		log_error("Failed to allocate watch entry name.");
+		return ADI_ERR_INTERNAL_ERROR;
+	}
+	if(entryOut) *entryOut = watch->entryCount;
+	watch->entryCount++;
+	// 监视项改变后重新规划
+	freePlans(watch);
+	return ADI_SUCCESS;
+}
+
+/**
+ * ADIv5_WatchLog 设置日志文件
+ */
+int ADIv5_WatchLog(MemWatch watch, const char *path, enum watchLogFormat format){
+	assert(watch != NULL);
+	if(watch->running){
+		log_warn("Cannot change the log file while the watch is running.");
+		return ADI_FAILED;
+	}
+	if(watch->log){
+		fclose(watch->log);
+		watch->log = NULL;
+	}
+	if(path == NULL) return ADI_SUCCESS;
+	watch->log = fopen(path, format == WatchLog_Binary ? "wb" : "w");
+	if(watch->log == NULL){
+		log_error("Failed to open watch log %s: %s.", path, strerror(errno));
+		return ADI_FAILED;
+	}
+	watch->format = format;
+	watch->logHeader = FALSE;
+	return ADI_SUCCESS;
+}
+
+// 排序用的监视项地址
+struct watchSortKey {
+	uint64_t addr;
+	unsigned int entry;
+};
+
+static int compareEntry(const void *a, const void *b){
+	const struct watchSortKey *keyA = a, *keyB = b;
+	if(keyA->addr != keyB->addr) return keyA->addr < keyB->addr ? -1 : 1;
+	return keyA->entry < keyB->entry ? -1 : keyA->entry > keyB->entry;
+}
+
+/**
+ * ADIv5_WatchStart 启动监视线程
+ */
+int ADIv5_WatchStart(MemWatch watch){
+	struct watchSortKey *keys;
+	unsigned int idx, p;
+	void *mem;
+	assert(watch != NULL);
+	if(watch->running) return ADI_SUCCESS;
+	if(watch->entryCount == 0){
+		log_warn("No watch entry.");
+		return ADI_FAILED;
+	}
+	// 排序和周期表
+	mem = realloc(watch->order, watch->entryCount * sizeof(unsigned int));
+	if(mem == NULL) goto NO_MEMORY;
+	watch->order = mem;
+	mem = realloc(watch->periods, watch->entryCount * sizeof(unsigned int));
+	if(mem == NULL) goto NO_MEMORY;
+	watch->periods = mem;
+	mem = realloc(watch->samples, watch->entryCount * sizeof(struct watchSample));
+	if(mem == NULL) goto NO_MEMORY;
+	watch->samples = mem;
+	keys = malloc(watch->entryCount * sizeof(struct watchSortKey));
+	if(keys == NULL) goto NO_MEMORY;
+	watch->periodCount = 0;
+	for(idx = 0; idx < watch->entryCount; idx++){
+		keys[idx].addr = watch->entries[idx].addr;
+		keys[idx].entry = idx;
+		for(p = 0; p < watch->periodCount && watch->periods[p] != watch->entries[idx].period; p++);
+		if(p == watch->periodCount) watch->periods[watch->periodCount++] = watch->entries[idx].period;
+	}
+	qsort(keys, watch->entryCount, sizeof(struct watchSortKey), compareEntry);
+	for(idx = 0; idx < watch->entryCount; idx++){
+		watch->order[idx] = keys[idx].entry;
+	}
+	free(keys);
+	// 文件头只在第一次启动时写入,之后的启动接着追加采样
+	if(watch->log && !watch->logHeader){
+		if(writeLogHeader(watch) != ADI_SUCCESS){
+			log_error("Failed to write the watch log header.");
+			return ADI_FAILED;
+		}
+		watch->logHeader = TRUE;
+	}
+	atomic_store(&watch->ticks, 0);
+	atomic_store(&watch->transactions, 0);
+	atomic_store(&watch->sampleCount, 0);
+	atomic_store(&watch->dropped, 0);
+	atomic_store(&watch->late, 0);
+	atomic_store(&watch->errors, 0);
+	atomic_store(&watch->logged, 0);
+	atomic_store(&watch->lastError, ADI_SUCCESS);
+	atomic_store(&watch->stop, FALSE);
+	atomic_store(&watch->logStop, FALSE);
+	watch->startNs = nowNs();
+	if(watch->log && pthread_create(&watch->logThread, NULL, logThread, watch) != 0){
+		log_error("Failed to start the watch log thread.");
+		return ADI_ERR_INTERNAL_ERROR;
+	}
+	if(pthread_create(&watch->thread, NULL, watchThread, watch) != 0){
+		log_error("Failed to start the watch thread.");
+		if(watch->log){
+			atomic_store(&watch->logStop, TRUE);
+			pthread_join(watch->logThread, NULL);
+		}
+		return ADI_ERR_INTERNAL_ERROR;
+	}
+	watch->running = TRUE;
+	return ADI_SUCCESS;
+NO_MEMORY:
+	log_error("Failed to allocate watch buffers.");
+	return ADI_ERR_INTERNAL_ERROR;
+}
+
+/**
+ * ADIv5_WatchStop 停止监视线程
+ */
+void ADIv5_WatchStop(MemWatch watch){
+	assert(watch != NULL);
+	if(!watch->running) return;
+	atomic_store_explicit(&watch->stop, TRUE, memory_order_release);
+	pthread_join(watch->thread, NULL);
+	if(watch->log){
+		atomic_store_explicit(&watch->logStop, TRUE, memory_order_release);
+		pthread_join(watch->logThread, NULL);
+		fflush(watch->log);
+	}
+	watch->running = FALSE;
+}
+
+/**
+ * ADIv5_WatchDrain 读出采样
+ */
+unsigned int ADIv5_WatchDrain(MemWatch watch, struct watchSample *samples, unsigned int max){
+	assert(watch != NULL && samples != NULL);
+	// 日志线程是环形缓冲区唯一的消费者
+	if(watch->log) return 0;
+	return Ring_Pop(watch->ring, samples, max);
+}
+
+/**
+ * ADIv5_WatchStats 获得统计信息
+ */
+void ADIv5_WatchStats(MemWatch watch, struct watchStats *stats){
+	assert(watch != NULL && stats != NULL);
+	stats->ticks = atomic_load_explicit(&watch->ticks, memory_order_relaxed);
+	stats->transactions = atomic_load_explicit(&watch->transactions, memory_order_relaxed);
+	stats->samples = atomic_load_explicit(&watch->sampleCount, memory_order_relaxed);
+	stats->dropped = atomic_load_explicit(&watch->dropped, memory_order_relaxed);
+	stats->late = atomic_load_explicit(&watch->late, memory_order_relaxed);
+	stats->errors = atomic_load_explicit(&watch->errors, memory_order_relaxed);
+	stats->logged = atomic_load_explicit(&watch->logged, memory_order_relaxed);
+	stats->lastError = atomic_load_explicit(&watch->lastError, memory_order_relaxed);
+	stats->running = watch->running;
+}
+
+/**
+ * ADIv5_WatchDestroy 停止并销毁监视对象
+ */
+void ADIv5_WatchDestroy(MemWatch *watchPtr){
+	struct memWatch *watch;
+	unsigned int idx;
+	assert(watchPtr != NULL && *watchPtr != NULL);
+	watch = *watchPtr;
+	ADIv5_WatchStop(watch);
+	if(watch->log) fclose(watch->log);
+	freePlans(watch);
+	for(idx = 0; idx < watch->entryCount; idx++){
+		free(watch->entries[idx].name);
+	}
+	free(watch->entries);
+	free(watch->order);
+	free(watch->periods);
+	free(watch->samples);
+	Ring_Destroy(&watch->ring);
+	free(watch);
+	*watchPtr = NULL;
+}
@@ -0,0 +1,365 @@
+/*
+ * ADIv5_writebuf.c
+ *
+ *  Created on: 2019-6-20
+ *      Author: virusv
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "smart_ocd.h"
+#include "misc/log.h"
+#include "misc/misc.h"
+
+#include "arch/ARM/ADI/ADIv5_private.h"
+
+/**
+ * 写合并缓冲区
+ * 按1KB对齐的页保存还没有提交的写数据和字节掩码,页和TAR的自增边界一致,
+ * 提交时每页中连续的字节拆分成:开头不对齐的字节/半字,中间的字用Block写,结尾的字节/半字
+ */
+#define WRITE_BUFFER_PAGES		16
+#define WRITE_BUFFER_PAGE_SIZE	1024
+
+struct writeBufferPage {
+	uint64_t base;	// 页的基址
+	uint32_t data[WRITE_BUFFER_PAGE_SIZE / 4];	// 按byte lane排列的数据
+	uint8_t mask[WRITE_BUFFER_PAGE_SIZE / 8];	// 每字节一位,1表示该字节等待写入
+};
+
+struct deviceRegion {
+	uint64_t base;
+	uint64_t size;
+};
+
+struct ADIv5_WriteBuffer {
+	unsigned int depth;	// 写合并区间的嵌套深度
+	unsigned int pageCount;	// 正在使用的页数
+	struct writeBufferPage pages[WRITE_BUFFER_PAGES];
+	struct deviceRegion *devices;
+	unsigned int deviceCount;
+};
+
+#define MASK_TEST(page,off)	((page)->mask[(off) >> 3] & (1u << ((off) & 0x7)))
+#define MASK_SET(page,off)	((page)->mask[(off) >> 3] |= (1u << ((off) & 0x7)))
+
+/**
+ * 获得写合并缓冲区,不存在就新建
+ */
+static struct ADIv5_WriteBuffer *getWriteBuffer(struct ADIv5_AccessPort *ap){
+	if(ap->type.memory.writeBuffer == NULL){
+		ap->type.memory.writeBuffer = calloc(1, sizeof(struct ADIv5_WriteBuffer));
+		if(ap->type.memory.writeBuffer == NULL){
+			log_error("Failed to allocate write buffer!");
+		}
+	}
+	return ap->type.memory.writeBuffer;
+}
+
+/**
+ * 判断[addr, addr+len)是否和设备内存重叠
+ */
+static BOOL isDevice(struct ADIv5_WriteBuffer *buffer, uint64_t addr, uint64_t len){
+	unsigned int idx;
+	for(idx = 0; idx < buffer->deviceCount; idx++){
+		struct deviceRegion *region = &buffer->devices[idx];
+		if(addr >= region->base ? addr - region->base < region->size : addr + len > region->base){
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+/**
+ * 找到页中下一段连续的等待写入的字节
+ * 返回:
+ * 	TRUE:找到,[*start, *end)为页内偏移
+ */
+static BOOL nextRun(struct writeBufferPage *page, unsigned int *start, unsigned int *end){
+	unsigned int off = *end;
+	while(off < WRITE_BUFFER_PAGE_SIZE && !MASK_TEST(page, off)) off++;
+	if(off == WRITE_BUFFER_PAGE_SIZE) return FALSE;
+	*start = off;
+	while(off < WRITE_BUFFER_PAGE_SIZE && MASK_TEST(page, off)) off++;
+	*end = off;
+	return TRUE;
+}
+
+/**
+ * 把一个字节或者半字的写加入队列
+ */
+static int queueSubWord(struct ADIv5_AccessPort *ap, struct writeBufferPage *page, unsigned int off, enum dataSize size){
+	int result;
+	uint32_t laneMask = (size == DataSize_8 ? 0xFFu : 0xFFFFu) << ((off & 0x3) << 3);
+	if((result = ADIv5_QueueCsw(ap, AddrInc_Off, size)) != ADI_SUCCESS){
+		return result;
+	}
+	ADIv5_QueueTar(ap, page->base + off);
+	return ap->dap->adapter->DapSingleWrite(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_DRW, page->data[off >> 2] & laneMask)
+			== ADPT_SUCCESS ? ADI_SUCCESS : ADI_ERR_INTERNAL_ERROR;
+}
+
+/**
+ * 把一段连续字节拆分成对齐的写操作加入队列
+ */
+static int queueRun(struct ADIv5_AccessPort *ap, struct writeBufferPage *page, unsigned int start, unsigned int end){
+	int result = ADI_SUCCESS;
+	unsigned int words;
+	// 开头不对齐的部分
+	while(start < end && (start & 0x3) && result == ADI_SUCCESS){
+		if(!(start & 0x1) && start + 2 <= end){
+			result = queueSubWord(ap, page, start, DataSize_16);
+			start += 2;
+		}else{
+			result = queueSubWord(ap, page, start, DataSize_8);
+			start += 1;
+		}
+	}
+	// 中间对齐的字
+	words = (end - start) >> 2;
+	if(words > 0 && result == ADI_SUCCESS){
+		result = ADIv5_QueueBlockWrite(ap, page->base + start, AddrInc_Single, DataSize_32, words, page->data + (start >> 2));
+		start += words << 2;
+	}
+	// 结尾不足一个字的部分
+	while(start < end && result == ADI_SUCCESS){
+		if(start + 2 <= end){
+			result = queueSubWord(ap, page, start, DataSize_16);
+			start += 2;
+		}else{
+			result = queueSubWord(ap, page, start, DataSize_8);
+			start += 1;
+		}
+	}
+	return result;
+}
+
+/**
+ * 提交缓冲区中所有的写操作,按页的地址顺序在一次提交中完成
+ */
+static int flushAll(struct ADIv5_AccessPort *ap, struct ADIv5_WriteBuffer *buffer){
+	struct writeBufferPage *page, tmp;
+	unsigned int idx, jdx, start, end;
+	int result = ADI_SUCCESS;
+	if(buffer->pageCount == 0) return ADI_SUCCESS;
+	// 按地址排序,页数很少,用插入排序
+	for(idx = 1; idx < buffer->pageCount; idx++){
+		for(jdx = idx; jdx > 0 && buffer->pages[jdx - 1].base > buffer->pages[jdx].base; jdx--){
+			tmp = buffer->pages[jdx];
+			buffer->pages[jdx] = buffer->pages[jdx - 1];
+			buffer->pages[jdx - 1] = tmp;
+		}
+	}
+	for(idx = 0; idx < buffer->pageCount && result == ADI_SUCCESS; idx++){
+		page = &buffer->pages[idx];
+		end = 0;
+		while(result == ADI_SUCCESS && nextRun(page, &start, &end)){
+			result = queueRun(ap, page, start, end);
+		}
+	}
+	if(result != ADI_SUCCESS){
+		ap->dap->adapter->DapCleanPending(ap->dap->adapter);
+	}else{
+		result = ADIv5_DapCommit(ap->dap);
+	}
+	if(result != ADI_SUCCESS){
+		log_error("Flush write buffer failed!");
+	}
+	// 更新缓存,失败时目标内存的状态不确定,使缓存行失效
+	for(idx = 0; idx < buffer->pageCount; idx++){
+		page = &buffer->pages[idx];
+		end = 0;
+		while(nextRun(page, &start, &end)){
+			ADIv5_DeltaForget(ap, page->base + start, end - start);
+			if(result == ADI_SUCCESS){
+				ADIv5_CacheWrite(ap, page->base + start, end - start, CAST(uint8_t *, page->data) + start);
+			}else{
+				ADIv5_CacheInvalidate(ap, page->base + start, end - start);
+			}
+		}
+	}
+	buffer->pageCount = 0;
+	return result;
+}
+
+/**
+ * 不支持小于1个字传输的AP只能整字写入
+ * 把[off, off+len)所在的字中没有等待写入、这次也不写的字节从目标读出来补齐,整个字标记为等待写入
+ * 这些字节没有未提交的写操作,读出的就是目标当前的值
+ */
+static int mergeWords(struct ADIv5_AccessPort *ap, struct writeBufferPage *page, unsigned int off, unsigned int len){
+	unsigned int word, byte, missing;
+	uint32_t orig = 0;
+	int result;
+	for(word = off & ~0x3u; word < off + len; word += 4){
+		for(byte = word, missing = 0; byte < word + 4; byte++){
+			if(!MASK_TEST(page, byte) && (byte < off || byte >= off + len)) missing |= 0xFFu << ((byte & 0x3) << 3);
+		}
+		if(missing == 0) continue;
+		if((result = ADIv5_QueueCsw(ap, AddrInc_Off, DataSize_32)) != ADI_SUCCESS){
+			return result;
+		}
+		ADIv5_QueueTar(ap, page->base + word);
+		ap->dap->adapter->DapSingleRead(ap->dap->adapter, ADPT_DAP_AP_REG, AP_REG_DRW, &orig);
+		if((result = ADIv5_DapCommit(ap->dap)) != ADI_SUCCESS){
+			return result;
+		}
+		page->data[word >> 2] = (page->data[word >> 2] & ~missing) | (orig & missing);
+		for(byte = word; byte < word + 4; byte++){
+			MASK_SET(page, byte);
+		}
+	}
+	return ADI_SUCCESS;
+}
+
+/**
+ * ADIv5_BufferWrite 把写操作放入写合并缓冲区
+ * 参数:
+ * 	buffered:TRUE:已经放入缓冲区;FALSE:没有在写合并区间内,或者是设备内存,调用者需要直接写
+ * 返回:
+ * 	提交之前的写操作或者补齐整字失败时返回错误码,这些写操作的数据已经丢失,调用者需要把错误返回给上层
+ */
+int ADIv5_BufferWrite(struct ADIv5_AccessPort *ap, uint64_t addr, unsigned int len, const uint8_t *data, BOOL *buffered){
+	assert(ap != NULL && data != NULL && buffered != NULL);
+	struct ADIv5_WriteBuffer *buffer = ap->type.memory.writeBuffer;
+	struct writeBufferPage *page = NULL;
+	uint64_t base = addr & ~(uint64_t)(WRITE_BUFFER_PAGE_SIZE - 1);
+	unsigned int idx, off;
+	int result;
+	*buffered = FALSE;
+	if(buffer == NULL || buffer->depth == 0) return ADI_SUCCESS;
+	// 设备内存先提交之前的写,保证顺序
+	if(isDevice(buffer, addr, len)){
+		return flushAll(ap, buffer);
+	}
+	// 写操作都是对齐的,不会跨页
+	assert(((addr + len - 1) & ~(uint64_t)(WRITE_BUFFER_PAGE_SIZE - 1)) == base);
+	for(idx = 0; idx < buffer->pageCount; idx++){
+		if(buffer->pages[idx].base == base){
+			page = &buffer->pages[idx];
+			break;
+		}
+	}
+	if(page == NULL){
+		if(buffer->pageCount == WRITE_BUFFER_PAGES){
+			if((result = flushAll(ap, buffer)) != ADI_SUCCESS){
+				return result;
+			}
+		}
+		page = &buffer->pages[buffer->pageCount++];
+		page->base = base;
+		memset(page->mask, 0x0, sizeof(page->mask));
+	}
+	if(!ap->type.memory.config.lessWordTransfers && (result = mergeWords(ap, page, addr - base, len)) != ADI_SUCCESS){
+		return result;
+	}
+	// 重叠的字节用新数据覆盖
+	for(off = addr - base; len > 0; off++, len--, data++){
+		CAST(uint8_t *, page->data)[off] = *data;
+		MASK_SET(page, off);
+	}
+	*buffered = TRUE;
+	return ADI_SUCCESS;
+}
+
+/**
+ * ADIv5_WriteBufferFlush 如果缓冲区中有和[addr, addr+len)重叠的写操作,提交整个缓冲区
+ * len为0时无条件提交
+ */
+int ADIv5_WriteBufferFlush(struct ADIv5_AccessPort *ap, uint64_t addr, uint64_t len){
+	assert(ap != NULL);
+	struct ADIv5_WriteBuffer *buffer = ap->type.memory.writeBuffer;
+	unsigned int idx;
+	if(buffer == NULL || buffer->pageCount == 0) return ADI_SUCCESS;
+	if(len == 0) return flushAll(ap, buffer);
+	for(idx = 0; idx < buffer->pageCount; idx++){
+		uint64_t base = buffer->pages[idx].base;
+		if(addr >= base ? addr - base < WRITE_BUFFER_PAGE_SIZE : addr + len > base){
+			return flushAll(ap, buffer);
+		}
+	}
+	return ADI_SUCCESS;
+}
+
+/**
+ * ADIv5_FreeWriteBuffer 释放写合并缓冲区,不提交
+ */
+void ADIv5_FreeWriteBuffer(struct ADIv5_WriteBuffer *buffer){
+	if(buffer == NULL) return;
+	if(buffer->pageCount > 0){
+		log_warn("Discard %u pending write buffer pages.", buffer->pageCount);
+	}
+	free(buffer->devices);
+	free(buffer);
+}
+
+/**
+ * 获得MEM-AP对象
+ */
+static struct ADIv5_AccessPort *memoryAp(AccessPort apApi){
+	assert(apApi != NULL);
+	if(apApi->type != AccessPort_Memory){
+		log_error("Not a memory access port!");
+		return NULL;
+	}
+	return container_of(apApi, struct ADIv5_AccessPort, apApi);
+}
+
+/**
+ * ADIv5_WriteCombine 进入或者退出写合并区间
+ */
+int ADIv5_WriteCombine(AccessPort apApi, BOOL enable){
+	struct ADIv5_AccessPort *ap = memoryAp(apApi);
+	struct ADIv5_WriteBuffer *buffer;
+	if(ap == NULL) return ADI_ERR_BAD_PARAMETER;
+	if((buffer = getWriteBuffer(ap)) == NULL) return ADI_ERR_INTERNAL_ERROR;
+	if(enable){
+		buffer->depth++;
+		return ADI_SUCCESS;
+	}
+	if(buffer->depth == 0){
+		log_warn("Not in a write combine scope.");
+		return ADI_ERR_BAD_PARAMETER;
+	}
+	// 退出最外层区间时提交
+	if(--buffer->depth == 0){
+		return flushAll(ap, buffer);
+	}
+	return ADI_SUCCESS;
+}
+
+/**
+ * ADIv5_FlushWrites 写屏障
+ */
+int ADIv5_FlushWrites(AccessPort apApi){
+	struct ADIv5_AccessPort *ap = memoryAp(apApi);
+	if(ap == NULL) return ADI_ERR_BAD_PARAMETER;
+	return ADIv5_WriteBufferFlush(ap, 0, 0);
+}
+
+/**
+ * ADIv5_AddDeviceRegion 标记设备内存
+ */
+int ADIv5_AddDeviceRegion(AccessPort apApi, uint64_t base, uint64_t size){
+	struct ADIv5_AccessPort *ap = memoryAp(apApi);
+	struct ADIv5_WriteBuffer *buffer;
+	struct deviceRegion *devices;
+	int result;
+	if(ap == NULL || size == 0) return ADI_ERR_BAD_PARAMETER;
+	if((buffer = getWriteBuffer(ap)) == NULL) return ADI_ERR_INTERNAL_ERROR;
+	// 缓冲区中可能已经有该区域的写操作
+	if((result = ADIv5_WriteBufferFlush(ap, base, size)) != ADI_SUCCESS){
+		return result;
+	}
+	devices = realloc(buffer->devices, (buffer->deviceCount + 1) * sizeof(struct deviceRegion));
+	if(devices == NULL){
+		log_error("Failed to allocate device region!");
+		return ADI_ERR_INTERNAL_ERROR;
+	}
+	devices[buffer->deviceCount].base = base;
+	devices[buffer->deviceCount].size = size;
+	buffer->devices = devices;
+	buffer->deviceCount++;
+	return ADI_SUCCESS;
+}
@@ -10,6 +10,8 @@
 
 #include "smart_ocd.h"
 #include "adapter/include/adapter.h"
+#include "misc/image.h"
+#include "misc/symbols.h"
 
 #ifdef _IMPORTED_ARM_ADI_DEFINES_
 #error "Already imported ADI defines!!"
@@ -49,6 +51,13 @@
 #define DP_REG_DLPIDR		0x34U	// Data Link Protocol Identification Register (SW RO)
 #define DP_REG_EVENTSTAT	0x44U	// Event Status register (RO)
 #define DP_REG_TARGETSEL	0x0CU	// Target Selection register (SW WO, SWD Protocol v2才存在)
+
+// Abort Register definitions
+#define DP_ABORT_DAPABORT       0x00000001  // DAP Abort
+#define DP_ABORT_STKCMPCLR      0x00000002  // Clear STICKYCMP Flag (SW Only)
+#define DP_ABORT_STKERRCLR      0x00000004  // Clear STICKYERR Flag (SW Only)
+#define DP_ABORT_WDERRCLR       0x00000008  // Clear WDATAERR Flag (SW Only)
+#define DP_ABORT_ORUNERRCLR     0x00000010  // Clear STICKYORUN Flag (SW Only)
 /* AP寄存器 bit0 = 1 表示AP */
 #define AP_REG_CSW			0x01U		// Control and Status Word
 #define AP_REG_TAR_LSB 		0x05U		// Transfer Address
@@ -78,6 +87,13 @@ enum {
 typedef struct dap *DAP;
 // AP类型预定义
 typedef struct accessPort *AccessPort;
+// 内存扫描对象预定义
+typedef struct memScan *MemScan;
+// 预编译的批量读程序预定义
+typedef struct memProgram *MemProgram;
+// 变量监视对象预定义
+typedef struct memWatch *MemWatch;
+typedef struct pcProfile *PcProfile;
 
 /**
  * 初始化DAP
@@ -88,6 +104,18 @@ DAP ADIv5_CreateDap(
 		IN Adapter adapter	// Adapter对象
 );
 
+/**
+ * 初始化SWD multi-drop的DAP
+ * 同一个Adapter上的每个目标创建一个DAP对象,访问时自动切换目标
+ * 参数:
+ * 	adapter:Adapter对象
+ * 	targetSel:目标的TARGETSEL值,TINSTANCE在[31:28],TPARTNO和TDESIGNER在[27:1]
+ */
+DAP ADIv5_CreateMultidropDap(
+		IN Adapter adapter,	// Adapter对象
+		IN uint32_t targetSel
+);
+
 /**
  * 销毁DAP对象
  */
@@ -110,6 +138,24 @@ int ADIv5_ReadCidPid(
 		OUT uint64_t *pid
 );
 
+/**
+ * 取得内存扫描的下一个匹配,没有更多匹配时返回ADI_FAILED
+ * 参数:
+ * 	scan:MemAP的Scan接口创建的扫描对象
+ * 	where:匹配的起始地址
+ */
+int ADIv5_ScanNext(
+		IN MemScan scan,
+		OUT uint64_t *where
+);
+
+/**
+ * 销毁内存扫描对象,只释放主机端内存,可以在DAP销毁后调用
+ */
+void ADIv5_ScanClose(
+		IN MemScan *scan
+);
+
 /**
  * Access Port 类型
  */
@@ -141,11 +187,127 @@ typedef int (*ADIv5_FIND_ACCESS_PORT)(
 		OUT AccessPort* ap
 );
 
+/**
+ * CoreSight组件,ROM Table遍历的结果
+ */
+struct coresightComponent {
+	uint64_t base;	// 组件的基址(第一个4KB块)
+	uint64_t size;	// 组件占用的地址空间大小
+	uint32_t cid;	// Component ID
+	uint64_t pid;	// Peripheral ID
+	uint32_t devArch;	// DEVARCH寄存器,只有Class 0x9组件有效
+	uint8_t devType;	// DEVTYPE寄存器,Class 0x1 ROM Table为MEMTYPE寄存器
+	uint8_t componentClass;	// 组件类型:0x1 ROM Table,0x9 CoreSight组件,0xF Generic IP...
+	uint16_t partNumber;	// 部件号
+	uint16_t designer;	// JEP106设计者代码:bank在[10:7],ID在[6:0]
+	uint8_t revision;	// 版本
+	uint8_t valid;	// CID是否合法
+	unsigned int childCount;	// 子组件个数
+	struct coresightComponent *children;	// 子组件数组
+};
+
+/**
+ * 遍历MEM-AP的ROM Table
+ * 每一层组件的ID寄存器和表项分别在一次提交中读取,结果会缓存到磁盘,下次连接时只需一次提交验证
+ * 参数:
+ * 	self:dap自身对象
+ * 	ap:MEM-AP对象
+ * 	root:根ROM Table组件,由AP对象持有,不可释放
+ */
+typedef int (*ADIv5_READ_ROM_TABLE)(
+		IN DAP self,
+		IN AccessPort ap,
+		OUT const struct coresightComponent **root
+);
+
+// 内存映射的区域和访问步骤,定义在后面
+struct memoryRegion;
+struct accessStep;
+
+/**
+ * 添加内存映射的区域,区域之间不能重叠
+ * 设备内存区域同时加入AP的设备区域,不参与写合并;可缓存的区域在AP开启缓存时加入缓存区域
+ * 参数:
+ * 	self:dap自身对象
+ * 	region:区域描述
+ */
+typedef int (*ADIv5_ADD_MEMORY_REGION)(
+		IN DAP self,
+		IN const struct memoryRegion *region
+);
+
+/**
+ * 清空内存映射
+ * 参数:
+ * 	self:dap自身对象
+ */
+typedef int (*ADIv5_CLEAR_MEMORY_MAP)(
+		IN DAP self
+);
+
+/**
+ * 按内存映射规划一次访问,不访问目标
+ * 参数:
+ * 	self:dap自身对象
+ * 	addr:起始地址
+ * 	len:字节数
+ * 	steps:规划的步骤,可以为NULL
+ * 	maxSteps:steps的容量,超出的步骤不写入
+ * 	stepCount:全部步骤的个数
+ * 返回:
+ * 	地址不在内存映射中或者没有合法的访问宽度时返回ADI_ERR_BAD_PARAMETER
+ */
+typedef int (*ADIv5_PLAN_ACCESS)(
+		IN DAP self,
+		IN uint64_t addr,
+		IN uint64_t len,
+		OUT struct accessStep *steps,
+		IN unsigned int maxSteps,
+		OUT unsigned int *stepCount
+);
+
+/**
+ * 按内存映射读内存,每个区域经过所属的AP,用允许的最快方式访问
+ * 参数:
+ * 	self:dap自身对象
+ * 	addr:起始地址,任意对齐
+ * 	len:字节数
+ * 	data:数据存放地址
+ */
+typedef int (*ADIv5_READ_MEMORY)(
+		IN DAP self,
+		IN uint64_t addr,
+		IN uint64_t len,
+		OUT uint8_t *data
+);
+
+/**
+ * 按内存映射写内存,每个区域经过所属的AP,用允许的最快方式访问
+ * 参数:
+ * 	self:dap自身对象
+ * 	addr:起始地址,任意对齐
+ * 	len:字节数
+ * 	data:要写入的数据
+ */
+typedef int (*ADIv5_WRITE_MEMORY)(
+		IN DAP self,
+		IN uint64_t addr,
+		IN uint64_t len,
+		IN const uint8_t *data
+);
+
 /**
  * DAP接口
  */
 struct dap {
 	ADIv5_FIND_ACCESS_PORT FindAccessPort;
+	ADIv5_READ_ROM_TABLE ReadRomTable;
+	// 内存映射和访问规划
+	ADIv5_ADD_MEMORY_REGION AddMemoryRegion;
+	ADIv5_CLEAR_MEMORY_MAP ClearMemoryMap;
+	ADIv5_PLAN_ACCESS PlanAccess;
+	ADIv5_READ_MEMORY ReadMemory;
+	ADIv5_WRITE_MEMORY WriteMemory;
 };
 
 /**
@@ -345,6 +507,480 @@ typedef int (*ADIv5_MEM_AP_ABORT)(
 		IN AccessPort self
 );
 
+/**
+ * 轮询一个字,直到(值 & mask) == value,超时返回ADI_FAILED
+ * Adapter支持DapValueMatch时在仿真器端比较,不需要每次读回数据
+ * 访问出错(FAULT等)时清除sticky标志并返回ADI_ERR_INTERNAL_ERROR,不会等到超时
+ * 参数:
+ * 	self:AccessPort对象
+ * 	addr:地址,字对齐
+ * 	mask:比较的掩码
+ * 	value:期望的值
+ * 	timeout:超时的毫秒数
+ */
+typedef int (*ADIv5_MEM_AP_WAIT_VALUE)(
+		IN AccessPort self,
+		IN uint64_t addr,
+		IN uint32_t mask,
+		IN uint32_t value,
+		IN unsigned int timeout
+);
+
+/**
+ * 指定TAR地址自增的回绕大小,用于目标描述中已知回绕大小的AP
+ * 地址自增传输只在回绕边界上拆分并重写TAR
+ * 参数:
+ * 	self:AccessPort对象
+ * 	wrap:回绕大小,2的幂,1KB~64KB,0恢复为默认的1KB
+ */
+typedef int (*ADIv5_MEM_AP_SET_TAR_WRAP)(
+		IN AccessPort self,
+		IN unsigned int wrap
+);
+
+/**
+ * 探测TAR地址自增的回绕大小,结果保存到AP表缓存
+ * 只读取区域内每个候选边界两侧的字,不写内存
+ * 参数:
+ * 	self:AccessPort对象
+ * 	addr:可以安全读取的内存区域基址
+ * 	size:区域大小,至少要覆盖两倍的回绕大小才能探测到最大值
+ * 	wrap:探测到的回绕大小
+ */
+typedef int (*ADIv5_MEM_AP_PROBE_TAR_WRAP)(
+		IN AccessPort self,
+		IN uint64_t addr,
+		IN uint64_t size,
+		OUT unsigned int *wrap
+);
+
+/**
+ * Block传输出错时的恢复策略
+ * 出错后写ABORT清除STICKYERR/STICKYORUN,读TAR找到出错的位置,从出错的位置继续传输
+ */
+struct transferPolicy {
+	unsigned int retries;	// 同一个位置的最大重试次数
+	unsigned int backoff;	// 第一次重试前等待的微秒数,之后每次重试等待时间加倍
+	unsigned int skipSize;	// 重试失败后跳过出错位置所在的页(页大小,2的幂),读操作跳过的部分填0;0表示不跳过,直接返回失败
+};
+
+/**
+ * 最近一次Block传输的结果
+ */
+struct transferStatus {
+	uint64_t lastGood;	// 从起始地址开始连续传输成功的结束地址(不包括),传输全部成功时等于结束地址
+	uint64_t skipped;	// 被跳过的字节数
+	unsigned int retries;	// 重试的总次数
+};
+
+/**
+ * 设置Block传输出错时的恢复策略
+ * 参数:
+ * 	self:AccessPort对象
+ * 	policy:恢复策略
+ */
+typedef int (*ADIv5_MEM_AP_SET_TRANSFER_POLICY)(
+		IN AccessPort self,
+		IN const struct transferPolicy *policy
+);
+
+/**
+ * 获得最近一次Block传输的结果
+ * 参数:
+ * 	self:AccessPort对象
+ * 	status:传输结果
+ */
+typedef int (*ADIv5_MEM_AP_GET_TRANSFER_STATUS)(
+		IN AccessPort self,
+		OUT struct transferStatus *status
+);
+
+/**
+ * 主机端内存缓存的区域策略
+ * CachePolicy_Uncached:不缓存,每次访问都发到总线上,外设寄存器使用这个策略
+ * CachePolicy_ReadOnly:缓存读,写操作会使对应的缓存行失效,用于Flash和ROM
+ * CachePolicy_WriteThrough:缓存读,写操作成功后同时更新缓存行,用于RAM
+ */
+enum cachePolicy {
+	CachePolicy_Uncached = 0,
+	CachePolicy_ReadOnly,
+	CachePolicy_WriteThrough,
+};
+
+/**
+ * 缓存统计
+ */
+struct cacheStats {
+	uint64_t hits;	// 命中的缓存行数
+	uint64_t misses;	// 未命中的缓存行数
+	uint64_t fills;	// 填充缓存行的提交次数
+	uint64_t evictions;	// 被替换出去的有效缓存行数
+	uint64_t bypass;	// 没有经过缓存的访问次数
+};
+
+/**
+ * 配置主机端内存缓存
+ * 缓存默认关闭,开启后只有AddCacheRegion添加的区域会被缓存
+ * 参数:
+ * 	self:AccessPort对象
+ * 	lineSize:缓存行大小,2的幂,4~1024字节
+ * 	lineCount:缓存行数,0表示关闭缓存并释放内存
+ */
+typedef int (*ADIv5_MEM_AP_CONFIG_CACHE)(
+		IN AccessPort self,
+		IN unsigned int lineSize,
+		IN unsigned int lineCount
+);
+
+/**
+ * 设置一段地址区域的缓存策略,后添加的区域优先
+ * 参数:
+ * 	self:AccessPort对象
+ * 	base:区域基址
+ * 	size:区域大小
+ * 	policy:缓存策略
+ */
+typedef int (*ADIv5_MEM_AP_ADD_CACHE_REGION)(
+		IN AccessPort self,
+		IN uint64_t base,
+		IN uint64_t size,
+		IN enum cachePolicy policy
+);
+
+/**
+ * 使缓存失效
+ * 目标恢复运行,复位或者被其他主设备修改内存后必须调用
+ * 参数:
+ * 	self:AccessPort对象
+ * 	addr:起始地址
+ * 	size:大小,0表示使全部缓存失效
+ */
+typedef int (*ADIv5_MEM_AP_INVALIDATE_CACHE)(
+		IN AccessPort self,
+		IN uint64_t addr,
+		IN uint64_t size
+);
+
+/**
+ * 获得缓存统计
+ * 参数:
+ * 	self:AccessPort对象
+ * 	stats:统计数据
+ */
+typedef int (*ADIv5_MEM_AP_GET_CACHE_STATS)(
+		IN AccessPort self,
+		OUT struct cacheStats *stats
+);
+
+/**
+ * 进入或者退出写合并区间
+ * 区间内的Write8/16/32/64先放入写合并缓冲区,相邻和重叠的写操作合并成对齐的字写和Block写,
+ * 在退出最外层区间,读到缓冲区中的地址,Block写,写CSW或者调用FlushWrites时一次提交
+ * 缓冲区中的写操作按地址顺序提交,不保持原来的顺序,设备内存必须用AddDeviceRegion标记
+ * 参数:
+ * 	self:AccessPort对象
+ * 	enable:TRUE进入区间,可以嵌套;FALSE退出区间
+ */
+typedef int (*ADIv5_MEM_AP_WRITE_COMBINE)(
+		IN AccessPort self,
+		IN BOOL enable
+);
+
+/**
+ * 写屏障:提交写合并缓冲区中的所有写操作
+ * 参数:
+ * 	self:AccessPort对象
+ */
+typedef int (*ADIv5_MEM_AP_FLUSH_WRITES)(
+		IN AccessPort self
+);
+
+/**
+ * 把一段地址标记为设备内存
+ * 设备内存的写操作不会被合并,写之前先提交缓冲区,保证和之前的写操作的顺序
+ * 参数:
+ * 	self:AccessPort对象
+ * 	base:区域基址
+ * 	size:区域大小
+ */
+typedef int (*ADIv5_MEM_AP_ADD_DEVICE_REGION)(
+		IN AccessPort self,
+		IN uint64_t base,
+		IN uint64_t size
+);
+
+/**
+ * 校验内存,数据和期望值不一致时返回ADI_FAILED
+ * DP支持时使用pushed-verify:期望值作为写操作发出,由AP在片上比较,不需要读回数据
+ * 参数:
+ * 	self:AccessPort对象
+ * 	addr:起始地址,字对齐
+ * 	count:字数
+ * 	expect:期望的数据
+ * 	mismatch:第一个不一致的字的地址
+ */
+typedef int (*ADIv5_MEM_AP_VERIFY)(
+		IN AccessPort self,
+		IN uint64_t addr,
+		IN unsigned int count,
+		IN const uint32_t *expect,
+		OUT uint64_t *mismatch
+);
+
+/**
+ * 在内存中查找数据,没有找到返回ADI_FAILED
+ * DP支持时使用pushed-compare
+ * 参数:
+ * 	self:AccessPort对象
+ * 	addr:起始地址,字对齐
+ * 	count:查找的字数
+ * 	value:要查找的值
+ * 	lanes:参与比较的字节,bit0~3对应value的byte0~3
+ * 	where:第一个找到的字的地址
+ */
+typedef int (*ADIv5_MEM_AP_SEARCH)(
+		IN AccessPort self,
+		IN uint64_t addr,
+		IN unsigned int count,
+		IN uint32_t value,
+		IN uint8_t lanes,
+		OUT uint64_t *where
+);
+
+/**
+ * 用重复的pattern填充内存,不需要和填充长度一样大的缓冲区
+ * 参数:
+ * 	self:AccessPort对象
+ * 	addr:起始地址,可以不对齐
+ * 	len:填充的字节数
+ * 	pattern:重复的数据,低字节在前,addr处的字节是pattern的最低字节
+ * 	patternSize:pattern的字节数,1、2、4或8
+ */
+typedef int (*ADIv5_MEM_AP_FILL)(
+		IN AccessPort self,
+		IN uint64_t addr,
+		IN uint64_t len,
+		IN uint64_t pattern,
+		IN unsigned int patternSize
+);
+
+/**
+ * 写一段任意对齐的数据,中间对齐的部分用32位Block写
+ * 参数:
+ * 	self:AccessPort对象
+ * 	addr:起始地址,可以不对齐
+ * 	len:数据的字节数
+ * 	data:要写入的数据
+ */
+typedef int (*ADIv5_MEM_AP_WRITE)(
+		IN AccessPort self,
+		IN uint64_t addr,
+		IN uint64_t len,
+		IN const uint8_t *data
+);
+
+/**
+ * 镜像加载的统计
+ */
+struct loadStats {
+	uint64_t bytes;	// 写入的字节数
+	unsigned int segments;	// 写入的段数
+	double seconds;	// 写入用的时间
+	double verifySeconds;	// 校验用的时间,没有校验时为0
+};
+
+/**
+ * 把镜像写入目标内存,每段用Write写入,可选用Verify校验
+ * 参数:
+ * 	self:AccessPort对象
+ * 	image:镜像对象
+ * 	verify:写入后是否校验,校验失败返回ADI_FAILED
+ * 	stats:统计信息,可以为NULL
+ */
+typedef int (*ADIv5_MEM_AP_LOAD_IMAGE)(
+		IN AccessPort self,
+		IN Image image,
+		IN BOOL verify,
+		OUT struct loadStats *stats
+);
+
+/**
+ * 增量写入时比较的对象
+ * DeltaSource_Record:和主机端记录的上一次写入的数据比较,不需要读目标,
+ * 	记录之后目标内存被程序修改(例如目标运行过)时不能使用
+ * DeltaSource_Target:从目标读回比较,读回和写入在同一次提交中交替进行
+ */
+enum deltaSource {
+	DeltaSource_Record = 0,
+	DeltaSource_Target,
+};
+
+/**
+ * 增量写入,只写和比较对象不同的部分,间隔很小的不同部分合并成一次Block写
+ * 写入成功后更新主机端记录
+ * 参数:
+ * 	self:AccessPort对象
+ * 	addr:起始地址,可以不对齐
+ * 	len:数据的字节数
+ * 	data:要写入的数据
+ * 	source:比较的对象
+ * 	written:实际写入的字节数,可以为NULL
+ */
+typedef int (*ADIv5_MEM_AP_DELTA_WRITE)(
+		IN AccessPort self,
+		IN uint64_t addr,
+		IN uint64_t len,
+		IN const uint8_t *data,
+		IN enum deltaSource source,
+		OUT uint64_t *written
+);
+
+/**
+ * 内存转储选项
+ * DumpFlag_Resume:文件已经存在时从文件的长度处继续转储
+ * DumpFlag_Sparse:全0的页不写入文件(留下空洞),不能访问的页跳过并当作全0
+ */
+enum dumpFlag {
+	DumpFlag_Resume = 0x1,
+	DumpFlag_Sparse = 0x2,
+};
+
+/**
+ * 内存转储进度回调,每转储完一块调用一次,返回FALSE中止转储
+ * 参数:
+ * 	context:调用Dump时传入的参数
+ * 	done:已经转储的字节数,包括续传前文件中已有的部分
+ * 	total:总字节数
+ */
+typedef BOOL (*ADIv5_DUMP_PROGRESS)(
+		IN void *context,
+		IN uint64_t done,
+		IN uint64_t total
+);
+
+/**
+ * 转储内存到文件,按块读取后直接写入文件,主机内存占用和转储长度无关
+ * 文件的偏移0对应addr,被回调中止时返回ADI_FAILED,文件保留已转储的部分,可以续传
+ * 参数:
+ * 	self:AccessPort对象
+ * 	addr:起始地址,字对齐
+ * 	len:转储的字节数,字的整数倍
+ * 	path:输出文件路径
+ * 	flags:enum dumpFlag的组合
+ * 	progress:进度回调,可以为NULL
+ * 	context:传给进度回调的参数
+ * 	skipped:不能访问被跳过的字节数,可以为NULL
+ */
+typedef int (*ADIv5_MEM_AP_DUMP)(
+		IN AccessPort self,
+		IN uint64_t addr,
+		IN uint64_t len,
+		IN const char *path,
+		IN unsigned int flags,
+		IN ADIv5_DUMP_PROGRESS progress,
+		IN void *context,
+		OUT uint64_t *skipped
+);
+
+/**
+ * 创建内存扫描对象,用ADIv5_ScanNext逐个取得匹配
+ * 目标内存按块读到主机端,在主机端查找,每块一次提交
+ * 参数:
+ * 	self:AccessPort对象
+ * 	addr:起始地址,可以不对齐
+ * 	len:扫描的字节数,匹配必须完整落在范围内
+ * 	pattern:要查找的字节串
+ * 	mask:每个字节参与比较的位,NULL表示全部比较
+ * 	patternLen:字节串长度
+ * 	align:匹配地址的对齐,1、2、4或8
+ * 	scan:创建的扫描对象
+ */
+typedef int (*ADIv5_MEM_AP_SCAN)(
+		IN AccessPort self,
+		IN uint64_t addr,
+		IN uint64_t len,
+		IN const uint8_t *pattern,
+		IN const uint8_t *mask,
+		IN unsigned int patternLen,
+		IN unsigned int align,
+		OUT MemScan *scan
+);
+
+/**
+ * 批量读写中的一项
+ */
+struct memoryAccess {
+	uint64_t addr;	// 地址,必须按size对齐
+	uint64_t data;	// 读到的数据或要写入的数据,按数值存放,不按byte lane
+	enum dataSize size;	// 访问宽度,8、16、32或64位
+};
+
+/**
+ * 批量读取多个不连续的地址
+ * 所有读操作加入同一个指令队列,一次提交
+ * 参数:
+ * 	self:AccessPort对象
+ * 	access:要读的地址和宽度,读到的数据写回data
+ * 	count:项数
+ */
+typedef int (*ADIv5_MEM_AP_READ_MANY)(
+		IN AccessPort self,
+		IN OUT struct memoryAccess *access,
+		IN unsigned int count
+);
+
+/**
+ * 批量写入多个不连续的地址
+ * 按数组顺序写入,所有写操作加入同一个指令队列,一次提交
+ * 参数:
+ * 	self:AccessPort对象
+ * 	access:要写的地址、宽度和数据
+ * 	count:项数
+ */
+typedef int (*ADIv5_MEM_AP_WRITE_MANY)(
+		IN AccessPort self,
+		IN const struct memoryAccess *access,
+		IN unsigned int count
+);
+
+/**
+ * 把批量读取编译成可以重复执行的程序
+ * 由Adapter预先编码成数据包,执行时不需要重新构造指令,用于高频率采样一组固定的变量
+ * 程序不经过主机端缓存;Adapter不支持DapPrepare或者multi-drop模式下返回ADI_ERR_UNSUPPORT
+ * 参数:
+ * 	self:AccessPort对象
+ * 	access:要读的地址和宽度
+ * 	count:项数
+ * 	program:编译好的程序
+ */
+typedef int (*ADIv5_MEM_AP_PREPARE_READ)(
+		IN AccessPort self,
+		IN const struct memoryAccess *access,
+		IN unsigned int count,
+		OUT MemProgram *program
+);
+
+/**
+ * 执行预编译的批量读程序
+ * 参数:
+ * 	self:AccessPort对象
+ * 	program:PrepareRead编译的程序
+ * 	access:和编译时相同项数的数组,读到的数据写入data,地址和宽度是编译时的值
+ */
+typedef int (*ADIv5_MEM_AP_RUN_PROGRAM)(
+		IN AccessPort self,
+		IN MemProgram program,
+		OUT struct memoryAccess *access
+);
+
+/**
+ * 释放预编译的批量读程序
+ */
+typedef void (*ADIv5_MEM_AP_FREE_PROGRAM)(
+		IN AccessPort self,
+		IN MemProgram program
+);
+
 /**
  * Access Port接口定义
  */
@@ -371,6 +1007,49 @@ struct accessPort{
 			ADIv5_MEM_AP_WRITE_32 Write32;
 			ADIv5_MEM_AP_WRITE_64 Write64;
 			ADIv5_MEM_AP_BLOCK_WRITE BlockWrite;
+			// 批量读写不连续的地址
+			ADIv5_MEM_AP_READ_MANY ReadMany;
+			ADIv5_MEM_AP_WRITE_MANY WriteMany;
+			// 预编译的批量读
+			ADIv5_MEM_AP_PREPARE_READ PrepareRead;
+			ADIv5_MEM_AP_RUN_PROGRAM RunProgram;
+			ADIv5_MEM_AP_FREE_PROGRAM FreeProgram;
+			// 轮询等待
+			ADIv5_MEM_AP_WAIT_VALUE WaitValue;
+			// TAR地址自增的回绕大小
+			ADIv5_MEM_AP_SET_TAR_WRAP SetTarWrap;
+			ADIv5_MEM_AP_PROBE_TAR_WRAP ProbeTarWrap;
+
+			// Block传输出错恢复
+			ADIv5_MEM_AP_SET_TRANSFER_POLICY SetTransferPolicy;
+			ADIv5_MEM_AP_GET_TRANSFER_STATUS GetTransferStatus;
+
+			// 主机端内存缓存
+			ADIv5_MEM_AP_CONFIG_CACHE ConfigCache;
+			ADIv5_MEM_AP_ADD_CACHE_REGION AddCacheRegion;
+			ADIv5_MEM_AP_INVALIDATE_CACHE InvalidateCache;
+			ADIv5_MEM_AP_GET_CACHE_STATS GetCacheStats;
+
+			// 写合并
+			ADIv5_MEM_AP_WRITE_COMBINE WriteCombine;
+			ADIv5_MEM_AP_FLUSH_WRITES FlushWrites;
+			ADIv5_MEM_AP_ADD_DEVICE_REGION AddDeviceRegion;
+
+			// 校验和查找
+			ADIv5_MEM_AP_VERIFY Verify;
+			ADIv5_MEM_AP_SEARCH Search;
+			// 主机端内存扫描
+			ADIv5_MEM_AP_SCAN Scan;
+			// 填充
+			ADIv5_MEM_AP_FILL Fill;
+			// 写任意对齐的数据
+			ADIv5_MEM_AP_WRITE Write;
+			// 加载镜像
+			ADIv5_MEM_AP_LOAD_IMAGE LoadImage;
+			// 增量写入
+			ADIv5_MEM_AP_DELTA_WRITE DeltaWrite;
+			// 转储到文件
+			ADIv5_MEM_AP_DUMP Dump;
 		}Memory;
 		// JTAG-AP
 		struct {
@@ -379,5 +1058,322 @@ struct accessPort{
 	} Interface;
 };
 
+/**
+ * 内存区域的类型
+ * MemoryType_Normal:普通内存,读写没有副作用,可以地址自增批量访问
+ * MemoryType_Device:设备内存,每次访问都可能有副作用,用允许的宽度逐个访问,不缓存也不合并写
+ */
+enum memoryType {
+	MemoryType_Normal = 0,
+	MemoryType_Device,
+};
+
+// 内存区域允许的访问宽度掩码,参数是enum dataSize
+#define MEMORY_WIDTH(size)	(1u << (size))
+#define MEMORY_WIDTH_ALL	(MEMORY_WIDTH(DataSize_8) | MEMORY_WIDTH(DataSize_16) | MEMORY_WIDTH(DataSize_32))
+
+/**
+ * 内存映射的区域
+ */
+struct memoryRegion {
+	uint64_t base;	// 基址
+	uint64_t size;	// 字节数
+	unsigned int apIndex;	// 所属MEM-AP的索引
+	unsigned int widths;	// 允许的访问宽度,MEMORY_WIDTH的组合,0表示AP支持的所有宽度
+	enum memoryType type;	// 内存类型
+	unsigned int maxBurst;	// 一次地址自增传输的最大字节数,0表示不限制(设备内存为不自增)
+	enum cachePolicy cache;	// 主机端缓存策略
+};
+
+/**
+ * 规划出的一次访问
+ * mode为AddrInc_Off时是一次单独的访问,count为1
+ * mode为AddrInc_Packed时count是DRW的访问次数,每次传输4字节
+ */
+struct accessStep {
+	uint64_t addr;	// 起始地址
+	uint32_t len;	// 字节数
+	unsigned int count;	// 传输次数
+	unsigned int apIndex;	// 经过的MEM-AP的索引
+	enum dataSize size;	// 单次总线请求的数据长度
+	enum addrIncreaseMode mode;	// 地址自增模式
+	enum memoryType type;	// 所在区域的内存类型
+};
+
+/**
+ * 变量监视的一个采样
+ */
+struct watchSample {
+	uint64_t time;	// 采样时间,从Start开始的纳秒数
+	uint32_t entry;	// 监视项的索引
+	uint32_t tick;	// 采样所在的节拍
+	uint64_t value;	// 读到的值
+};
+
+/**
+ * 监视日志文件的格式
+ * WatchLog_CSV:每行一个采样,"time_ns,name,value"
+ * WatchLog_Binary:文件头、监视项表,然后是struct watchSample记录
+ */
+enum watchLogFormat {
+	WatchLog_CSV = 0,
+	WatchLog_Binary,
+};
+
+/**
+ * 变量监视的统计
+ */
+struct watchStats {
+	uint64_t ticks;	// 执行的节拍数
+	uint64_t transactions;	// 提交的批量读次数
+	uint64_t samples;	// 写入环形缓冲区的采样数
+	uint64_t dropped;	// 环形缓冲区满时丢弃的采样数
+	uint64_t late;	// 没有按时执行而跳过的节拍数
+	uint64_t errors;	// 读取失败的节拍数
+	uint64_t logged;	// 写入日志文件的采样数
+	int lastError;	// 最后一次失败的错误码
+	BOOL running;
+};
+
+/**
+ * 创建变量监视对象
+ * 监视线程按固定的节拍运行,每个节拍把到期的监视项合并成一次批量读,
+ * 同一个字或者相邻字中的监视项合并成地址连续的32位读,只写一次TAR。
+ * 到期的监视项组合第一次出现时编译成预编译程序(Adapter支持时),之后重复执行
+ * 参数:
+ * 	self:MEM-AP对象
+ * 	tickHz:节拍频率,0表示不等待,连续采样
+ * 	capacity:环形缓冲区的采样数
+ * 	watch:创建的监视对象
+ */
+int ADIv5_WatchCreate(
+		IN AccessPort self,
+		IN unsigned int tickHz,
+		IN unsigned int capacity,
+		OUT MemWatch *watch
+);
+
+/**
+ * 增加监视项,只能在停止时调用
+ * 参数:
+ * 	addr:地址,必须按size对齐
+ * 	size:宽度,8、16、32或64位
+ * 	rateHz:采样频率,按节拍频率取整,0表示每个节拍都采样
+ * 	name:名字,用于日志文件,NULL时使用地址
+ * 	entry:监视项的索引,从0开始
+ */
+int ADIv5_WatchAdd(
+		IN MemWatch watch,
+		IN uint64_t addr,
+		IN enum dataSize size,
+		IN unsigned int rateHz,
+		IN const char *name,
+		OUT unsigned int *entry
+);
+
+/**
+ * 把采样写入日志文件,只能在停止时调用
+ * 设置后由日志线程读取环形缓冲区,ADIv5_WatchDrain不再返回采样
+ * 参数:
+ * 	path:日志文件路径,NULL表示取消
+ * 	format:文件格式
+ */
+int ADIv5_WatchLog(
+		IN MemWatch watch,
+		IN const char *path,
+		IN enum watchLogFormat format
+);
+
+/**
+ * 启动监视线程
+ * 运行期间不能在其他线程中访问这个MEM-AP所在的Adapter
+ */
+int ADIv5_WatchStart(
+		IN MemWatch watch
+);
+
+/**
+ * 停止监视线程,等待当前节拍完成;设置了日志文件时写完剩余的采样,文件保持打开,再次启动时继续追加
+ */
+void ADIv5_WatchStop(
+		IN MemWatch watch
+);
+
+/**
+ * 从环形缓冲区读出采样,可以在运行时调用
+ * 参数:
+ * 	samples:存放采样的数组
+ * 	max:最多读出的采样数
+ * 返回:
+ * 	读出的采样数
+ */
+unsigned int ADIv5_WatchDrain(
+		IN MemWatch watch,
+		OUT struct watchSample *samples,
+		IN unsigned int max
+);
+
+/**
+ * 获得统计信息
+ */
+void ADIv5_WatchStats(
+		IN MemWatch watch,
+		OUT struct watchStats *stats
+);
+
+/**
+ * 停止并销毁监视对象
+ */
+void ADIv5_WatchDestroy(
+		IN MemWatch *watch
+);
+
+/**
+ * PC采样寄存器的种类
+ * ProfileCore_DWT:Cortex-M的DWT_PCSR,base是DWT的基地址,开始时置位DEMCR.TRCENA
+ * ProfileCore_EDPCSR:ARMv8外部调试接口的EDPCSRlo,base是核心调试寄存器的基地址,只取低32位
+ * ProfileCore_EDPCSR64:依次读EDPCSRlo和EDPCSRhi,得到64位PC
+ * EDPCSR类型开始时写EDLAR解锁并清除OS Lock
+ */
+enum profileCoreType {
+	ProfileCore_DWT = 0,
+	ProfileCore_EDPCSR,
+	ProfileCore_EDPCSR64,
+};
+
+/**
+ * 导出文件的格式
+ * ProfileExport_Folded:折叠栈格式,每行"coreN;函数 次数",可以直接交给flamegraph.pl
+ * ProfileExport_Perf:perf script的文本格式,每个不同的PC一条记录,period为命中次数
+ */
+enum profileExportFormat {
+	ProfileExport_Folded = 0,
+	ProfileExport_Perf,
+};
+
+/**
+ * 直方图中的一项
+ */
+struct profileHit {
+	uint64_t pc;
+	uint32_t core;	// 核心的索引
+	uint64_t count;	// 命中次数
+};
+
+/**
+ * PC采样的统计
+ */
+struct profileStats {
+	uint64_t samples;	// 有效的采样数
+	uint64_t invalid;	// 核心停止或者禁止采样时读到的无效值
+	uint64_t batches;	// 提交的批量读次数
+	uint64_t errors;	// 读取失败的批次数
+	uint64_t elapsedNs;	// 采样时间
+	unsigned int uniquePCs;	// 直方图中不同的PC数
+	int lastError;	// 最后一次失败的错误码
+	BOOL running;
+};
+
+/**
+ * 创建PC采样分析对象
+ * 采样线程不断读取各个核心的PC采样寄存器,同一个MEM-AP上的核心交替排列在一次批量读中,
+ * 单独的32位采样寄存器用地址不自增的块读。采样在主机上按PC累加到散列表中
+ * 参数:
+ * 	batch:每个核心每批读取的采样数
+ * 	profile:创建的对象
+ */
+int ADIv5_ProfileCreate(
+		IN unsigned int batch,
+		OUT PcProfile *profile
+);
+
+/**
+ * 增加一个核心,只能在停止时调用
+ * 参数:
+ * 	self:核心所在的MEM-AP,Cortex-M是AHB-AP,ARMv8是APB-AP
+ * 	type:采样寄存器的种类
+ * 	base:DWT或者核心调试寄存器的基地址
+ * 	core:核心的索引,从0开始
+ */
+int ADIv5_ProfileAddCore(
+		IN PcProfile profile,
+		IN AccessPort self,
+		IN enum profileCoreType type,
+		IN uint64_t base,
+		OUT unsigned int *core
+);
+
+/**
+ * 启动采样线程,多次启动的采样累加到同一个直方图中,直到ADIv5_ProfileClear
+ * 运行期间不能在其他线程中访问这些MEM-AP所在的Adapter
+ * 参数:
+ * 	durationMs:采样时间,到时后采样线程自己结束,0表示直到ADIv5_ProfileStop
+ */
+int ADIv5_ProfileStart(
+		IN PcProfile profile,
+		IN unsigned int durationMs
+);
+
+/**
+ * 等待采样线程结束,没有设置采样时间时一直等待
+ */
+void ADIv5_ProfileWait(
+		IN PcProfile profile
+);
+
+/**
+ * 停止采样线程,等待当前批次完成
+ */
+void ADIv5_ProfileStop(
+		IN PcProfile profile
+);
+
+/**
+ * 清空直方图,只能在停止时调用
+ */
+void ADIv5_ProfileClear(
+		IN PcProfile profile
+);
+
+/**
+ * 获得统计信息,可以在运行时调用
+ */
+void ADIv5_ProfileStats(
+		IN PcProfile profile,
+		OUT struct profileStats *stats
+);
+
+/**
+ * 取出直方图,按命中次数从多到少排序,只能在停止时调用
+ * 参数:
+ * 	hits:分配的数组,调用者用free释放,没有采样时为NULL
+ * 返回:
+ * 	项数
+ */
+unsigned int ADIv5_ProfileHits(
+		IN PcProfile profile,
+		OUT struct profileHit **hits
+);
+
+/**
+ * 导出采样结果,只能在停止时调用
+ * 参数:
+ * 	path:文件路径
+ * 	format:文件格式
+ * 	syms:用于把PC解析成函数的符号,NULL时只输出地址
+ */
+int ADIv5_ProfileExport(
+		IN PcProfile profile,
+		IN const char *path,
+		IN enum profileExportFormat format,
+		IN Symbols syms
+);
+
+/**
+ * 停止并销毁PC采样分析对象
+ */
+void ADIv5_ProfileDestroy(
+		IN PcProfile *profile
+);
 
 #endif /* SRC_ARCH_ARM_ADI_ADIV5_H_ */
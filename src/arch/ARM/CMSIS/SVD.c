@@ -0,0 +1,972 @@
+/*
+ * SVD.c
+ *
+ *  Created on: 2019-7-4
+ *      Author: virusv
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/stat.h>
+#include "smart_ocd.h"
+#include "misc/log.h"
+#include "misc/misc.h"
+#include "arch/ARM/CMSIS/include/SVD.h"
+
+#define SVD_DB_MAGIC	0x42445653	// "SVDB"
+#define SVD_DB_VERSION	1
+
+// 散列表项:ref的高2位是记录类型,低30位是索引
+#define SVD_HASH_EMPTY	0xFFFFFFFFu
+#define SVD_KIND_PERIPHERAL	0
+#define SVD_KIND_REGISTER	1
+#define SVD_KIND_FIELD	2
+#define SVD_REF(kind, index)	(((uint32_t)(kind) << 30) | (uint32_t)(index))
+#define SVD_REF_KIND(ref)	((ref) >> 30)
+#define SVD_REF_INDEX(ref)	((ref) & 0x3FFFFFFFu)
+
+/**
+ * 数据库文件格式
+ * 文件头之后依次是外设、寄存器、位域、散列表和字符串池,全部4字节对齐
+ */
+struct svdHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t sourceHash;	// SVD文件内容的散列
+	uint64_t sourceSize;	// SVD文件的字节数
+	uint32_t peripheralCount;
+	uint32_t registerCount;
+	uint32_t fieldCount;
+	uint32_t hashSize;	// 散列表项数,2的幂
+	uint32_t stringsSize;	// 字符串池的字节数
+	uint32_t reserved;
+};
+
+struct svdHashEntry {
+	uint32_t hash;
+	uint32_t ref;
+};
+
+struct svdDatabase {
+	const uint8_t *image;	// 数据库
+	size_t length;
+	BOOL mapped;	// image是映射的缓存文件
+	const struct svdHeader *header;
+	const struct svdPeripheral *peripherals;
+	const struct svdRegister *registers;
+	const struct svdField *fields;
+	const struct svdHashEntry *hash;
+	const char *strings;
+};
+
+/**
+ * 名字的散列,同一个外设的寄存器、同一个寄存器的位域用各自的scope区分
+ */
+static uint32_t nameHash(const char *name, unsigned int kind, uint32_t scope){
+	uint64_t seed = (((uint64_t)kind << 32) | scope) ^ 0xcbf29ce484222325ull;
+	return (uint32_t)misc_Hash64(name, strlen(name), seed);
+}
+
+/******************************* XML解析 *******************************/
+/**
+ * 只支持SVD用到的XML子集:元素、文本、CDATA和属性,跳过声明、注释和DOCTYPE
+ * 在文件内容上原地解析,名字和文本直接指向缓冲区
+ */
+struct xmlNode {
+	char *name;
+	char *text;	// 去掉首尾空白的文本
+	char *derivedFrom;	// derivedFrom属性
+	struct xmlNode *parent;
+	struct xmlNode *child;
+	struct xmlNode *lastChild;
+	struct xmlNode *next;
+};
+
+#define XML_BLOCK_NODES 4096
+
+struct xmlBlock {
+	struct xmlBlock *next;
+	unsigned int used;
+	struct xmlNode nodes[XML_BLOCK_NODES];
+};
+
+struct xmlDocument {
+	struct xmlBlock *blocks;
+	struct xmlNode root;
+};
+
+static char emptyText[] = "";
+
+static BOOL isSpace(char c){
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static struct xmlNode *xmlNewNode(struct xmlDocument *doc, struct xmlNode *parent){
+	struct xmlBlock *block = doc->blocks;
+	struct xmlNode *node;
+	if(block == NULL || block->used == XML_BLOCK_NODES){
+		block = malloc(sizeof(struct xmlBlock));
+		if(block == NULL) return NULL;
+		block->used = 0;
+		block->next = doc->blocks;
+		doc->blocks = block;
+	}
+	node = &block->nodes[block->used++];
+	memset(node, 0x0, sizeof(struct xmlNode));
+	node->text = emptyText;
+	node->parent = parent;
+	if(parent->lastChild){
+		parent->lastChild->next = node;
+	}else{
+		parent->child = node;
+	}
+	parent->lastChild = node;
+	return node;
+}
+
+static void xmlFree(struct xmlDocument *doc){
+	struct xmlBlock *block, *next;
+	for(block = doc->blocks; block; block = next){
+		next = block->next;
+		free(block);
+	}
+	doc->blocks = NULL;
+}
+
+/**
+ * 原地解码预定义的实体
+ */
+static void xmlDecode(char *text){
+	static const struct {
+		const char *entity;
+		char c;
+	} entities[] = {
+		{"&lt;", '<'}, {"&gt;", '>'}, {"&amp;", '&'}, {"&quot;", '"'}, {"&apos;", '\''}, {NULL, 0}
+	};
+	char *in = strchr(text, '&'), *out;
+	int i;
+	if(in == NULL) return;
+	for(out = in; *in; ){
+		if(*in == '&'){
+			for(i = 0; entities[i].entity; i++){
+				if(strncmp(in, entities[i].entity, strlen(entities[i].entity)) == 0) break;
+			}
+			if(entities[i].entity){
+				*out++ = entities[i].c;
+				in += strlen(entities[i].entity);
+				continue;
+			}
+		}
+		*out++ = *in++;
+	}
+	*out = '\0';
+}
+
+static char *skipPast(char *p, const char *token){
+	char *q = strstr(p, token);
+	return q ? q + strlen(token) : NULL;
+}
+
+/**
+ * 解析以'\0'结尾的XML文本
+ */
+static BOOL xmlParse(struct xmlDocument *doc, char *buffer){
+	struct xmlNode *cur = &doc->root, *node;
+	char *p = buffer, *lt, *start, *end, *attrName, *attrEnd, *value, c, quote;
+	while(p && *p){
+		lt = strchr(p, '<');
+		if(lt == NULL) break;
+		// 标签之前的文本
+		for(start = p; start < lt && isSpace(*start); start++);
+		for(end = lt; end > start && isSpace(end[-1]); end--);
+		if(end > start && cur != &doc->root && cur->text[0] == '\0'){
+			cur->text = start;
+			*end = '\0';	// 可能覆盖'<',下面从lt + 1继续
+			xmlDecode(start);
+		}
+		p = lt + 1;
+		if(*p == '\0') goto MALFORMED;
+		if(*p == '?'){
+			p = skipPast(p, "?>");
+		}else if(strncmp(p, "!--", 3) == 0){
+			p = skipPast(p + 3, "-->");
+		}else if(strncmp(p, "![CDATA[", 8) == 0){
+			start = p + 8;
+			p = skipPast(start, "]]>");
+			if(p && cur != &doc->root){
+				p[-3] = '\0';
+				cur->text = start;
+			}
+		}else if(*p == '!'){
+			p = skipPast(p, ">");
+		}else if(*p == '/'){
+			p = skipPast(p, ">");
+			if(cur == &doc->root) goto MALFORMED;
+			cur = cur->parent;
+		}else{
+			node = xmlNewNode(doc, cur);
+			if(node == NULL){
+				log_error("SVD: not enough memory.");
+				return FALSE;
+			}
+			node->name = p;
+			while(*p && !isSpace(*p) && *p != '>' && *p != '/') p++;
+			if(*p == '\0') goto MALFORMED;
+			c = *p;
+			*p++ = '\0';
+			// 属性
+			while(isSpace(c)){
+				while(isSpace(*p)) p++;
+				if(*p == '/' || *p == '>'){
+					c = *p++;
+					break;
+				}
+				attrName = p;
+				while(*p && *p != '=' && !isSpace(*p) && *p != '>' && *p != '/') p++;
+				attrEnd = p;
+				while(isSpace(*p)) p++;
+				if(*p != '=') goto MALFORMED;
+				p++;
+				while(isSpace(*p)) p++;
+				quote = *p;
+				if(quote != '"' && quote != '\'') goto MALFORMED;
+				value = ++p;
+				p = strchr(p, quote);
+				if(p == NULL) goto MALFORMED;
+				*p++ = '\0';
+				*attrEnd = '\0';
+				if(strcmp(attrName, "derivedFrom") == 0){
+					node->derivedFrom = value;
+				}
+				c = *p;
+				if(c == '\0') goto MALFORMED;
+				p++;
+			}
+			if(c == '/'){
+				if(*p != '>') goto MALFORMED;
+				p++;
+			}else if(c == '>'){
+				cur = node;
+			}else{
+				goto MALFORMED;
+			}
+		}
+	}
+	// 没有闭合的元素
+	if(p == NULL || cur != &doc->root) goto MALFORMED;
+	return TRUE;
+MALFORMED:
+	log_error("SVD: malformed XML near offset %ld.", p ? (long)(p - buffer) : -1L);
+	return FALSE;
+}
+
+static struct xmlNode *xmlChild(struct xmlNode *node, const char *name){
+	struct xmlNode *child;
+	for(child = node->child; child; child = child->next){
+		if(strcmp(child->name, name) == 0) return child;
+	}
+	return NULL;
+}
+
+static const char *xmlText(struct xmlNode *node, const char *name){
+	struct xmlNode *child = xmlChild(node, name);
+	return child ? child->text : NULL;
+}
+
+/******************************* 编译 *******************************/
+/**
+ * scaledNonNegativeInteger:十进制、0x十六进制或者#二进制,可以带k/M/G后缀
+ */
+static BOOL parseNumber(const char *text, uint64_t *value){
+	uint64_t result = 0;
+	char *end;
+	if(text == NULL || *text == '\0') return FALSE;
+	if(*text == '#' || (text[0] == '0' && (text[1] == 'b' || text[1] == 'B'))){
+		for(text += (*text == '#') ? 1 : 2; *text == '0' || *text == '1' || *text == 'x' || *text == 'X'; text++){
+			result = (result << 1) | (*text == '1');
+		}
+		end = CAST(char *, text);
+	}else if(text[0] == '0' && (text[1] == 'x' || text[1] == 'X')){
+		result = strtoull(text + 2, &end, 16);
+	}else{
+		result = strtoull(text, &end, 10);
+	}
+	switch(*end){
+	case 'k': case 'K': result <<= 10; break;
+	case 'm': case 'M': result <<= 20; break;
+	case 'g': case 'G': result <<= 30; break;
+	default:
+		if(*end != '\0') return FALSE;
+	}
+	*value = result;
+	return TRUE;
+}
+
+static uint32_t childNumber(struct xmlNode *node, const char *name, uint32_t def){
+	uint64_t value;
+	return parseNumber(xmlText(node, name), &value) ? (uint32_t)value : def;
+}
+
+static uint8_t parseAccess(const char *text, uint8_t def){
+	if(text == NULL) return def;
+	if(strcmp(text, "read-only") == 0) return SVD_ACCESS_READ;
+	if(strcmp(text, "write-only") == 0 || strcmp(text, "writeOnce") == 0) return SVD_ACCESS_WRITE;
+	if(strcmp(text, "read-write") == 0 || strcmp(text, "read-writeOnce") == 0) return SVD_ACCESS_READ_WRITE;
+	return def;
+}
+
+// 可以从device、peripheral、cluster继承的寄存器属性
+struct registerProps {
+	uint32_t size;
+	uint32_t resetValue;
+	uint32_t resetMask;
+	uint8_t access;
+};
+
+static void readProps(struct xmlNode *node, struct registerProps *props){
+	props->size = childNumber(node, "size", props->size);
+	props->resetValue = childNumber(node, "resetValue", props->resetValue);
+	props->resetMask = childNumber(node, "resetMask", props->resetMask);
+	props->access = parseAccess(xmlText(node, "access"), props->access);
+}
+
+// 编译过程中的寄存器和位域,scope是散列时使用的范围
+struct buildRegister {
+	struct svdRegister reg;
+	uint32_t scope;
+};
+
+struct buildField {
+	struct svdField field;
+	uint32_t scope;
+};
+
+struct svdBuilder {
+	struct svdPeripheral *peripherals;
+	unsigned int peripheralCount, peripheralCapacity;
+	struct buildRegister *registers;
+	unsigned int registerCount, registerCapacity;
+	struct buildField *fields;
+	unsigned int fieldCount, fieldCapacity;
+	char *strings;
+	unsigned int stringsSize, stringsCapacity;
+	uint32_t *stringTable;	// 字符串去重,保存偏移+1
+	unsigned int stringCount, stringTableSize;
+	BOOL failed;
+};
+
+/**
+ * 保证数组能容纳count + 1个元素
+ */
+static BOOL reserve(struct svdBuilder *builder, void **array, unsigned int *capacity, unsigned int count, size_t size){
+	unsigned int newCapacity;
+	void *data;
+	if(count < *capacity) return TRUE;
+	newCapacity = *capacity ? *capacity * 2 : 64;
+	data = realloc(*array, newCapacity * size);
+	if(data == NULL){
+		builder->failed = TRUE;
+		return FALSE;
+	}
+	*array = data;
+	*capacity = newCapacity;
+	return TRUE;
+}
+
+static uint32_t addString(struct svdBuilder *builder, const char *str){
+	size_t len = strlen(str);
+	uint32_t *table, offset, idx, mask;
+	unsigned int i;
+	if((builder->stringCount + 1) * 2 > builder->stringTableSize){
+		unsigned int size = builder->stringTableSize ? builder->stringTableSize * 2 : 1024;
+		table = calloc(size, sizeof(uint32_t));
+		if(table == NULL){
+			builder->failed = TRUE;
+			return 0;
+		}
+		for(i = 0; i < builder->stringTableSize; i++){
+			if(builder->stringTable[i] == 0) continue;
+			offset = builder->stringTable[i] - 1;
+			idx = (uint32_t)misc_Hash64(builder->strings + offset, strlen(builder->strings + offset), 0) & (size - 1);
+			while(table[idx]) idx = (idx + 1) & (size - 1);
+			table[idx] = offset + 1;
+		}
+		free(builder->stringTable);
+		builder->stringTable = table;
+		builder->stringTableSize = size;
+	}
+	mask = builder->stringTableSize - 1;
+	for(idx = (uint32_t)misc_Hash64(str, len, 0) & mask; builder->stringTable[idx]; idx = (idx + 1) & mask){
+		offset = builder->stringTable[idx] - 1;
+		if(strcmp(builder->strings + offset, str) == 0) return offset;
+	}
+	while(builder->stringsSize + len + 1 > builder->stringsCapacity){
+		char *data = realloc(builder->strings, builder->stringsCapacity ? builder->stringsCapacity * 2 : 4096);
+		if(data == NULL){
+			builder->failed = TRUE;
+			return 0;
+		}
+		builder->strings = data;
+		builder->stringsCapacity = builder->stringsCapacity ? builder->stringsCapacity * 2 : 4096;
+	}
+	offset = builder->stringsSize;
+	memcpy(builder->strings + offset, str, len + 1);
+	builder->stringsSize += len + 1;
+	builder->stringTable[idx] = offset + 1;
+	builder->stringCount++;
+	return offset;
+}
+
+/**
+ * dim数组的下标
+ * dimIndex可以是逗号分隔的列表或者"0-3"、"A-D"这样的范围,没有dimIndex时是0..dim-1
+ */
+#define DIM_INDEX_LEN 32
+struct dimInfo {
+	unsigned int count;	// 1表示不是数组
+	uint32_t increment;
+	char (*index)[DIM_INDEX_LEN];
+};
+
+static BOOL readDim(struct xmlNode *node, struct dimInfo *dim){
+	const char *text, *comma;
+	unsigned int i, len;
+	char first, last;
+	dim->count = childNumber(node, "dim", 1);
+	dim->increment = childNumber(node, "dimIncrement", 0);
+	dim->index = NULL;
+	if(dim->count <= 1 || xmlChild(node, "dim") == NULL){
+		dim->count = 1;
+		return TRUE;
+	}
+	dim->index = calloc(dim->count, DIM_INDEX_LEN);
+	if(dim->index == NULL) return FALSE;
+	text = xmlText(node, "dimIndex");
+	if(text && strchr(text, ',') == NULL && strlen(text) == 3 && text[1] == '-' && text[0] >= 'A' && text[0] <= 'Z'){
+		first = text[0];
+		last = text[2];
+		for(i = 0; i < dim->count; i++){
+			dim->index[i][0] = (first + i <= last) ? first + i : '?';
+		}
+	}else if(text && strchr(text, ',') == NULL && strchr(text, '-')){
+		unsigned int start = (unsigned int)strtoul(text, NULL, 10);
+		for(i = 0; i < dim->count; i++){
+			snprintf(dim->index[i], DIM_INDEX_LEN, "%u", start + i);
+		}
+	}else{
+		for(i = 0; i < dim->count; i++){
+			if(text && *text){
+				while(isSpace(*text)) text++;
+				comma = strchr(text, ',');
+				len = comma ? (unsigned int)(comma - text) : (unsigned int)strlen(text);
+				if(len >= DIM_INDEX_LEN) len = DIM_INDEX_LEN - 1;
+				memcpy(dim->index[i], text, len);
+				text = comma ? comma + 1 : NULL;
+			}else{
+				snprintf(dim->index[i], DIM_INDEX_LEN, "%u", i);
+			}
+		}
+	}
+	return TRUE;
+}
+
+/**
+ * 展开名字中的"[%s]"和"%s"
+ */
+static void dimName(char *out, size_t size, const char *prefix, const char *name, const char *index){
+	const char *pos;
+	size_t len;
+	snprintf(out, size, "%s", prefix);
+	len = strlen(out);
+	if(index && (pos = strstr(name, "%s")) != NULL){
+		size_t head = pos - name, skip = 2;
+		if(head > 0 && name[head - 1] == '[' && name[head + 2] == ']'){
+			head--;
+			skip = 4;
+		}
+		snprintf(out + len, size - len, "%.*s%s%s", (int)head, name, index, name + head + skip);
+	}else{
+		snprintf(out + len, size - len, "%s", name);
+	}
+}
+
+static void addFields(struct svdBuilder *builder, struct xmlNode *fieldsNode, uint8_t access){
+	struct xmlNode *node;
+	struct dimInfo dim;
+	const char *name, *range;
+	uint32_t bitOffset, bitWidth, msb, lsb, scope = builder->fieldCount;
+	unsigned int i;
+	char fullName[128];
+	for(node = fieldsNode->child; node; node = node->next){
+		if(strcmp(node->name, "field") != 0) continue;
+		name = xmlText(node, "name");
+		if(name == NULL) continue;
+		if((range = xmlText(node, "bitRange")) != NULL && sscanf(range, "[%u:%u]", &msb, &lsb) == 2){
+			bitOffset = lsb;
+			bitWidth = msb - lsb + 1;
+		}else if(xmlChild(node, "lsb") && xmlChild(node, "msb")){
+			lsb = childNumber(node, "lsb", 0);
+			msb = childNumber(node, "msb", 0);
+			bitOffset = lsb;
+			bitWidth = msb - lsb + 1;
+		}else{
+			bitOffset = childNumber(node, "bitOffset", 0);
+			bitWidth = childNumber(node, "bitWidth", 1);
+		}
+		if(readDim(node, &dim) == FALSE){
+			builder->failed = TRUE;
+			return;
+		}
+		for(i = 0; i < dim.count; i++){
+			uint32_t offset = bitOffset + i * dim.increment;
+			if(bitWidth == 0 || bitWidth > 32 || offset + bitWidth > 32){
+				log_warn("SVD: field %s has an invalid bit range, ignored.", name);
+				continue;
+			}
+			if(builder->fieldCount - scope >= 0xFFFF) break;
+			if(reserve(builder, (void **)&builder->fields, &builder->fieldCapacity, builder->fieldCount, sizeof(struct buildField)) == FALSE) break;
+			dimName(fullName, sizeof(fullName), "", name, dim.index ? dim.index[i] : NULL);
+			builder->fields[builder->fieldCount].field.name = addString(builder, fullName);
+			builder->fields[builder->fieldCount].field.bitOffset = (uint8_t)offset;
+			builder->fields[builder->fieldCount].field.bitWidth = (uint8_t)bitWidth;
+			builder->fields[builder->fieldCount].field.access = parseAccess(xmlText(node, "access"), access);
+			builder->fields[builder->fieldCount].field.reserved = 0;
+			builder->fields[builder->fieldCount].scope = scope;
+			builder->fieldCount++;
+		}
+		free(dim.index);
+	}
+}
+
+/**
+ * 在当前外设已经编译的寄存器中按名字查找,用于寄存器的derivedFrom
+ */
+static struct svdRegister *findBuiltRegister(struct svdBuilder *builder, uint32_t scope, const char *name){
+	const char *dot = strrchr(name, '.');
+	unsigned int i;
+	if(dot) name = dot + 1;
+	for(i = scope; i < builder->registerCount; i++){
+		if(strcmp(builder->strings + builder->registers[i].reg.name, name) == 0){
+			return &builder->registers[i].reg;
+		}
+	}
+	return NULL;
+}
+
+static void addRegisters(struct svdBuilder *builder, struct xmlNode *container, uint32_t baseOffset,
+		const char *prefix, const struct registerProps *inherit, uint32_t scope){
+	struct xmlNode *node, *fieldsNode;
+	struct registerProps props;
+	struct dimInfo dim;
+	struct svdRegister *base;
+	const char *name;
+	uint32_t offset, firstField, fieldCount;
+	unsigned int i;
+	char fullName[128];
+	for(node = container->child; node && !builder->failed; node = node->next){
+		BOOL isCluster = strcmp(node->name, "cluster") == 0;
+		if(!isCluster && strcmp(node->name, "register") != 0) continue;
+		name = xmlText(node, "name");
+		if(name == NULL) continue;
+		props = *inherit;
+		readProps(node, &props);
+		offset = baseOffset + childNumber(node, "addressOffset", 0);
+		if(readDim(node, &dim) == FALSE){
+			builder->failed = TRUE;
+			return;
+		}
+		if(isCluster){
+			for(i = 0; i < dim.count; i++){
+				dimName(fullName, sizeof(fullName) - 1, prefix, name, dim.index ? dim.index[i] : NULL);
+				strcat(fullName, "_");
+				addRegisters(builder, node, offset + i * dim.increment, fullName, &props, scope);
+			}
+			free(dim.index);
+			continue;
+		}
+		// 位域在dim展开的寄存器之间共享
+		firstField = builder->fieldCount;
+		fieldsNode = xmlChild(node, "fields");
+		if(fieldsNode){
+			addFields(builder, fieldsNode, props.access);
+		}
+		fieldCount = builder->fieldCount - firstField;
+		if(fieldsNode == NULL && node->derivedFrom && (base = findBuiltRegister(builder, scope, node->derivedFrom)) != NULL){
+			firstField = base->firstField;
+			fieldCount = base->fieldCount;
+			if(xmlChild(node, "size") == NULL) props.size = base->size;
+			if(xmlChild(node, "resetValue") == NULL) props.resetValue = base->resetValue;
+			if(xmlChild(node, "access") == NULL) props.access = base->access;
+		}
+		for(i = 0; i < dim.count; i++){
+			if(reserve(builder, (void **)&builder->registers, &builder->registerCapacity, builder->registerCount, sizeof(struct buildRegister)) == FALSE) break;
+			dimName(fullName, sizeof(fullName), prefix, name, dim.index ? dim.index[i] : NULL);
+			builder->registers[builder->registerCount].reg.name = addString(builder, fullName);
+			builder->registers[builder->registerCount].reg.addressOffset = offset + i * dim.increment;
+			builder->registers[builder->registerCount].reg.resetValue = props.resetValue;
+			builder->registers[builder->registerCount].reg.resetMask = props.resetMask;
+			builder->registers[builder->registerCount].reg.firstField = firstField;
+			builder->registers[builder->registerCount].reg.fieldCount = (uint16_t)fieldCount;
+			builder->registers[builder->registerCount].reg.size = (uint8_t)props.size;
+			builder->registers[builder->registerCount].reg.access = props.access;
+			builder->registers[builder->registerCount].scope = scope;
+			builder->registerCount++;
+		}
+		free(dim.index);
+	}
+}
+
+static void addPeripheral(struct svdBuilder *builder, struct xmlNode *node, const struct registerProps *deviceProps){
+	struct svdPeripheral *peripheral;
+	struct registerProps props = *deviceProps;
+	struct xmlNode *registers;
+	const char *name = xmlText(node, "name");
+	if(name == NULL) return;
+	if(reserve(builder, (void **)&builder->peripherals, &builder->peripheralCapacity, builder->peripheralCount, sizeof(struct svdPeripheral)) == FALSE) return;
+	readProps(node, &props);
+	peripheral = &builder->peripherals[builder->peripheralCount];
+	peripheral->name = addString(builder, name);
+	peripheral->baseAddress = childNumber(node, "baseAddress", 0);
+	peripheral->firstRegister = builder->registerCount;
+	registers = xmlChild(node, "registers");
+	if(registers){
+		addRegisters(builder, registers, 0, "", &props, peripheral->firstRegister);
+	}
+	// addRegisters可能改变了peripherals之外的数组,peripheral指针仍然有效
+	peripheral->registerCount = builder->registerCount - peripheral->firstRegister;
+	builder->peripheralCount++;
+}
+
+static const struct svdPeripheral *findBuiltPeripheral(struct svdBuilder *builder, const char *name){
+	unsigned int i;
+	for(i = 0; i < builder->peripheralCount; i++){
+		if(strcmp(builder->strings + builder->peripherals[i].name, name) == 0){
+			return &builder->peripherals[i];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * derivedFrom且没有自己的寄存器的外设:共享基外设的寄存器
+ * 基外设也可能是派生的,重复直到没有新的外设可以解析
+ */
+static void addDerivedPeripherals(struct svdBuilder *builder, struct xmlNode *peripherals){
+	struct xmlNode *node;
+	const struct svdPeripheral *base;
+	struct svdPeripheral *peripheral;
+	const char *name;
+	BOOL progress = TRUE;
+	while(progress && !builder->failed){
+		progress = FALSE;
+		for(node = peripherals->child; node; node = node->next){
+			if(strcmp(node->name, "peripheral") != 0 || node->derivedFrom == NULL || xmlChild(node, "registers")) continue;
+			name = xmlText(node, "name");
+			if(name == NULL || findBuiltPeripheral(builder, name)) continue;
+			base = findBuiltPeripheral(builder, node->derivedFrom);
+			if(base == NULL) continue;
+			if(reserve(builder, (void **)&builder->peripherals, &builder->peripheralCapacity, builder->peripheralCount, sizeof(struct svdPeripheral)) == FALSE) return;
+			base = findBuiltPeripheral(builder, node->derivedFrom);	// realloc之后重新查找
+			peripheral = &builder->peripherals[builder->peripheralCount];
+			peripheral->name = addString(builder, name);
+			peripheral->baseAddress = childNumber(node, "baseAddress", base->baseAddress);
+			peripheral->firstRegister = base->firstRegister;
+			peripheral->registerCount = base->registerCount;
+			builder->peripheralCount++;
+			progress = TRUE;
+		}
+	}
+	for(node = peripherals->child; node; node = node->next){
+		if(strcmp(node->name, "peripheral") != 0 || node->derivedFrom == NULL) continue;
+		name = xmlText(node, "name");
+		if(name && findBuiltPeripheral(builder, name) == NULL){
+			log_warn("SVD: peripheral %s derived from unknown %s, ignored.", name, node->derivedFrom);
+		}
+	}
+}
+
+static void insertHash(struct svdHashEntry *table, uint32_t mask, uint32_t hash, uint32_t ref){
+	uint32_t idx;
+	for(idx = hash & mask; table[idx].ref != SVD_HASH_EMPTY; idx = (idx + 1) & mask);
+	table[idx].hash = hash;
+	table[idx].ref = ref;
+}
+
+/**
+ * 生成数据库
+ */
+static uint8_t *buildImage(struct svdBuilder *builder, uint64_t sourceHash, uint64_t sourceSize, size_t *length){
+	struct svdHeader *header;
+	struct svdPeripheral *peripherals;
+	struct svdRegister *registers;
+	struct svdField *fields;
+	struct svdHashEntry *hash;
+	uint32_t hashSize = 16, mask, stringsSize;
+	unsigned int i, total;
+	uint8_t *image;
+	size_t size;
+	total = builder->peripheralCount + builder->registerCount + builder->fieldCount;
+	while(hashSize < total * 2) hashSize <<= 1;
+	mask = hashSize - 1;
+	stringsSize = (builder->stringsSize + 3) & ~3u;
+	size = sizeof(struct svdHeader)
+			+ builder->peripheralCount * sizeof(struct svdPeripheral)
+			+ builder->registerCount * sizeof(struct svdRegister)
+			+ builder->fieldCount * sizeof(struct svdField)
+			+ hashSize * sizeof(struct svdHashEntry)
+			+ stringsSize;
+	image = calloc(1, size);
+	if(image == NULL) return NULL;
+	header = CAST(struct svdHeader *, image);
+	header->magic = SVD_DB_MAGIC;
+	header->version = SVD_DB_VERSION;
+	header->sourceHash = sourceHash;
+	header->sourceSize = sourceSize;
+	header->peripheralCount = builder->peripheralCount;
+	header->registerCount = builder->registerCount;
+	header->fieldCount = builder->fieldCount;
+	header->hashSize = hashSize;
+	header->stringsSize = stringsSize;
+	peripherals = CAST(struct svdPeripheral *, header + 1);
+	registers = CAST(struct svdRegister *, peripherals + builder->peripheralCount);
+	fields = CAST(struct svdField *, registers + builder->registerCount);
+	hash = CAST(struct svdHashEntry *, fields + builder->fieldCount);
+	memset(hash, 0xFF, hashSize * sizeof(struct svdHashEntry));
+	for(i = 0; i < builder->peripheralCount; i++){
+		peripherals[i] = builder->peripherals[i];
+		insertHash(hash, mask, nameHash(builder->strings + peripherals[i].name, SVD_KIND_PERIPHERAL, 0), SVD_REF(SVD_KIND_PERIPHERAL, i));
+	}
+	for(i = 0; i < builder->registerCount; i++){
+		registers[i] = builder->registers[i].reg;
+		insertHash(hash, mask, nameHash(builder->strings + registers[i].name, SVD_KIND_REGISTER, builder->registers[i].scope), SVD_REF(SVD_KIND_REGISTER, i));
+	}
+	for(i = 0; i < builder->fieldCount; i++){
+		fields[i] = builder->fields[i].field;
+		insertHash(hash, mask, nameHash(builder->strings + fields[i].name, SVD_KIND_FIELD, builder->fields[i].scope), SVD_REF(SVD_KIND_FIELD, i));
+	}
+	memcpy(hash + hashSize, builder->strings, builder->stringsSize);
+	*length = size;
+	return image;
+}
+
+/**
+ * 解析SVD文件并生成数据库
+ * source会被原地修改
+ */
+static uint8_t *compileSvd(const char *path, char *source, uint64_t sourceHash, uint64_t sourceSize, size_t *length){
+	struct xmlDocument doc;
+	struct svdBuilder builder;
+	struct xmlNode *device, *peripherals, *node;
+	struct registerProps props = {32, 0, 0xFFFFFFFF, SVD_ACCESS_READ_WRITE};
+	uint8_t *image = NULL;
+	memset(&doc, 0x0, sizeof(struct xmlDocument));
+	memset(&builder, 0x0, sizeof(struct svdBuilder));
+	if(xmlParse(&doc, source) == FALSE) goto EXIT;
+	device = xmlChild(&doc.root, "device");
+	if(device == NULL || (peripherals = xmlChild(device, "peripherals")) == NULL){
+		log_error("SVD: %s is not a CMSIS-SVD device description.", path);
+		goto EXIT;
+	}
+	addString(&builder, "");	// 偏移0是空字符串
+	readProps(device, &props);
+	for(node = peripherals->child; node && !builder.failed; node = node->next){
+		if(strcmp(node->name, "peripheral") != 0) continue;
+		if(node->derivedFrom && xmlChild(node, "registers") == NULL) continue;
+		addPeripheral(&builder, node, &props);
+	}
+	addDerivedPeripherals(&builder, peripherals);
+	if(builder.failed){
+		log_error("SVD: not enough memory.");
+		goto EXIT;
+	}
+	image = buildImage(&builder, sourceHash, sourceSize, length);
+	log_info("SVD: compiled %s, %u peripherals, %u registers, %u fields.", path,
+			builder.peripheralCount, builder.registerCount, builder.fieldCount);
+EXIT:
+	xmlFree(&doc);
+	free(builder.peripherals);
+	free(builder.registers);
+	free(builder.fields);
+	free(builder.strings);
+	free(builder.stringTable);
+	return image;
+}
+
+/******************************* 数据库 *******************************/
+/**
+ * 检查数据库并建立索引
+ */
+static BOOL attachImage(struct svdDatabase *db, const uint8_t *image, size_t length, uint64_t sourceHash, uint64_t sourceSize){
+	const struct svdHeader *header = CAST(const struct svdHeader *, image);
+	size_t size;
+	if(length < sizeof(struct svdHeader)) return FALSE;
+	if(header->magic != SVD_DB_MAGIC || header->version != SVD_DB_VERSION) return FALSE;
+	if(header->sourceHash != sourceHash || header->sourceSize != sourceSize) return FALSE;
+	if(header->hashSize == 0 || (header->hashSize & (header->hashSize - 1)) != 0) return FALSE;
+	size = sizeof(struct svdHeader)
+			+ (size_t)header->peripheralCount * sizeof(struct svdPeripheral)
+			+ (size_t)header->registerCount * sizeof(struct svdRegister)
+			+ (size_t)header->fieldCount * sizeof(struct svdField)
+			+ (size_t)header->hashSize * sizeof(struct svdHashEntry)
+			+ header->stringsSize;
+	if(size != length || header->stringsSize == 0) return FALSE;
+	db->image = image;
+	db->length = length;
+	db->header = header;
+	db->peripherals = CAST(const struct svdPeripheral *, header + 1);
+	db->registers = CAST(const struct svdRegister *, db->peripherals + header->peripheralCount);
+	db->fields = CAST(const struct svdField *, db->registers + header->registerCount);
+	db->hash = CAST(const struct svdHashEntry *, db->fields + header->fieldCount);
+	db->strings = CAST(const char *, db->hash + header->hashSize);
+	if(db->strings[header->stringsSize - 1] != '\0') return FALSE;
+	return TRUE;
+}
+
+/**
+ * 加载SVD文件
+ */
+SVDDatabase SVD_Load(const char *path){
+	struct svdDatabase *db;
+	struct stat st;
+	const void *mapped;
+	uint8_t *image;
+	char *source;
+	char name[64];
+	size_t length;
+	uint64_t hash;
+	FILE *fp;
+	assert(path != NULL);
+	fp = fopen(path, "rb");
+	if(fp == NULL){
+		log_error("SVD: cannot open %s.", path);
+		return NULL;
+	}
+	if(fstat(fileno(fp), &st) != 0 || (source = malloc(st.st_size + 1)) == NULL){
+		fclose(fp);
+		return NULL;
+	}
+	if(fread(source, 1, st.st_size, fp) != (size_t)st.st_size){
+		log_error("SVD: failed to read %s.", path);
+		free(source);
+		fclose(fp);
+		return NULL;
+	}
+	fclose(fp);
+	source[st.st_size] = '\0';
+	db = calloc(1, sizeof(struct svdDatabase));
+	if(db == NULL){
+		free(source);
+		return NULL;
+	}
+	hash = misc_Hash64(source, st.st_size, 0);
+	snprintf(name, sizeof(name), "svd-%016" PRIx64 ".db", hash);
+	// 直接映射缓存的数据库
+	if(misc_CacheMap(name, &mapped, &length) == TRUE){
+		if(attachImage(db, mapped, length, hash, st.st_size)){
+			db->mapped = TRUE;
+			free(source);
+			log_debug("SVD: loaded %s from cache.", path);
+			return db;
+		}
+		misc_CacheUnmap(mapped, length);
+	}
+	image = compileSvd(path, source, hash, st.st_size, &length);
+	free(source);
+	if(image == NULL || attachImage(db, image, length, hash, st.st_size) == FALSE){
+		free(image);
+		free(db);
+		return NULL;
+	}
+	if(misc_CacheStore(name, image, length) == FALSE){
+		log_debug("SVD: failed to store the compiled database of %s.", path);
+	}
+	return db;
+}
+
+/**
+ * 释放数据库对象
+ */
+void SVD_Close(SVDDatabase *db){
+	assert(db != NULL && *db != NULL);
+	if((*db)->mapped){
+		misc_CacheUnmap((*db)->image, (*db)->length);
+	}else{
+		free(CAST(void *, (*db)->image));
+	}
+	free(*db);
+	*db = NULL;
+}
+
+/**
+ * 获得数据库的统计信息
+ */
+void SVD_Info(SVDDatabase db, unsigned int *peripherals, unsigned int *registers, unsigned int *fields, size_t *bytes){
+	assert(db != NULL);
+	if(peripherals) *peripherals = db->header->peripheralCount;
+	if(registers) *registers = db->header->registerCount;
+	if(fields) *fields = db->header->fieldCount;
+	if(bytes) *bytes = db->length;
+}
+
+const char *SVD_Name(SVDDatabase db, uint32_t name){
+	assert(db != NULL);
+	return name < db->header->stringsSize ? db->strings + name : "";
+}
+
+const struct svdPeripheral *SVD_Peripheral(SVDDatabase db, unsigned int index){
+	assert(db != NULL);
+	return index < db->header->peripheralCount ? &db->peripherals[index] : NULL;
+}
+
+const struct svdRegister *SVD_Register(SVDDatabase db, unsigned int index){
+	assert(db != NULL);
+	return index < db->header->registerCount ? &db->registers[index] : NULL;
+}
+
+const struct svdField *SVD_Field(SVDDatabase db, unsigned int index){
+	assert(db != NULL);
+	return index < db->header->fieldCount ? &db->fields[index] : NULL;
+}
+
+/**
+ * 在散列表中查找
+ * first,count:名字所在的记录范围
+ */
+static int findRecord(SVDDatabase db, unsigned int kind, uint32_t scope, uint32_t first, uint32_t count, const char *name){
+	uint32_t hash = nameHash(name, kind, scope), mask = db->header->hashSize - 1, idx, ref, index, nameOffset;
+	for(idx = hash & mask; (ref = db->hash[idx].ref) != SVD_HASH_EMPTY; idx = (idx + 1) & mask){
+		if(db->hash[idx].hash != hash || SVD_REF_KIND(ref) != kind) continue;
+		index = SVD_REF_INDEX(ref);
+		if(index < first || index - first >= count) continue;
+		switch(kind){
+		case SVD_KIND_PERIPHERAL: nameOffset = db->peripherals[index].name; break;
+		case SVD_KIND_REGISTER: nameOffset = db->registers[index].name; break;
+		default: nameOffset = db->fields[index].name; break;
+		}
+		if(strcmp(SVD_Name(db, nameOffset), name) == 0) return (int)index;
+	}
+	return -1;
+}
+
+const struct svdPeripheral *SVD_FindPeripheral(SVDDatabase db, const char *name){
+	int index;
+	assert(db != NULL && name != NULL);
+	index = findRecord(db, SVD_KIND_PERIPHERAL, 0, 0, db->header->peripheralCount, name);
+	return index < 0 ? NULL : &db->peripherals[index];
+}
+
+const struct svdRegister *SVD_FindRegister(SVDDatabase db, const struct svdPeripheral *peripheral, const char *name){
+	int index;
+	assert(db != NULL && peripheral != NULL && name != NULL);
+	index = findRecord(db, SVD_KIND_REGISTER, peripheral->firstRegister, peripheral->firstRegister, peripheral->registerCount, name);
+	return index < 0 ? NULL : &db->registers[index];
+}
+
+const struct svdField *SVD_FindField(SVDDatabase db, const struct svdRegister *reg, const char *name){
+	int index;
+	assert(db != NULL && reg != NULL && name != NULL);
+	index = findRecord(db, SVD_KIND_FIELD, reg->firstField, reg->firstField, reg->fieldCount, name);
+	return index < 0 ? NULL : &db->fields[index];
+}
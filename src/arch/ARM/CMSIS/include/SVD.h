@@ -0,0 +1,106 @@
+/*
+ * SVD.h
+ *
+ *  Created on: 2019-7-4
+ *      Author: virusv
+ */
+
+#ifndef SRC_ARCH_ARM_CMSIS_INCLUDE_SVD_H_
+#define SRC_ARCH_ARM_CMSIS_INCLUDE_SVD_H_
+
+#include "smart_ocd.h"
+
+/**
+ * CMSIS-SVD外设寄存器数据库
+ * SVD文件被编译成紧凑的二进制数据库,保存在磁盘缓存目录中,按SVD文件内容的散列命名,
+ * 下次加载同一个SVD文件时直接映射数据库文件,不再解析XML。
+ * 数据库中的外设、寄存器和位域都是定长记录,名字保存在字符串池中;
+ * 按名字查找使用数据库中的散列表,和外设、寄存器的数量无关。
+ * derivedFrom的外设共享基外设的寄存器记录,dim数组展开成多个寄存器,cluster展开成"簇名_寄存器名"
+ */
+
+// 访问权限
+#define SVD_ACCESS_READ		0x1
+#define SVD_ACCESS_WRITE	0x2
+#define SVD_ACCESS_READ_WRITE	(SVD_ACCESS_READ | SVD_ACCESS_WRITE)
+
+struct svdPeripheral {
+	uint32_t name;	// 名字在字符串池中的偏移
+	uint32_t baseAddress;	// 基址
+	uint32_t firstRegister;	// 第一个寄存器的索引
+	uint32_t registerCount;	// 寄存器个数
+};
+
+struct svdRegister {
+	uint32_t name;
+	uint32_t addressOffset;	// 相对外设基址的偏移
+	uint32_t resetValue;	// 复位值
+	uint32_t resetMask;	// 复位值中有效的位
+	uint32_t firstField;	// 第一个位域的索引
+	uint16_t fieldCount;	// 位域个数
+	uint8_t size;	// 寄存器位宽:8,16,32
+	uint8_t access;	// SVD_ACCESS_*
+};
+
+struct svdField {
+	uint32_t name;
+	uint8_t bitOffset;	// 最低位
+	uint8_t bitWidth;	// 位宽
+	uint8_t access;	// SVD_ACCESS_*
+	uint8_t reserved;
+};
+
+/**
+ * SVD数据库对象,不透明
+ */
+typedef struct svdDatabase *SVDDatabase;
+
+/**
+ * SVD_Load 加载SVD文件
+ * 先查找磁盘缓存中编译好的数据库,没有则解析SVD文件并写入缓存
+ * 参数:
+ * 	path:SVD文件路径
+ * 返回:
+ * 	数据库对象,失败返回NULL
+ */
+SVDDatabase SVD_Load(const char *path);
+
+/**
+ * SVD_Close 释放数据库对象
+ */
+void SVD_Close(SVDDatabase *db);
+
+/**
+ * SVD_Info 获得数据库的统计信息
+ * 参数:
+ * 	peripherals,registers,fields:记录个数
+ * 	bytes:数据库的字节数
+ */
+void SVD_Info(SVDDatabase db, unsigned int *peripherals, unsigned int *registers, unsigned int *fields, size_t *bytes);
+
+/**
+ * SVD_Name 获得记录的名字
+ * 参数:
+ * 	name:记录中的name字段
+ */
+const char *SVD_Name(SVDDatabase db, uint32_t name);
+
+/**
+ * SVD_Peripheral/SVD_Register/SVD_Field 按索引获得记录,索引超出范围返回NULL
+ */
+const struct svdPeripheral *SVD_Peripheral(SVDDatabase db, unsigned int index);
+const struct svdRegister *SVD_Register(SVDDatabase db, unsigned int index);
+const struct svdField *SVD_Field(SVDDatabase db, unsigned int index);
+
+/**
+ * SVD_FindPeripheral/SVD_FindRegister/SVD_FindField 按名字查找记录,不存在返回NULL
+ * 参数:
+ * 	peripheral:寄存器所在的外设
+ * 	reg:位域所在的寄存器
+ * 	name:名字,区分大小写
+ */
+const struct svdPeripheral *SVD_FindPeripheral(SVDDatabase db, const char *name);
+const struct svdRegister *SVD_FindRegister(SVDDatabase db, const struct svdPeripheral *peripheral, const char *name);
+const struct svdField *SVD_FindField(SVDDatabase db, const struct svdRegister *reg, const char *name);
+
+#endif /* SRC_ARCH_ARM_CMSIS_INCLUDE_SVD_H_ */
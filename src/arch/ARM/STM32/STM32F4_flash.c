@@ -0,0 +1,667 @@
+/*
+ * STM32F4_flash.c
+ *
+ *  Created on: 2019-6-28
+ *      Author: virusv
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "smart_ocd.h"
+#include "misc/log.h"
+#include "misc/misc.h"
+
+#include "arch/ARM/STM32/include/STM32F4.h"
+
+// Flash地址
+#define FLASH_BANK1_ADDR		0x08000000u
+#define FLASH_BANK2_ADDR		0x08100000u
+#define FLASH_SIZE_REG			0x1FFF7A22u	// Flash大小,单位KB
+// Flash接口寄存器
+#define FLASH_REG_BASE			0x40023C00u
+#define FLASH_KEYR				(FLASH_REG_BASE + 0x04)
+#define FLASH_OPTKEYR			(FLASH_REG_BASE + 0x08)
+#define FLASH_SR				(FLASH_REG_BASE + 0x0C)
+#define FLASH_CR				(FLASH_REG_BASE + 0x10)
+#define FLASH_OPTCR				(FLASH_REG_BASE + 0x14)
+
+#define FLASH_KEY1				0x45670123u
+#define FLASH_KEY2				0xCDEF89ABu
+#define FLASH_OPTKEY1			0x08192A3Bu
+#define FLASH_OPTKEY2			0x4C5D6E7Fu
+
+#define FLASH_SR_EOP			0x00000001u
+#define FLASH_SR_ERRORS			0x000000F2u	// PGSERR | PGPERR | PGAERR | WRPERR | OPERR
+#define FLASH_SR_BSY			0x00010000u
+
+#define FLASH_CR_PG				0x00000001u
+#define FLASH_CR_SER			0x00000002u
+#define FLASH_CR_SNB(n)			((uint32_t)(n) << 3)
+#define FLASH_CR_PSIZE_32		0x00000200u	// 32位并行编程,VDD 2.7V~3.6V
+#define FLASH_CR_STRT			0x00010000u
+#define FLASH_CR_LOCK			0x80000000u
+
+#define FLASH_OPTCR_OPTLOCK		0x00000001u
+#define FLASH_OPTCR_OPTSTRT		0x00000002u
+
+// Cortex-M调试寄存器
+#define DHCSR					0xE000EDF0u
+#define DCRSR					0xE000EDF4u
+#define DCRDR					0xE000EDF8u
+#define DHCSR_DBGKEY			0xA05F0000u
+#define DHCSR_C_DEBUGEN			0x00000001u
+#define DHCSR_C_HALT			0x00000002u
+#define DHCSR_C_MASKINTS		0x00000008u
+#define DHCSR_S_REGRDY			0x00010000u
+#define DHCSR_S_HALT			0x00020000u
+#define DCRSR_REGWnR			0x00010000u
+// 核心寄存器编号
+#define CORE_REG_R0				0
+#define CORE_REG_R2				2
+#define CORE_REG_R3				3
+#define CORE_REG_SP				13
+#define CORE_REG_PC				15
+#define CORE_REG_XPSR			16
+#define XPSR_THUMB				0x01000000u
+
+// 超时,毫秒
+#define CORE_TIMEOUT			100
+#define ERASE_TIMEOUT			5000	// 128KB扇区最长2秒
+#define PROGRAM_TIMEOUT			1000	// 一个缓冲区
+#define OPTION_TIMEOUT			30000	// 降低读保护等级会触发整片擦除
+
+#define MAX_SECTOR_COUNT		24
+#define MAX_SECTOR_SIZE			(128u << 10)
+#define ERASED_WORD				0xFFFFFFFFu
+#define ERASED_SPLIT_WORDS		16	// 块中间连续这么多个擦除值时分成两块,不传输这一段
+
+/**
+ * 工作区布局:
+ * +0				编程程序
+ * +HELPER_AREA		缓冲区0:+0 字节数(0表示空闲),+4 目标地址,+8 数据
+ * 紧接着			缓冲区1,布局相同
+ */
+#define HELPER_AREA				0x100u
+#define BUFFER_HEADER			8u
+
+/**
+ * 编程程序,在目标的RAM中运行
+ * r0:FLASH寄存器基址,r2:当前缓冲区,r3:另一个缓冲区
+ * 等待当前缓冲区的字节数不为0,逐字写入目标地址并等待BSY清零,
+ * 写完后把字节数清零表示缓冲区空闲,然后交换两个缓冲区。出错时停在断点上
+ */
+static const uint8_t flashHelper[] = {
+	0x15, 0x68,				// loop:	ldr r5, [r2, #0]
+	0x00, 0x2d,				//			cmp r5, #0
+	0xfc, 0xd0,				//			beq loop
+	0x51, 0x68,				//			ldr r1, [r2, #4]
+	0x16, 0x46,				//			mov r6, r2
+	0x08, 0x36,				//			adds r6, #8
+	0x37, 0x68,				// prog:	ldr r7, [r6]
+	0x0f, 0x60,				//			str r7, [r1]
+	0xbf, 0xf3, 0x4f, 0x8f,	//			dsb sy
+	0xc4, 0x68,				// busy:	ldr r4, [r0, #12]
+	0xe4, 0x03,				//			lsls r4, r4, #15
+	0xfc, 0xd4,				//			bmi busy
+	0x04, 0x36,				//			adds r6, #4
+	0x04, 0x31,				//			adds r1, #4
+	0x04, 0x3d,				//			subs r5, #4
+	0xf4, 0xd8,				//			bhi prog
+	0xc4, 0x68,				//			ldr r4, [r0, #12]
+	0xf2, 0x27,				//			movs r7, #0xF2
+	0x3c, 0x42,				//			tst r4, r7
+	0x05, 0xd1,				//			bne error
+	0x00, 0x25,				//			movs r5, #0
+	0x15, 0x60,				//			str r5, [r2, #0]
+	0x14, 0x46,				//			mov r4, r2
+	0x1a, 0x46,				//			mov r2, r3
+	0x23, 0x46,				//			mov r3, r4
+	0xe4, 0xe7,				//			b loop
+	0x00, 0xbe,				// error:	bkpt #0
+};
+
+struct stm32f4Sector {
+	uint32_t addr;
+	uint32_t size;
+	uint8_t snb;	// 写入FLASH_CR的扇区编号,Bank2从0x10开始
+};
+
+struct stm32f4Flash {
+	AccessPort ap;
+	uint32_t workArea;
+	uint32_t bufferSize;	// 每个缓冲区可以放的数据字节数
+	uint32_t size;	// Flash的字节数
+	unsigned int sectorCount;
+	struct stm32f4Sector sectors[MAX_SECTOR_COUNT];
+	uint32_t *blank;	// 空白检查用的全0xFF缓冲区,一个最大扇区大小
+};
+
+static double elapsedSeconds(const struct timespec *start){
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)(now.tv_sec - start->tv_sec) + (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/**
+ * 建立扇区表
+ * 每个Bank是4个16KB,1个64KB,其余是128KB。大于1MB的器件有两个Bank
+ */
+static void buildSectors(struct stm32f4Flash *flash){
+	static const uint32_t layout[] = {16u << 10, 16u << 10, 16u << 10, 16u << 10, 64u << 10};
+	unsigned int bankCount = flash->size > (1u << 20) ? 2 : 1, bank, idx;
+	uint32_t bankSize = flash->size / bankCount, offset, sectorSize;
+	flash->sectorCount = 0;
+	for(bank = 0; bank < bankCount; bank++){
+		for(idx = 0, offset = 0; offset < bankSize && flash->sectorCount < MAX_SECTOR_COUNT; idx++, offset += sectorSize){
+			sectorSize = idx < sizeof(layout) / sizeof(layout[0]) ? layout[idx] : MAX_SECTOR_SIZE;
+			flash->sectors[flash->sectorCount].addr = (bank ? FLASH_BANK2_ADDR : FLASH_BANK1_ADDR) + offset;
+			flash->sectors[flash->sectorCount].size = sectorSize;
+			flash->sectors[flash->sectorCount].snb = (bank ? 0x10 : 0x0) | idx;
+			flash->sectorCount++;
+		}
+	}
+}
+
+/**
+ * 停止核心
+ */
+static int haltCore(struct stm32f4Flash *flash){
+	int result;
+	if((result = flash->ap->Interface.Memory.Write32(flash->ap, DHCSR, DHCSR_DBGKEY | DHCSR_C_HALT | DHCSR_C_DEBUGEN)) != ADI_SUCCESS){
+		return result;
+	}
+	if((result = flash->ap->Interface.Memory.WaitValue(flash->ap, DHCSR, DHCSR_S_HALT, DHCSR_S_HALT, CORE_TIMEOUT)) != ADI_SUCCESS){
+		log_error("Failed to halt the core.");
+	}
+	return result;
+}
+
+/**
+ * 写核心寄存器,核心必须已经停止
+ */
+static int writeCoreReg(struct stm32f4Flash *flash, unsigned int reg, uint32_t value){
+	AccessPort ap = flash->ap;
+	int result;
+	if((result = ap->Interface.Memory.Write32(ap, DCRDR, value)) != ADI_SUCCESS
+			|| (result = ap->Interface.Memory.Write32(ap, DCRSR, DCRSR_REGWnR | reg)) != ADI_SUCCESS){
+		return result;
+	}
+	return ap->Interface.Memory.WaitValue(ap, DHCSR, DHCSR_S_REGRDY, DHCSR_S_REGRDY, CORE_TIMEOUT);
+}
+
+/**
+ * 解锁FLASH_CR并清除错误标志
+ */
+static int unlockFlash(struct stm32f4Flash *flash){
+	AccessPort ap = flash->ap;
+	uint32_t cr;
+	int result;
+	if((result = ap->Interface.Memory.Read32(ap, FLASH_CR, &cr)) != ADI_SUCCESS){
+		return result;
+	}
+	if(cr & FLASH_CR_LOCK){
+		if((result = ap->Interface.Memory.Write32(ap, FLASH_KEYR, FLASH_KEY1)) != ADI_SUCCESS
+				|| (result = ap->Interface.Memory.Write32(ap, FLASH_KEYR, FLASH_KEY2)) != ADI_SUCCESS
+				|| (result = ap->Interface.Memory.Read32(ap, FLASH_CR, &cr)) != ADI_SUCCESS){
+			return result;
+		}
+		if(cr & FLASH_CR_LOCK){
+			log_error("Failed to unlock flash.");
+			return ADI_ERR_INTERNAL_ERROR;
+		}
+	}
+	// 错误标志写1清除
+	return ap->Interface.Memory.Write32(ap, FLASH_SR, FLASH_SR_EOP | FLASH_SR_ERRORS);
+}
+
+static void lockFlash(struct stm32f4Flash *flash){
+	flash->ap->Interface.Memory.Write32(flash->ap, FLASH_CR, FLASH_CR_LOCK);
+}
+
+/**
+ * 等待Flash操作完成并检查错误标志
+ * BSY由仿真器端的值匹配轮询
+ */
+static int waitFlash(struct stm32f4Flash *flash, unsigned int timeout){
+	AccessPort ap = flash->ap;
+	uint32_t sr;
+	int result;
+	if((result = ap->Interface.Memory.WaitValue(ap, FLASH_SR, FLASH_SR_BSY, 0, timeout)) != ADI_SUCCESS){
+		log_error("Wait for flash operation timeout.");
+		return ADI_ERR_INTERNAL_ERROR;
+	}
+	if((result = ap->Interface.Memory.Read32(ap, FLASH_SR, &sr)) != ADI_SUCCESS){
+		return result;
+	}
+	if(sr & FLASH_SR_ERRORS){
+		log_error("Flash operation failed, FLASH_SR: 0x%08X.", sr);
+		ap->Interface.Memory.Write32(ap, FLASH_SR, FLASH_SR_ERRORS);
+		return ADI_ERR_INTERNAL_ERROR;
+	}
+	return ADI_SUCCESS;
+}
+
+/**
+ * 擦除一个扇区,FLASH_CR必须已经解锁
+ */
+static int eraseSector(struct stm32f4Flash *flash, const struct stm32f4Sector *sector){
+	int result;
+	log_debug("Erase sector 0x%08X, %u KB.", sector->addr, sector->size >> 10);
+	result = flash->ap->Interface.Memory.Write32(flash->ap, FLASH_CR,
+			FLASH_CR_SER | FLASH_CR_SNB(sector->snb) | FLASH_CR_PSIZE_32 | FLASH_CR_STRT);
+	if(result != ADI_SUCCESS){
+		return result;
+	}
+	return waitFlash(flash, ERASE_TIMEOUT);
+}
+
+/**
+ * STM32F4_CreateFlash 创建Flash对象
+ */
+STM32F4Flash STM32F4_CreateFlash(AccessPort ap, uint32_t workArea, uint32_t workSize){
+	assert(ap != NULL);
+	struct stm32f4Flash *flash;
+	uint16_t sizeKB;
+	if(ap->type != AccessPort_Memory){
+		log_error("Not a memory access port!");
+		return NULL;
+	}
+	if((workArea & 0x3) || workSize < (1u << 10)){
+		log_error("Work area must be word aligned and at least 1KB!");
+		return NULL;
+	}
+	if(ap->Interface.Memory.Read16(ap, FLASH_SIZE_REG, &sizeKB) != ADI_SUCCESS){
+		log_error("Failed to read flash size.");
+		return NULL;
+	}
+	if(sizeKB == 0 || sizeKB > 2048){
+		log_error("Invalid flash size: %u KB.", sizeKB);
+		return NULL;
+	}
+	flash = calloc(1, sizeof(struct stm32f4Flash));
+	if(flash == NULL){
+		log_error("Failed to allocate flash object!");
+		return NULL;
+	}
+	flash->blank = malloc(MAX_SECTOR_SIZE);
+	if(flash->blank == NULL){
+		log_error("Failed to allocate blank buffer!");
+		free(flash);
+		return NULL;
+	}
+	memset(flash->blank, 0xFF, MAX_SECTOR_SIZE);
+	flash->ap = ap;
+	flash->workArea = workArea;
+	flash->bufferSize = ((workSize - HELPER_AREA) / 2 - BUFFER_HEADER) & ~0x3u;
+	flash->size = (uint32_t)sizeKB << 10;
+	buildSectors(flash);
+	log_info("STM32F4 flash: %u KB, %u sectors.", sizeKB, flash->sectorCount);
+	return flash;
+}
+
+/**
+ * STM32F4_DestroyFlash 释放Flash对象
+ */
+void STM32F4_DestroyFlash(STM32F4Flash *flash){
+	assert(flash != NULL);
+	if(*flash == NULL) return;
+	free((*flash)->blank);
+	free(*flash);
+	*flash = NULL;
+}
+
+/**
+ * STM32F4_FlashInfo 获得Flash的信息
+ */
+void STM32F4_FlashInfo(STM32F4Flash flash, uint32_t *size, unsigned int *sectorCount){
+	assert(flash != NULL);
+	if(size) *size = flash->size;
+	if(sectorCount) *sectorCount = flash->sectorCount;
+}
+
+/**
+ * STM32F4_FlashErase 擦除扇区
+ */
+int STM32F4_FlashErase(STM32F4Flash flash, unsigned int first, unsigned int last){
+	assert(flash != NULL);
+	unsigned int idx;
+	int result;
+	if(first > last || last >= flash->sectorCount){
+		log_error("Invalid sector range %u - %u.", first, last);
+		return ADI_ERR_BAD_PARAMETER;
+	}
+	if((result = haltCore(flash)) != ADI_SUCCESS || (result = unlockFlash(flash)) != ADI_SUCCESS){
+		return result;
+	}
+	for(idx = first; idx <= last; idx++){
+		if((result = eraseSector(flash, &flash->sectors[idx])) != ADI_SUCCESS){
+			break;
+		}
+	}
+	lockFlash(flash);
+	flash->ap->Interface.Memory.InvalidateCache(flash->ap, flash->sectors[first].addr,
+			flash->sectors[last].addr + flash->sectors[last].size - flash->sectors[first].addr);
+	return result;
+}
+
+/**
+ * 把编程程序写入工作区并启动
+ * 核心运行时屏蔽中断,编程程序不会被打断
+ */
+static int startHelper(struct stm32f4Flash *flash){
+	AccessPort ap = flash->ap;
+	uint32_t buffer0 = flash->workArea + HELPER_AREA;
+	uint32_t buffer1 = buffer0 + BUFFER_HEADER + flash->bufferSize;
+	int result;
+	if((result = haltCore(flash)) != ADI_SUCCESS){
+		return result;
+	}
+	if((result = ap->Interface.Memory.Write(ap, flash->workArea, sizeof(flashHelper), flashHelper)) != ADI_SUCCESS
+			|| (result = ap->Interface.Memory.Write32(ap, buffer0, 0)) != ADI_SUCCESS
+			|| (result = ap->Interface.Memory.Write32(ap, buffer1, 0)) != ADI_SUCCESS){
+		return result;
+	}
+	if((result = writeCoreReg(flash, CORE_REG_R0, FLASH_REG_BASE)) != ADI_SUCCESS
+			|| (result = writeCoreReg(flash, CORE_REG_R2, buffer0)) != ADI_SUCCESS
+			|| (result = writeCoreReg(flash, CORE_REG_R3, buffer1)) != ADI_SUCCESS
+			|| (result = writeCoreReg(flash, CORE_REG_SP, flash->workArea + HELPER_AREA)) != ADI_SUCCESS
+			|| (result = writeCoreReg(flash, CORE_REG_PC, flash->workArea)) != ADI_SUCCESS
+			|| (result = writeCoreReg(flash, CORE_REG_XPSR, XPSR_THUMB)) != ADI_SUCCESS){
+		log_error("Failed to set core registers.");
+		return result;
+	}
+	// C_MASKINTS只能在停止状态下修改
+	if((result = ap->Interface.Memory.Write32(ap, DHCSR, DHCSR_DBGKEY | DHCSR_C_MASKINTS | DHCSR_C_HALT | DHCSR_C_DEBUGEN)) != ADI_SUCCESS){
+		return result;
+	}
+	return ap->Interface.Memory.Write32(ap, DHCSR, DHCSR_DBGKEY | DHCSR_C_MASKINTS | DHCSR_C_DEBUGEN);
+}
+
+/**
+ * 停止编程程序,核心保持停止状态
+ */
+static int stopHelper(struct stm32f4Flash *flash){
+	int result = haltCore(flash);
+	if(result == ADI_SUCCESS){
+		result = flash->ap->Interface.Memory.Write32(flash->ap, DHCSR, DHCSR_DBGKEY | DHCSR_C_HALT | DHCSR_C_DEBUGEN);
+	}
+	return result;
+}
+
+/**
+ * 等待缓冲区空闲
+ * 超时后检查编程程序是否停在了出错的断点上
+ */
+static int waitBuffer(struct stm32f4Flash *flash, uint32_t buffer){
+	AccessPort ap = flash->ap;
+	uint32_t dhcsr = 0, sr = 0;
+	if(ap->Interface.Memory.WaitValue(ap, buffer, 0xFFFFFFFFu, 0, PROGRAM_TIMEOUT) == ADI_SUCCESS){
+		return ADI_SUCCESS;
+	}
+	if(ap->Interface.Memory.Read32(ap, DHCSR, &dhcsr) == ADI_SUCCESS && (dhcsr & DHCSR_S_HALT)
+			&& ap->Interface.Memory.Read32(ap, FLASH_SR, &sr) == ADI_SUCCESS){
+		log_error("Flash program failed, FLASH_SR: 0x%08X.", sr);
+		ap->Interface.Memory.Write32(ap, FLASH_SR, FLASH_SR_ERRORS);
+	}else{
+		log_error("Flash program helper timeout.");
+	}
+	return ADI_ERR_INTERNAL_ERROR;
+}
+
+/**
+ * 交替使用两个缓冲区,把[start, end)中非空白的数据交给编程程序
+ * 目标编程一个缓冲区的同时主机向另一个缓冲区传输数据
+ * 块首尾和块中间较长的擦除值都不传输,块中间零散的擦除值和前后的数据一起传输,比多交接一次缓冲区更快
+ * 参数:
+ * 	image:字对齐的数据,image[0]对应start
+ * 	buffer:下一个要使用的缓冲区,0或1
+ */
+static int programRange(struct stm32f4Flash *flash, uint32_t start, uint32_t end, const uint32_t *image, unsigned int *buffer,
+		uint64_t *bytes){
+	AccessPort ap = flash->ap;
+	uint32_t pos = start, chunkEnd, bufferAddr, scan;
+	unsigned int run;
+	int result;
+	while(pos < end){
+		// 擦除后的值不需要编程
+		if(image[(pos - start) >> 2] == ERASED_WORD){
+			pos += 4;
+			continue;
+		}
+		chunkEnd = end - pos < flash->bufferSize ? end : pos + flash->bufferSize;
+		for(scan = pos + 4, run = 0; scan < chunkEnd; scan += 4){
+			if(image[(scan - start) >> 2] != ERASED_WORD){
+				run = 0;
+			}else if(++run == ERASED_SPLIT_WORDS){
+				chunkEnd = scan + 4 - (run << 2);
+				break;
+			}
+		}
+		while(image[((chunkEnd - start) >> 2) - 1] == ERASED_WORD) chunkEnd -= 4;
+		bufferAddr = flash->workArea + HELPER_AREA + *buffer * (BUFFER_HEADER + flash->bufferSize);
+		if((result = waitBuffer(flash, bufferAddr)) != ADI_SUCCESS){
+			return result;
+		}
+		if((result = ap->Interface.Memory.Write32(ap, bufferAddr + 4, pos)) != ADI_SUCCESS
+				|| (result = ap->Interface.Memory.BlockWrite(ap, bufferAddr + BUFFER_HEADER, AddrInc_Single, DataSize_32,
+						(chunkEnd - pos) >> 2, CAST(uint8_t *, image + ((pos - start) >> 2)))) != ADI_SUCCESS){
+			return result;
+		}
+		// 最后写字节数,编程程序看到字节数不为0就开始编程
+		if((result = ap->Interface.Memory.Write32(ap, bufferAddr, chunkEnd - pos)) != ADI_SUCCESS){
+			return result;
+		}
+		*bytes += chunkEnd - pos;
+		*buffer ^= 1;
+		pos = chunkEnd;
+	}
+	return ADI_SUCCESS;
+}
+
+/**
+ * 读出起始和结尾不足一个字的部分,使编程的数据字对齐
+ */
+static int alignImage(struct stm32f4Flash *flash, uint32_t addr, uint32_t len, const uint8_t *data, uint32_t start, uint32_t end,
+		uint32_t *image){
+	AccessPort ap = flash->ap;
+	int result;
+	if(addr != start && (result = ap->Interface.Memory.Read32(ap, start, image)) != ADI_SUCCESS){
+		return result;
+	}
+	if(addr + len != end && (result = ap->Interface.Memory.Read32(ap, end - 4, image + ((end - start) >> 2) - 1)) != ADI_SUCCESS){
+		return result;
+	}
+	memcpy(CAST(uint8_t *, image) + (addr - start), data, len);
+	return ADI_SUCCESS;
+}
+
+/**
+ * 只编程扇区的一部分时,擦除之前读出整个扇区,用[lo, hi)的新数据覆盖
+ * 擦除后把整个扇区编程回去,扇区中编程范围以外的数据保持不变
+ * 参数:
+ * 	data:[lo, hi)的新数据
+ * 	merged:合并后的整个扇区的数据,由调用者释放
+ */
+static int mergeSector(struct stm32f4Flash *flash, const struct stm32f4Sector *sector, uint32_t lo, uint32_t hi,
+		const uint32_t *data, uint32_t **merged){
+	AccessPort ap = flash->ap;
+	uint32_t *buff;
+	int result;
+	buff = malloc(sector->size);
+	if(buff == NULL){
+		log_error("Failed to allocate sector buffer!");
+		return ADI_ERR_INTERNAL_ERROR;
+	}
+	result = ap->Interface.Memory.BlockRead(ap, sector->addr, AddrInc_Single, DataSize_32, sector->size >> 2, CAST(uint8_t *, buff));
+	if(result != ADI_SUCCESS){
+		log_error("Failed to read back the sector at 0x%08X.", sector->addr);
+		free(buff);
+		return result;
+	}
+	memcpy(buff + ((lo - sector->addr) >> 2), data, hi - lo);
+	*merged = buff;
+	return ADI_SUCCESS;
+}
+
+/**
+ * STM32F4_FlashProgram 编程Flash
+ * 先逐个扇区比较:内容一致的跳过,空白的直接编程,其他的擦除,然后一次运行编程程序写入所有需要编程的扇区
+ * 需要擦除的扇区只有一部分在编程范围内时,先读出扇区的其余部分,擦除后和新数据一起编程回去
+ */
+int STM32F4_FlashProgram(STM32F4Flash flash, uint32_t addr, uint32_t len, const uint8_t *data, BOOL verify,
+		struct stm32f4ProgramStats *stats){
+	assert(flash != NULL && data != NULL);
+	AccessPort ap = flash->ap;
+	struct stm32f4ProgramStats programStats = {0};
+	struct timespec startTime;
+	uint32_t start = addr & ~0x3u, end = (addr + len + 3) & ~0x3u, lo, hi;
+	struct {
+		uint32_t lo, hi;	// 需要编程的范围
+		const uint32_t *data;	// [lo, hi)的数据
+		uint32_t *merged;	// 合并了扇区原有数据的副本,没有时为NULL
+	} program[MAX_SECTOR_COUNT];	// 每个扇区的编程任务
+	unsigned int idx, programCount = 0, buffer = 0;
+	uint32_t *image;
+	uint64_t mismatch;
+	int result, stopResult;
+	if(len == 0){
+		if(stats) *stats = programStats;
+		return ADI_SUCCESS;
+	}
+	if(addr < FLASH_BANK1_ADDR || (uint64_t)addr + len > (uint64_t)flash->sectors[flash->sectorCount - 1].addr
+			+ flash->sectors[flash->sectorCount - 1].size){
+		log_error("Program range 0x%08X - 0x%08X is out of flash.", addr, addr + len);
+		return ADI_ERR_BAD_PARAMETER;
+	}
+	image = malloc(end - start);
+	if(image == NULL){
+		log_error("Failed to allocate program buffer!");
+		return ADI_ERR_INTERNAL_ERROR;
+	}
+	memset(program, 0x0, sizeof(program));
+	clock_gettime(CLOCK_MONOTONIC, &startTime);
+	if((result = haltCore(flash)) != ADI_SUCCESS
+			|| (result = alignImage(flash, addr, len, data, start, end, image)) != ADI_SUCCESS){
+		goto EXIT;
+	}
+	if((result = unlockFlash(flash)) != ADI_SUCCESS){
+		goto EXIT;
+	}
+	for(idx = 0; idx < flash->sectorCount; idx++){
+		const struct stm32f4Sector *sector = &flash->sectors[idx];
+		lo = start > sector->addr ? start : sector->addr;
+		hi = end < sector->addr + sector->size ? end : sector->addr + sector->size;
+		if(lo >= hi) continue;
+		// 内容已经一致
+		result = ap->Interface.Memory.Verify(ap, lo, (hi - lo) >> 2, image + ((lo - start) >> 2), &mismatch);
+		if(result == ADI_SUCCESS){
+			programStats.skipped++;
+			continue;
+		}
+		if(result != ADI_FAILED) goto LOCK;
+		program[programCount].data = image + ((lo - start) >> 2);
+		// 需要编程的部分是空白的就不用擦除
+		result = ap->Interface.Memory.Verify(ap, lo, (hi - lo) >> 2, flash->blank, &mismatch);
+		if(result == ADI_FAILED){
+			// 擦除会破坏扇区中编程范围以外的数据,先读出来
+			if(lo != sector->addr || hi != sector->addr + sector->size){
+				if((result = mergeSector(flash, sector, lo, hi, program[programCount].data,
+						&program[programCount].merged)) != ADI_SUCCESS){
+					goto LOCK;
+				}
+				lo = sector->addr;
+				hi = sector->addr + sector->size;
+				program[programCount].data = program[programCount].merged;
+			}
+			if((result = eraseSector(flash, sector)) != ADI_SUCCESS) goto LOCK;
+			programStats.erased++;
+		}else if(result != ADI_SUCCESS){
+			goto LOCK;
+		}
+		program[programCount].lo = lo;
+		program[programCount].hi = hi;
+		programCount++;
+	}
+	if(programCount > 0){
+		if((result = ap->Interface.Memory.Write32(ap, FLASH_CR, FLASH_CR_PG | FLASH_CR_PSIZE_32)) != ADI_SUCCESS
+				|| (result = startHelper(flash)) != ADI_SUCCESS){
+			goto LOCK;
+		}
+		for(idx = 0; idx < programCount && result == ADI_SUCCESS; idx++){
+			result = programRange(flash, program[idx].lo, program[idx].hi, program[idx].data, &buffer, &programStats.bytes);
+		}
+		// 等待两个缓冲区都编程完成
+		if(result == ADI_SUCCESS && (result = waitBuffer(flash, flash->workArea + HELPER_AREA)) == ADI_SUCCESS){
+			result = waitBuffer(flash, flash->workArea + HELPER_AREA + BUFFER_HEADER + flash->bufferSize);
+		}
+		stopResult = stopHelper(flash);
+		if(result == ADI_SUCCESS) result = stopResult;
+	}
+LOCK:
+	lockFlash(flash);
+	// 擦除的是整个扇区
+	for(idx = 0; idx < flash->sectorCount; idx++){
+		if(flash->sectors[idx].addr < end && flash->sectors[idx].addr + flash->sectors[idx].size > start){
+			ap->Interface.Memory.InvalidateCache(ap, flash->sectors[idx].addr, flash->sectors[idx].size);
+		}
+	}
+	if(result != ADI_SUCCESS) goto EXIT;
+	programStats.seconds = elapsedSeconds(&startTime);
+	log_info("Programmed %" PRIu64 " bytes, %u sectors erased, %u skipped, %.3f s (%.1f KiB/s).", programStats.bytes,
+			programStats.erased, programStats.skipped, programStats.seconds,
+			programStats.seconds > 0 ? programStats.bytes / 1024.0 / programStats.seconds : 0.0);
+	if(verify){
+		for(idx = 0; idx < programCount; idx++){
+			result = ap->Interface.Memory.Verify(ap, program[idx].lo, (program[idx].hi - program[idx].lo) >> 2,
+					program[idx].data, &mismatch);
+			if(result == ADI_FAILED){
+				log_error("Verify failed at 0x%" PRIX64 ".", mismatch);
+			}
+			if(result != ADI_SUCCESS) break;
+		}
+	}
+EXIT:
+	for(idx = 0; idx < MAX_SECTOR_COUNT; idx++){
+		free(program[idx].merged);
+	}
+	free(image);
+	if(stats) *stats = programStats;
+	return result;
+}
+
+/**
+ * STM32F4_ReadOptionBytes 读FLASH_OPTCR寄存器
+ */
+int STM32F4_ReadOptionBytes(STM32F4Flash flash, uint32_t *optcr){
+	assert(flash != NULL && optcr != NULL);
+	return flash->ap->Interface.Memory.Read32(flash->ap, FLASH_OPTCR, optcr);
+}
+
+/**
+ * STM32F4_WriteOptionBytes 写选项字节
+ */
+int STM32F4_WriteOptionBytes(STM32F4Flash flash, uint32_t optcr){
+	assert(flash != NULL);
+	AccessPort ap = flash->ap;
+	uint32_t current;
+	int result;
+	if((result = ap->Interface.Memory.Read32(ap, FLASH_OPTCR, &current)) != ADI_SUCCESS){
+		return result;
+	}
+	if(current & FLASH_OPTCR_OPTLOCK){
+		if((result = ap->Interface.Memory.Write32(ap, FLASH_OPTKEYR, FLASH_OPTKEY1)) != ADI_SUCCESS
+				|| (result = ap->Interface.Memory.Write32(ap, FLASH_OPTKEYR, FLASH_OPTKEY2)) != ADI_SUCCESS){
+			return result;
+		}
+	}
+	optcr &= ~(FLASH_OPTCR_OPTLOCK | FLASH_OPTCR_OPTSTRT);
+	if((result = ap->Interface.Memory.Write32(ap, FLASH_OPTCR, optcr)) != ADI_SUCCESS
+			|| (result = ap->Interface.Memory.Write32(ap, FLASH_OPTCR, optcr | FLASH_OPTCR_OPTSTRT)) != ADI_SUCCESS){
+		return result;
+	}
+	result = waitFlash(flash, OPTION_TIMEOUT);
+	ap->Interface.Memory.Write32(ap, FLASH_OPTCR, optcr | FLASH_OPTCR_OPTLOCK);
+	return result;
+}
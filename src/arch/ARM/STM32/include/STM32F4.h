@@ -0,0 +1,92 @@
+/*
+ * STM32F4.h
+ *
+ *  Created on: 2019-6-28
+ *      Author: virusv
+ */
+
+#ifndef SRC_ARCH_ARM_STM32_INCLUDE_STM32F4_H_
+#define SRC_ARCH_ARM_STM32_INCLUDE_STM32F4_H_
+
+#include "smart_ocd.h"
+#include "arch/ARM/ADI/include/ADIv5.h"
+
+// 默认的工作区:SRAM1开头的16KB
+#define STM32F4_DEFAULT_WORK_AREA		0x20000000u
+#define STM32F4_DEFAULT_WORK_SIZE		(16u << 10)
+
+/**
+ * Flash编程的统计信息
+ */
+struct stm32f4ProgramStats {
+	uint64_t bytes;	// 实际编程的字节数
+	unsigned int erased;	// 擦除的扇区数
+	unsigned int skipped;	// 内容已经一致被跳过的扇区数
+	double seconds;	// 擦除和编程的时间
+};
+
+/**
+ * STM32F4 Flash对象,不透明
+ */
+typedef struct stm32f4Flash *STM32F4Flash;
+
+/**
+ * STM32F4_CreateFlash 创建Flash对象,读取Flash大小并建立扇区表
+ * 编程时核心会被停止,工作区中的数据会被覆盖
+ * 参数:
+ * 	ap:连接到系统总线的MEM-AP
+ * 	workArea:存放编程程序和数据缓冲区的RAM地址,字对齐
+ * 	workSize:工作区的字节数,至少1KB
+ * 返回:
+ * 	Flash对象,失败返回NULL
+ */
+STM32F4Flash STM32F4_CreateFlash(AccessPort ap, uint32_t workArea, uint32_t workSize);
+
+/**
+ * STM32F4_DestroyFlash 释放Flash对象,不会恢复核心的状态
+ */
+void STM32F4_DestroyFlash(STM32F4Flash *flash);
+
+/**
+ * STM32F4_FlashInfo 获得Flash的信息
+ * 参数:
+ * 	size:Flash的字节数
+ * 	sectorCount:扇区数
+ */
+void STM32F4_FlashInfo(STM32F4Flash flash, uint32_t *size, unsigned int *sectorCount);
+
+/**
+ * STM32F4_FlashErase 擦除扇区
+ * 参数:
+ * 	first:第一个扇区
+ * 	last:最后一个扇区(包括)
+ */
+int STM32F4_FlashErase(STM32F4Flash flash, unsigned int first, unsigned int last);
+
+/**
+ * STM32F4_FlashProgram 编程Flash
+ * 内容已经一致的扇区被跳过,空白的扇区不擦除,其他涉及的扇区整个擦除
+ * 数据由RAM中的编程程序写入Flash,使用两个缓冲区交替,主机传输下一块的同时目标编程当前块
+ * 参数:
+ * 	addr:起始地址,可以不对齐
+ * 	len:字节数
+ * 	data:数据
+ * 	verify:编程后是否校验,校验失败返回ADI_FAILED
+ * 	stats:统计信息,可以为NULL
+ */
+int STM32F4_FlashProgram(STM32F4Flash flash, uint32_t addr, uint32_t len, const uint8_t *data, BOOL verify,
+		struct stm32f4ProgramStats *stats);
+
+/**
+ * STM32F4_ReadOptionBytes 读FLASH_OPTCR寄存器
+ */
+int STM32F4_ReadOptionBytes(STM32F4Flash flash, uint32_t *optcr);
+
+/**
+ * STM32F4_WriteOptionBytes 写FLASH_OPTCR寄存器并启动选项字节编程
+ * 参数:
+ * 	optcr:寄存器的值,OPTLOCK和OPTSTRT位被忽略
+ */
+int STM32F4_WriteOptionBytes(STM32F4Flash flash, uint32_t optcr);
+
+#endif /* SRC_ARCH_ARM_STM32_INCLUDE_STM32F4_H_ */
@@ -0,0 +1,236 @@
+/*
+ * async.c
+ *
+ *  Created on: 2019-7-1
+ *      Author: virusv
+ */
+
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "smart_ocd.h"
+#include "misc/log.h"
+#include "misc/async.h"
+
+/**
+ * 设备的工作线程
+ * 工作线程创建之后一直存在,直到进程退出
+ */
+struct asyncWorker {
+	void *device;	// 设备
+	pthread_t thread;
+	pthread_cond_t cond;	// 有新任务时通知工作线程
+	struct list_head jobs;	// 等待执行的任务
+	unsigned int pending;	// 已提交但没有完成的任务数
+	unsigned int owners;	// 占用设备的后台线程数(监视、采样等)
+	struct asyncWorker *next;
+};
+
+static pthread_mutex_t asyncMutex = PTHREAD_MUTEX_INITIALIZER;
+// 有任务完成时广播
+static pthread_cond_t asyncDone = PTHREAD_COND_INITIALIZER;
+static struct asyncWorker *workers = NULL;
+static unsigned long generation = 0;
+// 工作线程会打印日志
+static pthread_mutex_t logMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void logLock(void *udata, int lock){
+	(void)udata;
+	if(lock){
+		pthread_mutex_lock(&logMutex);
+	}else{
+		pthread_mutex_unlock(&logMutex);
+	}
+}
+
+static void *workerThread(void *arg){
+	struct asyncWorker *worker = arg;
+	struct asyncJob *job;
+	int result;
+	pthread_mutex_lock(&asyncMutex);
+	for(;;){
+		while(list_empty(&worker->jobs)){
+			pthread_cond_wait(&worker->cond, &asyncMutex);
+		}
+		job = list_first_entry(&worker->jobs, struct asyncJob, list_entry);
+		list_del(&job->list_entry);
+		// 执行任务时不持有锁
+		pthread_mutex_unlock(&asyncMutex);
+		result = job->func(job->context);
+		pthread_mutex_lock(&asyncMutex);
+		job->result = result;
+		job->done = TRUE;
+		worker->pending--;
+		generation++;
+		pthread_cond_broadcast(&asyncDone);
+	}
+	return NULL;
+}
+
+/**
+ * 查找设备的工作线程,不存在时返回NULL
+ * 调用时持有asyncMutex
+ */
+static struct asyncWorker *findWorker(void *device){
+	struct asyncWorker *worker;
+	for(worker = workers; worker; worker = worker->next){
+		if(worker->device == device) return worker;
+	}
+	return NULL;
+}
+
+/**
+ * 查找设备的工作线程,不存在则创建
+ * 调用时持有asyncMutex
+ */
+static struct asyncWorker *getWorker(void *device){
+	struct asyncWorker *worker = findWorker(device);
+	if(worker) return worker;
+	worker = calloc(1, sizeof(struct asyncWorker));
+	if(worker == NULL){
+		log_warn("Failed to create async worker.");
+		return NULL;
+	}
+	worker->device = device;
+	INIT_LIST_HEAD(&worker->jobs);
+	pthread_cond_init(&worker->cond, NULL);
+	if(workers == NULL){
+		log_set_lock(logLock);
+	}
+	if(pthread_create(&worker->thread, NULL, workerThread, worker) != 0){
+		log_warn("Failed to start async worker thread.");
+		pthread_cond_destroy(&worker->cond);
+		free(worker);
+		return NULL;
+	}
+	pthread_detach(worker->thread);
+	worker->next = workers;
+	workers = worker;
+	return worker;
+}
+
+/**
+ * 把任务提交到设备的工作线程
+ */
+BOOL Async_Submit(void *device, struct asyncJob *job){
+	struct asyncWorker *worker;
+	assert(job != NULL && job->func != NULL);
+	pthread_mutex_lock(&asyncMutex);
+	worker = getWorker(device);
+	if(worker == NULL || worker->owners > 0){
+		pthread_mutex_unlock(&asyncMutex);
+		return FALSE;
+	}
+	job->done = FALSE;
+	job->submitted = TRUE;
+	worker->pending++;
+	list_add_tail(&job->list_entry, &worker->jobs);
+	pthread_cond_signal(&worker->cond);
+	pthread_mutex_unlock(&asyncMutex);
+	return TRUE;
+}
+
+/**
+ * 设备上没有完成的任务数
+ */
+unsigned int Async_Pending(void *device){
+	struct asyncWorker *worker;
+	unsigned int pending = 0;
+	pthread_mutex_lock(&asyncMutex);
+	worker = findWorker(device);
+	if(worker){
+		pending = worker->pending;
+	}
+	pthread_mutex_unlock(&asyncMutex);
+	return pending;
+}
+
+/**
+ * 占用设备
+ */
+BOOL Async_Acquire(void *device){
+	struct asyncWorker *worker;
+	BOOL acquired = FALSE;
+	pthread_mutex_lock(&asyncMutex);
+	worker = getWorker(device);
+	if(worker && worker->pending == 0 && worker->owners == 0){
+		worker->owners++;
+		acquired = TRUE;
+	}
+	pthread_mutex_unlock(&asyncMutex);
+	return acquired;
+}
+
+/**
+ * 释放Async_Acquire占用的设备
+ */
+void Async_Release(void *device){
+	struct asyncWorker *worker;
+	pthread_mutex_lock(&asyncMutex);
+	worker = findWorker(device);
+	assert(worker != NULL && worker->owners > 0);
+	worker->owners--;
+	pthread_mutex_unlock(&asyncMutex);
+}
+
+/**
+ * 设备是否被后台线程占用
+ */
+BOOL Async_Owned(void *device){
+	struct asyncWorker *worker;
+	BOOL owned;
+	pthread_mutex_lock(&asyncMutex);
+	worker = findWorker(device);
+	owned = worker != NULL && worker->owners > 0;
+	pthread_mutex_unlock(&asyncMutex);
+	return owned;
+}
+
+/**
+ * 任务是否完成
+ */
+BOOL Async_Done(struct asyncJob *job){
+	BOOL done;
+	assert(job != NULL);
+	pthread_mutex_lock(&asyncMutex);
+	done = job->done;
+	pthread_mutex_unlock(&asyncMutex);
+	return done;
+}
+
+/**
+ * 等待任务完成
+ */
+int Async_Wait(struct asyncJob *job){
+	int result;
+	assert(job != NULL && job->submitted);
+	pthread_mutex_lock(&asyncMutex);
+	while(!job->done){
+		pthread_cond_wait(&asyncDone, &asyncMutex);
+	}
+	result = job->result;
+	pthread_mutex_unlock(&asyncMutex);
+	return result;
+}
+
+/**
+ * 已完成任务的计数
+ */
+unsigned long Async_Generation(void){
+	unsigned long gen;
+	pthread_mutex_lock(&asyncMutex);
+	gen = generation;
+	pthread_mutex_unlock(&asyncMutex);
+	return gen;
+}
+
+/**
+ * 等待到有新的任务完成
+ */
+void Async_WaitAny(unsigned long gen){
+	pthread_mutex_lock(&asyncMutex);
+	while(generation == gen){
+		pthread_cond_wait(&asyncDone, &asyncMutex);
+	}
+	pthread_mutex_unlock(&asyncMutex);
+}
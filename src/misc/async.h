@@ -0,0 +1,91 @@
+/*
+ * async.h
+ *
+ *  Created on: 2019-7-1
+ *      Author: virusv
+ */
+
+#ifndef SRC_MISC_ASYNC_H_
+#define SRC_MISC_ASYNC_H_
+
+#include "smart_ocd.h"
+#include "misc/list.h"
+
+/**
+ * 后台执行的阻塞操作
+ * 每个设备(一般是Adapter对象)有一个工作线程,同一个设备上的任务按提交顺序依次执行,
+ * 不同设备上的任务并行执行。任务函数在工作线程中运行,只能访问该设备的对象和任务自己的数据。
+ * 同一个设备上有未完成的任务时,调用者不能在主线程直接访问该设备
+ */
+typedef int (*ASYNC_JOB_FUNC)(void *context);
+
+struct asyncJob {
+	ASYNC_JOB_FUNC func;	// 任务函数
+	void *context;	// 传给任务函数的参数
+	int result;	// 任务函数的返回值,完成之后有效
+	BOOL submitted;	// 是否已经提交
+	BOOL done;	// 是否已经完成,用Async_Done读取
+	struct list_head list_entry;	// 工作线程的任务队列
+};
+
+/**
+ * Async_Submit - 把任务提交到设备的工作线程
+ * 第一次在设备上提交任务时创建工作线程
+ * 参数:
+ * 	device:设备,作为工作线程的标识
+ * 	job:任务,完成之前不能释放
+ * 返回:
+ * 	TRUE:提交成功
+ * 	FALSE:创建工作线程失败,或者设备被Async_Acquire占用
+ */
+BOOL Async_Submit(void *device, struct asyncJob *job);
+
+/**
+ * Async_Pending - 设备上已提交但没有完成的任务数
+ * 不为0时调用者不能在主线程直接访问该设备
+ */
+unsigned int Async_Pending(void *device);
+
+/**
+ * Async_Acquire - 后台线程(监视、采样等)占用设备
+ * 占用期间不能提交任务,调用者也不能在主线程直接访问该设备,直到Async_Release
+ * 返回:
+ * 	TRUE:占用成功
+ * 	FALSE:设备上有未完成的任务或者已经被占用
+ */
+BOOL Async_Acquire(void *device);
+
+/**
+ * Async_Release - 释放Async_Acquire占用的设备
+ */
+void Async_Release(void *device);
+
+/**
+ * Async_Owned - 设备是否被Async_Acquire占用
+ */
+BOOL Async_Owned(void *device);
+
+/**
+ * Async_Done - 任务是否完成
+ */
+BOOL Async_Done(struct asyncJob *job);
+
+/**
+ * Async_Wait - 等待任务完成
+ * 返回:任务函数的返回值
+ */
+int Async_Wait(struct asyncJob *job);
+
+/**
+ * Async_Generation - 已完成任务的计数,用于Async_WaitAny
+ */
+unsigned long Async_Generation(void);
+
+/**
+ * Async_WaitAny - 等待到有新的任务完成
+ * 参数:
+ * 	generation:调用之前用Async_Generation取得的计数,期间已经有任务完成时立即返回
+ */
+void Async_WaitAny(unsigned long generation);
+
+#endif /* SRC_MISC_ASYNC_H_ */
@@ -0,0 +1,387 @@
+/*
+ * image.c
+ *
+ *  Created on: 2019-6-27
+ *      Author: virusv
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <elf.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "smart_ocd.h"
+#include "misc/log.h"
+#include "misc/image.h"
+
+struct imagePrivate {
+	struct image imageApi;
+	const uint8_t *map;	// 映射的文件
+	size_t mapSize;
+	struct imageSegment *segments;
+	unsigned int segmentCount, segmentCapacity;
+	uint8_t *hexData;	// HEX文件解码后的数据
+	uint8_t *merged;	// 合并数据不连续的相邻段时复制的数据
+	uint64_t entry;
+};
+
+static BOOL addSegment(struct imagePrivate *img, uint64_t addr, uint64_t size, const uint8_t *data){
+	struct imageSegment *segments, *last;
+	// 和上一段地址、数据都连续时直接扩展
+	if(img->segmentCount > 0){
+		last = &img->segments[img->segmentCount - 1];
+		if(last->addr + last->size == addr && last->data + last->size == data){
+			last->size += size;
+			return TRUE;
+		}
+	}
+	if(img->segmentCount == img->segmentCapacity){
+		segments = realloc(img->segments, (img->segmentCapacity + 16) * sizeof(struct imageSegment));
+		if(segments == NULL){
+			log_error("Failed to allocate image segments!");
+			return FALSE;
+		}
+		img->segments = segments;
+		img->segmentCapacity += 16;
+	}
+	img->segments[img->segmentCount].addr = addr;
+	img->segments[img->segmentCount].size = size;
+	img->segments[img->segmentCount].data = data;
+	img->segmentCount++;
+	return TRUE;
+}
+
+static int hexDigit(uint8_t c){
+	if(c >= '0' && c <= '9') return c - '0';
+	if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+	if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+	return -1;
+}
+
+/**
+ * 解析HEX记录中的一个字节
+ */
+static BOOL hexByte(const uint8_t *pos, const uint8_t *end, uint8_t *value){
+	int high, low;
+	if(end - pos < 2 || (high = hexDigit(pos[0])) < 0 || (low = hexDigit(pos[1])) < 0){
+		return FALSE;
+	}
+	*value = (uint8_t)((high << 4) | low);
+	return TRUE;
+}
+
+/**
+ * 解析Intel HEX文件,数据记录解码到hexData,连续的记录在解码时就合并成一段
+ * 扩展线性地址(类型04)下,记录的偏移越过64KB时进位到高16位,整个地址在4GB内回绕;
+ * 扩展段地址(类型02)下,偏移在64KB的段内回绕。回绕的记录拆成两段
+ */
+static BOOL loadIntelHex(struct imagePrivate *img){
+	const uint8_t *pos = img->map, *end = img->map + img->mapSize;
+	uint8_t record[5 + 255], *out;
+	unsigned int line = 0, idx, count, first;
+	uint32_t base = 0, offset, addr, wrapAddr;
+	BOOL segmented = FALSE;	// 是否使用扩展段地址
+	uint8_t sum;
+	// 每个数据字节至少占两个字符
+	img->hexData = malloc(img->mapSize / 2 + 1);
+	if(img->hexData == NULL){
+		log_error("Failed to allocate HEX data buffer!");
+		return FALSE;
+	}
+	out = img->hexData;
+	while(pos < end){
+		if(*pos == '\r' || *pos == '\n' || *pos == ' ' || *pos == '\t'){
+			if(*pos == '\n') line++;
+			pos++;
+			continue;
+		}
+		if(*pos++ != ':' || !hexByte(pos, end, &record[0])){
+			goto BAD_RECORD;
+		}
+		// 长度、地址、类型、数据、校验和
+		count = 5u + record[0];
+		sum = 0;
+		for(idx = 0; idx < count; idx++, pos += 2){
+			if(!hexByte(pos, end, &record[idx])){
+				goto BAD_RECORD;
+			}
+			sum += record[idx];
+		}
+		if(sum != 0){
+			log_error("HEX checksum error at line %u.", line + 1);
+			return FALSE;
+		}
+		switch(record[3]){
+		case 0x00:	// 数据
+			memcpy(out, record + 4, record[0]);
+			offset = (uint32_t)record[1] << 8 | record[2];
+			if(segmented){
+				addr = base + offset;
+				wrapAddr = base;
+				first = offset + record[0] > 0x10000u ? 0x10000u - offset : record[0];
+			}else{
+				addr = base + offset;	// 32位运算,偏移进位到高16位
+				wrapAddr = 0;
+				first = addr + record[0] < addr ? (unsigned int)(0u - addr) : record[0];
+			}
+			if(first > 0 && !addSegment(img, addr, first, out)){
+				return FALSE;
+			}
+			if(first < record[0] && !addSegment(img, wrapAddr, record[0] - first, out + first)){
+				return FALSE;
+			}
+			out += record[0];
+			break;
+		case 0x01:	// 文件结束
+			return TRUE;
+		case 0x02:	// 扩展段地址
+			if(record[0] != 2) goto BAD_RECORD;
+			base = ((uint32_t)record[4] << 8 | record[5]) << 4;
+			segmented = TRUE;
+			break;
+		case 0x03:	// 起始段地址 CS:IP
+			if(record[0] != 4) goto BAD_RECORD;
+			img->entry = (((uint64_t)record[4] << 8 | record[5]) << 4) + ((uint32_t)record[6] << 8 | record[7]);
+			break;
+		case 0x04:	// 扩展线性地址
+			if(record[0] != 2) goto BAD_RECORD;
+			base = ((uint32_t)record[4] << 8 | record[5]) << 16;
+			segmented = FALSE;
+			break;
+		case 0x05:	// 起始线性地址
+			if(record[0] != 4) goto BAD_RECORD;
+			img->entry = (uint32_t)record[4] << 24 | (uint32_t)record[5] << 16 | (uint32_t)record[6] << 8 | record[7];
+			break;
+		default:
+			goto BAD_RECORD;
+		}
+	}
+	log_warn("HEX file has no end of file record.");
+	return TRUE;
+BAD_RECORD:
+	log_error("Invalid HEX record at line %u.", line + 1);
+	return FALSE;
+}
+
+/**
+ * 解析ELF文件,加载PT_LOAD段在文件中的部分到物理地址(LMA)
+ * 只支持小端的ELF
+ */
+static BOOL loadElf(struct imagePrivate *img){
+	const uint8_t *file = img->map;
+	uint64_t phoff, offset, paddr, filesz;
+	unsigned int phentsize, phnum, idx;
+	uint32_t type;
+	if(img->mapSize < EI_NIDENT || file[EI_DATA] != ELFDATA2LSB){
+		log_error("Only little-endian ELF files are supported!");
+		return FALSE;
+	}
+	if(file[EI_CLASS] == ELFCLASS32 && img->mapSize >= sizeof(Elf32_Ehdr)){
+		Elf32_Ehdr ehdr;
+		memcpy(&ehdr, file, sizeof(ehdr));
+		phoff = ehdr.e_phoff; phentsize = ehdr.e_phentsize; phnum = ehdr.e_phnum;
+		img->entry = ehdr.e_entry;
+		if(phentsize < sizeof(Elf32_Phdr)) goto BAD_ELF;
+	}else if(file[EI_CLASS] == ELFCLASS64 && img->mapSize >= sizeof(Elf64_Ehdr)){
+		Elf64_Ehdr ehdr;
+		memcpy(&ehdr, file, sizeof(ehdr));
+		phoff = ehdr.e_phoff; phentsize = ehdr.e_phentsize; phnum = ehdr.e_phnum;
+		img->entry = ehdr.e_entry;
+		if(phentsize < sizeof(Elf64_Phdr)) goto BAD_ELF;
+	}else{
+		goto BAD_ELF;
+	}
+	if(phoff > img->mapSize || (uint64_t)phentsize * phnum > img->mapSize - phoff){
+		goto BAD_ELF;
+	}
+	for(idx = 0; idx < phnum; idx++){
+		if(file[EI_CLASS] == ELFCLASS32){
+			Elf32_Phdr phdr;
+			memcpy(&phdr, file + phoff + (uint64_t)idx * phentsize, sizeof(phdr));
+			type = phdr.p_type; offset = phdr.p_offset; paddr = phdr.p_paddr; filesz = phdr.p_filesz;
+		}else{
+			Elf64_Phdr phdr;
+			memcpy(&phdr, file + phoff + (uint64_t)idx * phentsize, sizeof(phdr));
+			type = phdr.p_type; offset = phdr.p_offset; paddr = phdr.p_paddr; filesz = phdr.p_filesz;
+		}
+		// .bss之类只占内存的部分不加载
+		if(type != PT_LOAD || filesz == 0) continue;
+		if(offset > img->mapSize || filesz > img->mapSize - offset){
+			goto BAD_ELF;
+		}
+		if(!addSegment(img, paddr, filesz, file + offset)){
+			return FALSE;
+		}
+	}
+	return TRUE;
+BAD_ELF:
+	log_error("Invalid ELF file!");
+	return FALSE;
+}
+
+static int segmentCompare(const void *a, const void *b){
+	const struct imageSegment *segA = a, *segB = b;
+	return segA->addr < segB->addr ? -1 : segA->addr > segB->addr;
+}
+
+/**
+ * 按地址排序,合并地址相邻的段
+ * 数据在内存中也连续的段直接合并,否则复制到merged
+ */
+static BOOL coalesceSegments(struct imagePrivate *img){
+	struct imageSegment *seg = img->segments;
+	unsigned int idx, runStart, out = 0;
+	uint64_t copyBytes = 0, runSize;
+	BOOL contiguous;
+	uint8_t *copy;
+	if(img->segmentCount == 0) return TRUE;
+	qsort(seg, img->segmentCount, sizeof(struct imageSegment), segmentCompare);
+	// 检查重叠,计算需要复制的字节数
+	for(runStart = 0; runStart < img->segmentCount; runStart = idx){
+		runSize = seg[runStart].size;
+		contiguous = TRUE;
+		for(idx = runStart + 1; idx < img->segmentCount && seg[idx].addr <= seg[idx - 1].addr + seg[idx - 1].size; idx++){
+			if(seg[idx].addr < seg[idx - 1].addr + seg[idx - 1].size){
+				log_error("Image segments overlap at 0x%" PRIX64 "!", seg[idx].addr);
+				return FALSE;
+			}
+			if(seg[idx].data != seg[idx - 1].data + seg[idx - 1].size) contiguous = FALSE;
+			runSize += seg[idx].size;
+		}
+		if(!contiguous) copyBytes += runSize;
+	}
+	if(copyBytes > 0){
+		img->merged = malloc((size_t)copyBytes);
+		if(img->merged == NULL){
+			log_error("Failed to allocate image merge buffer!");
+			return FALSE;
+		}
+	}
+	copy = img->merged;
+	for(runStart = 0; runStart < img->segmentCount; runStart = idx){
+		runSize = seg[runStart].size;
+		contiguous = TRUE;
+		for(idx = runStart + 1; idx < img->segmentCount && seg[idx].addr == seg[idx - 1].addr + seg[idx - 1].size; idx++){
+			if(seg[idx].data != seg[idx - 1].data + seg[idx - 1].size) contiguous = FALSE;
+			runSize += seg[idx].size;
+		}
+		seg[out].addr = seg[runStart].addr;
+		seg[out].data = seg[runStart].data;
+		if(!contiguous){
+			for(runSize = 0; runStart < idx; runStart++){
+				memcpy(copy + runSize, seg[runStart].data, (size_t)seg[runStart].size);
+				runSize += seg[runStart].size;
+			}
+			seg[out].data = copy;
+			copy += runSize;
+		}
+		seg[out].size = runSize;
+		out++;
+	}
+	img->segmentCount = out;
+	return TRUE;
+}
+
+/**
+ * 根据扩展名和文件内容判断格式
+ */
+static enum imageFormat detectFormat(const char *path, const uint8_t *file, size_t size){
+	const char *ext = strrchr(path, '.');
+	if(size >= SELFMAG && memcmp(file, ELFMAG, SELFMAG) == 0){
+		return ImageFormat_Elf;
+	}
+	if(ext && (strcasecmp(ext, ".hex") == 0 || strcasecmp(ext, ".ihex") == 0 || strcasecmp(ext, ".ihx") == 0)){
+		return ImageFormat_IntelHex;
+	}
+	if(file[0] == ':' && !(ext && strcasecmp(ext, ".bin") == 0)){
+		return ImageFormat_IntelHex;
+	}
+	return ImageFormat_Binary;
+}
+
+/**
+ * image_Load 加载镜像文件
+ */
+Image image_Load(const char *path, enum imageFormat format, uint64_t base){
+	assert(path != NULL);
+	struct imagePrivate *img;
+	struct stat fileStat;
+	void *map;
+	BOOL result;
+	int fd;
+	fd = open(path, O_RDONLY);
+	if(fd < 0){
+		log_error("Failed to open %s: %s.", path, strerror(errno));
+		return NULL;
+	}
+	if(fstat(fd, &fileStat) != 0 || fileStat.st_size == 0){
+		log_error("Failed to get the size of %s or it is empty.", path);
+		close(fd);
+		return NULL;
+	}
+	map = mmap(NULL, (size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);	// 映射建立后不再需要文件描述符
+	if(map == MAP_FAILED){
+		log_error("Failed to map %s: %s.", path, strerror(errno));
+		return NULL;
+	}
+	img = calloc(1, sizeof(struct imagePrivate));
+	if(img == NULL){
+		log_error("Failed to allocate image object!");
+		munmap(map, (size_t)fileStat.st_size);
+		return NULL;
+	}
+	img->map = map;
+	img->mapSize = (size_t)fileStat.st_size;
+	if(format == ImageFormat_Auto){
+		format = detectFormat(path, img->map, img->mapSize);
+	}
+	switch(format){
+	case ImageFormat_Binary:
+		result = addSegment(img, base, img->mapSize, img->map);
+		break;
+	case ImageFormat_IntelHex:
+		result = loadIntelHex(img);
+		break;
+	case ImageFormat_Elf:
+		result = loadElf(img);
+		break;
+	default:
+		log_error("Unknown image format!");
+		result = FALSE;
+		break;
+	}
+	if(result){
+		result = coalesceSegments(img);
+	}
+	INTERFACE_CONST_INIT(enum imageFormat, img->imageApi.format, format);
+	INTERFACE_CONST_INIT(unsigned int, img->imageApi.segmentCount, img->segmentCount);
+	INTERFACE_CONST_INIT(uint64_t, img->imageApi.entry, img->entry);
+	img->imageApi.segments = img->segments;
+	Image image = &img->imageApi;
+	if(!result){
+		image_Free(&image);
+		return NULL;
+	}
+	return image;
+}
+
+/**
+ * image_Free 释放镜像对象
+ */
+void image_Free(Image *image){
+	assert(image != NULL && *image != NULL);
+	struct imagePrivate *img = container_of(*image, struct imagePrivate, imageApi);
+	munmap(CAST(void *, img->map), img->mapSize);
+	free(img->segments);
+	free(img->hexData);
+	free(img->merged);
+	free(img);
+	*image = NULL;
+}
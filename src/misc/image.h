@@ -0,0 +1,59 @@
+/*
+ * image.h
+ *
+ *  Created on: 2019-6-27
+ *      Author: virusv
+ */
+
+#ifndef SRC_MISC_IMAGE_H_
+#define SRC_MISC_IMAGE_H_
+
+#include "smart_ocd.h"
+
+/**
+ * 镜像文件格式
+ */
+enum imageFormat {
+	ImageFormat_Auto = 0,	// 根据扩展名和文件内容判断
+	ImageFormat_Binary,		// 原始二进制
+	ImageFormat_IntelHex,	// Intel HEX
+	ImageFormat_Elf,		// ELF,加载PT_LOAD段
+};
+
+/**
+ * 镜像中一段连续的数据
+ */
+struct imageSegment {
+	uint64_t addr;	// 加载地址
+	uint64_t size;	// 字节数
+	const uint8_t *data;	// 数据,指向映射的文件或者镜像内部的缓冲区
+};
+
+/**
+ * 镜像对象,所有段按地址排序,相邻的段已经合并
+ */
+struct image {
+	const enum imageFormat format;	// 文件格式,只读
+	const unsigned int segmentCount;	// 段数,只读
+	const struct imageSegment *segments;
+	const uint64_t entry;	// 入口地址,文件中没有时为0
+};
+typedef struct image *Image;
+
+/**
+ * image_Load 加载镜像文件,文件内容通过mmap映射
+ * 参数:
+ * 	path:文件路径
+ * 	format:文件格式
+ * 	base:二进制文件的加载地址,其他格式忽略
+ * 返回:
+ * 	镜像对象,失败返回NULL
+ */
+Image image_Load(const char *path, enum imageFormat format, uint64_t base);
+
+/**
+ * image_Free 释放镜像对象
+ */
+void image_Free(Image *image);
+
+#endif /* SRC_MISC_IMAGE_H_ */
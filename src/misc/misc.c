@@ -8,8 +8,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 
 #include "smart_ocd.h"
+#include "misc/misc.h"
 
 /**
  * 32位按位镜像翻转
@@ -80,3 +87,131 @@ int misc_PrintBulk(char *data, int length, int rowLen){
     }	
 	return currRow;
 }
+
+/**
+ * 64位FNV-1a散列
+ */
+uint64_t misc_Hash64(const void *data, size_t length, uint64_t seed){
+	const uint8_t *p = data;
+	uint64_t hash = seed ? seed : 0xcbf29ce484222325ull;
+	while(length--){
+		hash ^= *p++;
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+/**
+ * 获得缓存目录,并确保目录存在
+ * 返回:FALSE:缓存被禁用或者目录无法创建
+ */
+static BOOL cacheDir(char *path, size_t size){
+	const char *env;
+	if(getenv("SMARTOCD_NO_CACHE") != NULL) return FALSE;
+	if((env = getenv("SMARTOCD_CACHE_DIR")) != NULL){
+		snprintf(path, size, "%s", env);
+	}else if((env = getenv("XDG_CACHE_HOME")) != NULL){
+		snprintf(path, size, "%s/smartocd", env);
+	}else if((env = getenv("HOME")) != NULL){
+		snprintf(path, size, "%s/.cache", env);
+		mkdir(path, 0755);
+		snprintf(path, size, "%s/.cache/smartocd", env);
+	}else{
+		return FALSE;
+	}
+	if(mkdir(path, 0755) != 0 && errno != EEXIST) return FALSE;
+	return TRUE;
+}
+
+/**
+ * 读取缓存文件
+ */
+BOOL misc_CacheLoad(const char *name, void **data, size_t *length){
+	char path[PATH_MAX];
+	struct stat st;
+	FILE *fp;
+	void *buff;
+	assert(name != NULL && data != NULL && length != NULL);
+	if(cacheDir(path, sizeof(path)) == FALSE) return FALSE;
+	strncat(path, "/", sizeof(path) - strlen(path) - 1);
+	strncat(path, name, sizeof(path) - strlen(path) - 1);
+	fp = fopen(path, "rb");
+	if(fp == NULL) return FALSE;
+	if(fstat(fileno(fp), &st) != 0 || st.st_size == 0){
+		fclose(fp);
+		return FALSE;
+	}
+	buff = malloc(st.st_size);
+	if(buff == NULL){
+		fclose(fp);
+		return FALSE;
+	}
+	if(fread(buff, 1, st.st_size, fp) != (size_t)st.st_size){
+		free(buff);
+		fclose(fp);
+		return FALSE;
+	}
+	fclose(fp);
+	*data = buff;
+	*length = st.st_size;
+	return TRUE;
+}
+
+/**
+ * 写入缓存文件
+ */
+BOOL misc_CacheStore(const char *name, const void *data, size_t length){
+	char path[PATH_MAX], tmpPath[PATH_MAX + 16];
+	FILE *fp;
+	assert(name != NULL && data != NULL);
+	if(cacheDir(path, sizeof(path)) == FALSE) return FALSE;
+	strncat(path, "/", sizeof(path) - strlen(path) - 1);
+	strncat(path, name, sizeof(path) - strlen(path) - 1);
+	snprintf(tmpPath, sizeof(tmpPath), "%s.%d", path, (int)getpid());
+	fp = fopen(tmpPath, "wb");
+	if(fp == NULL) return FALSE;
+	if(fwrite(data, 1, length, fp) != length){
+		fclose(fp);
+		unlink(tmpPath);
+		return FALSE;
+	}
+	fclose(fp);
+	if(rename(tmpPath, path) != 0){
+		unlink(tmpPath);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * 只读映射缓存文件
+ */
+BOOL misc_CacheMap(const char *name, const void **data, size_t *length){
+	char path[PATH_MAX];
+	struct stat st;
+	void *addr;
+	int fd;
+	assert(name != NULL && data != NULL && length != NULL);
+	if(cacheDir(path, sizeof(path)) == FALSE) return FALSE;
+	strncat(path, "/", sizeof(path) - strlen(path) - 1);
+	strncat(path, name, sizeof(path) - strlen(path) - 1);
+	fd = open(path, O_RDONLY);
+	if(fd < 0) return FALSE;
+	if(fstat(fd, &st) != 0 || st.st_size == 0){
+		close(fd);
+		return FALSE;
+	}
+	addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(addr == MAP_FAILED) return FALSE;
+	*data = addr;
+	*length = st.st_size;
+	return TRUE;
+}
+
+/**
+ * 取消缓存文件的映射
+ */
+void misc_CacheUnmap(const void *data, size_t length){
+	munmap(CAST(void *, data), length);
+}
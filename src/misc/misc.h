@@ -8,7 +8,64 @@
 #ifndef SRC_MISC_MISC_H_
 #define SRC_MISC_MISC_H_
 
+#include <stddef.h>
+#include "smart_ocd.h"
+
 uint32_t misc_BitReverse(uint32_t n);
 int misc_PrintBulk(char *data, int length, int rowLen);
 
+/**
+ * misc_Hash64 - 计算数据的64位FNV-1a散列值
+ * 参数:
+ * 	data:数据
+ * 	length:数据长度
+ * 	seed:初始值,传0使用默认初始值;可以传入上一次的结果实现分段计算
+ * 返回:散列值
+ */
+uint64_t misc_Hash64(const void *data, size_t length, uint64_t seed);
+
+/**
+ * misc_CacheLoad - 从磁盘缓存目录读取缓存文件
+ * 缓存目录按顺序取:SMARTOCD_CACHE_DIR,XDG_CACHE_HOME/smartocd,HOME/.cache/smartocd
+ * 设置环境变量SMARTOCD_NO_CACHE可以禁用所有磁盘缓存
+ * 参数:
+ * 	name:缓存文件名,不包含目录
+ * 	data:读取的数据,使用完毕后需要调用者free
+ * 	length:数据长度
+ * 返回:
+ * 	TRUE:读取成功
+ * 	FALSE:缓存不存在或者读取失败
+ */
+BOOL misc_CacheLoad(const char *name, void **data, size_t *length);
+
+/**
+ * misc_CacheStore - 写入磁盘缓存文件,先写临时文件再重命名,保证缓存文件的完整性
+ * 参数:
+ * 	name:缓存文件名,不包含目录
+ * 	data:数据
+ * 	length:数据长度
+ * 返回:
+ * 	TRUE:写入成功
+ * 	FALSE:写入失败
+ */
+BOOL misc_CacheStore(const char *name, const void *data, size_t length);
+
+/**
+ * misc_CacheMap - 只读映射缓存文件,适合直接使用文件内容的大缓存
+ * 缓存文件总是通过重命名整体替换,映射期间不会被改写
+ * 参数:
+ * 	name:缓存文件名,不包含目录
+ * 	data:映射的地址,使用完毕后调用misc_CacheUnmap
+ * 	length:数据长度
+ * 返回:
+ * 	TRUE:映射成功
+ * 	FALSE:缓存不存在或者映射失败
+ */
+BOOL misc_CacheMap(const char *name, const void **data, size_t *length);
+
+/**
+ * misc_CacheUnmap - 取消misc_CacheMap的映射
+ */
+void misc_CacheUnmap(const void *data, size_t length);
+
 #endif /* SRC_MISC_MISC_H_ */
@@ -0,0 +1,138 @@
+/*
+ * ring.c
+ *
+ *  Created on: 2019-7-6
+ *      Author: virusv
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include "smart_ocd.h"
+#include "misc/log.h"
+#include "misc/ring.h"
+
+// 生产者和消费者的位置放在不同的缓存行,避免互相干扰
+#define RING_CACHE_LINE 64
+
+struct ringBuffer {
+	// 生产者写入
+	_Alignas(RING_CACHE_LINE) atomic_uint head;	// 下一条写入的位置
+	unsigned int tailCache;	// 生产者看到的消费者位置,满的时候才重新读取
+	// 消费者写入
+	_Alignas(RING_CACHE_LINE) atomic_uint tail;	// 下一条读出的位置
+	unsigned int headCache;	// 消费者看到的生产者位置,空的时候才重新读取
+	// 只读
+	_Alignas(RING_CACHE_LINE) unsigned int mask;	// 容量-1
+	size_t elemSize;
+	uint8_t *data;
+};
+
+/**
+ * 创建环形缓冲区
+ */
+RingBuffer Ring_Create(size_t elemSize, unsigned int capacity){
+	struct ringBuffer *ring;
+	unsigned int size = 1;
+	assert(elemSize > 0);
+	if(capacity == 0 || capacity > (1u << 30)){
+		log_warn("Invalid ring buffer capacity %u.", capacity);
+		return NULL;
+	}
+	while(size < capacity) size <<= 1;
+	ring = aligned_alloc(RING_CACHE_LINE, sizeof(struct ringBuffer));
+	if(ring == NULL){
+		log_error("Failed to allocate ring buffer object.");
+		return NULL;
+	}
+	memset(ring, 0x0, sizeof(struct ringBuffer));
+	ring->data = malloc(elemSize * size);
+	if(ring->data == NULL){
+		log_error("Failed to allocate ring buffer of %u records.", size);
+		free(ring);
+		return NULL;
+	}
+	atomic_init(&ring->head, 0);
+	atomic_init(&ring->tail, 0);
+	ring->mask = size - 1;
+	ring->elemSize = elemSize;
+	return ring;
+}
+
+/**
+ * 销毁环形缓冲区
+ */
+void Ring_Destroy(RingBuffer *ringPtr){
+	assert(ringPtr != NULL && *ringPtr != NULL);
+	free((*ringPtr)->data);
+	free(*ringPtr);
+	*ringPtr = NULL;
+}
+
+/**
+ * 写入多条记录
+ * 位置是自由增长的计数,相减得到记录数,回绕不影响结果
+ */
+unsigned int Ring_Push(RingBuffer ring, const void *elems, unsigned int count){
+	unsigned int head, space, first, pos;
+	assert(ring != NULL);
+	head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	space = ring->mask + 1 - (head - ring->tailCache);
+	if(space < count){
+		ring->tailCache = atomic_load_explicit(&ring->tail, memory_order_acquire);
+		space = ring->mask + 1 - (head - ring->tailCache);
+	}
+	if(count > space) count = space;
+	if(count == 0) return 0;
+	pos = head & ring->mask;
+	first = ring->mask + 1 - pos;
+	if(first > count) first = count;
+	memcpy(ring->data + pos * ring->elemSize, elems, first * ring->elemSize);
+	if(count > first){
+		memcpy(ring->data, CAST(const uint8_t *, elems) + first * ring->elemSize, (count - first) * ring->elemSize);
+	}
+	atomic_store_explicit(&ring->head, head + count, memory_order_release);
+	return count;
+}
+
+/**
+ * 读出多条记录
+ */
+unsigned int Ring_Pop(RingBuffer ring, void *elems, unsigned int max){
+	unsigned int tail, count, first, pos;
+	assert(ring != NULL);
+	tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	count = ring->headCache - tail;
+	if(count < max){
+		ring->headCache = atomic_load_explicit(&ring->head, memory_order_acquire);
+		count = ring->headCache - tail;
+	}
+	if(count > max) count = max;
+	if(count == 0) return 0;
+	pos = tail & ring->mask;
+	first = ring->mask + 1 - pos;
+	if(first > count) first = count;
+	memcpy(elems, ring->data + pos * ring->elemSize, first * ring->elemSize);
+	if(count > first){
+		memcpy(CAST(uint8_t *, elems) + first * ring->elemSize, ring->data, (count - first) * ring->elemSize);
+	}
+	atomic_store_explicit(&ring->tail, tail + count, memory_order_release);
+	return count;
+}
+
+/**
+ * 缓冲区中的记录数
+ */
+unsigned int Ring_Count(RingBuffer ring){
+	assert(ring != NULL);
+	return atomic_load_explicit(&ring->head, memory_order_acquire) - atomic_load_explicit(&ring->tail, memory_order_acquire);
+}
+
+/**
+ * 缓冲区的容量
+ */
+unsigned int Ring_Capacity(RingBuffer ring){
+	assert(ring != NULL);
+	return ring->mask + 1;
+}
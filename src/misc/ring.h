@@ -0,0 +1,67 @@
+/*
+ * ring.h
+ *
+ *  Created on: 2019-7-6
+ *      Author: virusv
+ */
+
+#ifndef SRC_MISC_RING_H_
+#define SRC_MISC_RING_H_
+
+#include <stddef.h>
+#include "smart_ocd.h"
+
+/**
+ * 单生产者单消费者的无锁环形缓冲区
+ * 保存定长的记录,容量是2的幂。生产者和消费者各自只写自己的位置,用acquire/release同步,
+ * 不需要互斥锁,生产者在采样线程中写入时不会被消费者阻塞。满时写入失败,由生产者决定丢弃。
+ * 同一时刻只能有一个线程写入、一个线程读取
+ */
+typedef struct ringBuffer *RingBuffer;
+
+/**
+ * Ring_Create - 创建环形缓冲区
+ * 参数:
+ * 	elemSize:每条记录的字节数
+ * 	capacity:最少可以保存的记录数,向上取整到2的幂
+ * 返回:
+ * 	环形缓冲区对象,失败返回NULL
+ */
+RingBuffer Ring_Create(size_t elemSize, unsigned int capacity);
+
+/**
+ * Ring_Destroy - 销毁环形缓冲区,调用时不能有线程在读写
+ */
+void Ring_Destroy(RingBuffer *ring);
+
+/**
+ * Ring_Push - 写入多条记录,只能由生产者调用
+ * 参数:
+ * 	elems:记录数组
+ * 	count:记录数
+ * 返回:
+ * 	写入的记录数,空间不足时只写入前面的部分
+ */
+unsigned int Ring_Push(RingBuffer ring, const void *elems, unsigned int count);
+
+/**
+ * Ring_Pop - 读出多条记录,只能由消费者调用
+ * 参数:
+ * 	elems:存放记录的数组
+ * 	max:最多读出的记录数
+ * 返回:
+ * 	读出的记录数
+ */
+unsigned int Ring_Pop(RingBuffer ring, void *elems, unsigned int max);
+
+/**
+ * Ring_Count - 缓冲区中的记录数,其他线程同时读写时只是一个近似值
+ */
+unsigned int Ring_Count(RingBuffer ring);
+
+/**
+ * Ring_Capacity - 缓冲区的容量
+ */
+unsigned int Ring_Capacity(RingBuffer ring);
+
+#endif /* SRC_MISC_RING_H_ */
@@ -0,0 +1,1917 @@
+/*
+ * symbols.c
+ *
+ *  Created on: 2019-7-5
+ *      Author: virusv
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <elf.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "smart_ocd.h"
+#include "misc/log.h"
+#include "misc/misc.h"
+#include "misc/symbols.h"
+
+// 用到的DWARF常量
+#define DW_TAG_array_type		0x01
+#define DW_TAG_class_type		0x02
+#define DW_TAG_enumeration_type	0x04
+#define DW_TAG_member			0x0d
+#define DW_TAG_pointer_type		0x0f
+#define DW_TAG_reference_type	0x10
+#define DW_TAG_structure_type	0x13
+#define DW_TAG_subroutine_type	0x15
+#define DW_TAG_typedef			0x16
+#define DW_TAG_union_type		0x17
+#define DW_TAG_subrange_type	0x21
+#define DW_TAG_enumerator		0x28
+#define DW_TAG_base_type		0x24
+#define DW_TAG_const_type		0x26
+#define DW_TAG_variable			0x34
+#define DW_TAG_volatile_type	0x35
+#define DW_TAG_restrict_type	0x37
+#define DW_TAG_rvalue_reference_type	0x42
+#define DW_TAG_atomic_type		0x47
+
+#define DW_AT_sibling			0x01
+#define DW_AT_location			0x02
+#define DW_AT_name				0x03
+#define DW_AT_byte_size			0x0b
+#define DW_AT_bit_offset		0x0c
+#define DW_AT_bit_size			0x0d
+#define DW_AT_const_value		0x1c
+#define DW_AT_upper_bound		0x2f
+#define DW_AT_count				0x37
+#define DW_AT_data_member_location	0x38
+#define DW_AT_declaration		0x3c
+#define DW_AT_encoding			0x3e
+#define DW_AT_specification		0x47
+#define DW_AT_type				0x49
+#define DW_AT_data_bit_offset	0x6b
+#define DW_AT_str_offsets_base	0x72
+
+#define DW_FORM_addr			0x01
+#define DW_FORM_block2			0x03
+#define DW_FORM_block4			0x04
+#define DW_FORM_data2			0x05
+#define DW_FORM_data4			0x06
+#define DW_FORM_data8			0x07
+#define DW_FORM_string			0x08
+#define DW_FORM_block			0x09
+#define DW_FORM_block1			0x0a
+#define DW_FORM_data1			0x0b
+#define DW_FORM_flag			0x0c
+#define DW_FORM_sdata			0x0d
+#define DW_FORM_strp			0x0e
+#define DW_FORM_udata			0x0f
+#define DW_FORM_ref_addr		0x10
+#define DW_FORM_ref1			0x11
+#define DW_FORM_ref2			0x12
+#define DW_FORM_ref4			0x13
+#define DW_FORM_ref8			0x14
+#define DW_FORM_ref_udata		0x15
+#define DW_FORM_indirect		0x16
+#define DW_FORM_sec_offset		0x17
+#define DW_FORM_exprloc			0x18
+#define DW_FORM_flag_present	0x19
+#define DW_FORM_strx			0x1a
+#define DW_FORM_addrx			0x1b
+#define DW_FORM_ref_sup4		0x1c
+#define DW_FORM_strp_sup		0x1d
+#define DW_FORM_data16			0x1e
+#define DW_FORM_line_strp		0x1f
+#define DW_FORM_ref_sig8		0x20
+#define DW_FORM_implicit_const	0x21
+#define DW_FORM_loclistx		0x22
+#define DW_FORM_rnglistx		0x23
+#define DW_FORM_ref_sup8		0x24
+#define DW_FORM_strx1			0x25
+#define DW_FORM_strx2			0x26
+#define DW_FORM_strx3			0x27
+#define DW_FORM_strx4			0x28
+#define DW_FORM_addrx1			0x29
+#define DW_FORM_addrx2			0x2a
+#define DW_FORM_addrx3			0x2b
+#define DW_FORM_addrx4			0x2c
+#define DW_FORM_GNU_ref_alt		0x1f20
+#define DW_FORM_GNU_strp_alt	0x1f21
+
+#define DW_ATE_boolean			0x02
+#define DW_ATE_float			0x04
+#define DW_ATE_signed			0x05
+#define DW_ATE_signed_char		0x06
+
+#define DW_OP_addr				0x03
+#define DW_OP_plus_uconst		0x23
+
+#define DW_UT_skeleton			0x04
+#define DW_UT_split_compile		0x05
+#define DW_UT_type				0x02
+#define DW_UT_split_type		0x06
+
+/**
+ * 索引文件格式
+ * 文件头之后依次是符号、编译单元偏移、散列表和字符串池
+ */
+#define SYMBOLS_INDEX_MAGIC		0x59534f53	// "SOSY"
+#define SYMBOLS_INDEX_VERSION	1
+
+#define SYMBOL_FLAG_FUNCTION	0x01	// .symtab中的函数
+#define SYMBOL_FLAG_OBJECT		0x02	// .symtab中的变量或者DWARF变量
+#define SYMBOL_FLAG_GLOBAL		0x04	// 全局符号
+#define SYMBOL_FLAG_ADDRESS		0x08	// addr有效
+#define SYMBOL_FLAG_DECLARATION	0x10	// die只是声明
+
+#define INDEX_HASH_EMPTY	0xFFFFFFFFu
+
+struct indexHeader {
+	uint32_t magic;
+	uint32_t version;
+	int64_t mtime;	// ELF文件修改时间
+	uint64_t fileSize;	// ELF文件字节数
+	uint64_t elfHash;	// ELF文件头和节头表的散列
+	uint32_t entryCount;
+	uint32_t unitCount;
+	uint32_t hashSize;	// 2的幂
+	uint32_t stringsSize;
+};
+
+struct indexEntry {
+	uint64_t addr;
+	uint64_t size;	// .symtab中的大小
+	uint64_t die;	// DW_TAG_variable在.debug_info中的偏移,0表示没有调试信息
+	uint32_t name;	// 名字在字符串池中的偏移
+	uint32_t flags;	// SYMBOL_FLAG_*
+};
+
+struct indexHash {
+	uint32_t hash;
+	uint32_t index;
+};
+
+struct elfSection {
+	const uint8_t *data;
+	uint64_t size;
+};
+
+// 缩写表
+struct abbrevAttr {
+	uint16_t name;
+	uint16_t form;
+	int64_t implicitConst;
+};
+
+struct abbrev {
+	uint16_t tag;	// 0表示这个代码没有定义
+	uint8_t hasChildren;
+	int fixedSize;	// 所有属性都是定长时的总字节数,否则为-1
+	unsigned int attrCount;
+	const struct abbrevAttr *attrs;
+};
+
+struct abbrevTable {
+	struct abbrev *abbrevs;	// 按代码索引
+	uint64_t count;
+	struct abbrevAttr *attrs;
+};
+
+// 编译单元,第一次访问时解析单元头和缩写表
+struct dwarfUnit {
+	uint64_t offset;	// 单元头在.debug_info中的偏移
+	uint64_t end;
+	uint64_t dieStart;	// 第一个DIE的偏移
+	uint16_t version;
+	uint8_t addrSize;
+	uint8_t offsetSize;
+	uint64_t abbrevOffset;
+	uint64_t strOffsetsBase;
+	struct abbrevTable abbrevs;
+	BOOL ready;
+};
+
+struct reader {
+	const uint8_t *pos;
+	const uint8_t *end;
+	BOOL error;
+};
+
+struct formValue {
+	uint64_t u;
+	const uint8_t *block;
+	uint64_t blockLength;
+	const char *str;
+};
+
+// 解析出的DIE,只保留用到的属性
+struct dwarfDie {
+	uint64_t offset;
+	uint64_t end;	// 属性之后的偏移,也就是第一个子DIE
+	uint16_t tag;
+	BOOL hasChildren;
+	const char *name;
+	uint64_t type;
+	uint64_t byteSize, bitSize, bitOffset, dataBitOffset, memberOffset;
+	int64_t upperBound;
+	uint64_t count, encoding, sibling, specification, location, strOffsetsBase;
+	BOOL hasByteSize, hasBitOffset, hasDataBitOffset, hasMemberOffset, hasUpperBound, hasCount;
+	BOOL hasLocation, hasStrOffsetsBase, declaration;
+	BOOL negativeConst;	// DW_AT_const_value是负数
+};
+
+// 解码后的类型
+struct typeNode {
+	struct symbolType type;
+	uint64_t targetRef;	// 指针和数组元素的类型
+	const struct symbolType *target;
+	struct symbolMember *members;	// 自己分配的成员
+	char *name;	// 自己分配的名字
+	struct typeNode *next;
+};
+
+struct typeSlot {
+	uint64_t offset;	// 0表示空
+	const struct symbolType *type;
+};
+
+// 函数的地址范围
+struct functionRange {
+	uint64_t addr;
+	uint64_t end;	// 结束地址,不包含
+	const char *name;
+	BOOL global;
+};
+
+// 路径解析结果的缓存
+struct pathCache {
+	struct pathCache *next;
+	uint64_t hash;
+	struct symbolLocation location;
+	char path[];
+};
+
+struct symbols {
+	const uint8_t *map;	// 映射的ELF文件
+	size_t mapSize;
+	struct elfSection info, abbrev, str, lineStr, strOffsets;
+	// 索引,映射的缓存文件或者malloc
+	const uint8_t *index;
+	size_t indexSize;
+	BOOL indexMapped;
+	const struct indexHeader *header;
+	const struct indexEntry *entries;
+	const uint64_t *unitOffsets;
+	const struct indexHash *hash;
+	const char *strings;
+	// 延迟解码的编译单元和类型
+	struct dwarfUnit *units;
+	unsigned int decodedUnits;
+	struct typeSlot *typeSlots;
+	unsigned int typeCount, typeSlotCount;
+	struct typeNode *typeNodes;
+	// 路径缓存
+	struct pathCache **paths;
+	unsigned int pathCount, pathBucketCount;
+	// 按地址排序的函数,第一次按地址查找时建立
+	struct functionRange *functions;
+	unsigned int functionCount;
+	BOOL functionsReady;
+};
+
+static struct typeNode voidType = {
+	.type = {SymbolType_Unknown, "void", 0, SymbolEncoding_Unsigned, 0, 0, NULL},
+};
+
+/******************************* 基本读取 *******************************/
+static uint64_t readU(struct reader *r, unsigned int size){
+	uint64_t value = 0;
+	unsigned int i;
+	if((size_t)(r->end - r->pos) < size){
+		r->error = TRUE;
+		r->pos = r->end;
+		return 0;
+	}
+	for(i = 0; i < size; i++){
+		value |= (uint64_t)r->pos[i] << (i << 3);
+	}
+	r->pos += size;
+	return value;
+}
+
+static uint64_t readULEB(struct reader *r){
+	uint64_t value = 0;
+	unsigned int shift = 0;
+	uint8_t byte;
+	do{
+		if(r->pos >= r->end){
+			r->error = TRUE;
+			return 0;
+		}
+		byte = *r->pos++;
+		if(shift < 64) value |= (uint64_t)(byte & 0x7f) << shift;
+		shift += 7;
+	}while(byte & 0x80);
+	return value;
+}
+
+static int64_t readSLEB(struct reader *r){
+	uint64_t value = 0;
+	unsigned int shift = 0;
+	uint8_t byte;
+	do{
+		if(r->pos >= r->end){
+			r->error = TRUE;
+			return 0;
+		}
+		byte = *r->pos++;
+		if(shift < 64) value |= (uint64_t)(byte & 0x7f) << shift;
+		shift += 7;
+	}while(byte & 0x80);
+	if(shift < 64 && (byte & 0x40)) value |= ~0ull << shift;
+	return (int64_t)value;
+}
+
+static void skipBytes(struct reader *r, uint64_t size){
+	if((uint64_t)(r->end - r->pos) < size){
+		r->error = TRUE;
+		r->pos = r->end;
+		return;
+	}
+	r->pos += size;
+}
+
+/**
+ * 字符串节中的字符串,越界或者没有结束符时返回NULL
+ */
+static const char *sectionString(const struct elfSection *section, uint64_t offset){
+	if(section->data == NULL || offset >= section->size) return NULL;
+	if(memchr(section->data + offset, '\0', section->size - offset) == NULL) return NULL;
+	return CAST(const char *, section->data + offset);
+}
+
+/******************************* DWARF *******************************/
+/**
+ * 定长形式的字节数,变长返回-1
+ */
+static int formSize(const struct dwarfUnit *unit, unsigned int form){
+	switch(form){
+	case DW_FORM_flag_present: case DW_FORM_implicit_const:
+		return 0;
+	case DW_FORM_data1: case DW_FORM_ref1: case DW_FORM_flag: case DW_FORM_strx1: case DW_FORM_addrx1:
+		return 1;
+	case DW_FORM_data2: case DW_FORM_ref2: case DW_FORM_strx2: case DW_FORM_addrx2:
+		return 2;
+	case DW_FORM_strx3: case DW_FORM_addrx3:
+		return 3;
+	case DW_FORM_data4: case DW_FORM_ref4: case DW_FORM_strx4: case DW_FORM_addrx4: case DW_FORM_ref_sup4:
+		return 4;
+	case DW_FORM_data8: case DW_FORM_ref8: case DW_FORM_ref_sig8: case DW_FORM_ref_sup8:
+		return 8;
+	case DW_FORM_data16:
+		return 16;
+	case DW_FORM_addr:
+		return unit->addrSize;
+	case DW_FORM_strp: case DW_FORM_line_strp: case DW_FORM_sec_offset: case DW_FORM_strp_sup:
+	case DW_FORM_GNU_ref_alt: case DW_FORM_GNU_strp_alt:
+		return unit->offsetSize;
+	case DW_FORM_ref_addr:
+		return unit->version <= 2 ? unit->addrSize : unit->offsetSize;
+	default:
+		return -1;
+	}
+}
+
+static const char *strxString(struct symbols *syms, const struct dwarfUnit *unit, uint64_t index){
+	struct reader r;
+	uint64_t offset = unit->strOffsetsBase + index * unit->offsetSize;
+	if(syms->strOffsets.data == NULL || offset >= syms->strOffsets.size) return NULL;
+	r.pos = syms->strOffsets.data + offset;
+	r.end = syms->strOffsets.data + syms->strOffsets.size;
+	r.error = FALSE;
+	offset = readU(&r, unit->offsetSize);
+	return r.error ? NULL : sectionString(&syms->str, offset);
+}
+
+/**
+ * 读取一个属性值
+ * 单元内的引用转换成.debug_info中的偏移
+ */
+static void readForm(struct symbols *syms, const struct dwarfUnit *unit, unsigned int form, int64_t implicitConst, struct reader *r, struct formValue *value){
+	int size;
+	value->u = 0;
+	value->block = NULL;
+	value->blockLength = 0;
+	value->str = NULL;
+	switch(form){
+	case DW_FORM_string:
+		value->str = CAST(const char *, r->pos);
+		value->block = memchr(r->pos, '\0', r->end - r->pos);
+		if(value->block == NULL){
+			value->str = NULL;
+			r->error = TRUE;
+			r->pos = r->end;
+		}else{
+			r->pos = value->block + 1;
+			value->block = NULL;
+		}
+		return;
+	case DW_FORM_strp:
+		value->u = readU(r, unit->offsetSize);
+		value->str = sectionString(&syms->str, value->u);
+		return;
+	case DW_FORM_line_strp:
+		value->u = readU(r, unit->offsetSize);
+		value->str = sectionString(&syms->lineStr, value->u);
+		return;
+	case DW_FORM_strx:
+		value->str = strxString(syms, unit, readULEB(r));
+		return;
+	case DW_FORM_strx1: case DW_FORM_strx2: case DW_FORM_strx3: case DW_FORM_strx4:
+		value->str = strxString(syms, unit, readU(r, form - DW_FORM_strx1 + 1));
+		return;
+	case DW_FORM_ref1: case DW_FORM_ref2: case DW_FORM_ref4: case DW_FORM_ref8:
+		value->u = unit->offset + readU(r, formSize(unit, form));
+		return;
+	case DW_FORM_ref_udata:
+		value->u = unit->offset + readULEB(r);
+		return;
+	case DW_FORM_sdata:
+		value->u = (uint64_t)readSLEB(r);
+		return;
+	case DW_FORM_udata: case DW_FORM_addrx: case DW_FORM_loclistx: case DW_FORM_rnglistx:
+		value->u = readULEB(r);
+		return;
+	case DW_FORM_implicit_const:
+		value->u = (uint64_t)implicitConst;
+		return;
+	case DW_FORM_flag_present:
+		value->u = 1;
+		return;
+	case DW_FORM_exprloc: case DW_FORM_block:
+		value->blockLength = readULEB(r);
+		break;
+	case DW_FORM_block1:
+		value->blockLength = readU(r, 1);
+		break;
+	case DW_FORM_block2:
+		value->blockLength = readU(r, 2);
+		break;
+	case DW_FORM_block4:
+		value->blockLength = readU(r, 4);
+		break;
+	case DW_FORM_indirect:
+		form = (unsigned int)readULEB(r);
+		if(form == DW_FORM_indirect || r->error){
+			r->error = TRUE;
+			return;
+		}
+		readForm(syms, unit, form, implicitConst, r, value);
+		return;
+	default:
+		size = formSize(unit, form);
+		if(size < 0){
+			r->error = TRUE;
+			r->pos = r->end;
+		}else if(size <= 8){
+			value->u = readU(r, size);
+		}else{
+			skipBytes(r, size);
+		}
+		return;
+	}
+	// 块
+	value->block = r->pos;
+	skipBytes(r, value->blockLength);
+}
+
+/**
+ * 解析缩写表
+ */
+static BOOL parseAbbrevs(struct symbols *syms, struct dwarfUnit *unit){
+	struct abbrevTable *table = &unit->abbrevs;
+	struct reader r;
+	uint64_t code, maxCode = 0, attrTotal = 0, name, form;
+	struct abbrev *abbrev;
+	struct abbrevAttr *attr;
+	int size;
+	int pass;
+	if(unit->abbrevOffset >= syms->abbrev.size) return FALSE;
+	// 第一遍统计代码范围和属性个数,第二遍填充
+	for(pass = 0; pass < 2; pass++){
+		r.pos = syms->abbrev.data + unit->abbrevOffset;
+		r.end = syms->abbrev.data + syms->abbrev.size;
+		r.error = FALSE;
+		attr = table->attrs;
+		while(!r.error && (code = readULEB(&r)) != 0){
+			abbrev = NULL;
+			if(pass == 0){
+				if(code > maxCode) maxCode = code;
+			}else{
+				abbrev = &table->abbrevs[code];
+				abbrev->tag = (uint16_t)readULEB(&r);
+				abbrev->hasChildren = readU(&r, 1) != 0;
+				abbrev->fixedSize = 0;
+				abbrev->attrs = attr;
+				abbrev->attrCount = 0;
+			}
+			if(pass == 0){
+				readULEB(&r);
+				readU(&r, 1);
+			}
+			for(;;){
+				name = readULEB(&r);
+				form = readULEB(&r);
+				if(r.error || (name == 0 && form == 0)) break;
+				if(pass == 0){
+					if(form == DW_FORM_implicit_const) readSLEB(&r);
+					attrTotal++;
+					continue;
+				}
+				attr->name = (uint16_t)name;
+				attr->form = (uint16_t)form;
+				attr->implicitConst = form == DW_FORM_implicit_const ? readSLEB(&r) : 0;
+				size = formSize(unit, (unsigned int)form);
+				if(size < 0 || abbrev->fixedSize < 0){
+					abbrev->fixedSize = -1;
+				}else{
+					abbrev->fixedSize += size;
+				}
+				abbrev->attrCount++;
+				attr++;
+			}
+		}
+		if(r.error) return FALSE;
+		if(pass == 0){
+			// 代码一般从1开始连续编号
+			if(maxCode > 0x100000) return FALSE;
+			table->count = maxCode + 1;
+			table->abbrevs = calloc(table->count, sizeof(struct abbrev));
+			table->attrs = malloc((attrTotal ? attrTotal : 1) * sizeof(struct abbrevAttr));
+			if(table->abbrevs == NULL || table->attrs == NULL) return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+static void freeAbbrevs(struct abbrevTable *table){
+	free(table->abbrevs);
+	free(table->attrs);
+	table->abbrevs = NULL;
+	table->attrs = NULL;
+}
+
+/**
+ * 解析单元头
+ */
+static BOOL parseUnitHeader(struct symbols *syms, uint64_t offset, struct dwarfUnit *unit){
+	struct reader r;
+	uint64_t length;
+	uint8_t unitType = 0;
+	if(offset >= syms->info.size) return FALSE;
+	r.pos = syms->info.data + offset;
+	r.end = syms->info.data + syms->info.size;
+	r.error = FALSE;
+	unit->offset = offset;
+	unit->offsetSize = 4;
+	length = readU(&r, 4);
+	if(length == 0xFFFFFFFF){
+		unit->offsetSize = 8;
+		length = readU(&r, 8);
+	}
+	if(r.error || length > (uint64_t)(r.end - r.pos)) return FALSE;
+	unit->end = (r.pos - syms->info.data) + length;
+	r.end = syms->info.data + unit->end;
+	unit->version = (uint16_t)readU(&r, 2);
+	if(unit->version < 2 || unit->version > 5) return FALSE;
+	if(unit->version >= 5){
+		unitType = (uint8_t)readU(&r, 1);
+		unit->addrSize = (uint8_t)readU(&r, 1);
+		unit->abbrevOffset = readU(&r, unit->offsetSize);
+		if(unitType == DW_UT_skeleton || unitType == DW_UT_split_compile){
+			skipBytes(&r, 8);
+		}else if(unitType == DW_UT_type || unitType == DW_UT_split_type){
+			skipBytes(&r, 8 + unit->offsetSize);
+		}
+	}else{
+		unit->abbrevOffset = readU(&r, unit->offsetSize);
+		unit->addrSize = (uint8_t)readU(&r, 1);
+	}
+	unit->dieStart = r.pos - syms->info.data;
+	unit->strOffsetsBase = unit->offsetSize == 8 ? 16 : 8;	// 没有DW_AT_str_offsets_base时跳过.debug_str_offsets的头
+	return !r.error && (unit->addrSize == 4 || unit->addrSize == 8);
+}
+
+static const struct abbrev *nextAbbrev(const struct dwarfUnit *unit, struct reader *r, uint64_t *code){
+	*code = readULEB(r);
+	if(*code == 0 || r->error) return NULL;
+	if(*code >= unit->abbrevs.count || unit->abbrevs.abbrevs[*code].tag == 0){
+		r->error = TRUE;
+		return NULL;
+	}
+	return &unit->abbrevs.abbrevs[*code];
+}
+
+static void skipAttrs(struct symbols *syms, const struct dwarfUnit *unit, const struct abbrev *abbrev, struct reader *r){
+	struct formValue value;
+	unsigned int i;
+	if(abbrev->fixedSize >= 0){
+		skipBytes(r, abbrev->fixedSize);
+		return;
+	}
+	for(i = 0; i < abbrev->attrCount && !r->error; i++){
+		readForm(syms, unit, abbrev->attrs[i].form, abbrev->attrs[i].implicitConst, r, &value);
+	}
+}
+
+/**
+ * 解析offset处的DIE
+ * 返回:
+ * 	FALSE:数据错误;DIE为空项时die->tag为0
+ */
+static BOOL readDie(struct symbols *syms, const struct dwarfUnit *unit, uint64_t offset, struct dwarfDie *die){
+	const struct abbrev *abbrev;
+	struct formValue value;
+	struct reader r;
+	uint64_t code;
+	unsigned int i;
+	memset(die, 0x0, sizeof(struct dwarfDie));
+	if(offset < unit->dieStart || offset >= unit->end) return FALSE;
+	r.pos = syms->info.data + offset;
+	r.end = syms->info.data + unit->end;
+	r.error = FALSE;
+	die->offset = offset;
+	abbrev = nextAbbrev(unit, &r, &code);
+	if(abbrev == NULL){
+		die->end = r.pos - syms->info.data;
+		return !r.error;
+	}
+	die->tag = abbrev->tag;
+	die->hasChildren = abbrev->hasChildren;
+	for(i = 0; i < abbrev->attrCount && !r.error; i++){
+		readForm(syms, unit, abbrev->attrs[i].form, abbrev->attrs[i].implicitConst, &r, &value);
+		switch(abbrev->attrs[i].name){
+		case DW_AT_name:
+			die->name = value.str;
+			break;
+		case DW_AT_type:
+			die->type = value.u;
+			break;
+		case DW_AT_sibling:
+			die->sibling = value.u;
+			break;
+		case DW_AT_byte_size:
+			die->byteSize = value.u;
+			die->hasByteSize = value.block == NULL;
+			break;
+		case DW_AT_bit_size:
+			die->bitSize = value.u;
+			break;
+		case DW_AT_bit_offset:
+			die->bitOffset = value.u;
+			die->hasBitOffset = TRUE;
+			break;
+		case DW_AT_data_bit_offset:
+			die->dataBitOffset = value.u;
+			die->hasDataBitOffset = TRUE;
+			break;
+		case DW_AT_data_member_location:
+			if(value.block){
+				// DW_OP_plus_uconst
+				struct reader expr = {value.block, value.block + value.blockLength, FALSE};
+				if(readU(&expr, 1) == DW_OP_plus_uconst){
+					die->memberOffset = readULEB(&expr);
+					die->hasMemberOffset = !expr.error;
+				}
+			}else{
+				die->memberOffset = value.u;
+				die->hasMemberOffset = TRUE;
+			}
+			break;
+		case DW_AT_upper_bound:
+			die->upperBound = abbrev->attrs[i].form == DW_FORM_data1 ? (int8_t)value.u
+					: abbrev->attrs[i].form == DW_FORM_data2 ? (int16_t)value.u
+					: abbrev->attrs[i].form == DW_FORM_data4 ? (int32_t)value.u : (int64_t)value.u;
+			die->hasUpperBound = value.block == NULL;
+			break;
+		case DW_AT_count:
+			die->count = value.u;
+			die->hasCount = value.block == NULL;
+			break;
+		case DW_AT_encoding:
+			die->encoding = value.u;
+			break;
+		case DW_AT_declaration:
+			die->declaration = value.u != 0;
+			break;
+		case DW_AT_const_value:
+			die->negativeConst = (abbrev->attrs[i].form == DW_FORM_sdata || abbrev->attrs[i].form == DW_FORM_implicit_const)
+					&& (int64_t)value.u < 0;
+			break;
+		case DW_AT_specification:
+			die->specification = value.u;
+			break;
+		case DW_AT_str_offsets_base:
+			die->strOffsetsBase = value.u;
+			die->hasStrOffsetsBase = TRUE;
+			break;
+		case DW_AT_location:
+			// 只处理固定地址:DW_OP_addr
+			if(value.block && value.blockLength == 1u + unit->addrSize && value.block[0] == DW_OP_addr){
+				struct reader expr = {value.block + 1, value.block + value.blockLength, FALSE};
+				die->location = readU(&expr, unit->addrSize);
+				die->hasLocation = TRUE;
+			}
+			break;
+		}
+	}
+	die->end = r.pos - syms->info.data;
+	return !r.error;
+}
+
+/**
+ * 跳过DIE的所有子DIE,返回下一个兄弟DIE的偏移
+ */
+static uint64_t dieSibling(struct symbols *syms, const struct dwarfUnit *unit, const struct dwarfDie *die){
+	const struct abbrev *abbrev;
+	struct reader r;
+	uint64_t code;
+	unsigned int depth = 1;
+	if(!die->hasChildren) return die->end;
+	if(die->sibling > die->offset && die->sibling <= unit->end) return die->sibling;
+	r.pos = syms->info.data + die->end;
+	r.end = syms->info.data + unit->end;
+	r.error = FALSE;
+	while(depth > 0 && !r.error){
+		abbrev = nextAbbrev(unit, &r, &code);
+		if(abbrev == NULL){
+			depth--;
+			continue;
+		}
+		skipAttrs(syms, unit, abbrev, &r);
+		if(abbrev->hasChildren) depth++;
+	}
+	return r.error ? unit->end : (uint64_t)(r.pos - syms->info.data);
+}
+
+/**
+ * 解析单元头、缩写表和str_offsets_base
+ */
+static BOOL openUnit(struct symbols *syms, struct dwarfUnit *unit, uint64_t offset){
+	struct dwarfDie die;
+	if(parseUnitHeader(syms, offset, unit) == FALSE || parseAbbrevs(syms, unit) == FALSE){
+		freeAbbrevs(&unit->abbrevs);
+		return FALSE;
+	}
+	// 编译单元DIE中的str_offsets_base决定了strx的解码,先用不含strx的方式读取
+	if(readDie(syms, unit, unit->dieStart, &die) && die.hasStrOffsetsBase){
+		unit->strOffsetsBase = die.strOffsetsBase;
+	}
+	return TRUE;
+}
+
+/**
+ * 获得offset所在的编译单元,第一次访问时解析
+ */
+static struct dwarfUnit *unitForOffset(struct symbols *syms, uint64_t offset){
+	unsigned int low = 0, high = syms->header->unitCount, mid;
+	struct dwarfUnit *unit;
+	if(high == 0) return NULL;
+	// 找到最后一个起始偏移不大于offset的单元
+	while(high - low > 1){
+		mid = (low + high) / 2;
+		if(syms->unitOffsets[mid] <= offset){
+			low = mid;
+		}else{
+			high = mid;
+		}
+	}
+	if(syms->unitOffsets[low] > offset) return NULL;
+	unit = &syms->units[low];
+	if(!unit->ready){
+		if(openUnit(syms, unit, syms->unitOffsets[low]) == FALSE){
+			return NULL;
+		}
+		unit->ready = TRUE;
+		syms->decodedUnits++;
+	}
+	return offset < unit->end ? unit : NULL;
+}
+
+/******************************* 建立索引 *******************************/
+struct indexBuilder {
+	struct indexEntry *entries;
+	unsigned int entryCount, entryCapacity;
+	uint32_t *table;	// 按名字散列,保存entries的索引+1
+	unsigned int tableSize;
+	char *strings;
+	size_t stringsSize, stringsCapacity;
+	uint64_t *units;
+	unsigned int unitCount, unitCapacity;
+	// 当前单元中带名字的声明,用于DW_AT_specification
+	struct {
+		uint64_t offset;
+		const char *name;
+	} *decls;
+	unsigned int declCount, declCapacity;
+	BOOL failed;
+};
+
+static BOOL growArray(struct indexBuilder *builder, void **array, unsigned int *capacity, unsigned int count, size_t size){
+	unsigned int newCapacity;
+	void *data;
+	if(count < *capacity) return TRUE;
+	newCapacity = *capacity ? *capacity * 2 : 256;
+	data = realloc(*array, (size_t)newCapacity * size);
+	if(data == NULL){
+		builder->failed = TRUE;
+		return FALSE;
+	}
+	*array = data;
+	*capacity = newCapacity;
+	return TRUE;
+}
+
+static uint32_t nameHash(const char *name){
+	return (uint32_t)misc_Hash64(name, strlen(name), 0);
+}
+
+/**
+ * 按名字查找或者新建符号
+ * 返回:
+ * 	符号的索引,失败返回-1
+ */
+static int builderFind(struct indexBuilder *builder, const char *name, BOOL *created){
+	uint32_t idx, mask;
+	unsigned int i;
+	size_t len;
+	*created = FALSE;
+	if((builder->entryCount + 1) * 2 > builder->tableSize){
+		unsigned int size = builder->tableSize ? builder->tableSize * 2 : 4096;
+		uint32_t *table = calloc(size, sizeof(uint32_t));
+		if(table == NULL){
+			builder->failed = TRUE;
+			return -1;
+		}
+		for(i = 0; i < builder->entryCount; i++){
+			idx = nameHash(builder->strings + builder->entries[i].name) & (size - 1);
+			while(table[idx]) idx = (idx + 1) & (size - 1);
+			table[idx] = i + 1;
+		}
+		free(builder->table);
+		builder->table = table;
+		builder->tableSize = size;
+	}
+	mask = builder->tableSize - 1;
+	for(idx = nameHash(name) & mask; builder->table[idx]; idx = (idx + 1) & mask){
+		i = builder->table[idx] - 1;
+		if(strcmp(builder->strings + builder->entries[i].name, name) == 0) return (int)i;
+	}
+	if(growArray(builder, (void **)&builder->entries, &builder->entryCapacity, builder->entryCount, sizeof(struct indexEntry)) == FALSE){
+		return -1;
+	}
+	len = strlen(name) + 1;
+	while(builder->stringsSize + len > builder->stringsCapacity){
+		size_t capacity = builder->stringsCapacity ? builder->stringsCapacity * 2 : 65536;
+		char *strings = realloc(builder->strings, capacity);
+		if(strings == NULL){
+			builder->failed = TRUE;
+			return -1;
+		}
+		builder->strings = strings;
+		builder->stringsCapacity = capacity;
+	}
+	i = builder->entryCount++;
+	memset(&builder->entries[i], 0x0, sizeof(struct indexEntry));
+	builder->entries[i].name = (uint32_t)builder->stringsSize;
+	memcpy(builder->strings + builder->stringsSize, name, len);
+	builder->stringsSize += len;
+	builder->table[idx] = i + 1;
+	*created = TRUE;
+	return (int)i;
+}
+
+/**
+ * 加入.symtab中的符号
+ * 同名时全局符号优先
+ */
+static void builderAddSymbol(struct indexBuilder *builder, const char *name, uint64_t addr, uint64_t size, uint32_t flags){
+	BOOL created;
+	int idx = builderFind(builder, name, &created);
+	struct indexEntry *entry;
+	if(idx < 0) return;
+	entry = &builder->entries[idx];
+	if(created || ((flags & SYMBOL_FLAG_GLOBAL) && !(entry->flags & SYMBOL_FLAG_GLOBAL))){
+		entry->addr = addr;
+		entry->size = size;
+		entry->flags = (entry->flags & SYMBOL_FLAG_DECLARATION) | flags | SYMBOL_FLAG_ADDRESS;
+	}
+}
+
+/**
+ * 加入DWARF中的变量
+ * 同名的符号地址不同时是另一个文件中的静态变量,不关联;定义优先于声明
+ */
+static void builderAddVariable(struct indexBuilder *builder, const char *name, uint64_t die, const struct dwarfDie *var){
+	BOOL created;
+	int idx = builderFind(builder, name, &created);
+	struct indexEntry *entry;
+	if(idx < 0) return;
+	entry = &builder->entries[idx];
+	if(created){
+		entry->flags = SYMBOL_FLAG_OBJECT;
+	}
+	if(var->hasLocation && (entry->flags & SYMBOL_FLAG_ADDRESS) && entry->addr != var->location){
+		return;
+	}
+	if(entry->die == 0 || ((entry->flags & SYMBOL_FLAG_DECLARATION) && !var->declaration)){
+		entry->die = die;
+		entry->flags &= ~SYMBOL_FLAG_DECLARATION;
+		if(var->declaration) entry->flags |= SYMBOL_FLAG_DECLARATION;
+	}
+	if(!(entry->flags & SYMBOL_FLAG_ADDRESS) && var->hasLocation){
+		entry->addr = var->location;
+		entry->flags |= SYMBOL_FLAG_ADDRESS;
+	}
+}
+
+static const char *findDecl(struct indexBuilder *builder, uint64_t offset){
+	unsigned int low = 0, high = builder->declCount, mid;
+	while(low < high){
+		mid = (low + high) / 2;
+		if(builder->decls[mid].offset == offset) return builder->decls[mid].name;
+		if(builder->decls[mid].offset < offset){
+			low = mid + 1;
+		}else{
+			high = mid;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * 扫描编译单元顶层的变量
+ * 其他顶层DIE的子树用DW_AT_sibling或者定长属性快速跳过
+ */
+static BOOL scanUnit(struct symbols *syms, struct indexBuilder *builder, struct dwarfUnit *unit){
+	const struct abbrev *abbrev;
+	struct dwarfDie die;
+	struct reader r;
+	uint64_t offset, code;
+	unsigned int depth;
+	const char *name;
+	if(readDie(syms, unit, unit->dieStart, &die) == FALSE) return FALSE;
+	if(!die.hasChildren) return TRUE;
+	builder->declCount = 0;
+	offset = die.end;
+	depth = 1;
+	r.end = syms->info.data + unit->end;
+	r.error = FALSE;
+	while(depth > 0 && offset < unit->end){
+		r.pos = syms->info.data + offset;
+		abbrev = nextAbbrev(unit, &r, &code);
+		if(abbrev == NULL){
+			if(r.error) return FALSE;
+			offset = r.pos - syms->info.data;
+			depth--;
+			continue;
+		}
+		if(depth == 1 && (abbrev->tag == DW_TAG_variable || abbrev->hasChildren)){
+			if(readDie(syms, unit, offset, &die) == FALSE) return FALSE;
+			if(die.tag == DW_TAG_variable){
+				name = die.name ? die.name : (die.specification ? findDecl(builder, die.specification) : NULL);
+				if(name && die.declaration && die.name
+						&& growArray(builder, (void **)&builder->decls, &builder->declCapacity, builder->declCount, sizeof(builder->decls[0]))){
+					builder->decls[builder->declCount].offset = offset;
+					builder->decls[builder->declCount].name = name;
+					builder->declCount++;
+				}
+				if(name){
+					builderAddVariable(builder, name, offset, &die);
+				}
+			}
+			offset = dieSibling(syms, unit, &die);
+			continue;
+		}
+		skipAttrs(syms, unit, abbrev, &r);
+		if(r.error) return FALSE;
+		offset = r.pos - syms->info.data;
+		if(abbrev->hasChildren) depth++;
+	}
+	return TRUE;
+}
+
+/**
+ * 扫描所有编译单元
+ */
+static void scanDwarf(struct symbols *syms, struct indexBuilder *builder){
+	struct dwarfUnit unit;
+	uint64_t offset = 0;
+	while(offset < syms->info.size && !builder->failed){
+		memset(&unit, 0x0, sizeof(struct dwarfUnit));
+		if(parseUnitHeader(syms, offset, &unit) == FALSE){
+			log_warn("Invalid DWARF unit at 0x%" PRIX64 ", stop scanning.", offset);
+			break;
+		}
+		if(growArray(builder, (void **)&builder->units, &builder->unitCapacity, builder->unitCount, sizeof(uint64_t)) == FALSE) break;
+		builder->units[builder->unitCount++] = offset;
+		if(openUnit(syms, &unit, offset) == FALSE || scanUnit(syms, builder, &unit) == FALSE){
+			log_warn("Invalid DWARF data in unit at 0x%" PRIX64 ".", offset);
+		}
+		freeAbbrevs(&unit.abbrevs);
+		offset = unit.end;
+	}
+}
+
+/**
+ * 读取.symtab
+ */
+static void scanSymtab(BOOL is64, uint16_t machine, const struct elfSection *symtab,
+		const struct elfSection *strtab, struct indexBuilder *builder){
+	uint64_t count, i, addr, size;
+	unsigned int type, bind, shndx;
+	uint32_t nameOffset, flags;
+	const char *name;
+	struct elfSection strings = *strtab;
+	count = symtab->size / (is64 ? sizeof(Elf64_Sym) : sizeof(Elf32_Sym));
+	for(i = 1; i < count && !builder->failed; i++){
+		if(is64){
+			Elf64_Sym sym;
+			memcpy(&sym, symtab->data + i * sizeof(Elf64_Sym), sizeof(sym));
+			nameOffset = sym.st_name; addr = sym.st_value; size = sym.st_size;
+			type = ELF64_ST_TYPE(sym.st_info); bind = ELF64_ST_BIND(sym.st_info); shndx = sym.st_shndx;
+		}else{
+			Elf32_Sym sym;
+			memcpy(&sym, symtab->data + i * sizeof(Elf32_Sym), sizeof(sym));
+			nameOffset = sym.st_name; addr = sym.st_value; size = sym.st_size;
+			type = ELF32_ST_TYPE(sym.st_info); bind = ELF32_ST_BIND(sym.st_info); shndx = sym.st_shndx;
+		}
+		if(shndx == SHN_UNDEF) continue;
+		if(type == STT_FUNC){
+			flags = SYMBOL_FLAG_FUNCTION;
+			// Thumb函数地址的最低位是1
+			if(machine == EM_ARM) addr &= ~1ull;
+		}else if(type == STT_OBJECT || type == STT_COMMON){
+			flags = SYMBOL_FLAG_OBJECT;
+		}else{
+			continue;
+		}
+		name = sectionString(&strings, nameOffset);
+		if(name == NULL || name[0] == '\0') continue;
+		if(bind == STB_GLOBAL || bind == STB_WEAK) flags |= SYMBOL_FLAG_GLOBAL;
+		builderAddSymbol(builder, name, addr, size, flags);
+	}
+}
+
+/**
+ * 生成索引
+ */
+static uint8_t *buildIndex(struct indexBuilder *builder, const struct indexHeader *source, size_t *length){
+	struct indexHeader *header;
+	struct indexEntry *entries;
+	struct indexHash *hash;
+	uint64_t *units;
+	uint32_t hashSize = 16, mask, idx, h;
+	size_t stringsSize = (builder->stringsSize + 8) & ~(size_t)7, size;
+	unsigned int i;
+	uint8_t *image;
+	while(hashSize < builder->entryCount * 2) hashSize <<= 1;
+	mask = hashSize - 1;
+	size = sizeof(struct indexHeader) + (size_t)builder->entryCount * sizeof(struct indexEntry)
+			+ (size_t)builder->unitCount * sizeof(uint64_t) + (size_t)hashSize * sizeof(struct indexHash) + stringsSize;
+	image = calloc(1, size);
+	if(image == NULL) return NULL;
+	header = CAST(struct indexHeader *, image);
+	*header = *source;
+	header->entryCount = builder->entryCount;
+	header->unitCount = builder->unitCount;
+	header->hashSize = hashSize;
+	header->stringsSize = (uint32_t)stringsSize;
+	entries = CAST(struct indexEntry *, header + 1);
+	units = CAST(uint64_t *, entries + builder->entryCount);
+	hash = CAST(struct indexHash *, units + builder->unitCount);
+	if(builder->entryCount){
+		memcpy(entries, builder->entries, (size_t)builder->entryCount * sizeof(struct indexEntry));
+	}
+	if(builder->unitCount){
+		memcpy(units, builder->units, (size_t)builder->unitCount * sizeof(uint64_t));
+	}
+	memset(hash, 0xFF, (size_t)hashSize * sizeof(struct indexHash));
+	for(i = 0; i < builder->entryCount; i++){
+		h = nameHash(builder->strings + entries[i].name);
+		for(idx = h & mask; hash[idx].index != INDEX_HASH_EMPTY; idx = (idx + 1) & mask);
+		hash[idx].hash = h;
+		hash[idx].index = i;
+	}
+	if(builder->stringsSize){
+		memcpy(hash + hashSize, builder->strings, builder->stringsSize);
+	}
+	*length = size;
+	return image;
+}
+
+/**
+ * 检查索引并建立指针
+ */
+static BOOL attachIndex(struct symbols *syms, const uint8_t *image, size_t length, const struct indexHeader *expect){
+	const struct indexHeader *header = CAST(const struct indexHeader *, image);
+	size_t size;
+	if(length < sizeof(struct indexHeader)) return FALSE;
+	if(header->magic != SYMBOLS_INDEX_MAGIC || header->version != SYMBOLS_INDEX_VERSION
+			|| header->mtime != expect->mtime || header->fileSize != expect->fileSize || header->elfHash != expect->elfHash){
+		return FALSE;
+	}
+	if(header->hashSize == 0 || (header->hashSize & (header->hashSize - 1)) != 0 || header->stringsSize == 0) return FALSE;
+	size = sizeof(struct indexHeader) + (size_t)header->entryCount * sizeof(struct indexEntry)
+			+ (size_t)header->unitCount * sizeof(uint64_t) + (size_t)header->hashSize * sizeof(struct indexHash) + header->stringsSize;
+	if(size != length) return FALSE;
+	syms->index = image;
+	syms->indexSize = length;
+	syms->header = header;
+	syms->entries = CAST(const struct indexEntry *, header + 1);
+	syms->unitOffsets = CAST(const uint64_t *, syms->entries + header->entryCount);
+	syms->hash = CAST(const struct indexHash *, syms->unitOffsets + header->unitCount);
+	syms->strings = CAST(const char *, syms->hash + header->hashSize);
+	return syms->strings[header->stringsSize - 1] == '\0';
+}
+
+/**
+ * 解析ELF文件头和节头,找到符号表和调试信息节
+ */
+static BOOL parseElf(struct symbols *syms, struct indexHeader *expect, struct elfSection *symtab, struct elfSection *strtab, BOOL *is64, uint16_t *machine){
+	const uint8_t *file = syms->map;
+	uint64_t shoff, offset, size, flags;
+	unsigned int shentsize, shnum, shstrndx, idx, type, link, nameOffset, symtabLink = 0;
+	struct elfSection shstrtab, *target;
+	const char *name;
+	if(syms->mapSize < EI_NIDENT || memcmp(file, ELFMAG, SELFMAG) != 0){
+		log_error("Not an ELF file!");
+		return FALSE;
+	}
+	if(file[EI_DATA] != ELFDATA2LSB){
+		log_error("Only little-endian ELF files are supported!");
+		return FALSE;
+	}
+	*is64 = file[EI_CLASS] == ELFCLASS64;
+	if(*is64 && syms->mapSize >= sizeof(Elf64_Ehdr)){
+		Elf64_Ehdr ehdr;
+		memcpy(&ehdr, file, sizeof(ehdr));
+		shoff = ehdr.e_shoff; shentsize = ehdr.e_shentsize; shnum = ehdr.e_shnum; shstrndx = ehdr.e_shstrndx;
+		*machine = ehdr.e_machine;
+		if(shentsize < sizeof(Elf64_Shdr)) goto BAD_ELF;
+	}else if(file[EI_CLASS] == ELFCLASS32 && syms->mapSize >= sizeof(Elf32_Ehdr)){
+		Elf32_Ehdr ehdr;
+		memcpy(&ehdr, file, sizeof(ehdr));
+		shoff = ehdr.e_shoff; shentsize = ehdr.e_shentsize; shnum = ehdr.e_shnum; shstrndx = ehdr.e_shstrndx;
+		*machine = ehdr.e_machine;
+		if(shentsize < sizeof(Elf32_Shdr)) goto BAD_ELF;
+	}else{
+		goto BAD_ELF;
+	}
+	if(shoff > syms->mapSize || (uint64_t)shentsize * shnum > syms->mapSize - shoff || shstrndx >= shnum){
+		goto BAD_ELF;
+	}
+	// 缓存的索引用ELF文件头和节头表校验
+	expect->elfHash = misc_Hash64(file, *is64 ? sizeof(Elf64_Ehdr) : sizeof(Elf32_Ehdr), 0);
+	expect->elfHash = misc_Hash64(file + shoff, (size_t)shentsize * shnum, expect->elfHash);
+	// 两遍:第一遍找到节名字符串表
+	shstrtab.data = NULL;
+	shstrtab.size = 0;
+	for(idx = 0; idx < shnum; idx++){
+		if(*is64){
+			Elf64_Shdr shdr;
+			memcpy(&shdr, file + shoff + (uint64_t)idx * shentsize, sizeof(shdr));
+			nameOffset = shdr.sh_name; type = shdr.sh_type; offset = shdr.sh_offset; size = shdr.sh_size; flags = shdr.sh_flags; link = shdr.sh_link;
+		}else{
+			Elf32_Shdr shdr;
+			memcpy(&shdr, file + shoff + (uint64_t)idx * shentsize, sizeof(shdr));
+			nameOffset = shdr.sh_name; type = shdr.sh_type; offset = shdr.sh_offset; size = shdr.sh_size; flags = shdr.sh_flags; link = shdr.sh_link;
+		}
+		if(type == SHT_NOBITS) size = 0;
+		if(offset > syms->mapSize || size > syms->mapSize - offset) goto BAD_ELF;
+		if(shstrtab.data == NULL){
+			if(idx != shstrndx) continue;
+			shstrtab.data = file + offset;
+			shstrtab.size = size;
+			idx = (unsigned int)-1;	// 重新开始
+			continue;
+		}
+		name = sectionString(&shstrtab, nameOffset);
+		if(name == NULL) continue;
+		target = NULL;
+		if(type == SHT_SYMTAB){
+			symtab->data = file + offset;
+			symtab->size = size;
+			symtabLink = link;
+			continue;
+		}
+		if(strcmp(name, ".debug_info") == 0) target = &syms->info;
+		else if(strcmp(name, ".debug_abbrev") == 0) target = &syms->abbrev;
+		else if(strcmp(name, ".debug_str") == 0) target = &syms->str;
+		else if(strcmp(name, ".debug_line_str") == 0) target = &syms->lineStr;
+		else if(strcmp(name, ".debug_str_offsets") == 0) target = &syms->strOffsets;
+		if(target == NULL) continue;
+		if(flags & SHF_COMPRESSED){
+			log_warn("Compressed section %s is not supported.", name);
+			continue;
+		}
+		target->data = file + offset;
+		target->size = size;
+	}
+	// 符号表关联的字符串表
+	if(symtab->data && symtabLink < shnum){
+		if(*is64){
+			Elf64_Shdr shdr;
+			memcpy(&shdr, file + shoff + (uint64_t)symtabLink * shentsize, sizeof(shdr));
+			strtab->data = file + shdr.sh_offset; strtab->size = shdr.sh_size;
+		}else{
+			Elf32_Shdr shdr;
+			memcpy(&shdr, file + shoff + (uint64_t)symtabLink * shentsize, sizeof(shdr));
+			strtab->data = file + shdr.sh_offset; strtab->size = shdr.sh_size;
+		}
+	}
+	if(syms->info.data == NULL || syms->abbrev.data == NULL){
+		syms->info.data = NULL;
+		syms->info.size = 0;
+	}
+	return TRUE;
+BAD_ELF:
+	log_error("Invalid ELF file!");
+	return FALSE;
+}
+
+/**
+ * 索引缓存文件名,由ELF文件的绝对路径决定
+ */
+static void cacheName(const char *path, char *name, size_t size){
+	char real[PATH_MAX];
+	const char *key = realpath(path, real) ? real : path;
+	snprintf(name, size, "sym-%016" PRIx64 ".idx", misc_Hash64(key, strlen(key), 0));
+}
+
+/**
+ * symbols_Load 加载ELF文件的符号
+ */
+Symbols symbols_Load(const char *path){
+	assert(path != NULL);
+	struct indexBuilder builder;
+	struct indexHeader expect;
+	struct elfSection symtab = {NULL, 0}, strtab = {NULL, 0};
+	struct symbols *syms;
+	struct stat fileStat;
+	const void *cached;
+	uint8_t *image;
+	size_t length;
+	char name[64];
+	uint16_t machine = 0;
+	BOOL is64 = FALSE;
+	void *map;
+	int fd;
+	fd = open(path, O_RDONLY);
+	if(fd < 0){
+		log_error("Failed to open %s: %s.", path, strerror(errno));
+		return NULL;
+	}
+	if(fstat(fd, &fileStat) != 0 || fileStat.st_size == 0){
+		log_error("Failed to get the size of %s or it is empty.", path);
+		close(fd);
+		return NULL;
+	}
+	map = mmap(NULL, (size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED){
+		log_error("Failed to map %s: %s.", path, strerror(errno));
+		return NULL;
+	}
+	syms = calloc(1, sizeof(struct symbols));
+	if(syms == NULL){
+		log_error("Failed to allocate symbols object!");
+		munmap(map, (size_t)fileStat.st_size);
+		return NULL;
+	}
+	syms->map = map;
+	syms->mapSize = (size_t)fileStat.st_size;
+	memset(&expect, 0x0, sizeof(struct indexHeader));
+	expect.magic = SYMBOLS_INDEX_MAGIC;
+	expect.version = SYMBOLS_INDEX_VERSION;
+	expect.mtime = (int64_t)fileStat.st_mtime;
+	expect.fileSize = (uint64_t)fileStat.st_size;
+	if(parseElf(syms, &expect, &symtab, &strtab, &is64, &machine) == FALSE){
+		goto ERROR;
+	}
+	cacheName(path, name, sizeof(name));
+	if(misc_CacheMap(name, &cached, &length) == TRUE){
+		if(attachIndex(syms, cached, length, &expect)){
+			syms->indexMapped = TRUE;
+			log_debug("Loaded symbol index of %s from cache.", path);
+		}else{
+			misc_CacheUnmap(cached, length);
+			syms->index = NULL;
+		}
+	}
+	if(syms->index == NULL){
+		memset(&builder, 0x0, sizeof(struct indexBuilder));
+		if(symtab.data){
+			scanSymtab(is64, machine, &symtab, &strtab, &builder);
+		}
+		if(syms->info.data){
+			scanDwarf(syms, &builder);
+		}
+		image = builder.failed ? NULL : buildIndex(&builder, &expect, &length);
+		free(builder.entries);
+		free(builder.table);
+		free(builder.strings);
+		free(builder.units);
+		free(builder.decls);
+		if(image == NULL){
+			log_error("Failed to build symbol index: not enough memory.");
+			goto ERROR;
+		}
+		if(attachIndex(syms, image, length, &expect) == FALSE){
+			free(image);
+			goto ERROR;
+		}
+		if(misc_CacheStore(name, image, length) == FALSE){
+			log_debug("Failed to store symbol index of %s.", path);
+		}
+		log_info("Indexed %s: %u symbols, %u units.", path, syms->header->entryCount, syms->header->unitCount);
+	}
+	syms->units = calloc(syms->header->unitCount ? syms->header->unitCount : 1, sizeof(struct dwarfUnit));
+	if(syms->units == NULL){
+		goto ERROR;
+	}
+	return syms;
+ERROR:
+	symbols_Free(&syms);
+	return NULL;
+}
+
+/**
+ * symbols_Free 释放符号对象
+ */
+void symbols_Free(Symbols *symsPtr){
+	assert(symsPtr != NULL && *symsPtr != NULL);
+	struct symbols *syms = *symsPtr;
+	struct typeNode *node, *nextNode;
+	struct pathCache *path, *nextPath;
+	unsigned int i;
+	if(syms->units){
+		for(i = 0; i < syms->header->unitCount; i++){
+			freeAbbrevs(&syms->units[i].abbrevs);
+		}
+		free(syms->units);
+	}
+	for(node = syms->typeNodes; node; node = nextNode){
+		nextNode = node->next;
+		free(node->members);
+		free(node->name);
+		free(node);
+	}
+	free(syms->typeSlots);
+	for(i = 0; i < syms->pathBucketCount; i++){
+		for(path = syms->paths[i]; path; path = nextPath){
+			nextPath = path->next;
+			free(path);
+		}
+	}
+	free(syms->paths);
+	free(syms->functions);
+	if(syms->index){
+		if(syms->indexMapped){
+			misc_CacheUnmap(syms->index, syms->indexSize);
+		}else{
+			free(CAST(void *, syms->index));
+		}
+	}
+	munmap(CAST(void *, syms->map), syms->mapSize);
+	free(syms);
+	*symsPtr = NULL;
+}
+
+/**
+ * symbols_Info 获得统计信息
+ */
+void symbols_Info(Symbols syms, unsigned int *symbolCount, unsigned int *unitCount, unsigned int *decodedUnits, unsigned int *typeCount){
+	assert(syms != NULL);
+	if(symbolCount) *symbolCount = syms->header->entryCount;
+	if(unitCount) *unitCount = syms->header->unitCount;
+	if(decodedUnits) *decodedUnits = syms->decodedUnits;
+	if(typeCount) *typeCount = syms->typeCount;
+}
+
+/******************************* 类型 *******************************/
+static const struct indexEntry *findEntry(struct symbols *syms, const char *name){
+	uint32_t h = nameHash(name), mask = syms->header->hashSize - 1, idx;
+	for(idx = h & mask; syms->hash[idx].index != INDEX_HASH_EMPTY; idx = (idx + 1) & mask){
+		if(syms->hash[idx].hash == h && syms->hash[idx].index < syms->header->entryCount
+				&& strcmp(syms->strings + syms->entries[syms->hash[idx].index].name, name) == 0){
+			return &syms->entries[syms->hash[idx].index];
+		}
+	}
+	return NULL;
+}
+
+static const struct symbolType *typeLookup(struct symbols *syms, uint64_t offset){
+	uint32_t mask, idx;
+	if(syms->typeSlotCount == 0) return NULL;
+	mask = syms->typeSlotCount - 1;
+	for(idx = (uint32_t)(offset * 0x9E3779B97F4A7C15ull >> 32) & mask; syms->typeSlots[idx].offset; idx = (idx + 1) & mask){
+		if(syms->typeSlots[idx].offset == offset) return syms->typeSlots[idx].type;
+	}
+	return NULL;
+}
+
+static void typeInsert(struct symbols *syms, uint64_t offset, const struct symbolType *type){
+	struct typeSlot *slots;
+	uint32_t mask, idx;
+	unsigned int i, count;
+	if((syms->typeCount + 1) * 2 > syms->typeSlotCount){
+		count = syms->typeSlotCount ? syms->typeSlotCount * 2 : 1024;
+		slots = calloc(count, sizeof(struct typeSlot));
+		if(slots == NULL) return;	// 只是不缓存
+		for(i = 0; i < syms->typeSlotCount; i++){
+			if(syms->typeSlots[i].offset == 0) continue;
+			for(idx = (uint32_t)(syms->typeSlots[i].offset * 0x9E3779B97F4A7C15ull >> 32) & (count - 1); slots[idx].offset; idx = (idx + 1) & (count - 1));
+			slots[idx] = syms->typeSlots[i];
+		}
+		free(syms->typeSlots);
+		syms->typeSlots = slots;
+		syms->typeSlotCount = count;
+	}
+	mask = syms->typeSlotCount - 1;
+	for(idx = (uint32_t)(offset * 0x9E3779B97F4A7C15ull >> 32) & mask; syms->typeSlots[idx].offset; idx = (idx + 1) & mask);
+	syms->typeSlots[idx].offset = offset;
+	syms->typeSlots[idx].type = type;
+	syms->typeCount++;
+}
+
+static struct typeNode *newType(struct symbols *syms, enum symbolTypeKind kind){
+	struct typeNode *node = calloc(1, sizeof(struct typeNode));
+	if(node == NULL) return NULL;
+	node->type.kind = kind;
+	node->type.name = "";
+	node->next = syms->typeNodes;
+	syms->typeNodes = node;
+	return node;
+}
+
+static void setTypeName(struct typeNode *node, const char *format, const char *a, const char *b){
+	size_t len = strlen(format) + strlen(a) + strlen(b) + 1;
+	node->name = malloc(len);
+	if(node->name){
+		snprintf(node->name, len, format, a, b);
+		node->type.name = node->name;
+	}
+}
+
+static const struct symbolType *decodeType(struct symbols *syms, uint64_t offset, unsigned int depth);
+
+/**
+ * 结构体和联合的成员
+ */
+static BOOL decodeMembers(struct symbols *syms, const struct dwarfUnit *unit, const struct dwarfDie *parent, struct typeNode *node){
+	struct symbolMember *members = NULL, *member, *grown;
+	unsigned int count = 0, capacity = 0;
+	struct dwarfDie die;
+	uint64_t offset = parent->end, bitPos;
+	while(offset < unit->end){
+		if(readDie(syms, unit, offset, &die) == FALSE) break;
+		if(die.tag == 0) break;
+		offset = dieSibling(syms, unit, &die);
+		if(die.tag != DW_TAG_member) continue;
+		if(count == capacity){
+			capacity = capacity ? capacity * 2 : 16;
+			grown = realloc(members, capacity * sizeof(struct symbolMember));
+			if(grown == NULL){
+				free(members);
+				return FALSE;
+			}
+			members = grown;
+		}
+		member = &members[count++];
+		member->name = die.name;
+		member->typeRef = die.type;
+		member->offset = die.hasMemberOffset ? die.memberOffset : 0;
+		member->bitOffset = 0;
+		member->bitSize = 0;
+		if(die.bitSize > 0 && die.bitSize <= 64){
+			if(die.hasDataBitOffset){
+				bitPos = die.dataBitOffset;
+			}else if(die.hasBitOffset){
+				// DWARF2/3:从存储单元的最高位开始计数
+				uint64_t storage = die.hasByteSize ? die.byteSize : 4;
+				bitPos = member->offset * 8 + storage * 8 - die.bitOffset - die.bitSize;
+			}else{
+				bitPos = member->offset * 8;
+			}
+			member->offset = bitPos / 8;
+			member->bitOffset = bitPos % 8;
+			member->bitSize = (uint8_t)die.bitSize;
+		}
+	}
+	node->members = members;
+	node->type.members = members;
+	node->type.memberCount = count;
+	return TRUE;
+}
+
+/**
+ * 数组类型,多维数组拆成嵌套的一维数组
+ */
+static const struct symbolType *decodeArray(struct symbols *syms, const struct dwarfUnit *unit, const struct dwarfDie *parent, unsigned int depth){
+	uint64_t dims[8], offset = parent->end;
+	unsigned int dimCount = 0, i, d;
+	const struct symbolType *element, *base;
+	struct typeNode *node = NULL;
+	struct dwarfDie die;
+	char suffix[8 * 24], *pos;
+	element = decodeType(syms, parent->type, depth + 1);
+	if(element == NULL) return NULL;
+	base = element;
+	while(parent->hasChildren && offset < unit->end && dimCount < 8){
+		if(readDie(syms, unit, offset, &die) == FALSE || die.tag == 0) break;
+		offset = dieSibling(syms, unit, &die);
+		if(die.tag != DW_TAG_subrange_type) continue;
+		if(die.hasCount){
+			dims[dimCount++] = die.count;
+		}else if(die.hasUpperBound){
+			dims[dimCount++] = die.upperBound >= 0 ? (uint64_t)die.upperBound + 1 : 0;
+		}else{
+			dims[dimCount++] = 0;
+		}
+	}
+	if(dimCount == 0) dims[dimCount++] = 0;
+	// 从最内层开始
+	for(i = dimCount; i-- > 0; ){
+		node = newType(syms, SymbolType_Array);
+		if(node == NULL) return NULL;
+		node->type.count = dims[i];
+		node->type.size = dims[i] * element->size;
+		node->target = element;
+		// 名字用最外层元素的类型名,例如"int[2][3]"
+		for(pos = suffix, suffix[0] = '\0', d = i; d < dimCount; d++){
+			pos += snprintf(pos, suffix + sizeof(suffix) - pos, "[%" PRIu64 "]", dims[d]);
+		}
+		setTypeName(node, "%s%s", base->name, suffix);
+		element = &node->type;
+	}
+	if(parent->hasByteSize) node->type.size = parent->byteSize;
+	return &node->type;
+}
+
+/**
+ * 解码offset处的类型DIE,结果按偏移缓存
+ * 结构体成员的类型和指针指向的类型不在这里递归解码
+ */
+static const struct symbolType *decodeType(struct symbols *syms, uint64_t offset, unsigned int depth){
+	const struct symbolType *type, *target;
+	const struct dwarfUnit *unit;
+	struct typeNode *node = NULL;
+	struct dwarfDie die;
+	if(offset == 0) return &voidType.type;
+	if((type = typeLookup(syms, offset)) != NULL) return type;
+	if(depth > 32) return NULL;
+	unit = unitForOffset(syms, offset);
+	if(unit == NULL || readDie(syms, unit, offset, &die) == FALSE || die.tag == 0) return NULL;
+	switch(die.tag){
+	case DW_TAG_base_type:
+		node = newType(syms, SymbolType_Base);
+		if(node == NULL) return NULL;
+		node->type.name = die.name ? die.name : "";
+		node->type.size = die.byteSize;
+		switch(die.encoding){
+		case DW_ATE_boolean: node->type.encoding = SymbolEncoding_Bool; break;
+		case DW_ATE_float: node->type.encoding = SymbolEncoding_Float; break;
+		case DW_ATE_signed: case DW_ATE_signed_char: node->type.encoding = SymbolEncoding_Signed; break;
+		default: node->type.encoding = SymbolEncoding_Unsigned; break;
+		}
+		break;
+	case DW_TAG_const_type: case DW_TAG_volatile_type: case DW_TAG_restrict_type: case DW_TAG_atomic_type:
+		// 修饰符不影响访问方式
+		type = decodeType(syms, die.type, depth + 1);
+		if(type) typeInsert(syms, offset, type);
+		return type;
+	case DW_TAG_typedef:
+		target = decodeType(syms, die.type, depth + 1);
+		if(target == NULL) return NULL;
+		node = newType(syms, target->kind);
+		if(node == NULL) return NULL;
+		node->type = *target;
+		node->type.name = die.name ? die.name : target->name;
+		if(target != &voidType.type){
+			node->targetRef = CAST(const struct typeNode *, target)->targetRef;
+			node->target = CAST(const struct typeNode *, target)->target;
+		}
+		break;
+	case DW_TAG_pointer_type: case DW_TAG_reference_type: case DW_TAG_rvalue_reference_type:
+		node = newType(syms, SymbolType_Pointer);
+		if(node == NULL) return NULL;
+		node->type.size = die.hasByteSize ? die.byteSize : unit->addrSize;
+		node->targetRef = die.type;
+		// 先登记,指向自身的类型不会无限递归
+		typeInsert(syms, offset, &node->type);
+		target = decodeType(syms, die.type, depth + 1);
+		node->target = target;
+		setTypeName(node, "%s%s", target ? target->name : "void", " *");
+		return &node->type;
+	case DW_TAG_structure_type: case DW_TAG_class_type: case DW_TAG_union_type:
+		node = newType(syms, die.tag == DW_TAG_union_type ? SymbolType_Union : SymbolType_Struct);
+		if(node == NULL) return NULL;
+		node->type.size = die.byteSize;
+		setTypeName(node, "%s %s", die.tag == DW_TAG_union_type ? "union" : "struct", die.name ? die.name : "<anonymous>");
+		if(die.hasChildren && decodeMembers(syms, unit, &die, node) == FALSE) return NULL;
+		break;
+	case DW_TAG_enumeration_type:
+		node = newType(syms, SymbolType_Enum);
+		if(node == NULL) return NULL;
+		node->type.size = die.hasByteSize ? die.byteSize : 4;
+		target = die.type ? decodeType(syms, die.type, depth + 1) : NULL;
+		if(target){
+			node->type.encoding = target->encoding;
+		}else if(die.hasChildren){
+			// DWARF4之前没有底层类型,有负数枚举值时按有符号处理
+			struct dwarfDie child;
+			uint64_t childOffset = die.end;
+			node->type.encoding = SymbolEncoding_Unsigned;
+			while(childOffset < unit->end && readDie(syms, unit, childOffset, &child) && child.tag != 0){
+				if(child.tag == DW_TAG_enumerator && child.negativeConst){
+					node->type.encoding = SymbolEncoding_Signed;
+					break;
+				}
+				childOffset = dieSibling(syms, unit, &child);
+			}
+		}
+		setTypeName(node, "%s %s", "enum", die.name ? die.name : "<anonymous>");
+		break;
+	case DW_TAG_array_type:
+		type = decodeArray(syms, unit, &die, depth);
+		if(type) typeInsert(syms, offset, type);
+		return type;
+	case DW_TAG_subroutine_type:
+		node = newType(syms, SymbolType_Function);
+		if(node == NULL) return NULL;
+		node->type.name = "function";
+		break;
+	default:
+		node = newType(syms, SymbolType_Unknown);
+		if(node == NULL) return NULL;
+		node->type.name = die.name ? die.name : "unknown";
+		node->type.size = die.byteSize;
+		break;
+	}
+	typeInsert(syms, offset, &node->type);
+	return &node->type;
+}
+
+/**
+ * symbols_Target 获得指针指向的类型或者数组元素的类型
+ */
+const struct symbolType *symbols_Target(Symbols syms, const struct symbolType *type){
+	struct typeNode *node;
+	assert(syms != NULL && type != NULL);
+	if(type->kind != SymbolType_Pointer && type->kind != SymbolType_Array) return NULL;
+	node = container_of(type, struct typeNode, type);
+	if(node->target == NULL && node->targetRef){
+		node->target = decodeType(syms, node->targetRef, 0);
+	}
+	return node->target ? node->target : &voidType.type;
+}
+
+/**
+ * symbols_MemberType 获得成员的类型
+ */
+const struct symbolType *symbols_MemberType(Symbols syms, const struct symbolMember *member){
+	assert(syms != NULL && member != NULL);
+	return decodeType(syms, member->typeRef, 0);
+}
+
+/******************************* 路径 *******************************/
+/**
+ * 查找成员,匿名结构体和联合的成员也可以直接访问
+ * offset:累加成员的偏移
+ */
+static const struct symbolMember *findMember(struct symbols *syms, const struct symbolType *type, const char *name, size_t len, uint64_t *offset, unsigned int depth){
+	const struct symbolMember *member, *found;
+	const struct symbolType *sub;
+	unsigned int i;
+	for(i = 0; i < type->memberCount; i++){
+		member = &type->members[i];
+		if(member->name && strncmp(member->name, name, len) == 0 && member->name[len] == '\0'){
+			*offset += member->offset;
+			return member;
+		}
+	}
+	if(depth > 8) return NULL;
+	for(i = 0; i < type->memberCount; i++){
+		member = &type->members[i];
+		if(member->name) continue;
+		sub = symbols_MemberType(syms, member);
+		if(sub == NULL || (sub->kind != SymbolType_Struct && sub->kind != SymbolType_Union)) continue;
+		found = findMember(syms, sub, name, len, offset, depth + 1);
+		if(found){
+			*offset += member->offset;
+			return found;
+		}
+	}
+	return NULL;
+}
+
+static void cachePath(struct symbols *syms, const char *path, uint64_t hash, const struct symbolLocation *location){
+	struct pathCache *entry, **buckets, *next;
+	unsigned int i, count;
+	size_t len = strlen(path) + 1;
+	if(syms->pathCount >= syms->pathBucketCount){
+		count = syms->pathBucketCount ? syms->pathBucketCount * 2 : 256;
+		buckets = calloc(count, sizeof(struct pathCache *));
+		if(buckets == NULL) return;
+		for(i = 0; i < syms->pathBucketCount; i++){
+			for(entry = syms->paths[i]; entry; entry = next){
+				next = entry->next;
+				entry->next = buckets[entry->hash & (count - 1)];
+				buckets[entry->hash & (count - 1)] = entry;
+			}
+		}
+		free(syms->paths);
+		syms->paths = buckets;
+		syms->pathBucketCount = count;
+	}
+	entry = malloc(sizeof(struct pathCache) + len);
+	if(entry == NULL) return;
+	entry->hash = hash;
+	entry->location = *location;
+	memcpy(entry->path, path, len);
+	entry->next = syms->paths[hash & (syms->pathBucketCount - 1)];
+	syms->paths[hash & (syms->pathBucketCount - 1)] = entry;
+	syms->pathCount++;
+}
+
+/**
+ * symbols_Resolve 解析变量路径
+ */
+BOOL symbols_Resolve(Symbols syms, const char *path, struct symbolLocation *location){
+	const struct indexEntry *entry;
+	const struct symbolMember *member;
+	const struct symbolType *type = NULL;
+	struct symbolLocation result;
+	struct pathCache *cached;
+	struct dwarfUnit *unit;
+	struct dwarfDie die;
+	uint64_t hash, offset, index;
+	char name[256], *end;
+	const char *pos;
+	size_t len;
+	assert(syms != NULL && path != NULL && location != NULL);
+	hash = misc_Hash64(path, strlen(path), 0);
+	if(syms->pathBucketCount){
+		for(cached = syms->paths[hash & (syms->pathBucketCount - 1)]; cached; cached = cached->next){
+			if(cached->hash == hash && strcmp(cached->path, path) == 0){
+				*location = cached->location;
+				return TRUE;
+			}
+		}
+	}
+	len = strcspn(path, ".[");
+	if(len == 0 || len >= sizeof(name)) return FALSE;
+	memcpy(name, path, len);
+	name[len] = '\0';
+	entry = findEntry(syms, name);
+	if(entry == NULL || !(entry->flags & SYMBOL_FLAG_ADDRESS)) return FALSE;
+	memset(&result, 0x0, sizeof(struct symbolLocation));
+	result.addr = entry->addr;
+	result.size = entry->size;
+	if(entry->die && (unit = unitForOffset(syms, entry->die)) != NULL && readDie(syms, unit, entry->die, &die)){
+		// 定义中没有类型时从DW_AT_specification指向的声明中获得
+		if(die.type == 0 && die.specification && (unit = unitForOffset(syms, die.specification)) != NULL){
+			readDie(syms, unit, die.specification, &die);
+		}
+		if(die.type){
+			type = decodeType(syms, die.type, 0);
+		}
+	}
+	result.type = type;
+	if(type && type->size) result.size = type->size;
+	for(pos = path + len; *pos; ){
+		if(result.bitSize) return FALSE;	// 位域之后不能再有路径
+		if(*pos == '.'){
+			pos++;
+			len = strcspn(pos, ".[");
+			if(len == 0 || type == NULL || (type->kind != SymbolType_Struct && type->kind != SymbolType_Union)) return FALSE;
+			offset = 0;
+			member = findMember(syms, type, pos, len, &offset, 0);
+			if(member == NULL) return FALSE;
+			type = symbols_MemberType(syms, member);
+			if(type == NULL) return FALSE;
+			result.addr += offset;
+			result.size = type->size;
+			if(member->bitSize){
+				result.bitOffset = member->bitOffset;
+				result.bitSize = member->bitSize;
+				result.size = (member->bitOffset + member->bitSize + 7) / 8;
+			}
+			pos += len;
+		}else if(*pos == '['){
+			index = strtoull(pos + 1, &end, 0);
+			if(end == pos + 1 || *end != ']' || type == NULL || type->kind != SymbolType_Array) return FALSE;
+			if(type->count && index >= type->count) return FALSE;
+			type = symbols_Target(syms, type);
+			if(type == NULL) return FALSE;
+			result.addr += index * type->size;
+			result.size = type->size;
+			pos = end + 1;
+		}else{
+			return FALSE;
+		}
+		result.type = type;
+	}
+	cachePath(syms, path, hash, &result);
+	*location = result;
+	return TRUE;
+}
+
+/******************************* 地址查找 *******************************/
+// 同一地址的多个函数(别名)全局符号优先,再按名字排序,保证结果确定
+static int compareFunction(const void *a, const void *b){
+	const struct functionRange *funcA = a, *funcB = b;
+	if(funcA->addr != funcB->addr) return funcA->addr < funcB->addr ? -1 : 1;
+	if(funcA->global != funcB->global) return funcA->global ? -1 : 1;
+	return strcmp(funcA->name, funcB->name);
+}
+
+/**
+ * 从索引中取出所有函数,按地址排序
+ * 同一地址只保留一个;没有大小的函数(汇编)延伸到下一个函数的起始地址
+ */
+static BOOL buildFunctions(struct symbols *syms){
+	const struct indexEntry *entry;
+	struct functionRange *functions;
+	unsigned int idx, count = 0, kept = 0;
+	for(idx = 0; idx < syms->header->entryCount; idx++){
+		entry = &syms->entries[idx];
+		if((entry->flags & (SYMBOL_FLAG_FUNCTION | SYMBOL_FLAG_ADDRESS)) == (SYMBOL_FLAG_FUNCTION | SYMBOL_FLAG_ADDRESS)) count++;
+	}
+	if(count == 0) return TRUE;
+	functions = malloc(count * sizeof(struct functionRange));
+	if(functions == NULL){
+		log_error("Failed to allocate the function table.");
+		return FALSE;
+	}
+	for(idx = 0, count = 0; idx < syms->header->entryCount; idx++){
+		entry = &syms->entries[idx];
+		if((entry->flags & (SYMBOL_FLAG_FUNCTION | SYMBOL_FLAG_ADDRESS)) != (SYMBOL_FLAG_FUNCTION | SYMBOL_FLAG_ADDRESS)) continue;
+		functions[count].addr = entry->addr;
+		functions[count].end = entry->addr + entry->size;
+		functions[count].name = syms->strings + entry->name;
+		functions[count].global = (entry->flags & SYMBOL_FLAG_GLOBAL) != 0;
+		count++;
+	}
+	qsort(functions, count, sizeof(struct functionRange), compareFunction);
+	for(idx = 0; idx < count; idx++){
+		if(kept && functions[kept - 1].addr == functions[idx].addr){
+			if(functions[idx].end > functions[kept - 1].end) functions[kept - 1].end = functions[idx].end;
+			continue;
+		}
+		functions[kept++] = functions[idx];
+	}
+	for(idx = 0; idx < kept; idx++){
+		if(functions[idx].end > functions[idx].addr) continue;
+		functions[idx].end = idx + 1 < kept ? functions[idx + 1].addr : functions[idx].addr + 1;
+	}
+	syms->functions = functions;
+	syms->functionCount = kept;
+	return TRUE;
+}
+
+/**
+ * symbols_Function 查找地址所在的函数
+ */
+BOOL symbols_Function(Symbols syms, uint64_t addr, const char **name, uint64_t *offset){
+	unsigned int low, high, mid;
+	assert(syms != NULL);
+	if(!syms->functionsReady){
+		if(buildFunctions(syms) == FALSE) return FALSE;
+		syms->functionsReady = TRUE;
+	}
+	// 找到最后一个起始地址不大于addr的函数
+	low = 0;
+	high = syms->functionCount;
+	while(low < high){
+		mid = low + (high - low) / 2;
+		if(syms->functions[mid].addr <= addr){
+			low = mid + 1;
+		}else{
+			high = mid;
+		}
+	}
+	if(low == 0 || addr >= syms->functions[low - 1].end) return FALSE;
+	if(name) *name = syms->functions[low - 1].name;
+	if(offset) *offset = addr - syms->functions[low - 1].addr;
+	return TRUE;
+}
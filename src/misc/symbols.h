@@ -0,0 +1,146 @@
+/*
+ * symbols.h
+ *
+ *  Created on: 2019-7-5
+ *      Author: virusv
+ */
+
+#ifndef SRC_MISC_SYMBOLS_H_
+#define SRC_MISC_SYMBOLS_H_
+
+#include "smart_ocd.h"
+
+/**
+ * ELF符号和DWARF类型信息
+ * ELF文件通过mmap映射。加载时建立符号索引:.symtab中的变量和函数,以及每个编译单元顶层的
+ * DW_TAG_variable,按名字散列。索引保存在磁盘缓存目录中,ELF文件的修改时间、大小和节头不变时直接映射。
+ * 类型信息在第一次访问时才解码,每个编译单元的缩写表只在访问该单元时解析,解码过的类型和路径都会缓存,
+ * 同一个路径第二次解析只有一次散列表查找。
+ * 只支持小端ELF,不支持压缩的调试信息节和分离的调试信息文件(.dwo)
+ */
+
+/**
+ * 类型的种类
+ */
+enum symbolTypeKind {
+	SymbolType_Unknown = 0,	// void或者不支持的类型
+	SymbolType_Base,		// 基本类型
+	SymbolType_Enum,		// 枚举
+	SymbolType_Pointer,		// 指针
+	SymbolType_Struct,		// 结构体
+	SymbolType_Union,		// 联合
+	SymbolType_Array,		// 数组
+	SymbolType_Function,	// 函数
+};
+
+/**
+ * 基本类型和枚举的编码
+ */
+enum symbolEncoding {
+	SymbolEncoding_Unsigned = 0,
+	SymbolEncoding_Signed,
+	SymbolEncoding_Float,
+	SymbolEncoding_Bool,
+};
+
+/**
+ * 结构体和联合的成员
+ */
+struct symbolMember {
+	const char *name;	// 匿名成员为NULL
+	uint64_t offset;	// 相对结构体起始地址的字节偏移
+	uint8_t bitOffset;	// 位域在offset处的小端数据中的最低位
+	uint8_t bitSize;	// 位域宽度,0表示不是位域
+	uint64_t typeRef;	// 成员类型,用symbols_MemberType获得
+};
+
+/**
+ * 类型
+ */
+struct symbolType {
+	enum symbolTypeKind kind;
+	const char *name;	// 类型名,例如"unsigned int","struct stats","uint8_t *"
+	uint64_t size;	// 字节数
+	enum symbolEncoding encoding;	// 基本类型和枚举的编码
+	uint64_t count;	// 数组元素个数,0表示长度未知
+	unsigned int memberCount;	// 结构体和联合的成员数
+	const struct symbolMember *members;
+};
+
+/**
+ * 路径解析的结果
+ */
+struct symbolLocation {
+	uint64_t addr;	// 地址
+	uint64_t size;	// 字节数,位域为包含该位域的字节数
+	const struct symbolType *type;	// 类型,没有调试信息时为NULL
+	uint8_t bitOffset;	// 位域的最低位
+	uint8_t bitSize;	// 位域宽度,0表示不是位域
+};
+
+typedef struct symbols *Symbols;
+
+/**
+ * symbols_Load 加载ELF文件的符号
+ * 参数:
+ * 	path:ELF文件路径
+ * 返回:
+ * 	符号对象,失败返回NULL
+ */
+Symbols symbols_Load(const char *path);
+
+/**
+ * symbols_Free 释放符号对象
+ */
+void symbols_Free(Symbols *syms);
+
+/**
+ * symbols_Info 获得统计信息
+ * 参数:
+ * 	symbolCount:索引中的符号数
+ * 	unitCount:编译单元数
+ * 	decodedUnits:已经解码的编译单元数
+ * 	typeCount:已经解码的类型数
+ */
+void symbols_Info(Symbols syms, unsigned int *symbolCount, unsigned int *unitCount, unsigned int *decodedUnits, unsigned int *typeCount);
+
+/**
+ * symbols_Resolve 解析变量路径
+ * 路径由变量名开始,后面是任意个".成员"和"[下标]",例如"g_stats.rx_count","table[3].name"
+ * 匿名结构体和联合的成员可以直接访问。不会经过指针,指针指向的数据需要先读出指针的值
+ * 参数:
+ * 	path:路径
+ * 	location:解析结果
+ * 返回:
+ * 	TRUE:成功
+ * 	FALSE:符号不存在或者路径无效
+ */
+BOOL symbols_Resolve(Symbols syms, const char *path, struct symbolLocation *location);
+
+/**
+ * symbols_Target 获得指针指向的类型或者数组元素的类型
+ * 返回:
+ * 	类型,其他种类的类型或者解码失败返回NULL
+ */
+const struct symbolType *symbols_Target(Symbols syms, const struct symbolType *type);
+
+/**
+ * symbols_MemberType 获得成员的类型
+ */
+const struct symbolType *symbols_MemberType(Symbols syms, const struct symbolMember *member);
+
+/**
+ * symbols_Function 查找地址所在的函数
+ * 使用.symtab中的函数符号,第一次调用时按地址排序,之后每次查找是一次二分查找。
+ * 同一地址有多个名字时(例如弱别名)全局符号优先
+ * 参数:
+ * 	addr:地址,Thumb函数不需要设置最低位
+ * 	name:函数名
+ * 	offset:addr相对函数起始地址的偏移
+ * 返回:
+ * 	TRUE:成功
+ * 	FALSE:地址不在任何函数中
+ */
+BOOL symbols_Function(Symbols syms, uint64_t addr, const char **name, uint64_t *offset);
+
+#endif /* SRC_MISC_SYMBOLS_H_ */
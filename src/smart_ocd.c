@@ -30,6 +30,7 @@ static const struct option long_option[]={
    {"file", required_argument, NULL, 'f'},
    {"debuglevel", required_argument, NULL, 'd'},
    {"exit", no_argument, NULL, 'e'},
+   {"allocator", required_argument, NULL, 'a'},
    {NULL, 0, NULL, 0}
 };
 static lua_State *globalL = NULL;
@@ -61,6 +62,7 @@ static void printHelp(char *progName) {
 			"\t-f script, --file script : Pre-executed script, this parameter can be more than one.\n"
 			"\t-e, --exit : End of the script does not enter the interactive mode.\n"
 			"\t-l, --logfile : Log file.\n"
+			"\t-a name, --allocator name : Lua memory allocator, pool(default) or system.\n"
 			"\t-h, --help : Show this help message.\n\n"
 			"For more information, visit: https://github.com/Virus-V/SmartOCD/\n");
 }
@@ -124,8 +126,8 @@ static int msghandler (lua_State *L) {
  */
 static int handleScript (lua_State *L, char *script) {
 	int status;
-	// FIXME luaL_loadfile这个函数使用script时是否会其进行拷贝？
-	status = luaL_loadfile(L, script);
+	// 使用缓存的字节码
+	status = LuaApiLoadFile(L, script);
 	if (status == LUA_OK) {
 		// 错误处理handle
 		lua_pushcfunction(L, msghandler);
@@ -359,7 +361,7 @@ static int init (lua_State *L) {
 	// LOG默认静默模式
 	log_set_quiet(1);
 	// 解析参数
-	while((opt = getopt_long(argc, argv, "f:d:ehl:", long_option, NULL)) != -1) {
+	while((opt = getopt_long(argc, argv, "f:d:ehl:a:", long_option, NULL)) != -1) {
 		switch(opt) {
 		case 'f':	// 执行脚本
 			//log_debug("script name:%s", optarg);
@@ -387,6 +389,8 @@ static int init (lua_State *L) {
 				return 1;
 			}
 			break;
+		case 'a':	// 分配器在创建状态机之前已经选择
+			break;
 		default:; // 0 error: label at end of compound statement
 		}
 	}
@@ -404,6 +408,26 @@ EXIT:
 	return 1;
 }
 
+/**
+ * 在创建Lua状态机之前取得分配器参数 -a --allocator
+ */
+static const char *allocatorOption(int argc, char **argv){
+	int i;
+	for(i = 1; i < argc; i++){
+		if(strcmp(argv[i], "--") == 0) break;
+		if((strcmp(argv[i], "-a") == 0 || strcmp(argv[i], "--allocator") == 0) && i + 1 < argc){
+			return argv[i + 1];
+		}
+		if(strncmp(argv[i], "--allocator=", 12) == 0){
+			return argv[i] + 12;
+		}
+		if(strncmp(argv[i], "-a", 2) == 0 && argv[i][2] != '\0'){
+			return argv[i] + 2;
+		}
+	}
+	return NULL;
+}
+
 /**
  * SmartOCD Entry Point
  */
@@ -418,9 +442,9 @@ int main (int argc, char **argv) {
 	case 0:break;
 	}
 	// 创建lua状态机
-	lua_State *L = luaL_newstate();
+	lua_State *L = LuaApiNewState(allocatorOption(argc, argv));
 	if (L == NULL) {
-		log_fatal("cannot create state: not enough memory.");
+		log_fatal("cannot create state: unknown allocator or not enough memory.");
 		return 1;
 	}
 	// 以保护模式运行初始化函数，这些函数不会抛出异常。
@@ -434,6 +458,6 @@ int main (int argc, char **argv) {
 	// 打如果错误则打印
 	report(L, status);
 	result = lua_toboolean(L, -1);
-	lua_close(L);
+	LuaApiCloseState(L);
 	return (result && status == LUA_OK) ? 0 : 1;
 }
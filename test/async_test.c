@@ -0,0 +1,116 @@
+/*
+ * async_test.c
+ *
+ *  Created on: 2019-7-20
+ *      Author: virusv
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "smart_ocd.h"
+#include "misc/log.h"
+#include "api/api.h"
+#include "fake_adapter.h"
+
+extern void RegisterApi_Buffer(lua_State *L);
+extern void RegisterApi_Async(lua_State *L);
+extern void RegisterApi_ADIv5(lua_State *L);
+
+#define FAKE_ADAPTER_LUA_OBJECT_TYPE "adapter.Fake"
+
+static Adapter adapterObj;
+
+/**
+ * 暂停/恢复测试Adapter的DapCommit
+ * 1#:boolean
+ */
+static int hold(lua_State *L){
+	FakeAdapter_Hold(adapterObj, lua_toboolean(L, 1));
+	return 0;
+}
+
+/**
+ * 异步任务没有完成时,所有同步接口都要抛出错误;任务完成后恢复正常
+ */
+static const char *script =
+	"local adiv5 = require('ADIv5')\n"
+	"local dap = adiv5.Create(FakeAdapter)\n"
+	"local ap = dap:FindAccessPort(adiv5.AP_Memory, adiv5.Bus_AMBA_AHB)\n"
+	"ap:Memory32(0x100, 0x12345678)\n"
+	"local scan = ap:Scan(0x100, 64, '\\x78\\x56')\n"
+	"Hold(true)\n"
+	"local co = coroutine.create(function()\n"
+	"	return ap:BlockReadAsync(0x100, adiv5.AddrInc_Single, adiv5.DataSize_32, 4)\n"
+	"end)\n"
+	"local ok, job = coroutine.resume(co)\n"
+	"assert(ok and job and not job:Done(), 'the job should stay pending')\n"
+	"local calls = {\n"
+	"	FindAccessPort = function() return dap:FindAccessPort(adiv5.AP_Memory) end,\n"
+	"	ReadMemory = function() return dap:ReadMemory(0x100, 4) end,\n"
+	"	MemoryRegion = function() return dap:MemoryRegion(0, 0x1000) end,\n"
+	"	Memory8 = function() return ap:Memory8(0x100) end,\n"
+	"	Memory16 = function() return ap:Memory16(0x100) end,\n"
+	"	Memory32 = function() return ap:Memory32(0x100) end,\n"
+	"	CSW = function() return ap:CSW() end,\n"
+	"	Abort = function() return ap:Abort() end,\n"
+	"	ReadMany = function() return ap:ReadMany({0x100}) end,\n"
+	"	WriteMany = function() return ap:WriteMany({0x100}, {0}) end,\n"
+	"	BlockRead = function() return ap:BlockRead(0x100, adiv5.AddrInc_Single, adiv5.DataSize_32, 1) end,\n"
+	"	Verify = function() return ap:Verify(0x100, '\\0\\0\\0\\0') end,\n"
+	"	Search = function() return ap:Search(0x100, 4, 0) end,\n"
+	"	Scan = function() return scan() end,\n"
+	"	Fill = function() return ap:Fill(0x100, 4) end,\n"
+	"	DeltaWrite = function() return ap:DeltaWrite(0x100, '\\0\\0\\0\\0') end,\n"
+	"	WaitValue = function() return ap:WaitValue(0x100, 0, 0) end,\n"
+	"	ProbeTarWrap = function() return ap:ProbeTarWrap() end,\n"
+	"	TransferPolicy = function() return ap:TransferPolicy() end,\n"
+	"	WriteCombine = function() return ap:WriteCombine(true) end,\n"
+	"}\n"
+	"for name, call in pairs(calls) do\n"
+	"	local ok, err = pcall(call)\n"
+	"	assert(not ok and tostring(err):find('busy'), name .. ' did not reject the busy adapter: ' .. tostring(err))\n"
+	"end\n"
+	"Hold(false)\n"
+	"job:Wait()\n"
+	"local ok, data = coroutine.resume(co)\n"
+	"assert(ok and string.unpack('<I4', data) == 0x12345678)\n"
+	"assert(ap:Memory32(0x100) == 0x12345678)\n"
+	"assert(scan() == 0x100)\n";
+
+int main(){
+	lua_State *L;
+	struct fakeTarget *target;
+	int result;
+	log_set_level(LOG_INFO);
+	setenv("SMARTOCD_NO_CACHE", "1", 1);	// 不读写AP表的磁盘缓存
+	adapterObj = FakeAdapter_Create(&target);
+	if(adapterObj == NULL){
+		return 1;
+	}
+	L = luaL_newstate();
+	if(L == NULL){
+		log_fatal("cannot create state: not enough memory.");
+		return 1;
+	}
+	luaL_openlibs(L);
+	RegisterApi_Buffer(L);
+	RegisterApi_Async(L);
+	RegisterApi_ADIv5(L);
+	lua_register(L, "Hold", hold);
+	// Adapter对象
+	*CAST(Adapter *, lua_newuserdata(L, sizeof(Adapter))) = adapterObj;
+	luaL_newmetatable(L, FAKE_ADAPTER_LUA_OBJECT_TYPE);
+	lua_setmetatable(L, -2);
+	lua_setglobal(L, "FakeAdapter");
+
+	result = luaL_dostring(L, script);
+	if(result != LUA_OK){
+		log_error("%s", lua_tostring(L, -1));
+	}else{
+		log_info("Async busy check test passed.");
+	}
+	lua_close(L);
+	FakeAdapter_Destroy(&adapterObj);
+	return result == LUA_OK ? 0 : 1;
+}
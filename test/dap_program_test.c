@@ -0,0 +1,304 @@
+/*
+ * dap_program_test.c
+ *
+ *  Created on: 2019-7-21
+ *      Author: virusv
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "smart_ocd.h"
+#include "misc/log.h"
+#include "arch/ARM/ADI/include/ADIv5.h"
+#include "adapter/cmsis-dap/cmsis-dap.h"
+
+/**
+ * CMSIS-DAP数据包编码测试
+ * 用模拟的USB端点代替仿真器:解析发出的DAP_Transfer数据包,记录下来并按简单的寄存器模型应答
+ */
+
+#define test(fn) \
+	puts("... \x1b[33m" # fn "\x1b[0m"); \
+	test_##fn();
+
+#define PACKET_SIZE	64
+#define MAX_PACKETS	64
+
+static struct {
+	uint8_t packets[MAX_PACKETS][PACKET_SIZE];	// 发出的数据包
+	int lengths[MAX_PACKETS];
+	int packetCount;
+	uint8_t resp[PACKET_SIZE];
+	uint32_t dp[4], ap[4];	// 按A[3:2]保存的寄存器
+	uint32_t drwCounter;	// 每次读AP DRW返回的值,读一次加1
+	long transfers;	// 执行的transfer个数
+	long failAt;	// 执行到第几个transfer时返回FAULT,-1表示不出错
+	uint32_t abortValue;	// 最后一次DAP_WriteABORT的值
+	int aborts;
+	uint32_t matchMask;	// Match Mask写入的掩码
+} dev;
+
+static uint32_t getWord(const uint8_t *data){
+	return data[0] | (uint32_t)data[1] << 8 | (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24;
+}
+
+static void putWord(uint8_t *data, uint32_t value){
+	data[0] = value & 0xFF;
+	data[1] = (value >> 8) & 0xFF;
+	data[2] = (value >> 16) & 0xFF;
+	data[3] = (value >> 24) & 0xFF;
+}
+
+/**
+ * 执行一个DAP_Transfer数据包
+ */
+static void deviceTransfer(const uint8_t *data, int len){
+	int count = data[2], pos = 3, out = 3, done = 0;
+	uint8_t request, ack = CMDAP_TRANSFER_OK;
+	uint32_t *regs, value;
+	for(; done < count; done++){
+		assert(pos < len);
+		request = data[pos++];
+		regs = request & CMDAP_TRANSFER_APnDP ? dev.ap : dev.dp;
+		if(dev.failAt >= 0 && dev.transfers == dev.failAt){
+			ack = CMDAP_TRANSFER_FAULT;
+			break;
+		}
+		dev.transfers++;
+		if(request & CMDAP_TRANSFER_MATCH_MASK){
+			dev.matchMask = getWord(data + pos);
+			pos += 4;
+		}else if(request & CMDAP_TRANSFER_MATCH_VALUE){
+			// 带4字节期望值,不返回数据;不匹配时停止执行
+			value = getWord(data + pos);
+			pos += 4;
+			if((regs[(request >> 2) & 0x3] & dev.matchMask) != value){
+				ack = CMDAP_TRANSFER_MISMATCH | CMDAP_TRANSFER_OK;
+				break;
+			}
+		}else if(request & CMDAP_TRANSFER_RnW){
+			if((request & (CMDAP_TRANSFER_APnDP | 0xC)) == (CMDAP_TRANSFER_APnDP | 0xC)){
+				value = dev.drwCounter++;
+			}else{
+				value = regs[(request >> 2) & 0x3];
+			}
+			putWord(dev.resp + out, value);
+			out += 4;
+		}else{
+			regs[(request >> 2) & 0x3] = getWord(data + pos);
+			pos += 4;
+		}
+	}
+	assert(done < count || pos == len);
+	dev.resp[0] = CMDAP_ID_DAP_Transfer;
+	dev.resp[1] = done;
+	dev.resp[2] = ack;
+}
+
+static int usbWrite(USB self, unsigned char *data, int len, int timeout, int *transferred){
+	(void)self;
+	(void)timeout;
+	assert(len <= PACKET_SIZE);
+	*transferred = len;
+	memset(dev.resp, 0x0, sizeof(dev.resp));
+	switch(data[0]){
+	case CMDAP_ID_DAP_Transfer:
+		assert(dev.packetCount < MAX_PACKETS);
+		memcpy(dev.packets[dev.packetCount], data, len);
+		dev.lengths[dev.packetCount++] = len;
+		deviceTransfer(data, len);
+		break;
+	case CMDAP_ID_DAP_WriteABORT:
+		dev.abortValue = getWord(data + 2);
+		dev.aborts++;
+		dev.resp[0] = data[0];
+		dev.resp[1] = CMDAP_OK;
+		break;
+	default:
+		assert(0);
+	}
+	return USB_SUCCESS;
+}
+
+static int usbRead(USB self, unsigned char *data, int len, int timeout, int *transferred){
+	(void)self;
+	(void)timeout;
+	memcpy(data, dev.resp, len);
+	*transferred = len;
+	return USB_SUCCESS;
+}
+
+static void resetDevice(void){
+	memset(&dev, 0x0, sizeof(dev));
+	dev.failAt = -1;
+}
+
+/**
+ * 创建CMSIS-DAP对象,用模拟的端点代替USB读写
+ */
+static Adapter createAdapter(void){
+	Adapter adapter = CreateCmsisDap();
+	struct cmsis_dap *cmdapObj;
+	assert(adapter != NULL);
+	cmdapObj = container_of(adapter, struct cmsis_dap, adaperAPI);
+	cmdapObj->usbObj->Read = usbRead;
+	cmdapObj->usbObj->Write = usbWrite;
+	cmdapObj->PacketSize = PACKET_SIZE;
+	cmdapObj->respBuffer = malloc(PACKET_SIZE);
+	cmdapObj->currTransMode = ADPT_MODE_SWD;
+	assert(cmdapObj->respBuffer != NULL);
+	return adapter;
+}
+
+/**
+ * 编译的数据包布局:每个transfer一字节请求,写操作带4字节数据;按包长度和读数据长度分包
+ */
+static void test_program_layout(){
+	Adapter adapter = createAdapter();
+	static const uint32_t pattern[] = {0x11111111, 0x22222222};
+	uint32_t blockWrite[12], reads[32];
+	unsigned int readCount, writeCount, idx;
+	DapProgram program;
+	int packet;
+	resetDevice();
+	for(idx = 0; idx < 12; idx++) blockWrite[idx] = 0xB0000000 + idx;
+	// SELECT + TAR,20次读DRW,12次Block写DRW,4次循环写
+	assert(adapter->DapSingleWrite(adapter, ADPT_DAP_DP_REG, DP_REG_SELECT, 0x01000000) == ADPT_SUCCESS);
+	assert(adapter->DapSingleWrite(adapter, ADPT_DAP_AP_REG, AP_REG_TAR_LSB, 0x20000000) == ADPT_SUCCESS);
+	assert(adapter->DapMultiRead(adapter, ADPT_DAP_AP_REG, AP_REG_DRW, 20, reads) == ADPT_SUCCESS);
+	assert(adapter->DapMultiWrite(adapter, ADPT_DAP_AP_REG, AP_REG_DRW, 12, blockWrite) == ADPT_SUCCESS);
+	assert(adapter->DapPatternWrite(adapter, ADPT_DAP_AP_REG, AP_REG_DRW, 4, pattern, 2) == ADPT_SUCCESS);
+	assert(adapter->DapPrepare(adapter, &program, &readCount, &writeCount) == ADPT_SUCCESS);
+	assert(readCount == 20);
+	assert(writeCount == 2 + 12 + 4);
+	// 编译不发送任何数据,队列已经清空
+	assert(dev.packetCount == 0);
+	assert(adapter->DapCommit(adapter) == ADPT_SUCCESS);
+	assert(dev.packetCount == 0);
+
+	memset(reads, 0x0, sizeof(reads));
+	assert(adapter->DapRunProgram(adapter, program, NULL, reads) == ADPT_SUCCESS);
+	// 包0:两个写(10字节)+读,读数据最多(64-3)/4=15个字
+	assert(dev.packetCount == 3);
+	assert(dev.packets[0][0] == CMDAP_ID_DAP_Transfer && dev.packets[0][2] == 2 + 15);
+	assert(dev.packets[0][3] == (DP_REG_SELECT & 0xC));
+	assert(getWord(dev.packets[0] + 4) == 0x01000000);
+	assert(dev.packets[0][8] == (CMDAP_TRANSFER_APnDP | (AP_REG_TAR_LSB & 0xC)));
+	assert(getWord(dev.packets[0] + 9) == 0x20000000);
+	for(idx = 0; idx < 15; idx++){
+		assert(dev.packets[0][13 + idx] == (CMDAP_TRANSFER_APnDP | CMDAP_TRANSFER_RnW | AP_REG_DRW));
+	}
+	assert(dev.lengths[0] == 3 + 10 + 15);
+	// 包1:剩下5个读和前面的写,每个写5字节,(64-3-5)/5=11个写
+	assert(dev.packets[1][2] == 5 + 11);
+	assert(dev.lengths[1] == 3 + 5 + 11 * 5);
+	// 包2:剩下1个Block写和4个循环写
+	assert(dev.packets[2][2] == 1 + 4);
+	assert(getWord(dev.packets[2] + 4) == 0xB000000B);
+	for(idx = 0; idx < 4; idx++){
+		assert(getWord(dev.packets[2] + 9 + idx * 5) == pattern[idx & 0x1]);
+	}
+	for(packet = 0, idx = 0; packet < dev.packetCount; packet++){
+		idx += dev.packets[packet][2];
+	}
+	assert(idx == 2 + 20 + 12 + 4);
+	// 读到的数据按顺序返回
+	for(idx = 0; idx < 20; idx++){
+		assert(reads[idx] == idx);
+	}
+	adapter->DapFreeProgram(adapter, program);
+	DestroyCmsisDap(&adapter);
+}
+
+/**
+ * 传入写数据时替换编译时的数据,不传入时恢复编译时的数据
+ */
+static void test_program_writes(){
+	Adapter adapter = createAdapter();
+	uint32_t writes[2], reads[1];
+	DapProgram program;
+	resetDevice();
+	assert(adapter->DapSingleWrite(adapter, ADPT_DAP_AP_REG, AP_REG_TAR_LSB, 0x1000) == ADPT_SUCCESS);
+	assert(adapter->DapSingleRead(adapter, ADPT_DAP_DP_REG, DP_REG_CTRL_STAT, reads) == ADPT_SUCCESS);
+	assert(adapter->DapSingleWrite(adapter, ADPT_DAP_DP_REG, DP_REG_CTRL_STAT, 0x50000000) == ADPT_SUCCESS);
+	assert(adapter->DapPrepare(adapter, &program, NULL, NULL) == ADPT_SUCCESS);
+	writes[0] = 0x2000;
+	writes[1] = 0x12345678;
+	assert(adapter->DapRunProgram(adapter, program, writes, reads) == ADPT_SUCCESS);
+	assert(dev.ap[(AP_REG_TAR_LSB >> 2) & 0x3] == 0x2000);
+	assert(dev.dp[(DP_REG_CTRL_STAT >> 2) & 0x3] == 0x12345678);
+	assert(adapter->DapRunProgram(adapter, program, NULL, reads) == ADPT_SUCCESS);
+	assert(reads[0] == 0x12345678);	// 读在写之前
+	assert(dev.ap[(AP_REG_TAR_LSB >> 2) & 0x3] == 0x1000);
+	assert(dev.dp[(DP_REG_CTRL_STAT >> 2) & 0x3] == 0x50000000);
+	// 执行之前先提交队列中已有的操作
+	assert(adapter->DapSingleWrite(adapter, ADPT_DAP_DP_REG, DP_REG_SELECT, 0xF0) == ADPT_SUCCESS);
+	dev.packetCount = 0;
+	assert(adapter->DapRunProgram(adapter, program, NULL, reads) == ADPT_SUCCESS);
+	assert(dev.packetCount == 2);
+	assert(dev.packets[0][2] == 1 && dev.packets[0][3] == (DP_REG_SELECT & 0xC));
+	adapter->DapFreeProgram(adapter, program);
+	DestroyCmsisDap(&adapter);
+}
+
+/**
+ * 执行出错时停止发送后面的数据包,写ABORT清除错误标志
+ */
+static void test_program_fault(){
+	Adapter adapter = createAdapter();
+	uint32_t reads[40];
+	DapProgram program;
+	resetDevice();
+	assert(adapter->DapMultiRead(adapter, ADPT_DAP_AP_REG, AP_REG_DRW, 40, reads) == ADPT_SUCCESS);
+	assert(adapter->DapPrepare(adapter, &program, NULL, NULL) == ADPT_SUCCESS);
+	dev.failAt = 20;	// 第二个数据包中出错
+	assert(adapter->DapRunProgram(adapter, program, NULL, reads) == ADPT_FAILED);
+	assert(dev.packetCount == 2);
+	assert(dev.aborts == 1);
+	assert(dev.abortValue == (DP_ABORT_STKCMPCLR | DP_ABORT_STKERRCLR | DP_ABORT_WDERRCLR | DP_ABORT_ORUNERRCLR));
+	// 恢复之后可以再次执行
+	dev.failAt = -1;
+	dev.drwCounter = 100;
+	assert(adapter->DapRunProgram(adapter, program, NULL, reads) == ADPT_SUCCESS);
+	assert(reads[0] == 100 && reads[39] == 139);
+	adapter->DapFreeProgram(adapter, program);
+	DestroyCmsisDap(&adapter);
+}
+
+/**
+ * 值匹配:先写Match Mask,再用带期望值的Value Match读;不匹配时返回ADPT_ERR_MISMATCH
+ */
+static void test_value_match(){
+	Adapter adapter = createAdapter();
+	resetDevice();
+	dev.ap[(AP_REG_DRW >> 2) & 0x3] = 0x12345678;
+	assert(adapter->DapValueMatch(adapter, ADPT_DAP_AP_REG, AP_REG_DRW, 0x0000FFFF, 0x00005678) == ADPT_SUCCESS);
+	assert(adapter->DapCommit(adapter) == ADPT_SUCCESS);
+	assert(dev.packetCount == 1);
+	// 05 idx 02 | 20 mask | 1F value
+	assert(dev.lengths[0] == 3 + 5 + 5);
+	assert(dev.packets[0][0] == CMDAP_ID_DAP_Transfer && dev.packets[0][2] == 2);
+	assert(dev.packets[0][3] == CMDAP_TRANSFER_MATCH_MASK);
+	assert(getWord(dev.packets[0] + 4) == 0x0000FFFF);
+	assert(dev.packets[0][8] == (CMDAP_TRANSFER_APnDP | CMDAP_TRANSFER_RnW | CMDAP_TRANSFER_MATCH_VALUE | (AP_REG_DRW & 0xC)));
+	assert(dev.packets[0][8] == 0x1F);
+	assert(getWord(dev.packets[0] + 9) == 0x00005678);
+	// 不匹配不是传输错误,不写ABORT
+	assert(adapter->DapValueMatch(adapter, ADPT_DAP_AP_REG, AP_REG_DRW, 0xFFFFFFFF, 0x00005678) == ADPT_SUCCESS);
+	assert(adapter->DapCommit(adapter) == ADPT_ERR_MISMATCH);
+	assert(dev.packetCount == 2);
+	assert(dev.aborts == 0);
+	DestroyCmsisDap(&adapter);
+}
+
+int main(){
+	log_set_level(LOG_FATAL);
+	test(program_layout);
+	test(program_writes);
+	test(program_fault);
+	test(value_match);
+	puts("... \x1b[32m100%\x1b[0m\n");
+	return 0;
+}
@@ -0,0 +1,137 @@
+/*
+ * delta_test.c
+ *
+ *  Created on: 2019-7-21
+ *      Author: virusv
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "smart_ocd.h"
+#include "misc/log.h"
+#include "arch/ARM/ADI/include/ADIv5.h"
+#include "fake_adapter.h"
+
+/**
+ * 增量写入测试:只写不同的部分,结果和完整写入一致
+ */
+
+#define test(fn) \
+	puts("... \x1b[33m" # fn "\x1b[0m"); \
+	test_##fn();
+
+#define DELTA_BASE	0x20000u
+#define DELTA_SIZE	0x30000u	// 跨越多个64KB的窗口
+
+static Adapter adapterObj;
+static struct fakeTarget *target;
+static DAP dapObj;
+static AccessPort ahbAp, apbAp;
+static uint8_t image[DELTA_SIZE];
+
+static void fillImage(uint32_t seed){
+	unsigned int idx;
+	for(idx = 0; idx < DELTA_SIZE; idx++){
+		seed = seed * 1103515245 + 12345;
+		image[idx] = seed >> 16;
+	}
+}
+
+/**
+ * 和主机端记录比较:第一次全部写入,之后只写修改的部分
+ */
+static void test_delta_record(){
+	uint64_t written;
+	unsigned long memWrites;
+	fillImage(1);
+	memset(target->memory + DELTA_BASE - 0x10, 0x5A, DELTA_SIZE + 0x20);
+	// 开头和结尾都不对齐
+	assert(ahbAp->Interface.Memory.DeltaWrite(ahbAp, DELTA_BASE + 1, DELTA_SIZE - 2, image + 1, DeltaSource_Record, &written) == ADI_SUCCESS);
+	assert(written == DELTA_SIZE - 2);
+	assert(memcmp(target->memory + DELTA_BASE + 1, image + 1, DELTA_SIZE - 2) == 0);
+	assert(target->memory[DELTA_BASE] == 0x5A && target->memory[DELTA_BASE + DELTA_SIZE - 1] == 0x5A);
+	// 没有修改时不写
+	memWrites = target->memWrites;
+	assert(ahbAp->Interface.Memory.DeltaWrite(ahbAp, DELTA_BASE + 1, DELTA_SIZE - 2, image + 1, DeltaSource_Record, &written) == ADI_SUCCESS);
+	assert(written == 0);
+	assert(target->memWrites == memWrites);
+	// 零散的修改:第一个字节,窗口边界两侧,间隔很小的两处合并成一段,最后一个字节
+	image[1] ^= 0xFF;
+	image[0x10000 - 1] ^= 0xFF;
+	image[0x10000] ^= 0xFF;
+	image[0x18000] ^= 0xFF;
+	image[0x18010] ^= 0xFF;
+	image[DELTA_SIZE - 2] ^= 0xFF;
+	memWrites = target->memWrites;
+	assert(ahbAp->Interface.Memory.DeltaWrite(ahbAp, DELTA_BASE + 1, DELTA_SIZE - 2, image + 1, DeltaSource_Record, &written) == ADI_SUCCESS);
+	assert(written > 0 && written < 64);
+	assert(target->memWrites - memWrites < 32);
+	assert(memcmp(target->memory + DELTA_BASE + 1, image + 1, DELTA_SIZE - 2) == 0);
+	assert(target->memory[DELTA_BASE] == 0x5A && target->memory[DELTA_BASE + DELTA_SIZE - 1] == 0x5A);
+	// 其他写操作修改过的地方不能信任记录
+	assert(ahbAp->Interface.Memory.Write32(ahbAp, DELTA_BASE + 0x100, 0xDEADBEEF) == ADI_SUCCESS);
+	assert(ahbAp->Interface.Memory.DeltaWrite(ahbAp, DELTA_BASE + 1, DELTA_SIZE - 2, image + 1, DeltaSource_Record, &written) == ADI_SUCCESS);
+	assert(written > 0);
+	assert(memcmp(target->memory + DELTA_BASE + 1, image + 1, DELTA_SIZE - 2) == 0);
+}
+
+/**
+ * 从目标读回比较,目标内存在主机不知道的情况下被修改
+ */
+static void test_delta_target(){
+	uint64_t written;
+	unsigned int idx;
+	fillImage(2);
+	memcpy(target->memory + DELTA_BASE, image, DELTA_SIZE);
+	for(idx = 3; idx < DELTA_SIZE; idx += 0x1003){
+		target->memory[DELTA_BASE + idx] ^= 0xA5;
+	}
+	// 记录和目标一致,按记录比较会漏掉这些修改
+	assert(ahbAp->Interface.Memory.DeltaWrite(ahbAp, DELTA_BASE, DELTA_SIZE, image, DeltaSource_Target, &written) == ADI_SUCCESS);
+	assert(written > 0 && written <= (DELTA_SIZE / 0x1003 + 1) * 4);
+	assert(memcmp(target->memory + DELTA_BASE, image, DELTA_SIZE) == 0);
+	assert(ahbAp->Interface.Memory.DeltaWrite(ahbAp, DELTA_BASE, DELTA_SIZE, image, DeltaSource_Target, &written) == ADI_SUCCESS);
+	assert(written == 0);
+}
+
+/**
+ * 只支持32位访问的AP,不对齐的字节读出所在的字合并后写入
+ */
+static void test_delta_word_only(){
+	uint64_t written;
+	memset(target->memory + DELTA_BASE, 0x0, 0x100);
+	memset(image, 0x0, 0x100);
+	// 不对齐的单个字节
+	image[0x41] = 0x77;
+	assert(apbAp->Interface.Memory.DeltaWrite(apbAp, DELTA_BASE + 0x41, 6, image + 0x41, DeltaSource_Target, &written) == ADI_SUCCESS);
+	assert(written == 3);	// 在数据范围内扩展到字边界
+	assert(target->memory[DELTA_BASE + 0x41] == 0x77);
+	assert(target->memory[DELTA_BASE + 0x40] == 0x0 && target->memory[DELTA_BASE + 0x42] == 0x0);
+	// 开头和结尾都不对齐,中间整字
+	target->memory[DELTA_BASE + 0x3F] = 0xEE;
+	target->memory[DELTA_BASE + 0x50] = 0xEE;
+	memset(image + 0x43, 0x33, 10);
+	assert(apbAp->Interface.Memory.DeltaWrite(apbAp, DELTA_BASE + 0x41, 0xF, image + 0x41, DeltaSource_Target, &written) == ADI_SUCCESS);
+	assert(memcmp(target->memory + DELTA_BASE + 0x41, image + 0x41, 0xF) == 0);
+	assert(target->memory[DELTA_BASE + 0x3F] == 0xEE && target->memory[DELTA_BASE + 0x50] == 0xEE);
+}
+
+int main(){
+	log_set_level(LOG_FATAL);
+	setenv("SMARTOCD_NO_CACHE", "1", 1);	// 不读写AP表的磁盘缓存
+	adapterObj = FakeAdapter_Create(&target);
+	assert(adapterObj != NULL);
+	dapObj = ADIv5_CreateDap(adapterObj);
+	assert(dapObj != NULL);
+	assert(dapObj->FindAccessPort(dapObj, AccessPort_Memory, Bus_AMBA_AHB, &ahbAp) == ADI_SUCCESS);
+	assert(dapObj->FindAccessPort(dapObj, AccessPort_Memory, Bus_AMBA_APB, &apbAp) == ADI_SUCCESS);
+	test(delta_record);
+	test(delta_target);
+	test(delta_word_only);
+	ADIv5_DestoryDap(&dapObj);
+	FakeAdapter_Destroy(&adapterObj);
+	puts("... \x1b[32m100%\x1b[0m\n");
+	return 0;
+}
@@ -0,0 +1,291 @@
+/*
+ * fake_adapter.c
+ *
+ *  Created on: 2019-7-20
+ *      Author: virusv
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "smart_ocd.h"
+#include "misc/log.h"
+#include "arch/ARM/ADI/include/ADIv5.h"
+#include "fake_adapter.h"
+
+#define FAKE_QUEUE_SIZE	(1 << 16)
+
+// 队列中的一个动作
+struct fakeOp {
+	BOOL write;
+	enum dapRegType type;
+	int reg;
+	int count;
+	uint32_t value;	// 单次写的值
+	uint32_t *data;	// 读的目的地址或者连续写的数据
+};
+
+struct fakeAdapter {
+	struct adapter adapterInterface;
+	struct fakeTarget target;
+	struct fakeOp queue[FAKE_QUEUE_SIZE];
+	int queueLen;
+	pthread_mutex_t holdMutex;
+	pthread_cond_t holdCond;
+	BOOL hold;
+	BOOL waiting;	// 有线程阻塞在DapCommit中
+};
+
+#define GET_FAKE(adapter) container_of((adapter), struct fakeAdapter, adapterInterface)
+
+static struct fakeAp *currentAp(struct fakeTarget *target){
+	unsigned int apSel = target->select >> 24;
+	return apSel < FAKE_AP_COUNT ? &target->ap[apSel] : NULL;
+}
+
+/**
+ * DRW访问,按CSW的大小和TAR的字节通道读写内存
+ */
+static int accessDrw(struct fakeTarget *target, struct fakeAp *ap, BOOL write, uint32_t *data){
+	unsigned int size = 1u << (ap->csw & 0x7);
+	unsigned int addrInc = (ap->csw >> 4) & 0x3;
+	uint32_t addr = ap->tar, value = 0, next;
+	unsigned int pos, lane;
+	if(addrInc == 2){	// packed传输每次传一个字
+		size = 4;
+	}
+	if(addr >= FAKE_MEMORY_SIZE || FAKE_MEMORY_SIZE - addr < size){
+		target->stickyErr = TRUE;
+		return -1;
+	}
+	for(pos = 0; pos < size; pos++){
+		lane = addrInc == 2 ? pos : (addr + pos) & 0x3;
+		if(write){
+			target->memory[addr + pos] = (*data >> (lane * 8)) & 0xFF;
+		}else{
+			value |= (uint32_t)target->memory[addr + pos] << (lane * 8);
+		}
+	}
+	if(write){
+		target->memWrites++;
+	}else{
+		*data = value;
+		target->memReads++;
+	}
+	if(addrInc != 0){
+		// 自增只改变回绕边界以内的低位
+		next = addr + size;
+		ap->tar = (addr & ~(target->tarWrap - 1)) | (next & (target->tarWrap - 1));
+	}
+	return 0;
+}
+
+static int apAccess(struct fakeTarget *target, BOOL write, int reg, uint32_t *data){
+	struct fakeAp *ap = currentAp(target);
+	unsigned int addr = (target->select & 0xF0) | (reg & 0xC);
+	if(target->stickyErr){
+		return -1;
+	}
+	if(ap == NULL){	// 不存在的AP读出0
+		if(!write) *data = 0;
+		return 0;
+	}
+	switch(addr){
+	case 0x00:
+		if(write){
+			target->cswWrites++;
+			// 只支持32位访问的AP:SIZE固定为32位,不支持packed传输
+			ap->csw = *data;
+			if(!ap->lessWord){
+				ap->csw = (ap->csw & ~0x7u) | 0x2;
+				if(((ap->csw >> 4) & 0x3) == 2) ap->csw &= ~0x30u;
+			}
+		}else{
+			*data = ap->csw;
+		}
+		return 0;
+	case 0x04:
+		if(write) ap->tar = *data; else *data = ap->tar;
+		return 0;
+	case 0x0C:
+		return accessDrw(target, ap, write, data);
+	case 0xF4:
+		if(!write) *data = ap->cfg;
+		return 0;
+	case 0xF8:
+		if(!write) *data = ap->base;
+		return 0;
+	case 0xFC:
+		if(!write) *data = ap->idr;
+		return 0;
+	default:
+		if(!write) *data = 0;
+		return 0;
+	}
+}
+
+static int dpAccess(struct fakeTarget *target, BOOL write, int reg, uint32_t *data){
+	switch(reg & 0xC){
+	case DP_REG_DPIDR:	// 写是ABORT
+		if(write){
+			if(*data & DP_ABORT_STKERRCLR) target->stickyErr = FALSE;
+		}else{
+			*data = target->dpidr;
+		}
+		return 0;
+	case DP_REG_CTRL_STAT:
+		if(!write){
+			// 上电请求总是立即应答
+			*data = 0xF0000000 | (target->stickyErr ? 0x20 : 0);
+		}
+		return 0;
+	case DP_REG_SELECT:
+		if(write) target->select = *data; else *data = 0;
+		return 0;
+	default:
+		if(!write) *data = 0;
+		return 0;
+	}
+}
+
+static int enqueue(Adapter self, BOOL write, enum dapRegType type, int reg, int count, uint32_t value, uint32_t *data){
+	struct fakeAdapter *fake = GET_FAKE(self);
+	struct fakeOp *op;
+	if(fake->queueLen == FAKE_QUEUE_SIZE){
+		return ADPT_ERR_INTERNAL_ERROR;
+	}
+	op = &fake->queue[fake->queueLen++];
+	op->write = write;
+	op->type = type;
+	op->reg = reg;
+	op->count = count;
+	op->value = value;
+	op->data = data;
+	return ADPT_SUCCESS;
+}
+
+static int singleRead(Adapter self, enum dapRegType type, int reg, uint32_t *data){
+	return enqueue(self, FALSE, type, reg, 1, 0, data);
+}
+
+static int singleWrite(Adapter self, enum dapRegType type, int reg, uint32_t data){
+	return enqueue(self, TRUE, type, reg, 1, data, NULL);
+}
+
+static int multiRead(Adapter self, enum dapRegType type, int reg, int count, uint32_t *data){
+	return enqueue(self, FALSE, type, reg, count, 0, data);
+}
+
+static int multiWrite(Adapter self, enum dapRegType type, int reg, int count, uint32_t *data){
+	return enqueue(self, TRUE, type, reg, count, 0, data);
+}
+
+static int commit(Adapter self){
+	struct fakeAdapter *fake = GET_FAKE(self);
+	struct fakeTarget *target = &fake->target;
+	struct fakeOp *op;
+	int pos, idx, result = ADPT_SUCCESS;
+	uint32_t value;
+	pthread_mutex_lock(&fake->holdMutex);
+	if(fake->hold && fake->waiting){
+		// 暂停期间只有一个线程可以访问Adapter,第二个线程进来说明调用者没有做互斥
+		pthread_mutex_unlock(&fake->holdMutex);
+		log_error("Concurrent access to the fake adapter.");
+		return ADPT_ERR_INTERNAL_ERROR;
+	}
+	fake->waiting = TRUE;
+	while(fake->hold){
+		pthread_cond_wait(&fake->holdCond, &fake->holdMutex);
+	}
+	fake->waiting = FALSE;
+	pthread_mutex_unlock(&fake->holdMutex);
+	target->commits++;
+	for(pos = 0; pos < fake->queueLen && result == ADPT_SUCCESS; pos++){
+		op = &fake->queue[pos];
+		for(idx = 0; idx < op->count; idx++){
+			value = op->write ? (op->data ? op->data[idx] : op->value) : 0;
+			target->transfers++;
+			if((op->type == ADPT_DAP_DP_REG ? dpAccess : apAccess)(target, op->write, op->reg, &value) != 0){
+				result = ADPT_FAILED;
+				break;
+			}
+			if(!op->write){
+				op->data[idx] = value;
+			}
+		}
+	}
+	fake->queueLen = 0;
+	return result;
+}
+
+static int cleanPending(Adapter self){
+	GET_FAKE(self)->queueLen = 0;
+	return ADPT_SUCCESS;
+}
+
+static int reset(Adapter self, enum targetResetType type){
+	(void)self;
+	(void)type;
+	return ADPT_SUCCESS;
+}
+
+/**
+ * 创建测试Adapter
+ */
+Adapter FakeAdapter_Create(struct fakeTarget **target){
+	struct fakeAdapter *fake = calloc(1, sizeof(struct fakeAdapter));
+	if(fake == NULL){
+		log_error("Failed to create fake adapter object.");
+		return NULL;
+	}
+	INTERFACE_CONST_INIT(enum transfertMode, fake->adapterInterface.currTransMode, ADPT_MODE_SWD);
+	fake->adapterInterface.Reset = reset;
+	fake->adapterInterface.DapSingleRead = singleRead;
+	fake->adapterInterface.DapSingleWrite = singleWrite;
+	fake->adapterInterface.DapMultiRead = multiRead;
+	fake->adapterInterface.DapMultiWrite = multiWrite;
+	fake->adapterInterface.DapCommit = commit;
+	fake->adapterInterface.DapCleanPending = cleanPending;
+	pthread_mutex_init(&fake->holdMutex, NULL);
+	pthread_cond_init(&fake->holdCond, NULL);
+	fake->target.dpidr = 0x2BA01477;
+	fake->target.tarWrap = 1024;
+	// AP0:AHB MEM-AP,ROM Table在0x000F0000
+	fake->target.ap[0].idr = 0x24770011;
+	fake->target.ap[0].base = 0x000F0003;
+	fake->target.ap[0].csw = 0x23000040;
+	fake->target.ap[0].lessWord = TRUE;
+	// AP1:APB MEM-AP,没有ROM Table
+	fake->target.ap[1].idr = 0x44770002;
+	fake->target.ap[1].base = 0x00000002;
+	fake->target.ap[1].csw = 0x80000042;
+	fake->target.ap[1].lessWord = FALSE;
+	if(target){
+		*target = &fake->target;
+	}
+	return &fake->adapterInterface;
+}
+
+/**
+ * 释放测试Adapter
+ */
+void FakeAdapter_Destroy(Adapter *adapter){
+	struct fakeAdapter *fake = GET_FAKE(*adapter);
+	pthread_mutex_destroy(&fake->holdMutex);
+	pthread_cond_destroy(&fake->holdCond);
+	free(fake);
+	*adapter = NULL;
+}
+
+/**
+ * 暂停/恢复DapCommit
+ */
+void FakeAdapter_Hold(Adapter adapter, BOOL hold){
+	struct fakeAdapter *fake = GET_FAKE(adapter);
+	pthread_mutex_lock(&fake->holdMutex);
+	fake->hold = hold;
+	pthread_cond_broadcast(&fake->holdCond);
+	pthread_mutex_unlock(&fake->holdMutex);
+}
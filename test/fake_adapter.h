@@ -0,0 +1,60 @@
+/*
+ * fake_adapter.h
+ *
+ *  Created on: 2019-7-20
+ *      Author: virusv
+ */
+
+#ifndef TEST_FAKE_ADAPTER_H_
+#define TEST_FAKE_ADAPTER_H_
+
+#include "smart_ocd.h"
+#include "adapter/include/adapter.h"
+
+/**
+ * 测试用的SWD Adapter,在主机内存中模拟一个DP和两个MEM-AP
+ * AP0:AHB MEM-AP,支持8/16位访问;AP1:APB MEM-AP,只支持32位访问
+ * 两个AP访问同一块从0开始的内存,超出范围的访问置位STICKYERR
+ */
+#define FAKE_MEMORY_SIZE	(1u << 20)
+#define FAKE_AP_COUNT	2
+
+struct fakeAp {
+	uint32_t idr, cfg, base;
+	uint32_t csw, tar;
+	BOOL lessWord;	// 是否支持8/16位访问
+};
+
+struct fakeTarget {
+	uint32_t dpidr, select;
+	uint32_t tarWrap;	// TAR自增的回绕边界
+	BOOL stickyErr;
+	struct fakeAp ap[FAKE_AP_COUNT];
+	uint8_t memory[FAKE_MEMORY_SIZE];
+	// 统计
+	unsigned long commits;	// DapCommit的次数
+	unsigned long transfers;	// DP/AP寄存器的访问次数
+	unsigned long memReads, memWrites;	// DRW的读写次数
+	unsigned long cswWrites;	// CSW的写次数
+};
+
+/**
+ * FakeAdapter_Create - 创建测试Adapter
+ * 参数:
+ * 	target:返回模拟目标的状态,测试直接读写其中的内存和统计
+ */
+Adapter FakeAdapter_Create(struct fakeTarget **target);
+
+/**
+ * FakeAdapter_Destroy - 释放测试Adapter
+ */
+void FakeAdapter_Destroy(Adapter *adapter);
+
+/**
+ * FakeAdapter_Hold - 暂停/恢复DapCommit
+ * 暂停时DapCommit阻塞到恢复,用来让异步任务保持在未完成状态;
+ * 暂停期间第二个线程调用DapCommit时返回错误,用来发现没有互斥的访问
+ */
+void FakeAdapter_Hold(Adapter adapter, BOOL hold);
+
+#endif /* TEST_FAKE_ADAPTER_H_ */
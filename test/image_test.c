@@ -0,0 +1,225 @@
+/*
+ * image_test.c
+ *
+ *  Created on: 2019-7-21
+ *      Author: virusv
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <elf.h>
+
+#include "smart_ocd.h"
+#include "misc/log.h"
+#include "misc/image.h"
+
+/**
+ * 镜像加载测试:Intel HEX、ELF和二进制文件
+ * image.c没有实现Motorola S-record,所以这里没有SREC的测试
+ */
+
+#define test(fn) \
+	puts("... \x1b[33m" # fn "\x1b[0m"); \
+	test_##fn();
+
+static char dirPath[] = "/tmp/image_test.XXXXXX";
+static char filePath[128];
+
+/**
+ * 在临时目录中写一个文件
+ * 返回:
+ * 	文件路径
+ */
+static const char *writeFile(const char *name, const void *data, size_t size){
+	FILE *file;
+	size_t written;
+	snprintf(filePath, sizeof(filePath), "%s/%s", dirPath, name);
+	file = fopen(filePath, "wb");
+	assert(file != NULL);
+	written = fwrite(data, 1, size, file);
+	assert(written == size);
+	fclose(file);
+	return filePath;
+}
+
+/**
+ * 生成一条HEX记录,追加到out
+ */
+static void hexRecord(char *out, uint8_t type, uint16_t addr, const uint8_t *data, uint8_t len){
+	uint8_t sum = len + (addr >> 8) + (addr & 0xFF) + type;
+	unsigned int idx;
+	out += strlen(out);
+	out += sprintf(out, ":%02X%04X%02X", len, addr, type);
+	for(idx = 0; idx < len; idx++){
+		out += sprintf(out, "%02X", data[idx]);
+		sum += data[idx];
+	}
+	sprintf(out, "%02X\r\n", (uint8_t)(0u - sum));
+}
+
+static void fillPattern(uint8_t *data, size_t size, uint8_t seed){
+	size_t idx;
+	for(idx = 0; idx < size; idx++){
+		data[idx] = (uint8_t)(seed + idx * 7);
+	}
+}
+
+static void test_image_binary(){
+	uint8_t data[300];
+	Image image;
+	fillPattern(data, sizeof(data), 1);
+	image = image_Load(writeFile("firmware.bin", data, sizeof(data)), ImageFormat_Auto, 0x08000000);
+	assert(image != NULL);
+	assert(image->format == ImageFormat_Binary);
+	assert(image->segmentCount == 1);
+	assert(image->segments[0].addr == 0x08000000);
+	assert(image->segments[0].size == sizeof(data));
+	assert(memcmp(image->segments[0].data, data, sizeof(data)) == 0);
+	assert(image->entry == 0);
+	image_Free(&image);
+	assert(image == NULL);
+	// .bin扩展名的文件即使以':'开头也按二进制加载
+	data[0] = ':';
+	image = image_Load(writeFile("colon.bin", data, sizeof(data)), ImageFormat_Auto, 0);
+	assert(image != NULL && image->format == ImageFormat_Binary);
+	image_Free(&image);
+}
+
+static void test_image_hex(){
+	static char text[4096];
+	uint8_t data[64], addr[4];
+	const struct imageSegment *seg;
+	Image image;
+	fillPattern(data, sizeof(data), 3);
+	text[0] = '\0';
+	// 0x08000000开始的两条连续记录
+	addr[0] = 0x08; addr[1] = 0x00;
+	hexRecord(text, 0x04, 0, addr, 2);
+	hexRecord(text, 0x00, 0x0000, data, 16);
+	hexRecord(text, 0x00, 0x0010, data + 16, 16);
+	// 偏移越过64KB的记录进位到高16位,和下一个扩展线性地址之后的记录连成一段
+	hexRecord(text, 0x00, 0xFFF8, data, 16);
+	addr[0] = 0x08; addr[1] = 0x01;
+	hexRecord(text, 0x04, 0, addr, 2);
+	hexRecord(text, 0x00, 0x0008, data + 16, 8);
+	// 扩展段地址下偏移在段内回绕
+	addr[0] = 0x10; addr[1] = 0x00;	// 段0x1000,基地址0x10000
+	hexRecord(text, 0x02, 0, addr, 2);
+	hexRecord(text, 0x00, 0xFFFC, data + 32, 8);
+	// 起始线性地址
+	addr[0] = 0x08; addr[1] = 0x00; addr[2] = 0x01; addr[3] = 0x01;
+	hexRecord(text, 0x05, 0, addr, 4);
+	hexRecord(text, 0x01, 0, NULL, 0);
+	image = image_Load(writeFile("firmware.hex", text, strlen(text)), ImageFormat_Auto, 0);
+	assert(image != NULL);
+	assert(image->format == ImageFormat_IntelHex);
+	assert(image->entry == 0x08000101);
+	assert(image->segmentCount == 4);
+	seg = image->segments;
+	// 段回绕拆出来的两段:0x10000开始4字节,0x1FFFC开始4字节
+	assert(seg[0].addr == 0x10000 && seg[0].size == 4);
+	assert(memcmp(seg[0].data, data + 36, 4) == 0);
+	assert(seg[1].addr == 0x1FFFC && seg[1].size == 4);
+	assert(memcmp(seg[1].data, data + 32, 4) == 0);
+	assert(seg[2].addr == 0x08000000 && seg[2].size == 32);
+	assert(memcmp(seg[2].data, data, 32) == 0);
+	assert(seg[3].addr == 0x0800FFF8 && seg[3].size == 24);
+	assert(memcmp(seg[3].data, data, 24) == 0);
+	image_Free(&image);
+
+	// 校验和错误
+	text[0] = '\0';
+	hexRecord(text, 0x00, 0x0000, data, 4);
+	text[strlen(text) - 3] ^= 0x1;
+	assert(image_Load(writeFile("bad.hex", text, strlen(text)), ImageFormat_Auto, 0) == NULL);
+	// 重叠的记录
+	text[0] = '\0';
+	hexRecord(text, 0x00, 0x0000, data, 8);
+	hexRecord(text, 0x00, 0x0004, data, 8);
+	hexRecord(text, 0x01, 0, NULL, 0);
+	assert(image_Load(writeFile("overlap.hex", text, strlen(text)), ImageFormat_Auto, 0) == NULL);
+}
+
+static void test_image_elf(){
+	static uint8_t file[1024];
+	Elf32_Ehdr *ehdr = (Elf32_Ehdr *)file;
+	Elf32_Phdr *phdr = (Elf32_Phdr *)(file + sizeof(Elf32_Ehdr));
+	uint8_t *payload = file + 0x100;
+	Image image;
+	memset(file, 0x0, sizeof(file));
+	fillPattern(payload, 0x80, 5);
+	memcpy(ehdr->e_ident, ELFMAG, SELFMAG);
+	ehdr->e_ident[EI_CLASS] = ELFCLASS32;
+	ehdr->e_ident[EI_DATA] = ELFDATA2LSB;
+	ehdr->e_ident[EI_VERSION] = EV_CURRENT;
+	ehdr->e_type = ET_EXEC;
+	ehdr->e_machine = EM_ARM;
+	ehdr->e_version = EV_CURRENT;
+	ehdr->e_entry = 0x08000041;
+	ehdr->e_phoff = sizeof(Elf32_Ehdr);
+	ehdr->e_ehsize = sizeof(Elf32_Ehdr);
+	ehdr->e_phentsize = sizeof(Elf32_Phdr);
+	ehdr->e_phnum = 4;
+	// .text:加载到LMA 0x08000000
+	phdr[0].p_type = PT_LOAD;
+	phdr[0].p_offset = 0x100;
+	phdr[0].p_vaddr = 0x08000000;
+	phdr[0].p_paddr = 0x08000000;
+	phdr[0].p_filesz = 0x40;
+	phdr[0].p_memsz = 0x40;
+	// .data:VMA在RAM,LMA紧跟.text,加载后和.text合并成一段
+	phdr[1].p_type = PT_LOAD;
+	phdr[1].p_offset = 0x140;
+	phdr[1].p_vaddr = 0x20000000;
+	phdr[1].p_paddr = 0x08000040;
+	phdr[1].p_filesz = 0x40;
+	phdr[1].p_memsz = 0x40;
+	// .bss:只占内存,不加载
+	phdr[2].p_type = PT_LOAD;
+	phdr[2].p_offset = 0x180;
+	phdr[2].p_vaddr = 0x20000040;
+	phdr[2].p_paddr = 0x20000040;
+	phdr[2].p_filesz = 0;
+	phdr[2].p_memsz = 0x100;
+	// 不是PT_LOAD的段
+	phdr[3].p_type = PT_NOTE;
+	phdr[3].p_offset = 0x100;
+	phdr[3].p_paddr = 0x30000000;
+	phdr[3].p_filesz = 0x10;
+	image = image_Load(writeFile("firmware.elf", file, 0x180), ImageFormat_Auto, 0x1234);
+	assert(image != NULL);
+	assert(image->format == ImageFormat_Elf);
+	assert(image->entry == 0x08000041);
+	assert(image->segmentCount == 1);
+	assert(image->segments[0].addr == 0x08000000);
+	assert(image->segments[0].size == 0x80);
+	assert(memcmp(image->segments[0].data, payload, 0x80) == 0);
+	image_Free(&image);
+
+	// 段超出文件
+	phdr[1].p_filesz = 0x1000;
+	assert(image_Load(writeFile("truncated.elf", file, 0x180), ImageFormat_Auto, 0) == NULL);
+	// 大端的ELF
+	phdr[1].p_filesz = 0x40;
+	ehdr->e_ident[EI_DATA] = ELFDATA2MSB;
+	assert(image_Load(writeFile("big.elf", file, 0x180), ImageFormat_Auto, 0) == NULL);
+}
+
+int main(){
+	log_set_level(LOG_FATAL);	// 错误用例会打印错误日志
+	if(mkdtemp(dirPath) == NULL){
+		printf("Failed to create %s.\n", dirPath);
+		return 1;
+	}
+	test(image_binary);
+	test(image_hex);
+	test(image_elf);
+	snprintf(filePath, sizeof(filePath), "rm -rf %s", dirPath);
+	if(system(filePath) != 0){
+		printf("Failed to remove %s.\n", dirPath);
+	}
+	puts("... \x1b[32m100%\x1b[0m\n");
+	return 0;
+}
@@ -0,0 +1,124 @@
+/*
+ * profile_test.c
+ *
+ *  Created on: 2019-7-21
+ *      Author: virusv
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "smart_ocd.h"
+#include "misc/log.h"
+#include "api/api.h"
+#include "fake_adapter.h"
+
+extern void RegisterApi_Buffer(lua_State *L);
+extern void RegisterApi_Async(lua_State *L);
+extern void RegisterApi_ADIv5(lua_State *L);
+extern void RegisterApi_Profiler(lua_State *L);
+
+#define FAKE_ADAPTER_LUA_OBJECT_TYPE "adapter.Fake"
+
+/**
+ * 采样线程运行期间,同步接口和异步接口都要抛出错误;Wait、Stop之后恢复正常
+ * 两个核心在同一个Adapter上,只占用一次
+ */
+static const char *script =
+	"local adiv5 = require('ADIv5')\n"
+	"local profiler = require('Profiler')\n"
+	"local dap = adiv5.Create(FakeAdapter)\n"
+	"local ahb = dap:FindAccessPort(adiv5.AP_Memory, adiv5.Bus_AMBA_AHB)\n"
+	"local apb = dap:FindAccessPort(adiv5.AP_Memory, adiv5.Bus_AMBA_APB)\n"
+	"ahb:Memory32(0x100, 0x12345678)\n"
+	"local prof = profiler.New()\n"
+	"prof:AddCore(ahb, 'edpcsr', 0x1000)\n"
+	"prof:AddCore(apb, 'edpcsr', 0x2000)\n"
+	"local function checkBusy()\n"
+	"	local calls = {\n"
+	"		ReadMemory = function() return dap:ReadMemory(0x100, 4) end,\n"
+	"		Memory32 = function() return ahb:Memory32(0x100) end,\n"
+	"		ApbMemory32 = function() return apb:Memory32(0x100) end,\n"
+	"		BlockRead = function() return ahb:BlockRead(0x100, adiv5.AddrInc_Single, adiv5.DataSize_32, 1) end,\n"
+	"		AddCore = function() return profiler.New():AddCore(ahb) end,\n"
+	"		BlockReadAsync = function()\n"
+	"			local co = coroutine.create(function()\n"
+	"				return ahb:BlockReadAsync(0x100, adiv5.AddrInc_Single, adiv5.DataSize_32, 1)\n"
+	"			end)\n"
+	"			local ok, err = coroutine.resume(co)\n"
+	"			if not ok then error(err) end\n"
+	"			return err\n"
+	"		end,\n"
+	"	}\n"
+	"	for name, call in pairs(calls) do\n"
+	"		local ok, err = pcall(call)\n"
+	"		assert(not ok and tostring(err):find('busy'), name .. ' did not reject the busy adapter: ' .. tostring(err))\n"
+	"	end\n"
+	"end\n"
+	// 一直采样直到Stop
+	"prof:Start()\n"
+	"checkBusy()\n"
+	"prof:Stop()\n"
+	"assert(ahb:Memory32(0x100) == 0x12345678)\n"
+	// 定时采样,Wait之后释放
+	"prof:Start(20)\n"
+	"checkBusy()\n"
+	"prof:Wait()\n"
+	"assert(ahb:Memory32(0x100) == 0x12345678)\n"
+	// 定时采样结束之后没有Wait也可以重新启动
+	"prof:Start(1)\n"
+	"while prof:Stats().running do end\n"
+	"checkBusy()\n"
+	"prof:Start()\n"
+	"checkBusy()\n"
+	"prof:Stop()\n"
+	"local co = coroutine.create(function()\n"
+	"	return ahb:BlockReadAsync(0x100, adiv5.AddrInc_Single, adiv5.DataSize_32, 4)\n"
+	"end)\n"
+	"local ok, job = coroutine.resume(co)\n"
+	"assert(ok and job)\n"
+	"job:Wait()\n"
+	"local ok, data = coroutine.resume(co)\n"
+	"assert(ok and string.unpack('<I4', data) == 0x12345678)\n"
+	// 运行中回收对象时释放
+	"prof:Start()\n"
+	"prof = nil\n"
+	"collectgarbage()\n"
+	"assert(ahb:Memory32(0x100) == 0x12345678)\n";
+
+int main(){
+	lua_State *L;
+	Adapter adapterObj;
+	int result;
+	log_set_level(LOG_INFO);
+	setenv("SMARTOCD_NO_CACHE", "1", 1);	// 不读写AP表的磁盘缓存
+	adapterObj = FakeAdapter_Create(NULL);
+	if(adapterObj == NULL){
+		return 1;
+	}
+	L = luaL_newstate();
+	if(L == NULL){
+		log_fatal("cannot create state: not enough memory.");
+		return 1;
+	}
+	luaL_openlibs(L);
+	RegisterApi_Buffer(L);
+	RegisterApi_Async(L);
+	RegisterApi_ADIv5(L);
+	RegisterApi_Profiler(L);
+	// Adapter对象
+	*CAST(Adapter *, lua_newuserdata(L, sizeof(Adapter))) = adapterObj;
+	luaL_newmetatable(L, FAKE_ADAPTER_LUA_OBJECT_TYPE);
+	lua_setmetatable(L, -2);
+	lua_setglobal(L, "FakeAdapter");
+
+	result = luaL_dostring(L, script);
+	if(result != LUA_OK){
+		log_error("%s", lua_tostring(L, -1));
+	}else{
+		log_info("Profiler busy check test passed.");
+	}
+	lua_close(L);
+	FakeAdapter_Destroy(&adapterObj);
+	return result == LUA_OK ? 0 : 1;
+}
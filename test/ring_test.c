@@ -0,0 +1,129 @@
+/*
+ * ring_test.c
+ *
+ *  Created on: 2019-7-21
+ *      Author: virusv
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "smart_ocd.h"
+#include "misc/log.h"
+#include "misc/ring.h"
+
+#define test(fn) \
+	puts("... \x1b[33m" # fn "\x1b[0m"); \
+	test_##fn();
+
+#define THREAD_RECORDS	200000u
+
+struct record {
+	uint32_t seq;
+	uint32_t check;
+};
+
+static void test_ring_capacity(){
+	RingBuffer ring = Ring_Create(sizeof(struct record), 5);
+	assert(ring != NULL);
+	assert(Ring_Capacity(ring) == 8);	// 向上取整到2的幂
+	assert(Ring_Count(ring) == 0);
+	Ring_Destroy(&ring);
+	assert(ring == NULL);
+}
+
+/**
+ * 读写位置多次越过缓冲区末尾,批量读写拆成两段复制
+ */
+static void test_ring_wrap(){
+	RingBuffer ring = Ring_Create(sizeof(struct record), 8);
+	struct record in[8], out[8];
+	uint32_t next = 0, expect = 0;
+	unsigned int round, idx, count;
+	for(round = 0; round < 100; round++){
+		// 每轮写5条读5条,位置在末尾的不同偏移处回绕
+		for(idx = 0; idx < 5; idx++){
+			in[idx].seq = next++;
+			in[idx].check = ~in[idx].seq;
+		}
+		assert(Ring_Push(ring, in, 5) == 5);
+		assert(Ring_Count(ring) == 5);
+		count = Ring_Pop(ring, out, 8);
+		assert(count == 5);
+		for(idx = 0; idx < count; idx++, expect++){
+			assert(out[idx].seq == expect && out[idx].check == ~expect);
+		}
+	}
+	// 满时只写入能放下的部分
+	for(idx = 0; idx < 8; idx++){
+		in[idx].seq = next + idx;
+		in[idx].check = ~in[idx].seq;
+	}
+	assert(Ring_Push(ring, in, 6) == 6);
+	assert(Ring_Push(ring, in + 6, 2) == 2);
+	assert(Ring_Push(ring, in, 1) == 0);
+	assert(Ring_Count(ring) == 8);
+	// 分两次读出
+	assert(Ring_Pop(ring, out, 3) == 3);
+	assert(Ring_Pop(ring, out + 3, 8) == 5);
+	assert(memcmp(in, out, sizeof(in)) == 0);
+	assert(Ring_Pop(ring, out, 8) == 0);
+	Ring_Destroy(&ring);
+}
+
+static void *producer(void *arg){
+	RingBuffer ring = arg;
+	struct record batch[7];
+	uint32_t next = 0;
+	unsigned int idx, count, pushed, once;
+	while(next < THREAD_RECORDS){
+		count = THREAD_RECORDS - next < 7 ? THREAD_RECORDS - next : 7;
+		for(idx = 0; idx < count; idx++){
+			batch[idx].seq = next + idx;
+			batch[idx].check = ~batch[idx].seq;
+		}
+		// 满时让出CPU,重试剩下的部分
+		for(pushed = 0; pushed < count; pushed += once){
+			once = Ring_Push(ring, batch + pushed, count - pushed);
+			if(once == 0) sched_yield();
+		}
+		next += count;
+	}
+	return NULL;
+}
+
+/**
+ * 一个生产者线程和一个消费者线程同时读写,记录不丢失、不重复、不乱序
+ */
+static void test_ring_spsc(){
+	RingBuffer ring = Ring_Create(sizeof(struct record), 64);
+	struct record out[13];
+	uint32_t expect = 0;
+	unsigned int idx, count;
+	pthread_t thread;
+	assert(ring != NULL);
+	if(pthread_create(&thread, NULL, producer, ring) != 0){
+		assert(0);
+	}
+	while(expect < THREAD_RECORDS){
+		count = Ring_Pop(ring, out, 13);
+		if(count == 0) sched_yield();
+		for(idx = 0; idx < count; idx++, expect++){
+			assert(out[idx].seq == expect && out[idx].check == ~expect);
+		}
+	}
+	pthread_join(thread, NULL);
+	assert(Ring_Count(ring) == 0);
+	Ring_Destroy(&ring);
+}
+
+int main(){
+	test(ring_capacity);
+	test(ring_wrap);
+	test(ring_spsc);
+	puts("... \x1b[32m100%\x1b[0m\n");
+	return 0;
+}
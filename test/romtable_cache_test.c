@@ -0,0 +1,229 @@
+/*
+ * romtable_cache_test.c
+ *
+ *  Created on: 2019-7-21
+ *      Author: virusv
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+
+#include "smart_ocd.h"
+#include "misc/log.h"
+#include "arch/ARM/ADI/include/ADIv5.h"
+#include "fake_adapter.h"
+
+/**
+ * ROM Table磁盘缓存测试:遍历的结果写入缓存,下次连接时一次提交验证后从缓存读取,
+ * 根ROM Table的表项变化时缓存失效,重新遍历
+ */
+
+#define test(fn) \
+	puts("... \x1b[33m" # fn "\x1b[0m"); \
+	test_##fn();
+
+#define ROM_BASE	0xF0000u	// AP0的BASE寄存器指向这里
+
+static Adapter adapterObj;
+static struct fakeTarget *target;
+static char cacheDir[] = "/tmp/smartocd_romtable_XXXXXX";
+
+static void putWord(uint32_t addr, uint32_t value){
+	memcpy(target->memory + addr, &value, 4);
+}
+
+/**
+ * 在4KB块的末尾写入组件的ID寄存器
+ */
+static void putComponent(uint32_t idBase, uint8_t componentClass, uint64_t pid, uint32_t devArch, uint8_t devType){
+	unsigned int idx;
+	for(idx = 0; idx < 4; idx++){
+		putWord(idBase + 0xFE0 + (idx << 2), (pid >> (idx << 3)) & 0xFF);
+		putWord(idBase + 0xFD0 + (idx << 2), (pid >> ((idx + 4) << 3)) & 0xFF);
+	}
+	putWord(idBase + 0xFF0, 0x0D);
+	putWord(idBase + 0xFF4, componentClass << 4);
+	putWord(idBase + 0xFF8, 0x05);
+	putWord(idBase + 0xFFC, 0xB1);
+	putWord(idBase + 0xFBC, devArch);
+	putWord(idBase + 0xFCC, devType);
+}
+
+/**
+ * 根ROM Table:0xF1000的CoreSight组件,0xF2000的下级ROM Table,一个不存在的表项
+ * 下级ROM Table:0xF3000的组件,0xF4000开始占8KB的组件
+ */
+static void buildRomTable(void){
+	memset(target->memory + ROM_BASE, 0x0, 0x10000);
+	putComponent(ROM_BASE, 0x1, 0x04000BB4C4ull, 0, 0x1);
+	putWord(ROM_BASE + 0x0, 0x00001003);
+	putWord(ROM_BASE + 0x4, 0x00002003);
+	putWord(ROM_BASE + 0x8, 0x00005002);	// 不存在
+	putWord(ROM_BASE + 0xC, 0x0);
+	putComponent(ROM_BASE + 0x1000, 0x9, 0x04000BB002ull, 0x47701A02, 0x0);	// DWT
+	putComponent(ROM_BASE + 0x2000, 0x1, 0x04000BB4C3ull, 0, 0x1);
+	putWord(ROM_BASE + 0x2000, 0x00001003);
+	putWord(ROM_BASE + 0x2004, 0x00003003);
+	putWord(ROM_BASE + 0x2008, 0x0);
+	putComponent(ROM_BASE + 0x3000, 0x9, 0x04000BB00Cull, 0x0, 0x13);
+	putComponent(ROM_BASE + 0x5000, 0x9, 0x14000BB925ull, 0x0, 0x11);	// PID4.SIZE = 1
+}
+
+static void checkComponent(const struct coresightComponent *comp, uint64_t base, uint64_t size,
+		uint8_t componentClass, uint16_t partNumber, unsigned int childCount){
+	assert(comp->valid);
+	assert(comp->base == base && comp->size == size);
+	assert(comp->componentClass == componentClass);
+	assert(comp->partNumber == partNumber);
+	assert(comp->designer == 0x23B);	// ARM
+	assert(comp->childCount == childCount);
+}
+
+/**
+ * 两棵组件树完全相同
+ */
+static void compareTree(const struct coresightComponent *a, const struct coresightComponent *b){
+	unsigned int idx;
+	assert(a->base == b->base && a->size == b->size);
+	assert(a->cid == b->cid && a->pid == b->pid);
+	assert(a->devArch == b->devArch && a->devType == b->devType);
+	assert(a->componentClass == b->componentClass && a->partNumber == b->partNumber);
+	assert(a->designer == b->designer && a->revision == b->revision && a->valid == b->valid);
+	assert(a->childCount == b->childCount);
+	for(idx = 0; idx < a->childCount; idx++){
+		compareTree(&a->children[idx], &b->children[idx]);
+	}
+}
+
+static void freeTree(struct coresightComponent *comp){
+	unsigned int idx;
+	for(idx = 0; idx < comp->childCount; idx++){
+		freeTree(&comp->children[idx]);
+	}
+	free(comp->children);
+}
+
+/**
+ * 复制组件树,DAP销毁时原来的树会被释放
+ */
+static void copyTree(struct coresightComponent *dst, const struct coresightComponent *src){
+	unsigned int idx;
+	*dst = *src;
+	dst->children = NULL;
+	if(src->childCount == 0) return;
+	dst->children = calloc(src->childCount, sizeof(struct coresightComponent));
+	assert(dst->children != NULL);
+	for(idx = 0; idx < src->childCount; idx++){
+		copyTree(&dst->children[idx], &src->children[idx]);
+	}
+}
+
+/**
+ * 新建一个DAP连接读取ROM Table
+ * 参数:
+ * 	copy:返回组件树的副本
+ * 	commits:返回读取ROM Table用的提交次数
+ */
+static void readRomTable(struct coresightComponent *copy, unsigned long *commits){
+	const struct coresightComponent *root, *again;
+	DAP dapObj = ADIv5_CreateDap(adapterObj);
+	AccessPort ahbAp;
+	assert(dapObj != NULL);
+	assert(dapObj->FindAccessPort(dapObj, AccessPort_Memory, Bus_AMBA_AHB, &ahbAp) == ADI_SUCCESS);
+	*commits = target->commits;
+	assert(dapObj->ReadRomTable(dapObj, ahbAp, &root) == ADI_SUCCESS);
+	*commits = target->commits - *commits;
+	// 同一个连接中再次读取直接返回AP持有的树
+	assert(dapObj->ReadRomTable(dapObj, ahbAp, &again) == ADI_SUCCESS);
+	assert(again == root);
+	copyTree(copy, root);
+	ADIv5_DestoryDap(&dapObj);
+}
+
+/**
+ * 第一次遍历写入缓存,第二次只用一次提交验证,读出的树和遍历的结果一致
+ */
+static void test_romtable_cache_round_trip(){
+	struct coresightComponent walked, cached;
+	unsigned long commits;
+	struct dirent *entry;
+	BOOL found = FALSE;
+	DIR *dir;
+	buildRomTable();
+	readRomTable(&walked, &commits);
+	assert(commits > 1);
+	checkComponent(&walked, ROM_BASE, 0x1000, 0x1, 0x4C4, 2);
+	checkComponent(&walked.children[0], ROM_BASE + 0x1000, 0x1000, 0x9, 0x002, 0);
+	assert(walked.children[0].devArch == 0x47701A02);
+	checkComponent(&walked.children[1], ROM_BASE + 0x2000, 0x1000, 0x1, 0x4C3, 2);
+	checkComponent(&walked.children[1].children[0], ROM_BASE + 0x3000, 0x1000, 0x9, 0x00C, 0);
+	assert(walked.children[1].children[0].devType == 0x13);
+	checkComponent(&walked.children[1].children[1], ROM_BASE + 0x4000, 0x2000, 0x9, 0x925, 0);
+	// 缓存文件已经写入
+	dir = opendir(cacheDir);
+	assert(dir != NULL);
+	while((entry = readdir(dir)) != NULL){
+		if(strncmp(entry->d_name, "romtable-", 9) == 0) found = TRUE;
+	}
+	closedir(dir);
+	assert(found);
+
+	readRomTable(&cached, &commits);
+	assert(commits == 1);
+	compareTree(&walked, &cached);
+	freeTree(&walked);
+	freeTree(&cached);
+}
+
+/**
+ * 根ROM Table的表项或ID变化时缓存失效,重新遍历并更新缓存
+ */
+static void test_romtable_cache_stale(){
+	struct coresightComponent walked, cached;
+	unsigned long commits;
+	buildRomTable();
+	readRomTable(&walked, &commits);
+	freeTree(&walked);
+	// 不存在的表项变成0xF6000的组件
+	putWord(ROM_BASE + 0x8, 0x00006003);
+	putComponent(ROM_BASE + 0x6000, 0x9, 0x04000BB00Eull, 0x0, 0x0);
+	readRomTable(&walked, &commits);
+	assert(commits > 1);
+	assert(walked.childCount == 3);
+	checkComponent(&walked.children[2], ROM_BASE + 0x6000, 0x1000, 0x9, 0x00E, 0);
+	readRomTable(&cached, &commits);
+	assert(commits == 1);
+	compareTree(&walked, &cached);
+	freeTree(&cached);
+	// 根组件的PID变化
+	putComponent(ROM_BASE, 0x1, 0x04000BB4C5ull, 0, 0x1);
+	readRomTable(&cached, &commits);
+	assert(commits > 1);
+	assert(cached.partNumber == 0x4C5 && cached.childCount == 3);
+	freeTree(&walked);
+	freeTree(&cached);
+}
+
+int main(){
+	char command[64];
+	log_set_level(LOG_FATAL);
+	unsetenv("SMARTOCD_NO_CACHE");
+	if(mkdtemp(cacheDir) == NULL){
+		printf("Failed to create %s.\n", cacheDir);
+		return 1;
+	}
+	setenv("SMARTOCD_CACHE_DIR", cacheDir, 1);	// 缓存写到临时目录
+	adapterObj = FakeAdapter_Create(&target);
+	assert(adapterObj != NULL);
+	test(romtable_cache_round_trip);
+	test(romtable_cache_stale);
+	FakeAdapter_Destroy(&adapterObj);
+	snprintf(command, sizeof(command), "rm -rf %s", cacheDir);
+	if(system(command) != 0){
+		printf("Failed to remove %s.\n", cacheDir);
+	}
+	puts("... \x1b[32m100%\x1b[0m\n");
+	return 0;
+}
@@ -0,0 +1,135 @@
+/*
+ * scan_test.c
+ *
+ *  Created on: 2019-7-21
+ *      Author: virusv
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "smart_ocd.h"
+#include "misc/log.h"
+#include "arch/ARM/ADI/include/ADIv5.h"
+#include "fake_adapter.h"
+
+/**
+ * 内存扫描测试:分块读取的扫描结果和在主机内存中逐字节比较的结果一致
+ */
+
+#define test(fn) \
+	puts("... \x1b[33m" # fn "\x1b[0m"); \
+	test_##fn();
+
+#define SCAN_BASE	0x10000u
+#define SCAN_SIZE	0x40000u	// 跨越多个64KB的块
+
+static Adapter adapterObj;
+static struct fakeTarget *target;
+static DAP dapObj;
+static AccessPort ahbAp;
+
+/**
+ * 逐字节比较的参考实现
+ */
+static BOOL referenceMatch(uint64_t pos, const uint8_t *pattern, const uint8_t *mask, unsigned int patternLen){
+	unsigned int idx;
+	for(idx = 0; idx < patternLen; idx++){
+		uint8_t byteMask = mask ? mask[idx] : 0xFF;
+		if((target->memory[pos + idx] & byteMask) != (pattern[idx] & byteMask)) return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * 扫描并和参考实现比较
+ * 返回:
+ * 	匹配数
+ */
+static unsigned int checkScan(uint64_t addr, uint64_t len, const uint8_t *pattern, const uint8_t *mask, unsigned int patternLen, unsigned int align){
+	MemScan scan;
+	uint64_t where, pos = addr;
+	unsigned int matches = 0;
+	assert(ahbAp->Interface.Memory.Scan(ahbAp, addr, len, pattern, mask, patternLen, align, &scan) == ADI_SUCCESS);
+	while(ADIv5_ScanNext(scan, &where) == ADI_SUCCESS){
+		// 中间没有遗漏的匹配
+		for(; pos < where; pos++){
+			assert((pos & (align - 1)) || !referenceMatch(pos, pattern, mask, patternLen));
+		}
+		assert((where & (align - 1)) == 0);
+		assert(where + patternLen <= addr + len);
+		assert(referenceMatch(where, pattern, mask, patternLen));
+		pos = where + 1;
+		matches++;
+	}
+	for(; pos + patternLen <= addr + len; pos++){
+		assert((pos & (align - 1)) || !referenceMatch(pos, pattern, mask, patternLen));
+	}
+	// 结束之后一直返回没有匹配
+	assert(ADIv5_ScanNext(scan, &where) == ADI_FAILED);
+	ADIv5_ScanClose(&scan);
+	assert(scan == NULL);
+	return matches;
+}
+
+static void test_scan_random(){
+	static const uint8_t pattern[] = {0x01, 0x02, 0x03};
+	static const uint8_t mask[] = {0xFF, 0x00, 0x03};
+	uint32_t seed = 12345;
+	unsigned int idx;
+	// 只用4种字节,匹配足够多
+	for(idx = 0; idx < SCAN_SIZE; idx++){
+		seed = seed * 1103515245 + 12345;
+		target->memory[SCAN_BASE + idx] = (seed >> 16) & 0x3;
+	}
+	assert(checkScan(SCAN_BASE, SCAN_SIZE, pattern, NULL, sizeof(pattern), 1) > 1000);
+	assert(checkScan(SCAN_BASE, SCAN_SIZE, pattern, mask, sizeof(pattern), 1) > 1000);
+	assert(checkScan(SCAN_BASE, SCAN_SIZE, pattern, NULL, sizeof(pattern), 4) > 100);
+	assert(checkScan(SCAN_BASE, SCAN_SIZE, pattern, NULL, 1, 8) > 100);
+	// 开头和结尾不对齐
+	assert(checkScan(SCAN_BASE + 3, SCAN_SIZE - 6, pattern, NULL, sizeof(pattern), 1) > 1000);
+	assert(checkScan(SCAN_BASE + 1, 5, pattern, NULL, sizeof(pattern), 1) <= 3);
+	// 全部不比较的掩码,每个位置都匹配
+	assert(checkScan(SCAN_BASE + 2, 0x101, pattern, (const uint8_t *)"\0\0\0", sizeof(pattern), 2) == 0x80);
+}
+
+/**
+ * 跨越块边界的匹配不丢失,每块一次提交
+ */
+static void test_scan_chunk_boundary(){
+	static const uint8_t pattern[] = "smartocd scan pattern";
+	uint64_t where, boundary = SCAN_BASE + (64u << 10);
+	unsigned long commits;
+	MemScan scan;
+	memset(target->memory + SCAN_BASE, 0x0, SCAN_SIZE);
+	memcpy(target->memory + boundary - 7, pattern, sizeof(pattern));
+	memcpy(target->memory + SCAN_BASE + SCAN_SIZE - sizeof(pattern), pattern, sizeof(pattern));
+	commits = target->commits;
+	assert(ahbAp->Interface.Memory.Scan(ahbAp, SCAN_BASE, SCAN_SIZE, pattern, NULL, sizeof(pattern), 1, &scan) == ADI_SUCCESS);
+	assert(ADIv5_ScanNext(scan, &where) == ADI_SUCCESS && where == boundary - 7);
+	assert(ADIv5_ScanNext(scan, &where) == ADI_SUCCESS && where == SCAN_BASE + SCAN_SIZE - sizeof(pattern));
+	assert(ADIv5_ScanNext(scan, &where) == ADI_FAILED);
+	ADIv5_ScanClose(&scan);
+	assert(target->commits - commits == SCAN_SIZE / (64u << 10));
+	// 参数检查
+	assert(ahbAp->Interface.Memory.Scan(ahbAp, SCAN_BASE, SCAN_SIZE, pattern, NULL, 0, 1, &scan) == ADI_ERR_BAD_PARAMETER);
+	assert(ahbAp->Interface.Memory.Scan(ahbAp, SCAN_BASE, SCAN_SIZE, pattern, NULL, 1, 3, &scan) == ADI_ERR_BAD_PARAMETER);
+	assert(ahbAp->Interface.Memory.Scan(ahbAp, ~0ull, 2, pattern, NULL, 1, 1, &scan) == ADI_ERR_BAD_PARAMETER);
+}
+
+int main(){
+	log_set_level(LOG_FATAL);
+	setenv("SMARTOCD_NO_CACHE", "1", 1);	// 不读写AP表的磁盘缓存
+	adapterObj = FakeAdapter_Create(&target);
+	assert(adapterObj != NULL);
+	dapObj = ADIv5_CreateDap(adapterObj);
+	assert(dapObj != NULL);
+	assert(dapObj->FindAccessPort(dapObj, AccessPort_Memory, Bus_AMBA_AHB, &ahbAp) == ADI_SUCCESS);
+	test(scan_random);
+	test(scan_chunk_boundary);
+	ADIv5_DestoryDap(&dapObj);
+	FakeAdapter_Destroy(&adapterObj);
+	puts("... \x1b[32m100%\x1b[0m\n");
+	return 0;
+}
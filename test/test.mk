@@ -5,3 +5,4 @@ endif
 TEST_INC_PATHS += $(ROOT_DIR)/test
 # TEST_SRC_FILES += $(wildcard $(ROOT_DIR)/test/*.c)
 TEST_SRC_FILES += $(ROOT_DIR)/test/misc.c
+TEST_SRC_FILES += $(ROOT_DIR)/test/fake_adapter.c
@@ -0,0 +1,110 @@
+/*
+ * watch_test.c
+ *
+ *  Created on: 2019-7-21
+ *      Author: virusv
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "smart_ocd.h"
+#include "misc/log.h"
+#include "api/api.h"
+#include "fake_adapter.h"
+
+extern void RegisterApi_Buffer(lua_State *L);
+extern void RegisterApi_Async(lua_State *L);
+extern void RegisterApi_ADIv5(lua_State *L);
+extern void RegisterApi_Watch(lua_State *L);
+
+#define FAKE_ADAPTER_LUA_OBJECT_TYPE "adapter.Fake"
+
+/**
+ * 监视线程运行期间,同步接口和异步接口都要抛出错误;Stop之后恢复正常
+ */
+static const char *script =
+	"local adiv5 = require('ADIv5')\n"
+	"local watch = require('Watch')\n"
+	"local dap = adiv5.Create(FakeAdapter)\n"
+	"local ap = dap:FindAccessPort(adiv5.AP_Memory, adiv5.Bus_AMBA_AHB)\n"
+	"ap:Memory32(0x100, 0x12345678)\n"
+	"local w = watch.New(ap, 1000)\n"
+	"w:Add(0x100, 4)\n"
+	"local other = watch.New(ap, 1000)\n"
+	"other:Add(0x104, 4)\n"
+	"w:Start()\n"
+	"local calls = {\n"
+	"	FindAccessPort = function() return dap:FindAccessPort(adiv5.AP_Memory) end,\n"
+	"	ReadMemory = function() return dap:ReadMemory(0x100, 4) end,\n"
+	"	Memory32 = function() return ap:Memory32(0x100) end,\n"
+	"	BlockRead = function() return ap:BlockRead(0x100, adiv5.AddrInc_Single, adiv5.DataSize_32, 1) end,\n"
+	"	Fill = function() return ap:Fill(0x100, 4) end,\n"
+	"	WatchNew = function() return watch.New(ap, 1000) end,\n"
+	"	WatchStart = function() return other:Start() end,\n"
+	"	BlockReadAsync = function()\n"
+	"		local co = coroutine.create(function()\n"
+	"			return ap:BlockReadAsync(0x100, adiv5.AddrInc_Single, adiv5.DataSize_32, 1)\n"
+	"		end)\n"
+	"		local ok, err = coroutine.resume(co)\n"
+	"		if not ok then error(err) end\n"
+	"		return err\n"
+	"	end,\n"
+	"}\n"
+	"for name, call in pairs(calls) do\n"
+	"	local ok, err = pcall(call)\n"
+	"	assert(not ok and tostring(err):find('busy'), name .. ' did not reject the busy adapter: ' .. tostring(err))\n"
+	"end\n"
+	"w:Stop()\n"
+	"assert(ap:Memory32(0x100) == 0x12345678)\n"
+	"local co = coroutine.create(function()\n"
+	"	return ap:BlockReadAsync(0x100, adiv5.AddrInc_Single, adiv5.DataSize_32, 4)\n"
+	"end)\n"
+	"local ok, job = coroutine.resume(co)\n"
+	"assert(ok and job)\n"
+	"job:Wait()\n"
+	"local ok, data = coroutine.resume(co)\n"
+	"assert(ok and string.unpack('<I4', data) == 0x12345678)\n"
+	// 重新启动之后再次占用,回收对象时释放
+	"w:Start()\n"
+	"assert(not pcall(ap.Memory32, ap, 0x100))\n"
+	"w = nil\n"
+	"collectgarbage()\n"
+	"assert(ap:Memory32(0x100) == 0x12345678)\n";
+
+int main(){
+	lua_State *L;
+	Adapter adapterObj;
+	int result;
+	log_set_level(LOG_INFO);
+	setenv("SMARTOCD_NO_CACHE", "1", 1);	// 不读写AP表的磁盘缓存
+	adapterObj = FakeAdapter_Create(NULL);
+	if(adapterObj == NULL){
+		return 1;
+	}
+	L = luaL_newstate();
+	if(L == NULL){
+		log_fatal("cannot create state: not enough memory.");
+		return 1;
+	}
+	luaL_openlibs(L);
+	RegisterApi_Buffer(L);
+	RegisterApi_Async(L);
+	RegisterApi_ADIv5(L);
+	RegisterApi_Watch(L);
+	// Adapter对象
+	*CAST(Adapter *, lua_newuserdata(L, sizeof(Adapter))) = adapterObj;
+	luaL_newmetatable(L, FAKE_ADAPTER_LUA_OBJECT_TYPE);
+	lua_setmetatable(L, -2);
+	lua_setglobal(L, "FakeAdapter");
+
+	result = luaL_dostring(L, script);
+	if(result != LUA_OK){
+		log_error("%s", lua_tostring(L, -1));
+	}else{
+		log_info("Watch busy check test passed.");
+	}
+	lua_close(L);
+	FakeAdapter_Destroy(&adapterObj);
+	return result == LUA_OK ? 0 : 1;
+}
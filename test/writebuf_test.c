@@ -0,0 +1,153 @@
+/*
+ * writebuf_test.c
+ *
+ *  Created on: 2019-7-21
+ *      Author: virusv
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "smart_ocd.h"
+#include "misc/log.h"
+#include "arch/ARM/ADI/include/ADIv5.h"
+#include "fake_adapter.h"
+
+/**
+ * 写合并缓冲区测试
+ * AHB AP支持8/16位访问,零散的写合并成对齐的写;APB AP只支持32位访问,不完整的字先读出来补齐(mergeWords)
+ */
+
+#define test(fn) \
+	puts("... \x1b[33m" # fn "\x1b[0m"); \
+	test_##fn();
+
+static Adapter adapterObj;
+static struct fakeTarget *target;
+static DAP dapObj;
+static AccessPort ahbAp, apbAp;
+
+static uint32_t memory32(uint32_t addr){
+	uint32_t value;
+	memcpy(&value, target->memory + addr, 4);
+	return value;
+}
+
+/**
+ * 区间内的写在退出时一次提交,重叠的字节用后写的数据
+ */
+static void test_writebuf_combine(){
+	static const uint8_t expect[] = {0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0xAA, 0xBB, 0x99};
+	unsigned long commits, memWrites;
+	uint32_t value;
+	int idx;
+	memset(target->memory + 0x1000, 0xEE, 0x100);
+	assert(ahbAp->Interface.Memory.WriteCombine(ahbAp, TRUE) == ADI_SUCCESS);
+	// 嵌套的区间
+	assert(ahbAp->Interface.Memory.WriteCombine(ahbAp, TRUE) == ADI_SUCCESS);
+	commits = target->commits;
+	assert(ahbAp->Interface.Memory.Write32(ahbAp, 0x1004, 0x88776655) == ADI_SUCCESS);
+	assert(ahbAp->Interface.Memory.Write8(ahbAp, 0x1000, 0x11) == ADI_SUCCESS);
+	assert(ahbAp->Interface.Memory.Write8(ahbAp, 0x1001, 0x22) == ADI_SUCCESS);
+	assert(ahbAp->Interface.Memory.Write16(ahbAp, 0x1002, 0x4433) == ADI_SUCCESS);
+	assert(ahbAp->Interface.Memory.Write16(ahbAp, 0x1006, 0xBBAA) == ADI_SUCCESS);	// 覆盖前面的字
+	assert(ahbAp->Interface.Memory.Write8(ahbAp, 0x1008, 0x99) == ADI_SUCCESS);
+	// 不同的页
+	assert(ahbAp->Interface.Memory.Write32(ahbAp, 0x2000, 0xCAFEBABE) == ADI_SUCCESS);
+	assert(ahbAp->Interface.Memory.WriteCombine(ahbAp, FALSE) == ADI_SUCCESS);
+	// 还在外层区间内,没有提交
+	assert(target->commits == commits);
+	assert(target->memory[0x1000] == 0xEE);
+	memWrites = target->memWrites;
+	assert(ahbAp->Interface.Memory.WriteCombine(ahbAp, FALSE) == ADI_SUCCESS);
+	assert(target->commits == commits + 1);
+	// 0x1000~0x1008:两个字用Block写,结尾1个字节;0x2000:一个字
+	assert(target->memWrites - memWrites == 4);
+	assert(memcmp(target->memory + 0x1000, expect, sizeof(expect)) == 0);
+	assert(target->memory[0x1009] == 0xEE);
+	assert(memory32(0x2000) == 0xCAFEBABE);
+	// 不在区间内时直接写
+	assert(ahbAp->Interface.Memory.Write8(ahbAp, 0x1009, 0x5A) == ADI_SUCCESS);
+	assert(target->memory[0x1009] == 0x5A);
+	assert(ahbAp->Interface.Memory.WriteCombine(ahbAp, FALSE) == ADI_ERR_BAD_PARAMETER);
+	// 读缓冲区中的地址时先提交
+	assert(ahbAp->Interface.Memory.WriteCombine(ahbAp, TRUE) == ADI_SUCCESS);
+	assert(ahbAp->Interface.Memory.Write32(ahbAp, 0x1010, 0x01020304) == ADI_SUCCESS);
+	assert(ahbAp->Interface.Memory.Read32(ahbAp, 0x1010, &value) == ADI_SUCCESS);
+	assert(value == 0x01020304);
+	// FlushWrites
+	for(idx = 0; idx < 4; idx++){
+		assert(ahbAp->Interface.Memory.Write8(ahbAp, 0x1020 + idx, 0xA0 + idx) == ADI_SUCCESS);
+	}
+	assert(memory32(0x1020) == 0xEEEEEEEE);
+	commits = target->commits;
+	memWrites = target->memWrites;
+	assert(ahbAp->Interface.Memory.FlushWrites(ahbAp) == ADI_SUCCESS);
+	assert(target->commits == commits + 1);
+	assert(target->memWrites - memWrites == 1);	// 4个字节合并成一个字
+	assert(memory32(0x1020) == 0xA3A2A1A0);
+	assert(ahbAp->Interface.Memory.WriteCombine(ahbAp, FALSE) == ADI_SUCCESS);
+}
+
+/**
+ * 设备内存的写不合并,写之前提交缓冲区
+ */
+static void test_writebuf_device(){
+	assert(ahbAp->Interface.Memory.AddDeviceRegion(ahbAp, 0x3000, 0x100) == ADI_SUCCESS);
+	memset(target->memory + 0x3000, 0x0, 0x100);
+	assert(ahbAp->Interface.Memory.WriteCombine(ahbAp, TRUE) == ADI_SUCCESS);
+	assert(ahbAp->Interface.Memory.Write32(ahbAp, 0x1030, 0x12345678) == ADI_SUCCESS);
+	assert(memory32(0x1030) != 0x12345678);
+	assert(ahbAp->Interface.Memory.Write32(ahbAp, 0x3000, 0x1) == ADI_SUCCESS);
+	assert(memory32(0x3000) == 0x1);
+	assert(memory32(0x1030) == 0x12345678);
+	assert(ahbAp->Interface.Memory.WriteCombine(ahbAp, FALSE) == ADI_SUCCESS);
+}
+
+/**
+ * 只支持32位访问的AP,字节和半字写把所在字的其他字节从目标读出来补齐
+ */
+static void test_writebuf_merge_words(){
+	unsigned long memReads, memWrites;
+	memcpy(target->memory + 0x4000, "\x01\x02\x03\x04\x05\x06\x07\x08\x09\x0A\x0B\x0C", 12);
+	assert(apbAp->Interface.Memory.WriteCombine(apbAp, TRUE) == ADI_SUCCESS);
+	memReads = target->memReads;
+	// 第一次写字节时读出整个字
+	assert(apbAp->Interface.Memory.Write8(apbAp, 0x4001, 0xA1) == ADI_SUCCESS);
+	assert(target->memReads - memReads == 1);
+	// 同一个字已经补齐,不再读
+	assert(apbAp->Interface.Memory.Write16(apbAp, 0x4002, 0xB3B2) == ADI_SUCCESS);
+	assert(target->memReads - memReads == 1);
+	// 整字写不需要读
+	assert(apbAp->Interface.Memory.Write32(apbAp, 0x4004, 0xC7C6C5C4) == ADI_SUCCESS);
+	assert(target->memReads - memReads == 1);
+	// 下一个字的最后一个字节
+	assert(apbAp->Interface.Memory.Write8(apbAp, 0x400B, 0xDB) == ADI_SUCCESS);
+	assert(target->memReads - memReads == 2);
+	// 提交之前目标没有变化
+	assert(memcmp(target->memory + 0x4000, "\x01\x02\x03\x04\x05\x06\x07\x08\x09\x0A\x0B\x0C", 12) == 0);
+	memWrites = target->memWrites;
+	assert(apbAp->Interface.Memory.WriteCombine(apbAp, FALSE) == ADI_SUCCESS);
+	// 三个完整的字,不需要字节写
+	assert(target->memWrites - memWrites == 3);
+	assert(memcmp(target->memory + 0x4000, "\x01\xA1\xB2\xB3\xC4\xC5\xC6\xC7\x09\x0A\x0B\xDB", 12) == 0);
+}
+
+int main(){
+	log_set_level(LOG_FATAL);
+	setenv("SMARTOCD_NO_CACHE", "1", 1);	// 不读写AP表的磁盘缓存
+	adapterObj = FakeAdapter_Create(&target);
+	assert(adapterObj != NULL);
+	dapObj = ADIv5_CreateDap(adapterObj);
+	assert(dapObj != NULL);
+	assert(dapObj->FindAccessPort(dapObj, AccessPort_Memory, Bus_AMBA_AHB, &ahbAp) == ADI_SUCCESS);
+	assert(dapObj->FindAccessPort(dapObj, AccessPort_Memory, Bus_AMBA_APB, &apbAp) == ADI_SUCCESS);
+	test(writebuf_combine);
+	test(writebuf_device);
+	test(writebuf_merge_words);
+	ADIv5_DestoryDap(&dapObj);
+	FakeAdapter_Destroy(&adapterObj);
+	puts("... \x1b[32m100%\x1b[0m\n");
+	return 0;
+}